@@ -178,14 +178,18 @@ CBaseMediaFilter::SetSyncSource(__inout_opt IReferenceClock *pClock)
         pClock->AddRef();
     }
 
-    // if we have a clock, release it
-    if (m_pClock) {
-        m_pClock->Release();
-    }
-
     // Set the new reference clock (might be NULL)
     // Should we query it to ensure it is a clock?  Consider for a debug build.
+    // GetSyncSource doesn't take the filter lock, so swap it under ours
+    m_ClockLock.LockExclusive();
+    IReferenceClock *pOldClock = m_pClock;
     m_pClock = pClock;
+    m_ClockLock.UnlockExclusive();
+
+    // if we had a clock, release it
+    if (pOldClock) {
+        pOldClock->Release();
+    }
 
     return NOERROR;
 }
@@ -196,13 +200,16 @@ CBaseMediaFilter::GetSyncSource(__deref_out_opt IReferenceClock **pClock)
 {
     CheckPointer(pClock,E_POINTER);
     ValidateReadWritePtr(pClock,sizeof(IReferenceClock *));
-    CAutoLock cObjectLock(m_pLock);
 
+    // Not the filter lock - monitoring threads call this while streaming
+    // threads may be holding that
+    m_ClockLock.LockShared();
     if (m_pClock) {
         // returning an interface... addref it...
         m_pClock->AddRef();
     }
     *pClock = (IReferenceClock*)m_pClock;
+    m_ClockLock.UnlockShared();
     return NOERROR;
 }
 
@@ -309,6 +316,8 @@ STDMETHODIMP CBaseFilter::NonDelegatingQueryInterface(REFIID riid,
         return GetInterface((IPersist *) this, ppv);
     } else if (riid == IID_IAMovieSetup) {
         return GetInterface((IAMovieSetup *) this, ppv);
+    } else if (riid == IID_IAMLatencyStatistics) {
+        return GetInterface((IAMLatencyStatistics *) this, ppv);
     } else {
         return CUnknown::NonDelegatingQueryInterface(riid, ppv);
     }
@@ -338,6 +347,7 @@ CBaseFilter::CBaseFilter(__in_opt LPCTSTR pName,
     m_pClock(NULL),
     m_pGraph(NULL),
     m_pSink(NULL),
+    m_pLatency(NULL),
     m_pName(NULL),
     m_PinVersion(1)
 {
@@ -362,6 +372,7 @@ CBaseFilter::CBaseFilter(__in_opt LPCTSTR pName,
     m_pClock(NULL),
     m_pGraph(NULL),
     m_pSink(NULL),
+    m_pLatency(NULL),
     m_pName(NULL),
     m_PinVersion(1)
 {
@@ -385,6 +396,7 @@ CBaseFilter::CBaseFilter(__in_opt LPCSTR pName,
     m_pClock(NULL),
     m_pGraph(NULL),
     m_pSink(NULL),
+    m_pLatency(NULL),
     m_pName(NULL),
     m_PinVersion(1)
 {
@@ -406,6 +418,7 @@ CBaseFilter::CBaseFilter(__in_opt LPCSTR pName,
     m_pClock(NULL),
     m_pGraph(NULL),
     m_pSink(NULL),
+    m_pLatency(NULL),
     m_pName(NULL),
     m_PinVersion(1)
 {
@@ -430,6 +443,7 @@ CBaseFilter::~CBaseFilter()
     // When we did we had the circular reference problem.  Nothing would go away.
 
     delete[] m_pName;
+    delete m_pLatency;
 
     // must be stopped, but can't call Stop here since
     // our critsec has been destroyed.
@@ -476,14 +490,18 @@ CBaseFilter::SetSyncSource(__in_opt IReferenceClock *pClock)
         pClock->AddRef();
     }
 
-    // if we have a clock, release it
-    if (m_pClock) {
-        m_pClock->Release();
-    }
-
     // Set the new reference clock (might be NULL)
     // Should we query it to ensure it is a clock?  Consider for a debug build.
+    // GetSyncSource doesn't take the filter lock, so swap it under ours
+    m_ClockLock.LockExclusive();
+    IReferenceClock *pOldClock = m_pClock;
     m_pClock = pClock;
+    m_ClockLock.UnlockExclusive();
+
+    // if we had a clock, release it
+    if (pOldClock) {
+        pOldClock->Release();
+    }
 
     return NOERROR;
 }
@@ -494,13 +512,16 @@ CBaseFilter::GetSyncSource(__deref_out_opt IReferenceClock **pClock)
 {
     CheckPointer(pClock,E_POINTER);
     ValidateReadWritePtr(pClock,sizeof(IReferenceClock *));
-    CAutoLock cObjectLock(m_pLock);
 
+    // Not the filter lock - monitoring threads call this while streaming
+    // threads may be holding that
+    m_ClockLock.LockShared();
     if (m_pClock) {
         // returning an interface... addref it...
         m_pClock->AddRef();
     }
     *pClock = (IReferenceClock*)m_pClock;
+    m_ClockLock.UnlockShared();
     return NOERROR;
 }
 
@@ -964,6 +985,38 @@ STDMETHODIMP CBaseFilter::Unregister()
 }
 
 
+/* What CAMLatency has recorded for samples leaving us. We have nothing
+   until stamping has been turned on and a stamped sample has left */
+
+STDMETHODIMP
+CBaseFilter::GetLatencyStatistics(
+    AM_LATENCY_KIND Kind,
+    __out AM_LATENCY_STATISTICS *pStats)
+{
+    CheckPointer(pStats, E_POINTER);
+    ZeroMemory(pStats, sizeof(*pStats));
+    if (Kind != AM_LATENCY_FILTER && Kind != AM_LATENCY_TOTAL) {
+        return E_INVALIDARG;
+    }
+
+    CAMLatencyStatistics *pLatency = m_pLatency;
+    if (pLatency == NULL) {
+        return S_FALSE;
+    }
+    return pLatency->Get(Kind, pStats);
+}
+
+STDMETHODIMP
+CBaseFilter::ResetLatencyStatistics()
+{
+    CAMLatencyStatistics *pLatency = m_pLatency;
+    if (pLatency) {
+        pLatency->Reset();
+    }
+    return S_OK;
+}
+
+
 //=====================================================================
 //=====================================================================
 // Implements CEnumPins
@@ -1990,7 +2043,7 @@ CBasePin::CompleteConnect(IPin *pReceivePin)
 HRESULT
 CBasePin::SetMediaType(const CMediaType *pmt)
 {
-    HRESULT hr = m_mt.Set(*pmt);
+    HRESULT hr = SetCurrentMediaType(pmt);
     if (FAILED(hr)) {
         return hr;
     }
@@ -1998,6 +2051,15 @@ CBasePin::SetMediaType(const CMediaType *pmt)
     return NOERROR;
 }
 
+HRESULT
+CBasePin::SetCurrentMediaType(const AM_MEDIA_TYPE *pmt)
+{
+    m_TypeLock.LockExclusive();
+    HRESULT hr = m_mt.Set(*pmt);
+    m_TypeLock.UnlockExclusive();
+    return hr;
+}
+
 
 /* This is called during Connect() to provide a virtual method that can do
    any specific check needed for connection such as QueryInterface. This
@@ -2216,16 +2278,22 @@ CBasePin::ConnectionMediaType(
 {
     CheckPointer(pmt,E_POINTER);
     ValidateReadWritePtr(pmt,sizeof(AM_MEDIA_TYPE));
-    CAutoLock cObjectLock(m_pLock);
+
+    // m_TypeLock rather than the filter lock, so we don't wait for
+    // streaming threads
+    m_TypeLock.LockShared();
 
     /*  Copy constructor of m_mt allocates the memory */
+    HRESULT hr;
     if (IsConnected()) {
         CopyMediaType( pmt, &m_mt );
-        return S_OK;
+        hr = S_OK;
     } else {
         ((CMediaType *)pmt)->InitMediaType();
-        return VFW_E_NOT_CONNECTED;
+        hr = VFW_E_NOT_CONNECTED;
     }
+    m_TypeLock.UnlockShared();
+    return hr;
 }
 
 /* Return information about the filter we are connect to */
@@ -2692,6 +2760,9 @@ CBaseOutputPin::Deliver(IMediaSample * pSample)
     PERFLOG_DELIVER( m_pName ? m_pName : L"CBaseOutputPin", (IPin *) this, (IPin  *) m_pInputPin, pSample, &m_mt );
 #endif // DXMPERF
 
+    m_pFilter->RecordLatency(pSample);
+
+    CAMTraceSpan Span(AM_TRACE_DELIVER, FilterName(), m_pName, pSample);
     return m_pInputPin->Receive(pSample);
 }
 
@@ -2964,6 +3035,14 @@ CBaseInputPin::Receive(IMediaSample *pSample)
     PERFLOG_RECEIVE( m_pName ? m_pName : L"CBaseInputPin", (IPin *) m_Connected, (IPin *) this, pSample, &m_mt );
 #endif // DXMPERF
 
+    if (CAMStreamTrace::IsEnabled()) {
+        LONGLONG llNow = CAMStreamTrace::Now();
+        CAMStreamTrace::Record(AM_TRACE_RECEIVE, FilterName(), m_pName, pSample, llNow, llNow);
+    }
+    if (CAMLatency::IsEnabled()) {
+        CAMLatency::StampArrival(pSample);
+    }
+
 
     /* Check for IMediaSample2 */
     IMediaSample2 *pSample2;
@@ -3269,6 +3348,8 @@ CMediaSample::CMediaSample(__in_opt LPCTSTR pName,
     m_cRef(0),                      // 0 ref count
     m_dwTypeSpecificFlags(0),       // Type specific flags
     m_dwStreamId(AM_STREAM_MEDIA),  // Stream id
+    m_llLatencyOrigin(0),           // Not stamped
+    m_llLatencyArrival(0),
     m_pAllocator(pAllocator)        // Allocator
 {
 #ifdef DXMPERF
@@ -3300,6 +3381,8 @@ CMediaSample::CMediaSample(__in_opt LPCSTR pName,
     m_cRef(0),                      // 0 ref count
     m_dwTypeSpecificFlags(0),       // Type specific flags
     m_dwStreamId(AM_STREAM_MEDIA),  // Stream id
+    m_llLatencyOrigin(0),           // Not stamped
+    m_llLatencyArrival(0),
     m_pAllocator(pAllocator)        // Allocator
 {
 #ifdef DXMPERF
@@ -3335,6 +3418,8 @@ CMediaSample::QueryInterface(REFIID riid, __deref_out void **ppv)
         riid == IID_IMediaSample2 ||
         riid == IID_IUnknown) {
         return GetInterface((IMediaSample *) this, ppv);
+    } else if (riid == IID_IAMSampleLatency) {
+        return GetInterface((IAMSampleLatency *) this, ppv);
     } else {
         *ppv = NULL;
         return E_NOINTERFACE;
@@ -3391,6 +3476,8 @@ CMediaSample::Release()
         m_dwFlags = 0;
         m_dwTypeSpecificFlags = 0;
         m_dwStreamId = AM_STREAM_MEDIA;
+        m_llLatencyOrigin = 0;
+        m_llLatencyArrival = 0;
 
         /* This may cause us to be deleted */
         // Our refcount is reliably 0 thus no-one will mess with us
@@ -3861,6 +3948,32 @@ HRESULT CMediaSample::SetProperties(
     return S_OK;
 }
 
+/*  The stamps CAMLatency carries from filter to filter - not reset until
+    the sample goes back to its allocator
+*/
+
+STDMETHODIMP CMediaSample::GetLatencyStamps(
+    __out LONGLONG *pllOrigin,
+    __out LONGLONG *pllArrival
+)
+{
+    CheckPointer(pllOrigin, E_POINTER);
+    CheckPointer(pllArrival, E_POINTER);
+    *pllOrigin = m_llLatencyOrigin;
+    *pllArrival = m_llLatencyArrival;
+    return S_OK;
+}
+
+STDMETHODIMP CMediaSample::SetLatencyStamps(
+    LONGLONG llOrigin,
+    LONGLONG llArrival
+)
+{
+    m_llLatencyOrigin = llOrigin;
+    m_llLatencyArrival = llArrival;
+    return S_OK;
+}
+
 
 //
 // The streaming thread calls IPin::NewSegment(), IPin::EndOfStream(),
@@ -4542,6 +4655,10 @@ HRESULT CDynamicOutputPin::WaitEvent(HANDLE hEvent)
 //=====================================================================
 //=====================================================================
 
+// {2057263A-E32F-49FB-975B-9D378E05BAEE}
+EXTERN_C const IID IID_IMemAllocatorBatch =
+    { 0x2057263a, 0xe32f, 0x49fb, { 0x97, 0x5b, 0x9d, 0x37, 0x8e, 0x05, 0xba, 0xee } };
+
 
 /* Constructor overrides the default settings for the free list to request
    that it be alertable (ie the list can be cast to a handle which can be
@@ -4566,6 +4683,8 @@ CBaseAllocator::CBaseAllocator(__in_opt LPCTSTR pName,
     m_lPrefix(0),
     m_hSem(NULL),
     m_lWaiting(0),
+    m_bLockFree(FALSE),
+    m_lFreeReserve(0),
     m_fEnableReleaseCallback(fEnableReleaseCallback),
     m_pNotify(NULL)
 {
@@ -4599,6 +4718,8 @@ CBaseAllocator::CBaseAllocator(__in_opt LPCSTR pName,
     m_lPrefix(0),
     m_hSem(NULL),
     m_lWaiting(0),
+    m_bLockFree(FALSE),
+    m_lFreeReserve(0),
     m_fEnableReleaseCallback(fEnableReleaseCallback),
     m_pNotify(NULL)
 {
@@ -4740,31 +4861,40 @@ HRESULT CBaseAllocator::GetBuffer(__deref_out IMediaSample **ppBuffer,
     CMediaSample *pSample;
 
     *ppBuffer = NULL;
-    for (;;)
-    {
-        {  // scope for lock
-            CAutoLock cObjectLock(this);
+    if (m_bLockFree) {
+        LONG cClaimed;
+        HRESULT hr = ClaimBuffersLockFree(1, 1, &cClaimed, dwFlags);
+        if (FAILED(hr)) {
+            return hr;
+        }
+        pSample = DequeueFreeSample();
+    } else {
+        for (;;)
+        {
+            {  // scope for lock
+                CAutoLock cObjectLock(this);
 
-            /* Check we are committed */
-            if (!m_bCommitted) {
-                return VFW_E_NOT_COMMITTED;
-            }
-            pSample = (CMediaSample *) m_lFree.RemoveHead();
-            if (pSample == NULL) {
-                SetWaiting();
+                /* Check we are committed */
+                if (!m_bCommitted) {
+                    return VFW_E_NOT_COMMITTED;
+                }
+                pSample = (CMediaSample *) m_lFree.RemoveHead();
+                if (pSample == NULL) {
+                    SetWaiting();
+                }
             }
-        }
 
-        /* If we didn't get a sample then wait for the list to signal */
+            /* If we didn't get a sample then wait for the list to signal */
 
-        if (pSample) {
-            break;
-        }
-        if (dwFlags & AM_GBF_NOWAIT) {
-            return VFW_E_TIMEOUT;
+            if (pSample) {
+                break;
+            }
+            if (dwFlags & AM_GBF_NOWAIT) {
+                return VFW_E_TIMEOUT;
+            }
+            ASSERT(m_hSem != NULL);
+            WaitForSingleObject(m_hSem, INFINITE);
         }
-        ASSERT(m_hSem != NULL);
-        WaitForSingleObject(m_hSem, INFINITE);
     }
 
     /* Addref the buffer up to one. On release
@@ -4785,6 +4915,94 @@ HRESULT CBaseAllocator::GetBuffer(__deref_out IMediaSample **ppBuffer,
 }
 
 
+// get up to cRequested free samples in one go. Unless AM_GBF_BATCH_ALL is
+// set we only wait for the first one and then take whatever else is free
+// at that moment, so a producer never blocks for samples it could have
+// started filling. Each sample is returned as if from GetBuffer.
+
+STDMETHODIMP
+CBaseAllocator::GetBuffers(LONG cRequested,
+                           __out_ecount_part(cRequested, *pcReturned) IMediaSample **ppBuffers,
+                           __out LONG *pcReturned,
+                           DWORD dwFlags)
+{
+    CheckPointer(ppBuffers, E_POINTER);
+    CheckPointer(pcReturned, E_POINTER);
+    *pcReturned = 0;
+    if (cRequested <= 0) {
+        return E_INVALIDARG;
+    }
+
+    LONG cRequired = (dwFlags & AM_GBF_BATCH_ALL) ? cRequested : 1;
+    LONG cReturned = 0;
+
+    if (m_bLockFree) {
+        if (cRequired > m_lAllocated) {
+            return E_INVALIDARG;
+        }
+        LONG cClaimed;
+        HRESULT hr = ClaimBuffersLockFree(cRequested, cRequired, &cClaimed, dwFlags);
+        if (FAILED(hr)) {
+            return hr;
+        }
+        for (; cReturned < cClaimed; cReturned++) {
+            ppBuffers[cReturned] = PrepareBuffer(DequeueFreeSample());
+        }
+    } else {
+        for (;;)
+        {
+            {  // scope for lock
+                CAutoLock cObjectLock(this);
+
+                /* Check we are committed */
+                if (!m_bCommitted) {
+                    return VFW_E_NOT_COMMITTED;
+                }
+
+                /* We could wait for ever for more samples than there are */
+                if (cRequired > m_lAllocated) {
+                    return E_INVALIDARG;
+                }
+                if (m_lFree.GetCount() >= cRequired) {
+                    CMediaSample *pSample;
+                    while (cReturned < cRequested &&
+                           (pSample = m_lFree.RemoveHead()) != NULL) {
+                        ppBuffers[cReturned++] = PrepareBuffer(pSample);
+                    }
+                    break;
+                }
+                SetWaiting();
+            }
+
+            /* Not enough yet - wait for the list to signal and look again */
+
+            if (dwFlags & AM_GBF_NOWAIT) {
+                return VFW_E_TIMEOUT;
+            }
+            ASSERT(m_hSem != NULL);
+            WaitForSingleObject(m_hSem, INFINITE);
+        }
+    }
+
+    *pcReturned = cReturned;
+    return NOERROR;
+}
+
+// a free sample is about to be handed out by GetBuffers
+
+IMediaSample *
+CBaseAllocator::PrepareBuffer(__in CMediaSample *pSample)
+{
+    ASSERT(pSample->m_cRef == 0);
+    pSample->m_cRef = 1;
+
+#ifdef DXMPERF
+    PERFLOG_GETBUFFER( (IMemAllocator *) this, pSample );
+#endif // DXMPERF
+    return pSample;
+}
+
+
 /* Final release of a CMediaSample will call this */
 
 STDMETHODIMP
@@ -4799,7 +5017,14 @@ CBaseAllocator::ReleaseBuffer(IMediaSample * pSample)
 
 
     BOOL bRelease = FALSE;
-    {
+    if (m_bLockFree) {
+
+        /* Publish the sample before making it claimable */
+
+        EnqueueFreeSample((CMediaSample *)pSample);
+        bRelease = ReturnFreeClaim();
+
+    } else {
         CAutoLock cal(this);
 
         /* Put back on the free list */
@@ -4864,7 +5089,8 @@ CBaseAllocator::GetFreeCount(
 {
     ASSERT(m_fEnableReleaseCallback);
     CAutoLock cObjectLock(this);
-    *plBuffersFree = m_lCount - m_lAllocated + m_lFree.GetCount();
+    *plBuffersFree = m_lCount - m_lAllocated + m_lFree.GetCount() +
+                     (m_bLockFree ? m_lFreeReserve : 0);
     return NOERROR;
 }
 
@@ -4889,10 +5115,6 @@ CBaseAllocator::Commit()
         return NOERROR;
     }
 
-    /* Allow GetBuffer calls */
-
-    m_bCommitted = TRUE;
-
     // is there a pending decommit ? if so, just cancel it
     if (m_bDecommitInProgress) {
         m_bDecommitInProgress = FALSE;
@@ -4901,6 +5123,7 @@ CBaseAllocator::Commit()
         // between Decommit and the last free, so the buffer size cannot have
         // changed. And because some of the buffers are not free yet, he
         // cannot re-alloc anyway.
+        AllowGetBuffer();
         return NOERROR;
     }
 
@@ -4909,13 +5132,42 @@ CBaseAllocator::Commit()
     // actually need to allocate the samples
     HRESULT hr = Alloc();
     if (FAILED(hr)) {
-        m_bCommitted = FALSE;
         return hr;
     }
+
+    // in lock-free mode hand the free samples over to the ring
+    if (m_bLockFree) {
+        ASSERT(m_lFreeReserve == 0);
+        ASSERT(m_lFree.GetCount() == m_lAllocated);
+        hr = m_qFree.Initialize(2 * m_lAllocated);
+        if (FAILED(hr)) {
+            return hr;
+        }
+        CMediaSample *pSample;
+        while ((pSample = m_lFree.RemoveHead()) != NULL) {
+            EXECUTE_ASSERT(m_qFree.Enqueue(pSample));
+        }
+        InterlockedExchange(&m_lFreeReserve, m_lAllocated);
+    }
     AddRef();
+    AllowGetBuffer();
     return NOERROR;
 }
 
+/* Lock-free GetBuffer calls don't take our lock, so we only say we are
+   committed once the samples are ready for them, then wake any that
+   started waiting before we were */
+
+void
+CBaseAllocator::AllowGetBuffer()
+{
+    MemoryBarrier();
+    m_bCommitted = TRUE;
+    if (m_bLockFree) {
+        m_evFree.NotifyAll();
+    }
+}
+
 
 STDMETHODIMP
 CBaseAllocator::Decommit()
@@ -4933,8 +5185,20 @@ CBaseAllocator::Decommit()
         /* No more GetBuffer calls will succeed */
         m_bCommitted = FALSE;
 
-        // are any buffers outstanding?
-        if (m_lFree.GetCount() < m_lAllocated) {
+        if (m_bLockFree) {
+
+            // GetBuffer and ReleaseBuffer don't hold the lock, so flag the
+            // decommit first and then see whether all the samples are
+            // already back - whoever returns the last one finishes it
+
+            m_bDecommitInProgress = TRUE;
+            MemoryBarrier();
+            bRelease = CompleteLockFreeDecommit();
+
+            // wake anyone blocked in GetBuffer so they can fail
+            m_evFree.NotifyAll();
+
+        } else if (m_lFree.GetCount() < m_lAllocated) {
             // please complete the decommit when last buffer is freed
             m_bDecommitInProgress = TRUE;
         } else {
@@ -4988,6 +5252,163 @@ CBaseAllocator::Alloc(void)
     return NOERROR;
 }
 
+/* Select the lock-free free list. This only changes how GetBuffer and
+   ReleaseBuffer manage free samples, so it can be switched whenever the
+   allocator is fully decommitted */
+
+HRESULT
+CBaseAllocator::SetLockFreeMode(BOOL bLockFree)
+{
+    CAutoLock cObjectLock(this);
+    if (m_bCommitted || m_bDecommitInProgress) {
+        return VFW_E_ALREADY_COMMITTED;
+    }
+    m_bLockFree = bLockFree;
+    return NOERROR;
+}
+
+/* Claim between lMin and lMax of the samples on m_qFree without taking
+   the lock. Returns how many were claimed, 0 if fewer than lMin are free */
+
+LONG
+CBaseAllocator::TryClaimFreeSamples(LONG lMax, LONG lMin)
+{
+    ASSERT(lMin >= 1 && lMin <= lMax);
+    for (;;) {
+        LONG lFree = m_lFreeReserve;
+        if (lFree < lMin) {
+            return 0;
+        }
+        LONG lClaim = min(lFree, lMax);
+        if (InterlockedCompareExchange(&m_lFreeReserve, lFree - lClaim, lFree) == lFree) {
+            return lClaim;
+        }
+    }
+}
+
+/* The ring is twice the number of samples so it can never really be full,
+   but a consumer that was preempted just after taking the previous sample
+   from our slot can make it look so for a moment */
+
+void
+CBaseAllocator::EnqueueFreeSample(__in CMediaSample *pSample)
+{
+    for (int iSpin = 0; !m_qFree.Enqueue(pSample); iSpin++) {
+        if (iSpin < 64) {
+            YieldProcessor();
+        } else {
+            SwitchToThread();
+        }
+    }
+}
+
+/* Take a sample we have a claim on. The claim guarantees it has been
+   published but the producer ahead of it in the ring may still be between
+   reserving its slot and filling it in, in which case we wait for it */
+
+CMediaSample *
+CBaseAllocator::DequeueFreeSample()
+{
+    CMediaSample *pSample;
+    for (int iSpin = 0; (pSample = m_qFree.Dequeue()) == NULL; iSpin++) {
+        if (iSpin < 64) {
+            YieldProcessor();
+        } else {
+            SwitchToThread();
+        }
+    }
+    return pSample;
+}
+
+/* Lock-free equivalent of the GetBuffer(s) loop - wait until at least
+   cRequired samples are free and claim up to cRequested of them. Claims
+   that race with Decommit are handed back so that the decommit completes
+   normally */
+
+HRESULT
+CBaseAllocator::ClaimBuffersLockFree(
+    LONG cRequested,
+    LONG cRequired,
+    __out LONG *pcClaimed,
+    DWORD dwFlags)
+{
+    LONG cClaimed;
+    *pcClaimed = 0;
+    for (;;) {
+        if (!m_bCommitted) {
+            return VFW_E_NOT_COMMITTED;
+        }
+        cClaimed = TryClaimFreeSamples(cRequested, cRequired);
+        if (cClaimed != 0) {
+            if (!m_bCommitted) {
+                BOOL bRelease = FALSE;
+                while (cClaimed--) {
+                    bRelease |= ReturnFreeClaim();
+                }
+                if (bRelease) {
+                    Release();
+                }
+                return VFW_E_NOT_COMMITTED;
+            }
+            break;
+        }
+        if (dwFlags & AM_GBF_NOWAIT) {
+            return VFW_E_TIMEOUT;
+        }
+
+        // register before the final check so that a ReleaseBuffer or
+        // Decommit after it is guaranteed to wake us
+        LONG lKey = m_evFree.PrepareWait();
+        if (!m_bCommitted || m_lFreeReserve >= cRequired) {
+            m_evFree.CancelWait(lKey);
+            continue;
+        }
+        m_evFree.Wait(lKey);
+    }
+
+    *pcClaimed = cClaimed;
+    return NOERROR;
+}
+
+/* Make one more sample on m_qFree claimable, wake any waiters, and finish
+   a pending decommit if that was the last one. Returns TRUE if the caller
+   must Release() the allocator reference taken by Commit */
+
+BOOL
+CBaseAllocator::ReturnFreeClaim()
+{
+    InterlockedIncrement(&m_lFreeReserve);
+    m_evFree.NotifyAll();
+
+    if (m_bDecommitInProgress) {
+        CAutoLock cObjectLock(this);
+        return CompleteLockFreeDecommit();
+    }
+    return FALSE;
+}
+
+/* Called with the lock held once a decommit has been requested. If every
+   sample is back, take them all in one step so no GetBuffer can claim
+   one, put them back on m_lFree and let the derived class Free them */
+
+BOOL
+CBaseAllocator::CompleteLockFreeDecommit()
+{
+    ASSERT(CritCheckIn(this));
+    if (!m_bDecommitInProgress ||
+        InterlockedCompareExchange(&m_lFreeReserve, 0, m_lAllocated) != m_lAllocated) {
+        return FALSE;
+    }
+    for (LONG l = 0; l < m_lAllocated; l++) {
+        m_lFree.Add(DequeueFreeSample());
+    }
+    ASSERT(m_qFree.Dequeue() == NULL);
+
+    Free();
+    m_bDecommitInProgress = FALSE;
+    return TRUE;
+}
+
 /*  Implement CBaseAllocator::CSampleList::Remove(pSample)
     Removes pSample from the list
 */
@@ -5022,13 +5443,35 @@ CUnknown *CMemAllocator::CreateInstance(__inout_opt LPUNKNOWN pUnk, __inout HRES
     return pUnkRet;
 }
 
+/* Our GetBuffer and GetBuffers only place a deferred block and then use
+   the CBaseAllocator ones, so GetBuffers is equivalent and can be handed
+   out */
+
+STDMETHODIMP
+CMemAllocator::NonDelegatingQueryInterface(REFIID riid, __deref_out void **ppv)
+{
+    if (riid == IID_IMemAllocatorBatch) {
+        return GetInterface((IMemAllocatorBatch *) this, ppv);
+    } else {
+        return CBaseAllocator::NonDelegatingQueryInterface(riid, ppv);
+    }
+}
+
 CMemAllocator::CMemAllocator(
     __in_opt LPCTSTR pName,
     __inout_opt LPUNKNOWN pUnk,
     __inout HRESULT *phr)
     : CBaseAllocator(pName, pUnk, phr, TRUE, TRUE),
-    m_pBuffer(NULL)
+    m_pBuffer(NULL),
+    m_cbBuffer(0),
+    m_bLargePages(FALSE),
+    m_dwBackingFlags(0),
+    m_dwNumaNode(AM_NUMANODE_CURRENT),
+    m_ppSamples(NULL),
+    m_lAlignedSize(0),
+    m_lPlacePending(FALSE)
 {
+    ZeroMemory(&m_SlabKey, sizeof(m_SlabKey));
 }
 
 #ifdef UNICODE
@@ -5037,8 +5480,16 @@ CMemAllocator::CMemAllocator(
     __inout_opt LPUNKNOWN pUnk,
     __inout HRESULT *phr)
     : CBaseAllocator(pName, pUnk, phr, TRUE, TRUE),
-    m_pBuffer(NULL)
+    m_pBuffer(NULL),
+    m_cbBuffer(0),
+    m_bLargePages(FALSE),
+    m_dwBackingFlags(0),
+    m_dwNumaNode(AM_NUMANODE_CURRENT),
+    m_ppSamples(NULL),
+    m_lAlignedSize(0),
+    m_lPlacePending(FALSE)
 {
+    ZeroMemory(&m_SlabKey, sizeof(m_SlabKey));
 }
 #endif
 
@@ -5131,13 +5582,13 @@ CMemAllocator::Alloc(void)
 
     /* If the requirements haven't changed then don't reallocate */
     if (hr == S_FALSE) {
-        ASSERT(m_pBuffer);
+        ASSERT(m_pBuffer || m_lPlacePending);
         return NOERROR;
     }
     ASSERT(hr == S_OK); // we use this fact in the loop below
 
     /* Free the old resources */
-    if (m_pBuffer) {
+    if (m_pBuffer || m_ppSamples) {
         ReallyFree();
     }
 
@@ -5177,14 +5628,27 @@ CMemAllocator::Alloc(void)
         return E_OUTOFMEMORY;
     }
 
-    m_pBuffer = (PBYTE)VirtualAlloc(NULL,
-                    (LONG)lToAllocate,
-                    MEM_COMMIT,
-                    PAGE_READWRITE);
-
-    if (m_pBuffer == NULL) {
+    m_ppSamples = new CMediaSample *[m_lCount];
+    if (m_ppSamples == NULL) {
         return E_OUTOFMEMORY;
     }
+    m_lAlignedSize = lAlignedSize;
+    m_cbBuffer = (SIZE_T)lToAllocate;
+
+    // If the pages should go where the streaming thread is, rather than
+    // where we are, leave the block to the first GetBuffer
+    BOOL bDefer = (m_dwBackingFlags & AM_MEMALLOC_NUMANODE) ?
+                      m_dwNumaNode == AM_NUMANODE_CURRENT :
+                      (m_dwBackingFlags & AM_MEMALLOC_PREFAULT) != 0;
+    if (!bDefer) {
+        m_pBuffer = AllocBlock(&m_cbBuffer);
+        if (m_pBuffer == NULL) {
+            m_cbBuffer = 0;
+            delete [] m_ppSamples;
+            m_ppSamples = NULL;
+            return E_OUTOFMEMORY;
+        }
+    }
 
     LPBYTE pNext = m_pBuffer;
     CMediaSample *pSample;
@@ -5194,7 +5658,7 @@ CMemAllocator::Alloc(void)
     // Create the new samples - we have allocated m_lSize bytes for each sample
     // plus m_lPrefix bytes per sample as a prefix. We set the pointer to
     // the memory after the prefix - so that GetPointer() will return a pointer
-    // to m_lSize bytes.
+    // to m_lSize bytes. A deferred block gets its pointers in PlaceBlock.
     for (; m_lAllocated < m_lCount; m_lAllocated++, pNext += lAlignedSize) {
 
 
@@ -5202,8 +5666,8 @@ CMemAllocator::Alloc(void)
                             NAME("Default memory media sample"),
                 this,
                             &hr,
-                            pNext + m_lPrefix,      // GetPointer() value
-                            m_lSize);               // not including prefix
+                            bDefer ? NULL : pNext + m_lPrefix,  // GetPointer() value
+                            bDefer ? 0 : m_lSize);  // not including prefix
 
             ASSERT(SUCCEEDED(hr));
         if (pSample == NULL) {
@@ -5212,8 +5676,11 @@ CMemAllocator::Alloc(void)
 
         // This CANNOT fail
         m_lFree.Add(pSample);
+        m_ppSamples[m_lAllocated] = pSample;
     }
 
+    m_lPlacePending = bDefer;
+
     m_bChanged = FALSE;
     return NOERROR;
 }
@@ -5257,15 +5724,253 @@ CMemAllocator::ReallyFree(void)
     }
 
     m_lAllocated = 0;
+    delete [] m_ppSamples;
+    m_ppSamples = NULL;
+    m_lPlacePending = FALSE;
 
     // free the block of buffer memory
     if (m_pBuffer) {
-        EXECUTE_ASSERT(VirtualFree(m_pBuffer, 0, MEM_RELEASE));
+        FreeBlock(m_pBuffer, m_cbBuffer);
         m_pBuffer = NULL;
+        m_cbBuffer = 0;
     }
 }
 
 
+/* Allocate the block Alloc left for the first GetBuffer, on the thread
+   that called it, and point the samples into it. No sample has been
+   handed out yet so none of them can be in use while we do it */
+
+HRESULT
+CMemAllocator::PlaceBlock()
+{
+    CAutoLock lck(this);
+    if (!m_lPlacePending) {
+        return NOERROR;
+    }
+    if (!m_bCommitted) {
+        return VFW_E_NOT_COMMITTED;
+    }
+
+    m_pBuffer = AllocBlock(&m_cbBuffer);
+    if (m_pBuffer == NULL) {
+        return E_OUTOFMEMORY;
+    }
+
+    LPBYTE pNext = m_pBuffer;
+    for (LONG i = 0; i < m_lAllocated; i++, pNext += m_lAlignedSize) {
+        m_ppSamples[i]->SetPointer(pNext + m_lPrefix, m_lSize);
+    }
+
+    // publishes the pointers to the GetBuffer calls that didn't lock
+    InterlockedExchange(&m_lPlacePending, FALSE);
+    return NOERROR;
+}
+
+STDMETHODIMP
+CMemAllocator::GetBuffer(__deref_out IMediaSample **ppBuffer,
+                         __in_opt REFERENCE_TIME *pStartTime,
+                         __in_opt REFERENCE_TIME *pEndTime,
+                         DWORD dwFlags)
+{
+    if (m_lPlacePending) {
+        HRESULT hr = PlaceBlock();
+        if (FAILED(hr)) {
+            *ppBuffer = NULL;
+            return hr;
+        }
+    }
+    return CBaseAllocator::GetBuffer(ppBuffer, pStartTime, pEndTime, dwFlags);
+}
+
+STDMETHODIMP
+CMemAllocator::GetBuffers(LONG cRequested,
+                          __out_ecount_part(cRequested, *pcReturned) IMediaSample **ppBuffers,
+                          __out LONG *pcReturned,
+                          DWORD dwFlags)
+{
+    if (m_lPlacePending) {
+        HRESULT hr = PlaceBlock();
+        if (FAILED(hr)) {
+            CheckPointer(pcReturned, E_POINTER);
+            *pcReturned = 0;
+            return hr;
+        }
+    }
+    return CBaseAllocator::GetBuffers(cRequested, ppBuffers, pcReturned, dwFlags);
+}
+
+
+/* Select the backing store for the buffer block. We only record the
+   choice here, forcing Alloc to get a new block at the next Commit */
+
+HRESULT
+CMemAllocator::SetBackingStore(DWORD dwFlags, DWORD dwNumaNode)
+{
+    if (dwFlags & ~AM_MEMALLOC_VALIDFLAGS) {
+        return E_INVALIDARG;
+    }
+    CAutoLock cObjectLock(this);
+    if (m_bCommitted || m_bDecommitInProgress) {
+        return VFW_E_ALREADY_COMMITTED;
+    }
+    if (dwFlags != m_dwBackingFlags || dwNumaNode != m_dwNumaNode) {
+        m_dwBackingFlags = dwFlags;
+        m_dwNumaNode = dwNumaNode;
+        m_bChanged = TRUE;
+    }
+    return NOERROR;
+}
+
+
+/* Large pages can only be allocated with SeLockMemoryPrivilege enabled in
+   our token. Without it the allocation fails anyway, but only after the
+   memory manager has gone looking for contiguous physical memory, so we
+   check first and quietly use normal pages */
+
+static BOOL
+CanLockMemory()
+{
+    HANDLE hToken;
+    if (!OpenThreadToken(GetCurrentThread(), TOKEN_QUERY, TRUE, &hToken) &&
+        !OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &hToken)) {
+        return FALSE;
+    }
+
+    BOOL bEnabled = FALSE;
+    LUID Luid;
+    DWORD cb = 0;
+    if (LookupPrivilegeValue(NULL, SE_LOCK_MEMORY_NAME, &Luid) &&
+        !GetTokenInformation(hToken, TokenPrivileges, NULL, 0, &cb) &&
+        GetLastError() == ERROR_INSUFFICIENT_BUFFER) {
+        TOKEN_PRIVILEGES *pPrivileges = (TOKEN_PRIVILEGES *) new BYTE[cb];
+        if (pPrivileges &&
+            GetTokenInformation(hToken, TokenPrivileges, pPrivileges, cb, &cb)) {
+            for (DWORD i = 0; i < pPrivileges->PrivilegeCount; i++) {
+                const LUID_AND_ATTRIBUTES *pPrivilege = &pPrivileges->Privileges[i];
+                if (pPrivilege->Luid.LowPart == Luid.LowPart &&
+                    pPrivilege->Luid.HighPart == Luid.HighPart) {
+                    bEnabled = (pPrivilege->Attributes & SE_PRIVILEGE_ENABLED) != 0;
+                    break;
+                }
+            }
+        }
+        delete [] (BYTE *) pPrivileges;
+    }
+    CloseHandle(hToken);
+    return bEnabled;
+}
+
+
+/* The node of the processor we are running on, for AM_NUMANODE_CURRENT.
+   A filter can call this on its streaming thread and pass the result to
+   SetBackingStore to have the block placed and faulted in at Commit */
+
+DWORD
+CMemAllocator::GetCurrentNumaNode()
+{
+    // the processor group too, as there may be more than 64
+    PROCESSOR_NUMBER Processor;
+    USHORT Node;
+    GetCurrentProcessorNumberEx(&Processor);
+    if (GetNumaProcessorNodeEx(&Processor, &Node)) {
+        return Node;
+    }
+    return NUMA_NO_PREFERRED_NODE;
+}
+
+
+/* Allocate the block for all the samples. Large pages must be a multiple
+   of the large page size and are committed and locked when allocated, so
+   they never fault. For normal pages the block is optionally touched here
+   so that the pages are faulted in (and placed by first touch) now rather
+   than in the middle of streaming. Unless the node was given explicitly
+   we are called from the first GetBuffer, so that is the streaming thread */
+
+LPBYTE
+CMemAllocator::AllocBlock(__inout SIZE_T *pcb)
+{
+    DWORD flAllocationType = MEM_RESERVE | MEM_COMMIT;
+    SIZE_T cb = *pcb;
+    LPBYTE pBlock = NULL;
+
+    // the node the block really goes on, so that a parked block is only
+    // reused for the node it was placed on
+    DWORD dwNode = NUMA_NO_PREFERRED_NODE;
+    if (m_dwBackingFlags & AM_MEMALLOC_NUMANODE) {
+        dwNode = m_dwNumaNode;
+        if (dwNode == AM_NUMANODE_CURRENT) {
+            dwNode = GetCurrentNumaNode();
+        }
+    }
+
+    // remember what the block is for so FreeBlock can park it correctly
+    // even if the properties have been changed by then
+    m_SlabKey.lSize = m_lSize;
+    m_SlabKey.lAlignment = m_lAlignment;
+    m_SlabKey.lPrefix = m_lPrefix;
+    m_SlabKey.dwBackingFlags = m_dwBackingFlags;
+    m_SlabKey.dwNumaNode = dwNode;
+
+    if (m_dwBackingFlags & AM_MEMALLOC_RECYCLE) {
+        pBlock = CAMSlabCache::Lookup(&m_SlabKey, cb, pcb, &m_bLargePages);
+        if (pBlock != NULL) {
+            return pBlock;
+        }
+    }
+
+    m_bLargePages = FALSE;
+    if (m_dwBackingFlags & AM_MEMALLOC_LARGEPAGES) {
+        SIZE_T cbLargePage = GetLargePageMinimum();
+        if (cbLargePage != 0 && CanLockMemory()) {
+            SIZE_T cbLarge = (cb + cbLargePage - 1) & ~(cbLargePage - 1);
+            pBlock = (LPBYTE)VirtualAllocExNuma(GetCurrentProcess(),
+                                                NULL,
+                                                cbLarge,
+                                                flAllocationType | MEM_LARGE_PAGES,
+                                                PAGE_READWRITE,
+                                                dwNode);
+            if (pBlock != NULL) {
+                m_bLargePages = TRUE;
+                *pcb = cbLarge;
+                return pBlock;
+            }
+            DbgLog((LOG_MEMORY, 1, TEXT("Large page allocation of %Iu bytes failed (%d) - using normal pages"),
+                   cbLarge, GetLastError()));
+        }
+    }
+
+    pBlock = (LPBYTE)VirtualAllocExNuma(GetCurrentProcess(),
+                                        NULL,
+                                        cb,
+                                        flAllocationType,
+                                        PAGE_READWRITE,
+                                        dwNode);
+    if (pBlock == NULL) {
+        return NULL;
+    }
+
+    if (m_dwBackingFlags & AM_MEMALLOC_PREFAULT) {
+        SYSTEM_INFO SysInfo;
+        GetSystemInfo(&SysInfo);
+        for (SIZE_T cbOffset = 0; cbOffset < cb; cbOffset += SysInfo.dwPageSize) {
+            ((volatile BYTE *)pBlock)[cbOffset] = 0;
+        }
+    }
+    return pBlock;
+}
+
+void
+CMemAllocator::FreeBlock(__in LPBYTE pBlock, SIZE_T cb)
+{
+    if ((m_SlabKey.dwBackingFlags & AM_MEMALLOC_RECYCLE) &&
+        CAMSlabCache::Park(&m_SlabKey, pBlock, cb, m_bLargePages)) {
+        return;
+    }
+    EXECUTE_ASSERT(VirtualFree(pBlock, 0, MEM_RELEASE));
+}
+
+
 /* Destructor frees our memory resources */
 
 CMemAllocator::~CMemAllocator()
@@ -5274,6 +5979,224 @@ CMemAllocator::~CMemAllocator()
     ReallyFree();
 }
 
+//=====================================================================
+//=====================================================================
+// Implements CMediaSampleView and CSampleViewAllocator
+//=====================================================================
+//=====================================================================
+
+CMediaSampleView::CMediaSampleView(
+    __in_opt LPCTSTR pName,
+    __in CBaseAllocator *pAllocator,
+    __inout HRESULT *phr) :
+    CMediaSample(pName, pAllocator, phr, NULL, 0),
+    m_pParent(NULL)
+{
+}
+
+
+CSampleViewAllocator::CSampleViewAllocator(
+    __in_opt LPCTSTR pName,
+    __inout HRESULT *phr)
+    : CBaseAllocator(pName, NULL, phr, TRUE, FALSE)
+{
+}
+
+CSampleViewAllocator::~CSampleViewAllocator()
+{
+    Decommit();
+    ReallyFree();
+}
+
+/* The buffer size and alignment mean nothing to us, only the count */
+
+HRESULT
+CSampleViewAllocator::SetCount(LONG cViews)
+{
+    ALLOCATOR_PROPERTIES Request, Actual;
+    Request.cBuffers = cViews;
+    Request.cbBuffer = 1;
+    Request.cbAlign = 1;
+    Request.cbPrefix = 0;
+    return SetProperties(&Request, &Actual);
+}
+
+HRESULT
+CSampleViewAllocator::Alloc(void)
+{
+    CAutoLock lck(this);
+
+    /* Check SetCount has been called */
+    HRESULT hr = CBaseAllocator::Alloc();
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    /* If the count hasn't changed keep the views we have */
+    if (hr == S_FALSE) {
+        return NOERROR;
+    }
+    ReallyFree();
+
+    ASSERT(m_lAllocated == 0);
+    for (; m_lAllocated < m_lCount; m_lAllocated++) {
+        CMediaSampleView *pView = new CMediaSampleView(
+                                        NAME("Sample view"),
+                                        this,
+                                        &hr);
+        if (pView == NULL) {
+            return E_OUTOFMEMORY;
+        }
+        m_lFree.Add(pView);
+    }
+
+    m_bChanged = FALSE;
+    return NOERROR;
+}
+
+void
+CSampleViewAllocator::Free(void)
+{
+    return;
+}
+
+void
+CSampleViewAllocator::ReallyFree(void)
+{
+    ASSERT(m_lAllocated == m_lFree.GetCount());
+
+    CMediaSample *pSample;
+    while ((pSample = m_lFree.RemoveHead()) != NULL) {
+        delete pSample;
+    }
+    m_lAllocated = 0;
+}
+
+/* Release our hold on the parent only after the view is back on the free
+   list - releasing the parent may run arbitrary code in its allocator */
+
+STDMETHODIMP
+CSampleViewAllocator::ReleaseBuffer(IMediaSample *pSample)
+{
+    CheckPointer(pSample, E_POINTER);
+
+    CMediaSampleView *pView = (CMediaSampleView *) pSample;
+    IMediaSample *pParent = pView->m_pParent;
+    pView->m_pParent = NULL;
+    pView->SetPointer(NULL, 0);
+
+    HRESULT hr = CBaseAllocator::ReleaseBuffer(pSample);
+
+    if (pParent) {
+        pParent->Release();
+    }
+    return hr;
+}
+
+HRESULT
+CSampleViewAllocator::GetView(
+    __in IMediaSample *pParent,
+    LONG lOffset,
+    LONG lLength,
+    __deref_out IMediaSample **ppView,
+    DWORD dwFlags)
+{
+    CheckPointer(pParent, E_POINTER);
+    CheckPointer(ppView, E_POINTER);
+    *ppView = NULL;
+
+    /* The window must lie inside the parent's buffer */
+    LONG cbParent = pParent->GetSize();
+    if (lOffset < 0 || lLength < 0 || lOffset > cbParent ||
+        lLength > cbParent - lOffset) {
+        return E_INVALIDARG;
+    }
+
+    BYTE *pbParent;
+    HRESULT hr = pParent->GetPointer(&pbParent);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    IMediaSample *pSample;
+    hr = GetBuffer(&pSample, NULL, NULL, dwFlags);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    AttachView(pSample, pParent, pbParent + lOffset, lLength);
+    *ppView = pSample;
+    return NOERROR;
+}
+
+void
+CSampleViewAllocator::AttachView(
+    __inout IMediaSample *pSample,
+    __in IMediaSample *pParent,
+    __in_bcount(lLength) BYTE *pbData,
+    LONG lLength)
+{
+    CMediaSampleView *pView = (CMediaSampleView *) pSample;
+    ASSERT(pView->m_pParent == NULL);
+    EXECUTE_ASSERT(SUCCEEDED(pView->SetPointer(pbData, lLength)));
+    pParent->AddRef();
+    pView->m_pParent = pParent;
+}
+
+HRESULT
+CSampleViewAllocator::SplitSample(
+    __in IMediaSample *pParent,
+    LONG cSlices,
+    __in_ecount(cSlices) const LONG *plLengths,
+    __out_ecount(cSlices) IMediaSample **ppViews,
+    DWORD dwFlags)
+{
+    CheckPointer(pParent, E_POINTER);
+    CheckPointer(plLengths, E_POINTER);
+    CheckPointer(ppViews, E_POINTER);
+    if (cSlices <= 0) {
+        return E_INVALIDARG;
+    }
+
+    /* The slices must fit in the data the parent actually holds */
+    LONG cbRemaining = pParent->GetActualDataLength();
+    for (LONG i = 0; i < cSlices; i++) {
+        if (plLengths[i] < 0 || plLengths[i] > cbRemaining) {
+            return E_INVALIDARG;
+        }
+        cbRemaining -= plLengths[i];
+    }
+
+    BYTE *pbParent;
+    HRESULT hr = pParent->GetPointer(&pbParent);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    /* Take every view at once. Taking them one at a time would hold some
+       while waiting for the rest, and two splitters (or a splitter and a
+       downstream filter holding views) could each wait on the other.
+       GetBuffers also refuses, under our lock, more views than we have */
+    LONG cReturned;
+    hr = GetBuffers(cSlices, ppViews, &cReturned, dwFlags | AM_GBF_BATCH_ALL);
+    if (FAILED(hr)) {
+        return hr;
+    }
+    ASSERT(cReturned == cSlices);
+
+    BOOL bSyncPoint = pParent->IsSyncPoint() == S_OK;
+    BOOL bDiscontinuity = pParent->IsDiscontinuity() == S_OK;
+
+    LONG lOffset = 0;
+    for (LONG iSlice = 0; iSlice < cSlices; iSlice++) {
+        AttachView(ppViews[iSlice], pParent, pbParent + lOffset, plLengths[iSlice]);
+        ppViews[iSlice]->SetSyncPoint(bSyncPoint);
+        ppViews[iSlice]->SetDiscontinuity(bDiscontinuity && iSlice == 0);
+        lOffset += plLengths[iSlice];
+    }
+    return NOERROR;
+}
+
 // ------------------------------------------------------------------------
 // filter registration through IFilterMapper. used if IFilterMapper is
 // not found (Quartz 1.0 install)
@@ -69,6 +69,7 @@ protected:
     CLSID	    m_clsid;            // This filters clsid
                                         // used for serialization
     CCritSec        *m_pLock;           // Object we use for locking
+    CAMSharedLock   m_ClockLock;        // m_pClock for GetSyncSource
 
 public:
 
@@ -147,7 +148,8 @@ public:
 
 class AM_NOVTABLE CBaseFilter : public CUnknown,        // Handles an IUnknown
                     public IBaseFilter,     // The Filter Interface
-                    public IAMovieSetup     // For un/registration
+                    public IAMovieSetup,    // For un/registration
+                    public IAMLatencyStatistics // What CAMLatency recorded
 {
 
 friend class CBasePin;
@@ -159,12 +161,16 @@ protected:
     CLSID	    m_clsid;            // This filters clsid
                                         // used for serialization
     CCritSec        *m_pLock;           // Object we use for locking
+    CAMSharedLock   m_ClockLock;        // m_pClock for GetSyncSource
 
     WCHAR           *m_pName;           // Full filter name
     IFilterGraph    *m_pGraph;          // Graph we belong to
     IMediaEventSink *m_pSink;           // Called with notify events
     LONG            m_PinVersion;       // Current pin version
 
+    // created by the first sample CAMLatency sees leave us
+    CAMLatencyStatistics * volatile m_pLatency;
+
 public:
 
     CBaseFilter(
@@ -316,6 +322,19 @@ public:
 
     virtual __out_opt LPAMOVIESETUP_FILTER GetSetupData(){ return NULL; }
 
+    // --- IAMLatencyStatistics methods ---
+
+    STDMETHODIMP GetLatencyStatistics(
+        AM_LATENCY_KIND Kind,
+        __out AM_LATENCY_STATISTICS *pStats);
+    STDMETHODIMP ResetLatencyStatistics();
+
+    // pSample is leaving this filter - count it if it has been stamped
+    void RecordLatency(IMediaSample *pSample) {
+        if (CAMLatency::IsEnabled()) {
+            CAMLatency::RecordDeparture(pSample, &m_pLatency);
+        }
+    };
 };
 
 
@@ -344,6 +363,7 @@ protected:
     IQualityControl *m_pQSink;                  // Target for Quality messages
     LONG            m_TypeVersion;              // Holds current type version
     CMediaType      m_mt;                       // Media type of connection
+    CAMSharedLock   m_TypeLock;                 // m_mt for ConnectionMediaType
 
     CRefTime        m_tStart;                   // time from NewSegment call
     CRefTime        m_tStop;                    // time from NewSegment
@@ -525,6 +545,10 @@ public:
     // set the connection to use this format (previously agreed)
     virtual HRESULT SetMediaType(const CMediaType *);
 
+    // just replace m_mt, under m_TypeLock - for format changes made while
+    // streaming, which don't go through SetMediaType
+    HRESULT SetCurrentMediaType(const AM_MEDIA_TYPE *pmt);
+
     // check that the connection is ok before verifying it
     // can be overridden eg to check what interfaces will be supported.
     virtual HRESULT CheckConnect(IPin *);
@@ -550,6 +574,9 @@ public:
     //  Access name
     LPWSTR Name() { return m_pName; };
 
+    //  Name of the filter we belong to, or NULL if it has none yet
+    LPCWSTR FilterName() const { return m_pFilter->m_pName; };
+
     //  Can reconnectwhen active?
     void SetReconnectWhenActive(bool bCanReconnect)
     {
@@ -1182,7 +1209,8 @@ inline HRESULT CDynamicOutputPin::DeliverNewSegment(REFERENCE_TIME tStart, REFER
 //=====================================================================
 //=====================================================================
 
-class CMediaSample : public IMediaSample2    // The interface we support
+class CMediaSample : public IMediaSample2,   // The interface we support
+                     public IAMSampleLatency // Stamps for CAMLatency
 {
 
 protected:
@@ -1224,6 +1252,8 @@ protected:
     LONG             m_MediaEnd;        /* A difference to get the end */
     AM_MEDIA_TYPE    *m_pMediaType;     /* Media type change data */
     DWORD            m_dwStreamId;      /* Stream id */
+    LONGLONG         m_llLatencyOrigin; /* CAMLatency stamps, or 0 */
+    LONGLONG         m_llLatencyArrival;
 public:
     LONG             m_cRef;            /* Reference count */
 
@@ -1318,6 +1348,45 @@ public:
         DWORD cbProperties,
         __in_bcount(cbProperties) const BYTE * pbProperties
     );
+
+    // IAMSampleLatency
+    STDMETHODIMP GetLatencyStamps(
+        __out LONGLONG *pllOrigin,
+        __out LONGLONG *pllArrival
+    );
+
+    STDMETHODIMP SetLatencyStamps(
+        LONGLONG llOrigin,
+        LONGLONG llArrival
+    );
+};
+
+
+//=====================================================================
+//=====================================================================
+// Defines IMemAllocatorBatch
+//
+// Optional allocator interface that hands out several free samples under
+// a single acquisition of the allocator's lock. By default as many samples
+// as are free (at least one) are returned; with AM_GBF_BATCH_ALL the call
+// waits until all cRequested are free and returns them together. The
+// other AM_GBF_xxx flags mean the same as for IMemAllocator::GetBuffer.
+//=====================================================================
+//=====================================================================
+
+#define AM_GBF_BATCH_ALL    0x00010000
+
+// {2057263A-E32F-49FB-975B-9D378E05BAEE}
+EXTERN_C const IID IID_IMemAllocatorBatch;
+
+DECLARE_INTERFACE_(IMemAllocatorBatch, IUnknown)
+{
+    STDMETHOD(GetBuffers) (THIS_
+        LONG cRequested,
+        __out_ecount_part(cRequested, *pcReturned) IMediaSample **ppBuffers,
+        __out LONG *pcReturned,
+        DWORD dwFlags
+    ) PURE;
 };
 
 
@@ -1338,6 +1407,7 @@ public:
 
 class AM_NOVTABLE CBaseAllocator : public CUnknown,// A non delegating IUnknown
                        public IMemAllocatorCallbackTemp, // The interface we support
+                       public IMemAllocatorBatch,  // Multi-sample GetBuffer
                        public CCritSec             // Provides object locking
 {
     class CSampleList;
@@ -1427,6 +1497,25 @@ protected:
 
     HANDLE m_hSem;              // For signalling
     long m_lWaiting;            // Waiting for a free element
+
+    /*  Lock-free mode (see SetLockFreeMode).
+
+        While committed the free samples live in m_qFree instead of m_lFree
+        and GetBuffer/ReleaseBuffer do not take the allocator's critical
+        section. m_lFreeReserve counts the samples on m_qFree that nobody
+        has claimed yet - GetBuffer claims one by decrementing it before
+        dequeueing, ReleaseBuffer enqueues before incrementing it, so a
+        successful claim always finds a sample on the ring. Threads with
+        nothing to claim block on m_evFree rather than m_hSem.
+
+        The samples are moved back onto m_lFree before Free() is called, so
+        derived classes always find them where they expect them.
+    */
+
+    BOOL m_bLockFree;                       // use the lock-free free list
+    CBoundedQueue<CMediaSample> m_qFree;    // free samples while committed
+    volatile LONG m_lFreeReserve;           // unclaimed samples on m_qFree
+    CAMEventCount m_evFree;                 // wakes threads in GetBuffer
     long m_lCount;              // how many buffers we have agreed to provide
     long m_lAllocated;          // how many buffers are currently allocated
     long m_lSize;               // agreed size of each buffer
@@ -1452,6 +1541,23 @@ protected:
     // override to allocate the memory when commit called
     virtual HRESULT Alloc(void);
 
+private:
+
+    // lock-free mode helpers
+    LONG TryClaimFreeSamples(LONG lMax, LONG lMin);
+    void EnqueueFreeSample(__in CMediaSample *pSample);
+    CMediaSample *DequeueFreeSample();
+    HRESULT ClaimBuffersLockFree(
+        LONG cRequested,
+        LONG cRequired,
+        __out LONG *pcClaimed,
+        DWORD dwFlags);
+    BOOL ReturnFreeClaim();
+    BOOL CompleteLockFreeDecommit();
+
+    IMediaSample *PrepareBuffer(__in CMediaSample *pSample);
+    void AllowGetBuffer();
+
 public:
 
     CBaseAllocator(
@@ -1499,6 +1605,14 @@ public:
                            __in_opt REFERENCE_TIME * pEndTime,
                            DWORD dwFlags);
 
+    // get up to cRequested free samples at once (IMemAllocatorBatch). The
+    // CBaseAllocator implementation is only exposed by allocators which
+    // don't override GetBuffer - see CMemAllocator
+    STDMETHODIMP GetBuffers(LONG cRequested,
+                            __out_ecount_part(cRequested, *pcReturned) IMediaSample **ppBuffers,
+                            __out LONG *pcReturned,
+                            DWORD dwFlags);
+
     // final release of a CMediaSample will call this
     STDMETHODIMP ReleaseBuffer(IMediaSample *pBuffer);
     // obsolete:: virtual void PutOnFreeList(CMediaSample * pSample);
@@ -1512,6 +1626,10 @@ public:
 
     // Notify that we're waiting for a sample
     void SetWaiting() { m_lWaiting++; };
+
+    // Select the lock-free free list. Must be called while decommitted
+    HRESULT SetLockFreeMode(BOOL bLockFree);
+    BOOL IsLockFreeMode() const { return m_bLockFree; };
 };
 
 
@@ -1534,12 +1652,63 @@ public:
 //  Make me one from quartz.dll
 STDAPI CreateMemoryAllocator(__deref_out IMemAllocator **ppAllocator);
 
+//  Backing store flags for CMemAllocator::SetBackingStore
+//
+//  AM_MEMALLOC_LARGEPAGES  back the buffers with large pages if the system
+//                          has them and the committing thread's token has
+//                          SeLockMemoryPrivilege enabled, otherwise
+//                          silently fall back to normal pages
+//  AM_MEMALLOC_PREFAULT    touch every page before the first buffer is
+//                          handed out so the first pass over the buffers
+//                          takes no page faults
+//  AM_MEMALLOC_NUMANODE    place the buffers on the NUMA node passed to
+//                          SetBackingStore, or with AM_NUMANODE_CURRENT on
+//                          the node of the first thread to call GetBuffer
+//  AM_MEMALLOC_RECYCLE     park the block in CAMSlabCache when it is freed
+//                          and look there first when allocating
+//
+//  Where the pages end up depends on which thread touches them first
+//  unless an explicit node is given. So with AM_NUMANODE_CURRENT, or with
+//  AM_MEMALLOC_PREFAULT and no node, the block is not allocated at Commit
+//  but by the first GetBuffer (or GetBuffers), on the thread that is
+//  going to fill the buffers. That call pays for the allocation and the
+//  prefault. A filter that knows its streaming thread's node can pass
+//  GetCurrentNumaNode() from that thread instead, and have it all done at
+//  Commit.
+
+#define AM_MEMALLOC_LARGEPAGES  0x00000001
+#define AM_MEMALLOC_PREFAULT    0x00000002
+#define AM_MEMALLOC_NUMANODE    0x00000004
+#define AM_MEMALLOC_RECYCLE     0x00000008
+#define AM_MEMALLOC_VALIDFLAGS  0x0000000F
+
+#define AM_NUMANODE_CURRENT     ((DWORD)-1)
+
 class CMemAllocator : public CBaseAllocator
 {
 
 protected:
 
     LPBYTE m_pBuffer;   // combined memory for all buffers
+    SIZE_T m_cbBuffer;  // size of m_pBuffer as actually allocated
+    BOOL m_bLargePages; // m_pBuffer is backed by large pages
+
+    DWORD m_dwBackingFlags;     // AM_MEMALLOC_xxx
+    DWORD m_dwNumaNode;         // node for AM_MEMALLOC_NUMANODE
+    AM_SLAB_KEY m_SlabKey;      // what m_pBuffer was allocated for
+
+    CMediaSample **m_ppSamples; // the samples Alloc made, in block order
+    LONG m_lAlignedSize;        // distance between them in the block
+    volatile LONG m_lPlacePending;  // the block waits for the first GetBuffer
+
+    // allocate the block Alloc deferred and point the samples into it
+    HRESULT PlaceBlock();
+
+    // Allocate and free the block the samples are carved out of. Override
+    // these to put the buffers somewhere special - the default honours
+    // the backing store flags. AllocBlock may round *pcb up.
+    virtual LPBYTE AllocBlock(__inout SIZE_T *pcb);
+    virtual void FreeBlock(__in LPBYTE pBlock, SIZE_T cb);
 
     // override to free the memory when decommit completes
     // - we actually do nothing, and save the memory until deletion.
@@ -1556,6 +1725,9 @@ public:
     /* This goes in the factory template table to create new instances */
     static CUnknown *CreateInstance(__inout_opt LPUNKNOWN, __inout HRESULT *);
 
+    // we also support IMemAllocatorBatch
+    STDMETHODIMP NonDelegatingQueryInterface(REFIID riid, __deref_out void **ppv);
+
     STDMETHODIMP SetProperties(
 		    __in ALLOCATOR_PROPERTIES* pRequest,
 		    __out ALLOCATOR_PROPERTIES* pActual);
@@ -1565,6 +1737,118 @@ public:
     CMemAllocator(__in_opt LPCSTR , __inout_opt LPUNKNOWN, __inout HRESULT *);
 #endif
     ~CMemAllocator();
+
+    // choose how the buffer block is backed - takes effect at the next
+    // Commit and fails if the allocator is committed
+    HRESULT SetBackingStore(DWORD dwFlags, DWORD dwNumaNode = AM_NUMANODE_CURRENT);
+    BOOL IsUsingLargePages() const { return m_bLargePages; };
+
+    // the NUMA node of the calling thread's processor, or
+    // NUMA_NO_PREFERRED_NODE if it can't be found. That is the same value
+    // as AM_NUMANODE_CURRENT, so passing it on still defers the block
+    static DWORD GetCurrentNumaNode();
+
+    // these place a deferred block before handing out the first buffer
+    STDMETHODIMP GetBuffer(__deref_out IMediaSample **ppBuffer,
+                           __in_opt REFERENCE_TIME * pStartTime,
+                           __in_opt REFERENCE_TIME * pEndTime,
+                           DWORD dwFlags);
+    STDMETHODIMP GetBuffers(LONG cRequested,
+                            __out_ecount_part(cRequested, *pcReturned) IMediaSample **ppBuffers,
+                            __out LONG *pcReturned,
+                            DWORD dwFlags);
+};
+
+//=====================================================================
+//=====================================================================
+// Defines CMediaSampleView and CSampleViewAllocator
+//
+// A view is a sample whose buffer is a byte range of another (parent)
+// sample. While the view is in use it holds a reference on the parent,
+// so the parent only goes back to its own allocator once it and every
+// view on it have been released. This lets a filter pass part of an
+// input sample downstream without copying it, whatever allocators the
+// two connections are using.
+//
+// The view objects themselves come from a CSampleViewAllocator, which
+// recycles them through the normal CBaseAllocator free list - so the
+// number of views outstanding at once is bounded by its buffer count,
+// just like any other allocator. The allocator's buffer size and
+// alignment are not used.
+//=====================================================================
+//=====================================================================
+
+class CMediaSampleView : public CMediaSample
+{
+    friend class CSampleViewAllocator;
+
+protected:
+
+    IMediaSample *m_pParent;    // the sample we are a window on
+
+public:
+
+    CMediaSampleView(
+        __in_opt LPCTSTR pName,
+        __in CBaseAllocator *pAllocator,
+        __inout HRESULT *phr);
+
+    // not AddRef'd - only valid while the view is
+    IMediaSample *GetParent() const { return m_pParent; };
+};
+
+class CSampleViewAllocator : public CBaseAllocator
+{
+
+protected:
+
+    // view objects are kept until we are deleted, like CMemAllocator
+    void Free(void);
+    void ReallyFree(void);
+
+    // creates the view objects when Commit is called
+    HRESULT Alloc(void);
+
+    // make a free view a window on lLength bytes at pbData in pParent
+    void AttachView(
+        __inout IMediaSample *pView,
+        __in IMediaSample *pParent,
+        __in_bcount(lLength) BYTE *pbData,
+        LONG lLength);
+
+public:
+
+    CSampleViewAllocator(__in_opt LPCTSTR , __inout HRESULT *);
+    ~CSampleViewAllocator();
+
+    // drops the view's reference on its parent then recycles it
+    STDMETHODIMP ReleaseBuffer(IMediaSample *pBuffer);
+
+    // set the number of views that can be outstanding at once
+    HRESULT SetCount(LONG cViews);
+
+    // Get a view on lLength bytes of pParent starting at lOffset. The
+    // view's times, flags and media type are NOT copied from the parent.
+    // dwFlags is as for GetBuffer (AM_GBF_NOWAIT)
+    HRESULT GetView(
+        __in IMediaSample *pParent,
+        LONG lOffset,
+        LONG lLength,
+        __deref_out IMediaSample **ppView,
+        DWORD dwFlags = 0);
+
+    // Cut the valid data of pParent into cSlices consecutive views, the
+    // i'th one plLengths[i] bytes long (per-field, per-plane, per-NAL...).
+    // Either every view is returned or none is - they are taken from the
+    // free list together, so nothing is held while waiting. Each slice is
+    // marked as a sync point if the parent is, and the first one carries
+    // the parent's discontinuity flag
+    HRESULT SplitSample(
+        __in IMediaSample *pParent,
+        LONG cSlices,
+        __in_ecount(cSlices) const LONG *plLengths,
+        __out_ecount(cSlices) IMediaSample **ppViews,
+        DWORD dwFlags = 0);
 };
 
 // helper used by IAMovieSetup implementation
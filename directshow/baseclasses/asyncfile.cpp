@@ -0,0 +1,1029 @@
+//------------------------------------------------------------------------------
+// File: AsyncFile.cpp
+//
+// Desc: DirectShow base classes - implements CAsyncFileReader, an
+//       IAsyncReader implementation that reads from a file.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#include <streams.h>
+#include "asyncfile.h"
+
+
+// Sector size of the volume a file is on, or 0 if we can't tell
+static LONG
+GetSectorSize(__in LPCTSTR pszFileName)
+{
+    TCHAR szVolume[MAX_PATH];
+    DWORD dwSectorsPerCluster, dwBytesPerSector, dwFreeClusters, dwClusters;
+
+    if (!GetVolumePathName(pszFileName, szVolume, NUMELMS(szVolume)) ||
+	!GetDiskFreeSpace(szVolume,
+			  &dwSectorsPerCluster,
+			  &dwBytesPerSector,
+			  &dwFreeClusters,
+			  &dwClusters)) {
+	return 0;
+    }
+
+    // we round with masks so only accept a power of 2
+    if (dwBytesPerSector == 0 || (dwBytesPerSector & (dwBytesPerSector - 1))) {
+	return 0;
+    }
+    return (LONG) dwBytesPerSector;
+}
+
+
+// PrefetchVirtualMemory is only there from Windows 8 on, so we look it up
+// rather than link to it
+
+typedef struct {
+    PVOID VirtualAddress;
+    SIZE_T NumberOfBytes;
+} AM_MEMORY_RANGE_ENTRY;
+
+typedef BOOL (WINAPI *PPREFETCHVIRTUALMEMORY)(HANDLE, ULONG_PTR, AM_MEMORY_RANGE_ENTRY *, ULONG);
+
+static void
+PrefetchRange(__in PVOID pv, SIZE_T cb)
+{
+    static PPREFETCHVIRTUALMEMORY pfnPrefetch = NULL;
+    static BOOL bLookedUp = FALSE;
+
+    if (!bLookedUp) {
+	HMODULE hKernel = GetModuleHandle(TEXT("kernel32.dll"));
+	if (hKernel) {
+	    pfnPrefetch = (PPREFETCHVIRTUALMEMORY) GetProcAddress(hKernel, "PrefetchVirtualMemory");
+	}
+	bLookedUp = TRUE;
+    }
+
+    if (pfnPrefetch) {
+	AM_MEMORY_RANGE_ENTRY Range = { pv, cb };
+	pfnPrefetch(GetCurrentProcess(), 1, &Range, 0);
+    }
+}
+
+
+//=====================================================================
+// Implements CMappedFileSample and CMappedFileAllocator
+//=====================================================================
+
+CMappedFileSample::CMappedFileSample(
+    __in_opt LPCTSTR pName,
+    __in CBaseAllocator *pAllocator,
+    __inout HRESULT *phr,
+    LONG lSize) :
+    CMediaSample(pName, pAllocator, phr, NULL, lSize),
+    m_pView(NULL)
+{
+}
+
+
+CMappedFileAllocator::CMappedFileAllocator(
+    __in_opt LPCTSTR pName,
+    __inout HRESULT *phr)
+    : CBaseAllocator(pName, NULL, phr, TRUE, FALSE),
+      m_ppSamples(NULL)
+{
+}
+
+CMappedFileAllocator::~CMappedFileAllocator()
+{
+    Decommit();
+    ReallyFree();
+}
+
+STDMETHODIMP
+CMappedFileAllocator::SetProperties(
+    __in ALLOCATOR_PROPERTIES* pRequest,
+    __out ALLOCATOR_PROPERTIES* pActual)
+{
+    CheckPointer(pRequest, E_POINTER);
+    CheckPointer(pActual, E_POINTER);
+
+    // the data in a view is only as aligned as its file position, which
+    // the caller aligns - so the most we can promise is the granularity
+    // views are mapped at
+    SYSTEM_INFO SysInfo;
+    GetSystemInfo(&SysInfo);
+    if (pRequest->cbAlign <= 0 ||
+	(pRequest->cbAlign & (pRequest->cbAlign - 1)) ||
+	(DWORD) pRequest->cbAlign > SysInfo.dwAllocationGranularity) {
+	return VFW_E_BADALIGN;
+    }
+
+    ALLOCATOR_PROPERTIES Request = *pRequest;
+    Request.cbPrefix = 0;
+    return CBaseAllocator::SetProperties(&Request, pActual);
+}
+
+HRESULT
+CMappedFileAllocator::Alloc(void)
+{
+    CAutoLock lck(this);
+
+    /* Check SetProperties has been called */
+    HRESULT hr = CBaseAllocator::Alloc();
+    if (FAILED(hr)) {
+	return hr;
+    }
+
+    /* If nothing has changed keep the samples we have */
+    if (hr == S_FALSE) {
+	return NOERROR;
+    }
+    ReallyFree();
+
+    m_ppSamples = new CMappedFileSample *[m_lCount];
+    if (m_ppSamples == NULL) {
+	return E_OUTOFMEMORY;
+    }
+
+    ASSERT(m_lAllocated == 0);
+    for (; m_lAllocated < m_lCount; m_lAllocated++) {
+	CMappedFileSample *pSample = new CMappedFileSample(
+					NAME("Mapped file sample"),
+					this,
+					&hr,
+					m_lSize);
+	if (pSample == NULL) {
+	    return E_OUTOFMEMORY;
+	}
+	m_ppSamples[m_lAllocated] = pSample;
+	m_lFree.Add(pSample);
+    }
+
+    m_bChanged = FALSE;
+    return NOERROR;
+}
+
+void
+CMappedFileAllocator::Free(void)
+{
+    return;
+}
+
+void
+CMappedFileAllocator::ReallyFree(void)
+{
+    ASSERT(m_lAllocated == m_lFree.GetCount());
+
+    CMediaSample *pSample;
+    while ((pSample = m_lFree.RemoveHead()) != NULL) {
+	delete pSample;
+    }
+    m_lAllocated = 0;
+
+    delete [] m_ppSamples;
+    m_ppSamples = NULL;
+}
+
+STDMETHODIMP
+CMappedFileAllocator::ReleaseBuffer(IMediaSample *pSample)
+{
+    CheckPointer(pSample, E_POINTER);
+
+    CMappedFileSample *pMapped = (CMappedFileSample *) pSample;
+    if (pMapped->m_pView) {
+	EXECUTE_ASSERT(UnmapViewOfFile(pMapped->m_pView));
+	pMapped->m_pView = NULL;
+    }
+    pMapped->SetPointer(NULL, m_lSize);
+
+    return CBaseAllocator::ReleaseBuffer(pSample);
+}
+
+CMappedFileSample *
+CMappedFileAllocator::FindSample(__in IMediaSample *pSample)
+{
+    CAutoLock lck(this);
+
+    for (LONG i = 0; i < m_lAllocated; i++) {
+	if ((IMediaSample *) m_ppSamples[i] == pSample) {
+	    return m_ppSamples[i];
+	}
+    }
+    return NULL;
+}
+
+
+//=====================================================================
+// Implements CAsyncFileReader
+//=====================================================================
+
+
+CAsyncFileReader::CAsyncFileReader(
+    __in_opt LPCTSTR pName,
+    __inout_opt LPUNKNOWN pUnk,
+    __inout HRESULT *phr)
+  : CUnknown(pName, pUnk),
+    m_hFile(INVALID_HANDLE_VALUE),
+    m_hSyncFile(INVALID_HANDLE_VALUE),
+    m_hPort(NULL),
+    m_llLength(0),
+    m_lAlign(1),
+    m_bWorkers(FALSE),
+    m_hMapping(NULL),
+    m_dwGranularity(0),
+    m_pMapAlloc(NULL),
+    m_lFree(NAME("Free file requests")),
+    m_lWork(NAME("Queued file requests")),
+    m_hWorkSem(NULL),
+    m_cWorkers(0),
+    m_cOutstanding(0),
+    m_bFlushing(FALSE),
+    m_bTerminate(FALSE)
+{
+    UNREFERENCED_PARAMETER(phr);
+}
+
+CAsyncFileReader::~CAsyncFileReader()
+{
+    Close();
+
+    CFileRequest *pRequest;
+    while ((pRequest = m_lFree.RemoveHead()) != NULL) {
+	delete pRequest;
+    }
+}
+
+STDMETHODIMP
+CAsyncFileReader::NonDelegatingQueryInterface(REFIID riid, __deref_out void **ppv)
+{
+    CheckPointer(ppv, E_POINTER);
+
+    if (riid == IID_IAsyncReader) {
+	return GetInterface((IAsyncReader *) this, ppv);
+    } else {
+	return CUnknown::NonDelegatingQueryInterface(riid, ppv);
+    }
+}
+
+HRESULT
+CAsyncFileReader::Open(__in LPCTSTR pszFileName, DWORD dwFlags)
+{
+    CheckPointer(pszFileName, E_POINTER);
+    if ((dwFlags & ~AM_ASYNCFILE_VALIDFLAGS) ||
+	((dwFlags & AM_ASYNCFILE_MAPPED) && dwFlags != AM_ASYNCFILE_MAPPED)) {
+	return E_INVALIDARG;
+    }
+    if (m_hSyncFile != INVALID_HANDLE_VALUE) {
+	return E_UNEXPECTED;
+    }
+
+    // the cached handle is also how we find the length
+    m_hSyncFile = CreateFile(pszFileName,
+			     GENERIC_READ,
+			     FILE_SHARE_READ,
+			     NULL,
+			     OPEN_EXISTING,
+			     FILE_ATTRIBUTE_NORMAL,
+			     NULL);
+    if (m_hSyncFile == INVALID_HANDLE_VALUE) {
+	return AmHresultFromWin32(GetLastError());
+    }
+    LARGE_INTEGER liLength;
+    if (!GetFileSizeEx(m_hSyncFile, &liLength)) {
+	DWORD dwError = GetLastError();
+	Close();
+	return AmHresultFromWin32(dwError);
+    }
+    m_llLength = liLength.QuadPart;
+
+    // a copy-on-write mapping, and a port for Request to complete to.
+    // There is nothing to map in an empty file but then there is nothing
+    // to read either
+    m_lAlign = 1;
+    if (dwFlags & AM_ASYNCFILE_MAPPED) {
+	SYSTEM_INFO SysInfo;
+	GetSystemInfo(&SysInfo);
+	m_dwGranularity = SysInfo.dwAllocationGranularity;
+
+	if (m_llLength != 0) {
+	    m_hMapping = CreateFileMapping(m_hSyncFile, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	    if (m_hMapping == NULL) {
+		DWORD dwError = GetLastError();
+		Close();
+		return AmHresultFromWin32(dwError);
+	    }
+	}
+	m_hPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 0);
+	if (m_hPort == NULL) {
+	    DWORD dwError = GetLastError();
+	    Close();
+	    return AmHresultFromWin32(dwError);
+	}
+	m_bWorkers = FALSE;
+	m_bFlushing = FALSE;
+	return S_OK;
+    }
+
+    // bypass the cache if asked to and we know what alignment that needs
+    DWORD dwAttributes = FILE_ATTRIBUTE_NORMAL;
+    if (dwFlags & AM_ASYNCFILE_UNBUFFERED) {
+	LONG lSector = GetSectorSize(pszFileName);
+	if (lSector != 0) {
+	    dwAttributes |= FILE_FLAG_NO_BUFFERING;
+	    m_lAlign = lSector;
+	}
+    }
+
+    // overlapped reads completing to a port if we can
+    m_bWorkers = (dwFlags & AM_ASYNCFILE_WORKERS) != 0;
+    if (!m_bWorkers) {
+	m_hFile = CreateFile(pszFileName,
+			     GENERIC_READ,
+			     FILE_SHARE_READ,
+			     NULL,
+			     OPEN_EXISTING,
+			     dwAttributes | FILE_FLAG_OVERLAPPED,
+			     NULL);
+	if (m_hFile != INVALID_HANDLE_VALUE) {
+	    m_hPort = CreateIoCompletionPort(m_hFile, NULL, KeyFile, 0);
+	}
+	if (m_hPort == NULL) {
+	    DbgLog((LOG_TRACE, 2, TEXT("CAsyncFileReader - no overlapped reads, using workers")));
+	    if (m_hFile != INVALID_HANDLE_VALUE) {
+		EXECUTE_ASSERT(CloseHandle(m_hFile));
+		m_hFile = INVALID_HANDLE_VALUE;
+	    }
+	    m_bWorkers = TRUE;
+	}
+    }
+
+    // otherwise worker threads doing positioned reads and posting the
+    // results to a port of their own
+    if (m_bWorkers) {
+	m_hFile = CreateFile(pszFileName,
+			     GENERIC_READ,
+			     FILE_SHARE_READ,
+			     NULL,
+			     OPEN_EXISTING,
+			     dwAttributes,
+			     NULL);
+	if (m_hFile == INVALID_HANDLE_VALUE) {
+	    DWORD dwError = GetLastError();
+	    Close();
+	    return AmHresultFromWin32(dwError);
+	}
+	m_hPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 0);
+	if (m_hPort == NULL) {
+	    DWORD dwError = GetLastError();
+	    Close();
+	    return AmHresultFromWin32(dwError);
+	}
+	HRESULT hr = StartWorkers();
+	if (FAILED(hr)) {
+	    Close();
+	    return hr;
+	}
+    }
+
+    m_bFlushing = FALSE;
+    return S_OK;
+}
+
+void
+CAsyncFileReader::Close()
+{
+    ASSERT(m_cOutstanding == 0);
+
+    StopWorkers();
+
+    if (m_hFile != INVALID_HANDLE_VALUE) {
+	EXECUTE_ASSERT(CloseHandle(m_hFile));
+	m_hFile = INVALID_HANDLE_VALUE;
+    }
+    if (m_hSyncFile != INVALID_HANDLE_VALUE) {
+	EXECUTE_ASSERT(CloseHandle(m_hSyncFile));
+	m_hSyncFile = INVALID_HANDLE_VALUE;
+    }
+    if (m_hPort != NULL) {
+	EXECUTE_ASSERT(CloseHandle(m_hPort));
+	m_hPort = NULL;
+    }
+
+    // views still held by samples keep the mapping itself alive
+    if (m_hMapping != NULL) {
+	EXECUTE_ASSERT(CloseHandle(m_hMapping));
+	m_hMapping = NULL;
+    }
+    if (m_pMapAlloc) {
+	m_pMapAlloc->Release();
+	m_pMapAlloc = NULL;
+    }
+    m_llLength = 0;
+    m_lAlign = 1;
+}
+
+// request bookkeeping - recycled through m_lFree
+
+CAsyncFileReader::CFileRequest *
+CAsyncFileReader::NewRequest()
+{
+    CAutoLock lck(&m_csRequests);
+    CFileRequest *pRequest = m_lFree.RemoveHead();
+    if (pRequest == NULL) {
+	pRequest = new CFileRequest;
+    }
+    return pRequest;
+}
+
+void
+CAsyncFileReader::FreeRequest(__in CFileRequest *pRequest)
+{
+    CAutoLock lck(&m_csRequests);
+    if (m_lFree.AddHead(pRequest) == NULL) {
+	delete pRequest;
+    }
+}
+
+// worker threads - only used when we can't do overlapped reads
+
+HRESULT
+CAsyncFileReader::StartWorkers()
+{
+    m_bTerminate = FALSE;
+    m_hWorkSem = CreateSemaphore(NULL, 0, 0x7FFFFFFF, NULL);
+    if (m_hWorkSem == NULL) {
+	return AmHresultFromWin32(GetLastError());
+    }
+    for (m_cWorkers = 0; m_cWorkers < cWorkers; m_cWorkers++) {
+	DWORD dwThreadId;
+	m_ahWorkers[m_cWorkers] = CreateThread(NULL,
+					       0,
+					       InitialWorkerProc,
+					       (LPVOID) this,
+					       0,
+					       &dwThreadId);
+	if (m_ahWorkers[m_cWorkers] == NULL) {
+	    DWORD dwError = GetLastError();
+	    if (m_cWorkers == 0) {
+		return AmHresultFromWin32(dwError);
+	    }
+	    // make do with what we've got
+	    break;
+	}
+    }
+    return S_OK;
+}
+
+void
+CAsyncFileReader::StopWorkers()
+{
+    if (m_cWorkers != 0) {
+	{
+	    CAutoLock lck(&m_csRequests);
+	    m_bTerminate = TRUE;
+	}
+	ReleaseSemaphore(m_hWorkSem, m_cWorkers, NULL);
+	WaitForMultipleObjects(m_cWorkers, m_ahWorkers, TRUE, INFINITE);
+	while (m_cWorkers != 0) {
+	    EXECUTE_ASSERT(CloseHandle(m_ahWorkers[--m_cWorkers]));
+	}
+    }
+    if (m_hWorkSem != NULL) {
+	EXECUTE_ASSERT(CloseHandle(m_hWorkSem));
+	m_hWorkSem = NULL;
+    }
+}
+
+DWORD WINAPI
+CAsyncFileReader::InitialWorkerProc(__in LPVOID pv)
+{
+    CAsyncFileReader *pReader = (CAsyncFileReader *) pv;
+    return pReader->WorkerProc();
+}
+
+DWORD
+CAsyncFileReader::WorkerProc()
+{
+    while (TRUE) {
+	WaitForSingleObject(m_hWorkSem, INFINITE);
+
+	CFileRequest *pRequest;
+	{
+	    CAutoLock lck(&m_csRequests);
+	    if (m_bTerminate) {
+		return 0;
+	    }
+	    pRequest = m_lWork.RemoveHead();
+	}
+	if (pRequest == NULL) {
+	    continue;
+	}
+
+	// a positioned read on a synchronous handle waits for the data
+	DWORD cbRead = 0;
+	pRequest->m_dwError = 0;
+	if (m_bFlushing) {
+	    pRequest->m_dwError = ERROR_OPERATION_ABORTED;
+	} else {
+	    BYTE *pBuffer;
+	    EXECUTE_ASSERT(SUCCEEDED(pRequest->m_pSample->GetPointer(&pBuffer)));
+	    LONG lRead = (LONG) ((pRequest->m_lLength + (LONGLONG) m_lAlign - 1) & ~(LONGLONG) (m_lAlign - 1));
+	    if (!ReadFile(m_hFile, pBuffer, lRead, &cbRead, &pRequest->m_Overlapped)) {
+		pRequest->m_dwError = GetLastError();
+	    }
+	}
+
+	PostQueuedCompletionStatus(m_hPort, cbRead, KeyWorker, &pRequest->m_Overlapped);
+    }
+}
+
+// Work out which bytes a sample's times ask for, and check we can read
+// them with the alignment we need
+HRESULT
+CAsyncFileReader::GetSampleRange(
+    __in IMediaSample *pSample,
+    __out LONGLONG *pllPos,
+    __out LONG *plLength)
+{
+    REFERENCE_TIME tStart, tStop;
+    HRESULT hr = pSample->GetTime(&tStart, &tStop);
+    if (FAILED(hr)) {
+	return hr;
+    }
+    LONGLONG llPos = tStart / UNITS;
+    LONGLONG llEnd = tStop / UNITS;
+
+    if (llPos < 0 || llEnd < llPos) {
+	return E_INVALIDARG;
+    }
+    if (llPos >= m_llLength) {
+	return HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+    }
+
+    // a short read at the end of the file is fine
+    if (llEnd > m_llLength) {
+	llEnd = m_llLength;
+    }
+
+    // anything else must be whole sectors, into a buffer that holds them
+    if ((llPos & (m_lAlign - 1)) ||
+	(llEnd < m_llLength && (llEnd & (m_lAlign - 1)))) {
+	return VFW_E_BADALIGN;
+    }
+    LONGLONG llRead = ((llEnd - llPos) + m_lAlign - 1) & ~(LONGLONG) (m_lAlign - 1);
+    if (llRead > pSample->GetSize()) {
+	return VFW_E_BUFFER_OVERFLOW;
+    }
+
+    *pllPos = llPos;
+    *plLength = (LONG) (llEnd - llPos);
+    return S_OK;
+}
+
+// Read with the request handle and wait for it.  If that handle is
+// bound to our port we mustn't let the completion go there, which
+// setting the low bit of the event handle prevents
+HRESULT
+CAsyncFileReader::ReadAt(
+    LONGLONG llPos,
+    LONG lLength,
+    __out_bcount(lLength) BYTE *pBuffer,
+    __out LONG *plRead)
+{
+    OVERLAPPED Overlapped;
+    ZeroMemory(&Overlapped, sizeof(Overlapped));
+    Overlapped.Offset = (DWORD) llPos;
+    Overlapped.OffsetHigh = (DWORD) (llPos >> 32);
+
+    HANDLE hEvent = NULL;
+    if (!m_bWorkers) {
+	hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (hEvent == NULL) {
+	    return AmHresultFromWin32(GetLastError());
+	}
+	Overlapped.hEvent = (HANDLE) ((DWORD_PTR) hEvent | 1);
+    }
+
+    DWORD cbRead = 0;
+    BOOL bOK = ReadFile(m_hFile, pBuffer, lLength, &cbRead, &Overlapped);
+    if (!bOK && GetLastError() == ERROR_IO_PENDING) {
+	bOK = GetOverlappedResult(m_hFile, &Overlapped, &cbRead, TRUE);
+    }
+    DWORD dwError = bOK ? 0 : GetLastError();
+
+    if (hEvent != NULL) {
+	EXECUTE_ASSERT(CloseHandle(hEvent));
+    }
+    if (dwError != 0 && dwError != ERROR_HANDLE_EOF) {
+	return AmHresultFromWin32(dwError);
+    }
+    *plRead = (LONG) cbRead;
+    return S_OK;
+}
+
+// Map the view a request needs.  Views have to start on the allocation
+// granularity, so the data is generally some way into the view.  Ask for
+// it to be paged in now, which is cheaper than faulting it in a page at a
+// time when the sample is first touched
+HRESULT
+CAsyncFileReader::MapSample(
+    __in IMediaSample *pSample,
+    LONGLONG llPos,
+    LONG lLength)
+{
+    LONGLONG llBase = llPos & ~(LONGLONG) (m_dwGranularity - 1);
+    SIZE_T cbView = (SIZE_T) (llPos - llBase) + lLength;
+    PVOID pView = MapViewOfFile(m_hMapping,
+				FILE_MAP_COPY,
+				(DWORD) (llBase >> 32),
+				(DWORD) llBase,
+				cbView);
+    if (pView == NULL) {
+	return AmHresultFromWin32(GetLastError());
+    }
+    BYTE *pData = (BYTE *) pView + (llPos - llBase);
+    PrefetchRange(pData, lLength);
+
+    CMappedFileSample *pMapped = m_pMapAlloc ? m_pMapAlloc->FindSample(pSample) : NULL;
+    if (pMapped == NULL) {
+	// someone else's buffer - we can still save them the read
+	BYTE *pBuffer;
+	HRESULT hr = pSample->GetPointer(&pBuffer);
+	if (SUCCEEDED(hr)) {
+	    CopyMemory(pBuffer, pData, lLength);
+	    hr = pSample->SetActualDataLength(lLength);
+	}
+	EXECUTE_ASSERT(UnmapViewOfFile(pView));
+	return hr;
+    }
+
+    // asked again without being released in between
+    if (pMapped->m_pView) {
+	EXECUTE_ASSERT(UnmapViewOfFile(pMapped->m_pView));
+    }
+    pMapped->m_pView = pView;
+    return pMapped->SetPointer(pData, lLength);
+}
+
+// IAsyncReader methods
+
+// Insist on our alignment, otherwise as the SDK async reader does -
+// take the preferred allocator if it will do, or make our own.  When
+// mapped it always has to be our own
+STDMETHODIMP
+CAsyncFileReader::RequestAllocator(
+    IMemAllocator* pPreferred,
+    __in ALLOCATOR_PROPERTIES* pProps,
+    __deref_out IMemAllocator ** ppActual)
+{
+    CheckPointer(pProps, E_POINTER);
+    CheckPointer(ppActual, E_POINTER);
+    *ppActual = NULL;
+
+    ALLOCATOR_PROPERTIES Request = *pProps;
+    if (Request.cbAlign < m_lAlign) {
+	Request.cbAlign = m_lAlign;
+    }
+    Request.cbPrefix = (LONG) (((LONGLONG) Request.cbPrefix + m_lAlign - 1) & ~(LONGLONG) (m_lAlign - 1));
+    Request.cbBuffer = (LONG) (((LONGLONG) Request.cbBuffer + m_lAlign - 1) & ~(LONGLONG) (m_lAlign - 1));
+
+    ALLOCATOR_PROPERTIES Actual;
+    HRESULT hr;
+
+    // mapped samples only come from us - a fresh allocator each time, as
+    // the last one may still be committed to someone
+    if (m_hMapping) {
+	hr = S_OK;
+	CMappedFileAllocator *pMapAlloc = new CMappedFileAllocator(NAME("Mapped file allocator"), &hr);
+	if (pMapAlloc == NULL) {
+	    return E_OUTOFMEMORY;
+	}
+	pMapAlloc->AddRef();
+	if (SUCCEEDED(hr)) {
+	    hr = pMapAlloc->SetProperties(&Request, &Actual);
+	}
+	if (FAILED(hr)) {
+	    pMapAlloc->Release();
+	    return hr;
+	}
+
+	if (m_pMapAlloc) {
+	    m_pMapAlloc->Release();
+	}
+	m_pMapAlloc = pMapAlloc;
+	m_pMapAlloc->AddRef();
+	*ppActual = pMapAlloc;
+	return S_OK;
+    }
+
+    if (pPreferred) {
+	hr = pPreferred->SetProperties(&Request, &Actual);
+	if (SUCCEEDED(hr) &&
+	    (Actual.cbAlign % m_lAlign) == 0 &&
+	    (Actual.cbPrefix % m_lAlign) == 0) {
+	    pPreferred->AddRef();
+	    *ppActual = pPreferred;
+	    return S_OK;
+	}
+    }
+
+    // create our own allocator
+    hr = S_OK;
+    CMemAllocator *pMemObject = new CMemAllocator(NAME("Async file allocator"), NULL, &hr);
+    if (pMemObject == NULL) {
+	return E_OUTOFMEMORY;
+    }
+    if (FAILED(hr)) {
+	delete pMemObject;
+	return hr;
+    }
+
+    IMemAllocator *pAlloc;
+    hr = pMemObject->QueryInterface(IID_IMemAllocator, (void **) &pAlloc);
+    if (FAILED(hr)) {
+	delete pMemObject;
+	return E_NOINTERFACE;
+    }
+
+    hr = pAlloc->SetProperties(&Request, &Actual);
+    if (SUCCEEDED(hr) &&
+	((Actual.cbAlign % m_lAlign) != 0 || (Actual.cbPrefix % m_lAlign) != 0)) {
+	hr = VFW_E_BADALIGN;
+    }
+    if (FAILED(hr)) {
+	pAlloc->Release();
+	return hr;
+    }
+
+    *ppActual = pAlloc;
+    return S_OK;
+}
+
+// Queue a read of the bytes the sample's times ask for.  We hold the
+// caller's reference on the sample until WaitForNext returns it
+STDMETHODIMP
+CAsyncFileReader::Request(
+    IMediaSample* pSample,
+    DWORD_PTR dwUser)
+{
+    CheckPointer(pSample, E_POINTER);
+    if (m_hSyncFile == INVALID_HANDLE_VALUE) {
+	return E_UNEXPECTED;
+    }
+    if (m_bFlushing) {
+	return VFW_E_WRONG_STATE;
+    }
+
+    LONGLONG llPos;
+    LONG lLength;
+    HRESULT hr = GetSampleRange(pSample, &llPos, &lLength);
+    if (FAILED(hr)) {
+	return hr;
+    }
+
+    // mapped requests are done as soon as they are made
+    BYTE *pBuffer = NULL;
+    if (m_hMapping) {
+	hr = MapSample(pSample, llPos, lLength);
+    } else {
+	hr = pSample->GetPointer(&pBuffer);
+    }
+    if (FAILED(hr)) {
+	return hr;
+    }
+
+    CFileRequest *pRequest = NewRequest();
+    if (pRequest == NULL) {
+	return E_OUTOFMEMORY;
+    }
+    ZeroMemory(&pRequest->m_Overlapped, sizeof(pRequest->m_Overlapped));
+    pRequest->m_Overlapped.Offset = (DWORD) llPos;
+    pRequest->m_Overlapped.OffsetHigh = (DWORD) (llPos >> 32);
+    pRequest->m_pSample = pSample;
+    pRequest->m_dwUser = dwUser;
+    pRequest->m_lLength = lLength;
+    pRequest->m_dwError = 0;
+
+    InterlockedIncrement(&m_cOutstanding);
+
+    if (m_hMapping) {
+	if (!PostQueuedCompletionStatus(m_hPort, lLength, KeyMapped, &pRequest->m_Overlapped)) {
+	    DWORD dwError = GetLastError();
+	    FreeRequest(pRequest);
+	    InterlockedDecrement(&m_cOutstanding);
+	    return AmHresultFromWin32(dwError);
+	}
+	return S_OK;
+    }
+
+    if (m_bWorkers) {
+	POSITION pos;
+	{
+	    CAutoLock lck(&m_csRequests);
+	    pos = m_lWork.AddTail(pRequest);
+	}
+	if (pos == NULL) {
+	    FreeRequest(pRequest);
+	    InterlockedDecrement(&m_cOutstanding);
+	    return E_OUTOFMEMORY;
+	}
+	ReleaseSemaphore(m_hWorkSem, 1, NULL);
+	return S_OK;
+    }
+
+    // whether it finishes now or later the completion goes to the port
+    LONG lRead = (LONG) (((LONGLONG) lLength + m_lAlign - 1) & ~(LONGLONG) (m_lAlign - 1));
+    if (!ReadFile(m_hFile, pBuffer, lRead, NULL, &pRequest->m_Overlapped)) {
+	DWORD dwError = GetLastError();
+	if (dwError != ERROR_IO_PENDING) {
+	    FreeRequest(pRequest);
+	    InterlockedDecrement(&m_cOutstanding);
+	    return AmHresultFromWin32(dwError);
+	}
+    }
+    return S_OK;
+}
+
+// Collect the next read to finish - not necessarily in the order they
+// were requested, so callers reorder by dwUser (see asyncfile.h).  While
+// flushing we hand back everything still outstanding with
+// VFW_E_WRONG_STATE, waiting for it if need be so that a caller cleaning
+// up with a zero timeout gets all its samples back
+STDMETHODIMP
+CAsyncFileReader::WaitForNext(
+    DWORD dwTimeout,
+    __deref_out IMediaSample** ppSample,
+    __out DWORD_PTR * pdwUser)
+{
+    CheckPointer(ppSample, E_POINTER);
+    CheckPointer(pdwUser, E_POINTER);
+    *ppSample = NULL;
+    *pdwUser = 0;
+
+    if (m_hPort == NULL) {
+	return E_UNEXPECTED;
+    }
+
+    while (TRUE) {
+	DWORD dwWait = dwTimeout;
+	if (m_bFlushing) {
+	    if (m_cOutstanding == 0) {
+		return VFW_E_WRONG_STATE;
+	    }
+	    dwWait = INFINITE;
+	}
+
+	DWORD cbDone = 0;
+	ULONG_PTR ulKey = 0;
+	LPOVERLAPPED pOverlapped = NULL;
+	BOOL bOK = GetQueuedCompletionStatus(m_hPort, &cbDone, &ulKey, &pOverlapped, dwWait);
+	if (pOverlapped == NULL) {
+	    if (!bOK) {
+		DWORD dwError = GetLastError();
+		return dwError == WAIT_TIMEOUT ? VFW_E_TIMEOUT : AmHresultFromWin32(dwError);
+	    }
+
+	    // woken by BeginFlush - look again
+	    ASSERT(ulKey == KeyWake);
+	    continue;
+	}
+
+	// mapped requests had their data when they were made, and only
+	// worker threads set m_dwError
+	CFileRequest *pRequest = (CFileRequest *) pOverlapped;
+	DWORD dwError;
+	switch (ulKey) {
+	case KeyFile:
+	    dwError = bOK ? 0 : GetLastError();
+	    break;
+	case KeyWorker:
+	    dwError = pRequest->m_dwError;
+	    break;
+	default:
+	    ASSERT(ulKey == KeyMapped);
+	    dwError = 0;
+	    break;
+	}
+	LONG lLength = pRequest->m_lLength;
+	*ppSample = pRequest->m_pSample;
+	*pdwUser = pRequest->m_dwUser;
+	FreeRequest(pRequest);
+	InterlockedDecrement(&m_cOutstanding);
+
+	if (m_bFlushing) {
+	    return VFW_E_WRONG_STATE;
+	}
+	if (dwError != 0 && dwError != ERROR_HANDLE_EOF) {
+	    return AmHresultFromWin32(dwError);
+	}
+
+	// unbuffered reads may have gone past the end of what we wanted
+	LONG lRead = min((LONG) cbDone, lLength);
+	(*ppSample)->SetActualDataLength(lRead);
+	return lRead < lLength ? S_FALSE : S_OK;
+    }
+}
+
+STDMETHODIMP
+CAsyncFileReader::SyncReadAligned(
+    IMediaSample* pSample)
+{
+    CheckPointer(pSample, E_POINTER);
+    if (m_hSyncFile == INVALID_HANDLE_VALUE) {
+	return E_UNEXPECTED;
+    }
+
+    LONGLONG llPos;
+    LONG lLength;
+    HRESULT hr = GetSampleRange(pSample, &llPos, &lLength);
+    if (FAILED(hr)) {
+	return hr;
+    }
+    if (m_hMapping) {
+	return MapSample(pSample, llPos, lLength);
+    }
+    BYTE *pBuffer;
+    hr = pSample->GetPointer(&pBuffer);
+    if (FAILED(hr)) {
+	return hr;
+    }
+
+    LONG lRead = (LONG) (((LONGLONG) lLength + m_lAlign - 1) & ~(LONGLONG) (m_lAlign - 1));
+    hr = ReadAt(llPos, lRead, pBuffer, &lRead);
+    if (FAILED(hr)) {
+	return hr;
+    }
+    lRead = min(lRead, lLength);
+    pSample->SetActualDataLength(lRead);
+    return lRead < lLength ? S_FALSE : S_OK;
+}
+
+// Any position and length - so this goes through the cached handle
+STDMETHODIMP
+CAsyncFileReader::SyncRead(
+    LONGLONG llPosition,
+    LONG lLength,
+    __out_bcount(lLength) BYTE* pBuffer)
+{
+    CheckPointer(pBuffer, E_POINTER);
+    if (m_hSyncFile == INVALID_HANDLE_VALUE) {
+	return E_UNEXPECTED;
+    }
+    if (llPosition < 0 || lLength < 0) {
+	return E_INVALIDARG;
+    }
+
+    OVERLAPPED Overlapped;
+    ZeroMemory(&Overlapped, sizeof(Overlapped));
+    Overlapped.Offset = (DWORD) llPosition;
+    Overlapped.OffsetHigh = (DWORD) (llPosition >> 32);
+
+    DWORD cbRead = 0;
+    if (!ReadFile(m_hSyncFile, pBuffer, lLength, &cbRead, &Overlapped)) {
+	DWORD dwError = GetLastError();
+	if (dwError != ERROR_HANDLE_EOF) {
+	    return AmHresultFromWin32(dwError);
+	}
+    }
+    return (LONG) cbRead < lLength ? S_FALSE : S_OK;
+}
+
+STDMETHODIMP
+CAsyncFileReader::Length(
+    __out LONGLONG* pTotal,
+    __out LONGLONG* pAvailable)
+{
+    CheckPointer(pTotal, E_POINTER);
+    CheckPointer(pAvailable, E_POINTER);
+    if (m_hSyncFile == INVALID_HANDLE_VALUE) {
+	return E_UNEXPECTED;
+    }
+    *pTotal = m_llLength;
+    *pAvailable = m_llLength;
+    return S_OK;
+}
+
+// Cancel everything outstanding.  Those reads, and any that were still
+// waiting for a worker, come back through WaitForNext as failures
+STDMETHODIMP
+CAsyncFileReader::BeginFlush(void)
+{
+    if (m_hPort == NULL) {
+	return E_UNEXPECTED;
+    }
+
+    m_bFlushing = TRUE;
+    MemoryBarrier();
+
+    if (!m_bWorkers && m_hFile != INVALID_HANDLE_VALUE) {
+	CancelIoEx(m_hFile, NULL);
+    }
+
+    // wake anyone waiting for a read that was never issued
+    PostQueuedCompletionStatus(m_hPort, 0, KeyWake, NULL);
+    return S_OK;
+}
+
+STDMETHODIMP
+CAsyncFileReader::EndFlush(void)
+{
+    m_bFlushing = FALSE;
+    return S_OK;
+}
@@ -0,0 +1,238 @@
+//------------------------------------------------------------------------------
+// File: AsyncFile.h
+//
+// Desc: DirectShow base classes - defines CAsyncFileReader, an
+//       IAsyncReader implementation that reads from a file.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#ifndef __ASYNCFILE_H__
+#define __ASYNCFILE_H__
+
+//
+// CAsyncFileReader
+//
+// Object exposing IAsyncReader on top of a disk file, for use by a
+// CPullPin (or anything else that pulls data).  It can be handed straight
+// to CPullPin::Connect, or aggregated by the output pin of a source
+// filter which then passes QueryInterface(IID_IAsyncReader) on to it.
+//
+// Requests are issued as overlapped reads and their completions collected
+// from an I/O completion port, so any number can be in flight at once and
+// WaitForNext costs one call into the kernel per sample.  Where overlapped
+// reads are not available, or if AM_ASYNCFILE_WORKERS is passed to Open,
+// a small pool of worker threads does positioned synchronous reads
+// instead and posts their results to the same port.
+//
+// WaitForNext returns each read as it finishes, which with more than one
+// in flight need not be the order they were requested in - the async
+// reader in the SDK samples happened to keep them in order, but nothing
+// in IAsyncReader promises it.  A caller that needs the data in order
+// must tag each request through dwUser and put the completions back in
+// order itself, as CPullPin does.  Doing it here instead would hold a
+// finished read back behind a slower one the caller may not even need
+// yet.
+//
+// With AM_ASYNCFILE_UNBUFFERED the file is opened to bypass the system
+// cache.  The disk then transfers straight into the sample buffers, which
+// requires every read to start at, and be a multiple of, the volume's
+// sector size and every buffer to be aligned to it - so RequestAllocator
+// insists on at least that alignment.  SyncRead, which can be asked for
+// any range at all, always goes through a second, cached, handle.
+//
+// With AM_ASYNCFILE_MAPPED nothing is copied at all.  The file is mapped
+// and RequestAllocator always hands back an allocator of our own, whose
+// samples have no memory until Request points them straight into a view
+// of the mapping.  The view is copy-on-write, so downstream filters may
+// still write to the buffer, and is unmapped again when the sample is
+// released.  Where the system supports it we ask for the pages of each
+// view to be read in ahead of being touched.  Samples from any other
+// allocator are still filled, by copying from the mapping.
+//
+
+#define AM_ASYNCFILE_UNBUFFERED     0x00000001  // bypass the system cache
+#define AM_ASYNCFILE_WORKERS        0x00000002  // use worker threads, not overlapped reads
+#define AM_ASYNCFILE_MAPPED         0x00000004  // samples point into a mapping of the file
+#define AM_ASYNCFILE_VALIDFLAGS     0x00000007
+
+//
+// CMappedFileSample / CMappedFileAllocator
+//
+// The samples CAsyncFileReader hands out in AM_ASYNCFILE_MAPPED mode.
+// They are created without any memory; the reader maps the range each one
+// is asked for and releasing the sample unmaps it again.
+//
+
+class CMappedFileSample : public CMediaSample
+{
+    friend class CMappedFileAllocator;
+    friend class CAsyncFileReader;
+
+    PVOID m_pView;              // base of our view, NULL if none
+
+public:
+
+    CMappedFileSample(
+        __in_opt LPCTSTR pName,
+        __in CBaseAllocator *pAllocator,
+        __inout HRESULT *phr,
+        LONG lSize);
+};
+
+class CMappedFileAllocator : public CBaseAllocator
+{
+    // every sample we made, so we can recognise our own
+    CMappedFileSample **m_ppSamples;
+
+protected:
+
+    // samples are kept until we are deleted, like CMemAllocator
+    void Free(void);
+    void ReallyFree(void);
+
+    // creates the samples when Commit is called
+    HRESULT Alloc(void);
+
+public:
+
+    CMappedFileAllocator(__in_opt LPCTSTR , __inout HRESULT *);
+    ~CMappedFileAllocator();
+
+    // there is nowhere to put a prefix, so we never agree to one
+    STDMETHODIMP SetProperties(
+		    __in ALLOCATOR_PROPERTIES* pRequest,
+		    __out ALLOCATOR_PROPERTIES* pActual);
+
+    // unmaps the sample's view then recycles it
+    STDMETHODIMP ReleaseBuffer(IMediaSample *pBuffer);
+
+    // returns NULL if pSample isn't one of ours
+    CMappedFileSample *FindSample(__in IMediaSample *pSample);
+};
+
+class CAsyncFileReader : public CUnknown, public IAsyncReader
+{
+    // One read - from Request until it is returned by WaitForNext
+    struct CFileRequest {
+	OVERLAPPED      m_Overlapped;       // must be first
+	IMediaSample *  m_pSample;
+	DWORD_PTR       m_dwUser;
+	LONG            m_lLength;          // bytes wanted
+	DWORD           m_dwError;          // only set by worker threads
+    };
+
+    // completion keys
+    enum { KeyFile = 1,     // an overlapped read finished
+	   KeyWorker,       // a worker thread finished a read
+	   KeyMapped,       // a request was mapped from the file
+	   KeyWake };       // BeginFlush waking a waiter up
+
+    enum { cWorkers = 4 };
+
+    HANDLE          m_hFile;            // for requests
+    HANDLE          m_hSyncFile;        // cached handle for SyncRead
+    HANDLE          m_hPort;            // completion port
+    LONGLONG        m_llLength;
+    LONG            m_lAlign;           // required alignment
+    BOOL            m_bWorkers;         // no overlapped reads
+
+    // AM_ASYNCFILE_MAPPED only
+    HANDLE          m_hMapping;
+    DWORD           m_dwGranularity;    // views must start on this
+    CMappedFileAllocator *m_pMapAlloc;  // the last one we handed out
+
+    CCritSec        m_csRequests;       // protects the lists
+    CGenericList<CFileRequest> m_lFree; // recycled requests
+    CGenericList<CFileRequest> m_lWork; // waiting for a worker
+    HANDLE          m_hWorkSem;
+    HANDLE          m_ahWorkers[cWorkers];
+    LONG            m_cWorkers;
+
+    volatile LONG   m_cOutstanding;     // requests not yet collected
+    volatile BOOL   m_bFlushing;
+    BOOL            m_bTerminate;
+
+    CFileRequest *  NewRequest();
+    void            FreeRequest(__in CFileRequest *pRequest);
+
+    HRESULT         StartWorkers();
+    void            StopWorkers();
+    static DWORD WINAPI InitialWorkerProc(__in LPVOID pv);
+    DWORD           WorkerProc();
+
+    // range a sample covers - checked against our alignment
+    HRESULT         GetSampleRange(
+			__in IMediaSample *pSample,
+			__out LONGLONG *pllPos,
+			__out LONG *plLength);
+
+    // read with the request handle, waiting for it to finish
+    HRESULT         ReadAt(
+			LONGLONG llPos,
+			LONG lLength,
+			__out_bcount(lLength) BYTE *pBuffer,
+			__out LONG *plRead);
+
+    // point a sample at the range it asks for, or copy it there if it
+    // isn't one of ours
+    HRESULT         MapSample(
+			__in IMediaSample *pSample,
+			LONGLONG llPos,
+			LONG lLength);
+
+public:
+
+    CAsyncFileReader(
+	__in_opt LPCTSTR pName,
+	__inout_opt LPUNKNOWN pUnk,
+	__inout HRESULT *phr);
+    ~CAsyncFileReader();
+
+    DECLARE_IUNKNOWN
+    STDMETHODIMP NonDelegatingQueryInterface(REFIID riid, __deref_out void **ppv);
+
+    // open the file - see AM_ASYNCFILE_xxx for dwFlags
+    HRESULT Open(__in LPCTSTR pszFileName, DWORD dwFlags = 0);
+
+    // close it again - no requests may be outstanding
+    void Close();
+
+    // alignment RequestAllocator will insist on
+    LONG GetAlignment() const { return m_lAlign; };
+
+    // IAsyncReader methods
+
+    STDMETHODIMP RequestAllocator(
+		    IMemAllocator* pPreferred,
+		    __in ALLOCATOR_PROPERTIES* pProps,
+		    __deref_out IMemAllocator ** ppActual);
+
+    STDMETHODIMP Request(
+		    IMediaSample* pSample,
+		    DWORD_PTR dwUser);
+
+    // completions come back in the order they finish, not as requested
+    STDMETHODIMP WaitForNext(
+		    DWORD dwTimeout,
+		    __deref_out IMediaSample** ppSample,
+		    __out DWORD_PTR * pdwUser);
+
+    STDMETHODIMP SyncReadAligned(
+		    IMediaSample* pSample);
+
+    STDMETHODIMP SyncRead(
+		    LONGLONG llPosition,
+		    LONG lLength,
+		    __out_bcount(lLength) BYTE* pBuffer);
+
+    STDMETHODIMP Length(
+		    __out LONGLONG* pTotal,
+		    __out LONGLONG* pAvailable);
+
+    STDMETHODIMP BeginFlush(void);
+    STDMETHODIMP EndFlush(void);
+};
+
+#endif //__ASYNCFILE_H__
@@ -229,6 +229,10 @@ VOID PERFLOG_STREAMTRACE(
     ULONGLONG Data4
     )
 {
+    if (CAMStreamTrace::IsEnabled())
+    {
+        CAMStreamTrace::RecordStreamTrace( Id, DShowClock, Data1, Data2, Data3, Data4 );
+    }
     if (Level <= PerflogModuleLevel)
     {
         PERFINFO_WMI_STREAMTRACE perfData;
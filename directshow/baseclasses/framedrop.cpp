@@ -0,0 +1,94 @@
+//------------------------------------------------------------------------------
+// File: FrameDrop.cpp
+//
+// Desc: DirectShow base classes - implements CAMFrameDropPredictor.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#include <streams.h>
+
+
+void CAMFrameDropPredictor::Reset()
+{
+    for (int i = 0; i < 3; i++) {
+        m_artCost[i] = 0;
+        m_artDeviation[i] = 0;
+    }
+}
+
+
+// Running averages that follow the last 8 frames or so of each type
+
+void CAMFrameDropPredictor::AddCost(int iType, REFERENCE_TIME rtCost)
+{
+    if (iType < AM_VIDEO_FRAME_KEY || iType > AM_VIDEO_FRAME_B) {
+        return;
+    }
+    const int i = iType - AM_VIDEO_FRAME_KEY;
+    rtCost = max(rtCost, 1);
+    if (m_artCost[i] == 0) {
+        m_artCost[i] = rtCost;
+        m_artDeviation[i] = rtCost / 4;
+    } else {
+        REFERENCE_TIME rtDiff = rtCost - m_artCost[i];
+        m_artCost[i] = max(m_artCost[i] + rtDiff / 8, 1);
+        m_artDeviation[i] += ((rtDiff < 0 ? -rtDiff : rtDiff) - m_artDeviation[i]) / 8;
+    }
+}
+
+
+// Allow for the frame being a bit worse than average. Until we have seen a
+// B frame, guess that it costs what a delta frame does
+
+REFERENCE_TIME CAMFrameDropPredictor::GetCost(int iType) const
+{
+    if (iType < AM_VIDEO_FRAME_KEY || iType > AM_VIDEO_FRAME_B) {
+        return 0;
+    }
+    int i = iType - AM_VIDEO_FRAME_KEY;
+    if (m_artCost[i] == 0 && iType == AM_VIDEO_FRAME_B) {
+        i = AM_VIDEO_FRAME_DELTA - AM_VIDEO_FRAME_KEY;
+    }
+    if (m_artCost[i] == 0) {
+        return 0;
+    }
+    return m_artCost[i] + m_artDeviation[i];
+}
+
+
+BOOL CAMFrameDropPredictor::ShouldDrop(
+    int iType,
+    REFERENCE_TIME rtNow,
+    REFERENCE_TIME rtDue,
+    REFERENCE_TIME rtFrame,
+    int nTillKey) const
+{
+    const REFERENCE_TIME rtCost = GetCost(iType);
+    if (iType == AM_VIDEO_FRAME_KEY || rtCost == 0 || rtFrame <= 0) {
+        return FALSE;
+    }
+
+    // nothing depends on a B frame, so we only lose the one
+    if (iType == AM_VIDEO_FRAME_B) {
+        return rtNow + rtCost > rtDue;
+    }
+
+    // As ShouldSkipFrame says, if we take a small fraction of the frame
+    // time the trouble is somewhere else, and we don't know how long the
+    // skip would last unless we know when the next key frame is
+    if (rtCost * 4 <= rtFrame || nTillKey < 0) {
+        return FALSE;
+    }
+
+    // how late the next key frame would be if we decoded everything up to
+    // it, and whether skipping to it would freeze the picture for longer
+    REFERENCE_TIME rtKeyCost = GetCost(AM_VIDEO_FRAME_KEY);
+    if (rtKeyCost == 0) {
+        rtKeyCost = rtCost;
+    }
+    const REFERENCE_TIME rtLateAtKey =
+        rtNow + nTillKey * rtCost + rtKeyCost - (rtDue + nTillKey * rtFrame);
+    return rtLateAtKey > rtFrame && (nTillKey - 1) * rtFrame < rtLateAtKey;
+}
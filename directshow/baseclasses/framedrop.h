@@ -0,0 +1,57 @@
+//------------------------------------------------------------------------------
+// File: FrameDrop.h
+//
+// Desc: DirectShow base classes - defines CAMFrameDropPredictor, which
+//       CVideoTransformFilter uses to drop frames before they are late.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#ifndef __FRAMEDROP__
+#define __FRAMEDROP__
+
+// Frame types, as logged to m_idFrameType - see CVideoTransformFilter
+#define AM_VIDEO_FRAME_KEY      1       // I frame or AVI key frame
+#define AM_VIDEO_FRAME_DELTA    2       // P frame or AVI non-key frame
+#define AM_VIDEO_FRAME_B        3       // B frame - nothing depends on it
+
+// Predicts which frames will be late from what each type of frame has cost
+// to decode, so they can be dropped before the lateness builds up. It only
+// deals in times, so its decisions can be replayed from a log of them.
+//
+// A B frame is dropped if decoding it would make it late. A delta frame
+// can't be dropped without dropping every frame up to the next key frame,
+// so that only happens once decoding them all would leave the key frame
+// more than a frame late, and the gap until it is no longer than that
+// lateness. Key frames are never dropped.
+
+class CAMFrameDropPredictor
+{
+    REFERENCE_TIME m_artCost[3];        // average cost of each type, or 0
+    REFERENCE_TIME m_artDeviation[3];   // and its mean deviation
+
+  public:
+
+    CAMFrameDropPredictor() { Reset(); };
+    void Reset();
+
+    // a frame of type iType took rtCost to decode
+    void AddCost(int iType, REFERENCE_TIME rtCost);
+
+    // what we expect a frame of type iType to take - 0 if we don't know
+    REFERENCE_TIME GetCost(int iType) const;
+
+    // Should the frame be dropped? rtNow is the stream time now, rtDue
+    // when the frame is due and rtFrame its duration. nTillKey is how many
+    // frames, including this one, we expect before the next key frame, or
+    // -1 if we have no idea
+    BOOL ShouldDrop(
+        int iType,
+        REFERENCE_TIME rtNow,
+        REFERENCE_TIME rtDue,
+        REFERENCE_TIME rtFrame,
+        int nTillKey) const;
+};
+
+#endif // __FRAMEDROP__
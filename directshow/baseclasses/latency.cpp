@@ -0,0 +1,270 @@
+//------------------------------------------------------------------------------
+// File: Latency.cpp
+//
+// Desc: DirectShow base classes - implements the sample latency helpers.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#include <streams.h>
+#include <intrin.h>
+
+
+// {D5439A9B-AC15-4CB8-8544-FA71EB0487BE}
+EXTERN_C const IID IID_IAMSampleLatency =
+    { 0xd5439a9b, 0xac15, 0x4cb8, { 0x85, 0x44, 0xfa, 0x71, 0xeb, 0x04, 0x87, 0xbe } };
+
+// {A3633DDA-1E05-4893-83FD-E2A148AB7A1D}
+EXTERN_C const IID IID_IAMLatencyStatistics =
+    { 0xa3633dda, 0x1e05, 0x4893, { 0x83, 0xfd, 0xe2, 0xa1, 0x48, 0xab, 0x7a, 0x1d } };
+
+
+// --- CAMLatencyHistogram -----------------------
+
+LONG
+CAMLatencyHistogram::Bucket(LONGLONG ll)
+{
+    if (ll < AM_LATENCY_LINEAR) {
+        return ll < 0 ? 0 : (LONG) ll;
+    }
+
+    // the top bit, and the 3 after it
+    ULONG iBit;
+    if ((ULONGLONG) ll >> 32) {
+        _BitScanReverse(&iBit, (ULONG) ((ULONGLONG) ll >> 32));
+        iBit += 32;
+    } else {
+        _BitScanReverse(&iBit, (ULONG) ll);
+    }
+    LONG iOctave = (LONG) iBit - 4;
+    if (iOctave >= AM_LATENCY_OCTAVES) {
+        return AM_LATENCY_BUCKETS - 1;
+    }
+    return AM_LATENCY_LINEAR + iOctave * 8 + (LONG) ((ll >> (iBit - 3)) & 7);
+}
+
+// the middle of a bucket
+
+LONGLONG
+CAMLatencyHistogram::BucketValue(LONG iBucket)
+{
+    if (iBucket < AM_LATENCY_LINEAR) {
+        return iBucket;
+    }
+    LONG iShift = (iBucket - AM_LATENCY_LINEAR) / 8 + 1;
+    LONGLONG llLow = (LONGLONG) (8 + (iBucket - AM_LATENCY_LINEAR) % 8) << iShift;
+    return llLow + ((LONGLONG) 1 << iShift) / 2;
+}
+
+void
+CAMLatencyHistogram::Add(LONGLONG ll)
+{
+    InterlockedIncrement(&m_aBuckets[Bucket(ll)]);
+    InterlockedIncrement(&m_cSamples);
+
+    LONGLONG llMax = m_llMax;
+    while (ll > llMax) {
+        LONGLONG llWas = InterlockedCompareExchange64(&m_llMax, ll, llMax);
+        if (llWas == llMax) {
+            break;
+        }
+        llMax = llWas;
+    }
+}
+
+// Samples may be added while we look, so the buckets can add up to more
+// than the count we started with
+
+void
+CAMLatencyHistogram::Get(__out AM_LATENCY_STATISTICS *pStats) const
+{
+    ZeroMemory(pStats, sizeof(*pStats));
+    pStats->cSamples = m_cSamples;
+    if (pStats->cSamples == 0) {
+        return;
+    }
+
+    // the rank each percentile is at, rounding up
+    const LONGLONG cSamples = pStats->cSamples;
+    const LONGLONG acRank[3] = {
+        (cSamples * 50 + 99) / 100,
+        (cSamples * 95 + 99) / 100,
+        (cSamples * 99 + 99) / 100
+    };
+    REFERENCE_TIME * const aprt[3] = { &pStats->rtP50, &pStats->rtP95, &pStats->rtP99 };
+
+    LONGLONG cSeen = 0;
+    int iPercentile = 0;
+    for (LONG iBucket = 0; iBucket < AM_LATENCY_BUCKETS && iPercentile < 3; iBucket++) {
+        cSeen += m_aBuckets[iBucket];
+        while (iPercentile < 3 && cSeen >= acRank[iPercentile]) {
+            *aprt[iPercentile++] = BucketValue(iBucket);
+        }
+    }
+
+    // none is over the largest one seen
+    pStats->rtMax = m_llMax;
+    for (int i = 0; i < 3; i++) {
+        if (*aprt[i] > pStats->rtMax) {
+            *aprt[i] = pStats->rtMax;
+        }
+    }
+}
+
+void
+CAMLatencyHistogram::Reset()
+{
+    for (LONG i = 0; i < AM_LATENCY_BUCKETS; i++) {
+        m_aBuckets[i] = 0;
+    }
+    m_cSamples = 0;
+    m_llMax = 0;
+}
+
+
+// --- CAMLatencyStatistics -----------------------
+
+void
+CAMLatencyStatistics::Record(LONGLONG llOrigin, LONGLONG llArrival, LONGLONG llNow)
+{
+    m_Filter.Add(CAMLatency::ToReferenceTime(llNow - (llArrival ? llArrival : llOrigin)));
+    m_Total.Add(CAMLatency::ToReferenceTime(llNow - llOrigin));
+}
+
+HRESULT
+CAMLatencyStatistics::Get(AM_LATENCY_KIND Kind, __out AM_LATENCY_STATISTICS *pStats) const
+{
+    switch (Kind) {
+    case AM_LATENCY_FILTER:
+        m_Filter.Get(pStats);
+        break;
+    case AM_LATENCY_TOTAL:
+        m_Total.Get(pStats);
+        break;
+    default:
+        return E_INVALIDARG;
+    }
+    return pStats->cSamples ? S_OK : S_FALSE;
+}
+
+void
+CAMLatencyStatistics::Reset()
+{
+    m_Filter.Reset();
+    m_Total.Reset();
+}
+
+
+// --- CAMLatency -----------------------
+
+volatile BOOL CAMLatency::m_bEnabled = FALSE;
+LONGLONG CAMLatency::m_llFrequency = 0;
+
+void
+CAMLatency::Enable(BOOL bEnable)
+{
+    if (m_llFrequency == 0) {
+        LARGE_INTEGER li;
+        QueryPerformanceFrequency(&li);
+        m_llFrequency = li.QuadPart;
+    }
+    m_bEnabled = bEnable;
+}
+
+LONGLONG
+CAMLatency::ToReferenceTime(LONGLONG llTicks)
+{
+    return llMulDiv(llTicks, UNITS, m_llFrequency, 0);
+}
+
+static IAMSampleLatency *GetSampleLatency(__in IMediaSample *pSample)
+{
+    IAMSampleLatency *pLatency;
+    if (FAILED(pSample->QueryInterface(IID_IAMSampleLatency, (void **) &pLatency))) {
+        return NULL;
+    }
+    return pLatency;
+}
+
+void
+CAMLatency::StampOrigin(__in IMediaSample *pSample)
+{
+    IAMSampleLatency *pLatency = GetSampleLatency(pSample);
+    if (pLatency) {
+        LARGE_INTEGER li;
+        QueryPerformanceCounter(&li);
+        pLatency->SetLatencyStamps(li.QuadPart, 0);
+        pLatency->Release();
+    }
+}
+
+void
+CAMLatency::StampArrival(__in IMediaSample *pSample)
+{
+    IAMSampleLatency *pLatency = GetSampleLatency(pSample);
+    if (pLatency) {
+        LONGLONG llOrigin, llArrival;
+        pLatency->GetLatencyStamps(&llOrigin, &llArrival);
+        if (llOrigin) {
+            LARGE_INTEGER li;
+            QueryPerformanceCounter(&li);
+            pLatency->SetLatencyStamps(llOrigin, li.QuadPart);
+        }
+        pLatency->Release();
+    }
+}
+
+void
+CAMLatency::CopyStamps(__in IMediaSample *pFrom, __in IMediaSample *pTo)
+{
+    IAMSampleLatency *pLatency = GetSampleLatency(pFrom);
+    if (pLatency == NULL) {
+        return;
+    }
+    LONGLONG llOrigin, llArrival;
+    pLatency->GetLatencyStamps(&llOrigin, &llArrival);
+    pLatency->Release();
+
+    pLatency = GetSampleLatency(pTo);
+    if (pLatency) {
+        pLatency->SetLatencyStamps(llOrigin, llArrival);
+        pLatency->Release();
+    }
+}
+
+void
+CAMLatency::RecordDeparture(
+    __in IMediaSample *pSample,
+    __deref_inout_opt CAMLatencyStatistics * volatile *ppStats)
+{
+    IAMSampleLatency *pLatency = GetSampleLatency(pSample);
+    if (pLatency == NULL) {
+        return;
+    }
+    LONGLONG llOrigin, llArrival;
+    pLatency->GetLatencyStamps(&llOrigin, &llArrival);
+    pLatency->Release();
+    if (llOrigin == 0) {
+        return;
+    }
+
+    LARGE_INTEGER li;
+    QueryPerformanceCounter(&li);
+
+    // a filter may deliver on more than one thread
+    CAMLatencyStatistics *pStats = *ppStats;
+    if (pStats == NULL) {
+        pStats = new CAMLatencyStatistics;
+        if (pStats == NULL) {
+            return;
+        }
+        CAMLatencyStatistics *pWas = (CAMLatencyStatistics *)
+            InterlockedCompareExchangePointer((PVOID volatile *) ppStats, pStats, NULL);
+        if (pWas) {
+            delete pStats;
+            pStats = pWas;
+        }
+    }
+    pStats->Record(llOrigin, llArrival, li.QuadPart);
+}
@@ -0,0 +1,161 @@
+//------------------------------------------------------------------------------
+// File: Latency.h
+//
+// Desc: DirectShow base classes - defines the interfaces and helpers for
+//       following how long samples take to get through the graph.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+/* Once CAMLatency::Enable(TRUE) has been called, samples from the base
+   class allocators carry two performance counter stamps through the graph,
+   which they expose through IAMSampleLatency:
+
+       origin   when CSourceStream got the buffer to fill
+       arrival  when the filter that has it now received it
+
+   CBaseInputPin::Receive sets the arrival. CTransformFilter and
+   CTransInPlaceFilter copy both stamps from the input sample to the output
+   sample, so they follow the data rather than the buffer.
+   CBaseOutputPin::Deliver then records in the delivering filter's
+   statistics how long the filter had the sample (since its arrival, or
+   since its origin for a source), and how long it has been since the
+   origin. CBaseRenderer records both when it is about to call
+   DoRenderSample.
+
+   Every CBaseFilter hands out its statistics through IAMLatencyStatistics
+   as the 50th, 95th and 99th percentiles and the maximum. The percentiles
+   come from a histogram whose buckets are an eighth of a power of 2 wide,
+   so are within about 6%.
+
+   Samples from other allocators don't support IAMSampleLatency and just
+   aren't stamped. With stamping off, each place above costs a test of a
+   global flag */
+
+
+#ifndef __LATENCY__
+#define __LATENCY__
+
+
+enum AM_LATENCY_KIND {
+    AM_LATENCY_FILTER,          // from arriving at the filter to leaving it
+    AM_LATENCY_TOTAL            // from the source to leaving the filter
+};
+
+struct AM_LATENCY_STATISTICS {
+    LONG            cSamples;
+    REFERENCE_TIME  rtP50;
+    REFERENCE_TIME  rtP95;
+    REFERENCE_TIME  rtP99;
+    REFERENCE_TIME  rtMax;
+};
+
+// {D5439A9B-AC15-4CB8-8544-FA71EB0487BE}
+EXTERN_C const IID IID_IAMSampleLatency;
+
+// the stamps carried by a sample - 0 if it hasn't been stamped
+DECLARE_INTERFACE_(IAMSampleLatency, IUnknown)
+{
+    STDMETHOD(GetLatencyStamps) (THIS_
+        __out LONGLONG *pllOrigin,
+        __out LONGLONG *pllArrival
+    ) PURE;
+
+    STDMETHOD(SetLatencyStamps) (THIS_
+        LONGLONG llOrigin,
+        LONGLONG llArrival
+    ) PURE;
+};
+
+// {A3633DDA-1E05-4893-83FD-E2A148AB7A1D}
+EXTERN_C const IID IID_IAMLatencyStatistics;
+
+// what a filter has recorded - S_FALSE with all zeros if nothing yet
+DECLARE_INTERFACE_(IAMLatencyStatistics, IUnknown)
+{
+    STDMETHOD(GetLatencyStatistics) (THIS_
+        AM_LATENCY_KIND Kind,
+        __out AM_LATENCY_STATISTICS *pStats
+    ) PURE;
+
+    STDMETHOD(ResetLatencyStatistics) (THIS) PURE;
+};
+
+
+// 16 buckets of 1 for under 16 units, then 8 for each power of 2 up to
+// 2^36 units (nearly 2 hours in REFERENCE_TIME)
+#define AM_LATENCY_LINEAR       16
+#define AM_LATENCY_OCTAVES      32
+#define AM_LATENCY_BUCKETS      (AM_LATENCY_LINEAR + AM_LATENCY_OCTAVES * 8)
+
+class CAMLatencyHistogram {
+
+    volatile LONG m_aBuckets[AM_LATENCY_BUCKETS];
+    volatile LONG m_cSamples;
+    volatile LONGLONG m_llMax;
+
+    static LONG Bucket(LONGLONG ll);
+    static LONGLONG BucketValue(LONG iBucket);
+
+public:
+
+    CAMLatencyHistogram() { Reset(); };
+
+    // may be called on several threads at once
+    void Add(LONGLONG ll);
+
+    void Get(__out AM_LATENCY_STATISTICS *pStats) const;
+    void Reset();
+};
+
+
+// What a filter has recorded, in REFERENCE_TIME units
+
+class CAMLatencyStatistics {
+
+    CAMLatencyHistogram m_Filter;
+    CAMLatencyHistogram m_Total;
+
+public:
+
+    // the stamps of a sample leaving the filter at llNow
+    void Record(LONGLONG llOrigin, LONGLONG llArrival, LONGLONG llNow);
+
+    HRESULT Get(AM_LATENCY_KIND Kind, __out AM_LATENCY_STATISTICS *pStats) const;
+    void Reset();
+};
+
+
+class CAMLatency {
+
+    static volatile BOOL m_bEnabled;
+    static LONGLONG m_llFrequency;
+
+public:
+
+    static BOOL IsEnabled() { return m_bEnabled; };
+
+    // start or stop stamping samples
+    static void Enable(BOOL bEnable);
+
+    // REFERENCE_TIME units in llTicks of the performance counter
+    static LONGLONG ToReferenceTime(LONGLONG llTicks);
+
+    // a source is about to fill pSample
+    static void StampOrigin(__in IMediaSample *pSample);
+
+    // pSample has arrived at a filter
+    static void StampArrival(__in IMediaSample *pSample);
+
+    // pTo carries on from pFrom
+    static void CopyStamps(__in IMediaSample *pFrom, __in IMediaSample *pTo);
+
+    // pSample is leaving a filter - add to its statistics, which are
+    // created the first time
+    static void RecordDeparture(
+        __in IMediaSample *pSample,
+        __deref_inout_opt CAMLatencyStatistics * volatile *ppStats);
+};
+
+#endif // __LATENCY__
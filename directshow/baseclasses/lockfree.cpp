@@ -0,0 +1,189 @@
+//------------------------------------------------------------------------------
+// File: LockFree.cpp
+//
+// Desc: DirectShow base classes - implements the non-blocking helper classes.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#include <streams.h>
+
+// WaitOnAddress and WakeByAddressAll
+#pragma comment(lib, "synchronization.lib")
+
+
+// --- CAMEventCount -----------------------
+
+CAMEventCount::CAMEventCount() :
+    m_lState(0)
+{
+}
+
+CAMEventCount::~CAMEventCount()
+{
+    ASSERT((m_lState & WaiterMask) == 0);
+}
+
+LONG
+CAMEventCount::PrepareWait()
+{
+    LONG lOld = InterlockedExchangeAdd(&m_lState, 1);
+    ASSERT((lOld & WaiterMask) != WaiterMask);
+    return EpochOf(lOld);
+}
+
+// Until a NotifyAll has moved the epoch on our registration is still part
+// of the waiter count and can simply be removed. Once it has moved on the
+// notifier has already dropped us from the count and there is nothing to
+// give back
+
+BOOL
+CAMEventCount::CancelWait(LONG lKey)
+{
+    for (;;) {
+        LONG lState = m_lState;
+        if (EpochOf(lState) != lKey) {
+            return TRUE;
+        }
+        ASSERT((lState & WaiterMask) != 0);
+        if (InterlockedCompareExchange(&m_lState, lState - 1, lState) == lState) {
+            return FALSE;
+        }
+    }
+}
+
+// WaitOnAddress returns whenever the state word differs from the value we
+// last saw, and other threads registering change the waiter count as well
+// as NotifyAll changing the epoch, so we look again at the epoch each time
+// and only go back to sleep, on the new value, if it is still ours
+
+BOOL
+CAMEventCount::Wait(LONG lKey, DWORD dwTimeout)
+{
+    const DWORD dwStart = timeGetTime();
+    DWORD dwWait = dwTimeout;
+    for (;;) {
+        LONG lState = m_lState;
+        if (EpochOf(lState) != lKey) {
+            return TRUE;
+        }
+        if (!WaitOnAddress(&m_lState, &lState, sizeof(m_lState), dwWait)) {
+            return CancelWait(lKey);
+        }
+        if (dwTimeout != INFINITE) {
+            DWORD dwElapsed = timeGetTime() - dwStart;
+            if (dwElapsed >= dwTimeout) {
+                return CancelWait(lKey);
+            }
+            dwWait = dwTimeout - dwElapsed;
+        }
+    }
+}
+
+void
+CAMEventCount::NotifyAll()
+{
+    // order the caller's update of its condition before our read of the
+    // waiter count - pairs with the interlocked add in PrepareWait
+    MemoryBarrier();
+
+    for (;;) {
+        LONG lState = m_lState;
+        if ((lState & WaiterMask) == 0) {
+            return;
+        }
+        LONG lNext = (LONG)(((ULONG)lState & ~(ULONG)WaiterMask) + (1UL << EpochShift));
+        if (InterlockedCompareExchange(&m_lState, lNext, lState) == lState) {
+            WakeByAddressAll((PVOID)&m_lState);
+            return;
+        }
+    }
+}
+
+
+// --- CAMSharedLock -----------------------
+
+BOOL
+CAMSharedLock::TryLockShared()
+{
+    for (;;) {
+        LONG lState = m_lState;
+        if (lState & WriterMask) {
+            return FALSE;
+        }
+        if (InterlockedCompareExchange(&m_lState, lState + Reader, lState) == lState) {
+            return TRUE;
+        }
+    }
+}
+
+// we are already counted as waiting
+
+BOOL
+CAMSharedLock::TryLockExclusive()
+{
+    for (;;) {
+        LONG lState = m_lState;
+        if ((lState & Writer) || lState >= Reader) {
+            return FALSE;
+        }
+        LONG lNext = lState - WriterWaiting + Writer;
+        if (InterlockedCompareExchange(&m_lState, lNext, lState) == lState) {
+            return TRUE;
+        }
+    }
+}
+
+void
+CAMSharedLock::LockShared()
+{
+    for (;;) {
+        if (TryLockShared()) {
+            return;
+        }
+        LONG lKey = m_ec.PrepareWait();
+        if (TryLockShared()) {
+            m_ec.CancelWait(lKey);
+            return;
+        }
+        m_ec.Wait(lKey);
+    }
+}
+
+void
+CAMSharedLock::UnlockShared()
+{
+    LONG lState = InterlockedExchangeAdd(&m_lState, -Reader) - Reader;
+    ASSERT(lState >= 0);
+
+    // the last reader out lets a waiting writer in
+    if (lState < Reader && (lState & WriterMask)) {
+        m_ec.NotifyAll();
+    }
+}
+
+void
+CAMSharedLock::LockExclusive()
+{
+    InterlockedExchangeAdd(&m_lState, WriterWaiting);
+    for (;;) {
+        if (TryLockExclusive()) {
+            return;
+        }
+        LONG lKey = m_ec.PrepareWait();
+        if (TryLockExclusive()) {
+            m_ec.CancelWait(lKey);
+            return;
+        }
+        m_ec.Wait(lKey);
+    }
+}
+
+void
+CAMSharedLock::UnlockExclusive()
+{
+    ASSERT(m_lState & Writer);
+    InterlockedExchangeAdd(&m_lState, -Writer);
+    m_ec.NotifyAll();
+}
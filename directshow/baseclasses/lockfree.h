@@ -0,0 +1,368 @@
+//------------------------------------------------------------------------------
+// File: LockFree.h
+//
+// Desc: DirectShow base classes - defines non-blocking helper classes used
+//       on the streaming fast paths.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+/* These classes are only built on the Interlocked functions and, for
+   blocking, on WaitOnAddress, so the logic carries over unchanged to any
+   platform that offers a compare-and-swap and a futex. The harnesses in
+   tools\perf build this file on Linux that way.
+
+   CAMEventCount lets a thread block until "something changed" without
+   anyone holding a lock across the check of the condition. The pattern
+   for a waiter is
+
+        for (;;) {
+            if (TryTheFastPath()) break;
+            LONG lKey = ec.PrepareWait();
+            if (TryTheFastPath()) { ec.CancelWait(lKey); break; }
+            ec.Wait(lKey);
+        }
+
+   and for the thread that makes the condition true
+
+        MakeTheConditionTrue();
+        ec.NotifyAll();
+
+   NotifyAll costs one interlocked read when nobody is waiting. A waiter
+   sleeps on the state word itself until the epoch it registered in has
+   moved on, so each epoch has its own wakeup and a thread that registers
+   after a NotifyAll can't take the wakeup meant for one it counted.
+   Nothing is allocated, so constructing one can't fail.
+
+   CBoundedQueue is a fixed size multi-producer multi-consumer FIFO of
+   pointers. Each slot carries a sequence number which tells producers and
+   consumers whether it is their turn to use it, so neither side ever takes
+   a lock. The capacity is rounded up to a power of 2
+
+   CSPSCQueue is the same idea for exactly one producer thread and one
+   consumer thread at a time. With a single thread at each end the cursors
+   alone say which slots are in use, so there are no per-slot sequence
+   numbers and no compare-and-swap - each side just publishes its own
+   cursor. The producer can add several objects at once, which the
+   consumer then sees either all together or not at all
+
+   CAMSharedLock is a reader-writer lock for data that is read far more
+   often than it changes. Taking it shared when no writer holds it or is
+   waiting for it is one compare-and-swap, and readers never wait for each
+   other. A writer that is waiting keeps new readers out, so a steady
+   stream of readers can't starve it. Neither side is recursive */
+
+
+#ifndef __LOCKFREE__
+#define __LOCKFREE__
+
+
+class CAMEventCount {
+
+    // make copy constructor and assignment operator inaccessible
+
+    CAMEventCount(const CAMEventCount &refEventCount);
+    CAMEventCount &operator=(const CAMEventCount &refEventCount);
+
+    // The low word holds the number of registered waiters and the high
+    // word the notification epoch. Keeping them in one LONG means that a
+    // notifier bumps the epoch and takes the waiters it is about to wake
+    // in a single atomic step, so every registered waiter is either
+    // counted by exactly one NotifyAll or can safely withdraw
+
+    enum { WaiterMask = 0x0000FFFF, EpochShift = 16 };
+
+    volatile LONG m_lState;
+
+    LONG EpochOf(LONG lState) const {
+        return (LONG)((ULONG)lState >> EpochShift);
+    };
+
+public:
+
+    CAMEventCount();
+    ~CAMEventCount();
+
+    // register as a waiter - returns the key to pass to Wait or CancelWait
+    LONG PrepareWait();
+
+    // withdraw a registration made by PrepareWait. Returns TRUE if a
+    // NotifyAll had already counted us
+    BOOL CancelWait(LONG lKey);
+
+    // block until the first NotifyAll after PrepareWait returned lKey
+    BOOL Wait(LONG lKey, DWORD dwTimeout = INFINITE);
+
+    // wake every thread that has registered since the last NotifyAll
+    void NotifyAll();
+
+    // is anyone registered? a cheap hint for callers who batch signals
+    BOOL HasWaiters() const {
+        return (m_lState & WaiterMask) != 0;
+    };
+};
+
+
+
+class CAMSharedLock {
+
+    // make copy constructor and assignment operator inaccessible
+
+    CAMSharedLock(const CAMSharedLock &refLock);
+    CAMSharedLock &operator=(const CAMSharedLock &refLock);
+
+    // bit 0 is set while a writer holds the lock, the rest of the low word
+    // counts the writers waiting for it and the high word the readers
+    enum {
+        Writer = 0x00000001,
+        WriterWaiting = 0x00000002,
+        WriterMask = 0x0000FFFF,
+        Reader = 0x00010000
+    };
+
+    volatile LONG m_lState;
+    CAMEventCount m_ec;
+
+    BOOL TryLockShared();
+    BOOL TryLockExclusive();
+
+public:
+
+    CAMSharedLock() :
+        m_lState(0)
+    {
+    };
+
+    void LockShared();
+    void UnlockShared();
+    void LockExclusive();
+    void UnlockExclusive();
+};
+
+
+template <class T> class CBoundedQueue {
+
+    // make copy constructor and assignment operator inaccessible
+
+    CBoundedQueue(const CBoundedQueue &refQueue);
+    CBoundedQueue &operator=(const CBoundedQueue &refQueue);
+
+    struct CCell {
+        volatile LONG m_lSequence;
+        T *m_pObject;
+    };
+
+    CCell *m_pCells;            // the ring itself
+    LONG m_lMask;               // capacity - 1
+
+    // the two cursors are written by different threads so keep them on
+    // their own cache lines
+
+    BYTE m_Pad0[64];
+    volatile LONG m_lEnqueue;   // next slot a producer will claim
+    BYTE m_Pad1[64];
+    volatile LONG m_lDequeue;   // next slot a consumer will claim
+    BYTE m_Pad2[64];
+
+public:
+
+    CBoundedQueue() :
+        m_pCells(NULL),
+        m_lMask(0),
+        m_lEnqueue(0),
+        m_lDequeue(0)
+    {
+    };
+
+    ~CBoundedQueue() {
+        delete [] m_pCells;
+    };
+
+    // (re)size the ring - must not be called while the queue is in use.
+    // The queue is empty afterwards
+    HRESULT Initialize(LONG lCapacity) {
+        if (lCapacity <= 0 || lCapacity > 0x40000000) {
+            return E_INVALIDARG;
+        }
+        LONG lSize = 1;
+        while (lSize < lCapacity) {
+            lSize <<= 1;
+        }
+        if (m_pCells == NULL || lSize != m_lMask + 1) {
+            delete [] m_pCells;
+            m_pCells = new CCell[lSize];
+            if (m_pCells == NULL) {
+                m_lMask = 0;
+                return E_OUTOFMEMORY;
+            }
+            m_lMask = lSize - 1;
+        }
+        for (LONG i = 0; i < lSize; i++) {
+            m_pCells[i].m_lSequence = i;
+            m_pCells[i].m_pObject = NULL;
+        }
+        m_lEnqueue = 0;
+        m_lDequeue = 0;
+        return NOERROR;
+    };
+
+    LONG GetCapacity() const {
+        return m_pCells ? m_lMask + 1 : 0;
+    };
+
+    // returns FALSE if the ring is full, or if the consumer that last used
+    // the tail slot has not finished releasing it yet
+    BOOL Enqueue(__in T *pObject) {
+        ASSERT(m_pCells != NULL);
+        CCell *pCell;
+        LONG lPos = m_lEnqueue;
+        for (;;) {
+            pCell = &m_pCells[lPos & m_lMask];
+            LONG lDiff = (LONG)((ULONG)pCell->m_lSequence - (ULONG)lPos);
+            if (lDiff == 0) {
+                LONG lSeen = InterlockedCompareExchange(&m_lEnqueue, (LONG)((ULONG)lPos + 1), lPos);
+                if (lSeen == lPos) {
+                    break;
+                }
+                lPos = lSeen;
+            } else if (lDiff < 0) {
+                return FALSE;
+            } else {
+                lPos = m_lEnqueue;
+            }
+        }
+        pCell->m_pObject = pObject;
+        InterlockedExchange(&pCell->m_lSequence, (LONG)((ULONG)lPos + 1));
+        return TRUE;
+    };
+
+    // returns NULL if the ring is empty, or if the producer that owns the
+    // head slot has not finished publishing it yet
+    T *Dequeue() {
+        if (m_pCells == NULL) {
+            return NULL;
+        }
+        CCell *pCell;
+        LONG lPos = m_lDequeue;
+        for (;;) {
+            pCell = &m_pCells[lPos & m_lMask];
+            LONG lDiff = (LONG)((ULONG)pCell->m_lSequence - (ULONG)lPos - 1);
+            if (lDiff == 0) {
+                LONG lSeen = InterlockedCompareExchange(&m_lDequeue, (LONG)((ULONG)lPos + 1), lPos);
+                if (lSeen == lPos) {
+                    break;
+                }
+                lPos = lSeen;
+            } else if (lDiff < 0) {
+                return NULL;
+            } else {
+                lPos = m_lDequeue;
+            }
+        }
+        T *pObject = pCell->m_pObject;
+        InterlockedExchange(&pCell->m_lSequence, (LONG)((ULONG)lPos + m_lMask + 1));
+        return pObject;
+    };
+};
+
+template <class T> class CSPSCQueue {
+
+    // make copy constructor and assignment operator inaccessible
+
+    CSPSCQueue(const CSPSCQueue &refQueue);
+    CSPSCQueue &operator=(const CSPSCQueue &refQueue);
+
+    T **m_ppRing;               // the ring itself
+    LONG m_lMask;               // capacity - 1
+
+    // each cursor is only ever written by its own side
+
+    BYTE m_Pad0[64];
+    volatile LONG m_lTail;      // next slot the producer will fill
+    BYTE m_Pad1[64];
+    volatile LONG m_lHead;      // next slot the consumer will empty
+    BYTE m_Pad2[64];
+
+public:
+
+    CSPSCQueue() :
+        m_ppRing(NULL),
+        m_lMask(0),
+        m_lTail(0),
+        m_lHead(0)
+    {
+    };
+
+    ~CSPSCQueue() {
+        delete [] m_ppRing;
+    };
+
+    // (re)size the ring - must not be called while the queue is in use.
+    // The queue is empty afterwards
+    HRESULT Initialize(LONG lCapacity) {
+        if (lCapacity <= 0 || lCapacity > 0x40000000) {
+            return E_INVALIDARG;
+        }
+        LONG lSize = 1;
+        while (lSize < lCapacity) {
+            lSize <<= 1;
+        }
+        if (m_ppRing == NULL || lSize != m_lMask + 1) {
+            delete [] m_ppRing;
+            m_ppRing = new T *[lSize];
+            if (m_ppRing == NULL) {
+                m_lMask = 0;
+                return E_OUTOFMEMORY;
+            }
+            m_lMask = lSize - 1;
+        }
+        m_lTail = 0;
+        m_lHead = 0;
+        return NOERROR;
+    };
+
+    LONG GetCapacity() const {
+        return m_ppRing ? m_lMask + 1 : 0;
+    };
+
+    // only exact when called from one end with the other end idle
+    LONG GetCount() const {
+        return (LONG)((ULONG)m_lTail - (ULONG)m_lHead);
+    };
+
+    BOOL IsEmpty() const {
+        return m_lTail == m_lHead;
+    };
+
+    // producer only - adds all nObjects or, if there is not room for
+    // them all, none and returns FALSE
+    BOOL Enqueue(__in_ecount(nObjects) T * const *ppObjects, LONG nObjects) {
+        ASSERT(m_ppRing != NULL);
+        const LONG lTail = m_lTail;
+        if ((LONG)((ULONG)lTail - (ULONG)m_lHead) + nObjects > m_lMask + 1) {
+            return FALSE;
+        }
+        for (LONG i = 0; i < nObjects; i++) {
+            m_ppRing[(lTail + i) & m_lMask] = ppObjects[i];
+        }
+        InterlockedExchange(&m_lTail, (LONG)((ULONG)lTail + nObjects));
+        return TRUE;
+    };
+
+    // consumer only - returns NULL if the ring is empty
+    T *Dequeue() {
+        if (m_ppRing == NULL) {
+            return NULL;
+        }
+        const LONG lHead = m_lHead;
+        if (lHead == m_lTail) {
+            return NULL;
+        }
+        T *pObject = m_ppRing[lHead & m_lMask];
+        InterlockedExchange(&m_lHead, (LONG)((ULONG)lHead + 1));
+        return pObject;
+    };
+};
+
+#endif /* __LOCKFREE__ */
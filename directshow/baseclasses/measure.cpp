@@ -0,0 +1,489 @@
+//------------------------------------------------------------------------------
+// File: Measure.cpp
+//
+// Desc: DirectShow base classes - implements the Msr_ performance
+//       measurement functions declared in measure.h.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#include <streams.h>
+#define STRSAFE_NO_DEPRECATE
+#include <strsafe.h>
+#include <intrin.h>
+#include <math.h>
+
+
+// incidents that can be registered, including the unnamed id 0
+#define MSR_MAX_INCIDENTS   256
+#define MSR_MAX_NAME        64
+
+// incidents each thread's buffer holds - must be a power of 2
+#define MSR_RING_EVENTS     4096
+
+enum {
+    MSR_EVENT_START,
+    MSR_EVENT_STOP,
+    MSR_EVENT_NOTE,
+    MSR_EVENT_INTEGER,
+    MSR_EVENT_RESET         // Id -1 resets them all
+};
+
+struct CMsrEvent {
+    ULONGLONG ullTime;      // time stamp counter
+    DWORD dwThreadId;
+    int iType;
+    int Id;
+    int n;                  // for Msr_Integer
+};
+
+// A thread's buffer. Only the thread that owns it writes to it, and it
+// stores lNext after the incident, so a reader that sees lNext has moved on
+// sees the incident too
+
+struct CMsrRing {
+    CMsrRing *pNext;        // in g_pMsrRings
+    HANDLE hOwner;          // signalled once the owner has exited
+    DWORD dwThreadId;
+    volatile LONG lNext;    // incidents ever logged here
+    CMsrEvent aEvents[MSR_RING_EVENTS];
+};
+
+// an incident on its way to the log, with the time since the one it
+// pairs with, or -1
+struct CMsrLine {
+    CMsrEvent Event;
+    LONGLONG llDelta;
+};
+
+volatile BOOL g_fMsrEnabled =
+#ifdef PERF
+    TRUE;
+#else
+    FALSE;
+#endif
+
+static CCritSec g_MsrLock;          // registration and the list of buffers
+static DWORD g_dwMsrTls = TLS_OUT_OF_INDEXES;
+static CMsrRing *g_pMsrRings;
+static int g_cMsrIncidents = 1;
+static TCHAR g_aszMsrIncidents[MSR_MAX_INCIDENTS][MSR_MAX_NAME];
+
+// both counters when we started, to work out the time stamp counter's rate
+static ULONGLONG g_ullMsrTsc0;
+static LONGLONG g_llMsrQpc0;
+
+
+void WINAPI Msr_Init(void)
+{
+    CAutoLock lck(&g_MsrLock);
+    if (g_dwMsrTls == TLS_OUT_OF_INDEXES) {
+        g_dwMsrTls = TlsAlloc();
+
+        LARGE_INTEGER li;
+        QueryPerformanceCounter(&li);
+        g_llMsrQpc0 = li.QuadPart;
+        g_ullMsrTsc0 = __rdtsc();
+    }
+}
+
+// no thread may be logging by now
+
+void WINAPI Msr_Terminate(void)
+{
+    g_fMsrEnabled = FALSE;
+
+    CAutoLock lck(&g_MsrLock);
+    while (g_pMsrRings) {
+        CMsrRing *pRing = g_pMsrRings;
+        g_pMsrRings = pRing->pNext;
+        CloseHandle(pRing->hOwner);
+        delete pRing;
+    }
+    if (g_dwMsrTls != TLS_OUT_OF_INDEXES) {
+        TlsFree(g_dwMsrTls);
+        g_dwMsrTls = TLS_OUT_OF_INDEXES;
+    }
+}
+
+// every instance of a filter registers the same names, so they share an id
+
+int WINAPI Msr_Register(__in LPTSTR Incident)
+{
+    TCHAR szName[MSR_MAX_NAME];
+    StringCchCopy(szName, NUMELMS(szName), Incident);
+
+    CAutoLock lck(&g_MsrLock);
+    for (int Id = 1; Id < g_cMsrIncidents; Id++) {
+        if (lstrcmp(g_aszMsrIncidents[Id], szName) == 0) {
+            return Id;
+        }
+    }
+    if (g_cMsrIncidents == MSR_MAX_INCIDENTS) {
+        return 0;
+    }
+    StringCchCopy(g_aszMsrIncidents[g_cMsrIncidents], MSR_MAX_NAME, szName);
+    return g_cMsrIncidents++;
+}
+
+// give the calling thread a buffer - the one of a thread that has exited
+// if there is one
+
+static CMsrRing *MsrAttachRing()
+{
+    Msr_Init();
+    if (g_dwMsrTls == TLS_OUT_OF_INDEXES) {
+        return NULL;
+    }
+
+    HANDLE hOwner;
+    if (!DuplicateHandle(GetCurrentProcess(), GetCurrentThread(),
+                         GetCurrentProcess(), &hOwner, SYNCHRONIZE, FALSE, 0)) {
+        return NULL;
+    }
+
+    CAutoLock lck(&g_MsrLock);
+    CMsrRing *pRing;
+    for (pRing = g_pMsrRings; pRing; pRing = pRing->pNext) {
+        if (WaitForSingleObject(pRing->hOwner, 0) == WAIT_OBJECT_0) {
+            CloseHandle(pRing->hOwner);
+            break;
+        }
+    }
+    if (pRing == NULL) {
+        pRing = new CMsrRing;
+        if (pRing == NULL) {
+            CloseHandle(hOwner);
+            return NULL;
+        }
+        pRing->lNext = 0;
+        pRing->pNext = g_pMsrRings;
+        g_pMsrRings = pRing;
+    }
+    pRing->hOwner = hOwner;
+    pRing->dwThreadId = GetCurrentThreadId();
+    TlsSetValue(g_dwMsrTls, pRing);
+    return pRing;
+}
+
+static void MsrLog(int iType, int Id, int n)
+{
+    if (!g_fMsrEnabled) {
+        return;
+    }
+
+    CMsrRing *pRing = NULL;
+    if (g_dwMsrTls != TLS_OUT_OF_INDEXES) {
+        pRing = (CMsrRing *) TlsGetValue(g_dwMsrTls);
+    }
+    if (pRing == NULL) {
+        pRing = MsrAttachRing();
+        if (pRing == NULL) {
+            return;
+        }
+    }
+
+    LONG lNext = pRing->lNext;
+    CMsrEvent *pEvent = &pRing->aEvents[lNext & (MSR_RING_EVENTS - 1)];
+    pEvent->ullTime = __rdtsc();
+    pEvent->dwThreadId = pRing->dwThreadId;
+    pEvent->iType = iType;
+    pEvent->Id = Id;
+    pEvent->n = n;
+    InterlockedExchange(&pRing->lNext, (LONG)((ULONG)lNext + 1));
+}
+
+void WINAPI Msr_Reset(int Id)
+{
+    MsrLog(MSR_EVENT_RESET, Id, 0);
+}
+
+void WINAPI Msr_Control(int iAction)
+{
+    switch (iAction) {
+    case MSR_RESET_ALL:
+        MsrLog(MSR_EVENT_RESET, -1, 0);
+        break;
+    case MSR_PAUSE:
+        g_fMsrEnabled = FALSE;
+        break;
+    case MSR_RUN:
+        Msr_Init();
+        g_fMsrEnabled = TRUE;
+        break;
+    }
+}
+
+void WINAPI Msr_Start(int Id)
+{
+    MsrLog(MSR_EVENT_START, Id, 0);
+}
+
+void WINAPI Msr_Stop(int Id)
+{
+    MsrLog(MSR_EVENT_STOP, Id, 0);
+}
+
+void WINAPI Msr_Note(int Id)
+{
+    MsrLog(MSR_EVENT_NOTE, Id, 0);
+}
+
+void WINAPI Msr_Integer(int Id, int n)
+{
+    MsrLog(MSR_EVENT_INTEGER, Id, n);
+}
+
+
+// --- Dumping the log -----------------------
+
+static BOOL MsrValidId(int Id)
+{
+    return Id >= 0 && Id < MSR_MAX_INCIDENTS;
+}
+
+static LPCTSTR MsrName(int Id)
+{
+    if (Id > 0 && Id < g_cMsrIncidents) {
+        return g_aszMsrIncidents[Id];
+    }
+    return TEXT("(unnamed)");
+}
+
+// Copy what is left in a buffer, pairing each Stop with the last Start of
+// the same id by the same thread. The owner carries on logging meanwhile,
+// so anything it may have overwritten while we copied is dropped
+
+static LONG MsrCopyRing(CMsrRing *pRing, __out_ecount(MSR_RING_EVENTS) CMsrLine *pLines)
+{
+    ULONG ulEnd = (ULONG) pRing->lNext;
+    ULONG ulStart = ulEnd > MSR_RING_EVENTS ? ulEnd - MSR_RING_EVENTS : 0;
+    for (ULONG i = ulStart; i < ulEnd; i++) {
+        pLines[i - ulStart].Event = pRing->aEvents[i & (MSR_RING_EVENTS - 1)];
+    }
+
+    MemoryBarrier();
+    ULONG ulNow = (ULONG) pRing->lNext;
+    ULONG ulValid = ulNow >= MSR_RING_EVENTS ? ulNow - MSR_RING_EVENTS + 1 : 0;
+    LONG cLines = (LONG)(ulEnd - ulStart);
+    if (ulValid > ulStart) {
+        LONG cDrop = (LONG) min(ulValid - ulStart, ulEnd - ulStart);
+        cLines -= cDrop;
+        MoveMemory(pLines, pLines + cDrop, cLines * sizeof(pLines[0]));
+    }
+
+    // the buffer may have had an earlier owner
+    ULONGLONG aullStart[MSR_MAX_INCIDENTS];
+    ZeroMemory(aullStart, sizeof(aullStart));
+    DWORD dwThreadId = 0;
+    for (LONG i = 0; i < cLines; i++) {
+        CMsrLine *pLine = &pLines[i];
+        pLine->llDelta = -1;
+        if (pLine->Event.dwThreadId != dwThreadId) {
+            dwThreadId = pLine->Event.dwThreadId;
+            ZeroMemory(aullStart, sizeof(aullStart));
+        }
+        if (!MsrValidId(pLine->Event.Id)) {
+            continue;
+        }
+        if (pLine->Event.iType == MSR_EVENT_START) {
+            aullStart[pLine->Event.Id] = pLine->Event.ullTime;
+        } else if (pLine->Event.iType == MSR_EVENT_STOP && aullStart[pLine->Event.Id]) {
+            pLine->llDelta = pLine->Event.ullTime - aullStart[pLine->Event.Id];
+            aullStart[pLine->Event.Id] = 0;
+        }
+    }
+    return cLines;
+}
+
+static int __cdecl MsrCompareLines(const void *p1, const void *p2)
+{
+    ULONGLONG ull1 = ((const CMsrLine *) p1)->Event.ullTime;
+    ULONGLONG ull2 = ((const CMsrLine *) p2)->Event.ullTime;
+    return ull1 < ull2 ? -1 : ull1 > ull2 ? 1 : 0;
+}
+
+static double MsrTicksPerMicrosecond()
+{
+    LARGE_INTEGER liFreq;
+    QueryPerformanceFrequency(&liFreq);
+    for (;;) {
+        LARGE_INTEGER liNow;
+        QueryPerformanceCounter(&liNow);
+        ULONGLONG ullNow = __rdtsc();
+        double dSeconds = (double)(liNow.QuadPart - g_llMsrQpc0) / liFreq.QuadPart;
+
+        // too soon after we started to tell
+        if (dSeconds < 0.01) {
+            Sleep(10);
+            continue;
+        }
+        return (double)(ullNow - g_ullMsrTsc0) / (dSeconds * 1000000.0);
+    }
+}
+
+static void MsrWrite(HANDLE hFile, __in LPCTSTR pText)
+{
+    if (hFile == NULL) {
+        OutputDebugString(pText);
+        return;
+    }
+
+    DWORD dwWritten;
+#ifdef UNICODE
+    char sz[512];
+    int cb = WideCharToMultiByte(CP_ACP, 0, pText, -1, sz, sizeof(sz), NULL, NULL);
+    if (cb > 1) {
+        WriteFile(hFile, sz, cb - 1, &dwWritten, NULL);
+    }
+#else
+    WriteFile(hFile, pText, lstrlen(pText), &dwWritten, NULL);
+#endif
+}
+
+struct CMsrStats {
+    LONG cCount;
+    double dSum;
+    double dSumSq;
+    double dMin;
+    double dMax;
+};
+
+static void MsrAddStat(CMsrStats *pStats, double d)
+{
+    if (pStats->cCount == 0 || d < pStats->dMin) {
+        pStats->dMin = d;
+    }
+    if (pStats->cCount == 0 || d > pStats->dMax) {
+        pStats->dMax = d;
+    }
+    pStats->cCount++;
+    pStats->dSum += d;
+    pStats->dSumSq += d * d;
+}
+
+static void MsrDump(HANDLE hFile, BOOL bLog)
+{
+    if (g_dwMsrTls == TLS_OUT_OF_INDEXES) {
+        return;
+    }
+
+    // merge all the buffers into one log
+    CMsrLine *pLines = NULL;
+    LONG cLines = 0;
+    {
+        CAutoLock lck(&g_MsrLock);
+        LONG cRings = 0;
+        for (CMsrRing *pRing = g_pMsrRings; pRing; pRing = pRing->pNext) {
+            cRings++;
+        }
+        pLines = new CMsrLine[max(cRings, 1) * MSR_RING_EVENTS];
+        if (pLines == NULL) {
+            return;
+        }
+        for (CMsrRing *pRing = g_pMsrRings; pRing; pRing = pRing->pNext) {
+            cLines += MsrCopyRing(pRing, pLines + cLines);
+        }
+    }
+    qsort(pLines, cLines, sizeof(pLines[0]), MsrCompareLines);
+
+    const double dTicksPerUs = MsrTicksPerMicrosecond();
+    const ULONGLONG ullFirst = cLines ? pLines[0].Event.ullTime : 0;
+
+    CMsrStats *pStats = new CMsrStats[MSR_MAX_INCIDENTS];
+    ULONGLONG *pullLastNote = new ULONGLONG[MSR_MAX_INCIDENTS];
+    if (pStats == NULL || pullLastNote == NULL) {
+        delete [] pStats;
+        delete [] pullLastNote;
+        delete [] pLines;
+        return;
+    }
+    ZeroMemory(pStats, MSR_MAX_INCIDENTS * sizeof(pStats[0]));
+    ZeroMemory(pullLastNote, MSR_MAX_INCIDENTS * sizeof(pullLastNote[0]));
+
+    static const LPCTSTR aszTypes[] = {
+        TEXT("START"), TEXT("STOP"), TEXT("NOTE"), TEXT("INTEGER"), TEXT("RESET")
+    };
+    TCHAR sz[256];
+    if (bLog) {
+        MsrWrite(hFile, TEXT("   Time (us)   Thread  Type         Delta (us)  Incident_Name\r\n"));
+    }
+
+    for (LONG i = 0; i < cLines; i++) {
+        CMsrLine *pLine = &pLines[i];
+        const int Id = pLine->Event.Id;
+
+        if (pLine->Event.iType == MSR_EVENT_RESET) {
+            if (Id == -1) {
+                ZeroMemory(pStats, MSR_MAX_INCIDENTS * sizeof(pStats[0]));
+                ZeroMemory(pullLastNote, MSR_MAX_INCIDENTS * sizeof(pullLastNote[0]));
+            } else if (MsrValidId(Id)) {
+                ZeroMemory(&pStats[Id], sizeof(pStats[0]));
+                pullLastNote[Id] = 0;
+            }
+        } else if (MsrValidId(Id)) {
+            if (pLine->Event.iType == MSR_EVENT_NOTE) {
+                if (pullLastNote[Id]) {
+                    pLine->llDelta = pLine->Event.ullTime - pullLastNote[Id];
+                }
+                pullLastNote[Id] = pLine->Event.ullTime;
+            }
+            if (pLine->Event.iType == MSR_EVENT_INTEGER) {
+                MsrAddStat(&pStats[Id], pLine->Event.n);
+            } else if (pLine->llDelta >= 0) {
+                MsrAddStat(&pStats[Id], pLine->llDelta / dTicksPerUs);
+            }
+        }
+
+        if (bLog) {
+            TCHAR szDelta[32];
+            if (pLine->Event.iType == MSR_EVENT_INTEGER) {
+                StringCchPrintf(szDelta, NUMELMS(szDelta), TEXT("%12d"), pLine->Event.n);
+            } else if (pLine->llDelta >= 0) {
+                StringCchPrintf(szDelta, NUMELMS(szDelta), TEXT("%12.2f"), pLine->llDelta / dTicksPerUs);
+            } else {
+                StringCchCopy(szDelta, NUMELMS(szDelta), TEXT("          -."));
+            }
+            StringCchPrintf(sz, NUMELMS(sz), TEXT("%12.2f %8u  %-8s %s  %s\r\n"),
+                (pLine->Event.ullTime - ullFirst) / dTicksPerUs,
+                pLine->Event.dwThreadId,
+                aszTypes[pLine->Event.iType],
+                szDelta,
+                Id == -1 ? TEXT("(all)") : MsrName(Id));
+            MsrWrite(hFile, sz);
+        }
+    }
+
+    MsrWrite(hFile, TEXT("\r\nNumber      Average       StdDev     Smallest      Largest Incident_Name\r\n"));
+    for (int Id = 0; Id < g_cMsrIncidents; Id++) {
+        const CMsrStats *p = &pStats[Id];
+        if (p->cCount == 0) {
+            StringCchPrintf(sz, NUMELMS(sz),
+                TEXT("%6d     -.           -.           -.           -.       %s\r\n"),
+                0, MsrName(Id));
+        } else {
+            double dAvg = p->dSum / p->cCount;
+            double dVar = p->cCount > 1 ?
+                (p->dSumSq - p->dSum * dAvg) / (p->cCount - 1) : 0.0;
+            StringCchPrintf(sz, NUMELMS(sz),
+                TEXT("%6d %12.2f %12.2f %12.2f %12.2f %s\r\n"),
+                p->cCount, dAvg, sqrt(max(dVar, 0.0)), p->dMin, p->dMax, MsrName(Id));
+        }
+        MsrWrite(hFile, sz);
+    }
+
+    delete [] pStats;
+    delete [] pullLastNote;
+    delete [] pLines;
+}
+
+void WINAPI Msr_Dump(HANDLE hFile)
+{
+    MsrDump(hFile, TRUE);
+}
+
+void WINAPI Msr_DumpStats(HANDLE hFile)
+{
+    MsrDump(hFile, FALSE);
+}
@@ -93,7 +93,7 @@ Number      Average       StdDev     Smallest      Largest Incident_Name
 
            or
 
-       Msr_Dump(NULL);            // This writes it to DbgLog((LOG_TRACE,0, ... ));
+       Msr_Dump(NULL);            // This writes it to OutputDebugString
                                   // but if you are writing it out to the debugger
                                   // then the times are probably all garbage because
                                   // the debugger can make things run awfully slow.
@@ -102,51 +102,50 @@ Number      Average       StdDev     Smallest      Largest Incident_Name
     are mixed in with Starts and Stops their statistics will be gibberish.
 
     If you code the calls in upper case i.e. MSR_START(idMunge); then you get
-    macros which will turn into nothing unless PERF is defined.
+    macros which cost a test of g_fMsrEnabled while recording is off, so
+    they can be left in retail builds.  Recording starts on in PERF builds;
+    otherwise Msr_Control(MSR_RUN) turns it on and MSR_PAUSE off again.
 
     You can reset the statistical counts for a given id by calling Reset(Id).
     They are reset by default at the start.
     It logs Reset as a special incident, so you can see it in the log.
 
-    The log is a circular buffer in storage (to try to minimise disk I/O).
-    It overwrites the oldest entries once full.  The statistics include ALL
-    incidents since the last Reset, whether still visible in the log or not.
+    Each thread logs into a circular buffer of its own, without locking, and
+    stamps each incident with the processor's time stamp counter.  A buffer
+    overwrites its oldest entries once full.  Msr_Dump merges the buffers
+    into one log ordered by time, and a thread column says who logged what.
+    The statistics are worked out from whatever is still in the buffers
+    since the last Reset, and a Stop is paired with the last Start of the
+    same id on the same thread.  The buffer of a thread that has exited is
+    reused by the next new thread.
 */
 
 #ifndef __MEASURE__
 #define __MEASURE__
 
-#ifdef PERF
 #define MSR_INIT() Msr_Init()
 #define MSR_TERMINATE() Msr_Terminate()
 #define MSR_REGISTER(a) Msr_Register(a)
 #define MSR_RESET(a) Msr_Reset(a)
 #define MSR_CONTROL(a) Msr_Control(a)
-#define MSR_START(a) Msr_Start(a)
-#define MSR_STOP(a) Msr_Stop(a)
-#define MSR_NOTE(a) Msr_Note(a)
-#define MSR_INTEGER(a,b) Msr_Integer(a,b)
+#define MSR_START(a) (g_fMsrEnabled ? Msr_Start(a) : (void)0)
+#define MSR_STOP(a) (g_fMsrEnabled ? Msr_Stop(a) : (void)0)
+#define MSR_NOTE(a) (g_fMsrEnabled ? Msr_Note(a) : (void)0)
+#define MSR_INTEGER(a,b) (g_fMsrEnabled ? Msr_Integer(a,b) : (void)0)
 #define MSR_DUMP(a) Msr_Dump(a)
 #define MSR_DUMPSTATS(a) Msr_DumpStats(a)
-#else
-#define MSR_INIT() ((void)0)
-#define MSR_TERMINATE() ((void)0)
-#define MSR_REGISTER(a) 0
-#define MSR_RESET(a) ((void)0)
-#define MSR_CONTROL(a) ((void)0)
-#define MSR_START(a) ((void)0)
-#define MSR_STOP(a) ((void)0)
-#define MSR_NOTE(a) ((void)0)
-#define MSR_INTEGER(a,b) ((void)0)
-#define MSR_DUMP(a) ((void)0)
-#define MSR_DUMPSTATS(a) ((void)0)
-#endif
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// TRUE while incidents are being logged
+
+extern volatile BOOL g_fMsrEnabled;
+
+
 // This must be called first - (called by the DllEntry)
+// (or not - the first incident logged does it if need be)
 
 void WINAPI Msr_Init(void);
 
@@ -0,0 +1,303 @@
+//------------------------------------------------------------------------------
+// File: MemCopy.cpp
+//
+// Desc: DirectShow base classes - implements CAMMemCopy.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#include <streams.h>
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <intrin.h>
+#include <immintrin.h>
+#define AM_COPY_SIMD
+#if defined(_M_X64) && (_MSC_VER >= 1911)
+#define AM_COPY_AVX512
+#endif
+#endif
+
+// how far ahead of the loads to prefetch the source
+#define PREFETCH_DISTANCE   512
+
+
+static void
+CopyDefault(
+    __out_bcount(cb) BYTE *pDst,
+    __in_bcount(cb) const BYTE *pSrc,
+    SIZE_T cb)
+{
+    memcpy(pDst, pSrc, cb);
+}
+
+#ifdef AM_COPY_SIMD
+
+/* Each kernel copies just enough with memcpy to align the destination,
+   streams whole blocks, then copies what is left with memcpy. The loads
+   are unaligned as the source is generally at a different offset. The
+   threshold is far bigger than a block, so there is always at least one */
+
+static void
+CopySSE2(
+    __out_bcount(cb) BYTE *pDst,
+    __in_bcount(cb) const BYTE *pSrc,
+    SIZE_T cb)
+{
+    SIZE_T cbHead = (0 - (UINT_PTR) pDst) & 15;
+    memcpy(pDst, pSrc, cbHead);
+    pDst += cbHead;
+    pSrc += cbHead;
+    cb -= cbHead;
+
+    for (; cb >= 64; cb -= 64, pDst += 64, pSrc += 64) {
+        _mm_prefetch((const char *) pSrc + PREFETCH_DISTANCE, _MM_HINT_NTA);
+        __m128i x0 = _mm_loadu_si128((const __m128i *) pSrc);
+        __m128i x1 = _mm_loadu_si128((const __m128i *) pSrc + 1);
+        __m128i x2 = _mm_loadu_si128((const __m128i *) pSrc + 2);
+        __m128i x3 = _mm_loadu_si128((const __m128i *) pSrc + 3);
+        _mm_stream_si128((__m128i *) pDst, x0);
+        _mm_stream_si128((__m128i *) pDst + 1, x1);
+        _mm_stream_si128((__m128i *) pDst + 2, x2);
+        _mm_stream_si128((__m128i *) pDst + 3, x3);
+    }
+
+    // make the streamed stores visible before anything after us
+    _mm_sfence();
+    memcpy(pDst, pSrc, cb);
+}
+
+static void
+CopyAVX2(
+    __out_bcount(cb) BYTE *pDst,
+    __in_bcount(cb) const BYTE *pSrc,
+    SIZE_T cb)
+{
+    SIZE_T cbHead = (0 - (UINT_PTR) pDst) & 31;
+    memcpy(pDst, pSrc, cbHead);
+    pDst += cbHead;
+    pSrc += cbHead;
+    cb -= cbHead;
+
+    for (; cb >= 128; cb -= 128, pDst += 128, pSrc += 128) {
+        _mm_prefetch((const char *) pSrc + PREFETCH_DISTANCE, _MM_HINT_NTA);
+        _mm_prefetch((const char *) pSrc + PREFETCH_DISTANCE + 64, _MM_HINT_NTA);
+        __m256i y0 = _mm256_loadu_si256((const __m256i *) pSrc);
+        __m256i y1 = _mm256_loadu_si256((const __m256i *) pSrc + 1);
+        __m256i y2 = _mm256_loadu_si256((const __m256i *) pSrc + 2);
+        __m256i y3 = _mm256_loadu_si256((const __m256i *) pSrc + 3);
+        _mm256_stream_si256((__m256i *) pDst, y0);
+        _mm256_stream_si256((__m256i *) pDst + 1, y1);
+        _mm256_stream_si256((__m256i *) pDst + 2, y2);
+        _mm256_stream_si256((__m256i *) pDst + 3, y3);
+    }
+
+    _mm_sfence();
+
+    // avoid the SSE transition penalty in whoever runs next
+    _mm256_zeroupper();
+    memcpy(pDst, pSrc, cb);
+}
+
+#ifdef AM_COPY_AVX512
+static void
+CopyAVX512(
+    __out_bcount(cb) BYTE *pDst,
+    __in_bcount(cb) const BYTE *pSrc,
+    SIZE_T cb)
+{
+    SIZE_T cbHead = (0 - (UINT_PTR) pDst) & 63;
+    memcpy(pDst, pSrc, cbHead);
+    pDst += cbHead;
+    pSrc += cbHead;
+    cb -= cbHead;
+
+    for (; cb >= 256; cb -= 256, pDst += 256, pSrc += 256) {
+        _mm_prefetch((const char *) pSrc + PREFETCH_DISTANCE, _MM_HINT_NTA);
+        _mm_prefetch((const char *) pSrc + PREFETCH_DISTANCE + 64, _MM_HINT_NTA);
+        _mm_prefetch((const char *) pSrc + PREFETCH_DISTANCE + 128, _MM_HINT_NTA);
+        _mm_prefetch((const char *) pSrc + PREFETCH_DISTANCE + 192, _MM_HINT_NTA);
+        __m512i z0 = _mm512_loadu_si512((const void *) pSrc);
+        __m512i z1 = _mm512_loadu_si512((const void *) (pSrc + 64));
+        __m512i z2 = _mm512_loadu_si512((const void *) (pSrc + 128));
+        __m512i z3 = _mm512_loadu_si512((const void *) (pSrc + 192));
+        _mm512_stream_si512((__m512i *) pDst, z0);
+        _mm512_stream_si512((__m512i *) (pDst + 64), z1);
+        _mm512_stream_si512((__m512i *) (pDst + 128), z2);
+        _mm512_stream_si512((__m512i *) (pDst + 192), z3);
+    }
+
+    _mm_sfence();
+    _mm256_zeroupper();
+    memcpy(pDst, pSrc, cb);
+}
+#endif // AM_COPY_AVX512
+
+#endif // AM_COPY_SIMD
+
+
+CAMMemCopy::PCOPYKERNEL CAMMemCopy::m_pfnStream = CopyDefault;
+AM_COPY_KERNEL CAMMemCopy::m_Kernel = AM_COPY_KERNEL_DEFAULT;
+AM_COPY_KERNEL CAMMemCopy::m_BestKernel = AM_COPY_KERNEL_DEFAULT;
+SIZE_T CAMMemCopy::m_cbStreamThreshold = (SIZE_T) -1;
+BOOL CAMMemCopy::m_bInitialized = FALSE;
+
+// Pick the kernel when the module loads. Copies made before then (from
+// other static constructors) just use memcpy
+
+static class CMemCopyInit {
+public:
+    CMemCopyInit() { CAMMemCopy::Initialize(); };
+} g_MemCopyInit;
+
+
+/* The OS has to save the wider registers on a context switch as well as
+   the processor having them, which is what XCR0 tells us */
+
+AM_COPY_KERNEL
+CAMMemCopy::DetectKernel()
+{
+#ifdef AM_COPY_SIMD
+    int Info[4];
+    __cpuid(Info, 0);
+    int nIds = Info[0];
+
+    __cpuid(Info, 1);
+    if (!(Info[3] & (1 << 26))) {           // SSE2
+        return AM_COPY_KERNEL_DEFAULT;
+    }
+    AM_COPY_KERNEL Kernel = AM_COPY_KERNEL_SSE2;
+
+    if (nIds >= 7 &&
+        (Info[2] & (1 << 27)) &&            // OSXSAVE
+        (Info[2] & (1 << 28))) {            // AVX
+        unsigned __int64 ullXCR0 = _xgetbv(0);
+        __cpuidex(Info, 7, 0);
+
+        // XMM and YMM state
+        if ((ullXCR0 & 0x06) == 0x06 && (Info[1] & (1 << 5))) {
+            Kernel = AM_COPY_KERNEL_AVX2;
+        }
+#ifdef AM_COPY_AVX512
+        // ... and opmask and ZMM state
+        if ((ullXCR0 & 0xE6) == 0xE6 && (Info[1] & (1 << 16))) {
+            Kernel = AM_COPY_KERNEL_AVX512;
+        }
+#endif
+    }
+    return Kernel;
+#else
+    return AM_COPY_KERNEL_DEFAULT;
+#endif
+}
+
+/* Streaming only pays once a copy would flush a good part of the biggest
+   cache anyway, so start at half of it. copybench in tools/perf measures
+   both sides of that line */
+
+SIZE_T
+CAMMemCopy::DetectThreshold()
+{
+    SIZE_T cbLargest = 0;
+    DWORD cb = 0;
+
+    GetLogicalProcessorInformation(NULL, &cb);
+    if (GetLastError() == ERROR_INSUFFICIENT_BUFFER && cb != 0) {
+        SYSTEM_LOGICAL_PROCESSOR_INFORMATION *pInfo =
+            (SYSTEM_LOGICAL_PROCESSOR_INFORMATION *) new BYTE[cb];
+        if (pInfo) {
+            if (GetLogicalProcessorInformation(pInfo, &cb)) {
+                DWORD cInfo = cb / sizeof(pInfo[0]);
+                for (DWORD i = 0; i < cInfo; i++) {
+                    if (pInfo[i].Relationship == RelationCache &&
+                        pInfo[i].Cache.Size > cbLargest) {
+                        cbLargest = pInfo[i].Cache.Size;
+                    }
+                }
+            }
+            delete [] (BYTE *) pInfo;
+        }
+    }
+
+    if (cbLargest == 0) {
+        cbLargest = 2 * 1024 * 1024;
+    }
+    return max(cbLargest / 2, (SIZE_T) AM_COPY_MIN_STREAMING_THRESHOLD);
+}
+
+CAMMemCopy::PCOPYKERNEL
+CAMMemCopy::KernelFunction(AM_COPY_KERNEL Kernel)
+{
+    switch (Kernel) {
+#ifdef AM_COPY_SIMD
+    case AM_COPY_KERNEL_SSE2:
+        return CopySSE2;
+    case AM_COPY_KERNEL_AVX2:
+        return CopyAVX2;
+#ifdef AM_COPY_AVX512
+    case AM_COPY_KERNEL_AVX512:
+        return CopyAVX512;
+#endif
+#endif
+    default:
+        return CopyDefault;
+    }
+}
+
+/* Detecting is idempotent, so it doesn't matter if two threads race here */
+
+void
+CAMMemCopy::Initialize()
+{
+    if (m_bInitialized) {
+        return;
+    }
+    m_BestKernel = DetectKernel();
+    m_Kernel = m_BestKernel;
+    m_pfnStream = KernelFunction(m_Kernel);
+    m_cbStreamThreshold = DetectThreshold();
+    m_bInitialized = TRUE;
+
+    DbgLog((LOG_TRACE, 2, TEXT("CAMMemCopy - kernel %d, streaming from %d bytes"),
+            m_Kernel, (LONG) m_cbStreamThreshold));
+}
+
+AM_COPY_KERNEL
+CAMMemCopy::GetKernel()
+{
+    Initialize();
+    return m_Kernel;
+}
+
+AM_COPY_KERNEL
+CAMMemCopy::GetBestKernel()
+{
+    Initialize();
+    return m_BestKernel;
+}
+
+HRESULT
+CAMMemCopy::SetKernel(AM_COPY_KERNEL Kernel)
+{
+    Initialize();
+    if (Kernel < AM_COPY_KERNEL_DEFAULT || Kernel > m_BestKernel) {
+        return E_INVALIDARG;
+    }
+    m_pfnStream = KernelFunction(Kernel);
+    m_Kernel = Kernel;
+    return S_OK;
+}
+
+SIZE_T
+CAMMemCopy::GetStreamingThreshold()
+{
+    Initialize();
+    return m_cbStreamThreshold;
+}
+
+void
+CAMMemCopy::SetStreamingThreshold(SIZE_T cbThreshold)
+{
+    Initialize();
+    m_cbStreamThreshold = max(cbThreshold, (SIZE_T) AM_COPY_MIN_STREAMING_THRESHOLD);
+}
@@ -0,0 +1,116 @@
+//------------------------------------------------------------------------------
+// File: MemCopy.h
+//
+// Desc: DirectShow base classes - defines CAMMemCopy, buffer copies that
+//       pick the best way to copy for this processor at run time.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+/* Copies smaller than the streaming threshold go to the C runtime's memcpy,
+   which is as good as anything for data that stays in the cache. Bigger
+   copies - whole frames, typically - would only push everything else out
+   of the cache on their way through, so they use the widest non-temporal
+   stores the processor and OS support instead. The destination is written
+   straight to memory and the source is prefetched without polluting the
+   cache.
+
+   The kernel is chosen from CPUID when the module loads, and the threshold
+   from the size of the largest cache the system reports. Until then, and
+   on processors without SSE2, every copy goes to memcpy. SetKernel and
+   SetStreamingThreshold override the choice, mainly for measurement.
+
+   A copy that is read back straight away - one that is then transformed
+   in place, say - wants to be in the cache whatever its size. CopyCached
+   always goes to memcpy for those */
+
+
+#ifndef __MEMCOPY__
+#define __MEMCOPY__
+
+
+// ways of doing copies above the threshold
+enum AM_COPY_KERNEL {
+    AM_COPY_KERNEL_DEFAULT,     // just use memcpy
+    AM_COPY_KERNEL_SSE2,        // 16 byte non-temporal stores
+    AM_COPY_KERNEL_AVX2,        // 32 byte non-temporal stores
+    AM_COPY_KERNEL_AVX512       // 64 byte non-temporal stores
+};
+
+// the threshold is never set lower than this
+#define AM_COPY_MIN_STREAMING_THRESHOLD     (16 * 1024)
+
+class CAMMemCopy {
+
+    typedef void (*PCOPYKERNEL)(
+        __out_bcount(cb) BYTE *pDst,
+        __in_bcount(cb) const BYTE *pSrc,
+        SIZE_T cb);
+
+    static PCOPYKERNEL m_pfnStream;     // copies at or above the threshold
+    static AM_COPY_KERNEL m_Kernel;     // ... which is this one
+    static AM_COPY_KERNEL m_BestKernel; // best this processor supports
+    static SIZE_T m_cbStreamThreshold;  // (SIZE_T) -1 until initialized
+    static BOOL m_bInitialized;
+
+    static AM_COPY_KERNEL DetectKernel();
+    static SIZE_T DetectThreshold();
+    static PCOPYKERNEL KernelFunction(AM_COPY_KERNEL Kernel);
+
+public:
+
+    // pick the kernel and threshold - done for you when the module loads
+    static void Initialize();
+
+    // copy between buffers that do not overlap
+    static void *Copy(
+        __out_bcount(cb) void *pDst,
+        __in_bcount(cb) const void *pSrc,
+        SIZE_T cb)
+    {
+        if (cb < m_cbStreamThreshold) {
+            return memcpy(pDst, pSrc, cb);
+        }
+        m_pfnStream((BYTE *) pDst, (const BYTE *) pSrc, cb);
+        return pDst;
+    };
+
+    // copy between buffers that do not overlap, leaving the destination
+    // in the cache for whoever reads it next
+    static void *CopyCached(
+        __out_bcount(cb) void *pDst,
+        __in_bcount(cb) const void *pSrc,
+        SIZE_T cb)
+    {
+        return memcpy(pDst, pSrc, cb);
+    };
+
+    // copy between buffers that may overlap
+    static void *Move(
+        __out_bcount(cb) void *pDst,
+        __in_bcount(cb) const void *pSrc,
+        SIZE_T cb)
+    {
+        if ((const BYTE *) pDst + cb <= (const BYTE *) pSrc ||
+            (const BYTE *) pSrc + cb <= (const BYTE *) pDst) {
+            return Copy(pDst, pSrc, cb);
+        }
+        MoveMemory(pDst, pSrc, cb);
+        return pDst;
+    };
+
+    // the kernel in use, and the best one we could use
+    static AM_COPY_KERNEL GetKernel();
+    static AM_COPY_KERNEL GetBestKernel();
+
+    // Use a particular kernel. Fails with E_INVALIDARG if this processor
+    // (or OS) doesn't support it
+    static HRESULT SetKernel(AM_COPY_KERNEL Kernel);
+
+    // size from which copies use the kernel rather than memcpy
+    static SIZE_T GetStreamingThreshold();
+    static void SetStreamingThreshold(SIZE_T cbThreshold);
+};
+
+#endif // __MEMCOPY__
@@ -35,6 +35,11 @@ private:
     DWORD               m_ThreadId;
     HANDLE              m_hThread;
 
+    // set when the pump returns, if it runs on a loop thread of the
+    // shared CAMTaskScheduler - that thread carries on after it
+    HANDLE              m_hLoopDone;
+    DWORD               m_dwLoopExitCode;
+
 protected:
 
     // if you want to override GetThreadMsg to block on other things
@@ -48,6 +53,8 @@ public:
     CMsgThread()
         : m_ThreadId(0),
         m_hThread(NULL),
+        m_hLoopDone(NULL),
+        m_dwLoopExitCode(0),
         m_lWaiting(0),
         m_hSem(NULL),
         // make a list with a cache of 5 items
@@ -67,6 +74,11 @@ public:
     BOOL CreateThread();
 
     BOOL WaitForThreadExit(__out LPDWORD lpdwExitCode) {
+        if (m_hLoopDone != NULL) {
+            WaitForSingleObject(m_hLoopDone, INFINITE);
+            *lpdwExitCode = m_dwLoopExitCode;
+            return TRUE;
+        }
         if (m_hThread != NULL) {
             WaitForSingleObject(m_hThread, INFINITE);
             return GetExitCodeThread(m_hThread, lpdwExitCode);
@@ -74,11 +86,21 @@ public:
         return FALSE;
     }
 
+    // a shared loop thread goes on to run other work, so can't be
+    // suspended or handed out
     DWORD ResumeThread() {
+        if (m_hLoopDone != NULL) {
+            SetLastError(ERROR_NOT_SUPPORTED);
+            return (DWORD) -1;
+        }
         return ::ResumeThread(m_hThread);
     }
 
     DWORD SuspendThread() {
+        if (m_hLoopDone != NULL) {
+            SetLastError(ERROR_NOT_SUPPORTED);
+            return (DWORD) -1;
+        }
         return ::SuspendThread(m_hThread);
     }
 
@@ -91,7 +113,7 @@ public:
     }
 
     HANDLE GetThreadHandle() {
-        return m_hThread;
+        return m_hLoopDone != NULL ? NULL : m_hThread;
     }
 
     DWORD GetThreadId() {
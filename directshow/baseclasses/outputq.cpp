@@ -40,6 +40,10 @@
 //
 //     dwPriority - If we create a thread set its priority to this
 //
+//     bLockFreeQueue - If we create a thread pass it samples through a
+//                  ring of lListSize entries rather than a locked list.
+//                  Receive then only waits if the ring is full
+//
 COutputQueue::COutputQueue(
              IPin         *pInputPin,          //  Pin to send stuff to
              __inout HRESULT      *phr,        //  'Return code'
@@ -49,12 +53,15 @@ COutputQueue::COutputQueue(
              BOOL          bBatchExact,        //  Batch exactly to BatchSize
              LONG          lListSize,
              DWORD         dwPriority,
-             bool          bFlushingOpt        // flushing optimization
+             bool          bFlushingOpt,       // flushing optimization
+             bool          bLockFreeQueue      // queue through a ring
             ) : m_lBatchSize(lBatchSize),
                 m_bBatchExact(bBatchExact && (lBatchSize > 1)),
                 m_hThread(NULL),
+                m_hLoopDone(NULL),
                 m_hSem(NULL),
                 m_List(NULL),
+                m_pRing(NULL),
                 m_pPin(pInputPin),
                 m_ppSamples(NULL),
                 m_lWaiting(0),
@@ -104,35 +111,65 @@ COutputQueue::COutputQueue(
 
     if (bQueue) {
         DbgLog((LOG_TRACE, 2, TEXT("Creating thread for output pin")));
-        m_hSem = CreateSemaphore(NULL, 0, 0x7FFFFFFF, NULL);
-        if (m_hSem == NULL) {
-            DWORD dwError = GetLastError();
-            *phr = AmHresultFromWin32(dwError);
-            return;
-        }
-        m_List = new CSampleList(NAME("Sample Queue List"),
-                                 lListSize,
-                                 FALSE         // No lock
-                                );
-        if (m_List == NULL) {
-            *phr = E_OUTOFMEMORY;
-            return;
+        if (bLockFreeQueue) {
+
+            //  A new segment takes two entries which must go in together
+
+            m_pRing = new CSPSCQueue<IMediaSample>;
+            if (m_pRing == NULL) {
+                *phr = E_OUTOFMEMORY;
+                return;
+            }
+            HRESULT hr = m_pRing->Initialize(max(lListSize, 2));
+            if (FAILED(hr)) {
+                *phr = hr;
+                return;
+            }
+        } else {
+            m_hSem = CreateSemaphore(NULL, 0, 0x7FFFFFFF, NULL);
+            if (m_hSem == NULL) {
+                DWORD dwError = GetLastError();
+                *phr = AmHresultFromWin32(dwError);
+                return;
+            }
+            m_List = new CSampleList(NAME("Sample Queue List"),
+                                     lListSize,
+                                     FALSE         // No lock
+                                    );
+            if (m_List == NULL) {
+                *phr = E_OUTOFMEMORY;
+                return;
+            }
         }
 
 
-        DWORD dwThreadId;
-        m_hThread = CreateThread(NULL,
-                                 0,
-                                 InitialThreadProc,
-                                 (LPVOID)this,
-                                 0,
-                                 &dwThreadId);
-        if (m_hThread == NULL) {
-            DWORD dwError = GetLastError();
-            *phr = AmHresultFromWin32(dwError);
-            return;
+        if (CAMTaskScheduler::IsSharing()) {
+            HRESULT hr = CAMTaskScheduler::GetDefault()->StartLoop(
+                                InitialThreadProc,
+                                (LPVOID)this,
+                                &m_hThread,
+                                &m_hLoopDone,
+                                NULL,
+                                dwPriority);
+            if (FAILED(hr)) {
+                *phr = hr;
+                return;
+            }
+        } else {
+            DWORD dwThreadId;
+            m_hThread = CreateThread(NULL,
+                                     0,
+                                     InitialThreadProc,
+                                     (LPVOID)this,
+                                     0,
+                                     &dwThreadId);
+            if (m_hThread == NULL) {
+                DWORD dwError = GetLastError();
+                *phr = AmHresultFromWin32(dwError);
+                return;
+            }
+            SetThreadPriority(m_hThread, dwPriority);
         }
-        SetThreadPriority(m_hThread, dwPriority);
     } else {
         DbgLog((LOG_TRACE, 2, TEXT("Calling input pin directly - no thread")));
     }
@@ -160,16 +197,21 @@ COutputQueue::~COutputQueue()
             m_hr = S_FALSE;
             NotifyThread();
         }
-        DbgWaitForSingleObject(m_hThread);
+        DbgWaitForSingleObject(m_hLoopDone ? m_hLoopDone : m_hThread);
         EXECUTE_ASSERT(CloseHandle(m_hThread));
+        if (m_hLoopDone != NULL) {
+            EXECUTE_ASSERT(CloseHandle(m_hLoopDone));
+        }
 
         //  The thread frees the samples when asked to terminate
 
-        ASSERT(m_List->GetCount() == 0);
-        delete m_List;
+        ASSERT(m_List == NULL || m_List->GetCount() == 0);
+        ASSERT(m_pRing == NULL || m_pRing->IsEmpty());
     } else {
         FreeSamples();
     }
+    delete m_List;
+    delete m_pRing;
     if (m_hSem != NULL) {
         EXECUTE_ASSERT(CloseHandle(m_hSem));
     }
@@ -200,10 +242,17 @@ DWORD WINAPI COutputQueue::InitialThreadProc(__in LPVOID pv)
 //  holding the critical section) and then waits for m_hSem to be
 //  set (not holding the critical section)
 //
+//  With a lock free queue the thread still holds the critical section
+//  while it takes samples off the ring, but only to keep out the control
+//  calls - Receive never takes it.  Instead of m_hSem the thread waits
+//  on m_evNotEmpty, registering as a waiter before it makes its last
+//  check of the ring so that it cannot miss a sample added meanwhile
+//
 DWORD COutputQueue::ThreadProc()
 {
     while (TRUE) {
         BOOL          bWait = FALSE;
+        LONG          lWaitKey = 0;
         IMediaSample *pSample;
         LONG          lNumberToSend; // Local copy
         NewSegmentPacket* ppacket;
@@ -228,12 +277,7 @@ DWORD COutputQueue::ThreadProc()
 
                 //  Get a sample off the list
 
-                pSample = m_List->RemoveHead();
-		// inform derived class we took something off the queue
-		if (m_hEventPop) {
-                    //DbgLog((LOG_TRACE,3,TEXT("Queue: Delivered  SET EVENT")));
-		    SetEvent(m_hEventPop);
-		}
+                pSample = RemoveHead();
 
                 if (pSample != NULL &&
                     !IsSpecialSample(pSample)) {
@@ -260,6 +304,19 @@ DWORD COutputQueue::ThreadProc()
                         ASSERT(m_lWaiting == 0);
                         m_lWaiting++;
                         bWait      = TRUE;
+
+                        //  The ring can be added to without the lock so
+                        //  look once more now that we're registered
+
+                        if (m_pRing) {
+                            lWaitKey = m_evNotEmpty.PrepareWait();
+                            if (!m_pRing->IsEmpty()) {
+                                m_evNotEmpty.CancelWait(lWaitKey);
+                                m_lWaiting = 0;
+                                bWait      = FALSE;
+                                continue;
+                            }
+                        }
                     } else {
 
                         //  We break out of the loop on SEND_PACKET unless
@@ -272,13 +329,7 @@ DWORD COutputQueue::ThreadProc()
                         if (pSample == NEW_SEGMENT) {
                             // now we need the parameters - we are
                             // guaranteed that the next packet contains them
-                            ppacket = (NewSegmentPacket *) m_List->RemoveHead();
-			    // we took something off the queue
-			    if (m_hEventPop) {
-                    	        //DbgLog((LOG_TRACE,3,TEXT("Queue: Delivered  SET EVENT")));
-		    	        SetEvent(m_hEventPop);
-			    }
-
+                            ppacket = (NewSegmentPacket *) RemoveHead();
                             ASSERT(ppacket);
                         }
                         //  EOS_PACKET falls through here and we exit the loop
@@ -298,7 +349,13 @@ DWORD COutputQueue::ThreadProc()
         //  Wait for some more data
 
         if (bWait) {
-            DbgWaitForSingleObject(m_hSem);
+            if (m_pRing) {
+                m_evNotEmpty.Wait(lWaitKey);
+                CAutoLock lck(this);
+                m_lWaiting = 0;
+            } else {
+                DbgWaitForSingleObject(m_hSem);
+            }
             continue;
         }
 
@@ -382,6 +439,10 @@ void COutputQueue::SendAnyway()
         ReceiveMultiple(NULL, 0, &nProcessed);
         m_bSendAnyway = FALSE;
 
+    } else if (m_pRing) {
+        IMediaSample * const pPacket = SEND_PACKET;
+        RingQueue(&pPacket, 1, FALSE);
+        m_evNotEmpty.NotifyAll();
     } else {
         CAutoLock lck(this);
         QueueSample(SEND_PACKET);
@@ -421,6 +482,14 @@ COutputQueue::NewSegment(
             ppack->tStop = tStop;
             ppack->dRate = dRate;
 
+            if (m_pRing) {
+                IMediaSample * const apPacket[2] =
+                    { NEW_SEGMENT, (IMediaSample*) ppack };
+                RingQueue(apPacket, 2, FALSE);
+                m_evNotEmpty.NotifyAll();
+                return;
+            }
+
             CAutoLock lck(this);
             QueueSample(NEW_SEGMENT);
             QueueSample( (IMediaSample*) ppack);
@@ -435,6 +504,16 @@ COutputQueue::NewSegment(
 //
 void COutputQueue::EOS()
 {
+    if (m_pRing) {
+        if (m_hr == S_OK) {
+            m_bFlushed = FALSE;
+            IMediaSample * const pPacket = EOS_PACKET;
+            RingQueue(&pPacket, 1, FALSE);
+            m_evNotEmpty.NotifyAll();
+        }
+        return;
+    }
+
     CAutoLock lck(this);
     if (!IsQueued()) {
         if (m_bBatchExact) {
@@ -479,6 +558,13 @@ void COutputQueue::BeginFlush()
                 m_hr = S_FALSE;
             }
 
+            //  Receive doesn't take the lock with a lock free queue so
+            //  it must either see m_hr or we must see m_bFlushed cleared
+
+            if (m_pRing) {
+                MemoryBarrier();
+            }
+
             // Optimize so we don't keep calling downstream all the time
 
             if (m_bFlushed && m_bFlushingOpt) {
@@ -533,6 +619,19 @@ void COutputQueue::EndFlush()
 
     if (IsQueued()) {
         m_evFlushComplete.Wait();
+
+        //  A lock free Receive may have put a sample on the ring after
+        //  the thread emptied it, so have the thread empty it once more
+        //  now that no more can arrive
+
+        if (m_pRing) {
+            {
+                CAutoLock lck(this);
+                m_evFlushComplete.Reset();
+                NotifyThread();
+            }
+            m_evFlushComplete.Wait();
+        }
     } else {
         FreeSamples();
     }
@@ -557,6 +656,7 @@ void COutputQueue::EndFlush()
 
 void COutputQueue::QueueSample(IMediaSample *pSample)
 {
+    ASSERT(m_List != NULL);
     if (NULL == m_List->AddTail(pSample)) {
         if (!IsSpecialSample(pSample)) {
             pSample->Release();
@@ -564,6 +664,68 @@ void COutputQueue::QueueSample(IMediaSample *pSample)
     }
 }
 
+//  COutputQueue::RingQueue
+//
+//  private method to add packets to the lock free ring, waiting for the
+//  thread to make room if it's full.  The packets go in together.
+//  If bAbortOnError is set we give up (returning FALSE) rather than wait
+//  once m_hr is no longer S_OK.
+//  The critical section must NOT be held when this is called
+
+BOOL COutputQueue::RingQueue(
+    __in_ecount(nPackets) IMediaSample * const *ppPackets,
+    LONG nPackets,
+    BOOL bAbortOnError)
+{
+    ASSERT(m_pRing != NULL);
+    while (TRUE) {
+        if (m_pRing->Enqueue(ppPackets, nPackets)) {
+            return TRUE;
+        }
+
+        //  Full - make sure the thread is emptying it then wait for room
+
+        m_evNotEmpty.NotifyAll();
+        LONG lKey = m_evNotFull.PrepareWait();
+        if (m_pRing->Enqueue(ppPackets, nPackets)) {
+            m_evNotFull.CancelWait(lKey);
+            return TRUE;
+        }
+        m_evNotFull.Wait(lKey);
+
+        //  A flush empties the ring to unblock us - don't fill it again
+
+        if (bAbortOnError && m_hr != S_OK) {
+            return FALSE;
+        }
+    }
+}
+
+//  COutputQueue::RemoveHead
+//
+//  private method for the thread to take the next packet off the queue.
+//  Returns NULL if the queue is empty
+
+IMediaSample *COutputQueue::RemoveHead()
+{
+    IMediaSample *pSample;
+    if (m_pRing) {
+        pSample = m_pRing->Dequeue();
+        if (pSample != NULL) {
+            m_evNotFull.NotifyAll();
+        }
+    } else {
+        pSample = m_List->RemoveHead();
+    }
+
+    // inform derived class we took something off the queue
+    if (m_hEventPop) {
+        //DbgLog((LOG_TRACE,3,TEXT("Queue: Delivered  SET EVENT")));
+        SetEvent(m_hEventPop);
+    }
+    return pSample;
+}
+
 //
 //  COutputQueue::Receive()
 //
@@ -599,6 +761,10 @@ HRESULT COutputQueue::ReceiveMultiple (
     if (nSamples < 0) {
         return E_INVALIDARG;
     }
+
+    if (m_pRing) {
+        return RingReceiveMultiple(ppSamples, nSamples, nSamplesProcessed);
+    }
     
     CAutoLock lck(this);
     //  Either call directly or queue up the samples
@@ -697,11 +863,61 @@ HRESULT COutputQueue::ReceiveMultiple (
     }
 }
 
+//
+//  COutputQueue::RingReceiveMultiple()
+//
+//  ReceiveMultiple for a lock free queue - the samples go straight on
+//  the ring and we only wake the thread if it's waiting and there's
+//  enough for it to do
+//
+
+HRESULT COutputQueue::RingReceiveMultiple (
+    __in_ecount(nSamples) IMediaSample **ppSamples,
+    long nSamples,
+    __out long *nSamplesProcessed)
+{
+    //  Pairs with the barrier in BeginFlush - it either sees that we
+    //  have had data or we see its m_hr
+
+    m_bFlushed = FALSE;
+    MemoryBarrier();
+
+    long i = 0;
+    if (m_hr == S_OK) {
+        for (; i < nSamples; i++) {
+            if (!RingQueue(&ppSamples[i], 1, TRUE)) {
+                break;
+            }
+        }
+    }
+    *nSamplesProcessed = i;
+
+    if (i < nSamples) {
+        DbgLog((LOG_TRACE, 3, TEXT("COutputQueue (ring) : Discarding %d samples code 0x%8.8X"),
+                nSamples - i, m_hr));
+        for (; i < nSamples; i++) {
+            ppSamples[i]->Release();
+        }
+        return m_hr;
+    }
+
+    if (!m_bBatchExact ||
+        m_nBatched + m_pRing->GetCount() >= m_lBatchSize) {
+        m_evNotEmpty.NotifyAll();
+    }
+    return S_OK;
+}
+
 //  Get ready for new data - cancels sticky m_hr
 void COutputQueue::Reset()
 {
     if (!IsQueued()) {
         m_hr = S_OK;
+    } else if (m_pRing) {
+        IMediaSample * const pPacket = RESET_PACKET;
+        RingQueue(&pPacket, 1, FALSE);
+        m_evNotEmpty.NotifyAll();
+        m_evFlushComplete.Wait();
     } else {
         {
             CAutoLock lck(this);
@@ -718,12 +934,7 @@ void COutputQueue::FreeSamples()
     CAutoLock lck(this);
     if (IsQueued()) {
         while (TRUE) {
-            IMediaSample *pSample = m_List->RemoveHead();
-	    // inform derived class we took something off the queue
-	    if (m_hEventPop) {
-                //DbgLog((LOG_TRACE,3,TEXT("Queue: Delivered  SET EVENT")));
-	        SetEvent(m_hEventPop);
-	    }
+            IMediaSample *pSample = RemoveHead();
 
             if (pSample == NULL) {
                 break;
@@ -734,13 +945,7 @@ void COutputQueue::FreeSamples()
                 if (pSample == NEW_SEGMENT) {
                     //  Free NEW_SEGMENT packet
                     NewSegmentPacket *ppacket =
-                        (NewSegmentPacket *) m_List->RemoveHead();
-		    // inform derived class we took something off the queue
-		    if (m_hEventPop) {
-                        //DbgLog((LOG_TRACE,3,TEXT("Queue: Delivered  SET EVENT")));
-		        SetEvent(m_hEventPop);
-		    }
-
+                        (NewSegmentPacket *) RemoveHead();
                     ASSERT(ppacket != NULL);
                     delete ppacket;
                 }
@@ -760,7 +965,12 @@ void COutputQueue::NotifyThread()
 {
     //  Optimize - no need to signal if it's not waiting
     ASSERT(IsQueued());
-    if (m_lWaiting) {
+    if (m_pRing) {
+
+        //  The thread clears m_lWaiting itself when it wakes
+
+        m_evNotEmpty.NotifyAll();
+    } else if (m_lWaiting) {
         ReleaseSemaphore(m_hSem, m_lWaiting, NULL);
         m_lWaiting = 0;
     }
@@ -782,14 +992,18 @@ BOOL COutputQueue::IsIdle()
     //  AND
     //      there's nothing in the current batch (m_nBatched == 0)
 
-    if (IsQueued() && m_lWaiting == 0 || m_nBatched != 0) {
+    //  With a lock free queue samples can arrive while the thread is
+    //  still marked as waiting
+
+    if (IsQueued() && m_lWaiting == 0 || m_nBatched != 0 ||
+        m_pRing && !m_pRing->IsEmpty()) {
         return FALSE;
     } else {
 
         //  If we're idle it shouldn't be possible for there
         //  to be anything on the work queue
 
-        ASSERT(!IsQueued() || m_List->GetCount() == 0);
+        ASSERT(m_List == NULL || m_List->GetCount() == 0);
         return TRUE;
     }
 }
@@ -26,7 +26,8 @@ public:
                                 DEFAULTCACHE,
                  DWORD      dwPriority =        //  Priority of thread to create
                                 THREAD_PRIORITY_NORMAL,
-                 bool       bFlushingOpt = false // flushing optimization
+                 bool       bFlushingOpt = false, // flushing optimization
+                 bool       bLockFreeQueue = false // queue through a ring
                 );
     ~COutputQueue();
 
@@ -67,12 +68,25 @@ protected:
     DWORD ThreadProc();
     BOOL  IsQueued()
     {
-        return m_List != NULL;
+        return m_List != NULL || m_pRing != NULL;
     };
 
     //  The critical section MUST be held when this is called
     void QueueSample(IMediaSample *pSample);
 
+    //  Lock free queueing - the critical section must NOT be held as
+    //  these may wait for the thread to make room in the ring
+    BOOL RingQueue(__in_ecount(nPackets) IMediaSample * const *ppPackets,
+                   LONG nPackets,
+                   BOOL bAbortOnError);
+    HRESULT RingReceiveMultiple(
+        __in_ecount(nSamples) IMediaSample **ppSamples,
+        long nSamples,
+        __out long *nSamplesProcessed);
+
+    //  Take the next packet off whichever queue we are using
+    IMediaSample *RemoveHead();
+
     BOOL IsSpecialSample(IMediaSample *pSample)
     {
         return (DWORD_PTR)pSample > (DWORD_PTR)(LONG_PTR)(-16);
@@ -107,8 +121,17 @@ protected:
 
     CSampleList   *       m_List;
     HANDLE                m_hSem;
+
+    //  Used instead of m_List, m_hSem and the critical section when the
+    //  queue is lock free.  Only one thread at a time may call Receive,
+    //  ReceiveMultiple, EOS, NewSegment, SendAnyway and Reset - which is
+    //  the usual rule for a streaming thread anyway
+    CSPSCQueue<IMediaSample> * m_pRing;
+    CAMEventCount         m_evNotEmpty;     // thread waits on this
+    CAMEventCount         m_evNotFull;      // Receive waits on this
     CAMEvent                m_evFlushComplete;
     HANDLE                m_hThread;
+    HANDLE                m_hLoopDone;      // if on a shared loop thread
     __field_ecount_opt(m_lBatchSize) IMediaSample  **      m_ppSamples;
     __range(0, m_lBatchSize)         LONG                  m_nBatched;
 
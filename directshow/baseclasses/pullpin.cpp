@@ -19,7 +19,30 @@
 CPullPin::CPullPin()
   : m_pReader(NULL),
     m_pAlloc(NULL),
-    m_State(TM_Exit)
+    m_State(TM_Exit),
+    m_cMaxRequests(0),
+    m_cbMaxRequest(0),
+    m_cRequestLimit(0),
+    m_cbRequestLimit(0),
+    m_cRequests(0),
+    m_cbRequest(0),
+    m_lAlign(1),
+    m_eLastStep(RA_None),
+    m_lBeforeStep(0),
+    m_bProbing(TRUE),
+    m_cHoldWindows(0),
+    m_llBaseRate(0),
+    m_llRate(0),
+    m_llFrequency(0),
+    m_llWindowStart(0),
+    m_llWindowBytes(0),
+    m_llWindowLatency(0),
+    m_cWindowRequests(0),
+    m_rtLatency(0),
+    m_pPending(NULL),
+    m_cPending(0),
+    m_dwNextRequest(0),
+    m_dwNextDeliver(0)
 {
 #ifdef DXMPERF
 	PERFLOG_CTOR( L"CPullPin", this );
@@ -31,6 +54,9 @@ CPullPin::~CPullPin()
 {
     Disconnect();
 
+    // the thread has gone, so CleanupCancelled released anything parked
+    delete [] m_pPending;
+
 #ifdef DXMPERF
 	PERFLOG_DTOR( L"CPullPin", this );
 #endif // DXMPERF
@@ -150,8 +176,8 @@ CPullPin::DecideAllocator(
     ALLOCATOR_PROPERTIES *pRequest;
     ALLOCATOR_PROPERTIES Request;
     if (pProps == NULL) {
-	Request.cBuffers = 3;
-	Request.cbBuffer = 64*1024;
+	Request.cBuffers = m_cMaxRequests ? m_cMaxRequests : 3;
+	Request.cbBuffer = m_cMaxRequests ? m_cbMaxRequest : 64*1024;
 	Request.cbAlign = 0;
 	Request.cbPrefix = 0;
 	pRequest = &Request;
@@ -213,6 +239,62 @@ CPullPin::Duration(__out REFERENCE_TIME* ptDuration)
     return S_OK;
 }
 
+HRESULT
+CPullPin::SetReadAhead(LONG cMaxRequests, LONG cbMaxRequest)
+{
+    CAutoLock lock(&m_AccessLock);
+
+    if (m_pReader) {
+	return VFW_E_ALREADY_CONNECTED;
+    }
+    if (cMaxRequests < 0 || cbMaxRequest < 0 ||
+	(cMaxRequests == 0) != (cbMaxRequest == 0)) {
+	return E_INVALIDARG;
+    }
+
+    LARGE_INTEGER liFrequency;
+    if (cMaxRequests != 0 &&
+	(!QueryPerformanceFrequency(&liFrequency) || liFrequency.QuadPart <= 0)) {
+	return E_NOTIMPL;
+    }
+
+    m_cMaxRequests = cMaxRequests;
+    m_cbMaxRequest = cbMaxRequest;
+    m_llFrequency = cMaxRequests ? liFrequency.QuadPart : 0;
+
+    // start small - we grow as soon as we can see it helps
+    m_cRequests = 2;
+    m_cbRequest = 64*1024;
+    m_eLastStep = RA_None;
+    m_bProbing = TRUE;
+    m_cHoldWindows = 0;
+    m_llBaseRate = 0;
+    m_llRate = 0;
+    m_rtLatency = 0;
+    return S_OK;
+}
+
+HRESULT
+CPullPin::GetReadAhead(
+    __out LONG* pcRequests,
+    __out LONG* pcbRequest,
+    __out_opt LONGLONG* pllBytesPerSecond,
+    __out_opt REFERENCE_TIME* prtLatency)
+{
+    CheckPointer(pcRequests, E_POINTER);
+    CheckPointer(pcbRequest, E_POINTER);
+
+    *pcRequests = m_cRequests;
+    *pcbRequest = m_cbRequest;
+    if (pllBytesPerSecond) {
+	*pllBytesPerSecond = m_llRate;
+    }
+    if (prtLatency) {
+	*prtLatency = m_rtLatency;
+    }
+    return m_cMaxRequests ? S_OK : S_FALSE;
+}
+
 
 HRESULT
 CPullPin::StartThread()
@@ -336,17 +418,23 @@ HRESULT
 CPullPin::QueueSample(
     __inout REFERENCE_TIME& tCurrent,
     REFERENCE_TIME tAlignStop,
-    BOOL bDiscontinuity
+    BOOL bDiscontinuity,
+    LONG cbRequest,
+    DWORD dwFlags
     )
 {
     IMediaSample* pSample;
 
-    HRESULT hr = m_pAlloc->GetBuffer(&pSample, NULL, NULL, 0);
+    HRESULT hr = m_pAlloc->GetBuffer(&pSample, NULL, NULL, dwFlags);
     if (FAILED(hr)) {
 	return hr;
     }
 
-    LONGLONG tStopThis = tCurrent + (pSample->GetSize() * UNITS);
+    LONG cbThis = pSample->GetSize();
+    if (cbRequest > 0 && cbRequest < cbThis) {
+	cbThis = cbRequest;
+    }
+    LONGLONG tStopThis = tCurrent + (cbThis * UNITS);
     if (tStopThis > tAlignStop) {
 	tStopThis = tAlignStop;
     }
@@ -355,14 +443,28 @@ CPullPin::QueueSample(
 
     pSample->SetDiscontinuity(bDiscontinuity);
 
+    // tag the request with its sequence number, and when reading ahead
+    // note when it was issued so we can time it
+    const DWORD_PTR dwSequence = m_dwNextRequest;
+    PendingRead* pSlot = &m_pPending[dwSequence % m_cPending];
+    ASSERT(pSlot->pSample == NULL);
+    pSlot->llIssued = 0;
+    if (m_cMaxRequests) {
+	LARGE_INTEGER liNow;
+	QueryPerformanceCounter(&liNow);
+	pSlot->llIssued = liNow.QuadPart;
+    }
+
     hr = m_pReader->Request(
 			pSample,
-			0);
+			dwSequence);
     if (FAILED(hr)) {
 	pSample->Release();
 
 	CleanupCancelled();
 	OnError(hr);
+    } else {
+	m_dwNextRequest++;
     }
     return hr;
 }
@@ -372,17 +474,43 @@ CPullPin::CollectAndDeliver(
     REFERENCE_TIME tStart,
     REFERENCE_TIME tStop)
 {
-    IMediaSample* pSample = NULL;   // better be sure pSample is set
-    DWORD_PTR dwUnused;
-    HRESULT hr = m_pReader->WaitForNext(
+    // the one we want may have arrived while we were waiting for another
+    PendingRead* pNext = &m_pPending[m_dwNextDeliver % m_cPending];
+    HRESULT hr = S_OK;
+    while (pNext->pSample == NULL) {
+	IMediaSample* pSample = NULL;   // better be sure pSample is set
+	DWORD_PTR dwSequence;
+	hr = m_pReader->WaitForNext(
 			INFINITE,
 			&pSample,
-			&dwUnused);
-    if (FAILED(hr)) {
-	if (pSample) {
+			&dwSequence);
+	if (FAILED(hr)) {
+	    if (pSample) {
+		pSample->Release();
+	    }
+	    break;
+	}
+
+	// anything but one of the requests still outstanding means the
+	// reader has lost track
+	PendingRead* pSlot = &m_pPending[dwSequence % m_cPending];
+	if (dwSequence - m_dwNextDeliver >= m_dwNextRequest - m_dwNextDeliver ||
+	    pSlot->pSample != NULL) {
+	    DbgBreak("CPullPin: completion for a request we did not make");
 	    pSample->Release();
+	    hr = E_UNEXPECTED;
+	    break;
 	}
-    } else {
+	pSlot->pSample = pSample;
+	if (m_cMaxRequests) {
+	    RecordCompletion(pSample, pSlot->llIssued);
+	}
+    }
+
+    if (SUCCEEDED(hr)) {
+	IMediaSample* pSample = pNext->pSample;
+	pNext->pSample = NULL;
+	m_dwNextDeliver++;
 	hr = DeliverSample(pSample, tStart, tStop);
     }
     if (FAILED(hr)) {
@@ -459,10 +587,23 @@ CPullPin::Process(void)
     // doesn't matter
     REFERENCE_TIME tAlignStop = AlignUp(tStop / UNITS, Actual.cbAlign) * UNITS;
 
+    if (!m_bSync) {
+	hr = ResetPending(Actual.cBuffers);
+	if (FAILED(hr)) {
+	    OnError(hr);
+	    return;
+	}
+    }
 
     DWORD dwRequest;
 
-    if (!m_bSync) {
+    if (!m_bSync && m_cMaxRequests) {
+
+	hr = ProcessReadAhead(tStart, tCurrent, tStop, tAlignStop, Actual);
+	if (hr != S_OK) {
+	    return;
+	}
+    } else if (!m_bSync) {
 
 	//  Break out of the loop either if we get to the end or we're asked
 	//  to do something else
@@ -565,6 +706,192 @@ CPullPin::Process(void)
     EndOfStream();
 }
 
+// Keep m_cRequests requests of m_cbRequest bytes in flight, collecting
+// and delivering each in turn.  cInFlight counts the requests not yet
+// delivered, including any that completed early and are waiting for
+// their turn, as those still hold a buffer each.  Unlike the loop in
+// Process we never wait for a buffer while we have a request to collect,
+// since the buffers we are waiting for may be the ones sitting in the
+// reader's queue.
+HRESULT
+CPullPin::ProcessReadAhead(
+    REFERENCE_TIME tStart,
+    REFERENCE_TIME tCurrent,
+    REFERENCE_TIME tStop,
+    REFERENCE_TIME tAlignStop,
+    const ALLOCATOR_PROPERTIES& Actual)
+{
+    // we can't have more in flight, or ask for more, than the allocator
+    // has given us
+    m_lAlign = max(Actual.cbAlign, 1);
+    m_cRequestLimit = min(m_cMaxRequests, Actual.cBuffers);
+    m_cbRequestLimit = (LONG) AlignDown(min(m_cbMaxRequest, Actual.cbBuffer), m_lAlign);
+    if (m_cRequestLimit < 1 || m_cbRequestLimit < m_lAlign) {
+	OnError(VFW_E_SIZENOTSET);
+	return VFW_E_SIZENOTSET;
+    }
+    m_cRequests = max(min(m_cRequests, m_cRequestLimit), 1);
+    m_cbRequest = max((LONG) AlignDown(min(m_cbRequest, m_cbRequestLimit), m_lAlign), m_lAlign);
+
+    LARGE_INTEGER liNow;
+    QueryPerformanceCounter(&liNow);
+    m_llWindowStart = liNow.QuadPart;
+    m_llWindowBytes = 0;
+    m_llWindowLatency = 0;
+    m_cWindowRequests = 0;
+
+    BOOL bDiscontinuity = TRUE;
+    LONG cInFlight = 0;
+    DWORD dwRequest;
+    HRESULT hr;
+
+    while (tCurrent < tAlignStop || cInFlight > 0) {
+
+	// Break out without calling EndOfStream if we're asked to
+	// do something different.  ThreadProc cleans up the requests
+	if (CheckRequest(&dwRequest)) {
+	    return S_FALSE;
+	}
+
+	// top up the requests in flight
+	while (cInFlight < m_cRequests && tCurrent < tAlignStop) {
+
+	    hr = QueueSample(tCurrent, tAlignStop, bDiscontinuity, m_cbRequest,
+			     cInFlight ? AM_GBF_NOWAIT : 0);
+	    if (hr == VFW_E_TIMEOUT) {
+		// all our buffers are busy - go and collect one
+		break;
+	    }
+	    if (FAILED(hr)) {
+		return hr;
+	    }
+	    bDiscontinuity = FALSE;
+	    cInFlight++;
+	}
+
+	hr = CollectAndDeliver(tStart, tStop);
+	cInFlight--;
+	if (S_OK != hr) {
+
+	    // stop if error, or if downstream filter said
+	    // to stop.
+	    return hr;
+	}
+    }
+    return S_OK;
+}
+
+// called as each completion is collected, in whatever order the reader
+// finishes them - the latency is the reader's, not how long a sample
+// then waited for its turn
+void
+CPullPin::RecordCompletion(IMediaSample* pSample, LONGLONG llIssued)
+{
+    LARGE_INTEGER liNow;
+    QueryPerformanceCounter(&liNow);
+
+    m_llWindowLatency += liNow.QuadPart - llIssued;
+    m_llWindowBytes += pSample->GetActualDataLength();
+
+    // measure over enough requests that each window sees the whole
+    // pipeline turn over a couple of times
+    if (++m_cWindowRequests < max(2 * m_cRequests, 8)) {
+	return;
+    }
+    const LONGLONG llElapsed = liNow.QuadPart - m_llWindowStart;
+    if (llElapsed <= 0) {
+	return;
+    }
+
+    m_llRate = LONGLONG(double(m_llWindowBytes) * m_llFrequency / llElapsed);
+    m_rtLatency = REFERENCE_TIME(double(m_llWindowLatency) * UNITS /
+				 m_llFrequency / m_cWindowRequests);
+
+    DbgLog((LOG_TRACE, 3, TEXT("CPullPin read-ahead %d x %d bytes: %d KB/s, %d us"),
+	    m_cRequests, m_cbRequest, LONG(m_llRate / 1024), LONG(m_rtLatency / 10)));
+
+    AdaptReadAhead(m_llRate);
+
+    m_llWindowStart = liNow.QuadPart;
+    m_llWindowBytes = 0;
+    m_llWindowLatency = 0;
+    m_cWindowRequests = 0;
+}
+
+void
+CPullPin::AdaptReadAhead(LONGLONG llBytesPerSecond)
+{
+    enum { ReprobeWindows = 32 };
+
+    if (!m_bProbing) {
+
+	// try again every so often, or straight away if we've slowed
+	// down a lot, in case the device or the load on it has changed
+	if (++m_cHoldWindows < ReprobeWindows &&
+	    llBytesPerSecond >= m_llBaseRate * 3 / 4) {
+	    return;
+	}
+	m_bProbing = TRUE;
+	m_eLastStep = RA_None;
+    } else if (m_eLastStep != RA_None) {
+
+	// did the last step help?
+	if (llBytesPerSecond < m_llBaseRate * 95 / 100) {
+
+	    // made it worse - take it back. The step may have been cut short
+	    // by a limit, so halving wouldn't necessarily undo it
+	    if (m_eLastStep == RA_Depth) {
+		m_cRequests = m_lBeforeStep;
+	    } else {
+		m_cbRequest = m_lBeforeStep;
+	    }
+	    llBytesPerSecond = m_llBaseRate;
+	}
+	if (llBytesPerSecond < m_llBaseRate * 105 / 100) {
+
+	    // no better - stay here
+	    m_bProbing = FALSE;
+	    m_eLastStep = RA_None;
+	    m_cHoldWindows = 0;
+	    m_llBaseRate = llBytesPerSecond;
+	    return;
+	}
+    }
+
+    m_llBaseRate = llBytesPerSecond;
+    if (!GrowReadAhead()) {
+	m_bProbing = FALSE;
+	m_eLastStep = RA_None;
+	m_cHoldWindows = 0;
+    }
+}
+
+// double whichever of the depth and the request size is proportionally
+// further from its limit
+BOOL
+CPullPin::GrowReadAhead()
+{
+    const BOOL bCanDeepen = m_cRequests < m_cRequestLimit;
+    const BOOL bCanWiden = m_cbRequest < m_cbRequestLimit;
+
+    if (bCanDeepen &&
+	(!bCanWiden ||
+	 LONGLONG(m_cRequests) * m_cbRequestLimit <=
+	 LONGLONG(m_cbRequest) * m_cRequestLimit)) {
+	m_lBeforeStep = m_cRequests;
+	m_cRequests = min(m_cRequests * 2, m_cRequestLimit);
+	m_eLastStep = RA_Depth;
+	return TRUE;
+    }
+    if (bCanWiden) {
+	m_lBeforeStep = m_cbRequest;
+	m_cbRequest = (LONG) AlignDown(min(LONGLONG(m_cbRequest) * 2, LONGLONG(m_cbRequestLimit)), m_lAlign);
+	m_eLastStep = RA_Size;
+	return TRUE;
+    }
+    return FALSE;
+}
+
 // after a flush, cancelled i/o will be waiting for collection
 // and release
 void
@@ -582,7 +909,41 @@ CPullPin::CleanupCancelled(void)
 	    pSample->Release();
 	} else {
 	    // no more samples
-	    return;
+	    break;
+	}
+    }
+
+    // and any that completed ahead of their turn
+    for (LONG i = 0; i < m_cPending; i++) {
+	if (m_pPending[i].pSample) {
+	    m_pPending[i].pSample->Release();
+	    m_pPending[i].pSample = NULL;
 	}
     }
 }
+
+HRESULT
+CPullPin::ResetPending(LONG cBuffers)
+{
+    if (cBuffers < 1) {
+	return VFW_E_SIZENOTSET;
+    }
+    if (cBuffers != m_cPending) {
+	PendingRead* pPending = new PendingRead[cBuffers];
+	if (pPending == NULL) {
+	    return E_OUTOFMEMORY;
+	}
+	ZeroMemory(pPending, cBuffers * sizeof(PendingRead));
+	delete [] m_pPending;
+	m_pPending = pPending;
+	m_cPending = cBuffers;
+    }
+    for (LONG i = 0; i < m_cPending; i++) {
+	ASSERT(m_pPending[i].pSample == NULL);
+	m_pPending[i].pSample = NULL;
+	m_pPending[i].llIssued = 0;
+    }
+    m_dwNextRequest = 0;
+    m_dwNextDeliver = 0;
+    return S_OK;
+}
@@ -55,12 +55,32 @@ class CPullPin : public CAMThread
     // stop and close thread
     HRESULT StopThread();
 
+    // adaptive version of the async part of Process - returns S_OK if
+    // we got to the end
+    HRESULT ProcessReadAhead(
+		REFERENCE_TIME tStart,
+		REFERENCE_TIME tCurrent,
+		REFERENCE_TIME tStop,
+		REFERENCE_TIME tAlignStop,
+		const ALLOCATOR_PROPERTIES& Actual);
+
+    // measure a completed read-ahead request and adapt to it
+    void RecordCompletion(IMediaSample* pSample, LONGLONG llIssued);
+    void AdaptReadAhead(LONGLONG llBytesPerSecond);
+    BOOL GrowReadAhead();
+
     // called from ProcessAsync to queue and collect requests
+    // cbRequest limits the request to less than the whole buffer and
+    // dwFlags are passed to GetBuffer
     HRESULT QueueSample(
 		__inout REFERENCE_TIME& tCurrent,
 		REFERENCE_TIME tAlignStop,
-		BOOL bDiscontinuity);
+		BOOL bDiscontinuity,
+		LONG cbRequest = 0,
+		DWORD dwFlags = 0);
 
+    // delivers the next sample in the order it was requested, collecting
+    // completions until it turns up
     HRESULT CollectAndDeliver(
 		REFERENCE_TIME tStart,
 		REFERENCE_TIME tStop);
@@ -70,6 +90,58 @@ class CPullPin : public CAMThread
 		REFERENCE_TIME tStart,
 		REFERENCE_TIME tStop);
 
+    // size the reorder slots for cBuffers requests and empty them
+    HRESULT ResetPending(LONG cBuffers);
+
+    // The reader may complete requests in any order, so each is tagged
+    // with a sequence number in its dwUser, and a completion that arrives
+    // before its turn waits in the slot for that number until the ones
+    // ahead of it have been delivered.  We never have more requests
+    // outstanding than the allocator has buffers, so that many slots,
+    // indexed by sequence number modulo the count, can never collide
+    struct PendingRead {
+	IMediaSample*   pSample;        // completed but not yet delivered
+	LONGLONG        llIssued;       // counter when requested, if reading ahead
+    };
+    PendingRead*        m_pPending;
+    LONG                m_cPending;
+    DWORD_PTR           m_dwNextRequest;    // sequence number of the next request
+    DWORD_PTR           m_dwNextDeliver;    // ... and of the next to deliver
+
+    // adaptive read-ahead - all zero unless SetReadAhead is called.
+    // We start with a couple of small requests and, while doing so makes
+    // us read faster, double either the number in flight or their size,
+    // whichever is further from its limit.  When a step makes no
+    // difference we stay where we are, and when it makes things worse we
+    // take it back.  Every so often we try growing again in case things
+    // have changed
+    LONG                m_cMaxRequests;     // limits set by SetReadAhead
+    LONG                m_cbMaxRequest;
+    LONG                m_cRequestLimit;    // ... as the allocator allows
+    LONG                m_cbRequestLimit;
+    LONG                m_cRequests;        // requests to keep in flight
+    LONG                m_cbRequest;        // size of each
+    LONG                m_lAlign;
+
+    enum ReadAheadStep {
+	RA_None,        // holding steady
+	RA_Depth,       // last doubled the number of requests
+	RA_Size,        // last doubled the request size
+    };
+    ReadAheadStep       m_eLastStep;
+    LONG                m_lBeforeStep;      // what it changed, before it
+    BOOL                m_bProbing;         // still looking for the best
+    LONG                m_cHoldWindows;     // windows since we stopped
+    LONGLONG            m_llBaseRate;       // bytes/sec before the last step
+    LONGLONG            m_llRate;           // bytes/sec in the last window
+
+    LONGLONG            m_llFrequency;      // performance counter rate
+    LONGLONG            m_llWindowStart;    // current measurement window
+    LONGLONG            m_llWindowBytes;
+    LONGLONG            m_llWindowLatency;  // total, in counter ticks
+    LONG                m_cWindowRequests;
+    REFERENCE_TIME      m_rtLatency;        // mean in the last window
+
 protected:
     IMemAllocator *     m_pAlloc;
 
@@ -104,6 +176,20 @@ public:
     // return the total duration
     HRESULT Duration(__out REFERENCE_TIME* ptDuration);
 
+    // Keep up to cMaxRequests async requests of up to cbMaxRequest bytes
+    // each in flight, adapting the number and size to whatever gives the
+    // best throughput.  Must be called before Connect, as the default
+    // allocator is then asked for cMaxRequests buffers of cbMaxRequest
+    // bytes.  Ignored when using sync reads
+    HRESULT SetReadAhead(LONG cMaxRequests, LONG cbMaxRequest);
+
+    // where the read-ahead has got to - for diagnostics
+    HRESULT GetReadAhead(
+		__out LONG* pcRequests,
+		__out LONG* pcbRequest,
+		__out_opt LONGLONG* pllBytesPerSecond,
+		__out_opt REFERENCE_TIME* prtLatency);
+
     // start pulling data
     HRESULT Active(void);
 
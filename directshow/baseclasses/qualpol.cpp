@@ -0,0 +1,332 @@
+//------------------------------------------------------------------------------
+// File: QualPol.cpp
+//
+// Desc: DirectShow base classes - implements the video renderer quality
+//       control policies.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#include <streams.h>
+
+
+static const CAMVideoQualityPolicy g_DefaultPolicy;
+static const CAMLowLatencyQualityPolicy g_LowLatencyPolicy;
+static const CAMSmoothCadenceQualityPolicy g_SmoothCadencePolicy;
+static const CAMKeyFrameQualityPolicy g_KeyFramePolicy;
+
+const CAMVideoQualityPolicy *
+CAMVideoQualityPolicy::Get(AM_VIDEO_QUALITY_POLICY Policy)
+{
+    switch (Policy) {
+    case AM_QUALITY_DEFAULT:
+        return &g_DefaultPolicy;
+    case AM_QUALITY_LOW_LATENCY:
+        return &g_LowLatencyPolicy;
+    case AM_QUALITY_SMOOTH_CADENCE:
+        return &g_SmoothCadencePolicy;
+    case AM_QUALITY_KEY_FRAMES:
+        return &g_KeyFramePolicy;
+    }
+    return NULL;
+}
+
+
+// --- CAMVideoQualityPolicy -----------------------
+
+int CAMVideoQualityPolicy::AveragingPeriod() const
+{
+    return AVGPERIOD;
+}
+
+
+BOOL CAMVideoQualityPolicy::UsesJitter() const
+{
+    return FALSE;
+}
+
+
+BOOL CAMVideoQualityPolicy::ShouldDraw(const AM_VIDEO_QUALITY_STATE *pState) const
+{
+    // We will DRAW this frame IF...
+    return
+          // ...the time we are spending drawing is a small fraction of the total
+          // observed inter-frame time so that dropping it won't help much.
+          (3*pState->trRenderAvg <= pState->trFrameAvg)
+
+         // ...or our supplier is NOT handling things and the next frame would
+         // be less timely than this one or our supplier CLAIMS to be handling
+         // things, and is now less than a full FOUR frames late.
+       || ( pState->bSupplierHandlingQuality
+          ? (pState->trLate <= pState->trDuration*4)
+          : (pState->trLate+pState->trLate < pState->trDuration)
+          )
+
+          // ...or we are on average waiting for over eight milliseconds then
+          // this may be just a glitch.  Draw it and we'll hope to catch up.
+       || (pState->trWaitAvg > 80000)
+
+          // ...or we haven't drawn an image for over a second.  We will update
+          // the display, which stops the video looking hung.
+          // Do this regardless of how late this media sample is.
+       || (pState->trSinceLastDraw > UNITS);
+}
+
+
+BOOL CAMVideoQualityPolicy::ShouldDrawAtOnce(const AM_VIDEO_QUALITY_STATE *pState) const
+{
+    // We will play it early if we think we are in slow machine mode.
+    BOOL bPlayASAP = FALSE;
+
+    // we will play it AT ONCE (slow machine mode) if...
+
+        // ...we are playing catch-up
+    if (pState->bJustDroppedFrame) {
+        bPlayASAP = TRUE;
+    }
+
+        // ...or if we are running below the true frame rate
+        // exact comparisons are glitchy, for these measurements,
+        // so add an extra 5% or so
+    else if (  (pState->trFrameAvg > pState->trDuration + pState->trDuration/16)
+
+               // It's possible to get into a state where we are losing ground, but
+               // are a very long way ahead.  To avoid this or recover from it
+               // we refuse to play early by more than 10 frames.
+            && (pState->trLate > - pState->trDuration*10)
+            ){
+        bPlayASAP = TRUE;
+    }
+
+    // We will NOT play it at once if we are grossly early.  On very slow frame
+    // rate movies - e.g. clock.avi - it is not a good idea to leap ahead just
+    // because we got starved (for instance by the net) and dropped one frame
+    // some time or other.  If we are more than 900mSec early, then wait.
+    if (pState->trLate<-9000000) {
+        bPlayASAP = FALSE;
+    }
+    return bPlayASAP;
+}
+
+
+void CAMVideoQualityPolicy::GetQuality(const AM_VIDEO_QUALITY_STATE *pState,
+                                       __inout Quality *pq) const
+{
+    // If we are the main user of time, then report this as Flood/Dry.
+    // If our suppliers are, then report it as Famine/Glut.
+    //
+    // We need to take action, but avoid hunting.  Hunting is caused by
+    // 1. Taking too much action too soon and overshooting
+    // 2. Taking too long to react (so averaging can CAUSE hunting).
+    //
+    // The reason why we use trLate as well as Wait is to reduce hunting;
+    // if the wait time is coming down and about to go into the red, we do
+    // NOT want to rely on some average which is only telling is that it used
+    // to be OK once.
+
+    const int trFrameAvg = pState->trFrameAvg;
+    const int trWaitAvg = pState->trWaitAvg;
+    const int trLate = pState->trLate;
+
+    if (trFrameAvg<0) {
+        pq->Type = Famine;      // guess
+    }
+    // Is the greater part of the time taken bltting or something else
+    else if (trFrameAvg > 2*pState->trRenderAvg) {
+        pq->Type = Famine;                        // mainly other
+    } else {
+        pq->Type = Flood;                         // mainly bltting
+    }
+
+    pq->Proportion = 1000;               // default
+
+    if (trFrameAvg<0) {
+        // leave it alone - we don't know enough
+    }
+    else if ( trLate> 0 ) {
+        // try to catch up over the next second
+        // We could be Really, REALLY late, but rendering all the frames
+        // anyway, just because it's so cheap.
+
+        pq->Proportion = 1000 - (int)((trLate)/(UNITS/1000));
+        if (pq->Proportion<500) {
+           pq->Proportion = 500;      // don't go daft. (could've been negative!)
+        }
+
+    } else if (  trWaitAvg>20000
+              && trLate<-20000
+              ){
+        // Go cautiously faster - aim at 2mSec wait.
+        if (trWaitAvg>=trFrameAvg) {
+            // This can happen because of some fudges.
+            // The waitAvg is how long we originally planned to wait
+            // The frameAvg is more honest.
+            // It means that we are spending a LOT of time waiting
+            pq->Proportion = 2000;    // double.
+        } else {
+            if (trFrameAvg+20000 > trWaitAvg) {
+                pq->Proportion
+                    = 1000 * (trFrameAvg / (trFrameAvg + 20000 - trWaitAvg));
+            } else {
+                // We're apparently spending more than the whole frame time waiting.
+                // Assume that the averages are slightly out of kilter, but that we
+                // are indeed doing a lot of waiting.  (This leg probably never
+                // happens, but the code avoids any potential divide by zero).
+                pq->Proportion = 2000;
+            }
+        }
+
+        if (pq->Proportion>2000) {
+            pq->Proportion = 2000;    // don't go crazy.
+        }
+    }
+
+    // Tell the supplier how late frames are when they get rendered
+    // That's how late we are now.
+    // If we are in directdraw mode then the guy upstream can see the drawing
+    // times and we'll just report on the start time.  He can figure out any
+    // offset to apply.  If we are in DIB Section mode then we will apply an
+    // extra offset which is half of our drawing time.  This is usually small
+    // but can sometimes be the dominant effect.  For this we will use the
+    // average drawing time rather than the last frame.  If the last frame took
+    // a long time to draw and made us late, that's already in the lateness
+    // figure.  We should not add it in again unless we expect the next frame
+    // to be the same.  We don't, we expect the average to be a better shot.
+    // In direct draw mode the RenderAvg will be zero.
+
+    pq->Late = pState->trLateUncapped + pState->trRenderAvg/2;
+}
+
+
+// --- CAMLowLatencyQualityPolicy -----------------------
+
+// Follow changes within a frame or two
+
+int CAMLowLatencyQualityPolicy::AveragingPeriod() const
+{
+    return 2;
+}
+
+
+// A frame that is more than half a frame late only holds up the ones after
+// it, however cheap it is to draw. We still draw something every second so
+// the picture doesn't look hung
+
+BOOL CAMLowLatencyQualityPolicy::ShouldDraw(const AM_VIDEO_QUALITY_STATE *pState) const
+{
+    return (pState->trLate+pState->trLate < pState->trDuration)
+        || (pState->trSinceLastDraw > UNITS);
+}
+
+
+// Catch up as soon as we fall behind at all, but never draw more than a
+// frame early
+
+BOOL CAMLowLatencyQualityPolicy::ShouldDrawAtOnce(const AM_VIDEO_QUALITY_STATE *pState) const
+{
+    if (pState->trLate < -pState->trDuration) {
+        return FALSE;
+    }
+    return pState->bJustDroppedFrame
+        || (pState->trFrameAvg > pState->trDuration);
+}
+
+
+// Ask for twice the default cut when late, and report the whole of our
+// drawing time as lateness, as the next frame will take it too
+
+void CAMLowLatencyQualityPolicy::GetQuality(const AM_VIDEO_QUALITY_STATE *pState,
+                                            __inout Quality *pq) const
+{
+    CAMVideoQualityPolicy::GetQuality(pState, pq);
+    if (pState->trFrameAvg >= 0 && pState->trLate > 0) {
+        pq->Proportion = 1000 - (int)((pState->trLate)/(UNITS/2000));
+        if (pq->Proportion < 250) {
+            pq->Proportion = 250;
+        }
+    }
+    pq->Late = pState->trLateUncapped + pState->trRenderAvg;
+}
+
+
+// --- CAMSmoothCadenceQualityPolicy -----------------------
+
+// Ignore the odd slow frame
+
+int CAMSmoothCadenceQualityPolicy::AveragingPeriod() const
+{
+    return 16;
+}
+
+
+// ShouldDraw is more patient when the frame times are uneven
+
+BOOL CAMSmoothCadenceQualityPolicy::UsesJitter() const
+{
+    return TRUE;
+}
+
+
+// Every dropped frame is a jump in the picture, so put up with being up to
+// two frames late (four if our supplier is dropping for us), and never drop
+// two in a row. If the frame times are already uneven a drop only makes
+// them worse, so then we wait until we are four frames late regardless
+
+BOOL CAMSmoothCadenceQualityPolicy::ShouldDraw(const AM_VIDEO_QUALITY_STATE *pState) const
+{
+    if (pState->bJustDroppedFrame || pState->trSinceLastDraw > UNITS) {
+        return TRUE;
+    }
+    int nFrames = pState->bSupplierHandlingQuality ? 4 : 2;
+    if (pState->iJitter * 10000 > pState->trDuration / 2) {
+        nFrames = 4;
+    }
+    return (3*pState->trRenderAvg <= pState->trFrameAvg)
+        || (pState->trLate <= pState->trDuration * nFrames);
+}
+
+
+// Drawing frames early to catch up is what makes the times between them
+// uneven, so only do it when we are falling behind by a whole frame at a
+// time
+
+BOOL CAMSmoothCadenceQualityPolicy::ShouldDrawAtOnce(const AM_VIDEO_QUALITY_STATE *pState) const
+{
+    return (pState->trFrameAvg > 2 * pState->trDuration)
+        && (pState->trLate > - pState->trDuration*10);
+}
+
+
+// Ask for gentler changes than the default, and report lateness that is
+// half how late we are now and half how late we have been on average, so
+// the supplier doesn't chase every glitch
+
+void CAMSmoothCadenceQualityPolicy::GetQuality(const AM_VIDEO_QUALITY_STATE *pState,
+                                               __inout Quality *pq) const
+{
+    CAMVideoQualityPolicy::GetQuality(pState, pq);
+    if (pq->Proportion < 750) {
+        pq->Proportion = 750;
+    } else if (pq->Proportion > 1250) {
+        pq->Proportion = 1250;
+    }
+
+    // the first frame isn't in the statistics - see RecordFrameLateness
+    if (pState->cFramesDrawn > 2) {
+        REFERENCE_TIME trAvgLate =
+            (pState->iTotAcc / (pState->cFramesDrawn - 1)) * 10000;
+        pq->Late = (pState->trLateUncapped + trAvgLate) / 2 + pState->trRenderAvg/2;
+    }
+}
+
+
+// --- CAMKeyFrameQualityPolicy -----------------------
+
+// Dropping a sync point means whatever is drawn until the next one is
+// built on the wrong picture, so they are always drawn
+
+BOOL CAMKeyFrameQualityPolicy::ShouldDraw(const AM_VIDEO_QUALITY_STATE *pState) const
+{
+    return pState->bSyncPoint || CAMVideoQualityPolicy::ShouldDraw(pState);
+}
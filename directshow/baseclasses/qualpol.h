@@ -0,0 +1,131 @@
+//------------------------------------------------------------------------------
+// File: QualPol.h
+//
+// Desc: DirectShow base classes - defines the quality control policies that
+//       CBaseVideoRenderer uses to decide when to draw and drop frames.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+/* CBaseVideoRenderer keeps the averages and statistics, and asks its policy
+   three things about each frame it schedules:
+
+       ShouldDraw        draw the frame, or drop it
+       ShouldDrawAtOnce  draw it as soon as we can, or when it is due
+       GetQuality        what to tell the filter upstream
+
+   A policy only sees what is in AM_VIDEO_QUALITY_STATE, so it can be tried
+   out by handing it made up states, without a graph or a clock.
+
+   CAMVideoQualityPolicy makes the decisions the renderer always has. The
+   others are
+
+       CAMLowLatencyQualityPolicy      drops anything over half a frame late
+                                       and reacts to changes quickly
+       CAMSmoothCadenceQualityPolicy   drops as little as possible, and then
+                                       one frame at a time
+       CAMKeyFrameQualityPolicy        as the default, but never drops a
+                                       sync point
+
+   Policies hold no state of their own, so the renderers in a process can
+   share them. The ones here are static objects returned by
+   CAMVideoQualityPolicy::Get */
+
+
+#ifndef __QUALPOL__
+#define __QUALPOL__
+
+
+// what CBaseVideoRenderer knows when it schedules a frame - times are in
+// REFERENCE_TIME units unless they say otherwise
+
+struct AM_VIDEO_QUALITY_STATE {
+
+    // the frame being scheduled
+    int trLate;                     // how late it would be drawn now
+                                    // (negative is early), within 50 seconds
+    REFERENCE_TIME trLateUncapped;  // trLate as it really is, for Quality.Late
+    int trDuration;                 // its duration
+    REFERENCE_TIME trSinceLastDraw; // since a frame was last drawn
+    BOOL bSyncPoint;                // the sample is a sync point
+    BOOL bJustDroppedFrame;         // we or our supplier dropped the last one
+    BOOL bSupplierHandlingQuality;  // our supplier acts on Quality messages
+
+    // averages over the last few frames
+    int trRenderAvg;                // time taken to draw
+    int trFrameAvg;                 // time between frames, -1 if not known
+    int trWaitAvg;                  // how early we were
+
+    // since streaming started, as IQualProp reports them
+    int cFramesDrawn;
+    int cFramesDropped;             // in the renderer
+    LONGLONG iTotAcc;               // sum of the sync offsets (mSec)
+    int iJitter;                    // std deviation of frame time (mSec),
+                                    // 0 unless the policy UsesJitter
+};
+
+enum AM_VIDEO_QUALITY_POLICY {
+    AM_QUALITY_DEFAULT,
+    AM_QUALITY_LOW_LATENCY,
+    AM_QUALITY_SMOOTH_CADENCE,
+    AM_QUALITY_KEY_FRAMES
+};
+
+
+class CAMVideoQualityPolicy {
+
+public:
+
+    // the policy asked for, or NULL
+    static const CAMVideoQualityPolicy *Get(AM_VIDEO_QUALITY_POLICY Policy);
+
+    // how many frames the renderer's moving averages cover
+    virtual int AveragingPeriod() const;
+
+    // TRUE if the policy looks at iJitter, which costs a square root a frame
+    virtual BOOL UsesJitter() const;
+
+    // TRUE to draw the frame, FALSE to drop it
+    virtual BOOL ShouldDraw(const AM_VIDEO_QUALITY_STATE *pState) const;
+
+    // for a frame being drawn, TRUE to draw it at once rather than wait
+    virtual BOOL ShouldDrawAtOnce(const AM_VIDEO_QUALITY_STATE *pState) const;
+
+    // fill in the Type, Proportion and Late of the message to send upstream
+    virtual void GetQuality(const AM_VIDEO_QUALITY_STATE *pState,
+                            __inout Quality *pq) const;
+};
+
+
+class CAMLowLatencyQualityPolicy : public CAMVideoQualityPolicy {
+
+public:
+
+    int AveragingPeriod() const;
+    BOOL ShouldDraw(const AM_VIDEO_QUALITY_STATE *pState) const;
+    BOOL ShouldDrawAtOnce(const AM_VIDEO_QUALITY_STATE *pState) const;
+    void GetQuality(const AM_VIDEO_QUALITY_STATE *pState, __inout Quality *pq) const;
+};
+
+
+class CAMSmoothCadenceQualityPolicy : public CAMVideoQualityPolicy {
+
+public:
+
+    int AveragingPeriod() const;
+    BOOL UsesJitter() const;
+    BOOL ShouldDraw(const AM_VIDEO_QUALITY_STATE *pState) const;
+    BOOL ShouldDrawAtOnce(const AM_VIDEO_QUALITY_STATE *pState) const;
+    void GetQuality(const AM_VIDEO_QUALITY_STATE *pState, __inout Quality *pq) const;
+};
+
+
+class CAMKeyFrameQualityPolicy : public CAMVideoQualityPolicy {
+
+public:
+
+    BOOL ShouldDraw(const AM_VIDEO_QUALITY_STATE *pState) const;
+};
+
+#endif // __QUALPOL__
@@ -63,6 +63,8 @@ CBaseReferenceClock::~CBaseReferenceClock()
         EXECUTE_ASSERT( CloseHandle(m_pSchedule->GetEvent()) );
 	delete m_pSchedule;
     }
+
+    delete m_pTimeSource;
 }
 
 // A derived class may supply a hThreadEvent if it has its own thread that will take care
@@ -73,9 +75,14 @@ CBaseReferenceClock::CBaseReferenceClock( __in_opt LPCTSTR pName,
                                           __inout HRESULT *phr, 
                                           __inout_opt CAMSchedule * pShed )
 : CUnknown( pName, pUnk )
+, m_pTimeSource(NULL)
+, m_rtPrevSourceTime(0)
 , m_rtLastGotTime(0)
+, m_rtNextAdvise(MAX_TIME)
 , m_TimerResolution(0)
 , m_bAbort( FALSE )
+, m_rtSpinWindow(0)
+, m_rtTolerance(UNITS / MILLISECONDS)
 , m_pSchedule( pShed ? pShed : new CAMSchedule(CreateEvent(NULL, FALSE, FALSE, NULL)) )
 , m_hThread(0)
 {
@@ -84,6 +91,8 @@ CBaseReferenceClock::CBaseReferenceClock( __in_opt LPCTSTR pName,
     PERFLOG_CTOR( pName ? pName : L"CBaseReferenceClock", (IReferenceClock *) this );
 #endif // DXMPERF
 
+    ZeroMemory(&m_WakeupStats, sizeof(m_WakeupStats));
+
     ASSERT(m_pSchedule);
     if (!m_pSchedule)
     {
@@ -100,12 +109,15 @@ CBaseReferenceClock::CBaseReferenceClock( __in_opt LPCTSTR pName,
         timeBeginPeriod(m_TimerResolution);
 
         /* Initialise our system times - the derived clock should set the right values */
-        m_dwPrevSystemTime = timeGetTime();
-        m_rtPrivateTime = (UNITS / MILLISECONDS) * m_dwPrevSystemTime;
+        m_pTimeSource = new CAMTickTimeSource;
+        if (m_pTimeSource) {
+            m_rtPrevSourceTime = m_pTimeSource->GetTime();
+        } else {
+            *phr = E_OUTOFMEMORY;
+        }
+        m_rtPrivateTime = (UNITS / MILLISECONDS) * timeGetTime();
 
-        #ifdef PERF
-            m_idGetSystemTime = MSR_REGISTER(TEXT("CBaseReferenceClock::GetTime"));
-        #endif
+        m_idGetSystemTime = MSR_REGISTER(TEXT("CBaseReferenceClock::GetTime"));
 
         if ( !pShed )
         {
@@ -233,7 +245,44 @@ REFERENCE_TIME CBaseReferenceClock::GetPrivateTime()
 {
     CAutoLock cObjectLock(this);
 
+    /* Only the difference between successive readings matters, so our
+     * time carries on smoothly whatever the source's origin
+     */
+
+    const REFERENCE_TIME rtSource = m_pTimeSource->GetTime();
+    m_rtPrivateTime += rtSource - m_rtPrevSourceTime;
+    m_rtPrevSourceTime = rtSource;
+
+    return m_rtPrivateTime;
+}
+
+
+HRESULT CBaseReferenceClock::SetTimeSource( __in CAMTimeSource * pSource )
+{
+    CheckPointer(pSource, E_POINTER);
+    CAutoLock cObjectLock(this);
+
+    // Bring our time up to date from the old source before we drop it
+    if (m_pTimeSource) {
+        CBaseReferenceClock::GetPrivateTime();
+        delete m_pTimeSource;
+    }
+    m_pTimeSource = pSource;
+    m_rtPrevSourceTime = pSource->GetTime();
+    return NOERROR;
+}
+
+
+/* Time sources */
 
+CAMTickTimeSource::CAMTickTimeSource()
+: m_dwPrevTicks( timeGetTime() )
+{
+    m_rtTime = (UNITS / MILLISECONDS) * m_dwPrevTicks;
+}
+
+REFERENCE_TIME CAMTickTimeSource::GetTime()
+{
     /* If the clock has wrapped then the current time will be less than
      * the last time we were notified so add on the extra milliseconds
      *
@@ -242,12 +291,98 @@ REFERENCE_TIME CBaseReferenceClock::GetPrivateTime()
      */
 
     DWORD dwTime = timeGetTime();
-    {
-        m_rtPrivateTime += Int32x32To64(UNITS / MILLISECONDS, (DWORD)(dwTime - m_dwPrevSystemTime));
-        m_dwPrevSystemTime = dwTime;
+    m_rtTime += Int32x32To64(UNITS / MILLISECONDS, (DWORD)(dwTime - m_dwPrevTicks));
+    m_dwPrevTicks = dwTime;
+    return m_rtTime;
+}
+
+REFERENCE_TIME CAMTickTimeSource::GetResolution()
+{
+    return UNITS / MILLISECONDS;
+}
+
+
+CAMCounterTimeSource::CAMCounterTimeSource(__inout HRESULT *phr)
+: m_llFrequency(0)
+, m_llBaseCount(0)
+, m_lSlewPPM(0)
+, m_rtTickTime(0)
+{
+    LARGE_INTEGER liFrequency, liCount;
+    if (!QueryPerformanceFrequency(&liFrequency) || liFrequency.QuadPart <= 0 ||
+        !QueryPerformanceCounter(&liCount)) {
+        *phr = E_NOTIMPL;
+        liFrequency.QuadPart = 0;
+        liCount.QuadPart = 0;
     }
+    m_llFrequency = liFrequency.QuadPart;
+    m_llBaseCount = liCount.QuadPart;
 
-    return m_rtPrivateTime;
+    // Start out in step with timeGetTime
+    m_dwStartTicks = m_dwPrevTicks = timeGetTime();
+    m_rtStartTime = m_rtBaseTime = (UNITS / MILLISECONDS) * m_dwStartTicks;
+}
+
+// Our time at a given counter value.  The multiply is split so that
+// it cannot overflow however long it has been since the last calibration
+REFERENCE_TIME CAMCounterTimeSource::TimeAt(LONGLONG llCount) const
+{
+    const LONGLONG llElapsed = llCount - m_llBaseCount;
+    REFERENCE_TIME rtElapsed = (llElapsed / m_llFrequency) * UNITS +
+                               (llElapsed % m_llFrequency) * UNITS / m_llFrequency;
+    rtElapsed += rtElapsed * m_lSlewPPM / 1000000;
+    return m_rtBaseTime + rtElapsed;
+}
+
+// Compare how much time we have measured since we started with how
+// much timeGetTime has, and adjust our rate if we have drifted
+void CAMCounterTimeSource::Calibrate(LONGLONG llCount, DWORD dwTicks)
+{
+    const REFERENCE_TIME rtNow = TimeAt(llCount);
+    m_rtTickTime += (UNITS / MILLISECONDS) * (LONGLONG)(DWORD)(dwTicks - m_dwPrevTicks);
+    m_dwPrevTicks = dwTicks;
+
+    // Positive means we are running slow
+    const REFERENCE_TIME rtError = (m_rtStartTime + m_rtTickTime) - rtNow;
+
+    if (rtError > DriftTolerance || rtError < -DriftTolerance) {
+        // Aim to be back in line after SlewPeriod seconds
+        LONGLONG llPPM = rtError * 1000000 / (SlewPeriod * UNITS);
+        if (llPPM > MaxSlewPPM) llPPM = MaxSlewPPM;
+        if (llPPM < -MaxSlewPPM) llPPM = -MaxSlewPPM;
+        m_lSlewPPM = LONG(llPPM);
+    } else if ((rtError >= 0) != (m_lSlewPPM >= 0)) {
+        // We have pulled back past the point where we agree - stop slewing
+        m_lSlewPPM = 0;
+    }
+
+    DbgLog((LOG_TIMING, 4,
+        TEXT("CAMCounterTimeSource::Calibrate() error %ld us, slew %ld ppm"),
+        LONG(rtError / 10), m_lSlewPPM));
+
+    // Start the new rate from here so that time stays continuous
+    m_llBaseCount = llCount;
+    m_rtBaseTime = rtNow;
+}
+
+REFERENCE_TIME CAMCounterTimeSource::GetTime()
+{
+    ASSERT(m_llFrequency > 0);
+
+    LARGE_INTEGER liCount;
+    QueryPerformanceCounter(&liCount);
+
+    const DWORD dwTicks = timeGetTime();
+    if ((DWORD)(dwTicks - m_dwPrevTicks) >= CalibrationPeriod) {
+        Calibrate(liCount.QuadPart, dwTicks);
+    }
+    return TimeAt(liCount.QuadPart);
+}
+
+REFERENCE_TIME CAMCounterTimeSource::GetResolution()
+{
+    const REFERENCE_TIME rtResolution = UNITS / m_llFrequency;
+    return rtResolution > 0 ? rtResolution : 1;
 }
 
 
@@ -335,27 +470,51 @@ HRESULT CBaseReferenceClock::AdviseThread()
     {
         // Wait for an interesting event to happen
         DbgLog((LOG_TIMING, 3, TEXT("CBaseRefClock::AdviseThread() Delay: %lu ms"), dwWait ));
-        WaitForSingleObject(m_pSchedule->GetEvent(), dwWait);
+        const DWORD dwResult = WaitForSingleObject(m_pSchedule->GetEvent(), dwWait);
         if (m_bAbort) break;
 
+        REFERENCE_TIME rtSpinWindow, rtTolerance;
+        {
+            CAutoLock cObjectLock(this);
+            rtSpinWindow = m_rtSpinWindow;
+            rtTolerance = m_rtTolerance;
+        }
+
         // There are several reasons why we need to work from the internal
         // time, mainly to do with what happens when time goes backwards.
         // Mainly, it stop us looping madly if an event is just about to
         // expire when the clock goes backward (i.e. GetTime stop for a
         // while).
-        const REFERENCE_TIME  rtNow = GetPrivateTime();
+        REFERENCE_TIME rtNow = GetPrivateTime();
+
+        // If we woke because the next advise is nearly due (rather than
+        // because the schedule changed) spin out the rest of the wait
+        BOOL bSpun = FALSE;
+        if ( dwResult == WAIT_TIMEOUT && rtSpinWindow > 0 && rtNow < m_rtNextAdvise )
+        {
+            rtNow = SpinUntil( m_rtNextAdvise );
+            bSpun = TRUE;
+        }
+        if ( dwResult == WAIT_TIMEOUT && rtNow >= m_rtNextAdvise - rtTolerance )
+        {
+            RecordWakeup( rtNow - m_rtNextAdvise, bSpun );
+        }
 
         DbgLog((LOG_TIMING, 3,
               TEXT("CBaseRefClock::AdviseThread() Woke at = %lu ms"),
               ConvertToMilliseconds(rtNow) ));
 
-        // We must add in a millisecond, since this is the resolution of our
-        // WaitForSingleObject timer.  Failure to do so will cause us to loop
-        // franticly for (approx) 1 a millisecond.
-        m_rtNextAdvise = m_pSchedule->Advise( 10000 + rtNow );
+        // Without spinning we must add in a millisecond, since this is the
+        // resolution of our WaitForSingleObject timer.  Failure to do so
+        // will cause us to loop franticly for (approx) 1 a millisecond.
+        m_rtNextAdvise = m_pSchedule->Advise( rtTolerance + rtNow );
         LONGLONG llWait = m_rtNextAdvise - rtNow;
 
-        ASSERT( llWait > 0 );
+        ASSERT( llWait > 0 || rtSpinWindow > 0 );
+
+        // When spinning, only block until we are within the spin window
+        llWait -= rtSpinWindow;
+        if (llWait < 0) llWait = 0;
 
         llWait = ConvertToMilliseconds(llWait);
         // DON'T replace this with a max!! (The type's of these things is VERY important)
@@ -364,6 +523,88 @@ HRESULT CBaseReferenceClock::AdviseThread()
     return NOERROR;
 }
 
+// Spin on our own time until rtDeadline.  We give up early if we are
+// shutting down or the schedule changes, as the next advise may then
+// be due sooner.
+REFERENCE_TIME CBaseReferenceClock::SpinUntil(REFERENCE_TIME rtDeadline)
+{
+    for (DWORD dwSpins = 0; ; dwSpins++)
+    {
+        const REFERENCE_TIME rtNow = GetPrivateTime();
+        if ( rtNow >= rtDeadline || m_bAbort ) return rtNow;
+
+        // Looking at the event costs a kernel call, so not every time
+        if ( (dwSpins & 63) == 63 &&
+             WaitForSingleObject(m_pSchedule->GetEvent(), 0) == WAIT_OBJECT_0 )
+        {
+            return rtNow;
+        }
+        YieldProcessor();
+    }
+}
+
+void CBaseReferenceClock::RecordWakeup(REFERENCE_TIME rtLateness, BOOL bSpun)
+{
+    // Upper bounds of the lateness buckets, in 100ns units
+    static const REFERENCE_TIME artBucket[AM_WAKEUP_BUCKETS - 1] = {
+        500, 1000, 2500, 5000, 10000, 20000, 50000
+    };
+
+    if (rtLateness < 0) rtLateness = 0;
+    int iBucket = 0;
+    while (iBucket < AM_WAKEUP_BUCKETS - 1 && rtLateness >= artBucket[iBucket]) {
+        iBucket++;
+    }
+
+    CAutoLock cObjectLock(this);
+    m_WakeupStats.cWakeups++;
+    if (bSpun) m_WakeupStats.cSpins++;
+    m_WakeupStats.rtTotalLateness += rtLateness;
+    if (rtLateness > m_WakeupStats.rtMaxLateness) {
+        m_WakeupStats.rtMaxLateness = rtLateness;
+    }
+    m_WakeupStats.acLateness[iBucket]++;
+}
+
+HRESULT CBaseReferenceClock::SetAdaptiveWait(
+    REFERENCE_TIME rtSpinWindow,
+    REFERENCE_TIME rtTolerance)
+{
+    if (rtSpinWindow < 0 || rtTolerance < -1) {
+        return E_INVALIDARG;
+    }
+    if (rtTolerance == -1) {
+        rtTolerance = rtSpinWindow > 0 ? 0 : UNITS / MILLISECONDS;
+    }
+
+    // Without spinning, a tolerance of less than the wait resolution
+    // would have the thread loop franticly
+    if (rtSpinWindow == 0 && rtTolerance < UNITS / MILLISECONDS) {
+        return E_INVALIDARG;
+    }
+
+    CAutoLock cObjectLock(this);
+    m_rtSpinWindow = rtSpinWindow;
+    m_rtTolerance = rtTolerance;
+    if (m_pSchedule->GetAdviseCount() > 0) TriggerThread();
+    return NOERROR;
+}
+
+HRESULT CBaseReferenceClock::GetWakeupStatistics(
+    __out AM_CLOCK_WAKEUP_STATISTICS * pStats)
+{
+    CheckPointer(pStats, E_POINTER);
+    CAutoLock cObjectLock(this);
+    *pStats = m_WakeupStats;
+    return NOERROR;
+}
+
+void CBaseReferenceClock::ResetWakeupStatistics()
+{
+    CAutoLock cObjectLock(this);
+    ZeroMemory(&m_WakeupStats, sizeof(m_WakeupStats));
+}
+
 HRESULT CBaseReferenceClock::SetDefaultTimerResolution(
         REFERENCE_TIME timerResolution // in 100ns
     )
@@ -24,6 +24,95 @@ inline LONGLONG WINAPI ConvertToMilliseconds(const REFERENCE_TIME& RT)
     return (RT / (UNITS / MILLISECONDS));
 }
 
+/* A time source is what a CBaseReferenceClock reads to find out how much
+   time has passed.  It returns a monotonic time in 100ns units from an
+   arbitrary origin - the clock only ever uses the difference between two
+   readings, so the origin does not matter.  The clock owns its time source
+   and only calls it with the clock locked, so a time source needs no
+   locking of its own.
+
+   CAMTickTimeSource is the traditional source, built on timeGetTime, and
+   is only as good as the multimedia timer resolution (1ms at best).
+
+   CAMCounterTimeSource reads QueryPerformanceCounter, which on current
+   hardware is the invariant TSC or the HPET, so it resolves well under a
+   microsecond.  The counter's rate can differ slightly from the system's
+   idea of a millisecond, so every CalibrationPeriod it compares the time
+   it has measured with timeGetTime and, once the two have drifted further
+   apart than timeGetTime's own jitter can explain, slews its rate (by at
+   most MaxSlewPPM) to pull back into line.  It never steps, so the time
+   it returns never goes backwards.
+*/
+
+class AM_NOVTABLE CAMTimeSource
+{
+public:
+    virtual ~CAMTimeSource() {};
+
+    // Current time in 100ns units
+    virtual REFERENCE_TIME GetTime() = 0;
+
+    // Smallest change GetTime can report, in 100ns units
+    virtual REFERENCE_TIME GetResolution() = 0;
+};
+
+class CAMTickTimeSource : public CAMTimeSource
+{
+    DWORD          m_dwPrevTicks;       // Last value we got from timeGetTime
+    REFERENCE_TIME m_rtTime;            // Accumulated, so we survive the wrap
+public:
+    CAMTickTimeSource();
+    REFERENCE_TIME GetTime();
+    REFERENCE_TIME GetResolution();
+};
+
+class CAMCounterTimeSource : public CAMTimeSource
+{
+    enum { CalibrationPeriod = 1000,    // ms between drift checks
+           DriftTolerance = 20000,      // 2ms - beyond timeGetTime jitter
+           SlewPeriod = 16,             // Seconds over which to correct drift
+           MaxSlewPPM = 500 };
+
+    LONGLONG       m_llFrequency;       // Counts per second
+    LONGLONG       m_llBaseCount;       // Counter at the last calibration
+    REFERENCE_TIME m_rtBaseTime;        // Our time at the last calibration
+    LONG           m_lSlewPPM;          // Rate correction in parts per million
+
+    DWORD          m_dwStartTicks;      // timeGetTime when we started
+    REFERENCE_TIME m_rtStartTime;       // Our time when we started
+    REFERENCE_TIME m_rtTickTime;        // timeGetTime since then, in 100ns
+    DWORD          m_dwPrevTicks;
+
+    REFERENCE_TIME TimeAt(LONGLONG llCount) const;
+    void Calibrate(LONGLONG llCount, DWORD dwTicks);
+
+public:
+    // Fails with E_NOTIMPL if there is no usable performance counter
+    CAMCounterTimeSource(__inout HRESULT *phr);
+    REFERENCE_TIME GetTime();
+    REFERENCE_TIME GetResolution();
+
+    // Current rate correction, for diagnostics
+    LONG GetSlewPPM() const { return m_lSlewPPM; }
+};
+
+/* Statistics on how late the advise thread woke up for the advises it
+   fired.  The lateness of a wakeup is how long after the time of the
+   first advise it fired it got round to firing it.
+*/
+
+enum { AM_WAKEUP_BUCKETS = 8 };
+
+typedef struct tagAM_CLOCK_WAKEUP_STATISTICS {
+    DWORD          cWakeups;            // Wakeups that fired an advise
+    DWORD          cSpins;              // ... of which spun out the last slice
+    REFERENCE_TIME rtTotalLateness;     // 100ns units
+    REFERENCE_TIME rtMaxLateness;
+    // Wakeups less than 50us, 100us, 250us, 500us, 1ms, 2ms, 5ms late,
+    // and the rest
+    DWORD          acLateness[AM_WAKEUP_BUCKETS];
+} AM_CLOCK_WAKEUP_STATISTICS;
+
 /* This class hierarchy will support an IReferenceClock interface so
    that an audio card (or other externally driven clock) can update the
    system wide clock that everyone uses.
@@ -136,6 +225,24 @@ public:
     /* Provide a method for correcting drift */
     STDMETHODIMP SetTimeDelta( const REFERENCE_TIME& TimeDelta );
 
+    // By default the advise thread just blocks until the next advise is
+    // due, so advises fire up to a millisecond early and as late as the
+    // scheduler makes it.  With a non-zero rtSpinWindow the thread only
+    // blocks until the next advise is that close, then spins on
+    // GetPrivateTime for the rest of the way.  rtTolerance is how early an
+    // advise may be fired - pass -1 for the default, which is 1ms without
+    // spinning and 0 with.  Both are in 100ns units
+    HRESULT SetAdaptiveWait( REFERENCE_TIME rtSpinWindow, REFERENCE_TIME rtTolerance = -1 );
+
+    HRESULT GetWakeupStatistics( __out AM_CLOCK_WAKEUP_STATISTICS * pStats );
+    void ResetWakeupStatistics();
+
+    // Replace the source the default GetPrivateTime reads.  We take
+    // ownership of pSource, deleting it when it is replaced or when we
+    // are destroyed.  Time carries on from where the old source left
+    // off, so this can be done at any time.
+    HRESULT SetTimeSource( __in CAMTimeSource * pSource );
+
     CAMSchedule * GetSchedule() const { return m_pSchedule; }
 
     // IReferenceClockTimerControl methods
@@ -150,14 +257,13 @@ public:
 
 private:
     REFERENCE_TIME m_rtPrivateTime;     // Current best estimate of time
-    DWORD          m_dwPrevSystemTime;  // Last vaule we got from timeGetTime
+    CAMTimeSource *m_pTimeSource;       // Where GetPrivateTime gets time from
+    REFERENCE_TIME m_rtPrevSourceTime;  // Last value we got from m_pTimeSource
     REFERENCE_TIME m_rtLastGotTime;     // Last time returned by GetTime
     REFERENCE_TIME m_rtNextAdvise;      // Time of next advise
     UINT           m_TimerResolution;
 
-#ifdef PERF
     int m_idGetSystemTime;
-#endif
 
 // Thread stuff
 public:
@@ -171,7 +277,13 @@ private:
     BOOL           m_bAbort;            // Flag used for thread shutdown
     HANDLE         m_hThread;           // Thread handle
 
+    REFERENCE_TIME m_rtSpinWindow;      // See SetAdaptiveWait
+    REFERENCE_TIME m_rtTolerance;
+    AM_CLOCK_WAKEUP_STATISTICS m_WakeupStats;
+
     HRESULT AdviseThread();             // Method in which the advise thread runs
+    REFERENCE_TIME SpinUntil(REFERENCE_TIME rtDeadline);
+    void RecordWakeup(REFERENCE_TIME rtLateness, BOOL bSpun);
     static DWORD __stdcall AdviseThreadFunction(__in LPVOID); // Function used to get there
 
 protected:
@@ -52,11 +52,9 @@ CBaseRenderer::CBaseRenderer(REFCLSID RenderClass, // CLSID for this renderer
 {
     if (SUCCEEDED(*phr)) {
         Ready();
-#ifdef PERF
         m_idBaseStamp = MSR_REGISTER(TEXT("BaseRenderer: sample time stamp"));
         m_idBaseRenderTime = MSR_REGISTER(TEXT("BaseRenderer: draw time (msec)"));
         m_idBaseAccuracy = MSR_REGISTER(TEXT("BaseRenderer: Accuracy (msec)"));
-#endif
     }
 }
 
@@ -996,6 +994,8 @@ HRESULT CBaseRenderer::Render(IMediaSample *pMediaSample)
 
     // Time how long the rendering takes
 
+    CAMTraceSpan Span(AM_TRACE_RENDER, m_pName, m_pInputPin ? m_pInputPin->Name() : NULL, pMediaSample);
+    RecordLatency(pMediaSample);
     OnRenderStart(pMediaSample);
     DoRenderSample(pMediaSample);
     OnRenderEnd(pMediaSample);
@@ -1776,11 +1776,11 @@ CBaseVideoRenderer::CBaseVideoRenderer(
     CBaseRenderer(RenderClass,pName,pUnk,phr),
     m_cFramesDropped(0),
     m_cFramesDrawn(0),
-    m_bSupplierHandlingQuality(FALSE)
+    m_bSupplierHandlingQuality(FALSE),
+    m_pQualityPolicy(CAMVideoQualityPolicy::Get(AM_QUALITY_DEFAULT))
 {
     ResetStreamingTimes();
 
-#ifdef PERF
     m_idTimeStamp       = MSR_REGISTER(TEXT("Frame time stamp"));
     m_idEarliness       = MSR_REGISTER(TEXT("Earliness fudge"));
     m_idTarget          = MSR_REGISTER(TEXT("Target (mSec)"));
@@ -1791,7 +1791,9 @@ CBaseVideoRenderer::CBaseVideoRenderer(
     m_idWaitReal        = MSR_REGISTER(TEXT("Render wait"));
     // m_idWait            = MSR_REGISTER(TEXT("wait time recorded (msec)"));
     m_idFrameAccuracy   = MSR_REGISTER(TEXT("Frame accuracy (msecs)"));
+#ifdef PERF
     m_bDrawLateFrames = GetProfileInt(AMQUALITY, DRAWLATEFRAMES, FALSE);
+#endif
     //m_idSendQuality      = MSR_REGISTER(TEXT("Processing Quality message"));
 
     m_idRenderAvg       = MSR_REGISTER(TEXT("Render draw time Avg"));
@@ -1800,7 +1802,6 @@ CBaseVideoRenderer::CBaseVideoRenderer(
     m_idDuration        = MSR_REGISTER(TEXT("Duration"));
     m_idThrottle        = MSR_REGISTER(TEXT("Audio-video throttle wait"));
     // m_idDebug           = MSR_REGISTER(TEXT("Debug stuff"));
-#endif // PERF
 } // Constructor
 
 
@@ -1907,8 +1908,9 @@ void CBaseVideoRenderer::OnWaitStart()
 
 void CBaseVideoRenderer::OnWaitEnd()
 {
-#ifdef PERF
     MSR_STOP(m_idWaitReal);
+
+#ifdef PERF
     // for a perf build we want to know just exactly how late we REALLY are.
     // even if this means that we have to look at the clock again.
 
@@ -2068,7 +2070,8 @@ void CBaseVideoRenderer::OnRenderEnd(IMediaSample *pMediaSample)
     int tr = (timeGetTime() - m_tRenderStart)*10000;   // convert mSec->UNITS
     if (tr < m_trRenderAvg*2 || tr < 2 * m_trRenderLast) {
         // DO_MOVING_AVG(m_trRenderAvg, tr);
-        m_trRenderAvg = (tr + (AVGPERIOD-1)*m_trRenderAvg)/AVGPERIOD;
+        const int nPeriod = m_pQualityPolicy->AveragingPeriod();
+        m_trRenderAvg = (tr + (nPeriod-1)*m_trRenderAvg)/nPeriod;
     }
     m_trRenderLast = tr;
     ThrottleWait();
@@ -2173,88 +2176,12 @@ HRESULT CBaseVideoRenderer::SendQuality(REFERENCE_TIME trLate,
     Quality q;
     HRESULT hr;
 
-    // If we are the main user of time, then report this as Flood/Dry.
-    // If our suppliers are, then report it as Famine/Glut.
-    //
-    // We need to take action, but avoid hunting.  Hunting is caused by
-    // 1. Taking too much action too soon and overshooting
-    // 2. Taking too long to react (so averaging can CAUSE hunting).
-    //
-    // The reason why we use trLate as well as Wait is to reduce hunting;
-    // if the wait time is coming down and about to go into the red, we do
-    // NOT want to rely on some average which is only telling is that it used
-    // to be OK once.
+    // The policy decides what to ask for - see CAMVideoQualityPolicy
+    AM_VIDEO_QUALITY_STATE State;
+    GetQualityState(trLate, &State);
 
     q.TimeStamp = (REFERENCE_TIME)trRealStream;
-
-    if (m_trFrameAvg<0) {
-        q.Type = Famine;      // guess
-    }
-    // Is the greater part of the time taken bltting or something else
-    else if (m_trFrameAvg > 2*m_trRenderAvg) {
-        q.Type = Famine;                        // mainly other
-    } else {
-        q.Type = Flood;                         // mainly bltting
-    }
-
-    q.Proportion = 1000;               // default
-
-    if (m_trFrameAvg<0) {
-        // leave it alone - we don't know enough
-    }
-    else if ( trLate> 0 ) {
-        // try to catch up over the next second
-        // We could be Really, REALLY late, but rendering all the frames
-        // anyway, just because it's so cheap.
-
-        q.Proportion = 1000 - (int)((trLate)/(UNITS/1000));
-        if (q.Proportion<500) {
-           q.Proportion = 500;      // don't go daft. (could've been negative!)
-        } else {
-        }
-
-    } else if (  m_trWaitAvg>20000
-              && trLate<-20000
-              ){
-        // Go cautiously faster - aim at 2mSec wait.
-        if (m_trWaitAvg>=m_trFrameAvg) {
-            // This can happen because of some fudges.
-            // The waitAvg is how long we originally planned to wait
-            // The frameAvg is more honest.
-            // It means that we are spending a LOT of time waiting
-            q.Proportion = 2000;    // double.
-        } else {
-            if (m_trFrameAvg+20000 > m_trWaitAvg) {
-                q.Proportion
-                    = 1000 * (m_trFrameAvg / (m_trFrameAvg + 20000 - m_trWaitAvg));
-            } else {
-                // We're apparently spending more than the whole frame time waiting.
-                // Assume that the averages are slightly out of kilter, but that we
-                // are indeed doing a lot of waiting.  (This leg probably never
-                // happens, but the code avoids any potential divide by zero).
-                q.Proportion = 2000;
-            }
-        }
-
-        if (q.Proportion>2000) {
-            q.Proportion = 2000;    // don't go crazy.
-        }
-    }
-
-    // Tell the supplier how late frames are when they get rendered
-    // That's how late we are now.
-    // If we are in directdraw mode then the guy upstream can see the drawing
-    // times and we'll just report on the start time.  He can figure out any
-    // offset to apply.  If we are in DIB Section mode then we will apply an
-    // extra offset which is half of our drawing time.  This is usually small
-    // but can sometimes be the dominant effect.  For this we will use the
-    // average drawing time rather than the last frame.  If the last frame took
-    // a long time to draw and made us late, that's already in the lateness
-    // figure.  We should not add it in again unless we expect the next frame
-    // to be the same.  We don't, we expect the average to be a better shot.
-    // In direct draw mode the RenderAvg will be zero.
-
-    q.Late = trLate + m_trRenderAvg/2;
+    m_pQualityPolicy->GetQuality(&State, &q);
 
     // log what we're doing
     MSR_INTEGER(m_idQualityRate, q.Proportion);
@@ -2346,8 +2273,9 @@ HRESULT CBaseVideoRenderer::ShouldDrawSampleNow(IMediaSample *pMediaSample,
 
     MSR_INTEGER(m_idSchLateTime, trTrueLate/10000);
 
-    // Send quality control messages upstream, measured against target
-    HRESULT hr = SendQuality(trLate, trRealStream);
+    // Send quality control messages upstream, measured against target.
+    // Quality.Late isn't an int, so it gets the lateness before TimeDiff
+    HRESULT hr = SendQuality(trRealStream - *ptrStart, trRealStream);
     // Note: the filter upstream is allowed to this FAIL meaning "you do it".
     m_bSupplierHandlingQuality = (hr==S_OK);
 
@@ -2409,12 +2337,13 @@ HRESULT CBaseVideoRenderer::ShouldDrawSampleNow(IMediaSample *pMediaSample,
 
     // prepare the new wait average - but don't pollute the old one until
     // we have finished with it.
+    const int nPeriod = m_pQualityPolicy->AveragingPeriod();
     int trWaitAvg;
     {
         // We never mix in a negative wait.  This causes us to believe in fast machines
         // slightly more.
         int trL = trLate<0 ? -trLate : 0;
-        trWaitAvg = (trL + m_trWaitAvg*(AVGPERIOD-1))/AVGPERIOD;
+        trWaitAvg = (trL + m_trWaitAvg*(nPeriod-1))/nPeriod;
     }
 
 
@@ -2427,30 +2356,15 @@ HRESULT CBaseVideoRenderer::ShouldDrawSampleNow(IMediaSample *pMediaSample,
         trFrame = int(tr);
     }
 
-    // We will DRAW this frame IF...
-    if (
-          // ...the time we are spending drawing is a small fraction of the total
-          // observed inter-frame time so that dropping it won't help much.
-          (3*m_trRenderAvg <= m_trFrameAvg)
-
-         // ...or our supplier is NOT handling things and the next frame would
-         // be less timely than this one or our supplier CLAIMS to be handling
-         // things, and is now less than a full FOUR frames late.
-       || ( m_bSupplierHandlingQuality
-          ? (trLate <= trDuration*4)
-          : (trLate+trLate < trDuration)
-          )
-
-          // ...or we are on average waiting for over eight milliseconds then
-          // this may be just a glitch.  Draw it and we'll hope to catch up.
-       || (m_trWaitAvg > 80000)
-
-          // ...or we haven't drawn an image for over a second.  We will update
-          // the display, which stops the video looking hung.
-          // Do this regardless of how late this media sample is.
-       || ((trRealStream - m_trLastDraw) > UNITS)
+    // Ask the policy what to do with what we know so far
+    AM_VIDEO_QUALITY_STATE State;
+    GetQualityState(trLate, &State);
+    State.trDuration = trDuration;
+    State.trSinceLastDraw = trRealStream - m_trLastDraw;
+    State.bSyncPoint = (S_OK == pMediaSample->IsSyncPoint());
+    State.bJustDroppedFrame = bJustDroppedFrame;
 
-    ) {
+    if (m_pQualityPolicy->ShouldDraw(&State)) {
         HRESULT Result;
 
         // We are going to play this frame.  We may want to play it early.
@@ -2459,44 +2373,10 @@ HRESULT CBaseVideoRenderer::ShouldDrawSampleNow(IMediaSample *pMediaSample,
         // it early by m_trEarliness as this controls the graceful slide back.
         // and in addition we aim at being m_trTarget late rather than "on time".
 
-        BOOL bPlayASAP = FALSE;
-
-        // we will play it AT ONCE (slow machine mode) if...
-
-            // ...we are playing catch-up
-        if ( bJustDroppedFrame) {
-            bPlayASAP = TRUE;
-            MSR_INTEGER(m_idDecision, 9001);
-        }
-
-            // ...or if we are running below the true frame rate
-            // exact comparisons are glitchy, for these measurements,
-            // so add an extra 5% or so
-        else if (  (m_trFrameAvg > trDuration + trDuration/16)
-
-                   // It's possible to get into a state where we are losing ground, but
-                   // are a very long way ahead.  To avoid this or recover from it
-                   // we refuse to play early by more than 10 frames.
-                && (trLate > - trDuration*10)
-                ){
-            bPlayASAP = TRUE;
-            MSR_INTEGER(m_idDecision, 9002);
-        }
-#if 0
-            // ...or if we have been late and are less than one frame early
-        else if (  (trLate + trDuration > 0)
-                && (m_trWaitAvg<=20000)
-                ) {
-            bPlayASAP = TRUE;
-            MSR_INTEGER(m_idDecision, 9003);
-        }
-#endif
-        // We will NOT play it at once if we are grossly early.  On very slow frame
-        // rate movies - e.g. clock.avi - it is not a good idea to leap ahead just
-        // because we got starved (for instance by the net) and dropped one frame
-        // some time or other.  If we are more than 900mSec early, then wait.
-        if (trLate<-9000000) {
-            bPlayASAP = FALSE;
+        const BOOL bPlayASAP = m_pQualityPolicy->ShouldDrawAtOnce(&State);
+        if (bPlayASAP) {
+            // catching up, or running below the true frame rate
+            MSR_INTEGER(m_idDecision, bJustDroppedFrame ? 9001 : 9002);
         }
 
         if (bPlayASAP) {
@@ -2508,10 +2388,10 @@ HRESULT CBaseVideoRenderer::ShouldDrawSampleNow(IMediaSample *pMediaSample,
             // dropping frames to keep sync.  We should not let that mislead
             // us into thinking that we have as much as zero spare time!
             // We just update with a zero wait.
-            m_trWaitAvg = (m_trWaitAvg*(AVGPERIOD-1))/AVGPERIOD;
+            m_trWaitAvg = (m_trWaitAvg*(nPeriod-1))/nPeriod;
 
             // Assume that we draw it immediately.  Update inter-frame stats
-            m_trFrameAvg = (trFrame + m_trFrameAvg*(AVGPERIOD-1))/AVGPERIOD;
+            m_trFrameAvg = (trFrame + m_trFrameAvg*(nPeriod-1))/nPeriod;
 #ifndef PERF
             // If this is NOT a perf build, then report what we know so far
             // without looking at the clock any more.  This assumes that we
@@ -2747,6 +2627,30 @@ int isqrt(int x)
     return s;
 }
 
+//
+//  Estimate a standard deviation from the sums - see GetStdDev
+//
+static int StdDev(int nSamples, LONGLONG llSumSq, LONGLONG iTot)
+{
+    // If S is the Sum of the Squares of observations and
+    //    T the Total (i.e. sum) of the observations and there were
+    //    N observations, then an estimate of the standard deviation is
+    //      sqrt( (S - T**2/N) / (N-1) )
+
+    if (nSamples<=1) {
+        return 0;
+    }
+    LONGLONG x;
+    // First frames have invalid stamps, so we get no stats for them
+    // So we need 2 frames to get 1 datum, so N is cFramesDrawn-1
+
+    // so we use m_cFramesDrawn-1 here
+    x = llSumSq - llMulDiv(iTot, iTot, nSamples, 0);
+    x = x / (nSamples-1);
+    ASSERT(x>=0);
+    return isqrt((LONG)x);
+}
+
 //
 //  Do estimates for standard deviations for per-frame
 //  statistics
@@ -2766,24 +2670,7 @@ HRESULT CBaseVideoRenderer::GetStdDev(
         return NOERROR;
     }
 
-    // If S is the Sum of the Squares of observations and
-    //    T the Total (i.e. sum) of the observations and there were
-    //    N observations, then an estimate of the standard deviation is
-    //      sqrt( (S - T**2/N) / (N-1) )
-
-    if (nSamples<=1) {
-        *piResult = 0;
-    } else {
-        LONGLONG x;
-        // First frames have invalid stamps, so we get no stats for them
-        // So we need 2 frames to get 1 datum, so N is cFramesDrawn-1
-
-        // so we use m_cFramesDrawn-1 here
-        x = llSumSq - llMulDiv(iTot, iTot, nSamples, 0);
-        x = x / (nSamples-1);
-        ASSERT(x>=0);
-        *piResult = isqrt((LONG)x);
-    }
+    *piResult = StdDev(nSamples, llSumSq, iTot);
     return NOERROR;
 }
 
@@ -2816,6 +2703,41 @@ STDMETHODIMP CBaseVideoRenderer::get_Jitter(__out int *piJitter)
 } // get_Jitter
 
 
+// Fill in what the quality policy is told about a frame that we already
+// know.  Called with the interface lock held, as the statistics above are
+
+void CBaseVideoRenderer::GetQualityState(REFERENCE_TIME trLate,
+                                         __out AM_VIDEO_QUALITY_STATE *pState)
+{
+    ZeroMemory(pState, sizeof(*pState));
+    pState->trLate = TimeDiff(trLate);
+    pState->trLateUncapped = trLate;
+    pState->bSupplierHandlingQuality = m_bSupplierHandlingQuality;
+    pState->trRenderAvg = m_trRenderAvg;
+    pState->trFrameAvg = m_trFrameAvg;
+    pState->trWaitAvg = m_trWaitAvg;
+    pState->cFramesDrawn = m_cFramesDrawn;
+    pState->cFramesDropped = m_cFramesDropped;
+    pState->iTotAcc = m_iTotAcc;
+
+    // only worked out for the policies that look at it
+    if (m_pQualityPolicy->UsesJitter()) {
+        pState->iJitter = StdDev(m_cFramesDrawn - 2, m_iSumSqFrameTime, m_iSumFrameTime);
+    }
+} // GetQualityState
+
+
+HRESULT CBaseVideoRenderer::SetQualityPolicy(__in_opt const CAMVideoQualityPolicy *pPolicy)
+{
+    CAutoLock cVideoLock(&m_InterfaceLock);
+    if (pPolicy == NULL) {
+        pPolicy = CAMVideoQualityPolicy::Get(AM_QUALITY_DEFAULT);
+    }
+    m_pQualityPolicy = pPolicy;
+    return NOERROR;
+} // SetQualityPolicy
+
+
 // Overidden to return our IQualProp interface
 
 STDMETHODIMP
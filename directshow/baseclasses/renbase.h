@@ -161,10 +161,10 @@ public:
 #ifdef PERF
     REFERENCE_TIME m_trRenderStart; // Just before we started drawing
                                     // Set in OnRenderStart, Used in OnRenderEnd
+#endif
     int m_idBaseStamp;              // MSR_id for frame time stamp
     int m_idBaseRenderTime;         // MSR_id for true wait time
     int m_idBaseAccuracy;           // MSR_id for time frame is late (int)
-#endif
 
     // Quality management implementation for scheduling rendering
 
@@ -241,7 +241,12 @@ public:
 // which the rest of the renderer calls at significant moments.  These do
 // the timing.
 
-// the number of frames that the sliding averages are averaged over.
+// The decisions about which frames to draw early and which to drop, and
+// what to tell the supplier, are left to a CAMVideoQualityPolicy (see
+// qualpol.h), which SetQualityPolicy can change.
+
+// the number of frames that the sliding averages are averaged over, unless
+// the quality policy says otherwise.
 // the rule is (1024*NewObservation + (AVGPERIOD-1) * PreviousAverage)/AVGPERIOD
 #define AVGPERIOD 4
 #define DO_MOVING_AVG(avg,obs) (avg = (1024*obs + (AVGPERIOD-1)*avg)/AVGPERIOD)
@@ -344,7 +349,6 @@ protected:
     int m_trFrameAvg;               // Average inter-frame time
     int m_trDuration;               // duration of last frame.
 
-#ifdef PERF
     // Performance logging identifiers
     int m_idTimeStamp;              // MSR_id for frame time stamp
     int m_idEarliness;              // MSR_id for earliness fudge
@@ -361,16 +365,15 @@ protected:
     int m_idThrottle;               // MSR_id for audio-video throttling
     //int m_idDebug;                  // MSR_id for trace style debugging
     //int m_idSendQuality;          // MSR_id for timing the notifications per se
-#endif // PERF
     REFERENCE_TIME m_trRememberStampForPerf;  // original time stamp of frame
                                               // with no earliness fudges etc.
 #ifdef PERF
     REFERENCE_TIME m_trRememberFrameForPerf;  // time when previous frame rendered
+#endif
 
     // debug...
     int m_idFrameAvg;
     int m_idWaitAvg;
-#endif
 
     // PROPERTY PAGE
     // This has edit fields that show the user what's happening
@@ -397,6 +400,8 @@ protected:
     int m_trLate;                   // hold onto frame lateness
     int m_trFrame;                  // hold onto inter-frame time
 
+    const CAMVideoQualityPolicy *m_pQualityPolicy;  // decides what to draw
+
     int m_tStreamingStart;          // if streaming then time streaming started
                                     // else time of last streaming session
                                     // used for property page statistics
@@ -441,6 +446,15 @@ public:
                                 __inout REFERENCE_TIME *ptrEnd);
 
     virtual HRESULT SendQuality(REFERENCE_TIME trLate, REFERENCE_TIME trRealStream);
+
+    // Use pPolicy, or the default policy if it is NULL. The renderer
+    // doesn't hold a reference, so a policy must outlive the renderers
+    // using it - those from CAMVideoQualityPolicy::Get always do
+    HRESULT SetQualityPolicy(__in_opt const CAMVideoQualityPolicy *pPolicy);
+
+    // the averages and statistics, and trLate - the rest is left zero
+    void GetQualityState(REFERENCE_TIME trLate, __out AM_VIDEO_QUALITY_STATE *pState);
+
     STDMETHODIMP JoinFilterGraph(__inout_opt IFilterGraph * pGraph, __in_opt LPCWSTR pName);
 
     //
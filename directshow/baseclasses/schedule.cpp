@@ -19,12 +19,11 @@
 
 CAMSchedule::CAMSchedule( HANDLE ev )
 : CBaseObject(TEXT("CAMSchedule"))
-, head(&z, 0), z(0, MAX_TIME)
+, m_ppHeap(0), m_ppHash(0), m_dwHeapSize(0)
 , m_dwNextCookie(0), m_dwAdviseCount(0)
 , m_pAdviseCache(0), m_dwCacheCount(0)
 , m_ev( ev )
 {
-    head.m_dwAdviseCookie = z.m_dwAdviseCookie = 0;
 }
 
 CAMSchedule::~CAMSchedule()
@@ -45,17 +44,14 @@ CAMSchedule::~CAMSchedule()
     if ( m_dwAdviseCount > 0 )
     {
         DumpLinkedList();
-        while ( !head.m_next->IsZ() )
+        while ( m_dwAdviseCount > 0 )
         {
-            head.DeleteNext();
-            --m_dwAdviseCount;
+            delete m_ppHeap[--m_dwAdviseCount];
         }
     }
 
-    // If, in the debug version, we assert twice, it means, not only
-    // did we have left over advises, but we have also let m_dwAdviseCount
-    // get out of sync. with the number of advises actually on the list.
-    ASSERT( m_dwAdviseCount == 0 );
+    delete [] m_ppHeap;
+    delete [] m_ppHash;
 
     m_Serialize.Unlock();
 }
@@ -70,8 +66,8 @@ DWORD CAMSchedule::GetAdviseCount()
 
 REFERENCE_TIME CAMSchedule::GetNextAdviseTime()
 {
-    CAutoLock lck(&m_Serialize); // Need to stop the linked list from changing
-    return head.m_next->m_rtEventTime;
+    CAutoLock lck(&m_Serialize); // Need to stop the heap from changing
+    return m_dwAdviseCount ? m_ppHeap[0]->m_rtEventTime : MAX_TIME;
 }
 
 DWORD_PTR CAMSchedule::AddAdvisePacket
@@ -80,8 +76,8 @@ DWORD_PTR CAMSchedule::AddAdvisePacket
 , HANDLE h, BOOL periodic
 )
 {
-    // Since we use MAX_TIME as a sentry, we can't afford to
-    // schedule a notification at MAX_TIME
+    // MAX_TIME means "nothing scheduled" to our callers, so we
+    // can't afford to schedule a notification at MAX_TIME
     ASSERT( time1 < MAX_TIME );
     DWORD_PTR Result;
     CAdvisePacket * p;
@@ -103,6 +99,7 @@ DWORD_PTR CAMSchedule::AddAdvisePacket
         p->m_rtEventTime = time1; p->m_rtPeriod = time2;
         p->m_hNotify = h; p->m_bPeriodic = periodic;
         Result = AddAdvisePacket( p );
+        if (Result == 0) Delete( p );
     }
     else Result = 0;
 
@@ -114,36 +111,23 @@ DWORD_PTR CAMSchedule::AddAdvisePacket
 HRESULT CAMSchedule::Unadvise(DWORD_PTR dwAdviseCookie)
 {
     HRESULT hr = S_FALSE;
-    CAdvisePacket * p_prev = &head;
-    CAdvisePacket * p_n;
     m_Serialize.Lock();
-    while ( p_n = p_prev->Next() ) // The Next() method returns NULL when it hits z
+    CAdvisePacket *const pPacket = HashRemove( dwAdviseCookie );
+    if ( pPacket )
     {
-        if ( p_n->m_dwAdviseCookie == dwAdviseCookie )
-        {
-            Delete( p_prev->RemoveNext() );
-            --m_dwAdviseCount;
-            hr = S_OK;
-	    // Having found one cookie that matches, there should be no more
-            #ifdef DEBUG
-	       while (p_n = p_prev->Next())
-               {
-                   ASSERT(p_n->m_dwAdviseCookie != dwAdviseCookie);
-                   p_prev = p_n;
-               }
-            #endif
-            break;
-        }
-        p_prev = p_n;
-    };
+        ASSERT( m_ppHeap[pPacket->m_dwHeapIndex] == pPacket );
+        EXECUTE_ASSERT( RemoveAt( pPacket->m_dwHeapIndex ) == pPacket );
+        Delete( pPacket );
+        hr = S_OK;
+    }
     m_Serialize.Unlock();
     return hr;
 }
 
 REFERENCE_TIME CAMSchedule::Advise( const REFERENCE_TIME & rtTime )
 {
-    REFERENCE_TIME  rtNextTime;
-    CAdvisePacket * pAdvise;
+    REFERENCE_TIME  rtNextTime = MAX_TIME;
+    CAdvisePacket * pAdvise = 0;
 
     DbgLog((LOG_TIMING, 2,
         TEXT("CAMSchedule::Advise( %lu ms )"), ULONG(rtTime / (UNITS / MILLISECONDS))));
@@ -155,10 +139,10 @@ REFERENCE_TIME CAMSchedule::Advise( const REFERENCE_TIME & rtTime )
     #endif
 
     //  Note - DON'T cache the difference, it might overflow 
-    while ( rtTime >= (rtNextTime = (pAdvise=head.m_next)->m_rtEventTime) &&
-            !pAdvise->IsZ() )
+    while ( m_dwAdviseCount > 0 &&
+            rtTime >= (rtNextTime = (pAdvise = m_ppHeap[0])->m_rtEventTime) )
     {
-        ASSERT(pAdvise->m_dwAdviseCookie); // If this is zero, its the head or the tail!!
+        ASSERT(pAdvise->m_dwAdviseCookie); // If this is zero, it was never added
 
         ASSERT(pAdvise->m_hNotify != INVALID_HANDLE_VALUE);
 
@@ -172,15 +156,17 @@ REFERENCE_TIME CAMSchedule::Advise( const REFERENCE_TIME & rtTime )
         {
             ASSERT( pAdvise->m_bPeriodic == FALSE );
             EXECUTE_ASSERT(SetEvent(pAdvise->m_hNotify));
-            --m_dwAdviseCount;
-            Delete( head.RemoveNext() );
+            EXECUTE_ASSERT(HashRemove( pAdvise->m_dwAdviseCookie ) == pAdvise);
+            Delete( RemoveAt(0) );
         }
 
+        rtNextTime = MAX_TIME;
+        pAdvise = 0;
     }
 
     DbgLog((LOG_TIMING, 3,
             TEXT("CAMSchedule::Advise() Next time stamp: %lu ms, for advise %lu."),
-            DWORD(rtNextTime / (UNITS / MILLISECONDS)), pAdvise->m_dwAdviseCookie ));
+            DWORD(rtNextTime / (UNITS / MILLISECONDS)), pAdvise ? pAdvise->m_dwAdviseCookie : 0 ));
 
     return rtNextTime;
 }
@@ -192,24 +178,17 @@ DWORD_PTR CAMSchedule::AddAdvisePacket( __inout CAdvisePacket * pPacket )
     ASSERT(pPacket->m_rtEventTime >= 0 && pPacket->m_rtEventTime < MAX_TIME);
     ASSERT(CritCheckIn(&m_Serialize));
 
-    CAdvisePacket * p_prev = &head;
-    CAdvisePacket * p_n;
+    if ( m_dwAdviseCount == m_dwHeapSize && FAILED(GrowHeap()) ) return 0;
 
     const DWORD_PTR Result = pPacket->m_dwAdviseCookie = ++m_dwNextCookie;
-    // This relies on the fact that z is a sentry with a maximal m_rtEventTime
-    for(;;p_prev = p_n)
-    {
-        p_n = p_prev->m_next;
-        if ( p_n->m_rtEventTime >= pPacket->m_rtEventTime ) break;
-    }
-    p_prev->InsertAfter( pPacket );
-    ++m_dwAdviseCount;
+    HashInsert( pPacket );
+    SiftUp( pPacket, m_dwAdviseCount++ );
 
     DbgLog((LOG_TIMING, 2, TEXT("Added advise %lu, for thread 0x%02X, scheduled at %lu"),
     	pPacket->m_dwAdviseCookie, GetCurrentThreadId(), (pPacket->m_rtEventTime / (UNITS / MILLISECONDS)) ));
 
-    // If packet added at the head, then clock needs to re-evaluate wait time.
-    if ( p_prev == &head ) SetEvent( m_ev );
+    // If packet added at the top, then clock needs to re-evaluate wait time.
+    if ( pPacket->m_dwHeapIndex == 0 ) SetEvent( m_ev );
 
     return Result;
 }
@@ -227,33 +206,148 @@ void CAMSchedule::Delete( __inout CAdvisePacket * pPacket )
     }
 }
 
+// Double the size of the heap and of the hash table, rehashing every
+// packet.  The heap itself is simply copied across.
+HRESULT CAMSchedule::GrowHeap()
+{
+    ASSERT(CritCheckIn(&m_Serialize));
 
-// Takes the head of the list & repositions it
-void CAMSchedule::ShuntHead()
+    const DWORD dwNewSize = m_dwHeapSize ? m_dwHeapSize * 2 : dwInitialHeapSize;
+    if ( dwNewSize < m_dwHeapSize ) return E_OUTOFMEMORY;
+
+    CAdvisePacket ** ppHeap = new CAdvisePacket *[dwNewSize];
+    CAdvisePacket ** ppHash = new CAdvisePacket *[dwNewSize];
+    if ( ppHeap == 0 || ppHash == 0 )
+    {
+        delete [] ppHeap;
+        delete [] ppHash;
+        return E_OUTOFMEMORY;
+    }
+
+    ZeroMemory( ppHash, dwNewSize * sizeof(CAdvisePacket *) );
+    for ( DWORD i = 0; i < m_dwAdviseCount; i++ )
+    {
+        ppHeap[i] = m_ppHeap[i];
+    }
+
+    delete [] m_ppHeap;
+    delete [] m_ppHash;
+    m_ppHeap = ppHeap;
+    m_ppHash = ppHash;
+    m_dwHeapSize = dwNewSize;
+
+    for ( DWORD i = 0; i < m_dwAdviseCount; i++ )
+    {
+        HashInsert( m_ppHeap[i] );
+    }
+    return NOERROR;
+}
+
+// Place pPacket at or above slot dwIndex, moving down any parents
+// that fire after it
+void CAMSchedule::SiftUp( __inout CAdvisePacket * pPacket, DWORD dwIndex )
 {
-    CAdvisePacket * p_prev = &head;
-    CAdvisePacket * p_n;
+    while ( dwIndex > 0 )
+    {
+        const DWORD dwParent = (dwIndex - 1) / 2;
+        CAdvisePacket *const pParent = m_ppHeap[dwParent];
+        if ( !pPacket->FiresBefore( pParent ) ) break;
+        m_ppHeap[dwIndex] = pParent;
+        pParent->m_dwHeapIndex = dwIndex;
+        dwIndex = dwParent;
+    }
+    m_ppHeap[dwIndex] = pPacket;
+    pPacket->m_dwHeapIndex = dwIndex;
+}
 
-    m_Serialize.Lock();
-    CAdvisePacket *const pPacket = head.m_next;
+// Place pPacket at or below slot dwIndex, moving up any children
+// that fire before it
+void CAMSchedule::SiftDown( __inout CAdvisePacket * pPacket, DWORD dwIndex )
+{
+    for (;;)
+    {
+        DWORD dwChild = dwIndex * 2 + 1;
+        if ( dwChild >= m_dwAdviseCount ) break;
+        if ( dwChild + 1 < m_dwAdviseCount &&
+             m_ppHeap[dwChild + 1]->FiresBefore( m_ppHeap[dwChild] ) )
+        {
+            dwChild++;
+        }
+        CAdvisePacket *const pChild = m_ppHeap[dwChild];
+        if ( !pChild->FiresBefore( pPacket ) ) break;
+        m_ppHeap[dwIndex] = pChild;
+        pChild->m_dwHeapIndex = dwIndex;
+        dwIndex = dwChild;
+    }
+    m_ppHeap[dwIndex] = pPacket;
+    pPacket->m_dwHeapIndex = dwIndex;
+}
 
-    // This will catch both an empty list,
-    // and if somehow a MAX_TIME time gets into the list
-    // (which would also break this method).
-    ASSERT( pPacket->m_rtEventTime < MAX_TIME );
+// Take the packet in slot dwIndex out of the heap and return it.
+// The caller is responsible for taking it out of the hash table.
+CAMSchedule::CAdvisePacket * CAMSchedule::RemoveAt( DWORD dwIndex )
+{
+    ASSERT(CritCheckIn(&m_Serialize));
+    ASSERT( dwIndex < m_dwAdviseCount );
+
+    CAdvisePacket *const pPacket = m_ppHeap[dwIndex];
+    CAdvisePacket *const pLast = m_ppHeap[--m_dwAdviseCount];
 
-    // This relies on the fact that z is a sentry with a maximal m_rtEventTime
-    for(;;p_prev = p_n)
+    // Fill the hole with the last packet and move that to its proper
+    // place - it may need to go either way if the hole was not the top
+    if ( pLast != pPacket )
     {
-        p_n = p_prev->m_next;
-        if ( p_n->m_rtEventTime > pPacket->m_rtEventTime ) break;
+        if ( dwIndex > 0 && pLast->FiresBefore( m_ppHeap[(dwIndex - 1) / 2] ) )
+        {
+            SiftUp( pLast, dwIndex );
+        }
+        else
+        {
+            SiftDown( pLast, dwIndex );
+        }
     }
-    // If p_prev == pPacket then we're already in the right place
-    if (p_prev != pPacket)
+    return pPacket;
+}
+
+void CAMSchedule::HashInsert( __inout CAdvisePacket * pPacket )
+{
+    CAdvisePacket ** ppBucket = &m_ppHash[pPacket->m_dwAdviseCookie & (m_dwHeapSize - 1)];
+    pPacket->m_next = *ppBucket;
+    *ppBucket = pPacket;
+}
+
+CAMSchedule::CAdvisePacket * CAMSchedule::HashRemove( DWORD_PTR dwAdviseCookie )
+{
+    ASSERT(CritCheckIn(&m_Serialize));
+    if ( m_dwHeapSize == 0 ) return 0;
+
+    for ( CAdvisePacket ** pp = &m_ppHash[dwAdviseCookie & (m_dwHeapSize - 1)]
+        ; *pp
+        ; pp = &(*pp)->m_next
+        )
     {
-        head.m_next = pPacket->m_next;
-        (p_prev->m_next = pPacket)->m_next = p_n;
+        CAdvisePacket *const pPacket = *pp;
+        if ( pPacket->m_dwAdviseCookie == dwAdviseCookie )
+        {
+            *pp = pPacket->m_next;
+            return pPacket;
+        }
     }
+    return 0;
+}
+
+// Takes the top of the heap & repositions it
+void CAMSchedule::ShuntHead()
+{
+    m_Serialize.Lock();
+    CAdvisePacket *const pPacket = m_ppHeap[0];
+
+    // This will catch both an empty heap,
+    // and if somehow a MAX_TIME time gets into the heap
+    ASSERT( m_dwAdviseCount > 0 );
+    ASSERT( pPacket->m_rtEventTime < MAX_TIME );
+
+    SiftDown( pPacket, 0 );
     #ifdef DEBUG
         DbgLog((LOG_TIMING, 2, TEXT("Periodic advise %lu, shunted to %lu"),
     	    pPacket->m_dwAdviseCookie, (pPacket->m_rtEventTime / (UNITS / MILLISECONDS)) ));
@@ -266,17 +360,13 @@ void CAMSchedule::ShuntHead()
 void CAMSchedule::DumpLinkedList()
 {
     m_Serialize.Lock();
-    int i=0;
     DbgLog((LOG_TIMING, 1, TEXT("CAMSchedule::DumpLinkedList() this = 0x%p"), this));
-    for ( CAdvisePacket * p = &head
-        ; p
-        ; p = p->m_next         , i++
-        )	
+    for ( DWORD i = 0; i < m_dwAdviseCount; i++ )
     {
-        DbgLog((LOG_TIMING, 1, TEXT("Advise List # %lu, Cookie %d,  RefTime %lu"),
+        DbgLog((LOG_TIMING, 1, TEXT("Advise Heap # %lu, Cookie %d,  RefTime %lu"),
             i,
-	    p->m_dwAdviseCookie,
-	    p->m_rtEventTime / (UNITS / MILLISECONDS)
+	    m_ppHeap[i]->m_dwAdviseCookie,
+	    m_ppHeap[i]->m_rtEventTime / (UNITS / MILLISECONDS)
             ));
     }
     m_Serialize.Unlock();
@@ -34,67 +34,50 @@ public:
     HANDLE GetEvent() const { return m_ev; }
 
 private:
-    // We define the nodes that will be used in our singly linked list
-    // of advise packets.  The list is ordered by time, with the
-    // elements that will expire first at the front.
+    // We define the nodes that will be held in our timer heap.  The
+    // heap is an array ordered so that each packet fires no later than
+    // the two below it, so the next packet to fire is always at the top
+    // and adding, firing or cancelling a packet is O(log n) however many
+    // advises are outstanding.  Each packet knows its slot in the heap,
+    // and the packets are also hashed on their cookie, so Unadvise can
+    // find one without searching.
     class CAdvisePacket
     {
     public:
         CAdvisePacket()
         {}
 
-        CAdvisePacket * m_next;
+        CAdvisePacket * m_next;             // Hash chain, or cache link once deleted
         DWORD_PTR       m_dwAdviseCookie;
+        DWORD           m_dwHeapIndex;      // Where we are in m_ppHeap
         REFERENCE_TIME  m_rtEventTime;      // Time at which event should be set
         REFERENCE_TIME  m_rtPeriod;         // Periodic time
         HANDLE          m_hNotify;          // Handle to event or semephore
         BOOL            m_bPeriodic;        // TRUE => Periodic event
 
-        CAdvisePacket( __inout_opt CAdvisePacket * next, LONGLONG time ) : m_next(next), m_rtEventTime(time)
-        {}
-
-        void InsertAfter( __inout CAdvisePacket * p )
-        {
-            p->m_next = m_next;
-            m_next    = p;
-        }
-
-        int IsZ() const // That is, is it the node that represents the end of the list
-        { return m_next == 0; }
-
-        CAdvisePacket * RemoveNext()
-        {
-            CAdvisePacket *const next = m_next;
-            CAdvisePacket *const new_next = next->m_next;
-            m_next = new_next;
-            return next;
-        }
-
-        void DeleteNext()
+        // Ties go to the older advise, as they did on the old sorted list
+        BOOL FiresBefore( const CAdvisePacket * p ) const
         {
-            delete RemoveNext();
-        }
-
-        CAdvisePacket * Next() const
-        {
-            CAdvisePacket * result = m_next;
-            if (result->IsZ()) result = 0;
-            return result;
+            return m_rtEventTime < p->m_rtEventTime ||
+                   (m_rtEventTime == p->m_rtEventTime &&
+                    m_dwAdviseCookie < p->m_dwAdviseCookie);
         }
 
         DWORD_PTR Cookie() const
         { return m_dwAdviseCookie; }
     };
 
-    // Structure is:
-    // head -> elmt1 -> elmt2 -> z -> null
-    // So an empty list is:       head -> z -> null
-    // Having head & z as links makes insertaion,
-    // deletion and shunting much easier.
-    CAdvisePacket   head, z;            // z is both a tail and a sentry
+    // The heap holds m_dwAdviseCount packets in a block of m_dwHeapSize
+    // slots.  The hash table has the same number of buckets and, as
+    // cookies are handed out in sequence, the low bits of a cookie make
+    // a perfectly good hash.  Both grow together, by doubling.
+    CAdvisePacket ** m_ppHeap;
+    CAdvisePacket ** m_ppHash;
+    DWORD           m_dwHeapSize;       // Always 0 or a power of 2
+    enum { dwInitialHeapSize = 16 };
 
     volatile DWORD_PTR  m_dwNextCookie;     // Strictly increasing
-    volatile DWORD  m_dwAdviseCount;    // Number of elements on list
+    volatile DWORD  m_dwAdviseCount;    // Number of elements in the heap
 
     CCritSec        m_Serialize;
 
@@ -103,9 +86,18 @@ private:
     // Event that we should set if the packed added above will be the next to fire.
     const HANDLE m_ev;
 
-    // A Shunt is where we have changed the first element in the
-    // list and want it re-evaluating (i.e. repositioned) in
-    // the list.
+    // Heap maintenance
+    HRESULT GrowHeap();
+    void SiftUp( __inout CAdvisePacket * pPacket, DWORD dwIndex );
+    void SiftDown( __inout CAdvisePacket * pPacket, DWORD dwIndex );
+    CAdvisePacket * RemoveAt( DWORD dwIndex );
+
+    // Hash maintenance
+    void HashInsert( __inout CAdvisePacket * pPacket );
+    CAdvisePacket * HashRemove( DWORD_PTR dwAdviseCookie );
+
+    // A Shunt is where we have changed the time of the first element in
+    // the heap and want it re-evaluating (i.e. repositioned).
     void ShuntHead();
 
     // Rather than delete advise packets, we cache them for future use
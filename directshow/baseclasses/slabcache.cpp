@@ -0,0 +1,156 @@
+//------------------------------------------------------------------------------
+// File: SlabCache.cpp
+//
+// Desc: DirectShow base classes - implements the process-wide cache of
+//       sample buffer blocks.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#include <streams.h>
+
+
+CCritSec CAMSlabCache::m_Lock;
+CAMSlabCache::CSlab *CAMSlabCache::m_pHead = NULL;
+AM_SLABCACHE_STATISTICS CAMSlabCache::m_Stats = {
+    0, 0, 0, 0, 0, AM_SLABCACHE_DEFAULT_LIMIT
+};
+
+// Release whatever is still parked when the module goes away
+
+static class CSlabCacheCleanup {
+public:
+    ~CSlabCacheCleanup() { CAMSlabCache::Flush(); };
+} g_SlabCacheCleanup;
+
+
+BOOL
+CAMSlabCache::KeysMatch(const AM_SLAB_KEY *pKey1, const AM_SLAB_KEY *pKey2)
+{
+    return pKey1->lSize == pKey2->lSize &&
+           pKey1->lAlignment == pKey2->lAlignment &&
+           pKey1->lPrefix == pKey2->lPrefix &&
+           pKey1->dwBackingFlags == pKey2->dwBackingFlags &&
+           pKey1->dwNumaNode == pKey2->dwNumaNode;
+}
+
+void
+CAMSlabCache::ReleaseBlock(__in LPBYTE pBlock)
+{
+    EXECUTE_ASSERT(VirtualFree(pBlock, 0, MEM_RELEASE));
+}
+
+LPBYTE
+CAMSlabCache::Lookup(
+    const AM_SLAB_KEY *pKey,
+    SIZE_T cbMin,
+    __out SIZE_T *pcb,
+    __out BOOL *pbLargePages)
+{
+    CAutoLock lck(&m_Lock);
+
+    CSlab **ppBest = NULL;
+    for (CSlab **ppSlab = &m_pHead; *ppSlab != NULL; ppSlab = &(*ppSlab)->pNext) {
+        CSlab *pSlab = *ppSlab;
+        if (pSlab->cb >= cbMin && KeysMatch(&pSlab->Key, pKey) &&
+            (ppBest == NULL || pSlab->cb < (*ppBest)->cb)) {
+            ppBest = ppSlab;
+        }
+    }
+
+    if (ppBest == NULL) {
+        m_Stats.cMisses++;
+        return NULL;
+    }
+
+    CSlab *pSlab = *ppBest;
+    *ppBest = pSlab->pNext;
+
+    LPBYTE pBlock = pSlab->pBlock;
+    *pcb = pSlab->cb;
+    *pbLargePages = pSlab->bLargePages;
+
+    m_Stats.cHits++;
+    m_Stats.cBlocksRetained--;
+    m_Stats.cbRetained -= pSlab->cb;
+    delete pSlab;
+
+    DbgLog((LOG_MEMORY, 2, TEXT("Slab cache hit: %Iu bytes"), *pcb));
+    return pBlock;
+}
+
+BOOL
+CAMSlabCache::Park(
+    const AM_SLAB_KEY *pKey,
+    __in LPBYTE pBlock,
+    SIZE_T cb,
+    BOOL bLargePages)
+{
+    CAutoLock lck(&m_Lock);
+
+    if (cb > m_Stats.cbLimit) {
+        return FALSE;
+    }
+
+    CSlab *pSlab = new CSlab;
+    if (pSlab == NULL) {
+        return FALSE;
+    }
+
+    // make room, oldest first
+    Trim(m_Stats.cbLimit - cb);
+
+    pSlab->pNext = NULL;
+    pSlab->Key = *pKey;
+    pSlab->pBlock = pBlock;
+    pSlab->cb = cb;
+    pSlab->bLargePages = bLargePages;
+
+    CSlab **ppTail = &m_pHead;
+    while (*ppTail != NULL) {
+        ppTail = &(*ppTail)->pNext;
+    }
+    *ppTail = pSlab;
+
+    m_Stats.cBlocksRetained++;
+    m_Stats.cbRetained += cb;
+    return TRUE;
+}
+
+/* Release the oldest parked blocks until no more than cbLimit bytes are
+   retained */
+
+void
+CAMSlabCache::Trim(SIZE_T cbLimit)
+{
+    CAutoLock lck(&m_Lock);
+
+    while (m_Stats.cbRetained > cbLimit) {
+        CSlab *pSlab = m_pHead;
+        ASSERT(pSlab != NULL);
+        m_pHead = pSlab->pNext;
+
+        m_Stats.cEvictions++;
+        m_Stats.cBlocksRetained--;
+        m_Stats.cbRetained -= pSlab->cb;
+
+        ReleaseBlock(pSlab->pBlock);
+        delete pSlab;
+    }
+}
+
+void
+CAMSlabCache::SetLimit(SIZE_T cbLimit)
+{
+    CAutoLock lck(&m_Lock);
+    m_Stats.cbLimit = cbLimit;
+    Trim(cbLimit);
+}
+
+void
+CAMSlabCache::GetStatistics(__out AM_SLABCACHE_STATISTICS *pStats)
+{
+    CAutoLock lck(&m_Lock);
+    *pStats = m_Stats;
+}
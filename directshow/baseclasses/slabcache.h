@@ -0,0 +1,93 @@
+//------------------------------------------------------------------------------
+// File: SlabCache.h
+//
+// Desc: DirectShow base classes - defines a process-wide cache of sample
+//       buffer blocks that outlives individual allocators.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+/* When a CMemAllocator with AM_MEMALLOC_RECYCLE set releases its buffer
+   block (because it is being destroyed or its properties changed) the block
+   is parked here instead of being returned to the OS. The next allocator
+   that asks for a block with the same buffer size, alignment, prefix and
+   backing store, and at least as many bytes, gets the parked block back
+   without a VirtualAlloc or any page faults.
+
+   The total number of bytes parked is capped. When parking a block would
+   exceed the cap the least recently parked blocks are released first, and
+   a block bigger than the cap on its own is never parked at all */
+
+
+#ifndef __SLABCACHE__
+#define __SLABCACHE__
+
+
+// what a parked block can be used for
+struct AM_SLAB_KEY {
+    LONG  lSize;                // agreed size of each buffer
+    LONG  lAlignment;           // agreed alignment
+    LONG  lPrefix;              // agreed prefix
+    DWORD dwBackingFlags;       // AM_MEMALLOC_xxx the block was made with
+    DWORD dwNumaNode;           // node the block is on, never AM_NUMANODE_CURRENT
+};
+
+struct AM_SLABCACHE_STATISTICS {
+    LONGLONG cHits;             // lookups satisfied from the cache
+    LONGLONG cMisses;           // lookups that went to the OS
+    LONGLONG cEvictions;        // parked blocks released to stay under the cap
+    LONG     cBlocksRetained;   // blocks parked now
+    SIZE_T   cbRetained;        // bytes parked now
+    SIZE_T   cbLimit;           // cap on cbRetained
+};
+
+#define AM_SLABCACHE_DEFAULT_LIMIT  (64 * 1024 * 1024)
+
+class CAMSlabCache {
+
+    struct CSlab {
+        CSlab      *pNext;
+        AM_SLAB_KEY Key;
+        LPBYTE      pBlock;
+        SIZE_T      cb;
+        BOOL        bLargePages;
+    };
+
+    static CCritSec m_Lock;
+    static CSlab *m_pHead;      // oldest first
+    static AM_SLABCACHE_STATISTICS m_Stats;
+
+    static BOOL KeysMatch(const AM_SLAB_KEY *pKey1, const AM_SLAB_KEY *pKey2);
+    static void Trim(SIZE_T cbLimit);
+    static void ReleaseBlock(__in LPBYTE pBlock);
+
+public:
+
+    // Find the smallest parked block for this key holding at least cbMin
+    // bytes. Returns NULL on a miss, otherwise the block, its real size
+    // and whether it is made of large pages
+    static LPBYTE Lookup(
+        const AM_SLAB_KEY *pKey,
+        SIZE_T cbMin,
+        __out SIZE_T *pcb,
+        __out BOOL *pbLargePages);
+
+    // Park a block. Returns FALSE (and leaves the block alone) if it
+    // cannot be kept, in which case the caller must free it
+    static BOOL Park(
+        const AM_SLAB_KEY *pKey,
+        __in LPBYTE pBlock,
+        SIZE_T cb,
+        BOOL bLargePages);
+
+    // change the cap - 0 disables the cache and releases everything
+    static void SetLimit(SIZE_T cbLimit);
+
+    // release every parked block
+    static void Flush() { Trim(0); };
+
+    static void GetStatistics(__out AM_SLABCACHE_STATISTICS *pStats);
+};
+
+#endif /* __SLABCACHE__ */
@@ -224,7 +224,8 @@ CSourceStream::CSourceStream(
     __inout CSource *ps,
     __in_opt LPCWSTR pPinName)
     : CBaseOutputPin(pObjectName, ps, ps->pStateLock(), phr, pPinName),
-      m_pFilter(ps) {
+      m_pFilter(ps),
+      m_lFillBatch(1) {
 
      *phr = m_pFilter->AddPin(this);
 }
@@ -236,7 +237,8 @@ CSourceStream::CSourceStream(
     __inout CSource *ps,
     __in_opt LPCWSTR pPinName)
     : CBaseOutputPin(pObjectName, ps, ps->pStateLock(), phr, pPinName),
-      m_pFilter(ps) {
+      m_pFilter(ps),
+      m_lFillBatch(1) {
 
      *phr = m_pFilter->AddPin(this);
 }
@@ -460,6 +462,15 @@ HRESULT CSourceStream::DoBufferProcessingLoop(void) {
 
     Command com;
 
+    if (m_lFillBatch > 1 && m_pAllocator != NULL) {
+        IMemAllocatorBatch *pBatch;
+        if (SUCCEEDED(m_pAllocator->QueryInterface(IID_IMemAllocatorBatch, (void **) &pBatch))) {
+            HRESULT hr = DoBatchedBufferProcessingLoop(pBatch);
+            pBatch->Release();
+            return hr;
+        }
+    }
+
     OnThreadStartPlay();
 
     do {
@@ -475,6 +486,10 @@ HRESULT CSourceStream::DoBufferProcessingLoop(void) {
 			    // exit soon.
 	    }
 
+	    if (CAMLatency::IsEnabled()) {
+		CAMLatency::StampOrigin(pSample);
+	    }
+
 	    // Virtual function user will override.
 	    hr = FillBuffer(pSample);
 
@@ -520,3 +535,148 @@ HRESULT CSourceStream::DoBufferProcessingLoop(void) {
     return S_FALSE;
 }
 
+
+//
+// SetFillBatchSize
+//
+// Choose how many buffers the worker thread gets from the allocator at a
+// time. Takes effect the next time the thread starts running.
+HRESULT CSourceStream::SetFillBatchSize(LONG lBatch) {
+
+    if (lBatch < 1 || lBatch > MAX_FILL_BATCH) {
+        return E_INVALIDARG;
+    }
+
+    CAutoLock lock(m_pFilter->pStateLock());
+    m_lFillBatch = lBatch;
+    return NOERROR;
+}
+
+
+//
+// DoBatchedBufferProcessingLoop
+//
+// As DoBufferProcessingLoop, but takes up to m_lFillBatch buffers from the
+// allocator at once. We never wait for a whole batch - we take whatever is
+// free once at least one buffer is - so nothing is held back from
+// downstream that could have been filled and delivered.
+HRESULT CSourceStream::DoBatchedBufferProcessingLoop(__in IMemAllocatorBatch *pBatch) {
+
+    Command com;
+    IMediaSample *apSamples[MAX_FILL_BATCH];
+
+    // we can never get more buffers than the allocator has
+    ALLOCATOR_PROPERTIES Props;
+    LONG lBatch = m_lFillBatch;
+    if (SUCCEEDED(m_pAllocator->GetProperties(&Props))) {
+        lBatch = max(1, min(lBatch, Props.cBuffers));
+    }
+
+    OnThreadStartPlay();
+
+    do {
+	while (!CheckRequest(&com)) {
+
+	    LONG cSamples;
+	    HRESULT hr = GetDeliveryBuffers(pBatch, lBatch, apSamples, &cSamples);
+	    if (FAILED(hr)) {
+                Sleep(1);
+		continue;	// go round again. Perhaps the error will go away
+			    // or the allocator is decommited & we will be asked to
+			    // exit soon.
+	    }
+
+            LONG iSample = 0;
+            HRESULT hrExit = S_FALSE;
+            BOOL bCommand = FALSE;
+            for (; iSample < cSamples; iSample++) {
+
+                // don't keep Stop or Pause waiting for the rest of the batch
+                if (iSample > 0 && CheckRequest(&com)) {
+                    bCommand = TRUE;
+                    break;
+                }
+
+                IMediaSample *pSample = apSamples[iSample];
+
+                if (CAMLatency::IsEnabled()) {
+                    CAMLatency::StampOrigin(pSample);
+                }
+
+                // Virtual function user will override.
+                hr = FillBuffer(pSample);
+
+                if (hr == S_OK) {
+                    hr = Deliver(pSample);
+                    pSample->Release();
+
+                    // downstream filter returns S_FALSE if it wants us to
+                    // stop or an error if it's reporting an error.
+                    if(hr != S_OK)
+                    {
+                      DbgLog((LOG_TRACE, 2, TEXT("Deliver() returned %08x; stopping"), hr));
+                      hrExit = S_OK;
+                      break;
+                    }
+
+                } else if (hr == S_FALSE) {
+                    // derived class wants us to stop pushing data
+                    pSample->Release();
+                    DeliverEndOfStream();
+                    hrExit = S_OK;
+                    break;
+                } else {
+                    // derived class encountered an error
+                    pSample->Release();
+                    DbgLog((LOG_ERROR, 1, TEXT("Error %08lX from FillBuffer!!!"), hr));
+                    DeliverEndOfStream();
+                    m_pFilter->NotifyEvent(EC_ERRORABORT, hr, 0);
+                    hrExit = hr;
+                    break;
+                }
+            }
+
+            if (hrExit != S_FALSE) {
+                // give back the buffers we didn't get round to
+                while (++iSample < cSamples) {
+                    apSamples[iSample]->Release();
+                }
+                return hrExit;
+            }
+            if (bCommand) {
+                for (; iSample < cSamples; iSample++) {
+                    apSamples[iSample]->Release();
+                }
+                break;
+            }
+
+            // all paths release the samples
+	}
+
+        // For all commands sent to us there must be a Reply call!
+
+	if (com == CMD_RUN || com == CMD_PAUSE) {
+	    Reply(NOERROR);
+	} else if (com != CMD_STOP) {
+	    Reply((DWORD) E_UNEXPECTED);
+	    DbgLog((LOG_ERROR, 1, TEXT("Unexpected command!!!")));
+	}
+    } while (com != CMD_STOP);
+
+    return S_FALSE;
+}
+
+
+//
+// GetDeliveryBuffers
+//
+// The batched equivalent of GetDeliveryBuffer, for
+// DoBatchedBufferProcessingLoop.
+HRESULT CSourceStream::GetDeliveryBuffers(
+    __in IMemAllocatorBatch *pBatch,
+    LONG cRequested,
+    __out_ecount_part(cRequested, *pcReturned) IMediaSample **ppSamples,
+    __out LONG *pcReturned) {
+
+    return pBatch->GetBuffers(cRequested, ppSamples, pcReturned, 0);
+}
@@ -148,6 +148,37 @@ protected:
 
     virtual HRESULT DoBufferProcessingLoop(void);    // the loop executed whilst running
 
+    // *
+    // * Batched fill
+    // *
+    // * If m_lFillBatch is more than 1 and the allocator supports
+    // * IMemAllocatorBatch, DoBufferProcessingLoop hands over to
+    // * DoBatchedBufferProcessingLoop which gets up to that many buffers
+    // * from the allocator at a time, then fills and delivers each one.
+    // * FillBuffer and Deliver are called exactly as in the normal loop,
+    // * and a command (Stop, Pause) is acted on before the next FillBuffer
+    // * rather than at the end of the batch.
+    // *
+    // * The buffers come from GetDeliveryBuffers, not GetDeliveryBuffer.
+    // * If you override GetDeliveryBuffer (for dynamic format changes, or
+    // * to swap allocators) override GetDeliveryBuffers to match, or leave
+    // * batching off.
+    // *
+
+    enum { MAX_FILL_BATCH = 64 };
+    LONG m_lFillBatch;          // 1 (the default) for one buffer at a time
+
+    HRESULT SetFillBatchSize(LONG lBatch);
+    virtual HRESULT DoBatchedBufferProcessingLoop(__in IMemAllocatorBatch *pBatch);
+
+    // get at least one and up to cRequested buffers - by default straight
+    // from pBatch
+    virtual HRESULT GetDeliveryBuffers(
+        __in IMemAllocatorBatch *pBatch,
+        LONG cRequested,
+        __out_ecount_part(cRequested, *pcReturned) IMediaSample **ppSamples,
+        __out LONG *pcReturned);
+
 
     // *
     // * AM_MEDIA_TYPE support
@@ -158,9 +158,16 @@ LONG_PTR _SetWindowLongPtr(HWND hwnd, int nIndex, T p)
 //include amaudio.h explicitly if you need it.  it requires the DX SDK.
 //#include <amaudio.h>    // ActiveMovie audio interfaces and definitions
 #include <wxutil.h>     // General helper classes for threads etc
+#include <lockfree.h>   // Non-blocking queue and wakeup helpers
+#include <slabcache.h>  // Process-wide cache of sample buffer blocks
+#include <memcopy.h>    // Buffer copies chosen by processor at run time
+#include <workpool.h>   // Persistent threads sharing the items of a job
+#include <tasksched.h>  // Threads shared by the base classes
 #include <combase.h>    // Base COM classes to support IUnknown
 #include <dllsetup.h>   // Filter registration support functions
 #include <measure.h>    // Performance measurement
+#include <streamtrace.h> // Trace of samples through the graph
+#include <latency.h>    // Sample latency through the graph
 #include <comlite.h>    // Light weight com function prototypes
 
 #include <cache.h>      // Simple cache container class
@@ -178,6 +185,7 @@ LONG_PTR _SetWindowLongPtr(HWND hwnd, int nIndex, T p)
 #include <source.h>	// Generic source filter
 #include <outputq.h>    // Output pin queueing
 #include <errors.h>     // HRESULT status and error definitions
+#include <qualpol.h>    // Video renderer quality control policies
 #include <renbase.h>    // Base class for writing ActiveX renderers
 #include <winutil.h>    // Helps with filters that manage windows
 #include <winctrl.h>    // Implements the IVideoWindow interface
@@ -185,7 +193,9 @@ LONG_PTR _SetWindowLongPtr(HWND hwnd, int nIndex, T p)
 #include <refclock.h>	// Base clock class
 #include <sysclock.h>	// System clock
 #include <pstream.h>    // IPersistStream helper class
+#include <framedrop.h>  // Predicts which video frames will be late
 #include <vtrans.h>     // Video Transform Filter base class
+#include <vconvert.h>   // Video format conversion and a filter built on it
 #include <amextra.h>
 #include <cprop.h>      // Base property page class
 #include <strmctl.h>    // IAMStreamControl support
@@ -0,0 +1,332 @@
+//------------------------------------------------------------------------------
+// File: StreamTrace.cpp
+//
+// Desc: DirectShow base classes - implements CAMStreamTrace.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#include <streams.h>
+#define STRSAFE_NO_DEPRECATE
+#include <strsafe.h>
+
+
+volatile BOOL CAMStreamTrace::m_bEnabled = FALSE;
+CCritSec CAMStreamTrace::m_Lock;
+CAMStreamTrace::CEvent *CAMStreamTrace::m_aEvents = NULL;
+LONG CAMStreamTrace::m_cEvents = 0;
+volatile LONG CAMStreamTrace::m_lNext = 0;
+LONG CAMStreamTrace::m_lFirst = 0;
+LONGLONG CAMStreamTrace::m_llFrequency = 0;
+LONGLONG CAMStreamTrace::m_llOrigin = 0;
+
+static const char * const g_aszTraceKinds[] = {
+    "Receive",
+    "Deliver",
+    "Transform",
+    "Render",
+    "StreamTrace"
+};
+
+
+LONGLONG
+CAMStreamTrace::Now()
+{
+    LARGE_INTEGER li;
+    QueryPerformanceCounter(&li);
+    return li.QuadPart;
+}
+
+HRESULT
+CAMStreamTrace::Start(LONG cEvents)
+{
+    if (cEvents <= 0 || cEvents > 0x1000000) {
+        return E_INVALIDARG;
+    }
+
+    CAutoLock lck(&m_Lock);
+    if (m_aEvents == NULL) {
+        LONG cAlloc = 1;
+        while (cAlloc < cEvents) {
+            cAlloc <<= 1;
+        }
+        CEvent *aEvents = new CEvent[cAlloc];
+        if (aEvents == NULL) {
+            return E_OUTOFMEMORY;
+        }
+        for (LONG i = 0; i < cAlloc; i++) {
+            aEvents[i].lSeq = -1;
+        }
+        m_cEvents = cAlloc;
+        m_aEvents = aEvents;
+
+        LARGE_INTEGER li;
+        QueryPerformanceFrequency(&li);
+        m_llFrequency = li.QuadPart;
+    }
+
+    // events from before now are left where they are but not written
+    m_lFirst = m_lNext;
+    m_llOrigin = Now();
+    m_bEnabled = TRUE;
+    return S_OK;
+}
+
+void
+CAMStreamTrace::Stop()
+{
+    CAutoLock lck(&m_Lock);
+    m_bEnabled = FALSE;
+}
+
+// claim the next slot - the caller fills it in and calls EndRecord
+
+CAMStreamTrace::CEvent *
+CAMStreamTrace::BeginRecord(
+    AM_TRACE_KIND Kind,
+    __in_opt LPCWSTR pszFilter,
+    __in_opt LPCWSTR pszPin,
+    __out LONG *plSeq)
+{
+    // Start may not have been called yet if we saw the flag change early
+    CEvent *aEvents = m_aEvents;
+    if (aEvents == NULL) {
+        return NULL;
+    }
+
+    LONG lSeq = InterlockedIncrement(&m_lNext) - 1;
+    CEvent *pEvent = &aEvents[lSeq & (m_cEvents - 1)];
+
+    // Take the slot over from the event published in it, if that is older
+    // than ours. If it is being written - by a thread that was slow to
+    // finish with it, or came round the ring since - or already holds a
+    // newer event, this one is lost rather than mixed with the other
+    const LONG lOld = pEvent->lSeq;
+    if (lOld == AM_TRACE_WRITING || (lOld != -1 && lOld - lSeq >= 0) ||
+        InterlockedCompareExchange(&pEvent->lSeq, AM_TRACE_WRITING, lOld) != lOld) {
+        return NULL;
+    }
+
+    pEvent->Kind = Kind;
+    pEvent->dwThreadId = GetCurrentThreadId();
+    pEvent->bSampleTime = FALSE;
+    pEvent->szFilter[0] = L'\0';
+    pEvent->szPin[0] = L'\0';
+    if (pszFilter) {
+        (void)StringCchCopyW(pEvent->szFilter, NUMELMS(pEvent->szFilter), pszFilter);
+    }
+    if (pszPin) {
+        (void)StringCchCopyW(pEvent->szPin, NUMELMS(pEvent->szPin), pszPin);
+    }
+
+    *plSeq = lSeq;
+    return pEvent;
+}
+
+// publish the slot - a reader that sees lSeq sees the rest of it too. We
+// own it until then, so no other writer can have touched it
+
+void
+CAMStreamTrace::EndRecord(__inout CEvent *pEvent, LONG lSeq)
+{
+    InterlockedExchange(&pEvent->lSeq, lSeq);
+}
+
+void
+CAMStreamTrace::Record(
+    AM_TRACE_KIND Kind,
+    __in_opt LPCWSTR pszFilter,
+    __in_opt LPCWSTR pszPin,
+    __in_opt IMediaSample *pSample,
+    LONGLONG llBegin,
+    LONGLONG llEnd)
+{
+    LONG lSeq;
+    CEvent *pEvent = BeginRecord(Kind, pszFilter, pszPin, &lSeq);
+    if (pEvent == NULL) {
+        return;
+    }
+
+    pEvent->llBegin = llBegin;
+    pEvent->llEnd = llEnd;
+    pEvent->Id = 0;
+    if (pSample) {
+        REFERENCE_TIME rtStop;
+        pEvent->bSampleTime = SUCCEEDED(pSample->GetTime(&pEvent->rtSample, &rtStop));
+    }
+    EndRecord(pEvent, lSeq);
+}
+
+void
+CAMStreamTrace::RecordStreamTrace(
+    ULONG Id,
+    ULONGLONG DShowClock,
+    ULONGLONG Data1,
+    ULONGLONG Data2,
+    ULONGLONG Data3,
+    ULONGLONG Data4)
+{
+    LONG lSeq;
+    CEvent *pEvent = BeginRecord(AM_TRACE_STREAMTRACE, NULL, NULL, &lSeq);
+    if (pEvent == NULL) {
+        return;
+    }
+
+    pEvent->llBegin = pEvent->llEnd = Now();
+    pEvent->rtSample = (REFERENCE_TIME) DShowClock;
+    pEvent->Id = Id;
+    pEvent->aData[0] = Data1;
+    pEvent->aData[1] = Data2;
+    pEvent->aData[2] = Data3;
+    pEvent->aData[3] = Data4;
+    EndRecord(pEvent, lSeq);
+}
+
+
+// --- Writing the trace -----------------------
+
+// buffers what is written to the file
+
+class CTraceWriter {
+
+    HANDLE m_hFile;
+    char m_ach[16384];
+    LONG m_cb;
+    HRESULT m_hr;
+
+public:
+
+    CTraceWriter(HANDLE hFile) : m_hFile(hFile), m_cb(0), m_hr(S_OK) {};
+
+    void Flush()
+    {
+        DWORD dwWritten;
+        if (m_cb && SUCCEEDED(m_hr) &&
+            !WriteFile(m_hFile, m_ach, m_cb, &dwWritten, NULL)) {
+            m_hr = AmHresultFromWin32(GetLastError());
+        }
+        m_cb = 0;
+    };
+
+    HRESULT Result() const { return m_hr; };
+
+    void Write(__in_ecount(cb) const char *pch, LONG cb)
+    {
+        if (m_cb + cb > (LONG) sizeof(m_ach)) {
+            Flush();
+        }
+        CopyMemory(m_ach + m_cb, pch, cb);
+        m_cb += cb;
+    };
+
+    void Printf(__format_string const char *pszFormat, ...)
+    {
+        char sz[256];
+        va_list va;
+        va_start(va, pszFormat);
+        (void)StringCchVPrintfA(sz, NUMELMS(sz), pszFormat, va);
+        va_end(va);
+        Write(sz, lstrlenA(sz));
+    };
+
+    // a JSON string, in UTF-8
+    void String(__in LPCWSTR psz)
+    {
+        char sz[AM_TRACE_MAX_NAME * 6 + 2];
+        LONG cb = 0;
+        sz[cb++] = '"';
+        for (; *psz; psz++) {
+            if (*psz == L'"' || *psz == L'\\') {
+                sz[cb++] = '\\';
+                sz[cb++] = (char) *psz;
+            } else if (*psz < L' ') {
+                sz[cb++] = ' ';
+            } else {
+                cb += WideCharToMultiByte(CP_UTF8, 0, psz, 1, sz + cb, 3, NULL, NULL);
+            }
+        }
+        sz[cb++] = '"';
+        Write(sz, cb);
+    };
+};
+
+HRESULT
+CAMStreamTrace::WriteChromeTrace(LPCTSTR pszFileName)
+{
+    CheckPointer(pszFileName, E_POINTER);
+
+    CAutoLock lck(&m_Lock);
+    if (m_aEvents == NULL) {
+        return E_UNEXPECTED;
+    }
+
+    HANDLE hFile = CreateFile(pszFileName, GENERIC_WRITE, 0, NULL,
+                              CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return AmHresultFromWin32(GetLastError());
+    }
+
+    CTraceWriter Writer(hFile);
+    Writer.Printf("{\"traceEvents\":[\n");
+
+    // whatever has not been overwritten since Start
+    const LONG lEnd = m_lNext;
+    LONG lBegin = lEnd - m_cEvents;
+    if (lBegin - m_lFirst < 0) {
+        lBegin = m_lFirst;
+    }
+
+    const DWORD dwProcessId = GetCurrentProcessId();
+    const double dTicksPerUs = m_llFrequency / 1000000.0;
+    BOOL bFirst = TRUE;
+    for (LONG lSeq = lBegin; lSeq != lEnd; lSeq++) {
+
+        // skip the slot if it is being written, or has been since we looked
+        const CEvent *pSlot = &m_aEvents[lSeq & (m_cEvents - 1)];
+        if (pSlot->lSeq != lSeq) {
+            continue;
+        }
+        MemoryBarrier();
+        CEvent Event = *pSlot;
+        MemoryBarrier();
+        if (pSlot->lSeq != lSeq) {
+            continue;
+        }
+
+        Writer.Printf("%s{\"name\":\"%s\",\"cat\":\"dshow\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,",
+            bFirst ? "" : ",\n",
+            g_aszTraceKinds[Event.Kind],
+            dwProcessId,
+            Event.dwThreadId,
+            (Event.llBegin - m_llOrigin) / dTicksPerUs);
+        bFirst = FALSE;
+
+        if (Event.Kind != AM_TRACE_RECEIVE && Event.Kind != AM_TRACE_STREAMTRACE) {
+            Writer.Printf("\"ph\":\"X\",\"dur\":%.3f,", (Event.llEnd - Event.llBegin) / dTicksPerUs);
+        } else {
+            Writer.Printf("\"ph\":\"i\",\"s\":\"t\",");
+        }
+
+        Writer.Printf("\"args\":{");
+        if (Event.Kind == AM_TRACE_STREAMTRACE) {
+            Writer.Printf("\"id\":%u,\"clock\":%I64u,\"data\":[%I64u,%I64u,%I64u,%I64u]}}",
+                Event.Id, (ULONGLONG) Event.rtSample,
+                Event.aData[0], Event.aData[1], Event.aData[2], Event.aData[3]);
+            continue;
+        }
+        Writer.Printf("\"filter\":");
+        Writer.String(Event.szFilter);
+        Writer.Printf(",\"pin\":");
+        Writer.String(Event.szPin);
+        if (Event.bSampleTime) {
+            Writer.Printf(",\"sample_ms\":%.3f", Event.rtSample / 10000.0);
+        }
+        Writer.Printf("}}");
+    }
+
+    Writer.Printf("\n],\"displayTimeUnit\":\"ms\"}\n");
+    Writer.Flush();
+    CloseHandle(hFile);
+    return Writer.Result();
+}
@@ -0,0 +1,168 @@
+//------------------------------------------------------------------------------
+// File: StreamTrace.h
+//
+// Desc: DirectShow base classes - defines CAMStreamTrace, a record of
+//       samples passing through the graph that can be loaded into a trace
+//       viewer.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+/* The PERFLOG_ macros in dxmperf.h only go to ETW. CAMStreamTrace keeps the
+   last few thousand streaming events of the whole process in memory instead,
+   and writes them out in the Chrome trace event format, which chrome://tracing
+   and the Perfetto UI both load. Each thread gets its own row, so a sample
+   can be followed from pin to pin across the streaming threads.
+
+   The base classes record
+       Receive    when CBaseInputPin::Receive accepts a sample (an instant)
+       Deliver    CBaseOutputPin::Deliver, ie the downstream Receive call
+       Transform  CTransformFilter::Receive, from input to delivered output
+       Render     CBaseRenderer::Render
+       StreamTrace  PERFLOG_STREAMTRACE, with its id and data
+   each with the filter and pin names and the sample's start time.
+
+   COutputQueue calls the downstream pin's ReceiveMultiple itself rather
+   than going through Deliver, so queued deliveries have no Deliver span.
+   The downstream Receive still records its instant.
+
+   Nothing is recorded until Start is called, and until then each of the
+   places above costs a test of a global flag. Recording claims a slot in
+   one ring with an interlocked increment, so threads don't wait for each
+   other. Once the ring is full the oldest events are overwritten. A thread
+   that comes round to a slot still being written loses its event.
+   WriteChromeTrace can be called while recording, but it is neater to
+   Stop first.
+
+   The ring is allocated by the first Start and is never freed, as a thread
+   may still be recording into it after Stop. Later Starts just empty it */
+
+
+#ifndef __STREAMTRACE__
+#define __STREAMTRACE__
+
+
+// events the ring holds unless Start is told otherwise
+#define AM_TRACE_DEFAULT_EVENTS     16384
+
+// characters of a filter or pin name that are kept
+#define AM_TRACE_MAX_NAME           32
+
+// what a slot's sequence number is while its event is being written
+#define AM_TRACE_WRITING            (-2)
+
+enum AM_TRACE_KIND {
+    AM_TRACE_RECEIVE,
+    AM_TRACE_DELIVER,
+    AM_TRACE_TRANSFORM,
+    AM_TRACE_RENDER,
+    AM_TRACE_STREAMTRACE
+};
+
+class CAMStreamTrace {
+
+    struct CEvent {
+        volatile LONG lSeq;         // index it was recorded at, -1 if it
+                                    // never was, or AM_TRACE_WRITING
+        AM_TRACE_KIND Kind;
+        DWORD dwThreadId;
+        LONGLONG llBegin;           // performance counter
+        LONGLONG llEnd;
+        REFERENCE_TIME rtSample;    // or the clock for PERFLOG_STREAMTRACE
+        BOOL bSampleTime;
+        ULONG Id;                   // for PERFLOG_STREAMTRACE
+        ULONGLONG aData[4];
+        WCHAR szFilter[AM_TRACE_MAX_NAME];
+        WCHAR szPin[AM_TRACE_MAX_NAME];
+    };
+
+    static volatile BOOL m_bEnabled;
+    static CCritSec m_Lock;         // Start, Stop and writing
+    static CEvent *m_aEvents;
+    static LONG m_cEvents;          // a power of 2
+    static volatile LONG m_lNext;   // events ever recorded
+    static LONG m_lFirst;           // m_lNext when Start was called
+    static LONGLONG m_llFrequency;
+    static LONGLONG m_llOrigin;     // when Start was called
+
+    static CEvent *BeginRecord(AM_TRACE_KIND Kind, LPCWSTR pszFilter, LPCWSTR pszPin,
+                               __out LONG *plSeq);
+    static void EndRecord(__inout CEvent *pEvent, LONG lSeq);
+
+public:
+
+    static BOOL IsEnabled() { return m_bEnabled; };
+
+    // performance counter now, for the times passed to Record
+    static LONGLONG Now();
+
+    // Empty the ring and start recording. cEvents is rounded up to a power
+    // of 2, and only counts the first time
+    static HRESULT Start(LONG cEvents = AM_TRACE_DEFAULT_EVENTS);
+
+    // stop recording, keeping what has been recorded
+    static void Stop();
+
+    // Write what the ring holds as a Chrome trace event (JSON) file
+    static HRESULT WriteChromeTrace(LPCTSTR pszFileName);
+
+    // Record a span from llBegin to llEnd - for Receive, an instant, they
+    // are the same. The names are copied, and either may be NULL, as may
+    // pSample
+    static void Record(
+        AM_TRACE_KIND Kind,
+        __in_opt LPCWSTR pszFilter,
+        __in_opt LPCWSTR pszPin,
+        __in_opt IMediaSample *pSample,
+        LONGLONG llBegin,
+        LONGLONG llEnd);
+
+    // what PERFLOG_STREAMTRACE passes on
+    static void RecordStreamTrace(
+        ULONG Id,
+        ULONGLONG DShowClock,
+        ULONGLONG Data1,
+        ULONGLONG Data2,
+        ULONGLONG Data3,
+        ULONGLONG Data4);
+};
+
+
+// Records a span from its construction to its destruction, if the trace
+// was recording when it was constructed
+
+class CAMTraceSpan {
+
+    AM_TRACE_KIND m_Kind;
+    LPCWSTR m_pszFilter;
+    LPCWSTR m_pszPin;
+    IMediaSample *m_pSample;
+    LONGLONG m_llBegin;
+
+public:
+
+    CAMTraceSpan(
+        AM_TRACE_KIND Kind,
+        __in_opt LPCWSTR pszFilter,
+        __in_opt LPCWSTR pszPin,
+        __in_opt IMediaSample *pSample) :
+        m_Kind(Kind),
+        m_pszFilter(pszFilter),
+        m_pszPin(pszPin),
+        m_pSample(pSample),
+        m_llBegin(CAMStreamTrace::IsEnabled() ? CAMStreamTrace::Now() : 0)
+    {
+    };
+
+    // the sample must still be valid here
+    ~CAMTraceSpan()
+    {
+        if (m_llBegin) {
+            CAMStreamTrace::Record(m_Kind, m_pszFilter, m_pszPin, m_pSample,
+                                   m_llBegin, CAMStreamTrace::Now());
+        }
+    };
+};
+
+#endif // __STREAMTRACE__
@@ -36,6 +36,16 @@ CUnknown * WINAPI CSystemClock::CreateInstance(__inout_opt LPUNKNOWN pUnk, __ino
 CSystemClock::CSystemClock(__in_opt LPCTSTR pName, __inout_opt LPUNKNOWN pUnk, __inout HRESULT *phr) :
     CBaseReferenceClock(pName, pUnk, phr)
 {
+    // Use the performance counter rather than timeGetTime if we can
+    if (SUCCEEDED(*phr)) {
+        HRESULT hr = S_OK;
+        CAMCounterTimeSource *pSource = new CAMCounterTimeSource(&hr);
+        if (pSource && SUCCEEDED(hr)) {
+            EXECUTE_ASSERT(SUCCEEDED(SetTimeSource(pSource)));
+        } else {
+            delete pSource;
+        }
+    }
 }
 
 STDMETHODIMP CSystemClock::NonDelegatingQueryInterface(
@@ -0,0 +1,600 @@
+//------------------------------------------------------------------------------
+// File: TaskSched.cpp
+//
+// Desc: DirectShow base classes - implements CAMTaskScheduler.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#include <streams.h>
+
+// tasks a deque has room for before it first grows
+#define INITIAL_DEQUE_SIZE  64
+
+
+CCritSec CAMTaskScheduler::m_DefaultLock;
+CAMTaskScheduler *CAMTaskScheduler::m_pDefault = NULL;
+BOOL CAMTaskScheduler::m_bSharing = FALSE;
+
+
+// =================================================================
+// Implements CAMTaskScheduler::CDeque
+// =================================================================
+
+/* Only the owner moves m_llBottom, so it pushes without competing with
+   anyone. Thieves compete for m_llTop with a compare-and-swap, and the
+   owner joins in only when it pops the last task, which a thief may be
+   taking at the same moment. The owner publishes m_llBottom with a full
+   barrier, so a thief that sees the new bottom sees the task too, and
+   pops by moving m_llBottom before it reads m_llTop, so a thief and the
+   owner can't both miss each other over the last task.
+
+   A full ring is replaced with one twice the size. Thieves may still be
+   reading the old one, so old rings are kept until the deque goes. The
+   owner never overwrites a slot a thief could still take, as that would
+   need the ring to be full. Indexes are 64 bit so they never wrap */
+
+CAMTaskScheduler::CDeque::CDeque() :
+    m_pRing(NULL),
+    m_llTop(0),
+    m_llBottom(0)
+{
+}
+
+CAMTaskScheduler::CDeque::~CDeque()
+{
+    while (m_pRing) {
+        CRing *pRing = m_pRing;
+        m_pRing = pRing->pOld;
+        delete [] pRing->aTasks;
+        delete pRing;
+    }
+}
+
+HRESULT
+CAMTaskScheduler::CDeque::Grow()
+{
+    CRing *pOld = m_pRing;
+    LONG cTasks = pOld ? (pOld->cMask + 1) * 2 : INITIAL_DEQUE_SIZE;
+    CRing *pRing = new CRing;
+    if (pRing == NULL) {
+        return E_OUTOFMEMORY;
+    }
+    pRing->aTasks = new CTask[cTasks];
+    if (pRing->aTasks == NULL) {
+        delete pRing;
+        return E_OUTOFMEMORY;
+    }
+    pRing->pOld = pOld;
+    pRing->cMask = cTasks - 1;
+    if (pOld) {
+        for (LONGLONG ll = m_llTop; ll < m_llBottom; ll++) {
+            pRing->aTasks[ll & pRing->cMask] = pOld->aTasks[ll & pOld->cMask];
+        }
+    }
+    InterlockedExchangePointer((PVOID volatile *) &m_pRing, pRing);
+    return S_OK;
+}
+
+HRESULT
+CAMTaskScheduler::CDeque::Push(PTASKPROC pfn, PVOID pv)
+{
+    LONGLONG llBottom = m_llBottom;
+    if (m_pRing == NULL || llBottom - m_llTop > m_pRing->cMask) {
+        HRESULT hr = Grow();
+        if (FAILED(hr)) {
+            return hr;
+        }
+    }
+
+    CTask *pTask = &m_pRing->aTasks[llBottom & m_pRing->cMask];
+    pTask->pfn = pfn;
+    pTask->pv = pv;
+    InterlockedExchange64(&m_llBottom, llBottom + 1);
+    return S_OK;
+}
+
+// the newest task
+BOOL
+CAMTaskScheduler::CDeque::Pop(__out CTask *pTask)
+{
+    LONGLONG llBottom = m_llBottom - 1;
+    InterlockedExchange64(&m_llBottom, llBottom);
+    LONGLONG llTop = m_llTop;
+    if (llTop > llBottom) {
+        m_llBottom = llBottom + 1;
+        return FALSE;
+    }
+
+    *pTask = m_pRing->aTasks[llBottom & m_pRing->cMask];
+    if (llTop < llBottom) {
+        return TRUE;
+    }
+
+    // the last one - a thief may be after it too
+    BOOL bWon = InterlockedCompareExchange64(&m_llTop, llTop + 1, llTop) == llTop;
+    m_llBottom = llBottom + 1;
+    return bWon;
+}
+
+// the oldest task. FALSE if there is none, or another thread took it first
+BOOL
+CAMTaskScheduler::CDeque::Steal(__out CTask *pTask)
+{
+    LONGLONG llTop = m_llTop;
+    MemoryBarrier();
+    LONGLONG llBottom = m_llBottom;
+    if (llTop >= llBottom) {
+        return FALSE;
+    }
+
+    CRing *pRing = m_pRing;
+    *pTask = pRing->aTasks[llTop & pRing->cMask];
+    return InterlockedCompareExchange64(&m_llTop, llTop + 1, llTop) == llTop;
+}
+
+
+// =================================================================
+// Implements CAMTaskScheduler
+// =================================================================
+
+CAMTaskScheduler::CAMTaskScheduler() :
+    m_aDeques(NULL),
+    m_ahWorkers(NULL),
+    m_cWorkers(0),
+    m_cMaxWorkers(0),
+    m_iNextWorker(0),
+    m_hWake(NULL),
+    m_cSleeping(0),
+    m_cQueued(0),
+    m_bExit(FALSE),
+    m_dwTlsIndex(TLS_OUT_OF_INDEXES),
+    m_pParked(NULL),
+    m_cLoopThreads(0),
+    m_hNoLoopThreads(NULL),
+    m_cTasksRun(0),
+    m_cTasksStolen(0),
+    m_cLoopsStarted(0),
+    m_cLoopThreadsCreated(0)
+{
+}
+
+/* Tasks still queued are never run. Running loops are waited for, so
+   whoever started them must have stopped them first */
+
+CAMTaskScheduler::~CAMTaskScheduler()
+{
+    m_bExit = TRUE;
+
+    // parked loop threads wait on m_hWake too, so they go first in case
+    // they take the workers' wakeups
+    if (m_hNoLoopThreads) {
+        {
+            CAutoLock lck(&m_LoopLock);
+            while (m_pParked) {
+                CLoopThread *pThread = m_pParked;
+                m_pParked = pThread->pNext;
+                pThread->pfnLoop = NULL;
+                SetEvent(pThread->hStart);
+            }
+        }
+        WaitForSingleObject(m_hNoLoopThreads, INFINITE);
+
+        // the last thread may still be leaving the lock
+        CAutoLock lck(&m_LoopLock);
+    }
+
+    if (m_cWorkers) {
+        ReleaseSemaphore(m_hWake, m_cWorkers, NULL);
+        WaitForMultipleObjects(m_cWorkers, m_ahWorkers, TRUE, INFINITE);
+        for (LONG i = 0; i < m_cWorkers; i++) {
+            CloseHandle(m_ahWorkers[i]);
+        }
+    }
+
+    delete [] m_ahWorkers;
+    delete [] m_aDeques;
+    if (m_hWake) {
+        CloseHandle(m_hWake);
+    }
+    if (m_hNoLoopThreads) {
+        CloseHandle(m_hNoLoopThreads);
+    }
+    if (m_dwTlsIndex != TLS_OUT_OF_INDEXES) {
+        TlsFree(m_dwTlsIndex);
+    }
+}
+
+HRESULT
+CAMTaskScheduler::Create(LONG cWorkers)
+{
+    if (m_hWake != NULL) {
+        return E_UNEXPECTED;
+    }
+    if (cWorkers < 0) {
+        return E_INVALIDARG;
+    }
+    if (cWorkers == 0) {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        cWorkers = (LONG) si.dwNumberOfProcessors;
+    }
+
+    // the destructor waits for them all at once
+    cWorkers = min(cWorkers, MAXIMUM_WAIT_OBJECTS);
+
+    m_dwTlsIndex = TlsAlloc();
+    if (m_dwTlsIndex == TLS_OUT_OF_INDEXES) {
+        return AmHresultFromWin32(GetLastError());
+    }
+    m_hWake = CreateSemaphore(NULL, 0, 0x7FFFFFFF, NULL);
+    m_hNoLoopThreads = CreateEvent(NULL, TRUE, TRUE, NULL);
+    if (m_hWake == NULL || m_hNoLoopThreads == NULL) {
+        return AmHresultFromWin32(GetLastError());
+    }
+
+    m_aDeques = new CDeque[cWorkers + 1];
+    m_ahWorkers = new HANDLE[cWorkers];
+    if (m_aDeques == NULL || m_ahWorkers == NULL) {
+        return E_OUTOFMEMORY;
+    }
+
+    m_cMaxWorkers = cWorkers;
+    DbgLog((LOG_TRACE, 2, TEXT("CAMTaskScheduler - up to %d workers"), m_cMaxWorkers));
+    return S_OK;
+}
+
+// S_FALSE if we have all the workers we may
+
+HRESULT
+CAMTaskScheduler::AddWorker()
+{
+    CAutoLock lck(&m_WorkerLock);
+    if (m_cWorkers == m_cMaxWorkers) {
+        return S_FALSE;
+    }
+
+    DWORD dwThreadId;
+    HANDLE hThread = CreateThread(NULL, 0, WorkerProc, this, 0, &dwThreadId);
+    if (hThread == NULL) {
+        return AmHresultFromWin32(GetLastError());
+    }
+    m_ahWorkers[m_cWorkers] = hThread;
+    InterlockedIncrement(&m_cWorkers);
+    return S_OK;
+}
+
+/* For a task just queued - a thread going to sleep checks m_cQueued after
+   saying so, so if nobody is sleeping whoever is about to will see it, or
+   everyone is busy and we start another worker if we may */
+
+void
+CAMTaskScheduler::WakeWorker()
+{
+    if (m_cSleeping > 0) {
+        ReleaseSemaphore(m_hWake, 1, NULL);
+    } else if (m_cWorkers < m_cMaxWorkers) {
+        AddWorker();
+    }
+}
+
+CAMTaskScheduler *
+CAMTaskScheduler::GetDefault()
+{
+    CAutoLock lck(&m_DefaultLock);
+    if (m_pDefault == NULL) {
+        CAMTaskScheduler *pScheduler = new CAMTaskScheduler;
+        if (pScheduler && FAILED(pScheduler->Create())) {
+            delete pScheduler;
+            pScheduler = NULL;
+        }
+        m_pDefault = pScheduler;
+    }
+    return m_pDefault;
+}
+
+HRESULT
+CAMTaskScheduler::EnableSharing(BOOL bEnable)
+{
+    if (bEnable && GetDefault() == NULL) {
+        return E_OUTOFMEMORY;
+    }
+    m_bSharing = bEnable;
+    return S_OK;
+}
+
+HRESULT
+CAMTaskScheduler::Submit(PTASKPROC pfn, __inout_opt PVOID pv)
+{
+    CheckPointer(pfn, E_POINTER);
+    if (m_hWake == NULL) {
+        return E_UNEXPECTED;
+    }
+
+    // there must be someone to run it whatever else happens
+    HRESULT hr;
+    if (m_cWorkers == 0) {
+        hr = AddWorker();
+        if (FAILED(hr)) {
+            return hr;
+        }
+    }
+
+    // a worker keeps its own tasks, anyone else shares theirs
+    LONG iDeque = (LONG) (LONG_PTR) TlsGetValue(m_dwTlsIndex) - 1;
+    if (iDeque < 0) {
+        iDeque = m_cMaxWorkers;
+    }
+    if (iDeque < m_cMaxWorkers) {
+        hr = m_aDeques[iDeque].Push(pfn, pv);
+    } else {
+        // only its owner may push onto a deque, so the rest take turns
+        CAutoLock lck(&m_SubmitLock);
+        hr = m_aDeques[iDeque].Push(pfn, pv);
+    }
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    InterlockedIncrement(&m_cQueued);
+    WakeWorker();
+    return S_OK;
+}
+
+/* Our own newest task, else the oldest of anyone else's. A parked loop
+   thread passes m_cMaxWorkers, as it has no deque of its own */
+
+BOOL
+CAMTaskScheduler::FindTask(LONG iWorker, __out CTask *pTask)
+{
+    if (iWorker < m_cMaxWorkers && m_aDeques[iWorker].Pop(pTask)) {
+        return TRUE;
+    }
+    if (m_aDeques[m_cMaxWorkers].Steal(pTask)) {
+        return TRUE;
+    }
+    LONG cWorkers = m_cWorkers;
+    for (LONG i = 0; i < cWorkers; i++) {
+        LONG iVictim = (iWorker + 1 + i) % cWorkers;
+        if (iVictim != iWorker && m_aDeques[iVictim].Steal(pTask)) {
+            InterlockedIncrement64(&m_cTasksStolen);
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+void
+CAMTaskScheduler::RunTask(const CTask &Task)
+{
+    InterlockedDecrement(&m_cQueued);
+    Task.pfn(Task.pv);
+    InterlockedIncrement64(&m_cTasksRun);
+}
+
+DWORD WINAPI
+CAMTaskScheduler::WorkerProc(__in LPVOID pv)
+{
+    CAMTaskScheduler *pThis = (CAMTaskScheduler *) pv;
+
+    LONG iWorker = InterlockedIncrement(&pThis->m_iNextWorker) - 1;
+    TlsSetValue(pThis->m_dwTlsIndex, (LPVOID) (LONG_PTR) (iWorker + 1));
+
+    for (;;) {
+        CTask Task;
+        if (pThis->FindTask(iWorker, &Task)) {
+            pThis->RunTask(Task);
+            continue;
+        }
+
+        InterlockedIncrement(&pThis->m_cSleeping);
+        if (pThis->m_cQueued == 0 && !pThis->m_bExit) {
+            WaitForSingleObject(pThis->m_hWake, INFINITE);
+        }
+        InterlockedDecrement(&pThis->m_cSleeping);
+        if (pThis->m_bExit) {
+            return 0;
+        }
+    }
+}
+
+HRESULT
+CAMTaskScheduler::StartLoop(
+    LPTHREAD_START_ROUTINE pfnLoop,
+    __inout_opt PVOID pv,
+    __out HANDLE *phThread,
+    __out HANDLE *phDone,
+    __out_opt DWORD *pdwExitCode,
+    int nPriority)
+{
+    CheckPointer(pfnLoop, E_POINTER);
+    CheckPointer(phThread, E_POINTER);
+    CheckPointer(phDone, E_POINTER);
+    if (m_hNoLoopThreads == NULL) {
+        return E_UNEXPECTED;
+    }
+
+    HANDLE hDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (hDone == NULL) {
+        return AmHresultFromWin32(GetLastError());
+    }
+
+    CLoopThread *pThread;
+    {
+        CAutoLock lck(&m_LoopLock);
+
+        pThread = m_pParked;
+        if (pThread) {
+            m_pParked = pThread->pNext;
+        } else {
+            pThread = new CLoopThread;
+            if (pThread == NULL) {
+                CloseHandle(hDone);
+                return E_OUTOFMEMORY;
+            }
+            ZeroMemory(pThread, sizeof(CLoopThread));
+            pThread->pScheduler = this;
+            pThread->hStart = CreateEvent(NULL, FALSE, FALSE, NULL);
+            if (pThread->hStart) {
+                DWORD dwThreadId;
+                pThread->hThread = CreateThread(NULL, 0, LoopThreadProc, pThread, 0, &dwThreadId);
+            }
+            if (pThread->hThread == NULL) {
+                HRESULT hr = AmHresultFromWin32(GetLastError());
+                if (pThread->hStart) {
+                    CloseHandle(pThread->hStart);
+                }
+                delete pThread;
+                CloseHandle(hDone);
+                return hr;
+            }
+            if (m_cLoopThreads++ == 0) {
+                ResetEvent(m_hNoLoopThreads);
+            }
+            m_cLoopThreadsCreated++;
+        }
+        m_cLoopsStarted++;
+
+        if (!DuplicateHandle(GetCurrentProcess(), pThread->hThread,
+                             GetCurrentProcess(), phThread,
+                             0, FALSE, DUPLICATE_SAME_ACCESS)) {
+            HRESULT hr = AmHresultFromWin32(GetLastError());
+            pThread->pNext = m_pParked;
+            m_pParked = pThread;
+            CloseHandle(hDone);
+            return hr;
+        }
+
+        pThread->pNext = NULL;
+        pThread->pfnLoop = pfnLoop;
+        pThread->pv = pv;
+        pThread->hDone = hDone;
+        pThread->pdwExitCode = pdwExitCode;
+        pThread->nPriority = nPriority;
+    }
+
+    *phDone = hDone;
+    SetEvent(pThread->hStart);
+    return S_OK;
+}
+
+/* A parked thread runs tasks while it waits for a loop, sleeping on
+   m_hWake like a worker. hStart comes first in the wait so a loop is not
+   held up by more than the task in hand. If it is started after Submit
+   counted it as sleeping it passes the wakeup on.
+
+   A parked thread that times out has to take itself off the parked list
+   before leaving, in case StartLoop has just picked it - in which case it
+   stays for that loop after all */
+
+DWORD WINAPI
+CAMTaskScheduler::LoopThreadProc(__in LPVOID pv)
+{
+    CLoopThread *pThread = (CLoopThread *) pv;
+    CAMTaskScheduler *pThis = pThread->pScheduler;
+    HANDLE ahWait[2] = { pThread->hStart, pThis->m_hWake };
+    BOOL bParked = FALSE;           // the first loop is on its way
+    DWORD dwWait = INFINITE;
+
+    for (;;) {
+        DWORD dwResult;
+        if (bParked) {
+            InterlockedIncrement(&pThis->m_cSleeping);
+            dwResult = WaitForMultipleObjects(2, ahWait, FALSE,
+                                              pThis->m_cQueued ? 0 : dwWait);
+            InterlockedDecrement(&pThis->m_cSleeping);
+            if (dwResult == WAIT_OBJECT_0 + 1 ||
+                (dwResult == WAIT_TIMEOUT && pThis->m_cQueued)) {
+                CTask Task;
+                while (pThis->FindTask(pThis->m_cMaxWorkers, &Task)) {
+                    pThis->RunTask(Task);
+                }
+                continue;
+            }
+        } else {
+            dwResult = WaitForSingleObject(pThread->hStart, dwWait);
+        }
+
+        if (dwResult == WAIT_TIMEOUT) {
+            CAutoLock lck(&pThis->m_LoopLock);
+            CLoopThread **ppThread = &pThis->m_pParked;
+            while (*ppThread && *ppThread != pThread) {
+                ppThread = &(*ppThread)->pNext;
+            }
+            if (*ppThread) {
+                *ppThread = pThread->pNext;
+                break;
+            }
+            dwWait = INFINITE;
+            continue;
+        }
+        if (pThread->pfnLoop == NULL) {
+            break;
+        }
+        if (bParked && pThis->m_cQueued) {
+            pThis->WakeWorker();
+        }
+
+        // set before the loop runs, as once it returns this thread may be
+        // running something else
+        if (pThread->nPriority != THREAD_PRIORITY_NORMAL) {
+            SetThreadPriority(GetCurrentThread(), pThread->nPriority);
+        }
+        DWORD dwExitCode = pThread->pfnLoop(pThread->pv);
+
+        // the loop may have changed our priority for itself
+        SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_NORMAL);
+        if (pThread->pdwExitCode) {
+            *pThread->pdwExitCode = dwExitCode;
+        }
+        HANDLE hDone = pThread->hDone;
+        pThread->pfnLoop = NULL;
+        pThread->hDone = NULL;
+        pThread->pdwExitCode = NULL;
+
+        // park before saying we're done so a new loop straight after
+        // finds us
+        BOOL bExit;
+        {
+            CAutoLock lck(&pThis->m_LoopLock);
+            bExit = pThis->m_bExit;
+            if (!bExit) {
+                pThread->pNext = pThis->m_pParked;
+                pThis->m_pParked = pThread;
+            }
+        }
+        SetEvent(hDone);
+        if (bExit) {
+            break;
+        }
+        bParked = TRUE;
+        dwWait = AM_SCHED_LOOP_IDLE_TIMEOUT;
+    }
+
+    CloseHandle(pThread->hStart);
+    CloseHandle(pThread->hThread);
+    delete pThread;
+
+    CAutoLock lck(&pThis->m_LoopLock);
+    if (--pThis->m_cLoopThreads == 0) {
+        SetEvent(pThis->m_hNoLoopThreads);
+    }
+    return 0;
+}
+
+void
+CAMTaskScheduler::GetStatistics(__out AM_TASKSCHEDULER_STATISTICS *pStats)
+{
+    CAutoLock lck(&m_LoopLock);
+    pStats->cWorkers = m_cWorkers;
+    pStats->cTasksRun = m_cTasksRun;
+    pStats->cTasksStolen = m_cTasksStolen;
+    pStats->cLoopThreads = m_cLoopThreads;
+    pStats->cLoopThreadsParked = 0;
+    for (CLoopThread *pThread = m_pParked; pThread; pThread = pThread->pNext) {
+        pStats->cLoopThreadsParked++;
+    }
+    pStats->cLoopsStarted = m_cLoopsStarted;
+    pStats->cLoopThreadsCreated = m_cLoopThreadsCreated;
+}
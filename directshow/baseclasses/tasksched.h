@@ -0,0 +1,177 @@
+//------------------------------------------------------------------------------
+// File: TaskSched.h
+//
+// Desc: DirectShow base classes - defines CAMTaskScheduler, threads shared
+//       by the base classes for short tasks and for streaming loops.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+/* A scheduler has up to one worker thread per processor for short tasks -
+   ones that never wait for anything. Workers are only started when tasks
+   are submitted and no thread is free to run them, so a scheduler nobody
+   submits tasks to has none. Each worker has its own deque. Tasks
+   submitted from a worker go on the bottom of its deque and it takes its
+   next task from there too, so related work stays on one processor. A
+   worker with nothing of its own steals from the top of another's deque,
+   and tasks submitted from other threads go on a deque no worker owns,
+   that they all steal from. Idle workers sleep on a semaphore.
+
+   Streaming loops - CAMThread::ThreadProc, CSourceStream's
+   DoBufferProcessingLoop, CMsgThread's message pump, COutputQueue's
+   thread - wait for most of their lives, so can't be tasks: each needs a
+   thread to itself while it runs. StartLoop runs one on a loop thread the
+   scheduler keeps. When the loop returns the thread is parked, and the
+   next StartLoop gets it back instead of creating a new one. A parked
+   thread runs short tasks too, like a worker with no deque of its own, so
+   it may finish a task before starting its next loop. Parked threads exit
+   if they are not reused within AM_SCHED_LOOP_IDLE_TIMEOUT.
+
+   The base classes only use the scheduler once EnableSharing(TRUE) has
+   been called. From then on the classes above start their loops with
+   StartLoop, and CAMWorkerPool (and so CTransformFilter's slicing) runs
+   its items as tasks instead of on threads of its own. Their handles to
+   a loop thread stay valid thread handles, but the thread does not exit
+   when the loop does, and may go on to run tasks and other loops - so it
+   must not be suspended, and its priority should only be set through
+   StartLoop. Code that waits on such a handle itself rather than calling
+   Close should not turn sharing on */
+
+
+#ifndef __TASKSCHED__
+#define __TASKSCHED__
+
+
+// how long a parked loop thread waits to be reused
+#define AM_SCHED_LOOP_IDLE_TIMEOUT  30000
+
+struct AM_TASKSCHEDULER_STATISTICS {
+    LONG     cWorkers;              // threads for short tasks
+    LONGLONG cTasksRun;
+    LONGLONG cTasksStolen;          // taken from another worker's deque
+    LONG     cLoopThreads;          // threads for loops, running or parked
+    LONG     cLoopThreadsParked;
+    LONGLONG cLoopsStarted;
+    LONGLONG cLoopThreadsCreated;   // cLoopsStarted less this were reused
+};
+
+class CAMTaskScheduler {
+
+public:
+
+    typedef void (*PTASKPROC)(__inout PVOID pv);
+
+private:
+
+    struct CTask {
+        PTASKPROC pfn;
+        PVOID pv;
+    };
+
+    // a worker's tasks - the owner pushes and pops at the bottom and
+    // thieves steal from the top, none of them taking a lock
+    class CDeque {
+        struct CRing {
+            CRing *pOld;            // the ring this one replaced
+            LONG cMask;             // one less than the size, a power of 2
+            CTask *aTasks;
+        };
+        CRing * volatile m_pRing;
+        volatile LONGLONG m_llTop;
+        volatile LONGLONG m_llBottom;
+        HRESULT Grow();
+    public:
+        CDeque();
+        ~CDeque();
+        HRESULT Push(PTASKPROC pfn, PVOID pv);
+        BOOL Pop(__out CTask *pTask);
+        BOOL Steal(__out CTask *pTask);
+    };
+
+    // a thread for loops, parked on m_hStart between them
+    struct CLoopThread {
+        CLoopThread *pNext;         // in m_pParked
+        CAMTaskScheduler *pScheduler;
+        HANDLE hThread;
+        HANDLE hStart;
+        LPTHREAD_START_ROUTINE pfnLoop;
+        PVOID pv;
+        HANDLE hDone;               // set when pfnLoop returns
+        DWORD *pdwExitCode;         // where to put what it returned
+        int nPriority;              // for pfnLoop
+    };
+
+    CDeque *m_aDeques;              // one per worker, then one for others
+    CCritSec m_SubmitLock;          // held to push onto the others' deque
+    HANDLE *m_ahWorkers;
+    volatile LONG m_cWorkers;       // started so far
+    LONG m_cMaxWorkers;
+    CCritSec m_WorkerLock;          // held to start a worker
+    volatile LONG m_iNextWorker;    // for numbering the workers
+    HANDLE m_hWake;                 // released when tasks are submitted
+    volatile LONG m_cSleeping;      // workers waiting on m_hWake
+    volatile LONG m_cQueued;        // tasks in all the deques
+    BOOL m_bExit;
+    DWORD m_dwTlsIndex;             // worker number + 1 on workers
+
+    CCritSec m_LoopLock;            // protects the loop threads
+    CLoopThread *m_pParked;
+    LONG m_cLoopThreads;
+    HANDLE m_hNoLoopThreads;        // set when m_cLoopThreads is 0
+
+    volatile LONGLONG m_cTasksRun;
+    volatile LONGLONG m_cTasksStolen;
+    LONGLONG m_cLoopsStarted;
+    LONGLONG m_cLoopThreadsCreated;
+
+    static CCritSec m_DefaultLock;
+    static CAMTaskScheduler *m_pDefault;
+    static BOOL m_bSharing;
+
+    static DWORD WINAPI WorkerProc(__in LPVOID pv);
+    static DWORD WINAPI LoopThreadProc(__in LPVOID pv);
+    HRESULT AddWorker();
+    void WakeWorker();
+    BOOL FindTask(LONG iWorker, __out CTask *pTask);
+    void RunTask(const CTask &Task);
+
+public:
+
+    CAMTaskScheduler();
+    ~CAMTaskScheduler();
+
+    // allow up to cWorkers workers - 0 means one per processor. None are
+    // started until there are tasks for them
+    HRESULT Create(LONG cWorkers = 0);
+
+    // the scheduler the base classes share, created on first use. It is
+    // never destroyed, as its threads can't be waited for once the
+    // process is exiting
+    static CAMTaskScheduler *GetDefault();
+
+    // Have the base classes use the default scheduler from now on. Objects
+    // already streaming carry on as they are
+    static HRESULT EnableSharing(BOOL bEnable);
+    static BOOL IsSharing() { return m_bSharing; };
+
+    // Queue a short task. It may run on any worker, in any order
+    // relative to other tasks
+    HRESULT Submit(PTASKPROC pfn, __inout_opt PVOID pv);
+
+    // Run pfnLoop(pv) on a loop thread, at nPriority. *phThread is a
+    // handle to the thread, and *phDone an event set once pfnLoop has
+    // returned and *pdwExitCode (if not NULL) has been set - close both
+    // when done
+    HRESULT StartLoop(
+        LPTHREAD_START_ROUTINE pfnLoop,
+        __inout_opt PVOID pv,
+        __out HANDLE *phThread,
+        __out HANDLE *phDone,
+        __out_opt DWORD *pdwExitCode,
+        int nPriority = THREAD_PRIORITY_NORMAL);
+
+    void GetStatistics(__out AM_TASKSCHEDULER_STATISTICS *pStats);
+};
+
+#endif // __TASKSCHED__
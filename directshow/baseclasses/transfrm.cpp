@@ -24,11 +24,13 @@ CTransformFilter::CTransformFilter(__in_opt LPCTSTR pName,
     m_pOutput(NULL),
     m_bEOSDelivered(FALSE),
     m_bQualityChanged(FALSE),
-    m_bSampleSkipped(FALSE)
+    m_bSampleSkipped(FALSE),
+    m_pViewAllocator(NULL),
+    m_pCopyAllocator(NULL),
+    m_pSlicePool(NULL),
+    m_pPipeline(NULL)
 {
-#ifdef PERF
     RegisterPerfId();
-#endif //  PERF
 }
 
 #ifdef UNICODE
@@ -40,11 +42,13 @@ CTransformFilter::CTransformFilter(__in_opt LPCSTR pName,
     m_pOutput(NULL),
     m_bEOSDelivered(FALSE),
     m_bQualityChanged(FALSE),
-    m_bSampleSkipped(FALSE)
+    m_bSampleSkipped(FALSE),
+    m_pViewAllocator(NULL),
+    m_pCopyAllocator(NULL),
+    m_pSlicePool(NULL),
+    m_pPipeline(NULL)
 {
-#ifdef PERF
     RegisterPerfId();
-#endif //  PERF
 }
 #endif
 
@@ -56,6 +60,15 @@ CTransformFilter::~CTransformFilter()
 
     delete m_pInput;
     delete m_pOutput;
+
+    if (m_pCopyAllocator) {
+        m_pCopyAllocator->Release();
+    }
+    if (m_pViewAllocator) {
+        m_pViewAllocator->Release();
+    }
+    delete m_pSlicePool;
+    delete m_pPipeline;
 }
 
 
@@ -244,8 +257,11 @@ CTransformFilter::InitializeOutputSample(IMediaSample *pSample, __deref_out IMed
 	dwFlags |= AM_GBF_NOTASYNCPOINT;
     }
 
-    ASSERT(m_pOutput->m_pAllocator != NULL);
-    HRESULT hr = m_pOutput->m_pAllocator->GetBuffer(
+    // with the view allocator agreed downstream the copy goes out as a view
+    // on one of our own buffers
+    IMemAllocator *pAllocator = m_pCopyAllocator ? m_pCopyAllocator : m_pOutput->m_pAllocator;
+    ASSERT(pAllocator != NULL);
+    HRESULT hr = pAllocator->GetBuffer(
              &pOutSample
              , pProps->dwSampleFlags & AM_SAMPLE_TIMEVALID ?
                    &pProps->tStart : NULL
@@ -253,12 +269,70 @@ CTransformFilter::InitializeOutputSample(IMediaSample *pSample, __deref_out IMed
                    &pProps->tStop : NULL
              , dwFlags
          );
+    if (SUCCEEDED(hr) && m_pCopyAllocator) {
+        IMediaSample *pView;
+        hr = m_pViewAllocator->GetView(pOutSample, 0, pOutSample->GetSize(), &pView);
+        pOutSample->Release();
+        pOutSample = SUCCEEDED(hr) ? pView : NULL;
+    }
     *ppOutSample = pOutSample;
     if (FAILED(hr)) {
         return hr;
     }
 
     ASSERT(pOutSample);
+    CopySampleProperties(pSample, pOutSample);
+    return S_OK;
+}
+
+// Copy the data across as it is
+HRESULT
+CTransformFilter::CopySampleData(IMediaSample *pIn, IMediaSample *pOut)
+{
+    CheckPointer(pIn, E_POINTER);
+    CheckPointer(pOut, E_POINTER);
+
+    const long lDataLength = pIn->GetActualDataLength();
+    if (lDataLength < 0 || lDataLength > pOut->GetSize()) {
+        return VFW_E_BUFFER_OVERFLOW;
+    }
+
+    BYTE *pInBuffer, *pOutBuffer;
+    HRESULT hr = pIn->GetPointer(&pInBuffer);
+    if (SUCCEEDED(hr)) {
+        hr = pOut->GetPointer(&pOutBuffer);
+    }
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    CAMMemCopy::Copy(pOutBuffer, pInBuffer, lDataLength);
+    return pOut->SetActualDataLength(lDataLength);
+}
+
+// Set up a view on part of the input sample as our output sample
+HRESULT
+CTransformFilter::InitializeForwardedSample(
+    IMediaSample *pSample,
+    LONG lOffset,
+    LONG lLength,
+    __deref_out IMediaSample **ppOutSample)
+{
+    ASSERT(m_pViewAllocator != NULL);
+    HRESULT hr = m_pViewAllocator->GetView(pSample, lOffset, lLength, ppOutSample);
+    if (FAILED(hr)) {
+        return hr;
+    }
+    CopySampleProperties(pSample, *ppOutSample);
+    return S_OK;
+}
+
+// Default - times, flags and media times are the same as the input's
+void
+CTransformFilter::CopySampleProperties(IMediaSample *pSample, IMediaSample *pOutSample)
+{
+    AM_SAMPLE2_PROPERTIES * const pProps = m_pInput->SampleProps();
+
     IMediaSample2 *pOutSample2;
     if (SUCCEEDED(pOutSample->QueryInterface(IID_IMediaSample2,
                                              (void **)&pOutSample2))) {
@@ -274,7 +348,7 @@ CTransformFilter::InitializeOutputSample(IMediaSample *pSample, __deref_out IMed
         OutProps.tStart = pProps->tStart;
         OutProps.tStop  = pProps->tStop;
         OutProps.cbData = FIELD_OFFSET(AM_SAMPLE2_PROPERTIES, dwStreamId);
-        hr = pOutSample2->SetProperties(
+        pOutSample2->SetProperties(
             FIELD_OFFSET(AM_SAMPLE2_PROPERTIES, dwStreamId),
             (PBYTE)&OutProps
         );
@@ -301,9 +375,674 @@ CTransformFilter::InitializeOutputSample(IMediaSample *pSample, __deref_out IMed
             pOutSample->SetMediaTime(&MediaStart,&MediaEnd);
         }
     }
+
+    // the output carries on from where the input has got to
+    if (CAMLatency::IsEnabled()) {
+        CAMLatency::CopyStamps(pSample, pOutSample);
+    }
+}
+
+// Turn zero-copy forwarding on or off. The views are created lazily and
+// committed with the rest of the filter in Pause
+
+HRESULT
+CTransformFilter::EnableForwarding(BOOL bEnable)
+{
+    CAutoLock lck(&m_csFilter);
+    if (m_State != State_Stopped) {
+        return VFW_E_NOT_STOPPED;
+    }
+    if (!bEnable) {
+        // the output may already be using the views
+        if (m_pCopyAllocator) {
+            return VFW_E_ALREADY_CONNECTED;
+        }
+        if (m_pViewAllocator) {
+            m_pViewAllocator->Release();
+            m_pViewAllocator = NULL;
+        }
+        return NOERROR;
+    }
+    if (m_pViewAllocator == NULL) {
+        HRESULT hr = S_OK;
+        m_pViewAllocator = new CSampleViewAllocator(NAME("Transform view allocator"), &hr);
+        if (m_pViewAllocator == NULL) {
+            return E_OUTOFMEMORY;
+        }
+        m_pViewAllocator->AddRef();
+        if (FAILED(hr)) {
+            m_pViewAllocator->Release();
+            m_pViewAllocator = NULL;
+            return hr;
+        }
+    }
+    return NOERROR;
+}
+
+// By default nothing is forwarded
+HRESULT
+CTransformFilter::CanForward(IMediaSample *pIn, __out LONG *plOffset, __out LONG *plLength)
+{
+    UNREFERENCED_PARAMETER(pIn);
+    UNREFERENCED_PARAMETER(plOffset);
+    UNREFERENCED_PARAMETER(plLength);
+    return S_FALSE;
+}
+
+// By default the forwarded sample goes out with the input's properties
+HRESULT
+CTransformFilter::TransformForward(IMediaSample *pIn, IMediaSample *pOut)
+{
+    UNREFERENCED_PARAMETER(pIn);
+    UNREFERENCED_PARAMETER(pOut);
+    return NOERROR;
+}
+
+// Turn slice-parallel transforms on or off. The pool's threads wait
+// between frames rather than being created for each one
+
+HRESULT
+CTransformFilter::EnableSlicing(BOOL bEnable, LONG cThreads)
+{
+    CAutoLock lck(&m_csFilter);
+    if (m_State != State_Stopped) {
+        return VFW_E_NOT_STOPPED;
+    }
+    if (cThreads < 0) {
+        return E_INVALIDARG;
+    }
+
+    delete m_pSlicePool;
+    m_pSlicePool = NULL;
+    if (!bEnable) {
+        return NOERROR;
+    }
+    if (m_pPipeline) {
+        return VFW_E_WRONG_STATE;
+    }
+
+    m_pSlicePool = new CAMWorkerPool;
+    if (m_pSlicePool == NULL) {
+        return E_OUTOFMEMORY;
+    }
+
+    // the streaming thread is one of them
+    HRESULT hr = m_pSlicePool->Create(cThreads == 0 ? AM_WORKPOOL_AUTO : cThreads - 1);
+    if (FAILED(hr)) {
+        delete m_pSlicePool;
+        m_pSlicePool = NULL;
+    }
+    return hr;
+}
+
+// one frame's worth of bands, for SliceItem
+struct CTransformSlices {
+    CTransformFilter *pFilter;
+    IMediaSample *pIn;
+    IMediaSample *pOut;
+    LONG lRows;
+    LONG lAlign;
+    LONG cSlices;
+};
+
+static HRESULT
+SliceItem(__inout PVOID pContext, LONG iItem)
+{
+    CTransformSlices *pSlices = (CTransformSlices *) pContext;
+
+    // split into whole multiples of lAlign, with what is left in the last
+    LONG cUnits = pSlices->lRows / pSlices->lAlign;
+    LONG y0 = (LONG) (Int32x32To64(cUnits, iItem) / pSlices->cSlices) * pSlices->lAlign;
+    LONG y1 = pSlices->lRows;
+    if (iItem + 1 < pSlices->cSlices) {
+        y1 = (LONG) (Int32x32To64(cUnits, iItem + 1) / pSlices->cSlices) * pSlices->lAlign;
+    }
+    return pSlices->pFilter->TransformSlice(pSlices->pIn, pSlices->pOut, y0, y1);
+}
+
+HRESULT
+CTransformFilter::TransformSlices(IMediaSample *pIn, IMediaSample *pOut)
+{
+    CTransformSlices Slices;
+    HRESULT hr = GetSliceRows(pIn, pOut, &Slices.lRows, &Slices.lAlign);
+    if (FAILED(hr)) {
+        return hr;
+    }
+    if (Slices.lRows <= 0 || Slices.lAlign <= 0) {
+        return E_UNEXPECTED;
+    }
+
+    Slices.pFilter = this;
+    Slices.pIn = pIn;
+    Slices.pOut = pOut;
+    Slices.cSlices = 1;
+    if (m_pSlicePool) {
+        Slices.cSlices = min(m_pSlicePool->GetThreadCount(), Slices.lRows / Slices.lAlign);
+    }
+    if (Slices.cSlices <= 1) {
+        return TransformSlice(pIn, pOut, 0, Slices.lRows);
+    }
+    return m_pSlicePool->Run(SliceItem, &Slices, Slices.cSlices);
+}
+
+// Slice place holder - must be overridden if slicing is enabled
+HRESULT
+CTransformFilter::TransformSlice(IMediaSample *pIn, IMediaSample *pOut, LONG y0, LONG y1)
+{
+    UNREFERENCED_PARAMETER(pIn);
+    UNREFERENCED_PARAMETER(pOut);
+    UNREFERENCED_PARAMETER(y0);
+    UNREFERENCED_PARAMETER(y1);
+    DbgBreak("CTransformFilter::TransformSlice() should never be called");
+    return E_UNEXPECTED;
+}
+
+HRESULT
+CTransformFilter::GetSliceRows(
+    IMediaSample *pIn,
+    IMediaSample *pOut,
+    __out LONG *plRows,
+    __out LONG *plAlign)
+{
+    UNREFERENCED_PARAMETER(pIn);
+    UNREFERENCED_PARAMETER(pOut);
+    CheckPointer(plRows, E_POINTER);
+    CheckPointer(plAlign, E_POINTER);
+
+    const CMediaType& mt = m_pOutput->CurrentMediaType();
+    const BITMAPINFOHEADER *pbmi = NULL;
+    if (*mt.FormatType() == FORMAT_VideoInfo &&
+        mt.FormatLength() >= sizeof(VIDEOINFOHEADER)) {
+        pbmi = HEADER(mt.Format());
+    } else if (*mt.FormatType() == FORMAT_VideoInfo2 &&
+               mt.FormatLength() >= sizeof(VIDEOINFOHEADER2)) {
+        pbmi = &((VIDEOINFOHEADER2 *) mt.Format())->bmiHeader;
+    }
+    if (pbmi == NULL) {
+        return VFW_E_INVALIDMEDIATYPE;
+    }
+
+    *plRows = abs(pbmi->biHeight);
+    *plAlign = 1;
+    return NOERROR;
+}
+
+// =================================================================
+// Implements the CTransformPipeline class
+// =================================================================
+
+/* The jobs are a ring indexed by how many frames came before them. Receive
+   adds at m_llTail, the threads take them in order from m_llNextWork, and
+   whichever thread finishes the job at m_llHead delivers it - and any
+   finished jobs after it - holding m_csDeliver so deliveries never overlap
+   or overtake each other */
+
+class CTransformPipeline
+{
+    struct CJob {
+        IMediaSample *pIn;          // released once transformed
+        IMediaSample *pOut;
+        BOOL bForward;              // TransformForward rather than Transform
+        BOOL bHold;                 // transform it but don't deliver it
+        BOOL bDone;
+        HRESULT hr;                 // from transforming it
+        LONGLONG llQueued;          // performance counter at Receive
+    };
+
+    CTransformFilter *m_pFilter;
+    CJob *m_aJobs;
+    LONG m_cDepth;
+    HANDLE *m_ahThreads;
+    LONG m_cThreads;
+    HANDLE m_hSlots;                // free jobs in the ring
+    HANDLE m_hWork;                 // jobs waiting for a thread
+    HANDLE m_hIdle;                 // set when nothing is in flight
+    BOOL m_bExit;
+
+    CCritSec m_Lock;                // protects everything below
+    CCritSec m_csDeliver;           // held while delivering
+    LONGLONG m_llTail;
+    LONGLONG m_llNextWork;
+    LONGLONG m_llHead;
+    BOOL m_bDiscard;                // flushing - throw results away
+    HRESULT m_hrError;              // for the next Receive
+    LONGLONG m_llFrequency;
+    LONGLONG m_llFirst;             // performance counter at first Receive
+    LONGLONG m_llLast;              // ... and at the last delivery
+    LONGLONG m_llLatencyTotal;
+    AM_PIPELINE_STATISTICS m_Stats;
+
+    static DWORD WINAPI ThreadProc(__in LPVOID pv);
+    void DeliverFinished();
+    HRESULT DeliverJob(const CJob *pJob);
+    static LONGLONG Now();
+
+public:
+
+    CTransformPipeline(__inout CTransformFilter *pFilter);
+    ~CTransformPipeline();
+
+    HRESULT Create(LONG cDepth);
+    HRESULT Receive(IMediaSample *pIn, IMediaSample *pOut, BOOL bForward, BOOL bHold = FALSE);
+    LONG GetDepth() const { return m_cDepth; };
+
+    // wait until everything queued has been delivered
+    void Drain();
+
+    // throw away everything queued, then forget any error
+    void BeginFlush();
+    void EndFlush();
+
+    void GetStatistics(__out AM_PIPELINE_STATISTICS *pStats);
+    void ResetStatistics();
+};
+
+CTransformPipeline::CTransformPipeline(__inout CTransformFilter *pFilter) :
+    m_pFilter(pFilter),
+    m_aJobs(NULL),
+    m_cDepth(0),
+    m_ahThreads(NULL),
+    m_cThreads(0),
+    m_hSlots(NULL),
+    m_hWork(NULL),
+    m_hIdle(NULL),
+    m_bExit(FALSE),
+    m_llTail(0),
+    m_llNextWork(0),
+    m_llHead(0),
+    m_bDiscard(FALSE),
+    m_hrError(S_OK),
+    m_llFrequency(1)
+{
+    LARGE_INTEGER li;
+    if (QueryPerformanceFrequency(&li)) {
+        m_llFrequency = li.QuadPart;
+    }
+    ZeroMemory(&m_Stats, sizeof(m_Stats));
+    ResetStatistics();
+}
+
+// only deleted while stopped, so nothing is in flight
+
+CTransformPipeline::~CTransformPipeline()
+{
+    if (m_cThreads) {
+        m_bExit = TRUE;
+        ReleaseSemaphore(m_hWork, m_cThreads, NULL);
+        WaitForMultipleObjects(m_cThreads, m_ahThreads, TRUE, INFINITE);
+        for (LONG i = 0; i < m_cThreads; i++) {
+            CloseHandle(m_ahThreads[i]);
+        }
+    }
+    delete [] m_ahThreads;
+    delete [] m_aJobs;
+    if (m_hSlots) {
+        CloseHandle(m_hSlots);
+    }
+    if (m_hWork) {
+        CloseHandle(m_hWork);
+    }
+    if (m_hIdle) {
+        CloseHandle(m_hIdle);
+    }
+}
+
+HRESULT
+CTransformPipeline::Create(LONG cDepth)
+{
+    if (cDepth == 0) {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        cDepth = (LONG) si.dwNumberOfProcessors;
+    }
+
+    // so the destructor can wait for all the threads at once
+    cDepth = min(cDepth, MAXIMUM_WAIT_OBJECTS);
+
+    m_aJobs = new CJob[cDepth];
+    m_ahThreads = new HANDLE[cDepth];
+    if (m_aJobs == NULL || m_ahThreads == NULL) {
+        return E_OUTOFMEMORY;
+    }
+    ZeroMemory(m_aJobs, cDepth * sizeof(CJob));
+    m_cDepth = cDepth;
+    m_Stats.cDepth = cDepth;
+
+    m_hSlots = CreateSemaphore(NULL, cDepth, cDepth, NULL);
+    m_hWork = CreateSemaphore(NULL, 0, cDepth, NULL);
+    m_hIdle = CreateEvent(NULL, TRUE, TRUE, NULL);
+    if (m_hSlots == NULL || m_hWork == NULL || m_hIdle == NULL) {
+        return AmHresultFromWin32(GetLastError());
+    }
+
+    for (; m_cThreads < cDepth; m_cThreads++) {
+        DWORD dwThreadId;
+        m_ahThreads[m_cThreads] = CreateThread(NULL, 0, ThreadProc, this, 0, &dwThreadId);
+        if (m_ahThreads[m_cThreads] == NULL) {
+            return AmHresultFromWin32(GetLastError());
+        }
+    }
+    return S_OK;
+}
+
+LONGLONG
+CTransformPipeline::Now()
+{
+    LARGE_INTEGER li;
+    QueryPerformanceCounter(&li);
+    return li.QuadPart;
+}
+
+// Takes over the caller's reference on pOut. Blocks while the pipeline
+// is full, which is what holds the upstream filter back
+
+HRESULT
+CTransformPipeline::Receive(IMediaSample *pIn, IMediaSample *pOut, BOOL bForward, BOOL bHold)
+{
+    WaitForSingleObject(m_hSlots, INFINITE);
+
+    {
+        CAutoLock lck(&m_Lock);
+
+        // report trouble with an earlier frame rather than queue this one
+        if (m_hrError != S_OK) {
+            HRESULT hr = m_hrError;
+            ReleaseSemaphore(m_hSlots, 1, NULL);
+            pOut->Release();
+            return hr;
+        }
+
+        CJob *pJob = &m_aJobs[m_llTail++ % m_cDepth];
+        pIn->AddRef();
+        pJob->pIn = pIn;
+        pJob->pOut = pOut;
+        pJob->bForward = bForward;
+        pJob->bHold = bHold;
+        pJob->bDone = FALSE;
+        pJob->hr = S_OK;
+        pJob->llQueued = Now();
+        if (m_llFirst == 0) {
+            m_llFirst = pJob->llQueued;
+        }
+        m_Stats.cMaxInFlight = max(m_Stats.cMaxInFlight, (LONG) (m_llTail - m_llHead));
+        ResetEvent(m_hIdle);
+    }
+
+    ReleaseSemaphore(m_hWork, 1, NULL);
     return S_OK;
 }
 
+DWORD WINAPI
+CTransformPipeline::ThreadProc(__in LPVOID pv)
+{
+    CTransformPipeline *pThis = (CTransformPipeline *) pv;
+
+    // Transform runs here rather than on the streaming thread, so it must
+    // find COM set up as CAMThread would have it
+    HRESULT hrCoInit = CAMThread::CoInitializeHelper();
+    if (FAILED(hrCoInit)) {
+        DbgLog((LOG_ERROR, 1, TEXT("CoInitializeEx failed.")));
+    }
+
+    for (;;) {
+        WaitForSingleObject(pThis->m_hWork, INFINITE);
+        if (pThis->m_bExit) {
+            break;
+        }
+
+        CJob *pJob;
+        BOOL bDiscard;
+        {
+            CAutoLock lck(&pThis->m_Lock);
+            pJob = &pThis->m_aJobs[pThis->m_llNextWork++ % pThis->m_cDepth];
+            bDiscard = pThis->m_bDiscard;
+        }
+
+        // no point transforming what will be thrown away
+        HRESULT hr = S_FALSE;
+        if (!bDiscard) {
+            if (pJob->bForward) {
+                hr = pThis->m_pFilter->TransformForward(pJob->pIn, pJob->pOut);
+            } else {
+                hr = pThis->m_pFilter->Transform(pJob->pIn, pJob->pOut);
+            }
+        }
+        pJob->pIn->Release();
+        pJob->pIn = NULL;
+
+        {
+            CAutoLock lck(&pThis->m_Lock);
+            pJob->hr = hr;
+            pJob->bDone = TRUE;
+        }
+        pThis->DeliverFinished();
+    }
+
+    if (SUCCEEDED(hrCoInit)) {
+        CoUninitialize();
+    }
+    return 0;
+}
+
+/* A thread that finds the head job unfinished leaves it to the thread
+   doing that job, which will look again after setting bDone */
+
+void
+CTransformPipeline::DeliverFinished()
+{
+    CAutoLock lckDeliver(&m_csDeliver);
+
+    for (;;) {
+        CJob Job;
+        BOOL bDiscard;
+        {
+            CAutoLock lck(&m_Lock);
+            if (m_llHead == m_llTail || !m_aJobs[m_llHead % m_cDepth].bDone) {
+                return;
+            }
+            Job = m_aJobs[m_llHead % m_cDepth];
+            bDiscard = m_bDiscard || m_hrError != S_OK;
+        }
+
+        HRESULT hr = S_OK;
+        if (!bDiscard) {
+            hr = DeliverJob(&Job);
+        }
+        Job.pOut->Release();
+
+        {
+            CAutoLock lck(&m_Lock);
+            m_aJobs[m_llHead % m_cDepth].pOut = NULL;
+            m_llHead++;
+            if (bDiscard) {
+                m_Stats.cFramesDiscarded++;
+            } else {
+                LONGLONG llNow = Now();
+                LONGLONG llLatency = llNow - Job.llQueued;
+                m_Stats.cFramesDelivered++;
+                m_llLatencyTotal += llLatency;
+                m_Stats.rtLatencyMax = max(m_Stats.rtLatencyMax,
+                                           llMulDiv(llLatency, UNITS, m_llFrequency, 0));
+                m_llLast = llNow;
+            }
+            if (hr != S_OK && !m_bDiscard && m_hrError == S_OK) {
+                m_hrError = hr;
+            }
+            if (m_llHead == m_llTail) {
+                SetEvent(m_hIdle);
+            }
+        }
+        ReleaseSemaphore(m_hSlots, 1, NULL);
+    }
+}
+
+// what CTransformFilter::Receive does with the result of Transform
+
+HRESULT
+CTransformPipeline::DeliverJob(const CJob *pJob)
+{
+    if (FAILED(pJob->hr)) {
+        DbgLog((LOG_TRACE,1,TEXT("Error from transform")));
+        return pJob->hr;
+    }
+    if (pJob->hr == S_FALSE || pJob->bHold) {
+        m_pFilter->m_bSampleSkipped = TRUE;
+        if (!m_pFilter->m_bQualityChanged) {
+            m_pFilter->NotifyEvent(EC_QUALITY_CHANGE,0,0);
+            m_pFilter->m_bQualityChanged = TRUE;
+        }
+        return S_OK;
+    }
+    m_pFilter->m_bSampleSkipped = FALSE;
+    return m_pFilter->m_pOutput->Deliver(pJob->pOut);
+}
+
+void
+CTransformPipeline::Drain()
+{
+    WaitForSingleObject(m_hIdle, INFINITE);
+}
+
+void
+CTransformPipeline::BeginFlush()
+{
+    CAutoLock lck(&m_Lock);
+    m_bDiscard = TRUE;
+}
+
+void
+CTransformPipeline::EndFlush()
+{
+    WaitForSingleObject(m_hIdle, INFINITE);
+    CAutoLock lck(&m_Lock);
+    m_bDiscard = FALSE;
+    m_hrError = S_OK;
+}
+
+void
+CTransformPipeline::GetStatistics(__out AM_PIPELINE_STATISTICS *pStats)
+{
+    CAutoLock lck(&m_Lock);
+    *pStats = m_Stats;
+    if (m_Stats.cFramesDelivered) {
+        pStats->rtLatencyAvg = llMulDiv(m_llLatencyTotal / m_Stats.cFramesDelivered,
+                                        UNITS, m_llFrequency, 0);
+    }
+    if (m_llLast > m_llFirst) {
+        pStats->rtElapsed = llMulDiv(m_llLast - m_llFirst, UNITS, m_llFrequency, 0);
+    }
+}
+
+void
+CTransformPipeline::ResetStatistics()
+{
+    CAutoLock lck(&m_Lock);
+    LONG cDepth = m_Stats.cDepth;
+    ZeroMemory(&m_Stats, sizeof(m_Stats));
+    m_Stats.cDepth = cDepth;
+    m_llFirst = 0;
+    m_llLast = 0;
+    m_llLatencyTotal = 0;
+}
+
+
+// Every frame in the pipeline holds an output buffer, so with fewer than
+// that the stages would wait in GetDeliveryBuffer rather than overlap.
+// Each holds its input buffer too until it has been transformed
+
+static HRESULT
+RaiseBufferCount(__in IMemAllocator *pAllocator, LONG cBuffers)
+{
+    ALLOCATOR_PROPERTIES Props, Actual;
+    HRESULT hr = pAllocator->GetProperties(&Props);
+    if (FAILED(hr) || Props.cBuffers >= cBuffers || Props.cbBuffer == 0) {
+        return hr;
+    }
+    Props.cBuffers = cBuffers;
+    hr = pAllocator->SetProperties(&Props, &Actual);
+    if (FAILED(hr)) {
+        return hr;
+    }
+    return Actual.cBuffers < cBuffers ? S_FALSE : S_OK;
+}
+
+
+// Turn pipelining on or off
+
+HRESULT
+CTransformFilter::EnablePipelining(BOOL bEnable, LONG cDepth)
+{
+    CAutoLock lck(&m_csFilter);
+    if (m_State != State_Stopped) {
+        return VFW_E_NOT_STOPPED;
+    }
+    if (cDepth < 0) {
+        return E_INVALIDARG;
+    }
+
+    delete m_pPipeline;
+    m_pPipeline = NULL;
+    if (!bEnable) {
+        return NOERROR;
+    }
+    if (m_pSlicePool) {
+        return VFW_E_WRONG_STATE;
+    }
+
+    m_pPipeline = new CTransformPipeline(this);
+    if (m_pPipeline == NULL) {
+        return E_OUTOFMEMORY;
+    }
+    HRESULT hr = m_pPipeline->Create(cDepth);
+    IMemAllocator *pAllocator = m_pCopyAllocator ? m_pCopyAllocator :
+                                m_pOutput ? m_pOutput->m_pAllocator : NULL;
+    if (SUCCEEDED(hr) && pAllocator) {
+        hr = RaiseBufferCount(pAllocator, m_pPipeline->GetDepth());
+    }
+
+    // upstream's buffers - with fewer it still works, it just can't keep
+    // the pipeline full
+    if (SUCCEEDED(hr) && m_pInput && m_pInput->m_pAllocator) {
+        if (RaiseBufferCount(m_pInput->m_pAllocator,
+                             m_pInput->GetPipelineBufferCount()) != S_OK) {
+            hr = S_FALSE;
+        }
+    }
+    if (FAILED(hr)) {
+        delete m_pPipeline;
+        m_pPipeline = NULL;
+    }
+    return hr;
+}
+
+HRESULT
+CTransformFilter::PipelineReceive(IMediaSample *pIn, IMediaSample *pOut, BOOL bHold)
+{
+    ASSERT(m_pPipeline);
+    return m_pPipeline->Receive(pIn, pOut, FALSE, bHold);
+}
+
+void
+CTransformFilter::PipelineDrain()
+{
+    if (m_pPipeline) {
+        m_pPipeline->Drain();
+    }
+}
+
+HRESULT
+CTransformFilter::GetPipelineStatistics(__out AM_PIPELINE_STATISTICS *pStats)
+{
+    CheckPointer(pStats, E_POINTER);
+    CAutoLock lck(&m_csFilter);
+    if (m_pPipeline == NULL) {
+        return VFW_E_WRONG_STATE;
+    }
+    m_pPipeline->GetStatistics(pStats);
+    return NOERROR;
+}
+
+
 // override this to customize the transform process
 
 HRESULT
@@ -312,29 +1051,55 @@ CTransformFilter::Receive(IMediaSample *pSample)
     /*  Check for other streams and pass them on */
     AM_SAMPLE2_PROPERTIES * const pProps = m_pInput->SampleProps();
     if (pProps->dwStreamId != AM_STREAM_MEDIA) {
+        if (m_pPipeline) {
+            m_pPipeline->Drain();
+        }
         return m_pOutput->m_pInputPin->Receive(pSample);
     }
     HRESULT hr;
     ASSERT(pSample);
     IMediaSample * pOutSample;
 
+    CAMTraceSpan Span(AM_TRACE_TRANSFORM, m_pName, m_pInput->Name(), pSample);
+
     // If no output to deliver to then no point sending us data
 
     ASSERT (m_pOutput != NULL) ;
 
-    // Set up the output sample
-    hr = InitializeOutputSample(pSample, &pOutSample);
+    // Set up the output sample - either a view on the input if the derived
+    // class can forward it, or a buffer from the output allocator. Views
+    // can only go downstream if it agreed to take them
+    LONG lOffset, lLength;
+    BOOL bForward = m_pCopyAllocator != NULL &&
+                    !m_pInput->IsReadOnly() &&
+                    CanForward(pSample, &lOffset, &lLength) == S_OK;
+    if (bForward) {
+        hr = InitializeForwardedSample(pSample, lOffset, lLength, &pOutSample);
+    } else {
+        hr = InitializeOutputSample(pSample, &pOutSample);
+    }
 
     if (FAILED(hr)) {
         return hr;
     }
 
+    // the pipeline transforms and delivers it later
+    if (m_pPipeline) {
+        return m_pPipeline->Receive(pSample, pOutSample, bForward);
+    }
+
     // Start timing the transform (if PERF is defined)
     MSR_START(m_idTransform);
 
     // have the derived class transform the data
 
-    hr = Transform(pSample, pOutSample);
+    if (bForward) {
+        hr = TransformForward(pSample, pOutSample);
+    } else if (m_pSlicePool) {
+        hr = TransformSlices(pSample, pOutSample);
+    } else {
+        hr = Transform(pSample, pOutSample);
+    }
 
     // Stop the clock and log it (if PERF is defined)
     MSR_STOP(m_idTransform);
@@ -346,6 +1111,7 @@ CTransformFilter::Receive(IMediaSample *pSample)
         // sample should not be delivered; we only deliver the sample if it's
         // really S_OK (same as NOERROR, of course.)
         if (hr == NOERROR) {
+            RecordLatency(pOutSample);
     	    hr = m_pOutput->m_pInputPin->Receive(pOutSample);
             m_bSampleSkipped = FALSE;	// last thing no longer dropped
         } else {
@@ -395,6 +1161,9 @@ HRESULT
 CTransformFilter::EndOfStream(void)
 {
     HRESULT hr = NOERROR;
+    if (m_pPipeline) {
+        m_pPipeline->Drain();
+    }
     if (m_pOutput != NULL) {
         hr = m_pOutput->DeliverEndOfStream();
     }
@@ -412,7 +1181,10 @@ CTransformFilter::BeginFlush(void)
     if (m_pOutput != NULL) {
 	// block receives -- done by caller (CBaseInputPin::BeginFlush)
 
-	// discard queued data -- we have no queued data
+	// discard queued data -- only if pipelining
+        if (m_pPipeline) {
+            m_pPipeline->BeginFlush();
+        }
 
 	// free anyone blocked on receive - not possible in this filter
 
@@ -430,7 +1202,10 @@ CTransformFilter::EndFlush(void)
 {
     // sync with pushing thread -- we have no worker thread
 
-    // ensure no more data to go downstream -- we have no queued data
+    // ensure no more data to go downstream -- only if pipelining
+    if (m_pPipeline) {
+        m_pPipeline->EndFlush();
+    }
 
     // call EndFlush on downstream pins
     ASSERT (m_pOutput != NULL);
@@ -469,7 +1244,19 @@ CTransformFilter::Stop()
     // synchronize with Receive calls
 
     CAutoLock lck2(&m_csReceive);
+
+    // throw away anything still being transformed
+    if (m_pPipeline) {
+        m_pPipeline->BeginFlush();
+        m_pPipeline->EndFlush();
+    }
     m_pOutput->Inactive();
+    if (m_pCopyAllocator) {
+        m_pCopyAllocator->Decommit();
+    }
+    if (m_pViewAllocator) {
+        m_pViewAllocator->Decommit();
+    }
 
     // allow a class derived from CTransformFilter
     // to know about starting and stopping streaming
@@ -520,6 +1307,23 @@ CTransformFilter::Pause()
 	    // to know about starting and stopping streaming
             CAutoLock lck2(&m_csReceive);
 	    hr = StartStreaming();
+            if (SUCCEEDED(hr) && m_pPipeline) {
+                m_pPipeline->ResetStatistics();
+            }
+
+            // allow as many views in flight as we have buffers to copy
+            // into. The output pin commits the views with the rest
+            if (SUCCEEDED(hr) && m_pCopyAllocator) {
+                ALLOCATOR_PROPERTIES Props;
+                LONG cViews = 1;
+                if (SUCCEEDED(m_pCopyAllocator->GetProperties(&Props))) {
+                    cViews = max(Props.cBuffers, 1);
+                }
+                hr = m_pViewAllocator->SetCount(cViews);
+                if (SUCCEEDED(hr)) {
+                    hr = m_pCopyAllocator->Commit();
+                }
+            }
 	}
 	if (SUCCEEDED(hr)) {
 	    hr = CBaseFilter::Pause();
@@ -537,6 +1341,9 @@ CTransformFilter::NewSegment(
     REFERENCE_TIME tStop,
     double dRate)
 {
+    if (m_pPipeline) {
+        m_pPipeline->Drain();
+    }
     if (m_pOutput != NULL) {
         return m_pOutput->DeliverNewSegment(tStart, tStop, dRate);
     }
@@ -767,6 +1574,28 @@ CTransformInputPin::Receive(IMediaSample * pSample)
 
 
 
+// Frames in the pipeline hold on to their input samples until they have
+// been transformed, and Receive holds one more while it waits for room
+
+LONG
+CTransformInputPin::GetPipelineBufferCount()
+{
+    ASSERT(m_pTransformFilter->m_pPipeline);
+    return m_pTransformFilter->m_pPipeline->GetDepth() + 1;
+}
+
+// ask upstream for enough buffers to keep the pipeline full
+STDMETHODIMP
+CTransformInputPin::GetAllocatorRequirements(__out ALLOCATOR_PROPERTIES *pProps)
+{
+    CheckPointer(pProps, E_POINTER);
+    if (m_pTransformFilter->m_pPipeline == NULL) {
+        return CBaseInputPin::GetAllocatorRequirements(pProps);
+    }
+    pProps->cBuffers = max(pProps->cBuffers, GetPipelineBufferCount());
+    return NOERROR;
+}
+
 
 // override to pass downstream
 STDMETHODIMP
@@ -889,10 +1718,41 @@ CTransformOutputPin::BreakConnect()
     //  Can't disconnect unless stopped
     ASSERT(IsStopped());
     m_pTransformFilter->BreakConnect(PINDIR_OUTPUT);
+    if (m_pTransformFilter->m_pCopyAllocator) {
+        m_pTransformFilter->m_pCopyAllocator->Decommit();
+        m_pTransformFilter->m_pCopyAllocator->Release();
+        m_pTransformFilter->m_pCopyAllocator = NULL;
+    }
     return CBaseOutputPin::BreakConnect();
 }
 
 
+/* Buffers are agreed as usual. With forwarding enabled we then offer the
+   view allocator, so that forwarded views and copies (made into the
+   agreed buffers and sent as views on them) all come from the allocator
+   downstream was told about. If it refuses we keep the agreed buffers and
+   copy everything */
+
+HRESULT
+CTransformOutputPin::DecideAllocator(IMemInputPin *pPin, __deref_out IMemAllocator **ppAlloc)
+{
+    HRESULT hr = CBaseOutputPin::DecideAllocator(pPin, ppAlloc);
+    CSampleViewAllocator *pViews = m_pTransformFilter->m_pViewAllocator;
+    if (FAILED(hr) || pViews == NULL) {
+        return hr;
+    }
+
+    ASSERT(m_pTransformFilter->m_pCopyAllocator == NULL);
+    if (FAILED(pPin->NotifyAllocator(pViews, FALSE))) {
+        return pPin->NotifyAllocator(*ppAlloc, FALSE);
+    }
+    m_pTransformFilter->m_pCopyAllocator = *ppAlloc;
+    pViews->AddRef();
+    *ppAlloc = pViews;
+    return NOERROR;
+}
+
+
 // Let derived class know when the output pin is connected
 
 HRESULT
@@ -960,7 +1820,11 @@ CTransformOutputPin::DecideBufferSize(
     IMemAllocator * pAllocator,
     __inout ALLOCATOR_PROPERTIES* pProp)
 {
-    return m_pTransformFilter->DecideBufferSize(pAllocator, pProp);
+    HRESULT hr = m_pTransformFilter->DecideBufferSize(pAllocator, pProp);
+    if (SUCCEEDED(hr) && m_pTransformFilter->m_pPipeline) {
+        hr = RaiseBufferCount(pAllocator, m_pTransformFilter->m_pPipeline->GetDepth());
+    }
+    return hr;
 }
 
 
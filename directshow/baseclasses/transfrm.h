@@ -25,6 +25,19 @@
 // ======================================================================
 
 class CTransformFilter;
+class CTransformPipeline;
+
+// what EnablePipelining's pipeline has done since streaming started
+struct AM_PIPELINE_STATISTICS {
+    LONG            cDepth;             // frames that may be in flight
+    LONG            cMaxInFlight;       // most that have been
+    LONGLONG        cFramesDelivered;
+    LONGLONG        cFramesDiscarded;   // by flushing, stopping or errors
+    REFERENCE_TIME  rtLatencyAvg;       // from Receive to delivery
+    REFERENCE_TIME  rtLatencyMax;
+    REFERENCE_TIME  rtElapsed;          // from the first Receive to the
+                                        // last delivery - for throughput
+};
 
 // ==================================================
 // Implements the input pin
@@ -92,6 +105,10 @@ public:
                         REFERENCE_TIME tStop,
                         double dRate);
 
+    // asks for a buffer for each frame a pipeline can hold
+    STDMETHODIMP GetAllocatorRequirements(__out ALLOCATOR_PROPERTIES *pProps);
+    LONG GetPipelineBufferCount();
+
     // Check if it's OK to process samples
     virtual HRESULT CheckStreaming();
 
@@ -147,6 +164,9 @@ public:
     HRESULT BreakConnect();
     HRESULT CompleteConnect(IPin *pReceivePin);
 
+    // offers the view allocator too when forwarding is enabled
+    HRESULT DecideAllocator(IMemInputPin *pPin, __deref_out IMemAllocator **ppAlloc);
+
     // check that we can support this output type
     HRESULT CheckMediaType(const CMediaType* mtOut);
 
@@ -248,6 +268,79 @@ public:
     // Standard setup for output sample
     HRESULT InitializeOutputSample(IMediaSample *pSample, __deref_out IMediaSample **ppOutSample);
 
+    // Copy the input sample's data to the output sample, for Transform
+    // overrides that pass it through unchanged. Big samples are copied
+    // without going through the cache (see CAMMemCopy)
+    HRESULT CopySampleData(IMediaSample *pIn, IMediaSample *pOut);
+
+    // =================================================================
+    // ----- Zero-copy forwarding              -------------------------
+    // =================================================================
+
+    // Once EnableForwarding(TRUE) has been called (while stopped) Receive
+    // asks CanForward about each input sample. If it returns S_OK the
+    // output sample is a view on bytes [*plOffset, *plOffset + *plLength)
+    // of the input sample instead of a buffer from the output allocator,
+    // and TransformForward is called in place of Transform to adjust its
+    // properties. Anything else falls back to the normal copying path, as
+    // does any sample arriving through a read-only allocator. Samples are
+    // only forwarded if downstream accepted the view allocator when the
+    // output was connected - otherwise everything is copied. Forwarding
+    // can't be turned off while connected that way.
+    HRESULT EnableForwarding(BOOL bEnable);
+    virtual HRESULT CanForward(IMediaSample *pIn, __out LONG *plOffset, __out LONG *plLength);
+    virtual HRESULT TransformForward(IMediaSample *pIn, IMediaSample *pOut);
+
+    // Standard setup for a forwarded output sample
+    HRESULT InitializeForwardedSample(
+                IMediaSample *pSample,
+                LONG lOffset,
+                LONG lLength,
+                __deref_out IMediaSample **ppOutSample);
+
+    // =================================================================
+    // ----- Slice-parallel transforms         -------------------------
+    // =================================================================
+
+    // Once EnableSlicing(TRUE) has been called (while stopped) Receive
+    // calls TransformSlices in place of Transform. That splits the rows of
+    // the picture into one band per thread and has TransformSlice do each
+    // band on a pool of cThreads threads (0 means one per processor), the
+    // streaming thread doing one band itself. Every band is finished before
+    // the output sample is delivered. Override TransformSlices to do any
+    // work that is once per frame, calling the base class for the bands.
+    HRESULT EnableSlicing(BOOL bEnable, LONG cThreads = 0);
+    virtual HRESULT TransformSlices(IMediaSample *pIn, IMediaSample *pOut);
+    virtual HRESULT TransformSlice(IMediaSample *pIn, IMediaSample *pOut, LONG y0, LONG y1);
+
+    // How many rows there are to split, and what every band but the last
+    // must be a multiple of (2 for 4:2:0 pictures, say). By default the
+    // height of the output type, split anywhere
+    virtual HRESULT GetSliceRows(
+                        IMediaSample *pIn,
+                        IMediaSample *pOut,
+                        __out LONG *plRows,
+                        __out LONG *plAlign);
+
+    // =================================================================
+    // ----- Pipelined transforms              -------------------------
+    // =================================================================
+
+    // Once EnablePipelining(TRUE) has been called (while stopped) Receive
+    // gets the output sample, queues the pair and returns. Up to cDepth
+    // frames (0 means one per processor, and never more than
+    // MAXIMUM_WAIT_OBJECTS) are transformed at once, on as many threads,
+    // and the output allocator is asked for at least that many buffers,
+    // and upstream's for one more. Transform must be safe to call for
+    // different samples at the same time. The outputs are delivered in
+    // the order the inputs arrived whichever finishes first, and an error
+    // delivering or transforming one is returned from a later Receive.
+    // EndOfStream and NewSegment wait until everything before them has
+    // been delivered, and flushing or stopping throws away whatever has
+    // not. Pipelining can't be combined with slicing
+    HRESULT EnablePipelining(BOOL bEnable, LONG cDepth = 0);
+    HRESULT GetPipelineStatistics(__out AM_PIPELINE_STATISTICS *pStats);
+
     // if you override Receive, you may need to override these three too
     virtual HRESULT EndOfStream(void);
     virtual HRESULT BeginFlush(void);
@@ -257,21 +350,17 @@ public:
                         REFERENCE_TIME tStop,
                         double dRate);
 
-#ifdef PERF
     // Override to register performance measurement with a less generic string
     // You should do this to avoid confusion with other filters
     virtual void RegisterPerfId()
          {m_idTransform = MSR_REGISTER(TEXT("Transform"));}
-#endif // PERF
 
 
 // implementation details
 
 protected:
 
-#ifdef PERF
     int m_idTransform;                 // performance measuring id
-#endif
     BOOL m_bEOSDelivered;              // have we sent EndOfStream
     BOOL m_bSampleSkipped;             // Did we just skip a frame
     BOOL m_bQualityChanged;            // Have we degraded?
@@ -291,6 +380,31 @@ protected:
 
     CCritSec m_csReceive;
 
+    // views for zero-copy forwarding - NULL unless forwarding is enabled
+    CSampleViewAllocator *m_pViewAllocator;
+
+    // the buffers we copy into when downstream has agreed to take the
+    // views - NULL unless it has, when the output allocator is the views
+    IMemAllocator *m_pCopyAllocator;
+
+    // threads for TransformSlices - NULL unless slicing is enabled
+    CAMWorkerPool *m_pSlicePool;
+
+    // queue and threads for pipelining - NULL unless it is enabled
+    friend class CTransformPipeline;
+    CTransformPipeline *m_pPipeline;
+
+    // For a Receive override when m_pPipeline is set - queue pOut to be
+    // transformed from pIn and delivered, taking over the reference on
+    // pOut. With bHold it is transformed but not delivered
+    HRESULT PipelineReceive(IMediaSample *pIn, IMediaSample *pOut, BOOL bHold = FALSE);
+
+    // wait until everything queued has been delivered
+    void PipelineDrain();
+
+    // copy the input sample's properties to the output sample
+    void CopySampleProperties(IMediaSample *pSample, IMediaSample *pOutSample);
+
     // these hold our input and output pins
 
     friend class CTransformInputPin;
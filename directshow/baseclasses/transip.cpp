@@ -270,9 +270,7 @@ CTransInPlaceFilter::CTransInPlaceFilter
    : CTransformFilter(pName, pUnk, clsid),
      m_bModifiesData(bModifiesData)
 {
-#ifdef PERF
     RegisterPerfId();
-#endif //  PERF
 
 } // constructor
 
@@ -287,9 +285,7 @@ CTransInPlaceFilter::CTransInPlaceFilter
    : CTransformFilter(pName, pUnk, clsid),
      m_bModifiesData(bModifiesData)
 {
-#ifdef PERF
     RegisterPerfId();
-#endif //  PERF
 
 } // constructor
 #endif
@@ -542,6 +538,11 @@ __out_opt IMediaSample * CTransInPlaceFilter::Copy(IMediaSample *pSource)
         pDest->SetMediaTime(&TimeStart,&TimeEnd);
     }
 
+    // and the latency stamps, if we are keeping them
+    if (CAMLatency::IsEnabled()) {
+        CAMLatency::CopyStamps(pSource, pDest);
+    }
+
     // Copy the actual data length and the actual data.
     {
         const long lDataLength = pSource->GetActualDataLength();
@@ -567,7 +568,8 @@ __out_opt IMediaSample * CTransInPlaceFilter::Copy(IMediaSample *pSource)
             }
             ASSERT(lDestSize == 0 || pSourceBuffer != NULL && pDestBuffer != NULL);
 
-            CopyMemory( (PVOID) pDestBuffer, (PVOID) pSourceBuffer, lDataLength );
+            // Transform works on the copy next, so keep it in the cache
+            CAMMemCopy::CopyCached( (PVOID) pDestBuffer, (PVOID) pSourceBuffer, lDataLength );
         }
     }
 
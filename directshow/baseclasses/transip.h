@@ -199,12 +199,10 @@ public:
     // static CCOMObject * CreateInstance(LPUNKNOWN, HRESULT *);
 
 
-#ifdef PERF
     // Override to register performance measurement with a less generic string
     // You should do this to avoid confusion with other filters
     virtual void RegisterPerfId()
          {m_idTransInPlace = MSR_REGISTER(TEXT("TransInPlace"));}
-#endif // PERF
 
 
 // implementation details
@@ -213,9 +211,7 @@ protected:
 
     __out_opt IMediaSample * CTransInPlaceFilter::Copy(IMediaSample *pSource);
 
-#ifdef PERF
     int m_idTransInPlace;                 // performance measuring id
-#endif // PERF
     bool  m_bModifiesData;                // Does this filter change the data?
 
     // these hold our input and output pins
@@ -0,0 +1,1007 @@
+//------------------------------------------------------------------------------
+// File: VConvert.cpp
+//
+// Desc: DirectShow base classes - implements CAMVideoConverter and
+//       CConvertVideoFilter.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#include <streams.h>
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <immintrin.h>
+#define AM_VCONVERT_SIMD
+#endif
+
+// where the bytes of a pair of pixels are - Y0, U, Y1, V
+#define YUY2_ORDER  0, 1, 2, 3
+#define UYVY_ORDER  1, 0, 3, 2
+
+
+//=====================================================================
+// Reference implementations
+//
+// BT.601 with 8 bits of fraction. The SIMD versions below do exactly the
+// same sums, so must be changed along with these
+//=====================================================================
+
+static inline BYTE
+Clip(int i)
+{
+    return (BYTE) (i < 0 ? 0 : i > 255 ? 255 : i);
+}
+
+static inline void
+YUVToBGR(int y, int u, int v, __out_ecount(3) BYTE *pBGR)
+{
+    int c = 298 * (y - 16);
+    int d = u - 128;
+    int e = v - 128;
+    pBGR[0] = Clip((c + 516 * d + 128) >> 8);
+    pBGR[1] = Clip((c - 100 * d - 208 * e + 128) >> 8);
+    pBGR[2] = Clip((c + 409 * e + 128) >> 8);
+}
+
+static inline BYTE
+RGBToY(int r, int g, int b)
+{
+    return (BYTE) (((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+static inline BYTE
+RGBToU(int r, int g, int b)
+{
+    return (BYTE) (((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+}
+
+static inline BYTE
+RGBToV(int r, int g, int b)
+{
+    return (BYTE) (((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+// single row conversions - RGB32 is written with an opaque alpha byte
+
+template <int iY0, int iU, int iY1, int iV, int cbPixel>
+static void
+PackedYUVToRGBRow_C(const BYTE *pSrc, BYTE *pDst, LONG lWidth)
+{
+    for (LONG x = 0; x < lWidth; x += 2, pSrc += 4, pDst += 2 * cbPixel) {
+        YUVToBGR(pSrc[iY0], pSrc[iU], pSrc[iV], pDst);
+        YUVToBGR(pSrc[iY1], pSrc[iU], pSrc[iV], pDst + cbPixel);
+        if (cbPixel == 4) {
+            pDst[3] = 0xFF;
+            pDst[7] = 0xFF;
+        }
+    }
+}
+
+template <int cbPixel>
+static void
+NV12ToRGBRow_C(const BYTE *pY, const BYTE *pUV, BYTE *pDst, LONG lWidth)
+{
+    for (LONG x = 0; x < lWidth; x += 2, pY += 2, pUV += 2, pDst += 2 * cbPixel) {
+        YUVToBGR(pY[0], pUV[0], pUV[1], pDst);
+        YUVToBGR(pY[1], pUV[0], pUV[1], pDst + cbPixel);
+        if (cbPixel == 4) {
+            pDst[3] = 0xFF;
+            pDst[7] = 0xFF;
+        }
+    }
+}
+
+template <int iY0, int iU, int iY1, int iV>
+static void
+NV12ToPackedYUVRow_C(const BYTE *pY, const BYTE *pUV, BYTE *pDst, LONG lWidth)
+{
+    for (LONG x = 0; x < lWidth; x += 2, pY += 2, pUV += 2, pDst += 4) {
+        pDst[iY0] = pY[0];
+        pDst[iY1] = pY[1];
+        pDst[iU] = pUV[0];
+        pDst[iV] = pUV[1];
+    }
+}
+
+// YUY2 <-> UYVY - the same either way
+static void
+SwapYUVRow_C(const BYTE *pSrc, BYTE *pDst, LONG lWidth)
+{
+    for (LONG x = 0; x < lWidth; x++, pSrc += 2, pDst += 2) {
+        BYTE b = pSrc[0];
+        pDst[0] = pSrc[1];
+        pDst[1] = b;
+    }
+}
+
+template <int cbSrc, int cbDst>
+static void
+RGBToRGBRow_C(const BYTE *pSrc, BYTE *pDst, LONG lWidth)
+{
+    for (LONG x = 0; x < lWidth; x++, pSrc += cbSrc, pDst += cbDst) {
+        pDst[0] = pSrc[0];
+        pDst[1] = pSrc[1];
+        pDst[2] = pSrc[2];
+        if (cbDst == 4) {
+            pDst[3] = 0xFF;
+        }
+    }
+}
+
+// each chroma sample is taken from the average of the pair of pixels
+template <int iY0, int iU, int iY1, int iV, int cbPixel>
+static void
+RGBToPackedYUVRow_C(const BYTE *pSrc, BYTE *pDst, LONG lWidth)
+{
+    for (LONG x = 0; x < lWidth; x += 2, pSrc += 2 * cbPixel, pDst += 4) {
+        const BYTE *p0 = pSrc;
+        const BYTE *p1 = pSrc + cbPixel;
+        int b = (p0[0] + p1[0] + 1) >> 1;
+        int g = (p0[1] + p1[1] + 1) >> 1;
+        int r = (p0[2] + p1[2] + 1) >> 1;
+        pDst[iY0] = RGBToY(p0[2], p0[1], p0[0]);
+        pDst[iY1] = RGBToY(p1[2], p1[1], p1[0]);
+        pDst[iU] = RGBToU(r, g, b);
+        pDst[iV] = RGBToV(r, g, b);
+    }
+}
+
+template <int cbPixel>
+static void
+CopyRow(const BYTE *pSrc, BYTE *pDst, LONG lWidth)
+{
+    CAMMemCopy::Copy(pDst, pSrc, lWidth * cbPixel);
+}
+
+// adapters from the row functions to CAMVideoConverter::PCONVERTROWS
+
+typedef void (*PROW)(const BYTE *pSrc, BYTE *pDst, LONG lWidth);
+typedef void (*PNV12ROW)(const BYTE *pY, const BYTE *pUV, BYTE *pDst, LONG lWidth);
+
+template <PROW pfnRow>
+static void
+Rows(const BYTE * const *ppSrc, BYTE * const *ppDst, LONG lWidth)
+{
+    pfnRow(ppSrc[0], ppDst[0], lWidth);
+}
+
+template <PNV12ROW pfnRow>
+static void
+FromNV12Rows(const BYTE * const *ppSrc, BYTE * const *ppDst, LONG lWidth)
+{
+    pfnRow(ppSrc[0], ppSrc[2], ppDst[0], lWidth);
+    pfnRow(ppSrc[1], ppSrc[2], ppDst[1], lWidth);
+}
+
+// the chroma of each pair of rows is averaged down to one
+template <int iY0, int iU, int iY1, int iV>
+static void
+PackedYUVToNV12Rows_C(const BYTE * const *ppSrc, BYTE * const *ppDst, LONG lWidth)
+{
+    const BYTE *pSrc0 = ppSrc[0];
+    const BYTE *pSrc1 = ppSrc[1];
+    BYTE *pY0 = ppDst[0];
+    BYTE *pY1 = ppDst[1];
+    BYTE *pUV = ppDst[2];
+
+    for (LONG x = 0; x < lWidth; x += 2) {
+        pY0[0] = pSrc0[iY0];
+        pY0[1] = pSrc0[iY1];
+        pY1[0] = pSrc1[iY0];
+        pY1[1] = pSrc1[iY1];
+        pUV[0] = (BYTE) ((pSrc0[iU] + pSrc1[iU] + 1) >> 1);
+        pUV[1] = (BYTE) ((pSrc0[iV] + pSrc1[iV] + 1) >> 1);
+        pSrc0 += 4;
+        pSrc1 += 4;
+        pY0 += 2;
+        pY1 += 2;
+        pUV += 2;
+    }
+}
+
+static void
+CopyNV12Rows(const BYTE * const *ppSrc, BYTE * const *ppDst, LONG lWidth)
+{
+    CAMMemCopy::Copy(ppDst[0], ppSrc[0], lWidth);
+    CAMMemCopy::Copy(ppDst[1], ppSrc[1], lWidth);
+    CAMMemCopy::Copy(ppDst[2], ppSrc[2], lWidth);
+}
+
+
+#ifdef AM_VCONVERT_SIMD
+
+//=====================================================================
+// SSE2 and AVX2 implementations
+//
+// Each does as many pixels as it can in whole blocks then leaves the
+// rest to the reference version
+//=====================================================================
+
+// a pair of 16 bit coefficients for madd
+#define COEFF_PAIR(a, b)    ((int) (((unsigned) (unsigned short) (b) << 16) | (unsigned short) (a)))
+
+/* Convert 8 pixels. Y holds their luma and UV their chroma, U0 V0 U1 V1 ...
+   as 16 bit values, with each chroma pair covering two pixels. Each madd
+   does two terms of a sum for one pixel, and the rounding constant is
+   folded into the last of the green ones */
+
+static inline void
+YUVToRGB32_SSE2(__m128i Y, __m128i UV, __out_ecount(32) BYTE *pDst)
+{
+    const __m128i k128 = _mm_set1_epi16(128);
+    const __m128i kRound = _mm_set1_epi32(128);
+
+    __m128i C = _mm_sub_epi16(Y, _mm_set1_epi16(16));
+    UV = _mm_sub_epi16(UV, k128);
+
+    // spread each U and each V over the two pixels it covers
+    __m128i D = _mm_and_si128(UV, _mm_set1_epi32(0xFFFF));
+    __m128i E = _mm_srli_epi32(UV, 16);
+    D = _mm_or_si128(D, _mm_slli_epi32(D, 16));
+    E = _mm_or_si128(E, _mm_slli_epi32(E, 16));
+
+    __m128i CDlo = _mm_unpacklo_epi16(C, D);
+    __m128i CDhi = _mm_unpackhi_epi16(C, D);
+    __m128i CElo = _mm_unpacklo_epi16(C, E);
+    __m128i CEhi = _mm_unpackhi_epi16(C, E);
+    __m128i E1lo = _mm_unpacklo_epi16(E, k128);
+    __m128i E1hi = _mm_unpackhi_epi16(E, k128);
+
+    const __m128i kB = _mm_set1_epi32(COEFF_PAIR(298, 516));
+    const __m128i kG1 = _mm_set1_epi32(COEFF_PAIR(298, -100));
+    const __m128i kG2 = _mm_set1_epi32(COEFF_PAIR(-208, 1));
+    const __m128i kR = _mm_set1_epi32(COEFF_PAIR(298, 409));
+
+    __m128i B = _mm_packs_epi32(
+        _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(CDlo, kB), kRound), 8),
+        _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(CDhi, kB), kRound), 8));
+    __m128i G = _mm_packs_epi32(
+        _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(CDlo, kG1), _mm_madd_epi16(E1lo, kG2)), 8),
+        _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(CDhi, kG1), _mm_madd_epi16(E1hi, kG2)), 8));
+    __m128i R = _mm_packs_epi32(
+        _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(CElo, kR), kRound), 8),
+        _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(CEhi, kR), kRound), 8));
+
+    // saturating to bytes does the clipping
+    __m128i BR = _mm_packus_epi16(B, R);
+    __m128i GA = _mm_packus_epi16(G, _mm_set1_epi16(0xFF));
+    __m128i BG = _mm_unpacklo_epi8(BR, GA);
+    __m128i RA = _mm_unpackhi_epi8(BR, GA);
+    _mm_storeu_si128((__m128i *) pDst, _mm_unpacklo_epi16(BG, RA));
+    _mm_storeu_si128((__m128i *) pDst + 1, _mm_unpackhi_epi16(BG, RA));
+}
+
+static void
+YUY2ToRGB32Row_SSE2(const BYTE *pSrc, BYTE *pDst, LONG lWidth)
+{
+    const __m128i kLow = _mm_set1_epi16(0xFF);
+    LONG x = 0;
+    for (; x + 8 <= lWidth; x += 8, pSrc += 16, pDst += 32) {
+        __m128i P = _mm_loadu_si128((const __m128i *) pSrc);
+        YUVToRGB32_SSE2(_mm_and_si128(P, kLow), _mm_srli_epi16(P, 8), pDst);
+    }
+    PackedYUVToRGBRow_C<YUY2_ORDER, 4>(pSrc, pDst, lWidth - x);
+}
+
+static void
+UYVYToRGB32Row_SSE2(const BYTE *pSrc, BYTE *pDst, LONG lWidth)
+{
+    const __m128i kLow = _mm_set1_epi16(0xFF);
+    LONG x = 0;
+    for (; x + 8 <= lWidth; x += 8, pSrc += 16, pDst += 32) {
+        __m128i P = _mm_loadu_si128((const __m128i *) pSrc);
+        YUVToRGB32_SSE2(_mm_srli_epi16(P, 8), _mm_and_si128(P, kLow), pDst);
+    }
+    PackedYUVToRGBRow_C<UYVY_ORDER, 4>(pSrc, pDst, lWidth - x);
+}
+
+static void
+NV12ToRGB32Row_SSE2(const BYTE *pY, const BYTE *pUV, BYTE *pDst, LONG lWidth)
+{
+    const __m128i kZero = _mm_setzero_si128();
+    LONG x = 0;
+    for (; x + 8 <= lWidth; x += 8, pY += 8, pUV += 8, pDst += 32) {
+        __m128i Y = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) pY), kZero);
+        __m128i UV = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) pUV), kZero);
+        YUVToRGB32_SSE2(Y, UV, pDst);
+    }
+    NV12ToRGBRow_C<4>(pY, pUV, pDst, lWidth - x);
+}
+
+static void
+SwapYUVRow_SSE2(const BYTE *pSrc, BYTE *pDst, LONG lWidth)
+{
+    LONG x = 0;
+    for (; x + 8 <= lWidth; x += 8, pSrc += 16, pDst += 16) {
+        __m128i P = _mm_loadu_si128((const __m128i *) pSrc);
+        _mm_storeu_si128((__m128i *) pDst,
+                         _mm_or_si128(_mm_slli_epi16(P, 8), _mm_srli_epi16(P, 8)));
+    }
+    SwapYUVRow_C(pSrc, pDst, lWidth - x);
+}
+
+/* As YUVToRGB32_SSE2 for 16 pixels - 0 to 7 in the low half of Y and UV and
+   8 to 15 in the high half. Everything but the final stores stays within
+   each half */
+
+static inline void
+YUVToRGB32_AVX2(__m256i Y, __m256i UV, __out_ecount(64) BYTE *pDst)
+{
+    const __m256i k128 = _mm256_set1_epi16(128);
+    const __m256i kRound = _mm256_set1_epi32(128);
+
+    __m256i C = _mm256_sub_epi16(Y, _mm256_set1_epi16(16));
+    UV = _mm256_sub_epi16(UV, k128);
+
+    __m256i D = _mm256_and_si256(UV, _mm256_set1_epi32(0xFFFF));
+    __m256i E = _mm256_srli_epi32(UV, 16);
+    D = _mm256_or_si256(D, _mm256_slli_epi32(D, 16));
+    E = _mm256_or_si256(E, _mm256_slli_epi32(E, 16));
+
+    __m256i CDlo = _mm256_unpacklo_epi16(C, D);
+    __m256i CDhi = _mm256_unpackhi_epi16(C, D);
+    __m256i CElo = _mm256_unpacklo_epi16(C, E);
+    __m256i CEhi = _mm256_unpackhi_epi16(C, E);
+    __m256i E1lo = _mm256_unpacklo_epi16(E, k128);
+    __m256i E1hi = _mm256_unpackhi_epi16(E, k128);
+
+    const __m256i kB = _mm256_set1_epi32(COEFF_PAIR(298, 516));
+    const __m256i kG1 = _mm256_set1_epi32(COEFF_PAIR(298, -100));
+    const __m256i kG2 = _mm256_set1_epi32(COEFF_PAIR(-208, 1));
+    const __m256i kR = _mm256_set1_epi32(COEFF_PAIR(298, 409));
+
+    __m256i B = _mm256_packs_epi32(
+        _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(CDlo, kB), kRound), 8),
+        _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(CDhi, kB), kRound), 8));
+    __m256i G = _mm256_packs_epi32(
+        _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(CDlo, kG1), _mm256_madd_epi16(E1lo, kG2)), 8),
+        _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(CDhi, kG1), _mm256_madd_epi16(E1hi, kG2)), 8));
+    __m256i R = _mm256_packs_epi32(
+        _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(CElo, kR), kRound), 8),
+        _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(CEhi, kR), kRound), 8));
+
+    __m256i BR = _mm256_packus_epi16(B, R);
+    __m256i GA = _mm256_packus_epi16(G, _mm256_set1_epi16(0xFF));
+    __m256i BG = _mm256_unpacklo_epi8(BR, GA);
+    __m256i RA = _mm256_unpackhi_epi8(BR, GA);
+    __m256i Lo = _mm256_unpacklo_epi16(BG, RA);     // pixels 0-3, 8-11
+    __m256i Hi = _mm256_unpackhi_epi16(BG, RA);     // pixels 4-7, 12-15
+    _mm256_storeu_si256((__m256i *) pDst, _mm256_permute2x128_si256(Lo, Hi, 0x20));
+    _mm256_storeu_si256((__m256i *) pDst + 1, _mm256_permute2x128_si256(Lo, Hi, 0x31));
+}
+
+static void
+YUY2ToRGB32Row_AVX2(const BYTE *pSrc, BYTE *pDst, LONG lWidth)
+{
+    const __m256i kLow = _mm256_set1_epi16(0xFF);
+    LONG x = 0;
+    for (; x + 16 <= lWidth; x += 16, pSrc += 32, pDst += 64) {
+        __m256i P = _mm256_loadu_si256((const __m256i *) pSrc);
+        YUVToRGB32_AVX2(_mm256_and_si256(P, kLow), _mm256_srli_epi16(P, 8), pDst);
+    }
+    _mm256_zeroupper();
+    PackedYUVToRGBRow_C<YUY2_ORDER, 4>(pSrc, pDst, lWidth - x);
+}
+
+static void
+UYVYToRGB32Row_AVX2(const BYTE *pSrc, BYTE *pDst, LONG lWidth)
+{
+    const __m256i kLow = _mm256_set1_epi16(0xFF);
+    LONG x = 0;
+    for (; x + 16 <= lWidth; x += 16, pSrc += 32, pDst += 64) {
+        __m256i P = _mm256_loadu_si256((const __m256i *) pSrc);
+        YUVToRGB32_AVX2(_mm256_srli_epi16(P, 8), _mm256_and_si256(P, kLow), pDst);
+    }
+    _mm256_zeroupper();
+    PackedYUVToRGBRow_C<UYVY_ORDER, 4>(pSrc, pDst, lWidth - x);
+}
+
+static void
+NV12ToRGB32Row_AVX2(const BYTE *pY, const BYTE *pUV, BYTE *pDst, LONG lWidth)
+{
+    LONG x = 0;
+    for (; x + 16 <= lWidth; x += 16, pY += 16, pUV += 16, pDst += 64) {
+        __m256i Y = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) pY));
+        __m256i UV = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) pUV));
+        YUVToRGB32_AVX2(Y, UV, pDst);
+    }
+    _mm256_zeroupper();
+    NV12ToRGBRow_C<4>(pY, pUV, pDst, lWidth - x);
+}
+
+static void
+SwapYUVRow_AVX2(const BYTE *pSrc, BYTE *pDst, LONG lWidth)
+{
+    LONG x = 0;
+    for (; x + 16 <= lWidth; x += 16, pSrc += 32, pDst += 32) {
+        __m256i P = _mm256_loadu_si256((const __m256i *) pSrc);
+        _mm256_storeu_si256((__m256i *) pDst,
+                            _mm256_or_si256(_mm256_slli_epi16(P, 8), _mm256_srli_epi16(P, 8)));
+    }
+    _mm256_zeroupper();
+    SwapYUVRow_C(pSrc, pDst, lWidth - x);
+}
+
+#define SSE2_ROWS(fn)       Rows<fn>
+#define AVX2_ROWS(fn)       Rows<fn>
+#define SSE2_NV12ROWS(fn)   FromNV12Rows<fn>
+#define AVX2_NV12ROWS(fn)   FromNV12Rows<fn>
+
+#else
+
+#define SSE2_ROWS(fn)       NULL
+#define AVX2_ROWS(fn)       NULL
+#define SSE2_NV12ROWS(fn)   NULL
+#define AVX2_NV12ROWS(fn)   NULL
+
+#endif // AM_VCONVERT_SIMD
+
+
+//=====================================================================
+// Implements CAMVideoConverter
+//=====================================================================
+
+const CAMVideoConverter::CFormat CAMVideoConverter::m_aFormats[] = {
+    { &MEDIASUBTYPE_YUY2,   MAKEFOURCC('Y','U','Y','2'),    16, FALSE,  FALSE },
+    { &MEDIASUBTYPE_UYVY,   MAKEFOURCC('U','Y','V','Y'),    16, FALSE,  FALSE },
+    { &MEDIASUBTYPE_NV12,   MAKEFOURCC('N','V','1','2'),    12, TRUE,   FALSE },
+    { &MEDIASUBTYPE_RGB32,  BI_RGB,                         32, FALSE,  TRUE  },
+    { &MEDIASUBTYPE_RGB24,  BI_RGB,                         24, FALSE,  TRUE  }
+};
+
+/* For each input subtype, the outputs in the order GetDestination offers
+   them - converting to the same subtype just copies, so it comes last */
+
+const CAMVideoConverter::CConversion CAMVideoConverter::m_aConversions[] = {
+    { &MEDIASUBTYPE_YUY2, &MEDIASUBTYPE_RGB32,
+      { Rows< PackedYUVToRGBRow_C<YUY2_ORDER, 4> >,
+        SSE2_ROWS(YUY2ToRGB32Row_SSE2),
+        AVX2_ROWS(YUY2ToRGB32Row_AVX2) } },
+    { &MEDIASUBTYPE_YUY2, &MEDIASUBTYPE_RGB24,
+      { Rows< PackedYUVToRGBRow_C<YUY2_ORDER, 3> >, NULL, NULL } },
+    { &MEDIASUBTYPE_YUY2, &MEDIASUBTYPE_UYVY,
+      { Rows<SwapYUVRow_C>,
+        SSE2_ROWS(SwapYUVRow_SSE2),
+        AVX2_ROWS(SwapYUVRow_AVX2) } },
+    { &MEDIASUBTYPE_YUY2, &MEDIASUBTYPE_NV12,
+      { PackedYUVToNV12Rows_C<YUY2_ORDER>, NULL, NULL } },
+    { &MEDIASUBTYPE_YUY2, &MEDIASUBTYPE_YUY2,
+      { Rows< CopyRow<2> >, NULL, NULL } },
+
+    { &MEDIASUBTYPE_UYVY, &MEDIASUBTYPE_RGB32,
+      { Rows< PackedYUVToRGBRow_C<UYVY_ORDER, 4> >,
+        SSE2_ROWS(UYVYToRGB32Row_SSE2),
+        AVX2_ROWS(UYVYToRGB32Row_AVX2) } },
+    { &MEDIASUBTYPE_UYVY, &MEDIASUBTYPE_RGB24,
+      { Rows< PackedYUVToRGBRow_C<UYVY_ORDER, 3> >, NULL, NULL } },
+    { &MEDIASUBTYPE_UYVY, &MEDIASUBTYPE_YUY2,
+      { Rows<SwapYUVRow_C>,
+        SSE2_ROWS(SwapYUVRow_SSE2),
+        AVX2_ROWS(SwapYUVRow_AVX2) } },
+    { &MEDIASUBTYPE_UYVY, &MEDIASUBTYPE_NV12,
+      { PackedYUVToNV12Rows_C<UYVY_ORDER>, NULL, NULL } },
+    { &MEDIASUBTYPE_UYVY, &MEDIASUBTYPE_UYVY,
+      { Rows< CopyRow<2> >, NULL, NULL } },
+
+    { &MEDIASUBTYPE_NV12, &MEDIASUBTYPE_RGB32,
+      { FromNV12Rows< NV12ToRGBRow_C<4> >,
+        SSE2_NV12ROWS(NV12ToRGB32Row_SSE2),
+        AVX2_NV12ROWS(NV12ToRGB32Row_AVX2) } },
+    { &MEDIASUBTYPE_NV12, &MEDIASUBTYPE_RGB24,
+      { FromNV12Rows< NV12ToRGBRow_C<3> >, NULL, NULL } },
+    { &MEDIASUBTYPE_NV12, &MEDIASUBTYPE_YUY2,
+      { FromNV12Rows< NV12ToPackedYUVRow_C<YUY2_ORDER> >, NULL, NULL } },
+    { &MEDIASUBTYPE_NV12, &MEDIASUBTYPE_UYVY,
+      { FromNV12Rows< NV12ToPackedYUVRow_C<UYVY_ORDER> >, NULL, NULL } },
+    { &MEDIASUBTYPE_NV12, &MEDIASUBTYPE_NV12,
+      { CopyNV12Rows, NULL, NULL } },
+
+    { &MEDIASUBTYPE_RGB32, &MEDIASUBTYPE_RGB24,
+      { Rows< RGBToRGBRow_C<4, 3> >, NULL, NULL } },
+    { &MEDIASUBTYPE_RGB32, &MEDIASUBTYPE_YUY2,
+      { Rows< RGBToPackedYUVRow_C<YUY2_ORDER, 4> >, NULL, NULL } },
+    { &MEDIASUBTYPE_RGB32, &MEDIASUBTYPE_UYVY,
+      { Rows< RGBToPackedYUVRow_C<UYVY_ORDER, 4> >, NULL, NULL } },
+    { &MEDIASUBTYPE_RGB32, &MEDIASUBTYPE_RGB32,
+      { Rows< CopyRow<4> >, NULL, NULL } },
+
+    { &MEDIASUBTYPE_RGB24, &MEDIASUBTYPE_RGB32,
+      { Rows< RGBToRGBRow_C<3, 4> >, NULL, NULL } },
+    { &MEDIASUBTYPE_RGB24, &MEDIASUBTYPE_YUY2,
+      { Rows< RGBToPackedYUVRow_C<YUY2_ORDER, 3> >, NULL, NULL } },
+    { &MEDIASUBTYPE_RGB24, &MEDIASUBTYPE_UYVY,
+      { Rows< RGBToPackedYUVRow_C<UYVY_ORDER, 3> >, NULL, NULL } },
+    { &MEDIASUBTYPE_RGB24, &MEDIASUBTYPE_RGB24,
+      { Rows< CopyRow<3> >, NULL, NULL } }
+};
+
+
+CAMVideoConverter::CAMVideoConverter() :
+    m_lWidth(0),
+    m_lHeight(0),
+    m_pfnConvert(NULL),
+    m_Level(AM_VCONVERT_SCALAR),
+    m_cRows(1)
+{
+    ZeroMemory(&m_Src, sizeof(m_Src));
+    ZeroMemory(&m_Dst, sizeof(m_Dst));
+}
+
+// CAMMemCopy has already asked the processor and OS what they support
+
+AM_VCONVERT_LEVEL
+CAMVideoConverter::GetProcessorLevel()
+{
+    switch (CAMMemCopy::GetBestKernel()) {
+    case AM_COPY_KERNEL_AVX512:
+    case AM_COPY_KERNEL_AVX2:
+        return AM_VCONVERT_AVX2;
+    case AM_COPY_KERNEL_SSE2:
+        return AM_VCONVERT_SSE2;
+    default:
+        return AM_VCONVERT_SCALAR;
+    }
+}
+
+const CAMVideoConverter::CConversion *
+CAMVideoConverter::FindConversion(const GUID *pSrcSubtype, const GUID *pDstSubtype)
+{
+    for (int i = 0; i < NUMELMS(m_aConversions); i++) {
+        if (IsEqualGUID(*m_aConversions[i].pSrcSubtype, *pSrcSubtype) &&
+            IsEqualGUID(*m_aConversions[i].pDstSubtype, *pDstSubtype)) {
+            return &m_aConversions[i];
+        }
+    }
+    return NULL;
+}
+
+BOOL
+CAMVideoConverter::CanConvert(const GUID *pSrcSubtype, const GUID *pDstSubtype)
+{
+    CheckPointer(pSrcSubtype, FALSE);
+    CheckPointer(pDstSubtype, FALSE);
+    return FindConversion(pSrcSubtype, pDstSubtype) != NULL;
+}
+
+const GUID *
+CAMVideoConverter::GetDestination(const GUID *pSrcSubtype, int iPosition)
+{
+    CheckPointer(pSrcSubtype, NULL);
+    for (int i = 0; i < NUMELMS(m_aConversions); i++) {
+        if (IsEqualGUID(*m_aConversions[i].pSrcSubtype, *pSrcSubtype)) {
+            if (iPosition-- == 0) {
+                return m_aConversions[i].pDstSubtype;
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Packed rows are DWORD aligned as for any DIB. NV12's chroma plane
+   follows its luma plane, with the same stride and half as many rows */
+
+HRESULT
+CAMVideoConverter::GetLayout(const AM_MEDIA_TYPE *pmt, __out CLayout *pLayout)
+{
+    CheckPointer(pmt, E_POINTER);
+    CheckPointer(pLayout, E_POINTER);
+
+    if (pmt->majortype != MEDIATYPE_Video || pmt->pbFormat == NULL) {
+        return VFW_E_TYPE_NOT_ACCEPTED;
+    }
+
+    const BITMAPINFOHEADER *pbmi;
+    if (pmt->formattype == FORMAT_VideoInfo &&
+        pmt->cbFormat >= sizeof(VIDEOINFOHEADER)) {
+        pbmi = HEADER(pmt->pbFormat);
+    } else if (pmt->formattype == FORMAT_VideoInfo2 &&
+               pmt->cbFormat >= sizeof(VIDEOINFOHEADER2)) {
+        pbmi = &((VIDEOINFOHEADER2 *) pmt->pbFormat)->bmiHeader;
+    } else {
+        return VFW_E_TYPE_NOT_ACCEPTED;
+    }
+
+    const CFormat *pFormat = NULL;
+    for (int i = 0; i < NUMELMS(m_aFormats); i++) {
+        if (IsEqualGUID(*m_aFormats[i].pSubtype, pmt->subtype)) {
+            pFormat = &m_aFormats[i];
+            break;
+        }
+    }
+    if (pFormat == NULL ||
+        pbmi->biCompression != pFormat->dwCompression ||
+        pbmi->biBitCount != pFormat->wBitCount) {
+        return VFW_E_TYPE_NOT_ACCEPTED;
+    }
+
+    LONG lWidth = pbmi->biWidth;
+    LONG lHeight = abs(pbmi->biHeight);
+    if (lWidth <= 0 || lHeight <= 0) {
+        return VFW_E_TYPE_NOT_ACCEPTED;
+    }
+
+    // YUV chroma covers pairs of pixels, and NV12's pairs of rows too
+    if (!pFormat->bRGB && (lWidth & 1)) {
+        return VFW_E_TYPE_NOT_ACCEPTED;
+    }
+    if (pFormat->bPlanar && (lHeight & 1)) {
+        return VFW_E_TYPE_NOT_ACCEPTED;
+    }
+
+    LONGLONG llStride = pFormat->bPlanar ? lWidth : DIBWIDTHBYTES(*pbmi);
+    LONGLONG llSize = llStride * lHeight;
+    if (pFormat->bPlanar) {
+        llSize += llSize / 2;
+    }
+    if (llSize > LONG_MAX) {
+        return VFW_E_TYPE_NOT_ACCEPTED;
+    }
+
+    pLayout->pFormat = pFormat;
+    pLayout->lWidth = lWidth;
+    pLayout->lHeight = lHeight;
+    pLayout->lStride = (LONG) llStride;
+    pLayout->bBottomUp = pFormat->bRGB && pbmi->biHeight > 0;
+    pLayout->lSize = (LONG) llSize;
+    return S_OK;
+}
+
+// RGB images come out bottom-up, the usual way round for DIBs
+
+HRESULT
+CAMVideoConverter::InitBitmapInfoHeader(
+    const GUID *pSubtype,
+    LONG lWidth,
+    LONG lHeight,
+    __out BITMAPINFOHEADER *pbmi)
+{
+    CheckPointer(pSubtype, E_POINTER);
+    CheckPointer(pbmi, E_POINTER);
+
+    const CFormat *pFormat = NULL;
+    for (int i = 0; i < NUMELMS(m_aFormats); i++) {
+        if (IsEqualGUID(*m_aFormats[i].pSubtype, *pSubtype)) {
+            pFormat = &m_aFormats[i];
+            break;
+        }
+    }
+    if (pFormat == NULL) {
+        return VFW_E_TYPE_NOT_ACCEPTED;
+    }
+
+    ZeroMemory(pbmi, sizeof(BITMAPINFOHEADER));
+    pbmi->biSize = sizeof(BITMAPINFOHEADER);
+    pbmi->biWidth = lWidth;
+    pbmi->biHeight = lHeight;
+    pbmi->biPlanes = 1;
+    pbmi->biBitCount = pFormat->wBitCount;
+    pbmi->biCompression = pFormat->dwCompression;
+
+    // let GetLayout check it and work out the size
+    AM_MEDIA_TYPE mt;
+    VIDEOINFOHEADER vih;
+    ZeroMemory(&mt, sizeof(mt));
+    ZeroMemory(&vih, sizeof(vih));
+    vih.bmiHeader = *pbmi;
+    mt.majortype = MEDIATYPE_Video;
+    mt.subtype = *pSubtype;
+    mt.formattype = FORMAT_VideoInfo;
+    mt.cbFormat = sizeof(vih);
+    mt.pbFormat = (BYTE *) &vih;
+
+    CLayout Layout;
+    HRESULT hr = GetLayout(&mt, &Layout);
+    if (FAILED(hr)) {
+        return hr;
+    }
+    pbmi->biSizeImage = Layout.lSize;
+    return S_OK;
+}
+
+HRESULT
+CAMVideoConverter::Initialize(
+    const AM_MEDIA_TYPE *pmtIn,
+    const AM_MEDIA_TYPE *pmtOut,
+    AM_VCONVERT_LEVEL Level)
+{
+    m_pfnConvert = NULL;
+
+    if (Level < AM_VCONVERT_SCALAR || Level > AM_VCONVERT_BEST) {
+        return E_INVALIDARG;
+    }
+
+    CLayout Src, Dst;
+    HRESULT hr = GetLayout(pmtIn, &Src);
+    if (FAILED(hr)) {
+        return hr;
+    }
+    hr = GetLayout(pmtOut, &Dst);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    const CConversion *pConversion = FindConversion(Src.pFormat->pSubtype,
+                                                    Dst.pFormat->pSubtype);
+    if (pConversion == NULL) {
+        return VFW_E_TYPE_NOT_ACCEPTED;
+    }
+
+    // the part both have must still be whole chroma samples
+    LONG lWidth = min(Src.lWidth, Dst.lWidth);
+    LONG lHeight = min(Src.lHeight, Dst.lHeight);
+    LONG cRows = (Src.pFormat->bPlanar || Dst.pFormat->bPlanar) ? 2 : 1;
+    if ((lWidth & 1) && !(Src.pFormat->bRGB && Dst.pFormat->bRGB)) {
+        return VFW_E_TYPE_NOT_ACCEPTED;
+    }
+    if (lHeight % cRows) {
+        return VFW_E_TYPE_NOT_ACCEPTED;
+    }
+
+    // the best we are allowed that we have
+    int iLevel = min(Level, GetProcessorLevel());
+    while (pConversion->apfnConvert[iLevel] == NULL) {
+        iLevel--;
+    }
+
+    m_Src = Src;
+    m_Dst = Dst;
+    m_lWidth = lWidth;
+    m_lHeight = lHeight;
+    m_cRows = cRows;
+    m_Level = (AM_VCONVERT_LEVEL) iLevel;
+    m_pfnConvert = pConversion->apfnConvert[iLevel];
+
+    DbgLog((LOG_TRACE, 3, TEXT("CAMVideoConverter - %s to %s, %dx%d, level %d"),
+            GetSubtypeName(Src.pFormat->pSubtype),
+            GetSubtypeName(Dst.pFormat->pSubtype),
+            lWidth, lHeight, iLevel));
+    return S_OK;
+}
+
+void
+CAMVideoConverter::GetRows(
+    const CLayout *pLayout,
+    __in BYTE *pImage,
+    LONG lRow,
+    LONG cRows,
+    __out_ecount(3) BYTE **ppRows)
+{
+    LONG lStride = pLayout->lStride;
+
+    if (pLayout->pFormat->bPlanar) {
+        ppRows[0] = pImage + lRow * lStride;
+        ppRows[1] = ppRows[0] + lStride;
+        ppRows[2] = pImage + (pLayout->lHeight + lRow / 2) * lStride;
+        return;
+    }
+
+    // bottom-up images start with the last row
+    ppRows[2] = NULL;
+    if (pLayout->bBottomUp) {
+        ppRows[0] = pImage + (pLayout->lHeight - 1 - lRow) * lStride;
+        ppRows[1] = cRows > 1 ? ppRows[0] - lStride : NULL;
+    } else {
+        ppRows[0] = pImage + lRow * lStride;
+        ppRows[1] = cRows > 1 ? ppRows[0] + lStride : NULL;
+    }
+}
+
+HRESULT
+CAMVideoConverter::ConvertImage(__in const BYTE *pSrc, __out BYTE *pDst)
+{
+    CheckPointer(pSrc, E_POINTER);
+    CheckPointer(pDst, E_POINTER);
+    if (m_pfnConvert == NULL) {
+        return E_UNEXPECTED;
+    }
+
+    for (LONG lRow = 0; lRow < m_lHeight; lRow += m_cRows) {
+        BYTE *apSrc[3];
+        BYTE *apDst[3];
+        GetRows(&m_Src, (BYTE *) pSrc, lRow, m_cRows, apSrc);
+        GetRows(&m_Dst, pDst, lRow, m_cRows, apDst);
+        m_pfnConvert(apSrc, apDst, m_lWidth);
+    }
+    return S_OK;
+}
+
+HRESULT
+CAMVideoConverter::Convert(IMediaSample *pIn, IMediaSample *pOut)
+{
+    CheckPointer(pIn, E_POINTER);
+    CheckPointer(pOut, E_POINTER);
+    if (m_pfnConvert == NULL) {
+        return E_UNEXPECTED;
+    }
+
+    if (pIn->GetActualDataLength() < m_Src.lSize) {
+        return E_INVALIDARG;
+    }
+    if (pOut->GetSize() < m_Dst.lSize) {
+        return VFW_E_BUFFER_OVERFLOW;
+    }
+
+    BYTE *pSrc, *pDst;
+    HRESULT hr = pIn->GetPointer(&pSrc);
+    if (SUCCEEDED(hr)) {
+        hr = pOut->GetPointer(&pDst);
+    }
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    hr = ConvertImage(pSrc, pDst);
+    if (FAILED(hr)) {
+        return hr;
+    }
+    return pOut->SetActualDataLength(m_Dst.lSize);
+}
+
+
+//=====================================================================
+// Implements CConvertVideoFilter
+//=====================================================================
+
+CConvertVideoFilter::CConvertVideoFilter(
+    __in_opt LPCTSTR pName,
+    __inout_opt LPUNKNOWN pUnk,
+    REFCLSID clsid) :
+    CVideoTransformFilter(pName, pUnk, clsid),
+    m_Level(AM_VCONVERT_BEST)
+{
+}
+
+HRESULT
+CConvertVideoFilter::CheckInputType(const CMediaType *mtIn)
+{
+    CheckPointer(mtIn, E_POINTER);
+    CAMVideoConverter::CLayout Layout;
+    return CAMVideoConverter::GetLayout(mtIn, &Layout);
+}
+
+// The output may be wider than the input (the renderer wanting a bigger
+// stride) but must hold the whole picture
+
+HRESULT
+CConvertVideoFilter::CheckTransform(const CMediaType *mtIn, const CMediaType *mtOut)
+{
+    CheckPointer(mtIn, E_POINTER);
+    CheckPointer(mtOut, E_POINTER);
+
+    CAMVideoConverter::CLayout In, Out;
+    HRESULT hr = CAMVideoConverter::GetLayout(mtIn, &In);
+    if (SUCCEEDED(hr)) {
+        hr = CAMVideoConverter::GetLayout(mtOut, &Out);
+    }
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    if (!CAMVideoConverter::CanConvert(In.pFormat->pSubtype, Out.pFormat->pSubtype) ||
+        Out.lWidth < In.lWidth ||
+        Out.lHeight != In.lHeight) {
+        return VFW_E_TYPE_NOT_ACCEPTED;
+    }
+    return S_OK;
+}
+
+HRESULT
+CConvertVideoFilter::GetMediaType(int iPosition, __inout CMediaType *pMediaType)
+{
+    CheckPointer(pMediaType, E_POINTER);
+    if (!m_pInput->IsConnected()) {
+        return E_UNEXPECTED;
+    }
+    if (iPosition < 0) {
+        return E_INVALIDARG;
+    }
+
+    const CMediaType& mtIn = m_pInput->CurrentMediaType();
+    const GUID *pSubtype = CAMVideoConverter::GetDestination(mtIn.Subtype(), iPosition);
+    if (pSubtype == NULL) {
+        return VFW_S_NO_MORE_ITEMS;
+    }
+
+    CAMVideoConverter::CLayout Layout;
+    HRESULT hr = CAMVideoConverter::GetLayout(&mtIn, &Layout);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    VIDEOINFOHEADER *pvi = (VIDEOINFOHEADER *) pMediaType->AllocFormatBuffer(sizeof(VIDEOINFOHEADER));
+    if (pvi == NULL) {
+        return E_OUTOFMEMORY;
+    }
+    ZeroMemory(pvi, sizeof(VIDEOINFOHEADER));
+
+    // VIDEOINFOHEADER2 has the frame rate in the same place
+    pvi->AvgTimePerFrame = ((VIDEOINFOHEADER *) mtIn.Format())->AvgTimePerFrame;
+
+    hr = CAMVideoConverter::InitBitmapInfoHeader(pSubtype,
+                                                 Layout.lWidth,
+                                                 Layout.lHeight,
+                                                 &pvi->bmiHeader);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    pMediaType->SetType(&MEDIATYPE_Video);
+    pMediaType->SetSubtype(pSubtype);
+    pMediaType->SetFormatType(&FORMAT_VideoInfo);
+    pMediaType->SetTemporalCompression(FALSE);
+    pMediaType->SetSampleSize(pvi->bmiHeader.biSizeImage);
+    return S_OK;
+}
+
+HRESULT
+CConvertVideoFilter::DecideBufferSize(
+    IMemAllocator *pAllocator,
+    __inout ALLOCATOR_PROPERTIES *pProperties)
+{
+    CheckPointer(pAllocator, E_POINTER);
+    CheckPointer(pProperties, E_POINTER);
+    if (!m_pInput->IsConnected()) {
+        return E_UNEXPECTED;
+    }
+
+    CAMVideoConverter::CLayout Layout;
+    HRESULT hr = CAMVideoConverter::GetLayout(&m_pOutput->CurrentMediaType(), &Layout);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    if (pProperties->cBuffers < 1) {
+        pProperties->cBuffers = 1;
+    }
+    if (pProperties->cbBuffer < Layout.lSize) {
+        pProperties->cbBuffer = Layout.lSize;
+    }
+    if (pProperties->cbAlign < 1) {
+        pProperties->cbAlign = 1;
+    }
+
+    ALLOCATOR_PROPERTIES Actual;
+    hr = pAllocator->SetProperties(pProperties, &Actual);
+    if (FAILED(hr)) {
+        return hr;
+    }
+    if (Actual.cBuffers < 1 || Actual.cbBuffer < Layout.lSize) {
+        return E_FAIL;
+    }
+    return S_OK;
+}
+
+HRESULT
+CConvertVideoFilter::StartStreaming()
+{
+    HRESULT hr = m_Converter.Initialize(&m_pInput->CurrentMediaType(),
+                                        &m_pOutput->CurrentMediaType(),
+                                        m_Level);
+    if (FAILED(hr)) {
+        return hr;
+    }
+    return CVideoTransformFilter::StartStreaming();
+}
+
+/* Either end may change the type as we go - the renderer typically does
+   to change the output stride. CVideoTransformFilter::Receive picks the
+   new type off the sample and restarts streaming, which sets the
+   converter up again */
+
+HRESULT
+CConvertVideoFilter::Transform(IMediaSample *pIn, IMediaSample *pOut)
+{
+    return m_Converter.Convert(pIn, pOut);
+}
+
+HRESULT
+CConvertVideoFilter::SetConversionLevel(AM_VCONVERT_LEVEL Level)
+{
+    if (Level < AM_VCONVERT_SCALAR || Level > AM_VCONVERT_BEST) {
+        return E_INVALIDARG;
+    }
+    CAutoLock lck(&m_csFilter);
+    m_Level = Level;
+    return S_OK;
+}
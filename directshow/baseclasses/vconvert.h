@@ -0,0 +1,174 @@
+//------------------------------------------------------------------------------
+// File: VConvert.h
+//
+// Desc: DirectShow base classes - defines CAMVideoConverter, which converts
+//       uncompressed video between subtypes, and CConvertVideoFilter, a
+//       video transform filter built on it.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+/* CAMVideoConverter converts whole images between YUY2, UYVY, NV12, RGB24
+   and RGB32. Initialize it with the input and output media types and it
+   picks the conversion, and works out the strides and orientation of each
+   image from its BITMAPINFOHEADER - RGB images are bottom-up when biHeight
+   is positive, YUV images are always top-down, and either may be wider
+   than the picture (biWidth being the stride in pixels). If the two images
+   are different sizes only the part they have in common is converted.
+
+   Every conversion has a plain C version which is the reference for the
+   others. The conversions that matter most - YUV to RGB32 and YUY2 to and
+   from UYVY - also have SSE2 and AVX2 versions, which give exactly the
+   same results. The best one the processor supports is used unless a
+   lower level is asked for. YUV is taken to be BT.601 with the video
+   (16-235) range */
+
+
+#ifndef __VCONVERT__
+#define __VCONVERT__
+
+
+// which implementations a converter may use
+enum AM_VCONVERT_LEVEL {
+    AM_VCONVERT_SCALAR,         // the C reference
+    AM_VCONVERT_SSE2,
+    AM_VCONVERT_AVX2,
+    AM_VCONVERT_BEST = AM_VCONVERT_AVX2
+};
+
+class CAMVideoConverter {
+
+public:
+
+    // converts one row of pixels - or a pair of rows when NV12 is involved,
+    // as each of its chroma rows goes with two luma rows. For NV12 the
+    // pointers are luma row 0, luma row 1 then the chroma row
+    typedef void (*PCONVERTROWS)(
+        const BYTE * const *ppSrc,
+        BYTE * const *ppDst,
+        LONG lWidth);
+
+    // what we know about each subtype
+    struct CFormat {
+        const GUID *pSubtype;
+        DWORD       dwCompression;      // biCompression
+        WORD        wBitCount;
+        BOOL        bPlanar;            // NV12 - luma plane then chroma
+        BOOL        bRGB;               // bottom-up if biHeight > 0
+    };
+
+    // the layout of one image
+    struct CLayout {
+        const CFormat *pFormat;
+        LONG lWidth;                    // in pixels
+        LONG lHeight;
+        LONG lStride;                   // bytes per row of each plane
+        BOOL bBottomUp;
+        LONG lSize;                     // bytes in the whole image
+    };
+
+private:
+
+    struct CConversion {
+        const GUID  *pSrcSubtype;
+        const GUID  *pDstSubtype;
+        PCONVERTROWS apfnConvert[AM_VCONVERT_BEST + 1];    // NULL if none
+    };
+
+    static const CFormat m_aFormats[];
+    static const CConversion m_aConversions[];
+
+    CLayout             m_Src;
+    CLayout             m_Dst;
+    LONG                m_lWidth;       // what the two have in common
+    LONG                m_lHeight;
+    PCONVERTROWS        m_pfnConvert;
+    AM_VCONVERT_LEVEL   m_Level;        // of m_pfnConvert
+    LONG                m_cRows;        // rows m_pfnConvert does at a time
+
+    static const CConversion *FindConversion(
+        const GUID *pSrcSubtype,
+        const GUID *pDstSubtype);
+
+    // set up ppRows for the cRows rows starting at lRow
+    static void GetRows(
+        const CLayout *pLayout,
+        __in BYTE *pImage,
+        LONG lRow,
+        LONG cRows,
+        __out_ecount(3) BYTE **ppRows);
+
+public:
+
+    CAMVideoConverter();
+
+    // the best level this processor supports
+    static AM_VCONVERT_LEVEL GetProcessorLevel();
+
+    // can we convert between these subtypes at all
+    static BOOL CanConvert(const GUID *pSrcSubtype, const GUID *pDstSubtype);
+
+    // the iPosition'th subtype we can convert pSrcSubtype to, or NULL
+    static const GUID *GetDestination(const GUID *pSrcSubtype, int iPosition);
+
+    // Work out the layout of images of this media type - fails with
+    // VFW_E_TYPE_NOT_ACCEPTED if it isn't one we handle
+    static HRESULT GetLayout(const AM_MEDIA_TYPE *pmt, __out CLayout *pLayout);
+
+    // Fill in pbmi for an image of this subtype and size
+    static HRESULT InitBitmapInfoHeader(
+        const GUID *pSubtype,
+        LONG lWidth,
+        LONG lHeight,
+        __out BITMAPINFOHEADER *pbmi);
+
+    // Choose the conversion between these types, using implementations no
+    // later than Level
+    HRESULT Initialize(
+        const AM_MEDIA_TYPE *pmtIn,
+        const AM_MEDIA_TYPE *pmtOut,
+        AM_VCONVERT_LEVEL Level = AM_VCONVERT_BEST);
+
+    // the implementation in use - only valid after Initialize
+    AM_VCONVERT_LEVEL GetLevel() const { return m_Level; };
+
+    // Convert a sample, setting the output's actual data length
+    HRESULT Convert(IMediaSample *pIn, IMediaSample *pOut);
+
+    // Convert between buffers laid out as Initialize was told
+    HRESULT ConvertImage(__in const BYTE *pSrc, __out BYTE *pDst);
+};
+
+
+// CConvertVideoFilter
+//
+// A video transform filter that converts between any of the subtypes
+// CAMVideoConverter handles. Its output types are the conversions offered
+// for the input type, in CAMVideoConverter's order of preference. Derive
+// from it (you need to supply a CLSID and a CreateInstance) to narrow the
+// types or to do something to the pictures on the way through.
+
+class CConvertVideoFilter : public CVideoTransformFilter
+{
+protected:
+
+    CAMVideoConverter   m_Converter;
+    AM_VCONVERT_LEVEL   m_Level;        // highest level we may use
+
+public:
+
+    CConvertVideoFilter(__in_opt LPCTSTR pName, __inout_opt LPUNKNOWN pUnk, REFCLSID clsid);
+
+    HRESULT CheckInputType(const CMediaType *mtIn);
+    HRESULT CheckTransform(const CMediaType *mtIn, const CMediaType *mtOut);
+    HRESULT GetMediaType(int iPosition, __inout CMediaType *pMediaType);
+    HRESULT DecideBufferSize(IMemAllocator *pAllocator, __inout ALLOCATOR_PROPERTIES *pProperties);
+    HRESULT StartStreaming();
+    HRESULT Transform(IMediaSample *pIn, IMediaSample *pOut);
+
+    // Don't use anything later than Level - from the next StartStreaming
+    HRESULT SetConversionLevel(AM_VCONVERT_LEVEL Level);
+};
+
+#endif // __VCONVERT__
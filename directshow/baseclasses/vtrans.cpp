@@ -21,10 +21,11 @@ CVideoTransformFilter::CVideoTransformFilter
     , m_tDecodeStart(0)
     , m_itrAvgDecode(300000)    // 30mSec - probably allows skipping
     , m_bQualityChanged(FALSE)
+    , m_bPredictive(FALSE)
+    , m_llFrequency(0)
+    , m_rtChecked(MAX_TIME)
 {
-#ifdef PERF
     RegisterPerfId();
-#endif //  PERF
 }
 
 
@@ -46,10 +47,30 @@ HRESULT CVideoTransformFilter::StartStreaming()
     m_itrAvgDecode = 300000;     // 30mSec - probably allows skipping
     m_bQualityChanged = FALSE;
     m_bSampleSkipped = FALSE;
+    m_Predictor.Reset();
     return NOERROR;
 }
 
 
+HRESULT CVideoTransformFilter::EnablePredictiveSkipping(BOOL bEnable)
+{
+    CAutoLock lck(&m_csReceive);
+    if (bEnable && m_llFrequency == 0) {
+        LARGE_INTEGER li;
+        QueryPerformanceFrequency(&li);
+        m_llFrequency = li.QuadPart;
+    }
+    m_bPredictive = bEnable;
+    return NOERROR;
+}
+
+
+int CVideoTransformFilter::GetFrameType(IMediaSample *pIn)
+{
+    return pIn->IsSyncPoint() == S_OK ? AM_VIDEO_FRAME_KEY : AM_VIDEO_FRAME_DELTA;
+}
+
+
 // Overriden to reset quality management information
 
 HRESULT CVideoTransformFilter::EndFlush()
@@ -153,13 +174,17 @@ HRESULT CVideoTransformFilter::Receive(IMediaSample *pSample)
 
 	// now switch to using the new format.  I am assuming that the
 	// derived filter will do the right thing when its media type is
-	// switched and streaming is restarted.
+	// switched and streaming is restarted.  Frames still in the pipeline
+	// are in the old format, so let them go first.
 
+	PipelineDrain();
 	StopStreaming();
-	m_pInput->CurrentMediaType() = *pmt;
+	hr = m_pInput->SetCurrentMediaType(pmt);
 	DeleteMediaType(pmt);
 	// if this fails, playback will stop, so signal an error
-	hr = StartStreaming();
+	if (SUCCEEDED(hr)) {
+	    hr = StartStreaming();
+	}
 	if (FAILED(hr)) {
 	    return AbortPlayback(hr);
 	}
@@ -215,10 +240,13 @@ HRESULT CVideoTransformFilter::Receive(IMediaSample *pSample)
 	// derived filter will do the right thing when its media type is
 	// switched and streaming is restarted.
 
+	PipelineDrain();
 	StopStreaming();
-	m_pOutput->CurrentMediaType() = *pmtOut;
+	hr = m_pOutput->SetCurrentMediaType(pmtOut);
 	DeleteMediaType(pmtOut);
-	hr = StartStreaming();
+	if (SUCCEEDED(hr)) {
+	    hr = StartStreaming();
+	}
 
 	if (SUCCEEDED(hr)) {
  	    // a new format, means a new empty buffer, so wait for a keyframe
@@ -245,20 +273,50 @@ HRESULT CVideoTransformFilter::Receive(IMediaSample *pSample)
 	m_nWaitForKey = 30;
     }
 
+    // The pipeline transforms and delivers it later.  Whether we are still
+    // waiting for a keyframe doesn't depend on the transform, so we can
+    // tell it now.  The frames overlap, so how long each one takes isn't
+    // what limits us and isn't measured.
+    if (m_pPipeline) {
+        if (m_nWaitForKey)
+            m_nWaitForKey--;
+        if (m_nWaitForKey && pSample->IsSyncPoint() == S_OK)
+	    m_nWaitForKey = FALSE;
+        return PipelineReceive(pSample, pOutSample, m_nWaitForKey != 0);
+    }
+
     // Start timing the transform (and log it if PERF is defined)
 
     if (SUCCEEDED(hr)) {
         m_tDecodeStart = timeGetTime();
+        LARGE_INTEGER liDecodeStart;
+        if (m_bPredictive) {
+            QueryPerformanceCounter(&liDecodeStart);
+        }
         MSR_START(m_idTransform);
 
         // have the derived class transform the data
-        hr = Transform(pSample, pOutSample);
+        if (m_pSlicePool) {
+            hr = TransformSlices(pSample, pOutSample);
+        } else {
+            hr = Transform(pSample, pOutSample);
+        }
 
         // Stop the clock (and log it if PERF is defined)
         MSR_STOP(m_idTransform);
         m_tDecodeStart = timeGetTime()-m_tDecodeStart;
         m_itrAvgDecode = m_tDecodeStart*(10000/16) + 15*(m_itrAvgDecode/16);
 
+        // and what this type of frame costs, for predicting lateness
+        if (m_bPredictive && SUCCEEDED(hr)) {
+            LARGE_INTEGER liDecodeEnd;
+            QueryPerformanceCounter(&liDecodeEnd);
+            const REFERENCE_TIME rtCost =
+                llMulDiv(liDecodeEnd.QuadPart - liDecodeStart.QuadPart, UNITS, m_llFrequency, 0);
+            m_Predictor.AddCost(GetFrameType(pSample), rtCost);
+            LogFrame(pSample, rtCost);
+        }
+
         // Maybe we're waiting for a keyframe still?
         if (m_nWaitForKey)
             m_nWaitForKey--;
@@ -315,8 +373,30 @@ HRESULT CVideoTransformFilter::Receive(IMediaSample *pSample)
 
 
 
+// One line per frame for replaying through CAMFrameDropPredictor offline
+// (see tools/qualsim/dropreplay.cpp) - its type, what it cost to decode
+// (-1 if we dropped it), when it was due, its length and the stream time
+// when ShouldSkipFrame looked at it
+
+void CVideoTransformFilter::LogFrame(IMediaSample *pIn, REFERENCE_TIME rtCost)
+{
+#ifdef DEBUG
+    REFERENCE_TIME trStart, trStopAt;
+    if (m_rtChecked != MAX_TIME && pIn->GetTime(&trStart, &trStopAt) == S_OK) {
+        DbgLog((LOG_TIMING, 3, TEXT("Frame %d cost %I64d due %I64d length %I64d now %I64d"),
+                GetFrameType(pIn), rtCost, trStart, trStopAt - trStart, m_rtChecked));
+    }
+#else
+    UNREFERENCED_PARAMETER(pIn);
+    UNREFERENCED_PARAMETER(rtCost);
+#endif
+}
+
+
 BOOL CVideoTransformFilter::ShouldSkipFrame( IMediaSample * pIn)
 {
+    m_rtChecked = MAX_TIME;
+
     REFERENCE_TIME trStart, trStopAt;
     HRESULT hr = pIn->GetTime(&trStart, &trStopAt);
 
@@ -326,8 +406,9 @@ BOOL CVideoTransformFilter::ShouldSkipFrame( IMediaSample * pIn)
 
     int itrFrame = (int)(trStopAt - trStart);  // frame duration
 
-    if(S_OK==pIn->IsSyncPoint()) {
-        MSR_INTEGER(m_idFrameType, 1);
+    const int iType = GetFrameType(pIn);
+    MSR_INTEGER(m_idFrameType, iType);
+    if (iType == AM_VIDEO_FRAME_KEY) {
         if ( m_nKeyFramePeriod < m_nFramesSinceKeyFrame ) {
             // record the max
             m_nKeyFramePeriod = m_nFramesSinceKeyFrame;
@@ -335,7 +416,6 @@ BOOL CVideoTransformFilter::ShouldSkipFrame( IMediaSample * pIn)
         m_nFramesSinceKeyFrame = 0;
         m_bSkipping = FALSE;
     } else {
-        MSR_INTEGER(m_idFrameType, 2);
         if (  m_nFramesSinceKeyFrame>m_nKeyFramePeriod
            && m_nKeyFramePeriod>0
            ) {
@@ -345,6 +425,35 @@ BOOL CVideoTransformFilter::ShouldSkipFrame( IMediaSample * pIn)
         }
     }
 
+    // If we can tell where the clock has got to, drop frames we expect to
+    // be late rather than waiting to be told they were. As below, once we
+    // drop a type 2 frame we are committed to skipping to the next type 1
+    CRefTime rtNow;
+    if (m_bPredictive && m_State == State_Running && StreamTime(rtNow) == NOERROR) {
+        BOOL bDrop = m_bSkipping;
+        if (!bDrop) {
+            int nTillKey = -1;
+            if (m_nKeyFramePeriod > 0) {
+                nTillKey = max(m_nKeyFramePeriod - m_nFramesSinceKeyFrame, 1);
+            }
+            bDrop = m_Predictor.ShouldDrop(iType, rtNow, trStart, trStopAt - trStart, nTillKey);
+            if (bDrop && iType == AM_VIDEO_FRAME_DELTA) {
+                m_bSkipping = TRUE;
+            }
+        }
+        ++m_nFramesSinceKeyFrame;
+        m_rtChecked = rtNow;
+        if (bDrop) {
+            LogFrame(pIn, -1);
+        }
+
+        if (bDrop && !m_bQualityChanged) {
+            m_bQualityChanged = TRUE;
+            NotifyEvent(EC_QUALITY_CHANGE,0,0);
+        }
+        return bDrop;
+    }
+
 
     // Whatever we might otherwise decide,
     // if we are taking only a small fraction of the required frame time to decode
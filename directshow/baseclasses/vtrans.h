@@ -19,6 +19,12 @@ class CVideoTransformFilter : public CTransformFilter
     ~CVideoTransformFilter();
     HRESULT EndFlush();
 
+    // Once EnablePredictiveSkipping(TRUE) has been called, frames are
+    // dropped when m_Predictor expects them to be late, instead of once
+    // Quality messages say frames have been late. It needs the clock, so
+    // without one we carry on as before
+    HRESULT EnablePredictiveSkipping(BOOL bEnable);
+
     // =================================================================
     // ----- override these bits ---------------------------------------
     // =================================================================
@@ -49,7 +55,6 @@ class CVideoTransformFilter : public CTransformFilter
     // virtual HRESULT EndFlush(void);
     // virtual HRESULT NewSegment
     //     (REFERENCE_TIME tStart,REFERENCE_TIME tStop,double dRate);
-#ifdef PERF
 
     // If you override this - ensure that you register all these ids
     // as well as any of your own,
@@ -60,7 +65,6 @@ class CVideoTransformFilter : public CTransformFilter
         m_idTimeTillKey = MSR_REGISTER(TEXT("Video Transform Estd. time to next key"));
         CTransformFilter::RegisterPerfId();
     }
-#endif
 
   protected:
 
@@ -98,7 +102,10 @@ class CVideoTransformFilter : public CTransformFilter
 
     // You can tell if it's a type 1 frame by calling IsSyncPoint().
     // there is no architected way to test for a type 3, so you should override
-    // the quality management here if you have B-frames.
+    // GetFrameType (or the quality management here) if you have B-frames.
+
+    // AM_VIDEO_FRAME_KEY for sync points, otherwise AM_VIDEO_FRAME_DELTA
+    virtual int GetFrameType(IMediaSample *pIn);
 
     int m_nKeyFramePeriod; // the largest observed interval between type 1 frames
                            // 1 means every frame is type 1, 2 means every other.
@@ -108,12 +115,10 @@ class CVideoTransformFilter : public CTransformFilter
 
     BOOL m_bSkipping;           // we are skipping to the next type 1 frame
 
-#ifdef PERF
     int m_idFrameType;          // MSR id Frame type.  1=Key, 2="non-key"
     int m_idSkip;               // MSR id skipping
     int m_idLate;               // MSR id lateness
     int m_idTimeTillKey;        // MSR id for guessed time till next key frame.
-#endif
 
     virtual HRESULT StartStreaming();
 
@@ -125,6 +130,9 @@ class CVideoTransformFilter : public CTransformFilter
 
     BOOL ShouldSkipFrame(IMediaSample * pIn);
 
+    // debug builds log each frame predictive skipping looks at
+    void LogFrame(IMediaSample *pIn, REFERENCE_TIME rtCost);
+
     int m_itrLate;              // lateness from last Quality message
                                 // (this overflows at 214 secs late).
     int m_tDecodeStart;         // timeGetTime when decode started.
@@ -140,4 +148,10 @@ class CVideoTransformFilter : public CTransformFilter
     // When non-zero, don't pass anything to renderer until next keyframe
     // If there are few keys, give up and eventually draw something
     int m_nWaitForKey;
+
+    // predictive skipping
+    BOOL m_bPredictive;
+    CAMFrameDropPredictor m_Predictor;  // reset with the rest of this state
+    LONGLONG m_llFrequency;             // of the performance counter
+    REFERENCE_TIME m_rtChecked;         // when it last looked, or MAX_TIME
 };
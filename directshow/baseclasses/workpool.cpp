@@ -0,0 +1,282 @@
+//------------------------------------------------------------------------------
+// File: WorkPool.cpp
+//
+// Desc: DirectShow base classes - implements CAMWorkerPool.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#include <streams.h>
+
+
+CAMWorkerPool::CAMWorkerPool() :
+    m_ahThreads(NULL),
+    m_cThreads(0),
+    m_hWork(NULL),
+    m_hDone(NULL),
+    m_bExit(FALSE),
+    m_bShared(FALSE),
+    m_bOpen(FALSE),
+    m_cActive(0),
+    m_cOutstanding(0),
+    m_hIdle(NULL),
+    m_pfnItem(NULL),
+    m_pContext(NULL),
+    m_cItems(0),
+    m_iNext(0),
+    m_cPending(0),
+    m_hrFailed(S_OK),
+    m_bSkipped(FALSE)
+{
+}
+
+CAMWorkerPool::~CAMWorkerPool()
+{
+    Close();
+}
+
+HRESULT
+CAMWorkerPool::Create(LONG cThreads)
+{
+    if (m_hWork != NULL) {
+        return E_UNEXPECTED;
+    }
+    if (cThreads == AM_WORKPOOL_AUTO) {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        cThreads = (LONG) si.dwNumberOfProcessors - 1;
+    }
+    if (cThreads < 0) {
+        return E_INVALIDARG;
+    }
+    cThreads = min(cThreads, MAXIMUM_WAIT_OBJECTS);
+
+    m_hWork = CreateSemaphore(NULL, 0, max(cThreads, 1), NULL);
+    m_hDone = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (m_hWork == NULL || m_hDone == NULL) {
+        HRESULT hr = AmHresultFromWin32(GetLastError());
+        Close();
+        return hr;
+    }
+
+    if (cThreads == 0) {
+        return S_OK;
+    }
+
+    if (CAMTaskScheduler::IsSharing()) {
+        m_hIdle = CreateEvent(NULL, TRUE, TRUE, NULL);
+        if (m_hIdle == NULL) {
+            HRESULT hr = AmHresultFromWin32(GetLastError());
+            Close();
+            return hr;
+        }
+        m_bShared = TRUE;
+        m_cThreads = cThreads;
+        return S_OK;
+    }
+
+    m_ahThreads = new HANDLE[cThreads];
+    if (m_ahThreads == NULL) {
+        Close();
+        return E_OUTOFMEMORY;
+    }
+    m_bExit = FALSE;
+    for (; m_cThreads < cThreads; m_cThreads++) {
+        DWORD dwThreadId;
+        m_ahThreads[m_cThreads] = CreateThread(NULL, 0, ThreadProc, this, 0, &dwThreadId);
+        if (m_ahThreads[m_cThreads] == NULL) {
+            HRESULT hr = AmHresultFromWin32(GetLastError());
+            Close();
+            return hr;
+        }
+    }
+
+    DbgLog((LOG_TRACE, 2, TEXT("CAMWorkerPool - %d threads"), m_cThreads));
+    return S_OK;
+}
+
+void
+CAMWorkerPool::Close()
+{
+    if (m_bShared) {
+
+        // helpers still queued on the scheduler refer to us
+        WaitForSingleObject(m_hIdle, INFINITE);
+        {
+            CAutoLock lck(&m_Lock);
+        }
+        CloseHandle(m_hIdle);
+        m_hIdle = NULL;
+        m_bShared = FALSE;
+        m_cThreads = 0;
+    }
+
+    if (m_cThreads) {
+        m_bExit = TRUE;
+        ReleaseSemaphore(m_hWork, m_cThreads, NULL);
+        WaitForMultipleObjects(m_cThreads, m_ahThreads, TRUE, INFINITE);
+        for (LONG i = 0; i < m_cThreads; i++) {
+            CloseHandle(m_ahThreads[i]);
+        }
+        m_cThreads = 0;
+    }
+    delete [] m_ahThreads;
+    m_ahThreads = NULL;
+
+    if (m_hWork) {
+        CloseHandle(m_hWork);
+        m_hWork = NULL;
+    }
+    if (m_hDone) {
+        CloseHandle(m_hDone);
+        m_hDone = NULL;
+    }
+}
+
+// take items until there are none left
+
+void
+CAMWorkerPool::DoItems()
+{
+    for (;;) {
+        LONG iItem = InterlockedIncrement(&m_iNext) - 1;
+        if (iItem >= m_cItems) {
+            return;
+        }
+        HRESULT hr = m_pfnItem(m_pContext, iItem);
+        if (FAILED(hr)) {
+            InterlockedCompareExchange(&m_hrFailed, hr, S_OK);
+        } else if (hr == S_FALSE) {
+            m_bSkipped = TRUE;
+        }
+    }
+}
+
+/* Each thread is woken once for every job. It may be woken after the other
+   threads have done all the items, but Run can't return until it has left
+   the job, so it never sees the next job's items early */
+
+DWORD WINAPI
+CAMWorkerPool::ThreadProc(__in LPVOID pv)
+{
+    CAMWorkerPool *pThis = (CAMWorkerPool *) pv;
+
+    for (;;) {
+        WaitForSingleObject(pThis->m_hWork, INFINITE);
+        if (pThis->m_bExit) {
+            return 0;
+        }
+        pThis->DoItems();
+        if (InterlockedDecrement(&pThis->m_cPending) == 0) {
+            SetEvent(pThis->m_hDone);
+        }
+    }
+}
+
+/* A helper that only gets going after the job it was submitted for has
+   finished joins whatever job is open then, or just leaves */
+
+void
+CAMWorkerPool::HelperTask(__inout PVOID pv)
+{
+    CAMWorkerPool *pThis = (CAMWorkerPool *) pv;
+
+    BOOL bJoin;
+    {
+        CAutoLock lck(&pThis->m_Lock);
+        bJoin = pThis->m_bOpen;
+        if (bJoin) {
+            pThis->m_cActive++;
+        }
+    }
+    if (bJoin) {
+        pThis->DoItems();
+    }
+
+    CAutoLock lck(&pThis->m_Lock);
+    if (bJoin && --pThis->m_cActive == 0 && !pThis->m_bOpen) {
+        SetEvent(pThis->m_hDone);
+    }
+    if (--pThis->m_cOutstanding == 0) {
+        SetEvent(pThis->m_hIdle);
+    }
+}
+
+void
+CAMWorkerPool::RunShared(LONG cItems)
+{
+    CAMTaskScheduler *pScheduler = CAMTaskScheduler::GetDefault();
+
+    {
+        CAutoLock lck(&m_Lock);
+        m_bOpen = TRUE;
+    }
+
+    // a helper per item we won't get to straight away
+    LONG cHelpers = min(m_cThreads, cItems - 1);
+    for (LONG i = 0; i < cHelpers; i++) {
+        {
+            CAutoLock lck(&m_Lock);
+            if (m_cOutstanding++ == 0) {
+                ResetEvent(m_hIdle);
+            }
+        }
+        if (FAILED(pScheduler->Submit(HelperTask, this))) {
+            CAutoLock lck(&m_Lock);
+            if (--m_cOutstanding == 0) {
+                SetEvent(m_hIdle);
+            }
+            break;
+        }
+    }
+
+    DoItems();
+
+    // every item is taken, but helpers may still be doing theirs
+    BOOL bWait;
+    {
+        CAutoLock lck(&m_Lock);
+        m_bOpen = FALSE;
+        bWait = m_cActive > 0;
+    }
+    if (bWait) {
+        WaitForSingleObject(m_hDone, INFINITE);
+    }
+}
+
+HRESULT
+CAMWorkerPool::Run(PWORKITEM pfnItem, __inout PVOID pContext, LONG cItems)
+{
+    CheckPointer(pfnItem, E_POINTER);
+    if (m_hWork == NULL) {
+        return E_UNEXPECTED;
+    }
+    if (cItems <= 0) {
+        return S_OK;
+    }
+
+    m_pfnItem = pfnItem;
+    m_pContext = pContext;
+    m_cItems = cItems;
+    m_iNext = 0;
+    m_hrFailed = S_OK;
+    m_bSkipped = FALSE;
+
+    // no point waking threads there is nothing for
+    if (cItems > 1 && m_bShared) {
+        RunShared(cItems);
+    } else if (cItems > 1 && m_cThreads) {
+        m_cPending = m_cThreads;
+        ReleaseSemaphore(m_hWork, m_cThreads, NULL);
+        DoItems();
+        WaitForSingleObject(m_hDone, INFINITE);
+    } else {
+        DoItems();
+    }
+
+    if (FAILED(m_hrFailed)) {
+        return m_hrFailed;
+    }
+    return m_bSkipped ? S_FALSE : S_OK;
+}
@@ -0,0 +1,94 @@
+//------------------------------------------------------------------------------
+// File: WorkPool.h
+//
+// Desc: DirectShow base classes - defines CAMWorkerPool, a set of persistent
+//       threads that share the items of a job with the thread that runs it.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+/* Run hands out the items 0 to cItems-1 of a job to the pool's threads and
+   to the calling thread, which all take the next item not yet taken until
+   there are none left. Run returns once every item has been done, so the
+   items can use anything on the caller's stack. One job runs at a time -
+   the pool is meant to belong to one streaming thread.
+
+   The threads are created once and wait on a semaphore between jobs, so a
+   job costs a wakeup per thread rather than a thread creation. A pool
+   created while CAMTaskScheduler::IsSharing() has no threads of its own -
+   it submits up to cThreads helper tasks to the shared scheduler instead,
+   and Run only waits for the helpers that started before the items ran
+   out */
+
+
+#ifndef __WORKPOOL__
+#define __WORKPOOL__
+
+
+// for Create - one thread less than the number of processors
+#define AM_WORKPOOL_AUTO    (-1)
+
+
+class CAMWorkerPool {
+
+public:
+
+    // does item iItem of a job - return S_FALSE to have Run return S_FALSE
+    // (unless another item fails)
+    typedef HRESULT (*PWORKITEM)(__inout PVOID pContext, LONG iItem);
+
+private:
+
+    HANDLE      *m_ahThreads;
+    LONG        m_cThreads;     // in m_ahThreads, or helpers if shared
+    HANDLE      m_hWork;        // released once per thread for each job
+    HANDLE      m_hDone;        // set when the last thread leaves a job
+    BOOL        m_bExit;
+
+    // helping out through the shared scheduler
+    BOOL        m_bShared;
+    CCritSec    m_Lock;         // protects the rest of these
+    BOOL        m_bOpen;        // helpers may join the job
+    LONG        m_cActive;      // helpers in the job
+    LONG        m_cOutstanding; // helpers submitted and not yet finished
+    HANDLE      m_hIdle;        // set when m_cOutstanding gets to 0
+
+    // the job in progress
+    PWORKITEM   m_pfnItem;
+    PVOID       m_pContext;
+    LONG        m_cItems;
+    volatile LONG m_iNext;      // next item to take
+    volatile LONG m_cPending;   // threads still to leave the job
+    volatile LONG m_hrFailed;   // first failure, or S_OK
+    volatile LONG m_bSkipped;   // an item returned S_FALSE
+
+    static DWORD WINAPI ThreadProc(__in LPVOID pv);
+    static void HelperTask(__inout PVOID pv);
+    void DoItems();
+    void RunShared(LONG cItems);
+
+public:
+
+    CAMWorkerPool();
+    ~CAMWorkerPool();
+
+    // Start cThreads threads besides the caller of Run, or with
+    // AM_WORKPOOL_AUTO one less than the number of processors. 0 leaves
+    // the caller of Run to do every item. There are never more than
+    // MAXIMUM_WAIT_OBJECTS, so Close can wait for them all at once. If
+    // the base classes are sharing threads, just allow for that many helpers
+    HRESULT Create(LONG cThreads = AM_WORKPOOL_AUTO);
+
+    // stop the threads, waiting for them to exit
+    void Close();
+
+    // threads taking part in a job, including the caller of Run
+    LONG GetThreadCount() const { return m_cThreads + 1; };
+
+    // Do all the items of a job. Returns the first failure from an item,
+    // otherwise S_FALSE if any item returned S_FALSE, otherwise S_OK
+    HRESULT Run(PWORKITEM pfnItem, __inout PVOID pContext, LONG cItems);
+};
+
+#endif // __WORKPOOL__
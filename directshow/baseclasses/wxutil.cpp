@@ -11,6 +11,9 @@
 #include <streams.h>
 #define STRSAFE_NO_DEPRECATE
 #include <strsafe.h>
+#include <intrin.h>
+
+#pragma intrinsic(_ReturnAddress)
 
 
 // --- CAMEvent -----------------------
@@ -101,6 +104,7 @@ CAMThread::CAMThread(__inout_opt HRESULT *phr)
       m_EventComplete(FALSE, phr)
 {
     m_hThread = NULL;
+    m_hLoopDone = NULL;
 }
 
 CAMThread::~CAMThread() {
@@ -140,6 +144,16 @@ CAMThread::Create()
 	return FALSE;
     }
 
+    // borrow one of the shared scheduler's threads if we may
+    if (CAMTaskScheduler::IsSharing()) {
+        return SUCCEEDED(CAMTaskScheduler::GetDefault()->StartLoop(
+                            CAMThread::InitialThreadProc,
+                            this,
+                            &m_hThread,
+                            &m_hLoopDone,
+                            NULL));
+    }
+
     m_hThread = CreateThread(
 		    NULL,
 		    0,
@@ -262,9 +276,12 @@ HRESULT CAMThread::CoInitializeHelper()
 CMsgThread::~CMsgThread()
 {
     if (m_hThread != NULL) {
-        WaitForSingleObject(m_hThread, INFINITE);
+        WaitForSingleObject(m_hLoopDone ? m_hLoopDone : m_hThread, INFINITE);
         EXECUTE_ASSERT(CloseHandle(m_hThread));
     }
+    if (m_hLoopDone != NULL) {
+        EXECUTE_ASSERT(CloseHandle(m_hLoopDone));
+    }
 
     POSITION pos = m_ThreadQueue.GetHeadPosition();
     while (pos) {
@@ -287,6 +304,20 @@ CMsgThread::CreateThread(
         return FALSE;
     }
 
+    // borrow one of the shared scheduler's threads if we may
+    if (CAMTaskScheduler::IsSharing()) {
+        if (FAILED(CAMTaskScheduler::GetDefault()->StartLoop(
+                        DefaultThreadProc,
+                        (LPVOID)this,
+                        &m_hThread,
+                        &m_hLoopDone,
+                        &m_dwLoopExitCode))) {
+            return FALSE;
+        }
+        m_ThreadId = ::GetThreadId(m_hThread);
+        return TRUE;
+    }
+
     m_hThread = ::CreateThread(NULL, 0, DefaultThreadProc,
 			       (LPVOID)this, 0, &m_ThreadId);
     return m_hThread != NULL;
@@ -381,6 +412,11 @@ void * __stdcall memmoveInternal(void * dst, const void * src, size_t count)
 {
     void * ret = dst;
 
+    // big copies are better done by CAMMemCopy's streaming kernels
+    if (count >= CAMMemCopy::GetStreamingThreshold()) {
+        return CAMMemCopy::Move(dst, src, count);
+    }
+
 #ifdef _X86_
     if (dst <= src || (char *)dst >= ((char *)src + count)) {
 
@@ -457,72 +493,517 @@ HRESULT AMSafeMemMoveOffset(
 }
 
 
-#ifdef DEBUG
 /******************************Public*Routine******************************\
-* Debug CCritSec helpers
+* Critical section contention profiling
 *
-* We provide debug versions of the Constructor, destructor, Lock and Unlock
-* routines.  The debug code tracks who owns each critical section by
-* maintaining a depth count.
+* A profile is only ever updated by the thread holding its lock, so the
+* counts need no interlocking of their own. Nobody else writes them - not
+* even CritProfileReset, which only asks for the counts to be cleared;
+* the next holder clears them before it adds to them. Readers copy them
+* out under a sequence count that the holder makes odd while it updates
+* them, and try again if it was odd or changed, so a copy is never torn.
+* The list of profiles is guarded by a spin lock rather than a CCritSec,
+* which would profile itself.
 *
-* History:
+\**************************************************************************/
+
+class CCritSecProfile {
+public:
+    CCritSecProfile *m_pNext;
+    CCritSecProfile *m_pPrev;
+    AM_CRITSEC_PROFILE m_Stats;
+    PVOID m_pvHolder;           // where the owner took the lock
+    LONGLONG m_llAcquired;      // and when, or 0 if it wasn't timed
+    volatile LONG m_lSequence;  // odd while m_Stats is being updated
+    volatile LONG m_lReset;     // clear m_Stats before the next update
+
+    void BeginUpdate();
+    void EndUpdate() { InterlockedIncrement(&m_lSequence); };
+    void Acquired(PVOID pvSite);
+    void Waited(PVOID pvHolder, LONGLONG llTicks);
+    void Released();
+    void Copy(__out AM_CRITSEC_PROFILE *pStats);
+};
+
+static CCritSecProfile *g_pCritProfiles;
+static volatile LONG g_lCritProfileLock;
+static BOOL g_bCritProfileAll;
+static LONGLONG g_llCritProfileFreq;
+
+static void CritProfileListLock()
+{
+    while (InterlockedExchange(&g_lCritProfileLock, 1) != 0) {
+        Sleep(0);
+    }
+}
+
+static void CritProfileListUnlock()
+{
+    InterlockedExchange(&g_lCritProfileLock, 0);
+}
+
+static LONGLONG CritProfileNow()
+{
+    LARGE_INTEGER li;
+    QueryPerformanceCounter(&li);
+    return li.QuadPart;
+}
+
+static LONGLONG CritProfileMicroseconds(LONGLONG llTicks)
+{
+    if (g_llCritProfileFreq == 0) {
+        LARGE_INTEGER li;
+        QueryPerformanceFrequency(&li);
+        g_llCritProfileFreq = li.QuadPart;
+    }
+    return llMulDiv(llTicks, 1000000, g_llCritProfileFreq, 0);
+}
+
+// everything but which lock it is
+static void CritProfileClear(__inout AM_CRITSEC_PROFILE *pStats)
+{
+    pStats->cAcquired = pStats->cContended = 0;
+    pStats->llWaitTime = pStats->llMaxWait = 0;
+    pStats->llHoldTime = pStats->llMaxHold = 0;
+    ZeroMemory(pStats->aWaitHistogram, sizeof(pStats->aWaitHistogram));
+    ZeroMemory(pStats->aHolders, sizeof(pStats->aHolders));
+}
+
+void CCritSecProfile::BeginUpdate()
+{
+    InterlockedIncrement(&m_lSequence);
+    if (m_lReset && InterlockedCompareExchange(&m_lReset, 0, 1) == 1) {
+        CritProfileClear(&m_Stats);
+    }
+}
+
+void CCritSecProfile::Acquired(PVOID pvSite)
+{
+    BeginUpdate();
+    m_Stats.cAcquired++;
+    EndUpdate();
+    m_pvHolder = pvSite;
+    m_llAcquired = CritProfileNow();
+}
+
+void CCritSecProfile::Waited(PVOID pvHolder, LONGLONG llTicks)
+{
+    LONGLONG llWait = CritProfileMicroseconds(llTicks);
+
+    BeginUpdate();
+    m_Stats.cContended++;
+    m_Stats.llWaitTime += llWait;
+    m_Stats.llMaxWait = max(m_Stats.llMaxWait, llWait);
+
+    int iBucket = 0;
+    while (iBucket < AM_CRITSEC_WAIT_BUCKETS - 1 && llWait >= (1LL << iBucket)) {
+        iBucket++;
+    }
+    m_Stats.aWaitHistogram[iBucket]++;
+
+    // the last entry collects the sites there isn't room for
+    int i = 0;
+    while (i < AM_CRITSEC_HOLDER_SITES - 1 &&
+           m_Stats.aHolders[i].cWaits != 0 &&
+           m_Stats.aHolders[i].pvSite != pvHolder) {
+        i++;
+    }
+    if (m_Stats.aHolders[i].cWaits == 0) {
+        m_Stats.aHolders[i].pvSite = pvHolder;
+    } else if (m_Stats.aHolders[i].pvSite != pvHolder) {
+        m_Stats.aHolders[i].pvSite = NULL;
+    }
+    m_Stats.aHolders[i].cWaits++;
+    m_Stats.aHolders[i].llWaitTime += llWait;
+    EndUpdate();
+}
+
+void CCritSecProfile::Released()
+{
+    if (m_llAcquired) {
+        LONGLONG llHold = CritProfileMicroseconds(CritProfileNow() - m_llAcquired);
+        BeginUpdate();
+        m_Stats.llHoldTime += llHold;
+        m_Stats.llMaxHold = max(m_Stats.llMaxHold, llHold);
+        EndUpdate();
+        m_llAcquired = 0;
+    }
+}
+
+// from any thread - the holder may be updating the counts meanwhile
+void CCritSecProfile::Copy(__out AM_CRITSEC_PROFILE *pStats)
+{
+    for (;;) {
+        LONG lSequence = m_lSequence;
+        if (!(lSequence & 1)) {
+            MemoryBarrier();
+            *pStats = m_Stats;
+            MemoryBarrier();
+            if (m_lSequence == lSequence) {
+                break;
+            }
+        }
+        Sleep(0);
+    }
+    if (m_lReset) {
+        CritProfileClear(pStats);
+    }
+}
+
+static CCritSecProfile *CritProfileAttach(CCritSec *pcCrit)
+{
+    CCritSecProfile *pProfile = pcCrit->m_pProfile;
+    if (pProfile) {
+        return pProfile;
+    }
+
+    pProfile = new CCritSecProfile;
+    if (pProfile == NULL) {
+        return NULL;
+    }
+    ZeroMemory(pProfile, sizeof(*pProfile));
+    pProfile->m_Stats.pLock = pcCrit;
+
+    CritProfileListLock();
+    if (pcCrit->m_pProfile == NULL) {
+        pProfile->m_pNext = g_pCritProfiles;
+        if (g_pCritProfiles) {
+            g_pCritProfiles->m_pPrev = pProfile;
+        }
+        g_pCritProfiles = pProfile;
+        pcCrit->m_pProfile = pProfile;
+        CritProfileListUnlock();
+    } else {
+        // someone else got there first
+        CritProfileListUnlock();
+        delete pProfile;
+        pProfile = pcCrit->m_pProfile;
+    }
+    return pProfile;
+}
+
+static void CritProfileDetach(CCritSec *pcCrit)
+{
+    CritProfileListLock();
+    CCritSecProfile *pProfile = pcCrit->m_pProfile;
+    if (pProfile->m_pPrev) {
+        pProfile->m_pPrev->m_pNext = pProfile->m_pNext;
+    } else {
+        g_pCritProfiles = pProfile->m_pNext;
+    }
+    if (pProfile->m_pNext) {
+        pProfile->m_pNext->m_pPrev = pProfile->m_pPrev;
+    }
+    pcCrit->m_pProfile = NULL;
+    CritProfileListUnlock();
+    delete pProfile;
+}
+
+void WINAPI CritProfileAll(BOOL fEnable)
+{
+    g_bCritProfileAll = fEnable;
+}
+
+void WINAPI CritProfileName(CCritSec * pcCrit, __in LPCTSTR pName)
+{
+    CCritSecProfile *pProfile = CritProfileAttach(pcCrit);
+    if (pProfile) {
+        CritProfileListLock();
+        StringCchCopy(pProfile->m_Stats.szName, NUMELMS(pProfile->m_Stats.szName), pName);
+        CritProfileListUnlock();
+    }
+}
+
+HRESULT WINAPI CritProfileGet(
+    __out_ecount_opt(cMax) AM_CRITSEC_PROFILE *pProfiles,
+    LONG cMax,
+    __out LONG *pcLocks)
+{
+    CheckPointer(pcLocks, E_POINTER);
+    if (cMax > 0) {
+        CheckPointer(pProfiles, E_POINTER);
+    }
+
+    LONG cLocks = 0;
+    CritProfileListLock();
+    for (CCritSecProfile *p = g_pCritProfiles; p; p = p->m_pNext) {
+        if (cLocks < cMax) {
+            p->Copy(&pProfiles[cLocks]);
+        }
+        cLocks++;
+    }
+    CritProfileListUnlock();
+
+    *pcLocks = cLocks;
+    return S_OK;
+}
+
+void WINAPI CritProfileReset()
+{
+    CritProfileListLock();
+    for (CCritSecProfile *p = g_pCritProfiles; p; p = p->m_pNext) {
+        InterlockedExchange(&p->m_lReset, 1);
+    }
+    CritProfileListUnlock();
+}
+
+static int __cdecl CritProfileCompare(const void *p1, const void *p2)
+{
+    LONGLONG ll1 = ((const AM_CRITSEC_PROFILE *) p1)->llWaitTime;
+    LONGLONG ll2 = ((const AM_CRITSEC_PROFILE *) p2)->llWaitTime;
+    return ll1 < ll2 ? 1 : ll1 > ll2 ? -1 : 0;
+}
+
+void WINAPI CritProfileDump()
+{
+    LONG cLocks;
+    CritProfileGet(NULL, 0, &cLocks);
+
+    // locks made meanwhile are left out
+    AM_CRITSEC_PROFILE *pProfiles = new AM_CRITSEC_PROFILE[max(cLocks, 1)];
+    if (pProfiles == NULL) {
+        return;
+    }
+    LONG cMax = cLocks;
+    CritProfileGet(pProfiles, cMax, &cLocks);
+    cLocks = min(cLocks, cMax);
+    qsort(pProfiles, cLocks, sizeof(pProfiles[0]), CritProfileCompare);
+
+    TCHAR sz[256];
+    for (LONG i = 0; i < cLocks; i++) {
+        const AM_CRITSEC_PROFILE *p = &pProfiles[i];
+        StringCchPrintf(sz, NUMELMS(sz),
+            TEXT("Lock %p %s: taken %I64d, waited for %I64d, wait %I64dus (max %I64d), held %I64dus (max %I64d)\r\n"),
+            p->pLock, p->szName, p->cAcquired, p->cContended,
+            p->llWaitTime, p->llMaxWait, p->llHoldTime, p->llMaxHold);
+        OutputDebugString(sz);
+        if (p->cContended == 0) {
+            continue;
+        }
+
+        TCHAR *pch = sz;
+        size_t cch = NUMELMS(sz);
+        StringCchPrintfEx(pch, cch, &pch, &cch, 0, TEXT("    waits by log2(us):"));
+        for (int j = 0; j < AM_CRITSEC_WAIT_BUCKETS; j++) {
+            StringCchPrintfEx(pch, cch, &pch, &cch, 0, TEXT(" %d"), p->aWaitHistogram[j]);
+        }
+        StringCchCopy(pch, cch, TEXT("\r\n"));
+        OutputDebugString(sz);
+
+        for (int j = 0; j < AM_CRITSEC_HOLDER_SITES && p->aHolders[j].cWaits; j++) {
+            StringCchPrintf(sz, NUMELMS(sz),
+                TEXT("    held at %p: waited for %d times, %I64dus\r\n"),
+                p->aHolders[j].pvSite, p->aHolders[j].cWaits, p->aHolders[j].llWaitTime);
+            OutputDebugString(sz);
+        }
+    }
+    delete [] pProfiles;
+}
+
+
+/******************************Public*Routine******************************\
+* CCritSec
+*
+* m_lState holds a locked bit, a waking bit and the number of threads
+* asleep on m_hWaiters. A thread that can't take the lock counts itself
+* in while the locked bit is still set, so the owner's Unlock is bound to
+* see it. Unlock wakes one sleeper, taking it off the count and setting
+* the waking bit so that later Unlocks don't wake more until that one has
+* run. The woken thread then tries for the lock like any other, so a
+* thread already running can take a lock that has just been freed instead
+* of the lock waiting for a sleeper to be scheduled.
+*
+* The owner is tracked in every build.  Debug builds can also log locking
+* for particular critical sections (see DbgLockTrace).
 *
 \**************************************************************************/
 
-CCritSec::CCritSec()
+#define CRITSEC_LOCKED      1
+#define CRITSEC_WAKING      2
+#define CRITSEC_WAITER      4
+
+// how many times a thread looks at a taken lock before it sleeps, on a
+// machine with more than one processor
+#define AM_CRITSEC_SPIN     1000
+
+static LONG g_cCritSpin = -1;
+
+CCritSec::CCritSec() :
+    m_lState(0),
+    m_hWaiters(NULL),
+    m_currentOwner(0),
+    m_lockCount(0),
+    m_pProfile(NULL)
 {
-    InitializeCriticalSection(&m_CritSec);
-    m_currentOwner = m_lockCount = 0;
+#ifdef DEBUG
     m_fTrace = FALSE;
+#endif
 }
 
 CCritSec::~CCritSec()
 {
-    DeleteCriticalSection(&m_CritSec);
+    if (m_pProfile) {
+        CritProfileDetach(this);
+    }
+    if (m_hWaiters) {
+        CloseHandle(m_hWaiters);
+    }
+}
+
+// the semaphore is created by whichever of the first sleeper and the
+// thread waking it gets here first
+
+HANDLE CCritSec::GetWaiters()
+{
+    HANDLE hWaiters = m_hWaiters;
+    while (hWaiters == NULL) {
+        hWaiters = CreateSemaphore(NULL, 0, MAXLONG, NULL);
+        if (hWaiters == NULL) {
+            // nothing else we can do - the sleeper can't give up
+            Sleep(1);
+            continue;
+        }
+        HANDLE hOld = InterlockedCompareExchangePointer(
+                          (PVOID volatile *) &m_hWaiters, hWaiters, NULL);
+        if (hOld != NULL) {
+            CloseHandle(hWaiters);
+            hWaiters = hOld;
+        }
+    }
+    return hWaiters;
+}
+
+void CCritSec::LockContended()
+{
+    CCritSecProfile *pProfile = m_pProfile;
+    LONGLONG llStart = 0;
+    PVOID pvHolder = NULL;
+    if (pProfile) {
+        llStart = CritProfileNow();
+        pvHolder = pProfile->m_pvHolder;
+    }
+
+    if (g_cCritSpin < 0) {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        g_cCritSpin = si.dwNumberOfProcessors > 1 ? AM_CRITSEC_SPIN : 0;
+    }
+
+    // the owner is usually about to let go
+    LONG cSpin = g_cCritSpin;
+    for (;;) {
+        LONG lState = m_lState;
+        if (!(lState & CRITSEC_LOCKED)) {
+            if (InterlockedCompareExchange(&m_lState, lState | CRITSEC_LOCKED, lState) == lState) {
+                break;
+            }
+            continue;
+        }
+        if (cSpin > 0) {
+            cSpin--;
+            YieldProcessor();
+            continue;
+        }
+        if (InterlockedCompareExchange(&m_lState, lState + CRITSEC_WAITER, lState) != lState) {
+            continue;
+        }
+
+        // Unlock took us off the count and set the waking bit for us
+        WaitForSingleObject(GetWaiters(), INFINITE);
+        InterlockedExchangeAdd(&m_lState, -CRITSEC_WAKING);
+    }
+
+    if (pProfile) {
+        pProfile->Waited(pvHolder, CritProfileNow() - llStart);
+    }
 }
 
 void CCritSec::Lock()
 {
-    UINT tracelevel=3;
     DWORD us = GetCurrentThreadId();
+    if (m_currentOwner == us) {
+        m_lockCount++;
+        return;
+    }
+
+    if (m_pProfile == NULL && g_bCritProfileAll) {
+        CritProfileAttach(this);
+    }
+
+#ifdef DEBUG
+    UINT tracelevel=3;
     DWORD currentOwner = m_currentOwner;
-    if (currentOwner && (currentOwner != us)) {
+    if (currentOwner) {
         // already owned, but not by us
         if (m_fTrace) {
             DbgLog((LOG_LOCKING, 2, TEXT("Thread %d about to wait for lock %x owned by %d"),
-                GetCurrentThreadId(), &m_CritSec, currentOwner));
+                GetCurrentThreadId(), this, currentOwner));
             tracelevel=2;
 	        // if we saw the message about waiting for the critical
 	        // section we ensure we see the message when we get the
 	        // critical section
         }
     }
-    EnterCriticalSection(&m_CritSec);
-    if (0 == m_lockCount++) {
-        // we now own it for the first time.  Set owner information
-        m_currentOwner = us;
+#endif
 
-        if (m_fTrace) {
-            DbgLog((LOG_LOCKING, tracelevel, TEXT("Thread %d now owns lock %x"), m_currentOwner, &m_CritSec));
-        }
+    if (InterlockedCompareExchange(&m_lState, CRITSEC_LOCKED, 0) != 0) {
+        LockContended();
+    }
+
+    // we now own it for the first time.  Set owner information
+    m_currentOwner = us;
+    m_lockCount = 1;
+
+    CCritSecProfile *pProfile = m_pProfile;
+    if (pProfile) {
+        pProfile->Acquired(_ReturnAddress());
     }
+
+#ifdef DEBUG
+    if (m_fTrace) {
+        DbgLog((LOG_LOCKING, tracelevel, TEXT("Thread %d now owns lock %x"), m_currentOwner, this));
+    }
+#endif
 }
 
 void CCritSec::Unlock() {
     if (0 == --m_lockCount) {
         // about to be unowned
+#ifdef DEBUG
         if (m_fTrace) {
-            DbgLog((LOG_LOCKING, 3, TEXT("Thread %d releasing lock %x"), m_currentOwner, &m_CritSec));
+            DbgLog((LOG_LOCKING, 3, TEXT("Thread %d releasing lock %x"), m_currentOwner, this));
+        }
+#endif
+        CCritSecProfile *pProfile = m_pProfile;
+        if (pProfile) {
+            pProfile->Released();
         }
 
         m_currentOwner = 0;
+        LONG lState = InterlockedExchangeAdd(&m_lState, -CRITSEC_LOCKED) - CRITSEC_LOCKED;
+
+        // wake a sleeper, unless one is already awake or the lock has
+        // been taken again - its owner will do it
+        while (lState >= CRITSEC_WAITER &&
+               !(lState & (CRITSEC_LOCKED | CRITSEC_WAKING))) {
+            LONG lWake = lState - CRITSEC_WAITER + CRITSEC_WAKING;
+            if (InterlockedCompareExchange(&m_lState, lWake, lState) == lState) {
+                ReleaseSemaphore(GetWaiters(), 1, NULL);
+                break;
+            }
+            lState = m_lState;
+        }
     }
-    LeaveCriticalSection(&m_CritSec);
 }
 
 void WINAPI DbgLockTrace(CCritSec * pcCrit, BOOL fTrace)
 {
+#ifdef DEBUG
     pcCrit->m_fTrace = fTrace;
+#endif
+    if (fTrace) {
+        CritProfileAttach(pcCrit);
+    }
 }
 
 BOOL WINAPI CritCheckIn(CCritSec * pcCrit)
@@ -544,7 +1025,6 @@ BOOL WINAPI CritCheckOut(const CCritSec * pcCrit)
 {
     return (GetCurrentThreadId() != pcCrit->m_currentOwner);
 }
-#endif
 
 
 STDAPI WriteBSTR(__deref_out BSTR *pstrDest, LPCWSTR szSrc)
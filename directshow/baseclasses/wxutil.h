@@ -15,6 +15,15 @@
 #pragma warning(disable: 4705)
 
 // wrapper for whatever critical section we have
+//
+// The lock itself is one LONG changed with the Interlocked functions, so
+// taking a free lock is one compare-and-swap. A thread that finds it taken
+// spins briefly, then sleeps on a semaphore until an Unlock wakes it to
+// try again. The semaphore is only created the first time a thread has to
+// sleep. Like a CRITICAL_SECTION the lock can be taken recursively.
+
+class CCritSecProfile;
+
 class CCritSec {
 
     // make copy constructor and assignment operator inaccessible
@@ -22,37 +31,25 @@ class CCritSec {
     CCritSec(const CCritSec &refCritSec);
     CCritSec &operator=(const CCritSec &refCritSec);
 
-    CRITICAL_SECTION m_CritSec;
+    volatile LONG   m_lState;       // locked, waking, sleepers
+    HANDLE volatile m_hWaiters;     // semaphore the sleepers wait on
+
+    HANDLE GetWaiters();
+    void LockContended();
 
-#ifdef DEBUG
 public:
     DWORD   m_currentOwner;
     DWORD   m_lockCount;
+    CCritSecProfile * volatile m_pProfile;  // NULL unless profiled
+#ifdef DEBUG
     BOOL    m_fTrace;        // Trace this one
+#endif
+
 public:
     CCritSec();
     ~CCritSec();
     void Lock();
     void Unlock();
-#else
-
-public:
-    CCritSec() {
-        InitializeCriticalSection(&m_CritSec);
-    };
-
-    ~CCritSec() {
-        DeleteCriticalSection(&m_CritSec);
-    };
-
-    void Lock() {
-        EnterCriticalSection(&m_CritSec);
-    };
-
-    void Unlock() {
-        LeaveCriticalSection(&m_CritSec);
-    };
-#endif
 };
 
 //
@@ -64,18 +61,68 @@ public:
 // a routine that allows usage of specific critical sections to be
 // traced.  This is NOT on by default - there are far too many.
 //
+// The owner is tracked in retail builds too, so the checks work there,
+// and DbgLockTrace turns on the contention profiler below for the lock
+// in any build. Debug builds also log each lock and unlock as before.
+//
 
-#ifdef DEBUG
-    BOOL WINAPI CritCheckIn(CCritSec * pcCrit);
-    BOOL WINAPI CritCheckIn(const CCritSec * pcCrit);
-    BOOL WINAPI CritCheckOut(CCritSec * pcCrit);
-    BOOL WINAPI CritCheckOut(const CCritSec * pcCrit);
-    void WINAPI DbgLockTrace(CCritSec * pcCrit, BOOL fTrace);
-#else
-    #define CritCheckIn(x) TRUE
-    #define CritCheckOut(x) TRUE
-    #define DbgLockTrace(pc, fT)
-#endif
+BOOL WINAPI CritCheckIn(CCritSec * pcCrit);
+BOOL WINAPI CritCheckIn(const CCritSec * pcCrit);
+BOOL WINAPI CritCheckOut(CCritSec * pcCrit);
+BOOL WINAPI CritCheckOut(const CCritSec * pcCrit);
+void WINAPI DbgLockTrace(CCritSec * pcCrit, BOOL fTrace);
+
+//
+// Contention profiling. A profiled lock counts its acquisitions, times
+// how long it is held and how long each thread that found it taken had to
+// wait, and notes where the lock was taken by whoever held it while
+// others waited - the return address of the Lock call. Waits go into a
+// histogram whose bucket i counts waits shorter than 2^i microseconds,
+// the last bucket taking the rest. Times are in microseconds.
+//
+// CritProfileAll(TRUE) profiles every lock from its next Lock on; locks
+// can also be profiled one at a time with DbgLockTrace or
+// CritProfileName. Only locks still alive are reported.
+//
+
+#define AM_CRITSEC_WAIT_BUCKETS 16
+#define AM_CRITSEC_HOLDER_SITES 8
+
+struct AM_CRITSEC_PROFILE {
+    const CCritSec *pLock;
+    TCHAR    szName[32];
+    LONGLONG cAcquired;
+    LONGLONG cContended;            // acquisitions that had to wait
+    LONGLONG llWaitTime;            // summed over the contended ones
+    LONGLONG llMaxWait;
+    LONGLONG llHoldTime;
+    LONGLONG llMaxHold;
+    LONG     aWaitHistogram[AM_CRITSEC_WAIT_BUCKETS];
+
+    // who held the lock while others waited, a NULL site for the
+    // overflow once there are more than AM_CRITSEC_HOLDER_SITES
+    struct {
+        PVOID    pvSite;
+        LONG     cWaits;
+        LONGLONG llWaitTime;
+    } aHolders[AM_CRITSEC_HOLDER_SITES];
+};
+
+void WINAPI CritProfileAll(BOOL fEnable);
+void WINAPI CritProfileName(CCritSec * pcCrit, __in LPCTSTR pName);
+
+// copy out up to cMax profiles - *pcLocks is the number there are
+HRESULT WINAPI CritProfileGet(
+    __out_ecount_opt(cMax) AM_CRITSEC_PROFILE *pProfiles,
+    LONG cMax,
+    __out LONG *pcLocks);
+
+// start the counts again. Each lock's are cleared by whoever takes it
+// next, never under its holder's feet, and read as clear until then
+void WINAPI CritProfileReset();
+
+// write the profiles to the debugger, most waited for first
+void WINAPI CritProfileDump();
 
 
 // locks a critical section, and unlocks it automatically
@@ -168,6 +215,10 @@ class AM_NOVTABLE CAMThread {
     DWORD m_dwParam;
     DWORD m_dwReturnVal;
 
+    // set when ThreadProc returns, if it runs on a loop thread of the
+    // shared CAMTaskScheduler - that thread carries on after it
+    HANDLE m_hLoopDone;
+
 protected:
     HANDLE m_hThread;
 
@@ -204,8 +255,12 @@ public:
 #pragma warning(pop)
 
         if (hThread) {
-            WaitForSingleObject(hThread, INFINITE);
+            WaitForSingleObject(m_hLoopDone ? m_hLoopDone : hThread, INFINITE);
             CloseHandle(hThread);
+            if (m_hLoopDone) {
+                CloseHandle(m_hLoopDone);
+                m_hLoopDone = NULL;
+            }
         }
     };
 
@@ -0,0 +1,252 @@
+//------------------------------------------------------------------------------
+// File: AllocBench.cpp
+//
+// Desc: Benchmarks for the ways CMemAllocator hands out samples.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+/* The benchmarks are
+
+       batch       1 and 4 threads each taking samples from a CMemAllocator
+                   with 64 samples in batches of 1, 4 and 16, either with
+                   one GetBuffer per sample or with one GetBuffers
+                   (AM_GBF_BATCH_ALL) per batch, then releasing the batch.
+                   Run with the locked and the lock-free free list. Reports
+                   samples per second and the 99th percentile time to get
+                   a whole batch
+       views       cutting 64KB, 1MB and 4MB samples into 4, 16 and 64
+                   slices, either by copying each slice into a buffer of
+                   its own from a CMemAllocator or with one SplitSample
+                   into views on the original. Reports samples per second
+                   and the equivalent MB/s through the filter
+
+   Build it with "make allocbench" and run it as "allocbench [benchmark]" */
+
+
+#include "perfutil.h"
+
+
+// --- batch ----------------------------------------------------------
+
+static const LONG c_lBatchSamples = 64;
+static const LONG c_lBatchPerThread = 400000;     // samples per thread
+static const LONG c_lMaxBatch = 16;
+
+struct BATCHBENCH {
+    CMemAllocator *pAllocator;
+    LONG cBatch;
+    BOOL bBatched;                      // GetBuffers rather than GetBuffer
+    std::vector<LONGLONG> *pTimes;      // one vector per thread
+};
+
+static void BatchThread(void *pv, int iThread)
+{
+    BATCHBENCH *pBench = (BATCHBENCH *) pv;
+    std::vector<LONGLONG> &Times = pBench->pTimes[iThread];
+    IMediaSample *apSamples[c_lMaxBatch];
+    LONG cBatches = c_lBatchPerThread / pBench->cBatch;
+
+    for (LONG i = 0; i < cBatches; i++) {
+        LONGLONG llStart = (i & 7) == 0 ? PerfNanoseconds() : 0;
+        if (pBench->bBatched) {
+            LONG cReturned;
+            PERF_CHECK(SUCCEEDED(pBench->pAllocator->GetBuffers(
+                pBench->cBatch, apSamples, &cReturned, AM_GBF_BATCH_ALL)));
+            PERF_CHECK(cReturned == pBench->cBatch);
+        } else {
+            for (LONG j = 0; j < pBench->cBatch; j++) {
+                PERF_CHECK(SUCCEEDED(pBench->pAllocator->GetBuffer(&apSamples[j], NULL, NULL, 0)));
+            }
+        }
+        if (llStart) {
+            Times.push_back(PerfNanoseconds() - llStart);
+        }
+        for (LONG j = 0; j < pBench->cBatch; j++) {
+            apSamples[j]->Release();
+        }
+    }
+}
+
+static void RunBatch(BOOL bLockFree, int cThreads, LONG cBatch, BOOL bBatched)
+{
+    HRESULT hr = S_OK;
+    BATCHBENCH Bench;
+    Bench.pAllocator = new CMemAllocator(NAME("allocbench"), NULL, &hr);
+    Bench.pAllocator->AddRef();
+    PERF_CHECK(SUCCEEDED(Bench.pAllocator->SetLockFreeMode(bLockFree)));
+    ALLOCATOR_PROPERTIES Request = { c_lBatchSamples, 4096, 1, 0 }, Actual;
+    PERF_CHECK(SUCCEEDED(Bench.pAllocator->SetProperties(&Request, &Actual)));
+    PERF_CHECK(SUCCEEDED(Bench.pAllocator->Commit()));
+    Bench.cBatch = cBatch;
+    Bench.bBatched = bBatched;
+    Bench.pTimes = new std::vector<LONGLONG>[cThreads];
+
+    LONGLONG llStart = PerfNanoseconds();
+    CPerfThreads::Run(cThreads, BatchThread, &Bench);
+    LONGLONG llTime = PerfNanoseconds() - llStart;
+
+    std::vector<LONGLONG> All;
+    for (int i = 0; i < cThreads; i++) {
+        All.insert(All.end(), Bench.pTimes[i].begin(), Bench.pTimes[i].end());
+    }
+    LONG cSamples = c_lBatchPerThread / cBatch * cBatch;
+    printf("%-10s %8d %6ld %-11s %12.0f %10lld\n",
+           bLockFree ? "lock-free" : "locked", cThreads, cBatch,
+           bBatched ? "GetBuffers" : "GetBuffer",
+           (double) cSamples * cThreads * 1e9 / llTime,
+           PerfPercentile(All, 99.0));
+
+    Bench.pAllocator->Decommit();
+    Bench.pAllocator->Release();
+    delete [] Bench.pTimes;
+}
+
+static void BenchBatch()
+{
+    printf("batch: %ld samples per thread, %ld in the allocator\n",
+           c_lBatchPerThread, c_lBatchSamples);
+    printf("%-10s %8s %6s %-11s %12s %10s\n", "", "threads", "batch", "",
+           "samples/s", "p99 ns");
+    for (int iLockFree = 0; iLockFree < 2; iLockFree++) {
+        for (int cThreads = 1; cThreads <= 4; cThreads *= 4) {
+            for (LONG cBatch = 1; cBatch <= c_lMaxBatch; cBatch *= 4) {
+                RunBatch(iLockFree, cThreads, cBatch, FALSE);
+                RunBatch(iLockFree, cThreads, cBatch, TRUE);
+            }
+        }
+    }
+    printf("\n");
+}
+
+// --- views ----------------------------------------------------------
+
+static const LONG c_lMaxSlices = 64;
+
+// time cutting pParent into cSlices pieces lIterations times
+static LONGLONG TimeSlicing(IMediaSample *pParent, LONG cSlices, BOOL bViews,
+                            LONG lIterations)
+{
+    HRESULT hr = S_OK;
+    LONG cbParent = pParent->GetActualDataLength();
+    LONG cbSlice = cbParent / cSlices;
+    LONG alLengths[c_lMaxSlices];
+    for (LONG i = 0; i < cSlices; i++) {
+        alLengths[i] = cbSlice;
+    }
+
+    CSampleViewAllocator *pViews = new CSampleViewAllocator(NAME("allocbench"), &hr);
+    pViews->AddRef();
+    PERF_CHECK(SUCCEEDED(pViews->SetCount(cSlices)));
+    PERF_CHECK(SUCCEEDED(pViews->Commit()));
+    CMemAllocator *pCopies = new CMemAllocator(NAME("allocbench"), NULL, &hr);
+    pCopies->AddRef();
+    ALLOCATOR_PROPERTIES Request = { cSlices, cbSlice, 1, 0 }, Actual;
+    PERF_CHECK(SUCCEEDED(pCopies->SetProperties(&Request, &Actual)));
+    PERF_CHECK(SUCCEEDED(pCopies->Commit()));
+
+    BYTE *pbParent;
+    PERF_CHECK(SUCCEEDED(pParent->GetPointer(&pbParent)));
+    IMediaSample *apSlices[c_lMaxSlices];
+
+    // an untimed first pass, so the copies' buffers are already faulted in
+    LONGLONG llStart = 0;
+    for (LONG lIteration = -1; lIteration < lIterations; lIteration++) {
+        if (lIteration == 0) {
+            llStart = PerfNanoseconds();
+        }
+        if (bViews) {
+            PERF_CHECK(SUCCEEDED(pViews->SplitSample(pParent, cSlices, alLengths, apSlices)));
+        } else {
+            LONG cReturned;
+            PERF_CHECK(SUCCEEDED(pCopies->GetBuffers(cSlices, apSlices, &cReturned,
+                                                     AM_GBF_BATCH_ALL)));
+            for (LONG i = 0; i < cSlices; i++) {
+                BYTE *pb;
+                apSlices[i]->GetPointer(&pb);
+                CopyMemory(pb, pbParent + i * cbSlice, cbSlice);
+                apSlices[i]->SetActualDataLength(cbSlice);
+            }
+        }
+        for (LONG i = 0; i < cSlices; i++) {
+            apSlices[i]->Release();
+        }
+    }
+    LONGLONG llTime = PerfNanoseconds() - llStart;
+
+    pViews->Decommit();
+    pViews->Release();
+    pCopies->Decommit();
+    pCopies->Release();
+    return llTime;
+}
+
+static void BenchViews()
+{
+    printf("views: cutting one sample into slices\n");
+    printf("%8s %7s %12s %12s %12s %12s\n", "sample", "slices",
+           "copy /s", "copy MB/s", "views /s", "views MB/s");
+
+    static const LONG acbParents[] = { 64 << 10, 1 << 20, 4 << 20 };
+    for (size_t iSize = 0; iSize < NUMELMS(acbParents); iSize++) {
+        LONG cbParent = acbParents[iSize];
+        HRESULT hr = S_OK;
+        CMemAllocator *pParents = new CMemAllocator(NAME("allocbench"), NULL, &hr);
+        pParents->AddRef();
+        ALLOCATOR_PROPERTIES Request = { 1, cbParent, 1, 0 }, Actual;
+        PERF_CHECK(SUCCEEDED(pParents->SetProperties(&Request, &Actual)));
+        PERF_CHECK(SUCCEEDED(pParents->Commit()));
+        IMediaSample *pParent;
+        PERF_CHECK(SUCCEEDED(pParents->GetBuffer(&pParent, NULL, NULL, 0)));
+        BYTE *pb;
+        pParent->GetPointer(&pb);
+        memset(pb, 0x5A, cbParent);
+        pParent->SetActualDataLength(cbParent);
+
+        // about 256MB through the copying path each time
+        LONG lIterations = (std::max)(16L, (LONG) ((256 << 20) / cbParent));
+        for (LONG cSlices = 4; cSlices <= c_lMaxSlices; cSlices *= 4) {
+            LONGLONG llCopy = TimeSlicing(pParent, cSlices, FALSE, lIterations);
+            LONGLONG llViews = TimeSlicing(pParent, cSlices, TRUE, lIterations);
+            printf("%6ldKB %7ld %12.0f %12.0f %12.0f %12.0f\n", cbParent >> 10, cSlices,
+                   lIterations * 1e9 / llCopy,
+                   (double) lIterations * cbParent * 1e9 / llCopy / (1 << 20),
+                   lIterations * 1e9 / llViews,
+                   (double) lIterations * cbParent * 1e9 / llViews / (1 << 20));
+        }
+
+        pParent->Release();
+        pParents->Decommit();
+        pParents->Release();
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct {
+        const char *pszName;
+        void (*pfnBench)();
+    } Benches[] = {
+        { "batch", BenchBatch },
+        { "views", BenchViews }
+    };
+
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    printf("%u processors\n\n", si.dwNumberOfProcessors);
+
+    BOOL bRan = FALSE;
+    for (size_t i = 0; i < NUMELMS(Benches); i++) {
+        if (argc < 2 || strcmp(argv[1], Benches[i].pszName) == 0) {
+            Benches[i].pfnBench();
+            bRan = TRUE;
+        }
+    }
+    if (!bRan) {
+        fprintf(stderr, "allocbench: no benchmark called %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
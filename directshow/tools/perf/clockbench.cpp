@@ -0,0 +1,119 @@
+//------------------------------------------------------------------------------
+// File: ClockBench.cpp
+//
+// Desc: Advise wakeup jitter benchmark for CBaseReferenceClock with the
+//       timeGetTime and the performance counter time sources.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+/* A client thread asks the clock for a one-shot advise 1 to 4ms ahead,
+   waits for the event and notes, by the host's own monotonic clock, how
+   far from the requested moment it woke up. That is done for each of
+
+       tick        CAMTickTimeSource, the old default
+       counter     CAMCounterTimeSource
+       tick spin   CAMTickTimeSource with SetAdaptiveWait spinning the last
+                   2ms
+       counter spin  CAMCounterTimeSource, likewise
+
+   and we report the percentiles of the error, negative when the event was
+   set early, and then what the clock itself recorded in
+   GetWakeupStatistics: the mean and worst lateness, and the bucket that
+   the 50th and 99th percentile wakeups fell in.
+
+   The shim's timeGetTime is a millisecond count of the host's monotonic
+   clock, like Windows with timeBeginPeriod(1), and its counter runs at
+   10MHz, so this shows what the sources do with the resolution they are
+   given, not the 15.6ms default tick of an idle Windows machine.
+
+   Build it with "make clockbench" and run it as "clockbench" */
+
+
+#include "perfutil.h"
+
+
+static const LONG c_lAdvises = 300;
+
+// the upper bounds of the AM_CLOCK_WAKEUP_STATISTICS buckets, in us
+static const LONG c_alBucketLimits[AM_WAKEUP_BUCKETS] =
+    { 50, 100, 250, 500, 1000, 2000, 5000, -1 };
+
+static const char *BucketFor(const AM_CLOCK_WAKEUP_STATISTICS *pStats, double dPercent)
+{
+    static char aszNames[2][16];
+    static int iName;
+    DWORD cTarget = (DWORD) (dPercent / 100.0 * pStats->cWakeups + 0.5);
+    DWORD cSeen = 0;
+    char *psz = aszNames[iName++ & 1];
+    for (int i = 0; i < AM_WAKEUP_BUCKETS; i++) {
+        cSeen += pStats->acLateness[i];
+        if (cSeen >= cTarget) {
+            if (c_alBucketLimits[i] < 0) {
+                sprintf(psz, ">%ldus", c_alBucketLimits[i - 1]);
+            } else {
+                sprintf(psz, "<%ldus", c_alBucketLimits[i]);
+            }
+            return psz;
+        }
+    }
+    return "-";
+}
+
+static void RunClock(const char *pszName, BOOL bCounter, BOOL bSpin)
+{
+    HRESULT hr = S_OK;
+    CBaseReferenceClock *pClock = new CBaseReferenceClock(NAME("clockbench"), NULL, &hr);
+    pClock->AddRef();
+    PERF_CHECK(SUCCEEDED(hr));
+    if (bCounter) {
+        CAMCounterTimeSource *pSource = new CAMCounterTimeSource(&hr);
+        PERF_CHECK(SUCCEEDED(hr));
+        PERF_CHECK(SUCCEEDED(pClock->SetTimeSource(pSource)));
+    }
+    if (bSpin) {
+        PERF_CHECK(SUCCEEDED(pClock->SetAdaptiveWait(20000)));
+    }
+    pClock->ResetWakeupStatistics();
+
+    HANDLE hEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    std::vector<LONGLONG> Errors;
+    DWORD dwSeed = 1;
+    for (LONG i = 0; i < c_lAdvises; i++) {
+        REFERENCE_TIME rtNow, rtDelay = 10000 + PerfRandom(&dwSeed) % 30000;
+        PERF_CHECK(SUCCEEDED(pClock->GetTime(&rtNow)));
+        LONGLONG llDue = PerfNanoseconds() + rtDelay * 100;
+        DWORD_PTR dwCookie;
+        PERF_CHECK(SUCCEEDED(pClock->AdviseTime(rtNow, rtDelay, (HEVENT) hEvent, &dwCookie)));
+        PERF_CHECK(WaitForSingleObject(hEvent, 1000) == WAIT_OBJECT_0);
+        Errors.push_back(PerfNanoseconds() - llDue);
+    }
+    CloseHandle(hEvent);
+
+    AM_CLOCK_WAKEUP_STATISTICS Stats;
+    PERF_CHECK(SUCCEEDED(pClock->GetWakeupStatistics(&Stats)));
+    pClock->Release();
+
+    printf("%-13s %8.0f %8.0f %8.0f %8.0f %8.0f | %9.0f %9.0f %9s %9s\n", pszName,
+           PerfPercentile(Errors, 1.0) / 1e3,
+           PerfPercentile(Errors, 50.0) / 1e3,
+           PerfPercentile(Errors, 90.0) / 1e3,
+           PerfPercentile(Errors, 99.0) / 1e3,
+           PerfPercentile(Errors, 100.0) / 1e3,
+           Stats.cWakeups ? Stats.rtTotalLateness / 10.0 / Stats.cWakeups : 0.0,
+           Stats.rtMaxLateness / 10.0,
+           BucketFor(&Stats, 50.0), BucketFor(&Stats, 99.0));
+}
+
+int main(int argc, char *argv[])
+{
+    printf("%ld advises 1-4ms ahead; error in us, negative is early\n\n", c_lAdvises);
+    printf("%-13s %8s %8s %8s %8s %8s | %9s %9s %9s %9s\n", "", "p1", "p50", "p90",
+           "p99", "max", "mean late", "max late", "p50 late", "p99 late");
+    RunClock("tick", FALSE, FALSE);
+    RunClock("counter", TRUE, FALSE);
+    RunClock("tick spin", FALSE, TRUE);
+    RunClock("counter spin", TRUE, TRUE);
+    return 0;
+}
@@ -0,0 +1,161 @@
+//------------------------------------------------------------------------------
+// File: ConvStress.cpp
+//
+// Desc: Checks that the SSE2 and AVX2 conversions of CAMVideoConverter give
+//       exactly what the C reference does.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+/* The test is
+
+       match       every conversion that has an SSE2 or AVX2 version, at
+                   widths either side of each vector size and up to 1920
+                   pixels, with RGB both bottom-up and top-down, converts
+                   random images at the reference level and at each level
+                   the processor supports. The outputs must be identical
+                   byte for byte, and nothing may be written past the end
+                   of the output image
+
+   Random pixels reach every value of Y, U and V, so the clipping at both
+   ends of the RGB range is covered along with everything in between.
+
+   Build it with "make convstress" and run it as "convstress [test]" */
+
+
+#include "perfutil.h"
+
+
+static const struct {
+    const GUID *pSubtype;
+    const char *pszName;
+} c_Subtypes[] = {
+    { &MEDIASUBTYPE_YUY2, "YUY2" },
+    { &MEDIASUBTYPE_UYVY, "UYVY" },
+    { &MEDIASUBTYPE_NV12, "NV12" },
+    { &MEDIASUBTYPE_RGB32, "RGB32" },
+    { &MEDIASUBTYPE_RGB24, "RGB24" }
+};
+
+static const char *c_aszLevels[] = { "C", "SSE2", "AVX2" };
+
+// bytes after each output image that must be left alone
+static const LONG c_cbGuard = 256;
+static const BYTE c_bGuard = 0xCD;
+
+// --- match ----------------------------------------------------------
+
+// convert one random image at Level and at the reference level and
+// compare; returns FALSE if there is no Level version of this conversion
+static BOOL MatchImage(size_t iSrc, size_t iDst, AM_VCONVERT_LEVEL Level,
+                       LONG lWidth, LONG lHeight, DWORD *pdwSeed)
+{
+    AM_MEDIA_TYPE mtIn, mtOut;
+    VIDEOINFOHEADER vihIn, vihOut;
+    PerfVideoType(c_Subtypes[iSrc].pSubtype, lWidth, abs(lHeight), &mtIn, &vihIn);
+    PerfVideoType(c_Subtypes[iDst].pSubtype, lWidth, lHeight, &mtOut, &vihOut);
+
+    CAMVideoConverter Reference, Converter;
+    PERF_CHECK(SUCCEEDED(Reference.Initialize(&mtIn, &mtOut, AM_VCONVERT_SCALAR)));
+    PERF_CHECK(SUCCEEDED(Converter.Initialize(&mtIn, &mtOut, Level)));
+    if (Converter.GetLevel() != Level) {
+        return FALSE;
+    }
+
+    LONG cbIn = vihIn.bmiHeader.biSizeImage;
+    LONG cbOut = vihOut.bmiHeader.biSizeImage;
+    std::vector<BYTE> In(cbIn), Expected(cbOut + c_cbGuard, c_bGuard),
+                      Actual(cbOut + c_cbGuard, c_bGuard);
+    for (LONG i = 0; i < cbIn; i++) {
+        In[i] = (BYTE) PerfRandom(pdwSeed);
+    }
+    PERF_CHECK(SUCCEEDED(Reference.ConvertImage(&In[0], &Expected[0])));
+    PERF_CHECK(SUCCEEDED(Converter.ConvertImage(&In[0], &Actual[0])));
+
+    if (Expected != Actual) {
+        LONG i = 0;
+        while (Expected[i] == Actual[i]) {
+            i++;
+        }
+        fprintf(stderr, "match: %s to %s at %s, %ldx%ld: byte %ld of %ld is %02X, not %02X\n",
+                c_Subtypes[iSrc].pszName, c_Subtypes[iDst].pszName, c_aszLevels[Level],
+                lWidth, lHeight, i, cbOut, Actual[i], Expected[i]);
+        PERF_CHECK(Expected == Actual);
+    }
+    return TRUE;
+}
+
+static void TestMatch()
+{
+    static const LONG alWidths[] = {
+        2, 4, 6, 8, 10, 14, 16, 18, 22, 30, 32, 34, 46, 62, 64, 66,
+        94, 126, 128, 130, 254, 258, 638, 640, 642, 1280, 1918, 1920
+    };
+    static const LONG alHeights[] = { 2, 6, -2, -6 };
+
+    AM_VCONVERT_LEVEL Best = CAMVideoConverter::GetProcessorLevel();
+    printf("match: processor level %s\n", c_aszLevels[Best]);
+    DWORD dwSeed = 1;
+    LONG cChecked = 0;
+    for (size_t iSrc = 0; iSrc < NUMELMS(c_Subtypes); iSrc++) {
+        for (size_t iDst = 0; iDst < NUMELMS(c_Subtypes); iDst++) {
+            if (!CAMVideoConverter::CanConvert(c_Subtypes[iSrc].pSubtype,
+                                               c_Subtypes[iDst].pSubtype)) {
+                continue;
+            }
+            for (int iLevel = AM_VCONVERT_SSE2; iLevel <= Best; iLevel++) {
+                LONG cImages = 0;
+                for (size_t iWidth = 0; iWidth < NUMELMS(alWidths); iWidth++) {
+                    for (size_t iHeight = 0; iHeight < NUMELMS(alHeights); iHeight++) {
+                        // only RGB has a top-down form distinct from the other
+                        if (alHeights[iHeight] < 0 &&
+                            c_Subtypes[iDst].pSubtype != &MEDIASUBTYPE_RGB32 &&
+                            c_Subtypes[iDst].pSubtype != &MEDIASUBTYPE_RGB24) {
+                            continue;
+                        }
+                        if (!MatchImage(iSrc, iDst, (AM_VCONVERT_LEVEL) iLevel,
+                                        alWidths[iWidth], alHeights[iHeight], &dwSeed)) {
+                            break;
+                        }
+                        cImages++;
+                    }
+                }
+                if (cImages) {
+                    printf("match: %-5s to %-5s at %-4s %4ld images identical\n",
+                           c_Subtypes[iSrc].pszName, c_Subtypes[iDst].pszName,
+                           c_aszLevels[iLevel], cImages);
+                    cChecked++;
+                }
+            }
+        }
+    }
+    // YUY2 and UYVY to RGB32 and to each other, and NV12 to RGB32
+    if (Best > AM_VCONVERT_SCALAR) {
+        PERF_CHECK(cChecked == 5 * (Best - AM_VCONVERT_SCALAR));
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct {
+        const char *pszName;
+        void (*pfnTest)();
+    } Tests[] = {
+        { "match", TestMatch }
+    };
+
+    PerfWatchdog(300);
+    BOOL bRan = FALSE;
+    for (size_t i = 0; i < NUMELMS(Tests); i++) {
+        if (argc < 2 || strcmp(argv[1], Tests[i].pszName) == 0) {
+            Tests[i].pfnTest();
+            bRan = TRUE;
+        }
+    }
+    if (!bRan) {
+        fprintf(stderr, "convstress: no test called %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
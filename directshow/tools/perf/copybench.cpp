@@ -0,0 +1,192 @@
+//------------------------------------------------------------------------------
+// File: CopyBench.cpp
+//
+// Desc: Cached against streaming copy benchmark for CAMMemCopy, from 1KB to
+//       64MB, to check where its streaming threshold should be.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+/* For each size from 1KB to 64MB we copy between two buffers over and over,
+   once with memcpy (CopyCached) and once with the best non-temporal kernel
+   (Copy with the threshold at its minimum, so from 16KB). For each we
+   report
+
+       GB/s        the copy on its own
+       +read GB/s  the copy and then a pass reading the destination, as a
+                   filter consuming what was just copied would
+       hot x       how much longer a pass over a 1MB working set - a table
+                   the filter keeps using, say - takes after the copy than
+                   with nothing in between; a copy that has pushed the
+                   working set out of the cache costs its owner later
+
+   and then the sizes from which streaming comes out ahead on each count,
+   next to the threshold DetectThreshold picked from the largest cache.
+
+   Streaming is for copies whose data isn't wanted again soon: it should
+   lose on +read until the copy no longer fits in the cache at all, and win
+   on hot x once the copy would evict the working set. The threshold
+   should sit between the two.
+
+   Build it with "make copybench" and run it as "copybench" */
+
+
+#include "perfutil.h"
+
+
+static const SIZE_T c_cbMin = 1 << 10;
+static const SIZE_T c_cbMax = 64 << 20;
+static const SIZE_T c_cbHot = 1 << 20;
+static const SIZE_T c_cbPerSize = 512 << 20;   // bytes copied at each size
+
+static BYTE *g_pbSrc;
+static BYTE *g_pbDst;
+static BYTE *g_pbHot;
+
+// sum a buffer 8 bytes at a time, so the reads can't be optimized away
+static ULONGLONG ReadBuffer(const BYTE *pb, SIZE_T cb)
+{
+    const ULONGLONG *pull = (const ULONGLONG *) pb;
+    ULONGLONG ullSum = 0;
+    for (SIZE_T i = 0; i < cb / 8; i++) {
+        ullSum += pull[i];
+    }
+    return ullSum;
+}
+
+static void CopyOnce(BOOL bStream, SIZE_T cb)
+{
+    if (bStream) {
+        CAMMemCopy::Copy(g_pbDst, g_pbSrc, cb);
+    } else {
+        CAMMemCopy::CopyCached(g_pbDst, g_pbSrc, cb);
+    }
+}
+
+struct COPYRESULT {
+    double dCopy;       // GB/s
+    double dRead;       // GB/s of copying, with the read afterwards
+    double dHot;        // working set pass after the copy, over without
+};
+
+static volatile ULONGLONG g_ullSink;
+
+static COPYRESULT TimeCopy(BOOL bStream, SIZE_T cb)
+{
+    COPYRESULT Result;
+    LONG lIterations = (LONG) (std::max)(c_cbPerSize / cb, (SIZE_T) 4);
+
+    CopyOnce(bStream, cb);
+    LONGLONG llStart = PerfNanoseconds();
+    for (LONG i = 0; i < lIterations; i++) {
+        CopyOnce(bStream, cb);
+    }
+    Result.dCopy = (double) cb * lIterations / (PerfNanoseconds() - llStart);
+
+    ULONGLONG ullSum = 0;
+    llStart = PerfNanoseconds();
+    for (LONG i = 0; i < lIterations; i++) {
+        CopyOnce(bStream, cb);
+        ullSum += ReadBuffer(g_pbDst, cb);
+    }
+    Result.dRead = (double) cb * lIterations / (PerfNanoseconds() - llStart);
+
+    // the working set pass on its own, then after each copy; enough rounds
+    // to see past the timer at the small sizes
+    LONG lRounds = (LONG) (std::max)((SIZE_T) 16, (SIZE_T) (64 << 20) / (cb + c_cbHot));
+    LONGLONG llAlone = 0, llAfter = 0;
+    ullSum += ReadBuffer(g_pbHot, c_cbHot);
+    for (LONG i = 0; i < lRounds; i++) {
+        LONGLONG llPass = PerfNanoseconds();
+        ullSum += ReadBuffer(g_pbHot, c_cbHot);
+        llAlone += PerfNanoseconds() - llPass;
+
+        CopyOnce(bStream, cb);
+        llPass = PerfNanoseconds();
+        ullSum += ReadBuffer(g_pbHot, c_cbHot);
+        llAfter += PerfNanoseconds() - llPass;
+    }
+    Result.dHot = (double) llAfter / llAlone;
+    g_ullSink += ullSum;
+    return Result;
+}
+
+static void FormatSize(char *psz, SIZE_T cb)
+{
+    if (cb == 0) {
+        strcpy(psz, "never");
+    } else if (cb >= (1 << 20)) {
+        sprintf(psz, "%luMB", (unsigned long) (cb >> 20));
+    } else {
+        sprintf(psz, "%luKB", (unsigned long) (cb >> 10));
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    SIZE_T cbThreshold = CAMMemCopy::GetStreamingThreshold();
+    AM_COPY_KERNEL Kernel = CAMMemCopy::GetBestKernel();
+    PERF_CHECK(SUCCEEDED(CAMMemCopy::SetKernel(Kernel)));
+    CAMMemCopy::SetStreamingThreshold(0);
+
+    // the caches the threshold was worked out from
+    SYSTEM_LOGICAL_PROCESSOR_INFORMATION aInfo[32];
+    DWORD cbInfo = sizeof(aInfo);
+    SIZE_T cbLargest = 0;
+    if (GetLogicalProcessorInformation(aInfo, &cbInfo)) {
+        for (DWORD i = 0; i < cbInfo / sizeof(aInfo[0]); i++) {
+            if (aInfo[i].Relationship == RelationCache && aInfo[i].Cache.Type != CacheInstruction) {
+                printf("L%u cache %luKB\n", aInfo[i].Cache.Level,
+                       (unsigned long) (aInfo[i].Cache.Size >> 10));
+                cbLargest = (std::max)(cbLargest, (SIZE_T) aInfo[i].Cache.Size);
+            }
+        }
+    }
+    char szThreshold[16];
+    FormatSize(szThreshold, cbThreshold);
+    printf("kernel %d, DetectThreshold picked %s\n\n", Kernel, szThreshold);
+
+    g_pbSrc = (BYTE *) VirtualAlloc(NULL, c_cbMax, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    g_pbDst = (BYTE *) VirtualAlloc(NULL, c_cbMax, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    g_pbHot = (BYTE *) VirtualAlloc(NULL, c_cbHot, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    PERF_CHECK(g_pbSrc && g_pbDst && g_pbHot);
+    memset(g_pbSrc, 0x5A, c_cbMax);
+    memset(g_pbDst, 0xA5, c_cbMax);
+    memset(g_pbHot, 0x3C, c_cbHot);
+
+    printf("%8s | %8s %10s %7s | %8s %10s %7s\n", "", "memcpy", "", "", "stream", "", "");
+    printf("%8s | %8s %10s %7s | %8s %10s %7s\n", "size", "GB/s", "+read GB/s", "hot x",
+           "GB/s", "+read GB/s", "hot x");
+
+    // the smallest sizes from which streaming wins at every larger size
+    SIZE_T cbCopyWins = 0, cbReadWins = 0, cbHotWins = 0;
+    for (SIZE_T cb = c_cbMin; cb <= c_cbMax; cb *= 2) {
+        char szSize[16];
+        FormatSize(szSize, cb);
+        COPYRESULT Cached = TimeCopy(FALSE, cb);
+        if (cb < AM_COPY_MIN_STREAMING_THRESHOLD) {
+            printf("%8s | %8.2f %10.2f %7.2f | %8s %10s %7s\n", szSize,
+                   Cached.dCopy, Cached.dRead, Cached.dHot, "-", "-", "-");
+            continue;
+        }
+        COPYRESULT Stream = TimeCopy(TRUE, cb);
+        printf("%8s | %8.2f %10.2f %7.2f | %8.2f %10.2f %7.2f\n", szSize,
+               Cached.dCopy, Cached.dRead, Cached.dHot,
+               Stream.dCopy, Stream.dRead, Stream.dHot);
+
+        cbCopyWins = Stream.dCopy >= Cached.dCopy ? (cbCopyWins ? cbCopyWins : cb) : 0;
+        cbReadWins = Stream.dRead >= Cached.dRead ? (cbReadWins ? cbReadWins : cb) : 0;
+        cbHotWins = Stream.dHot <= Cached.dHot ? (cbHotWins ? cbHotWins : cb) : 0;
+    }
+
+    char szCopy[16], szRead[16], szHot[16], szHalf[16];
+    FormatSize(szCopy, cbCopyWins);
+    FormatSize(szRead, cbReadWins);
+    FormatSize(szHot, cbHotWins);
+    FormatSize(szHalf, cbLargest / 2);
+    printf("\nstreaming wins from: copy alone %s, copy and read %s, working set %s\n",
+           szCopy, szRead, szHot);
+    printf("half the largest cache is %s; the threshold in use is %s\n", szHalf, szThreshold);
+    return 0;
+}
@@ -0,0 +1,144 @@
+//------------------------------------------------------------------------------
+// File: FilePin.h
+//
+// Desc: A scratch file and a CPullPin that reads it, for the harnesses.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#ifndef __FILEPIN__
+#define __FILEPIN__
+
+// system headers before streams.h, whose SAL macros break them
+#include <stdlib.h>
+#include <unistd.h>
+#include "perfutil.h"
+#include "pullpin.h"
+#include "asyncfile.h"
+
+// what the scratch file holds in the DWORD at llOffset, so data can be
+// checked against where it claims to have come from
+inline DWORD PerfFileWord(LONGLONG llOffset)
+{
+    return (DWORD) (llOffset >> 2) * 2654435761u;
+}
+
+// A file of cbFile bytes filled with PerfFileWord, deleted again when we
+// are. It is written through the page cache, so it is in memory when it is
+// read back; what the harnesses measure is the reader, not the disk
+class CPerfFile {
+
+    char m_szName[64];
+
+public:
+
+    CPerfFile(LONGLONG cbFile) {
+        strcpy(m_szName, "/tmp/perffileXXXXXX");
+        int fd = mkstemp(m_szName);
+        PERF_CHECK(fd >= 0);
+        std::vector<DWORD> Words(1 << 18);
+        for (LONGLONG llPos = 0; llPos < cbFile; ) {
+            LONG cb = (LONG) (std::min)((LONGLONG) Words.size() * 4, cbFile - llPos);
+            for (LONG i = 0; i < (cb + 3) / 4; i++) {
+                Words[i] = PerfFileWord(llPos + i * 4);
+            }
+            PERF_CHECK(write(fd, &Words[0], cb) == cb);
+            llPos += cb;
+        }
+        close(fd);
+    };
+    ~CPerfFile() { unlink(m_szName); };
+
+    const char *Name() const { return m_szName; };
+};
+
+// Pulls a CAsyncFileReader and counts what arrives. It can check that
+// every sample follows on from the last and holds what the file has there,
+// or else just touches each page, as a parser looking at the data would.
+// EndOfStream or an error sets m_hDone, except that errors while we are
+// being flushed are only the reader handing back cancelled requests
+class CPerfPullPin : public CPullPin {
+
+    BOOL m_bVerify;
+    volatile BOOL m_bFlushing;
+
+public:
+
+    LONGLONG m_llBase;              // file position the stream starts at
+    LONGLONG m_llSeekBase;          // ... after the seek in progress
+    LONGLONG m_llNext;              // where the next sample should start
+    LONGLONG m_llBytes;
+    LONG m_lSamples;
+    LONG m_lOutOfOrder;             // samples not starting at m_llNext
+    LONG m_lBadData;                // words not what the file holds
+    volatile DWORD m_dwTouched;
+    HRESULT m_hrError;
+    HANDLE m_hDone;
+
+    CPerfPullPin(BOOL bVerify) :
+        m_bVerify(bVerify), m_bFlushing(FALSE), m_llBase(0), m_llSeekBase(0),
+        m_llNext(0), m_llBytes(0), m_lSamples(0), m_lOutOfOrder(0), m_lBadData(0), m_dwTouched(0),
+        m_hrError(S_OK) {
+        m_hDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+    };
+    ~CPerfPullPin() {
+        Disconnect();
+        CloseHandle(m_hDone);
+    };
+
+    HRESULT Receive(IMediaSample *pSample) {
+        REFERENCE_TIME tStart, tStop;
+        PERF_CHECK(pSample->GetTime(&tStart, &tStop) == S_OK);
+        LONGLONG llPos = tStart / UNITS;
+        LONG cb = pSample->GetActualDataLength();
+        if (llPos != m_llNext) {
+            m_lOutOfOrder++;
+        }
+        m_llNext = llPos + cb;
+        m_llBytes += cb;
+        m_lSamples++;
+
+        BYTE *pb;
+        PERF_CHECK(SUCCEEDED(pSample->GetPointer(&pb)));
+        if (m_bVerify) {
+            const DWORD *pdw = (const DWORD *) pb;
+            for (LONG i = 0; i < cb / 4; i++) {
+                if (pdw[i] != PerfFileWord(m_llBase + llPos + i * 4)) {
+                    m_lBadData++;
+                }
+            }
+        } else {
+            DWORD dw = 0;
+            for (LONG i = 0; i < cb; i += 4096) {
+                dw += pb[i];
+            }
+            m_dwTouched += dw;
+        }
+        return S_OK;
+    };
+    HRESULT EndOfStream() {
+        SetEvent(m_hDone);
+        return S_OK;
+    };
+    void OnError(HRESULT hr) {
+        if (!m_bFlushing) {
+            m_hrError = hr;
+            SetEvent(m_hDone);
+        }
+    };
+    HRESULT BeginFlush() {
+        m_bFlushing = TRUE;
+        return S_OK;
+    };
+    // Seek calls this with the thread paused, before it starts again from
+    // the new position
+    HRESULT EndFlush() {
+        m_llBase = m_llSeekBase;
+        m_llNext = 0;
+        m_bFlushing = FALSE;
+        return S_OK;
+    };
+};
+
+#endif // __FILEPIN__
@@ -0,0 +1,231 @@
+//------------------------------------------------------------------------------
+// File: GraphBench.cpp
+//
+// Desc: Context switch and latency benchmark for a 40 filter synthetic
+//       graph, with and without the shared task scheduler.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+/* The graph is a chain of 40 filters, each spending 2us on a sample, with
+   a COutputQueue between each one and the next - 40 streaming loops, as a
+   graph of 40 filters each with a queued output pin has. A source feeds a
+   sample every 500us, stamped with the time it was sent, and the last
+   filter records how long it took to arrive. That is run
+
+       threads     with each queue on a thread of its own
+       shared      with CAMTaskScheduler::EnableSharing(TRUE), so each
+                   queue's loop runs through StartLoop
+       tasks       with no queues, each filter's work a task on the shared
+                   scheduler that submits the next filter's - what the
+                   graph would cost if its loops could run as tasks
+
+   and for each we report the threads in the process, the context switches
+   per second and the 50th and 99th percentile and worst latency through
+   the graph.
+
+   The loops block by contract - a COutputQueue waits for samples and then
+   for the pin it delivers to - so StartLoop gives each one a thread for as
+   long as it runs, just as the queues would have made for themselves.
+   What sharing saves is creating and destroying those threads as graphs
+   start and stop, and the loops' threads run tasks while parked; a
+   running graph has as many threads either way. The tasks row is the
+   bound the loops don't reach.
+
+   Build it with "make graphbench" and run it as "graphbench" */
+
+
+#include <algorithm>
+#include "sinkpin.h"
+
+
+static const LONG c_cFilters = 40;
+static const LONGLONG c_llWorkNs = 2000;
+static const LONGLONG c_llIntervalNs = 500000;
+static const LONG c_lSamples = 1000;
+
+static void Spin(LONGLONG llNs)
+{
+    LONGLONG llUntil = PerfNanoseconds() + llNs;
+    while (PerfNanoseconds() < llUntil) {
+    }
+}
+
+// sleep until PerfNanoseconds() reaches llNs, so the source costs one
+// context switch a sample and no more
+static void SleepUntil(LONGLONG llNs)
+{
+    struct timespec ts;
+    ts.tv_sec = (time_t) (llNs / 1000000000);
+    ts.tv_nsec = (long) (llNs % 1000000000);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {
+    }
+}
+
+// threads in this process, from /proc
+static LONG ThreadCount()
+{
+    FILE *pFile = fopen("/proc/self/status", "r");
+    PERF_CHECK(pFile != NULL);
+    char szLine[256];
+    LONG cThreads = 0;
+    while (fgets(szLine, sizeof(szLine), pFile)) {
+        if (sscanf(szLine, "Threads: %ld", &cThreads) == 1) {
+            break;
+        }
+    }
+    fclose(pFile);
+    return cThreads;
+}
+
+// how long each sample took to get through the graph, in arrival order
+struct LATENCIES {
+    LONGLONG allNs[c_lSamples];
+    volatile LONG lArrived;
+
+    void Arrived(IMediaSample *pSample)
+    {
+        REFERENCE_TIME rtStart, rtEnd;
+        PERF_CHECK(SUCCEEDED(pSample->GetTime(&rtStart, &rtEnd)));
+        LONG i = InterlockedIncrement(&lArrived) - 1;
+        allNs[i] = PerfNanoseconds() - rtStart;
+    }
+};
+
+// --- queued filters -----------------------------------------------------
+
+// a filter's input pin: the work, then on through the filter's queue, or
+// into the latencies if it is the last
+class CStagePin : public CPerfSinkPin {
+public:
+    COutputQueue *m_pQueue;
+    LATENCIES *m_pLatencies;
+
+    CStagePin() : m_pQueue(NULL), m_pLatencies(NULL) {};
+
+    STDMETHODIMP ReceiveMultiple(IMediaSample **ppSamples, LONG nSamples, LONG *pnProcessed) {
+        for (LONG i = 0; i < nSamples; i++) {
+            Spin(c_llWorkNs);
+            if (m_pQueue) {
+                ppSamples[i]->AddRef();
+                m_pQueue->Receive(ppSamples[i]);
+            } else {
+                m_pLatencies->Arrived(ppSamples[i]);
+            }
+        }
+        *pnProcessed = nSamples;
+        return S_OK;
+    };
+};
+
+// --- tasks --------------------------------------------------------------
+
+struct STAGETASK {
+    IMediaSample *pSample;
+    LONG iFilter;
+    LATENCIES *pLatencies;
+};
+
+static void StageTask(PVOID pv)
+{
+    STAGETASK *pTask = (STAGETASK *) pv;
+    Spin(c_llWorkNs);
+    if (++pTask->iFilter < c_cFilters) {
+        PERF_CHECK(SUCCEEDED(CAMTaskScheduler::GetDefault()->Submit(StageTask, pTask)));
+        return;
+    }
+    pTask->pLatencies->Arrived(pTask->pSample);
+    pTask->pSample->Release();
+    delete pTask;
+}
+
+// --- the graph ----------------------------------------------------------
+
+enum GRAPHMODE { GraphThreads, GraphShared, GraphTasks };
+
+static void RunGraph(GRAPHMODE Mode)
+{
+    HRESULT hr = S_OK;
+    CMemAllocator *pAllocator = new CMemAllocator(NAME("graphbench"), NULL, &hr);
+    pAllocator->AddRef();
+    ALLOCATOR_PROPERTIES Request = { 64, 1024, 1, 0 }, Actual;
+    PERF_CHECK(SUCCEEDED(pAllocator->SetProperties(&Request, &Actual)));
+    PERF_CHECK(SUCCEEDED(pAllocator->Commit()));
+
+    LATENCIES *pLatencies = new LATENCIES;
+    pLatencies->lArrived = 0;
+    PERF_CHECK(SUCCEEDED(CAMTaskScheduler::EnableSharing(Mode == GraphShared)));
+
+    // queue i delivers to filter i
+    CStagePin *aPins = new CStagePin[c_cFilters];
+    COutputQueue *apQueues[c_cFilters] = { NULL };
+    if (Mode != GraphTasks) {
+        for (LONG i = c_cFilters - 1; i >= 0; i--) {
+            apQueues[i] = new COutputQueue(&aPins[i], &hr, FALSE, TRUE);
+            PERF_CHECK(SUCCEEDED(hr));
+            if (i + 1 < c_cFilters) {
+                aPins[i].m_pQueue = apQueues[i + 1];
+            } else {
+                aPins[i].m_pLatencies = pLatencies;
+            }
+        }
+    }
+
+    LONG cThreads = ThreadCount();
+    LONGLONG llSwitches = PerfContextSwitches();
+    LONGLONG llStart = PerfNanoseconds();
+    for (LONG i = 0; i < c_lSamples; i++) {
+        SleepUntil(llStart + i * c_llIntervalNs);
+        IMediaSample *pSample;
+        PERF_CHECK(SUCCEEDED(pAllocator->GetBuffer(&pSample, NULL, NULL, 0)));
+        REFERENCE_TIME rtStart = PerfNanoseconds(), rtEnd = rtStart;
+        pSample->SetTime(&rtStart, &rtEnd);
+        if (Mode == GraphTasks) {
+            STAGETASK *pTask = new STAGETASK;
+            pTask->pSample = pSample;
+            pTask->iFilter = 0;
+            pTask->pLatencies = pLatencies;
+            PERF_CHECK(SUCCEEDED(CAMTaskScheduler::GetDefault()->Submit(StageTask, pTask)));
+        } else {
+            apQueues[0]->Receive(pSample);
+        }
+        cThreads = (std::max)(cThreads, ThreadCount());
+    }
+    while (pLatencies->lArrived < c_lSamples) {
+        Sleep(1);
+    }
+    LONGLONG llTime = PerfNanoseconds() - llStart;
+    llSwitches = PerfContextSwitches() - llSwitches;
+
+    std::vector<LONGLONG> Latencies(pLatencies->allNs, pLatencies->allNs + c_lSamples);
+    LONGLONG llWorst = *std::max_element(Latencies.begin(), Latencies.end());
+    static const char *aszModes[] = { "threads", "shared", "tasks" };
+    printf("%-8s %8ld %12.0f %10.1f %10.1f %10.1f\n", aszModes[Mode], cThreads,
+           llSwitches * 1e9 / llTime, PerfPercentile(Latencies, 50.0) / 1e3,
+           PerfPercentile(Latencies, 99.0) / 1e3, llWorst / 1e3);
+
+    for (LONG i = 0; i < c_cFilters; i++) {
+        delete apQueues[i];
+    }
+    delete [] aPins;
+    delete pLatencies;
+    PERF_CHECK(SUCCEEDED(CAMTaskScheduler::EnableSharing(FALSE)));
+    pAllocator->Decommit();
+    pAllocator->Release();
+}
+
+int main(int argc, char *argv[])
+{
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    printf("%u processors, %ld filters of %lldus, a sample every %lldus\n\n",
+           si.dwNumberOfProcessors, c_cFilters, c_llWorkNs / 1000, c_llIntervalNs / 1000);
+    printf("%-8s %8s %12s %10s %10s %10s\n", "", "threads", "switches/s",
+           "p50 us", "p99 us", "worst us");
+    // shared last, as its loop threads stay parked for a while after
+    RunGraph(GraphThreads);
+    RunGraph(GraphTasks);
+    RunGraph(GraphShared);
+    return 0;
+}
@@ -0,0 +1,11 @@
+//------------------------------------------------------------------------------
+// File: Schedule.h
+//
+// Desc: refclock.h asks for Schedule.h, and file names are case sensitive
+//       here.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#include <schedule.h>
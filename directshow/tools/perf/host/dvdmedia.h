@@ -0,0 +1,11 @@
+//------------------------------------------------------------------------------
+// File: DVDMedia.h
+//
+// Desc: VIDEOINFOHEADER2, which is all the base classes want from
+//       dvdmedia.h, is in our amvideo.h.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#include <amvideo.h>
@@ -0,0 +1,49 @@
+//------------------------------------------------------------------------------
+// File: Errors.h
+//
+// Desc: The status codes from the SDK's vfwmsgs.h and the event codes from
+//       its evcode.h that the base classes use, for the performance
+//       harnesses.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#ifndef __PERF_ERRORS__
+#define __PERF_ERRORS__
+
+#define VFW_E_INVALIDMEDIATYPE      ((HRESULT)0x80040200L)
+#define VFW_E_ENUM_OUT_OF_SYNC      ((HRESULT)0x80040203L)
+#define VFW_E_ALREADY_CONNECTED     ((HRESULT)0x80040204L)
+#define VFW_E_NO_ACCEPTABLE_TYPES   ((HRESULT)0x80040207L)
+#define VFW_E_INVALID_DIRECTION     ((HRESULT)0x80040208L)
+#define VFW_E_NOT_CONNECTED         ((HRESULT)0x80040209L)
+#define VFW_E_NO_ALLOCATOR          ((HRESULT)0x8004020AL)
+#define VFW_E_RUNTIME_ERROR         ((HRESULT)0x8004020BL)
+#define VFW_E_BUFFER_OVERFLOW       ((HRESULT)0x8004020DL)
+#define VFW_E_BADALIGN              ((HRESULT)0x8004020EL)
+#define VFW_E_ALREADY_COMMITTED     ((HRESULT)0x8004020FL)
+#define VFW_E_BUFFERS_OUTSTANDING   ((HRESULT)0x80040210L)
+#define VFW_E_NOT_COMMITTED         ((HRESULT)0x80040211L)
+#define VFW_E_SIZENOTSET            ((HRESULT)0x80040212L)
+#define VFW_E_NO_CLOCK              ((HRESULT)0x80040213L)
+#define VFW_E_NOT_FOUND             ((HRESULT)0x80040216L)
+#define VFW_E_STATE_CHANGED         ((HRESULT)0x80040223L)
+#define VFW_E_NOT_STOPPED           ((HRESULT)0x80040224L)
+#define VFW_E_WRONG_STATE           ((HRESULT)0x80040227L)
+#define VFW_E_TYPE_NOT_ACCEPTED     ((HRESULT)0x8004022AL)
+#define VFW_E_TIMEOUT               ((HRESULT)0x8004022EL)
+#define VFW_E_SAMPLE_TIME_NOT_SET   ((HRESULT)0x80040249L)
+#define VFW_E_MEDIA_TIME_NOT_SET    ((HRESULT)0x80040251L)
+#define VFW_E_NOT_IN_GRAPH          ((HRESULT)0x8004025FL)
+#define VFW_E_PIN_ALREADY_BLOCKED_ON_THIS_THREAD ((HRESULT)0x80040293L)
+#define VFW_E_PIN_ALREADY_BLOCKED   ((HRESULT)0x80040294L)
+#define VFW_S_NO_MORE_ITEMS         ((HRESULT)0x00040103L)
+#define VFW_S_NO_STOP_TIME          ((HRESULT)0x00040270L)
+
+#define EC_COMPLETE                 0x01
+#define EC_USERABORT                0x02
+#define EC_ERRORABORT               0x03
+#define EC_QUALITY_CHANGE           0x0B
+
+#endif // __PERF_ERRORS__
@@ -0,0 +1,10 @@
+//------------------------------------------------------------------------------
+// File: EvnTrace.h
+//
+// Desc: The event tracing types perfstruct.h wants are in our wmistr.h.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#include <wmistr.h>
@@ -0,0 +1,37 @@
+//------------------------------------------------------------------------------
+// File: Intrin.h
+//
+// Desc: The Visual C++ intrinsics the base classes use that the compiler's
+//       own headers spell differently, for the performance harnesses.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#ifndef __PERF_INTRIN__
+#define __PERF_INTRIN__
+
+#define _ReturnAddress()    __builtin_return_address(0)
+
+inline void __cpuidex(int aInfo[4], int nFunction, int nSubFunction)
+{
+    __asm__ __volatile__("cpuid"
+                         : "=a"(aInfo[0]), "=b"(aInfo[1]), "=c"(aInfo[2]), "=d"(aInfo[3])
+                         : "a"(nFunction), "c"(nSubFunction));
+}
+
+inline void __cpuid(int aInfo[4], int nFunction)
+{
+    __cpuidex(aInfo, nFunction, 0);
+}
+
+inline unsigned long long __perf_xgetbv(unsigned int nXcr)
+{
+    unsigned int uLow, uHigh;
+    __asm__ __volatile__("xgetbv" : "=a"(uLow), "=d"(uHigh) : "c"(nXcr));
+    return ((unsigned long long)uHigh << 32) | uLow;
+}
+#undef _xgetbv
+#define _xgetbv(n)  __perf_xgetbv(n)
+
+#endif // __PERF_INTRIN__
@@ -0,0 +1,11 @@
+//------------------------------------------------------------------------------
+// File: MMReg.h
+//
+// Desc: WAVEFORMATEX, which is all the base classes want from mmreg.h, is
+//       in our amvideo.h.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#include <amvideo.h>
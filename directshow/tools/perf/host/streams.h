@@ -0,0 +1,69 @@
+//------------------------------------------------------------------------------
+// File: Streams.h
+//
+// Desc: Stands in for the base classes' streams.h when the performance
+//       harnesses are built off Windows. It puts Win32.h and StrmIf.h where
+//       the SDK would be and then takes the base class headers the
+//       harnesses need in the real streams.h's order. The window, property
+//       page and automation classes are left out.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#ifndef __STREAMS__
+#define __STREAMS__
+
+#define AM_NOVTABLE
+
+#include <win32.h>
+#include <strmif.h>
+#include <amvideo.h>
+
+// the harnesses are release builds, but the base classes' own assertions
+// are what the stress tests are after, so wxdebug.h's retail ASSERT is
+// replaced with one that stops the run
+#define ASSERT(_x_) \
+    ((_x_) ? (void)0 : (fprintf(stderr, "%s(%d) : ASSERT(%s) failed\n", \
+                                __FILE__, __LINE__, #_x_), abort()))
+
+#define NUMELMS(aa) ARRAYSIZE(aa)
+
+#include <reftime.h>    // Helper class for REFERENCE_TIME management
+#include <wxdebug.h>    // Debug support for logging and ASSERTs
+#include <wxutil.h>     // General helper classes for threads etc
+#include <lockfree.h>   // Non-blocking queue and wakeup helpers
+#include <slabcache.h>  // Process-wide cache of sample buffer blocks
+#include <memcopy.h>    // Buffer copies chosen by processor at run time
+#include <workpool.h>   // Persistent threads sharing the items of a job
+#include <tasksched.h>  // Threads shared by the base classes
+#include <combase.h>    // Base COM classes to support IUnknown
+#include <measure.h>    // Performance measurement
+#include <streamtrace.h> // Trace of samples through the graph
+#include <latency.h>    // Sample latency through the graph
+
+#include <cache.h>      // Simple cache container class
+#include <wxlist.h>     // Non MFC generic list class
+#include <msgthrd.h>    // CMsgThread
+#include <mtype.h>      // Helper class for managing media types
+#include <fourcc.h>     // conversions between FOURCCs and GUIDs
+#include <errors.h>     // HRESULT status and error definitions, event codes
+#include <amfilter.h>   // Main streams architecture class hierachy
+#include <transfrm.h>   // Generic transform filter
+#include <transip.h>    // Generic transform-in-place filter
+#include <uuids.h>      // declaration of type GUIDs and well-known clsids
+#include <source.h>     // Generic source filter
+#include <outputq.h>    // Output pin queueing
+#include <refclock.h>   // Base clock class
+#include <framedrop.h>  // Predicts which video frames will be late
+#include <vtrans.h>     // Video Transform Filter base class
+#include <vconvert.h>   // Video format conversion and a filter built on it
+
+// from ctlutil.h, which is left out
+STDAPI CreatePosPassThru(
+    __in_opt LPUNKNOWN pAgg,
+    BOOL bRenderer,
+    IPin *pPin,
+    __deref_out IUnknown **ppPassThru);
+
+#endif // __STREAMS__
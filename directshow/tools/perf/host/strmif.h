@@ -0,0 +1,455 @@
+//------------------------------------------------------------------------------
+// File: StrmIf.h
+//
+// Desc: COM and the DirectShow interfaces the base classes implement or
+//       call, for the performance harnesses. The interfaces that the base
+//       classes implement are declared in full, in the SDK's order; the
+//       ones they only call have just the methods they call.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#ifndef __strmif_h__
+#define __strmif_h__
+
+// --- GUIDs ------------------------------------------------------
+
+typedef struct _GUID {
+    DWORD Data1;
+    WORD Data2;
+    WORD Data3;
+    BYTE Data4[8];
+} GUID;
+typedef GUID IID;
+typedef GUID CLSID;
+typedef GUID *LPGUID;
+typedef const GUID *LPCGUID;
+typedef IID *LPIID;
+typedef CLSID *LPCLSID;
+#define REFGUID     const GUID &
+#define REFIID      const IID &
+#define REFCLSID    const CLSID &
+
+inline BOOL IsEqualGUID(REFGUID rguid1, REFGUID rguid2)
+{
+    return memcmp(&rguid1, &rguid2, sizeof(GUID)) == 0;
+}
+#define IsEqualIID(a, b)    IsEqualGUID(a, b)
+#define IsEqualCLSID(a, b)  IsEqualGUID(a, b)
+inline bool operator==(REFGUID guidOne, REFGUID guidOther)
+{
+    return !!IsEqualGUID(guidOne, guidOther);
+}
+inline bool operator!=(REFGUID guidOne, REFGUID guidOther)
+{
+    return !(guidOne == guidOther);
+}
+
+// Win32.cpp defines INITGUID to give each of these its storage
+#ifdef INITGUID
+#define DEFINE_GUID(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8) \
+    EXTERN_C const GUID name = { l, w1, w2, { b1, b2, b3, b4, b5, b6, b7, b8 } }
+#else
+#define DEFINE_GUID(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8) \
+    EXTERN_C const GUID name
+#endif
+#define OUR_GUID_ENTRY(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8) \
+    DEFINE_GUID(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8);
+
+DEFINE_GUID(GUID_NULL, 0x00000000, 0x0000, 0x0000, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
+DEFINE_GUID(IID_IUnknown, 0x00000000, 0x0000, 0x0000, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46);
+DEFINE_GUID(IID_IClassFactory, 0x00000001, 0x0000, 0x0000, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46);
+DEFINE_GUID(IID_IPersist, 0x0000010c, 0x0000, 0x0000, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46);
+DEFINE_GUID(IID_IPin, 0x56a86891, 0x0ad4, 0x11ce, 0xb0, 0x3a, 0x00, 0x20, 0xaf, 0x0b, 0xa7, 0x70);
+DEFINE_GUID(IID_IEnumPins, 0x56a86892, 0x0ad4, 0x11ce, 0xb0, 0x3a, 0x00, 0x20, 0xaf, 0x0b, 0xa7, 0x70);
+DEFINE_GUID(IID_IEnumMediaTypes, 0x89c31040, 0x846b, 0x11ce, 0x97, 0xd3, 0x00, 0xaa, 0x00, 0x55, 0x59, 0x5a);
+DEFINE_GUID(IID_IFilterGraph, 0x56a8689f, 0x0ad4, 0x11ce, 0xb0, 0x3a, 0x00, 0x20, 0xaf, 0x0b, 0xa7, 0x70);
+DEFINE_GUID(IID_IFilterGraph2, 0x36b73882, 0xc2c8, 0x11cf, 0x8b, 0x46, 0x00, 0x80, 0x5f, 0x6c, 0xef, 0x60);
+DEFINE_GUID(IID_IMediaFilter, 0x56a86899, 0x0ad4, 0x11ce, 0xb0, 0x3a, 0x00, 0x20, 0xaf, 0x0b, 0xa7, 0x70);
+DEFINE_GUID(IID_IBaseFilter, 0x56a86895, 0x0ad4, 0x11ce, 0xb0, 0x3a, 0x00, 0x20, 0xaf, 0x0b, 0xa7, 0x70);
+DEFINE_GUID(IID_IReferenceClock, 0x56a86897, 0x0ad4, 0x11ce, 0xb0, 0x3a, 0x00, 0x20, 0xaf, 0x0b, 0xa7, 0x70);
+DEFINE_GUID(IID_IReferenceClockTimerControl, 0xebec459c, 0x2eca, 0x4d42, 0xa8, 0xaf, 0x30, 0xdf, 0x55, 0x76, 0x14, 0xb8);
+DEFINE_GUID(IID_IMediaSample, 0x56a8689a, 0x0ad4, 0x11ce, 0xb0, 0x3a, 0x00, 0x20, 0xaf, 0x0b, 0xa7, 0x70);
+DEFINE_GUID(IID_IMediaSample2, 0x36b73884, 0xc2c8, 0x11cf, 0x8b, 0x46, 0x00, 0x80, 0x5f, 0x6c, 0xef, 0x60);
+DEFINE_GUID(IID_IMemAllocator, 0x56a8689c, 0x0ad4, 0x11ce, 0xb0, 0x3a, 0x00, 0x20, 0xaf, 0x0b, 0xa7, 0x70);
+DEFINE_GUID(IID_IMemAllocatorCallbackTemp, 0x379a0cf0, 0xc1de, 0x11d2, 0xab, 0xf5, 0x00, 0xa0, 0xc9, 0x05, 0xf3, 0x75);
+DEFINE_GUID(IID_IMemAllocatorNotifyCallbackTemp, 0x92980b30, 0xc1de, 0x11d2, 0xab, 0xf5, 0x00, 0xa0, 0xc9, 0x05, 0xf3, 0x75);
+DEFINE_GUID(IID_IMemInputPin, 0x56a8689d, 0x0ad4, 0x11ce, 0xb0, 0x3a, 0x00, 0x20, 0xaf, 0x0b, 0xa7, 0x70);
+DEFINE_GUID(IID_IAMovieSetup, 0xa3d8cec0, 0x7e5a, 0x11cf, 0xbb, 0xc5, 0x00, 0x80, 0x5f, 0x6c, 0xef, 0x20);
+DEFINE_GUID(IID_IMediaSeeking, 0x36b73880, 0xc2c8, 0x11cf, 0x8b, 0x46, 0x00, 0x80, 0x5f, 0x6c, 0xef, 0x60);
+DEFINE_GUID(IID_IMediaPosition, 0x56a868b2, 0x0ad4, 0x11ce, 0xb0, 0x3a, 0x00, 0x20, 0xaf, 0x0b, 0xa7, 0x70);
+DEFINE_GUID(IID_ISeekingPassThru, 0x36b73883, 0xc2c8, 0x11cf, 0x8b, 0x46, 0x00, 0x80, 0x5f, 0x6c, 0xef, 0x60);
+DEFINE_GUID(IID_IQualityControl, 0x56a868a5, 0x0ad4, 0x11ce, 0xb0, 0x3a, 0x00, 0x20, 0xaf, 0x0b, 0xa7, 0x70);
+DEFINE_GUID(IID_IMediaEventSink, 0x56a868a2, 0x0ad4, 0x11ce, 0xb0, 0x3a, 0x00, 0x20, 0xaf, 0x0b, 0xa7, 0x70);
+DEFINE_GUID(IID_IAsyncReader, 0x56a868aa, 0x0ad4, 0x11ce, 0xb0, 0x3a, 0x00, 0x20, 0xaf, 0x0b, 0xa7, 0x70);
+DEFINE_GUID(IID_IFilterMapper, 0x56a868a3, 0x0ad4, 0x11ce, 0xb0, 0x3a, 0x00, 0x20, 0xaf, 0x0b, 0xa7, 0x70);
+DEFINE_GUID(IID_IPinConnection, 0x4a9a62d3, 0x27d4, 0x403d, 0x91, 0xe9, 0x89, 0xf5, 0x40, 0xe5, 0x55, 0x34);
+DEFINE_GUID(IID_IPinFlowControl, 0xc56e9858, 0xdbf3, 0x4f6b, 0x81, 0x19, 0x38, 0x4a, 0xf2, 0x06, 0x0d, 0xeb);
+DEFINE_GUID(IID_IGraphConfig, 0x03a1eb8e, 0x32bf, 0x4245, 0x85, 0x02, 0x11, 0x4d, 0x08, 0xa9, 0xcb, 0x88);
+DEFINE_GUID(CLSID_MemoryAllocator, 0x1e651cc0, 0xb199, 0x11d0, 0x82, 0x12, 0x00, 0xc0, 0x4f, 0xc3, 0x2c, 0x45);
+DEFINE_GUID(CLSID_SeekingPassThru, 0x060af76c, 0x68dd, 0x11d0, 0x8f, 0xc1, 0x00, 0xc0, 0x4f, 0xd9, 0x18, 0x9d);
+DEFINE_GUID(CLSID_FilterMapper, 0xcda42200, 0xbd88, 0x11d0, 0xbd, 0x4e, 0x00, 0xa0, 0xc9, 0x11, 0xce, 0x86);
+
+// --- COM ----------------------------------------------------------
+
+struct IUnknown {
+    virtual HRESULT QueryInterface(REFIID riid, void **ppvObject) = 0;
+    virtual ULONG AddRef() = 0;
+    virtual ULONG Release() = 0;
+};
+typedef IUnknown *LPUNKNOWN;
+
+struct IClassFactory : public IUnknown {
+    virtual HRESULT CreateInstance(IUnknown *pUnkOuter, REFIID riid, void **ppvObject) = 0;
+    virtual HRESULT LockServer(BOOL fLock) = 0;
+};
+
+struct IPersist : public IUnknown {
+    virtual HRESULT GetClassID(CLSID *pClassID) = 0;
+};
+
+// CoCreateInstance never finds anything - the harnesses make their own
+STDAPI CoCreateInstance(REFCLSID rclsid, LPUNKNOWN pUnkOuter, DWORD dwClsContext,
+                        REFIID riid, LPVOID *ppv);
+STDAPI CoInitialize(LPVOID pvReserved);
+STDAPI CoInitializeEx(LPVOID pvReserved, DWORD dwCoInit);
+STDAPI_(void) CoUninitialize();
+STDAPI_(void) CoFreeUnusedLibraries();
+STDAPI_(LPVOID) CoTaskMemAlloc(SIZE_T cb);
+STDAPI_(LPVOID) CoTaskMemRealloc(LPVOID pv, SIZE_T cb);
+STDAPI_(void) CoTaskMemFree(LPVOID pv);
+STDAPI_(int) StringFromGUID2(REFGUID rguid, LPOLESTR psz, int cchMax);
+STDAPI_(BSTR) SysAllocString(const OLECHAR *psz);
+STDAPI_(void) SysFreeString(BSTR bstr);
+
+// --- DirectShow types ---------------------------------------------
+
+typedef LONGLONG REFERENCE_TIME;
+typedef double REFTIME;
+typedef DWORD_PTR HSEMAPHORE;
+typedef DWORD_PTR HEVENT;
+
+typedef struct _AMMediaType {
+    GUID majortype;
+    GUID subtype;
+    BOOL bFixedSizeSamples;
+    BOOL bTemporalCompression;
+    ULONG lSampleSize;
+    GUID formattype;
+    IUnknown *pUnk;
+    ULONG cbFormat;
+    BYTE *pbFormat;
+} AM_MEDIA_TYPE;
+
+typedef enum _PinDirection {
+    PINDIR_INPUT = 0,
+    PINDIR_OUTPUT = PINDIR_INPUT + 1
+} PIN_DIRECTION;
+
+#define MAX_PIN_NAME        128
+#define MAX_FILTER_NAME     128
+
+typedef struct _AllocatorProperties {
+    LONG cBuffers;
+    LONG cbBuffer;
+    LONG cbAlign;
+    LONG cbPrefix;
+} ALLOCATOR_PROPERTIES;
+
+struct IBaseFilter;
+struct IFilterGraph;
+struct IReferenceClock;
+struct IEnumPins;
+struct IEnumMediaTypes;
+struct IEnumFilters;
+struct IMemAllocator;
+struct IMemAllocatorNotifyCallbackTemp;
+struct IPinConnection;
+struct IGraphConfigCallback;
+
+typedef struct _PinInfo {
+    IBaseFilter *pFilter;
+    PIN_DIRECTION dir;
+    WCHAR achName[128];
+} PIN_INFO;
+
+typedef struct _FilterInfo {
+    WCHAR achName[128];
+    IFilterGraph *pGraph;
+} FILTER_INFO;
+
+typedef enum _FilterState {
+    State_Stopped = 0,
+    State_Paused = State_Stopped + 1,
+    State_Running = State_Paused + 1
+} FILTER_STATE;
+
+typedef enum tagQualityMessageType {
+    Famine = 0,
+    Flood = Famine + 1
+} QualityMessageType;
+
+typedef struct tagQuality {
+    QualityMessageType Type;
+    LONG Proportion;
+    REFERENCE_TIME Late;
+    REFERENCE_TIME TimeStamp;
+} Quality;
+
+typedef struct tagAM_SAMPLE2_PROPERTIES {
+    DWORD cbData;
+    DWORD dwTypeSpecificFlags;
+    DWORD dwSampleFlags;
+    LONG lActual;
+    REFERENCE_TIME tStart;
+    REFERENCE_TIME tStop;
+    DWORD dwStreamId;
+    AM_MEDIA_TYPE *pMediaType;
+    BYTE *pbBuffer;
+    LONG cbBuffer;
+} AM_SAMPLE2_PROPERTIES;
+
+enum tagAM_SAMPLE_PROPERTY_FLAGS {
+    AM_SAMPLE_SPLICEPOINT = 0x1,
+    AM_SAMPLE_PREROLL = 0x2,
+    AM_SAMPLE_DATADISCONTINUITY = 0x4,
+    AM_SAMPLE_TYPECHANGED = 0x8,
+    AM_SAMPLE_TIMEVALID = 0x10,
+    AM_SAMPLE_TIMEDISCONTINUITY = 0x40,
+    AM_SAMPLE_FLUSH_ON_PAUSE = 0x80,
+    AM_SAMPLE_STOPVALID = 0x100,
+    AM_SAMPLE_ENDOFSTREAM = 0x200,
+    AM_STREAM_MEDIA = 0,
+    AM_STREAM_CONTROL = 1
+};
+
+#define AM_GBF_PREVFRAMESKIPPED     1
+#define AM_GBF_NOTASYNCPOINT        2
+#define AM_GBF_NOWAIT               4
+#define AM_GBF_NODDSURFACELOCK      8
+
+enum _AM_PIN_FLOW_CONTROL_BLOCK_FLAGS {
+    AM_PIN_FLOW_CONTROL_BLOCK = 0x1
+};
+
+typedef enum _AM_GRAPH_CONFIG_RECONNECT_FLAGS {
+    AM_GRAPH_CONFIG_RECONNECT_DIRECTCONNECT = 0x1,
+    AM_GRAPH_CONFIG_RECONNECT_CACHE_REMOVED_FILTERS = 0x2,
+    AM_GRAPH_CONFIG_RECONNECT_USE_ONLY_CACHED_FILTERS = 0x4
+} AM_GRAPH_CONFIG_RECONNECT_FLAGS;
+
+typedef struct {
+    const CLSID *clsMajorType;
+    const CLSID *clsMinorType;
+} REGPINTYPES;
+
+typedef struct {
+    LPWSTR strName;
+    BOOL bRendered;
+    BOOL bOutput;
+    BOOL bZero;
+    BOOL bMany;
+    const CLSID *clsConnectsToFilter;
+    const WCHAR *strConnectsToPin;
+    UINT nMediaTypes;
+    const REGPINTYPES *lpMediaType;
+} REGFILTERPINS;
+
+#define MERIT_DO_NOT_USE    0x200000
+#define MERIT_NORMAL        0x600000
+
+// --- DirectShow interfaces ------------------------------------------
+
+struct IPin : public IUnknown {
+    virtual HRESULT Connect(IPin *pReceivePin, const AM_MEDIA_TYPE *pmt) = 0;
+    virtual HRESULT ReceiveConnection(IPin *pConnector, const AM_MEDIA_TYPE *pmt) = 0;
+    virtual HRESULT Disconnect() = 0;
+    virtual HRESULT ConnectedTo(IPin **pPin) = 0;
+    virtual HRESULT ConnectionMediaType(AM_MEDIA_TYPE *pmt) = 0;
+    virtual HRESULT QueryPinInfo(PIN_INFO *pInfo) = 0;
+    virtual HRESULT QueryDirection(PIN_DIRECTION *pPinDir) = 0;
+    virtual HRESULT QueryId(LPWSTR *Id) = 0;
+    virtual HRESULT QueryAccept(const AM_MEDIA_TYPE *pmt) = 0;
+    virtual HRESULT EnumMediaTypes(IEnumMediaTypes **ppEnum) = 0;
+    virtual HRESULT QueryInternalConnections(IPin **apPin, ULONG *nPin) = 0;
+    virtual HRESULT EndOfStream() = 0;
+    virtual HRESULT BeginFlush() = 0;
+    virtual HRESULT EndFlush() = 0;
+    virtual HRESULT NewSegment(REFERENCE_TIME tStart, REFERENCE_TIME tStop, double dRate) = 0;
+};
+
+struct IEnumPins : public IUnknown {
+    virtual HRESULT Next(ULONG cPins, IPin **ppPins, ULONG *pcFetched) = 0;
+    virtual HRESULT Skip(ULONG cPins) = 0;
+    virtual HRESULT Reset() = 0;
+    virtual HRESULT Clone(IEnumPins **ppEnum) = 0;
+};
+
+struct IEnumMediaTypes : public IUnknown {
+    virtual HRESULT Next(ULONG cMediaTypes, AM_MEDIA_TYPE **ppMediaTypes, ULONG *pcFetched) = 0;
+    virtual HRESULT Skip(ULONG cMediaTypes) = 0;
+    virtual HRESULT Reset() = 0;
+    virtual HRESULT Clone(IEnumMediaTypes **ppEnum) = 0;
+};
+
+struct IFilterGraph : public IUnknown {
+    virtual HRESULT AddFilter(IBaseFilter *pFilter, LPCWSTR pName) = 0;
+    virtual HRESULT RemoveFilter(IBaseFilter *pFilter) = 0;
+    virtual HRESULT EnumFilters(IEnumFilters **ppEnum) = 0;
+    virtual HRESULT FindFilterByName(LPCWSTR pName, IBaseFilter **ppFilter) = 0;
+    virtual HRESULT ConnectDirect(IPin *ppinOut, IPin *ppinIn, const AM_MEDIA_TYPE *pmt) = 0;
+    virtual HRESULT Reconnect(IPin *ppin) = 0;
+    virtual HRESULT Disconnect(IPin *ppin) = 0;
+    virtual HRESULT SetDefaultSyncSource() = 0;
+};
+
+struct IFilterGraph2 : public IFilterGraph {
+    virtual HRESULT ReconnectEx(IPin *ppin, const AM_MEDIA_TYPE *pmt) = 0;
+};
+
+struct IMediaFilter : public IPersist {
+    virtual HRESULT Stop() = 0;
+    virtual HRESULT Pause() = 0;
+    virtual HRESULT Run(REFERENCE_TIME tStart) = 0;
+    virtual HRESULT GetState(DWORD dwMilliSecsTimeout, FILTER_STATE *State) = 0;
+    virtual HRESULT SetSyncSource(IReferenceClock *pClock) = 0;
+    virtual HRESULT GetSyncSource(IReferenceClock **pClock) = 0;
+};
+
+struct IBaseFilter : public IMediaFilter {
+    virtual HRESULT EnumPins(IEnumPins **ppEnum) = 0;
+    virtual HRESULT FindPin(LPCWSTR Id, IPin **ppPin) = 0;
+    virtual HRESULT QueryFilterInfo(FILTER_INFO *pInfo) = 0;
+    virtual HRESULT JoinFilterGraph(IFilterGraph *pGraph, LPCWSTR pName) = 0;
+    virtual HRESULT QueryVendorInfo(LPWSTR *pVendorInfo) = 0;
+};
+
+struct IReferenceClock : public IUnknown {
+    virtual HRESULT GetTime(REFERENCE_TIME *pTime) = 0;
+    virtual HRESULT AdviseTime(REFERENCE_TIME baseTime, REFERENCE_TIME streamTime,
+                               HEVENT hEvent, DWORD_PTR *pdwAdviseCookie) = 0;
+    virtual HRESULT AdvisePeriodic(REFERENCE_TIME startTime, REFERENCE_TIME periodTime,
+                                   HSEMAPHORE hSemaphore, DWORD_PTR *pdwAdviseCookie) = 0;
+    virtual HRESULT Unadvise(DWORD_PTR dwAdviseCookie) = 0;
+};
+
+struct IReferenceClockTimerControl : public IUnknown {
+    virtual HRESULT SetDefaultTimerResolution(REFERENCE_TIME timerResolution) = 0;
+    virtual HRESULT GetDefaultTimerResolution(REFERENCE_TIME *pTimerResolution) = 0;
+};
+
+struct IMediaSample : public IUnknown {
+    virtual HRESULT GetPointer(BYTE **ppBuffer) = 0;
+    virtual LONG GetSize() = 0;
+    virtual HRESULT GetTime(REFERENCE_TIME *pTimeStart, REFERENCE_TIME *pTimeEnd) = 0;
+    virtual HRESULT SetTime(REFERENCE_TIME *pTimeStart, REFERENCE_TIME *pTimeEnd) = 0;
+    virtual HRESULT IsSyncPoint() = 0;
+    virtual HRESULT SetSyncPoint(BOOL bIsSyncPoint) = 0;
+    virtual HRESULT IsPreroll() = 0;
+    virtual HRESULT SetPreroll(BOOL bIsPreroll) = 0;
+    virtual LONG GetActualDataLength() = 0;
+    virtual HRESULT SetActualDataLength(LONG lLen) = 0;
+    virtual HRESULT GetMediaType(AM_MEDIA_TYPE **ppMediaType) = 0;
+    virtual HRESULT SetMediaType(AM_MEDIA_TYPE *pMediaType) = 0;
+    virtual HRESULT IsDiscontinuity() = 0;
+    virtual HRESULT SetDiscontinuity(BOOL bDiscontinuity) = 0;
+    virtual HRESULT GetMediaTime(LONGLONG *pTimeStart, LONGLONG *pTimeEnd) = 0;
+    virtual HRESULT SetMediaTime(LONGLONG *pTimeStart, LONGLONG *pTimeEnd) = 0;
+};
+
+typedef IMediaSample *PMEDIASAMPLE;
+
+struct IMediaSample2 : public IMediaSample {
+    virtual HRESULT GetProperties(DWORD cbProperties, BYTE *pbProperties) = 0;
+    virtual HRESULT SetProperties(DWORD cbProperties, const BYTE *pbProperties) = 0;
+};
+
+struct IMemAllocator : public IUnknown {
+    virtual HRESULT SetProperties(ALLOCATOR_PROPERTIES *pRequest, ALLOCATOR_PROPERTIES *pActual) = 0;
+    virtual HRESULT GetProperties(ALLOCATOR_PROPERTIES *pProps) = 0;
+    virtual HRESULT Commit() = 0;
+    virtual HRESULT Decommit() = 0;
+    virtual HRESULT GetBuffer(IMediaSample **ppBuffer, REFERENCE_TIME *pStartTime,
+                              REFERENCE_TIME *pEndTime, DWORD dwFlags) = 0;
+    virtual HRESULT ReleaseBuffer(IMediaSample *pBuffer) = 0;
+};
+
+struct IMemAllocatorCallbackTemp : public IMemAllocator {
+    virtual HRESULT SetNotify(IMemAllocatorNotifyCallbackTemp *pNotify) = 0;
+    virtual HRESULT GetFreeCount(LONG *plBuffersFree) = 0;
+};
+
+struct IMemAllocatorNotifyCallbackTemp : public IUnknown {
+    virtual HRESULT NotifyRelease() = 0;
+};
+
+struct IMemInputPin : public IUnknown {
+    virtual HRESULT GetAllocator(IMemAllocator **ppAllocator) = 0;
+    virtual HRESULT NotifyAllocator(IMemAllocator *pAllocator, BOOL bReadOnly) = 0;
+    virtual HRESULT GetAllocatorRequirements(ALLOCATOR_PROPERTIES *pProps) = 0;
+    virtual HRESULT Receive(IMediaSample *pSample) = 0;
+    virtual HRESULT ReceiveMultiple(IMediaSample **pSamples, LONG nSamples, LONG *nSamplesProcessed) = 0;
+    virtual HRESULT ReceiveCanBlock() = 0;
+};
+
+struct IQualityControl : public IUnknown {
+    virtual HRESULT Notify(IBaseFilter *pSelf, Quality q) = 0;
+    virtual HRESULT SetSink(IQualityControl *piqc) = 0;
+};
+
+struct IMediaEventSink : public IUnknown {
+    virtual HRESULT Notify(LONG EventCode, LONG_PTR EventParam1, LONG_PTR EventParam2) = 0;
+};
+
+struct IAMovieSetup : public IUnknown {
+    virtual HRESULT Register() = 0;
+    virtual HRESULT Unregister() = 0;
+};
+
+struct IAsyncReader : public IUnknown {
+    virtual HRESULT RequestAllocator(IMemAllocator *pPreferred, ALLOCATOR_PROPERTIES *pProps,
+                                     IMemAllocator **ppActual) = 0;
+    virtual HRESULT Request(IMediaSample *pSample, DWORD_PTR dwUser) = 0;
+    virtual HRESULT WaitForNext(DWORD dwTimeout, IMediaSample **ppSample, DWORD_PTR *pdwUser) = 0;
+    virtual HRESULT SyncReadAligned(IMediaSample *pSample) = 0;
+    virtual HRESULT SyncRead(LONGLONG llPosition, LONG lLength, BYTE *pBuffer) = 0;
+    virtual HRESULT Length(LONGLONG *pTotal, LONGLONG *pAvailable) = 0;
+    virtual HRESULT BeginFlush() = 0;
+    virtual HRESULT EndFlush() = 0;
+};
+
+struct ISeekingPassThru : public IUnknown {
+    virtual HRESULT Init(BOOL bSupportRendering, IPin *pPin) = 0;
+};
+
+struct IFilterMapper : public IUnknown {
+    virtual HRESULT RegisterFilter(CLSID clsid, LPCWSTR Name, DWORD dwMerit) = 0;
+    virtual HRESULT RegisterFilterInstance(CLSID clsid, LPCWSTR Name, CLSID *MRId) = 0;
+    virtual HRESULT RegisterPin(CLSID Filter, LPCWSTR Name, BOOL bRendered, BOOL bOutput,
+                                BOOL bZero, BOOL bMany, CLSID ConnectsToFilter,
+                                LPCWSTR ConnectsToPin) = 0;
+    virtual HRESULT RegisterPinType(CLSID clsFilter, LPCWSTR strName, CLSID clsMajorType,
+                                    CLSID clsSubType) = 0;
+    virtual HRESULT UnregisterFilter(CLSID Filter) = 0;
+};
+
+struct IPinConnection : public IUnknown {
+    virtual HRESULT DynamicQueryAccept(const AM_MEDIA_TYPE *pmt) = 0;
+    virtual HRESULT NotifyEndOfStream(HANDLE hNotifyEvent) = 0;
+    virtual HRESULT IsEndPin() = 0;
+    virtual HRESULT DynamicDisconnect() = 0;
+};
+
+struct IPinFlowControl : public IUnknown {
+    virtual HRESULT Block(DWORD dwBlockFlags, HANDLE hEvent) = 0;
+};
+
+struct IGraphConfig : public IUnknown {
+    virtual HRESULT Reconnect(IPin *pOutputPin, IPin *pInputPin,
+                              const AM_MEDIA_TYPE *pmtFirstConnection,
+                              IBaseFilter *pUsingFilter, HANDLE hAbortEvent,
+                              DWORD dwFlags) = 0;
+};
+
+#endif // __strmif_h__
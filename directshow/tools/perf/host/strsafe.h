@@ -0,0 +1,111 @@
+//------------------------------------------------------------------------------
+// File: StrSafe.h
+//
+// Desc: The StringCch and StringCb functions the base classes use, over
+//       vsnprintf, for the performance harnesses.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#ifndef __PERF_STRSAFE__
+#define __PERF_STRSAFE__
+
+inline HRESULT StringCchVPrintfA(LPSTR psz, size_t cch, LPCSTR pszFormat, va_list va)
+{
+    if (cch == 0) {
+        return STRSAFE_E_INVALID_PARAMETER;
+    }
+    char szFormat[1024];
+    int c = vsnprintf(psz, cch, HostFormatA(pszFormat, szFormat, sizeof(szFormat)), va);
+    return (c < 0 || (size_t)c >= cch) ? STRSAFE_E_INSUFFICIENT_BUFFER : S_OK;
+}
+
+inline HRESULT StringCchPrintfA(LPSTR psz, size_t cch, LPCSTR pszFormat, ...)
+{
+    va_list va;
+    va_start(va, pszFormat);
+    HRESULT hr = StringCchVPrintfA(psz, cch, pszFormat, va);
+    va_end(va);
+    return hr;
+}
+
+inline HRESULT StringCchPrintfExA(LPSTR psz, size_t cch, LPSTR *ppszEnd, size_t *pcchRemaining,
+                                  DWORD dwFlags, LPCSTR pszFormat, ...)
+{
+    va_list va;
+    va_start(va, pszFormat);
+    HRESULT hr = StringCchVPrintfA(psz, cch, pszFormat, va);
+    va_end(va);
+    size_t c = strlen(psz);
+    if (ppszEnd) {
+        *ppszEnd = psz + c;
+    }
+    if (pcchRemaining) {
+        *pcchRemaining = cch - c;
+    }
+    return hr;
+}
+
+inline HRESULT StringCchCopyA(LPSTR pszDest, size_t cch, LPCSTR pszSrc)
+{
+    return StringCchPrintfA(pszDest, cch, "%s", pszSrc);
+}
+
+inline HRESULT StringCchCopyNA(LPSTR pszDest, size_t cch, LPCSTR pszSrc, size_t cchSrc)
+{
+    return StringCchPrintfA(pszDest, cch, "%.*s", (int)cchSrc, pszSrc);
+}
+
+inline HRESULT StringCchCatA(LPSTR pszDest, size_t cch, LPCSTR pszSrc)
+{
+    size_t c = strlen(pszDest);
+    if (c >= cch) {
+        return STRSAFE_E_INVALID_PARAMETER;
+    }
+    return StringCchCopyA(pszDest + c, cch - c, pszSrc);
+}
+
+inline HRESULT StringCchCopyW(LPWSTR pszDest, size_t cch, LPCWSTR pszSrc)
+{
+    if (cch == 0) {
+        return STRSAFE_E_INVALID_PARAMETER;
+    }
+    size_t c = wcslen(pszSrc);
+    HRESULT hr = S_OK;
+    if (c >= cch) {
+        c = cch - 1;
+        hr = STRSAFE_E_INSUFFICIENT_BUFFER;
+    }
+    wmemcpy(pszDest, pszSrc, c);
+    pszDest[c] = 0;
+    return hr;
+}
+
+inline HRESULT StringCchLengthW(LPCWSTR psz, size_t cchMax, size_t *pcch)
+{
+    size_t c = wcsnlen(psz, cchMax);
+    if (pcch) {
+        *pcch = c;
+    }
+    return c == cchMax ? STRSAFE_E_INVALID_PARAMETER : S_OK;
+}
+
+inline HRESULT StringCbLengthW(LPCWSTR psz, size_t cbMax, size_t *pcb)
+{
+    size_t cch;
+    HRESULT hr = StringCchLengthW(psz, cbMax / sizeof(WCHAR), &cch);
+    if (pcb) {
+        *pcb = cch * sizeof(WCHAR);
+    }
+    return hr;
+}
+
+#define StringCchPrintf     StringCchPrintfA
+#define StringCchPrintfEx   StringCchPrintfExA
+#define StringCchVPrintf    StringCchVPrintfA
+#define StringCchCopy       StringCchCopyA
+#define StringCchCopyN      StringCchCopyNA
+#define StringCchCat        StringCchCatA
+
+#endif // __PERF_STRSAFE__
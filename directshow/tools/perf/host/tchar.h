@@ -0,0 +1,11 @@
+//------------------------------------------------------------------------------
+// File: TChar.h
+//
+// Desc: The harnesses are built without UNICODE, so the generic text
+//       mappings are the ANSI ones Win32.h already gives.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#include <win32.h>
@@ -0,0 +1,1609 @@
+//------------------------------------------------------------------------------
+// File: Win32.cpp
+//
+// Desc: The Win32 functions that Win32.h declares, on POSIX, for the
+//       performance harnesses. Events, semaphores, threads and completion
+//       ports are one kind of waitable object under a single lock, each
+//       waiter sleeping on its own condition variable. WaitOnAddress is a
+//       futex on a hashed sequence word. Overlapped reads go to a few
+//       host I/O threads, so like a real completion port they can finish
+//       out of order. None of it knows NUMA nodes or large pages.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+// the system headers go in before Win32.h's SAL macros
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <linux/futex.h>
+#include <strings.h>
+#include <deque>
+#include <map>
+
+#define INITGUID
+#include <streams.h>
+
+
+// --- waitable objects -------------------------------------------------
+
+enum HostObjectType {
+    HostEvent,
+    HostSemaphore,
+    HostMutex,
+    HostThread,
+    HostPort,
+    HostFile,
+    HostMapping,
+    HostTimer
+};
+
+struct HostWaiter {
+    pthread_cond_t Cond;
+    HostWaiter() {
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&Cond, &attr);
+        pthread_condattr_destroy(&attr);
+    }
+};
+
+struct HostPacket {
+    DWORD cbTransferred;
+    ULONG_PTR Key;
+    LPOVERLAPPED pov;
+    DWORD dwError;
+};
+
+struct HostObject {
+    HostObjectType Type;
+    LONG cRef;
+    std::vector<HostWaiter *> Waiters;
+
+    // events, semaphores, mutexes and threads
+    BOOL bManualReset;
+    BOOL bSignalled;
+    LONG lCount;
+    LONG lMaximum;
+    DWORD dwOwner;
+    LONG lRecursion;
+
+    // threads
+    LPTHREAD_START_ROUTINE pfnStart;
+    LPVOID pvStart;
+    DWORD dwThreadId;
+    DWORD dwExitCode;
+    int nPriority;
+    BOOL bSuspended;
+
+    // completion ports
+    std::deque<HostPacket> Packets;
+
+    // files and mappings
+    int fd;
+    BOOL bOverlapped;
+    HostObject *pPort;
+    ULONG_PTR PortKey;
+    LONGLONG llSize;
+    BOOL bCopyOnWrite;
+
+    explicit HostObject(HostObjectType t)
+        : Type(t), cRef(1), bManualReset(FALSE), bSignalled(FALSE),
+          lCount(0), lMaximum(0), dwOwner(0), lRecursion(0),
+          pfnStart(NULL), pvStart(NULL), dwThreadId(0), dwExitCode(STILL_ACTIVE),
+          nPriority(THREAD_PRIORITY_NORMAL), bSuspended(FALSE),
+          fd(-1), bOverlapped(FALSE), pPort(NULL), PortKey(0), llSize(0),
+          bCopyOnWrite(FALSE) {}
+};
+
+static pthread_mutex_t g_Lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread HostWaiter *t_pWaiter;
+static __thread DWORD t_dwLastError;
+static __thread DWORD t_dwThreadId;
+static __thread HostObject *t_pThread;
+
+#define PSEUDO_THREAD   ((HANDLE)(LONG_PTR)-2)
+#define PSEUDO_PROCESS  ((HANDLE)(LONG_PTR)-1)
+
+DWORD GetLastError() { return t_dwLastError; }
+void SetLastError(DWORD dwError) { t_dwLastError = dwError; }
+
+static HostObject *ObjectFromHandle(HANDLE h)
+{
+    if (h == NULL || h == INVALID_HANDLE_VALUE || h == PSEUDO_THREAD) {
+        return NULL;
+    }
+    return (HostObject *) h;
+}
+
+static void NotifyWaiters(HostObject *pObject)
+{
+    for (size_t i = 0; i < pObject->Waiters.size(); i++) {
+        pthread_cond_signal(&pObject->Waiters[i]->Cond);
+    }
+}
+
+// called holding g_Lock
+static void ReleaseObject(HostObject *pObject)
+{
+    if (--pObject->cRef == 0) {
+        if (pObject->fd >= 0 && pObject->fd > 2) {
+            close(pObject->fd);
+        }
+        delete pObject;
+    }
+}
+
+BOOL CloseHandle(HANDLE h)
+{
+    HostObject *pObject = ObjectFromHandle(h);
+    if (pObject == NULL) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+    pthread_mutex_lock(&g_Lock);
+    ReleaseObject(pObject);
+    pthread_mutex_unlock(&g_Lock);
+    return TRUE;
+}
+
+BOOL DuplicateHandle(HANDLE hSourceProcess, HANDLE hSource, HANDLE hTargetProcess,
+                     LPHANDLE phTarget, DWORD dwAccess, BOOL bInherit, DWORD dwOptions)
+{
+    HostObject *pObject = hSource == PSEUDO_THREAD ? t_pThread : ObjectFromHandle(hSource);
+    if (pObject == NULL) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+    pthread_mutex_lock(&g_Lock);
+    pObject->cRef++;
+    if (dwOptions & DUPLICATE_CLOSE_SOURCE) {
+        ReleaseObject(pObject);
+    }
+    pthread_mutex_unlock(&g_Lock);
+    *phTarget = (HANDLE) pObject;
+    return TRUE;
+}
+
+// called holding g_Lock
+static BOOL IsSignalled(HostObject *pObject)
+{
+    switch (pObject->Type) {
+    case HostSemaphore:
+        return pObject->lCount > 0;
+    case HostMutex:
+        return pObject->dwOwner == 0 || pObject->dwOwner == GetCurrentThreadId();
+    case HostPort:
+        return !pObject->Packets.empty();
+    default:
+        return pObject->bSignalled;
+    }
+}
+
+// called holding g_Lock, on an object IsSignalled passed
+static void Consume(HostObject *pObject)
+{
+    switch (pObject->Type) {
+    case HostSemaphore:
+        pObject->lCount--;
+        break;
+    case HostMutex:
+        pObject->dwOwner = GetCurrentThreadId();
+        pObject->lRecursion++;
+        break;
+    case HostEvent:
+    case HostTimer:
+        if (!pObject->bManualReset) {
+            pObject->bSignalled = FALSE;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void DeadlineFromNow(struct timespec *pts, DWORD dwMilliseconds)
+{
+    clock_gettime(CLOCK_MONOTONIC, pts);
+    pts->tv_sec += dwMilliseconds / 1000;
+    pts->tv_nsec += (long) (dwMilliseconds % 1000) * 1000000;
+    if (pts->tv_nsec >= 1000000000) {
+        pts->tv_sec++;
+        pts->tv_nsec -= 1000000000;
+    }
+}
+
+static HostWaiter *CurrentWaiter()
+{
+    if (t_pWaiter == NULL) {
+        t_pWaiter = new HostWaiter;
+    }
+    return t_pWaiter;
+}
+
+// called holding g_Lock; returns the WAIT_ code with the lock still held.
+// The chosen object is left unconsumed if bConsume is FALSE, which is
+// what GetQueuedCompletionStatus wants
+static DWORD WaitLocked(DWORD nCount, HostObject **ppObjects, BOOL bWaitAll,
+                        DWORD dwMilliseconds, BOOL bConsume)
+{
+    struct timespec tsDeadline;
+    if (dwMilliseconds != INFINITE) {
+        DeadlineFromNow(&tsDeadline, dwMilliseconds);
+    }
+    HostWaiter *pWaiter = CurrentWaiter();
+
+    for (;;) {
+        if (bWaitAll) {
+            DWORD i;
+            for (i = 0; i < nCount && IsSignalled(ppObjects[i]); i++) {
+            }
+            if (i == nCount) {
+                for (i = 0; i < nCount; i++) {
+                    if (bConsume) Consume(ppObjects[i]);
+                }
+                return WAIT_OBJECT_0;
+            }
+        } else {
+            for (DWORD i = 0; i < nCount; i++) {
+                if (IsSignalled(ppObjects[i])) {
+                    if (bConsume) Consume(ppObjects[i]);
+                    return WAIT_OBJECT_0 + i;
+                }
+            }
+        }
+        if (dwMilliseconds == 0) {
+            return WAIT_TIMEOUT;
+        }
+
+        for (DWORD i = 0; i < nCount; i++) {
+            ppObjects[i]->Waiters.push_back(pWaiter);
+        }
+        int err = 0;
+        if (dwMilliseconds == INFINITE) {
+            pthread_cond_wait(&pWaiter->Cond, &g_Lock);
+        } else {
+            err = pthread_cond_timedwait(&pWaiter->Cond, &g_Lock, &tsDeadline);
+        }
+        for (DWORD i = 0; i < nCount; i++) {
+            std::vector<HostWaiter *> &w = ppObjects[i]->Waiters;
+            w.erase(std::find(w.begin(), w.end(), pWaiter));
+        }
+        if (err == ETIMEDOUT) {
+            dwMilliseconds = 0;
+        }
+    }
+}
+
+DWORD WaitForMultipleObjects(DWORD nCount, const HANDLE *ph, BOOL bWaitAll, DWORD dwMilliseconds)
+{
+    HostObject *apObjects[MAXIMUM_WAIT_OBJECTS];
+    if (nCount == 0 || nCount > MAXIMUM_WAIT_OBJECTS) {
+        if (nCount == 0) {
+            Sleep(dwMilliseconds == INFINITE ? 0 : dwMilliseconds);
+            return WAIT_TIMEOUT;
+        }
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return WAIT_FAILED;
+    }
+    for (DWORD i = 0; i < nCount; i++) {
+        apObjects[i] = ph[i] == PSEUDO_THREAD ? t_pThread : ObjectFromHandle(ph[i]);
+        if (apObjects[i] == NULL) {
+            SetLastError(ERROR_INVALID_HANDLE);
+            return WAIT_FAILED;
+        }
+    }
+    pthread_mutex_lock(&g_Lock);
+    DWORD dw = WaitLocked(nCount, apObjects, bWaitAll, dwMilliseconds, TRUE);
+    pthread_mutex_unlock(&g_Lock);
+    return dw;
+}
+
+DWORD WaitForSingleObject(HANDLE h, DWORD dwMilliseconds)
+{
+    return WaitForMultipleObjects(1, &h, FALSE, dwMilliseconds);
+}
+
+DWORD WaitForSingleObjectEx(HANDLE h, DWORD dwMilliseconds, BOOL bAlertable)
+{
+    return WaitForMultipleObjects(1, &h, FALSE, dwMilliseconds);
+}
+
+// there is never a message, so this is just the object wait
+DWORD MsgWaitForMultipleObjects(DWORD nCount, const HANDLE *ph, BOOL bWaitAll,
+                                DWORD dwMilliseconds, DWORD dwWakeMask)
+{
+    return WaitForMultipleObjects(nCount, ph, bWaitAll, dwMilliseconds);
+}
+
+HANDLE CreateEventA(LPSECURITY_ATTRIBUTES lpsa, BOOL bManualReset, BOOL bInitialState, LPCSTR pName)
+{
+    HostObject *pObject = new HostObject(HostEvent);
+    pObject->bManualReset = bManualReset;
+    pObject->bSignalled = bInitialState;
+    return (HANDLE) pObject;
+}
+
+BOOL SetEvent(HANDLE hEvent)
+{
+    HostObject *pObject = ObjectFromHandle(hEvent);
+    if (pObject == NULL) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+    pthread_mutex_lock(&g_Lock);
+    pObject->bSignalled = TRUE;
+    NotifyWaiters(pObject);
+    pthread_mutex_unlock(&g_Lock);
+    return TRUE;
+}
+
+BOOL ResetEvent(HANDLE hEvent)
+{
+    HostObject *pObject = ObjectFromHandle(hEvent);
+    if (pObject == NULL) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+    pthread_mutex_lock(&g_Lock);
+    pObject->bSignalled = FALSE;
+    pthread_mutex_unlock(&g_Lock);
+    return TRUE;
+}
+
+// nothing waits on a pulsed event in the base classes; this wakes
+// whoever is waiting now and leaves the event reset
+BOOL PulseEvent(HANDLE hEvent)
+{
+    SetEvent(hEvent);
+    SwitchToThread();
+    return ResetEvent(hEvent);
+}
+
+HANDLE CreateSemaphoreA(LPSECURITY_ATTRIBUTES lpsa, LONG lInitialCount, LONG lMaximumCount, LPCSTR pName)
+{
+    HostObject *pObject = new HostObject(HostSemaphore);
+    pObject->lCount = lInitialCount;
+    pObject->lMaximum = lMaximumCount;
+    return (HANDLE) pObject;
+}
+
+BOOL ReleaseSemaphore(HANDLE hSemaphore, LONG lReleaseCount, LPLONG plPreviousCount)
+{
+    HostObject *pObject = ObjectFromHandle(hSemaphore);
+    if (pObject == NULL) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+    pthread_mutex_lock(&g_Lock);
+    if (plPreviousCount) {
+        *plPreviousCount = pObject->lCount;
+    }
+    if (lReleaseCount <= 0 || pObject->lCount + lReleaseCount > pObject->lMaximum) {
+        pthread_mutex_unlock(&g_Lock);
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    pObject->lCount += lReleaseCount;
+    NotifyWaiters(pObject);
+    pthread_mutex_unlock(&g_Lock);
+    return TRUE;
+}
+
+HANDLE CreateMutexA(LPSECURITY_ATTRIBUTES lpsa, BOOL bInitialOwner, LPCSTR pName)
+{
+    HostObject *pObject = new HostObject(HostMutex);
+    if (bInitialOwner) {
+        pObject->dwOwner = GetCurrentThreadId();
+        pObject->lRecursion = 1;
+    }
+    return (HANDLE) pObject;
+}
+
+BOOL ReleaseMutex(HANDLE hMutex)
+{
+    HostObject *pObject = ObjectFromHandle(hMutex);
+    pthread_mutex_lock(&g_Lock);
+    if (pObject == NULL || pObject->dwOwner != GetCurrentThreadId()) {
+        pthread_mutex_unlock(&g_Lock);
+        SetLastError(ERROR_ACCESS_DENIED);
+        return FALSE;
+    }
+    if (--pObject->lRecursion == 0) {
+        pObject->dwOwner = 0;
+        NotifyWaiters(pObject);
+    }
+    pthread_mutex_unlock(&g_Lock);
+    return TRUE;
+}
+
+// --- WaitOnAddress ----------------------------------------------------
+//
+// Each address hashes to a sequence word. A waker changes the value,
+// then bumps the sequence and wakes everything sleeping on it; a waiter
+// reads the sequence before it compares the value, so a wake between the
+// compare and the futex call changes the sequence and the futex returns
+// at once. Addresses sharing a bucket only see spurious wakeups, which
+// WaitOnAddress allows
+
+static const int c_nAddressBuckets = 256;
+static struct {
+    volatile int nSequence;
+    char Pad[60];
+} g_AddressBuckets[c_nAddressBuckets];
+
+static volatile int *BucketFor(volatile void *Address)
+{
+    uintptr_t u = (uintptr_t) Address;
+    u = (u >> 3) ^ (u >> 11);
+    return &g_AddressBuckets[u % c_nAddressBuckets].nSequence;
+}
+
+BOOL WaitOnAddress(volatile void *Address, PVOID CompareAddress, SIZE_T AddressSize, DWORD dwMilliseconds)
+{
+    volatile int *pSequence = BucketFor(Address);
+    int nSequence = __atomic_load_n(pSequence, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (memcmp((const void *) Address, CompareAddress, AddressSize) != 0) {
+        return TRUE;
+    }
+
+    struct timespec ts, *pts = NULL;
+    if (dwMilliseconds != INFINITE) {
+        ts.tv_sec = dwMilliseconds / 1000;
+        ts.tv_nsec = (long) (dwMilliseconds % 1000) * 1000000;
+        pts = &ts;
+    }
+    if (syscall(SYS_futex, pSequence, FUTEX_WAIT_PRIVATE, nSequence, pts, NULL, 0) != 0 &&
+        errno == ETIMEDOUT) {
+        SetLastError(ERROR_TIMEOUT);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void WakeByAddressAll(PVOID Address)
+{
+    volatile int *pSequence = BucketFor(Address);
+    __atomic_add_fetch(pSequence, 1, __ATOMIC_SEQ_CST);
+    syscall(SYS_futex, pSequence, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+// the buckets are shared, so waking one sleeper might wake the wrong one
+void WakeByAddressSingle(PVOID Address)
+{
+    WakeByAddressAll(Address);
+}
+
+// --- critical sections ----------------------------------------------
+
+void InitializeCriticalSection(LPCRITICAL_SECTION pcs)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&pcs->Mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+BOOL InitializeCriticalSectionAndSpinCount(LPCRITICAL_SECTION pcs, DWORD dwSpinCount)
+{
+    InitializeCriticalSection(pcs);
+    return TRUE;
+}
+
+void DeleteCriticalSection(LPCRITICAL_SECTION pcs) { pthread_mutex_destroy(&pcs->Mutex); }
+void EnterCriticalSection(LPCRITICAL_SECTION pcs) { pthread_mutex_lock(&pcs->Mutex); }
+BOOL TryEnterCriticalSection(LPCRITICAL_SECTION pcs) { return pthread_mutex_trylock(&pcs->Mutex) == 0; }
+void LeaveCriticalSection(LPCRITICAL_SECTION pcs) { pthread_mutex_unlock(&pcs->Mutex); }
+
+// --- threads ----------------------------------------------------------
+
+DWORD GetCurrentThreadId()
+{
+    if (t_dwThreadId == 0) {
+        t_dwThreadId = (DWORD) syscall(SYS_gettid);
+    }
+    return t_dwThreadId;
+}
+
+DWORD GetCurrentProcessId() { return (DWORD) getpid(); }
+HANDLE GetCurrentThread() { return PSEUDO_THREAD; }
+HANDLE GetCurrentProcess() { return PSEUDO_PROCESS; }
+
+static void *ThreadTrampoline(void *pv)
+{
+    HostObject *pThread = (HostObject *) pv;
+    t_pThread = pThread;
+
+    pthread_mutex_lock(&g_Lock);
+    pThread->dwThreadId = GetCurrentThreadId();
+    NotifyWaiters(pThread);
+    while (pThread->bSuspended) {
+        HostWaiter *pWaiter = CurrentWaiter();
+        pThread->Waiters.push_back(pWaiter);
+        pthread_cond_wait(&pWaiter->Cond, &g_Lock);
+        std::vector<HostWaiter *> &w = pThread->Waiters;
+        w.erase(std::find(w.begin(), w.end(), pWaiter));
+    }
+    pthread_mutex_unlock(&g_Lock);
+
+    DWORD dwExit = pThread->pfnStart(pThread->pvStart);
+
+    pthread_mutex_lock(&g_Lock);
+    pThread->dwExitCode = dwExit;
+    pThread->bSignalled = TRUE;
+    NotifyWaiters(pThread);
+    ReleaseObject(pThread);
+    pthread_mutex_unlock(&g_Lock);
+
+    delete t_pWaiter;
+    t_pWaiter = NULL;
+    return NULL;
+}
+
+HANDLE CreateThread(LPSECURITY_ATTRIBUTES lpsa, SIZE_T cbStack,
+                    LPTHREAD_START_ROUTINE pfn, LPVOID pv,
+                    DWORD dwFlags, LPDWORD pdwThreadId)
+{
+    HostObject *pThread = new HostObject(HostThread);
+    pThread->cRef = 2;      // the handle and the running thread
+    pThread->pfnStart = pfn;
+    pThread->pvStart = pv;
+    pThread->bSuspended = (dwFlags & CREATE_SUSPENDED) != 0;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (cbStack) {
+        pthread_attr_setstacksize(&attr, (std::max)(cbStack, (SIZE_T) PTHREAD_STACK_MIN));
+    }
+    pthread_t tid;
+    int err = pthread_create(&tid, &attr, ThreadTrampoline, pThread);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        delete pThread;
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return NULL;
+    }
+
+    // the id is only known once the thread has run
+    pthread_mutex_lock(&g_Lock);
+    HostWaiter *pWaiter = CurrentWaiter();
+    while (pThread->dwThreadId == 0) {
+        pThread->Waiters.push_back(pWaiter);
+        pthread_cond_wait(&pWaiter->Cond, &g_Lock);
+        std::vector<HostWaiter *> &w = pThread->Waiters;
+        w.erase(std::find(w.begin(), w.end(), pWaiter));
+    }
+    if (pdwThreadId) {
+        *pdwThreadId = pThread->dwThreadId;
+    }
+    pthread_mutex_unlock(&g_Lock);
+    return (HANDLE) pThread;
+}
+
+DWORD ResumeThread(HANDLE hThread)
+{
+    HostObject *pThread = ObjectFromHandle(hThread);
+    if (pThread == NULL) {
+        return (DWORD) -1;
+    }
+    pthread_mutex_lock(&g_Lock);
+    DWORD dwPrevious = pThread->bSuspended ? 1 : 0;
+    pThread->bSuspended = FALSE;
+    NotifyWaiters(pThread);
+    pthread_mutex_unlock(&g_Lock);
+    return dwPrevious;
+}
+
+// a running thread cannot be stopped from outside here
+DWORD SuspendThread(HANDLE hThread)
+{
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return (DWORD) -1;
+}
+
+BOOL GetExitCodeThread(HANDLE hThread, LPDWORD pdwExitCode)
+{
+    HostObject *pThread = ObjectFromHandle(hThread);
+    if (pThread == NULL) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+    pthread_mutex_lock(&g_Lock);
+    *pdwExitCode = pThread->dwExitCode;
+    pthread_mutex_unlock(&g_Lock);
+    return TRUE;
+}
+
+// the priority is remembered and reported but the scheduler never sees
+// it, as raising it needs privileges the harnesses do not have
+static __thread int t_nPriority;
+
+BOOL SetThreadPriority(HANDLE hThread, int nPriority)
+{
+    HostObject *pThread = hThread == PSEUDO_THREAD ? t_pThread : ObjectFromHandle(hThread);
+    if (pThread == NULL) {
+        t_nPriority = nPriority;
+        return TRUE;
+    }
+    pThread->nPriority = nPriority;
+    return TRUE;
+}
+
+int GetThreadPriority(HANDLE hThread)
+{
+    HostObject *pThread = hThread == PSEUDO_THREAD ? t_pThread : ObjectFromHandle(hThread);
+    return pThread ? pThread->nPriority : t_nPriority;
+}
+
+DWORD GetThreadId(HANDLE hThread)
+{
+    if (hThread == PSEUDO_THREAD) {
+        return GetCurrentThreadId();
+    }
+    HostObject *pThread = ObjectFromHandle(hThread);
+    return pThread ? pThread->dwThreadId : 0;
+}
+
+void Sleep(DWORD dwMilliseconds)
+{
+    if (dwMilliseconds == 0) {
+        sched_yield();
+        return;
+    }
+    struct timespec ts;
+    ts.tv_sec = dwMilliseconds / 1000;
+    ts.tv_nsec = (long) (dwMilliseconds % 1000) * 1000000;
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+BOOL SwitchToThread()
+{
+    sched_yield();
+    return TRUE;
+}
+
+DWORD_PTR SetThreadAffinityMask(HANDLE hThread, DWORD_PTR dwMask)
+{
+    return 1;
+}
+
+DWORD TlsAlloc()
+{
+    pthread_key_t key;
+    if (pthread_key_create(&key, NULL) != 0) {
+        return TLS_OUT_OF_INDEXES;
+    }
+    return (DWORD) key;
+}
+
+BOOL TlsFree(DWORD dwIndex) { return pthread_key_delete((pthread_key_t) dwIndex) == 0; }
+LPVOID TlsGetValue(DWORD dwIndex) { return pthread_getspecific((pthread_key_t) dwIndex); }
+BOOL TlsSetValue(DWORD dwIndex, LPVOID pv) { return pthread_setspecific((pthread_key_t) dwIndex, pv) == 0; }
+
+// --- time -------------------------------------------------------------
+
+// QueryPerformanceCounter ticks at 10MHz, as it does on most current
+// Windows systems
+BOOL QueryPerformanceCounter(LARGE_INTEGER *pCount)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    pCount->QuadPart = (LONGLONG) ts.tv_sec * 10000000 + ts.tv_nsec / 100;
+    return TRUE;
+}
+
+BOOL QueryPerformanceFrequency(LARGE_INTEGER *pFrequency)
+{
+    pFrequency->QuadPart = 10000000;
+    return TRUE;
+}
+
+ULONGLONG GetTickCount64()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ULONGLONG) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+DWORD GetTickCount() { return (DWORD) GetTickCount64(); }
+DWORD timeGetTime() { return (DWORD) GetTickCount64(); }
+
+void GetSystemTimeAsFileTime(LPFILETIME pft)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ULONGLONG ull = ((ULONGLONG) ts.tv_sec + 11644473600ULL) * 10000000 + ts.tv_nsec / 100;
+    pft->dwLowDateTime = (DWORD) ull;
+    pft->dwHighDateTime = (DWORD) (ull >> 32);
+}
+
+MMRESULT timeGetDevCaps(LPTIMECAPS ptc, UINT cbtc)
+{
+    ptc->wPeriodMin = 1;
+    ptc->wPeriodMax = 1000000;
+    return TIMERR_NOERROR;
+}
+
+MMRESULT timeBeginPeriod(UINT uPeriod) { return TIMERR_NOERROR; }
+MMRESULT timeEndPeriod(UINT uPeriod) { return TIMERR_NOERROR; }
+
+// each multimedia timer is a thread that waits on its own object for the
+// delay, so timeKillEvent can stop it by signalling that object
+struct HostTimerThread {
+    HostObject *pKill;
+    UINT uDelay;
+    LPTIMECALLBACK pfn;
+    DWORD_PTR dwUser;
+    UINT fuEvent;
+    UINT uID;
+};
+
+static std::map<UINT, HostTimerThread *> g_Timers;
+static UINT g_uNextTimer = 1;
+
+static DWORD WINAPI TimerThreadProc(LPVOID pv)
+{
+    HostTimerThread *pTimer = (HostTimerThread *) pv;
+    HANDLE hKill = (HANDLE) pTimer->pKill;
+    do {
+        if (WaitForSingleObject(hKill, pTimer->uDelay) != WAIT_TIMEOUT) {
+            break;
+        }
+        if (pTimer->fuEvent & TIME_CALLBACK_EVENT_SET) {
+            SetEvent((HANDLE) pTimer->dwUser);
+        } else if (pTimer->fuEvent & TIME_CALLBACK_EVENT_PULSE) {
+            PulseEvent((HANDLE) pTimer->dwUser);
+        } else {
+            pTimer->pfn(pTimer->uID, 0, pTimer->dwUser, 0, 0);
+        }
+    } while (pTimer->fuEvent & TIME_PERIODIC);
+
+    pthread_mutex_lock(&g_Lock);
+    g_Timers.erase(pTimer->uID);
+    pthread_mutex_unlock(&g_Lock);
+    CloseHandle(hKill);
+    delete pTimer;
+    return 0;
+}
+
+MMRESULT timeSetEvent(UINT uDelay, UINT uResolution, LPTIMECALLBACK fptc, DWORD_PTR dwUser, UINT fuEvent)
+{
+    HostTimerThread *pTimer = new HostTimerThread;
+    pTimer->pKill = (HostObject *) CreateEventA(NULL, TRUE, FALSE, NULL);
+    pTimer->uDelay = uDelay;
+    pTimer->pfn = fptc;
+    pTimer->dwUser = dwUser;
+    pTimer->fuEvent = fuEvent;
+
+    pthread_mutex_lock(&g_Lock);
+    pTimer->uID = g_uNextTimer++;
+    g_Timers[pTimer->uID] = pTimer;
+    pthread_mutex_unlock(&g_Lock);
+
+    UINT uID = pTimer->uID;
+    HANDLE hThread = CreateThread(NULL, 0, TimerThreadProc, pTimer, 0, NULL);
+    if (hThread == NULL) {
+        return 0;
+    }
+    CloseHandle(hThread);
+    return uID;
+}
+
+MMRESULT timeKillEvent(UINT uTimerID)
+{
+    pthread_mutex_lock(&g_Lock);
+    std::map<UINT, HostTimerThread *>::iterator it = g_Timers.find(uTimerID);
+    if (it == g_Timers.end()) {
+        pthread_mutex_unlock(&g_Lock);
+        return 1;   // MMSYSERR_ERROR
+    }
+    HostObject *pKill = it->second->pKill;
+    pKill->bSignalled = TRUE;
+    NotifyWaiters(pKill);
+    pthread_mutex_unlock(&g_Lock);
+    return TIMERR_NOERROR;
+}
+
+// --- memory and the system --------------------------------------------
+
+// never destroyed, as the slab cache releases its blocks from a static
+// destructor that may run after ours would have
+static std::map<void *, SIZE_T> &g_Regions = *new std::map<void *, SIZE_T>;
+
+LPVOID VirtualAlloc(LPVOID pv, SIZE_T cb, DWORD flAllocationType, DWORD flProtect)
+{
+    if (pv != NULL || (flAllocationType & MEM_LARGE_PAGES)) {
+        SetLastError(ERROR_NOT_SUPPORTED);
+        return NULL;
+    }
+    int nProt = flProtect == PAGE_NOACCESS ? PROT_NONE :
+                flProtect == PAGE_READONLY ? PROT_READ : PROT_READ | PROT_WRITE;
+    void *p = mmap(NULL, cb, nProt, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return NULL;
+    }
+    pthread_mutex_lock(&g_Lock);
+    g_Regions[p] = cb;
+    pthread_mutex_unlock(&g_Lock);
+    return p;
+}
+
+// there is no libnuma here, so the preferred node is only a hint that
+// nothing takes
+LPVOID VirtualAllocExNuma(HANDLE hProcess, LPVOID pv, SIZE_T cb, DWORD flAllocationType,
+                          DWORD flProtect, DWORD nndPreferred)
+{
+    return VirtualAlloc(pv, cb, flAllocationType, flProtect);
+}
+
+BOOL VirtualFree(LPVOID pv, SIZE_T cb, DWORD dwFreeType)
+{
+    pthread_mutex_lock(&g_Lock);
+    std::map<void *, SIZE_T>::iterator it = g_Regions.find(pv);
+    if (it == g_Regions.end() || !(dwFreeType & MEM_RELEASE)) {
+        pthread_mutex_unlock(&g_Lock);
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    SIZE_T cbRegion = it->second;
+    g_Regions.erase(it);
+    pthread_mutex_unlock(&g_Lock);
+    munmap(pv, cbRegion);
+    return TRUE;
+}
+
+SIZE_T GetLargePageMinimum()
+{
+    return 0;
+}
+
+void GetSystemInfo(LPSYSTEM_INFO psi)
+{
+    ZeroMemory(psi, sizeof(*psi));
+    psi->dwPageSize = (DWORD) sysconf(_SC_PAGESIZE);
+    psi->dwNumberOfProcessors = (DWORD) sysconf(_SC_NPROCESSORS_ONLN);
+    psi->dwAllocationGranularity = 65536;
+    psi->dwActiveProcessorMask = psi->dwNumberOfProcessors >= 64 ? ~(DWORD_PTR) 0 :
+                                 ((DWORD_PTR) 1 << psi->dwNumberOfProcessors) - 1;
+}
+
+DWORD GetCurrentProcessorNumber()
+{
+    unsigned cpu = 0;
+    syscall(SYS_getcpu, &cpu, NULL, NULL);
+    return cpu;
+}
+
+void GetCurrentProcessorNumberEx(PPROCESSOR_NUMBER pProcNumber)
+{
+    pProcNumber->Group = 0;
+    pProcNumber->Number = (BYTE) GetCurrentProcessorNumber();
+    pProcNumber->Reserved = 0;
+}
+
+// a processor's node is the nodeN entry in its sysfs directory
+BOOL GetNumaProcessorNodeEx(PPROCESSOR_NUMBER pProcessor, USHORT *pNodeNumber)
+{
+    char szDir[64];
+    snprintf(szDir, sizeof(szDir), "/sys/devices/system/cpu/cpu%d", (int) pProcessor->Number);
+    DIR *pDir = opendir(szDir);
+    if (pDir == NULL) {
+        *pNodeNumber = 0;
+        return TRUE;
+    }
+    *pNodeNumber = 0;
+    for (struct dirent *pEntry; (pEntry = readdir(pDir)) != NULL; ) {
+        if (strncmp(pEntry->d_name, "node", 4) == 0 &&
+            pEntry->d_name[4] >= '0' && pEntry->d_name[4] <= '9') {
+            *pNodeNumber = (USHORT) atoi(pEntry->d_name + 4);
+            break;
+        }
+    }
+    closedir(pDir);
+    return TRUE;
+}
+
+static BOOL ReadSysfsString(const char *pszPath, char *psz, int cch)
+{
+    FILE *pFile = fopen(pszPath, "r");
+    if (pFile == NULL) {
+        return FALSE;
+    }
+    BOOL bOK = fgets(psz, cch, pFile) != NULL;
+    fclose(pFile);
+    return bOK;
+}
+
+// the caches come from cpu0's sysfs entries, one descriptor per level and
+// type, which is all DetectThreshold reads
+BOOL GetLogicalProcessorInformation(PSYSTEM_LOGICAL_PROCESSOR_INFORMATION pBuffer, PDWORD pcbReturned)
+{
+    SYSTEM_LOGICAL_PROCESSOR_INFORMATION aInfo[16];
+    DWORD cInfo = 0;
+    for (int i = 0; i < 16; i++) {
+        char szPath[128], sz[64];
+        snprintf(szPath, sizeof(szPath), "/sys/devices/system/cpu/cpu0/cache/index%d/level", i);
+        if (!ReadSysfsString(szPath, sz, sizeof(sz))) {
+            break;
+        }
+        SYSTEM_LOGICAL_PROCESSOR_INFORMATION &Info = aInfo[cInfo++];
+        ZeroMemory(&Info, sizeof(Info));
+        Info.ProcessorMask = 1;
+        Info.Relationship = RelationCache;
+        Info.Cache.Level = (BYTE) atoi(sz);
+
+        snprintf(szPath, sizeof(szPath), "/sys/devices/system/cpu/cpu0/cache/index%d/size", i);
+        if (ReadSysfsString(szPath, sz, sizeof(sz))) {
+            char *pszEnd;
+            DWORD dwSize = (DWORD) strtoul(sz, &pszEnd, 10);
+            if (*pszEnd == 'K') dwSize <<= 10;
+            else if (*pszEnd == 'M') dwSize <<= 20;
+            Info.Cache.Size = dwSize;
+        }
+        snprintf(szPath, sizeof(szPath), "/sys/devices/system/cpu/cpu0/cache/index%d/coherency_line_size", i);
+        Info.Cache.LineSize = ReadSysfsString(szPath, sz, sizeof(sz)) ? (WORD) atoi(sz) : 64;
+        snprintf(szPath, sizeof(szPath), "/sys/devices/system/cpu/cpu0/cache/index%d/ways_of_associativity", i);
+        Info.Cache.Associativity = ReadSysfsString(szPath, sz, sizeof(sz)) ? (BYTE) atoi(sz) : 0;
+        snprintf(szPath, sizeof(szPath), "/sys/devices/system/cpu/cpu0/cache/index%d/type", i);
+        Info.Cache.Type = CacheUnified;
+        if (ReadSysfsString(szPath, sz, sizeof(sz))) {
+            if (strncmp(sz, "Data", 4) == 0) Info.Cache.Type = CacheData;
+            else if (strncmp(sz, "Instruction", 11) == 0) Info.Cache.Type = CacheInstruction;
+        }
+    }
+
+    DWORD cbNeeded = cInfo * sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION);
+    if (pBuffer == NULL || *pcbReturned < cbNeeded) {
+        *pcbReturned = cbNeeded;
+        SetLastError(ERROR_INSUFFICIENT_BUFFER);
+        return FALSE;
+    }
+    CopyMemory(pBuffer, aInfo, cbNeeded);
+    *pcbReturned = cbNeeded;
+    return TRUE;
+}
+
+BOOL OpenThreadToken(HANDLE hThread, DWORD dwAccess, BOOL bOpenAsSelf, PHANDLE phToken)
+{
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return FALSE;
+}
+
+BOOL OpenProcessToken(HANDLE hProcess, DWORD dwAccess, PHANDLE phToken)
+{
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return FALSE;
+}
+
+BOOL LookupPrivilegeValueA(LPCSTR pSystemName, LPCSTR pName, PLUID pLuid)
+{
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return FALSE;
+}
+
+BOOL GetTokenInformation(HANDLE hToken, TOKEN_INFORMATION_CLASS Class, LPVOID pv,
+                         DWORD cb, PDWORD pcbReturned)
+{
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return FALSE;
+}
+
+BOOL GetVersionExA(LPOSVERSIONINFO pVersionInformation)
+{
+    pVersionInformation->dwMajorVersion = 10;
+    pVersionInformation->dwMinorVersion = 0;
+    pVersionInformation->dwBuildNumber = 19041;
+    pVersionInformation->dwPlatformId = VER_PLATFORM_WIN32_NT;
+    pVersionInformation->szCSDVersion[0] = 0;
+    return TRUE;
+}
+
+// there are no DLLs; GetProcAddress finding nothing sends the base
+// classes down their fallback paths
+HMODULE GetModuleHandleA(LPCSTR pModuleName) { return (HMODULE) 1; }
+HMODULE LoadLibraryA(LPCSTR pFileName) { return NULL; }
+BOOL FreeLibrary(HMODULE hModule) { return TRUE; }
+FARPROC GetProcAddress(HMODULE hModule, LPCSTR pProcName) { return NULL; }
+
+DWORD GetModuleFileNameA(HMODULE hModule, LPSTR pFilename, DWORD nSize)
+{
+    return (DWORD) snprintf(pFilename, nSize, "perf");
+}
+
+void OutputDebugStringA(LPCSTR pOutputString) { fputs(pOutputString, stderr); }
+void OutputDebugStringW(LPCWSTR pOutputString) { fprintf(stderr, "%ls", pOutputString); }
+void DebugBreak() { abort(); }
+
+BOOL GetProcessMemoryInfo(HANDLE hProcess, PPROCESS_MEMORY_COUNTERS ppmc, DWORD cb)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    ppmc->PageFaultCount = (DWORD) (ru.ru_minflt + ru.ru_majflt);
+    ppmc->PeakWorkingSetSize = (SIZE_T) ru.ru_maxrss * 1024;
+
+    ppmc->WorkingSetSize = 0;
+    FILE *pFile = fopen("/proc/self/statm", "r");
+    if (pFile) {
+        unsigned long ulSize, ulResident;
+        if (fscanf(pFile, "%lu %lu", &ulSize, &ulResident) == 2) {
+            ppmc->WorkingSetSize = (SIZE_T) ulResident * sysconf(_SC_PAGESIZE);
+        }
+        fclose(pFile);
+    }
+    return TRUE;
+}
+
+// --- strings ----------------------------------------------------------
+
+int lstrlenA(LPCSTR psz) { return psz ? (int) strlen(psz) : 0; }
+int lstrlenW(LPCWSTR psz) { return psz ? (int) wcslen(psz) : 0; }
+int lstrcmpA(LPCSTR psz1, LPCSTR psz2) { return strcmp(psz1, psz2); }
+int lstrcmpW(LPCWSTR psz1, LPCWSTR psz2) { return wcscmp(psz1, psz2); }
+int lstrcmpiA(LPCSTR psz1, LPCSTR psz2) { return strcasecmp(psz1, psz2); }
+int lstrcmpiW(LPCWSTR psz1, LPCWSTR psz2) { return wcscasecmp(psz1, psz2); }
+LPSTR lstrcpyA(LPSTR pszDest, LPCSTR pszSrc) { return strcpy(pszDest, pszSrc); }
+LPWSTR lstrcpyW(LPWSTR pszDest, LPCWSTR pszSrc) { return wcscpy(pszDest, pszSrc); }
+
+LPSTR lstrcpynA(LPSTR pszDest, LPCSTR pszSrc, int cch)
+{
+    if (cch > 0) {
+        strncpy(pszDest, pszSrc, cch - 1);
+        pszDest[cch - 1] = 0;
+    }
+    return pszDest;
+}
+
+LPWSTR lstrcpynW(LPWSTR pszDest, LPCWSTR pszSrc, int cch)
+{
+    if (cch > 0) {
+        wcsncpy(pszDest, pszSrc, cch - 1);
+        pszDest[cch - 1] = 0;
+    }
+    return pszDest;
+}
+
+LPCSTR HostFormatA(LPCSTR pszFormat, LPSTR pszBuffer, size_t cch)
+{
+    if (strstr(pszFormat, "I64") == NULL || strlen(pszFormat) >= cch) {
+        return pszFormat;
+    }
+    BOOL bSpec = FALSE;
+    size_t j = 0;
+    for (LPCSTR p = pszFormat; *p; p++) {
+        if (!bSpec) {
+            pszBuffer[j++] = *p;
+            if (*p == '%') {
+                if (p[1] == '%') {
+                    pszBuffer[j++] = *++p;
+                } else {
+                    bSpec = TRUE;
+                }
+            }
+        } else if (strncmp(p, "I64", 3) == 0) {
+            pszBuffer[j++] = 'l';
+            pszBuffer[j++] = 'l';
+            p += 2;
+        } else {
+            pszBuffer[j++] = *p;
+            bSpec = strchr("0123456789.-+ #*hlLjzt", *p) != NULL;
+        }
+    }
+    pszBuffer[j] = 0;
+    return pszBuffer;
+}
+
+int wvsprintfA(LPSTR pszDest, LPCSTR pszFormat, va_list va)
+{
+    char szFormat[1024];
+    return vsnprintf(pszDest, 1024, HostFormatA(pszFormat, szFormat, sizeof(szFormat)), va);
+}
+
+int wsprintfA(LPSTR pszDest, LPCSTR pszFormat, ...)
+{
+    char szFormat[1024];
+    va_list va;
+    va_start(va, pszFormat);
+    int n = vsnprintf(pszDest, 1024, HostFormatA(pszFormat, szFormat, sizeof(szFormat)), va);
+    va_end(va);
+    return n;
+}
+
+int wsprintfW(LPWSTR pszDest, LPCWSTR pszFormat, ...)
+{
+    va_list va;
+    va_start(va, pszFormat);
+    int n = vswprintf(pszDest, 1024, pszFormat, va);
+    va_end(va);
+    return n;
+}
+
+int CompareStringA(LCID Locale, DWORD dwCmpFlags, LPCSTR psz1, int cch1, LPCSTR psz2, int cch2)
+{
+    size_t cb1 = cch1 < 0 ? strlen(psz1) : cch1;
+    size_t cb2 = cch2 < 0 ? strlen(psz2) : cch2;
+    int n = (dwCmpFlags & NORM_IGNORECASE) ? strncasecmp(psz1, psz2, (std::min)(cb1, cb2))
+                                           : strncmp(psz1, psz2, (std::min)(cb1, cb2));
+    if (n == 0) n = (int) cb1 - (int) cb2;
+    return n < 0 ? CSTR_LESS_THAN : n > 0 ? CSTR_GREATER_THAN : CSTR_EQUAL;
+}
+
+int CompareStringW(LCID Locale, DWORD dwCmpFlags, LPCWSTR psz1, int cch1, LPCWSTR psz2, int cch2)
+{
+    size_t cch1u = cch1 < 0 ? wcslen(psz1) : cch1;
+    size_t cch2u = cch2 < 0 ? wcslen(psz2) : cch2;
+    int n = (dwCmpFlags & NORM_IGNORECASE) ? wcsncasecmp(psz1, psz2, (std::min)(cch1u, cch2u))
+                                           : wcsncmp(psz1, psz2, (std::min)(cch1u, cch2u));
+    if (n == 0) n = (int) cch1u - (int) cch2u;
+    return n < 0 ? CSTR_LESS_THAN : n > 0 ? CSTR_GREATER_THAN : CSTR_EQUAL;
+}
+
+// the harnesses only convert ASCII
+int MultiByteToWideChar(UINT CodePage, DWORD dwFlags, LPCSTR pMultiByteStr, int cbMultiByte,
+                        LPWSTR pWideCharStr, int cchWideChar)
+{
+    int cch = cbMultiByte < 0 ? (int) strlen(pMultiByteStr) + 1 : cbMultiByte;
+    if (cchWideChar == 0) {
+        return cch;
+    }
+    cch = (std::min)(cch, cchWideChar);
+    for (int i = 0; i < cch; i++) {
+        pWideCharStr[i] = (WCHAR) (unsigned char) pMultiByteStr[i];
+    }
+    return cch;
+}
+
+int WideCharToMultiByte(UINT CodePage, DWORD dwFlags, LPCWSTR pWideCharStr, int cchWideChar,
+                        LPSTR pMultiByteStr, int cbMultiByte, LPCSTR pDefaultChar, LPBOOL pbUsedDefaultChar)
+{
+    int cch = cchWideChar < 0 ? (int) wcslen(pWideCharStr) + 1 : cchWideChar;
+    if (cbMultiByte == 0) {
+        return cch;
+    }
+    cch = (std::min)(cch, cbMultiByte);
+    for (int i = 0; i < cch; i++) {
+        pMultiByteStr[i] = pWideCharStr[i] < 128 ? (CHAR) pWideCharStr[i] : '?';
+    }
+    return cch;
+}
+
+UINT GetACP() { return 1252; }
+
+// --- files and completion ports ---------------------------------------
+
+#define STATUS_PENDING  0x00000103
+
+// called holding g_Lock
+static void PostPacketLocked(HostObject *pPort, DWORD cb, ULONG_PTR Key, LPOVERLAPPED pov, DWORD dwError)
+{
+    HostPacket Packet = { cb, Key, pov, dwError };
+    pPort->Packets.push_back(Packet);
+    NotifyWaiters(pPort);
+}
+
+// the host I/O threads: overlapped reads queue here and complete in
+// whatever order the threads finish them
+struct HostRead {
+    HostObject *pFile;
+    LPVOID pBuffer;
+    DWORD cbToRead;
+    LPOVERLAPPED pov;
+};
+
+static const int c_nIoThreads = 4;
+static HostObject *g_pIoQueue;
+static std::deque<HostRead> g_Reads;
+static pthread_once_t g_IoOnce = PTHREAD_ONCE_INIT;
+
+static DWORD WINAPI IoThreadProc(LPVOID)
+{
+    for (;;) {
+        pthread_mutex_lock(&g_Lock);
+        WaitLocked(1, &g_pIoQueue, FALSE, INFINITE, TRUE);
+        HostRead Read = g_Reads.front();
+        g_Reads.pop_front();
+        pthread_mutex_unlock(&g_Lock);
+
+        LONGLONG llPos = ((LONGLONG) Read.pov->OffsetHigh << 32) | Read.pov->Offset;
+        ssize_t cb = pread(Read.pFile->fd, Read.pBuffer, Read.cbToRead, llPos);
+        DWORD dwError = cb < 0 ? ERROR_INVALID_FUNCTION : (cb == 0 && Read.cbToRead ? ERROR_HANDLE_EOF : 0);
+        if (cb < 0) cb = 0;
+
+        pthread_mutex_lock(&g_Lock);
+        Read.pov->InternalHigh = (ULONG_PTR) cb;
+        Read.pov->Internal = dwError;
+        // an event handle with its low bit set keeps the completion off the port
+        if (Read.pFile->pPort && !((ULONG_PTR) Read.pov->hEvent & 1)) {
+            PostPacketLocked(Read.pFile->pPort, (DWORD) cb, Read.pFile->PortKey, Read.pov, dwError);
+        }
+        HostObject *pEvent = ObjectFromHandle((HANDLE) ((ULONG_PTR) Read.pov->hEvent & ~(ULONG_PTR) 1));
+        if (pEvent) {
+            pEvent->bSignalled = TRUE;
+            NotifyWaiters(pEvent);
+        }
+        ReleaseObject(Read.pFile);
+        pthread_mutex_unlock(&g_Lock);
+    }
+    return 0;
+}
+
+static void StartIoThreads()
+{
+    g_pIoQueue = new HostObject(HostSemaphore);
+    g_pIoQueue->lMaximum = MAXLONG;
+    for (int i = 0; i < c_nIoThreads; i++) {
+        CloseHandle(CreateThread(NULL, 0, IoThreadProc, NULL, 0, NULL));
+    }
+}
+
+static HANDLE OpenFileObject(const char *pszName, DWORD dwDesiredAccess,
+                             DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes)
+{
+    int nFlags = (dwDesiredAccess & GENERIC_WRITE) ?
+                 ((dwDesiredAccess & GENERIC_READ) ? O_RDWR : O_WRONLY) : O_RDONLY;
+    switch (dwCreationDisposition) {
+    case CREATE_NEW:    nFlags |= O_CREAT | O_EXCL; break;
+    case CREATE_ALWAYS: nFlags |= O_CREAT | O_TRUNC; break;
+    case OPEN_ALWAYS:   nFlags |= O_CREAT; break;
+    default:            break;
+    }
+    int fd = open(pszName, nFlags, 0644);
+    if (fd < 0) {
+        SetLastError(errno == ENOENT ? ERROR_FILE_NOT_FOUND : ERROR_ACCESS_DENIED);
+        return INVALID_HANDLE_VALUE;
+    }
+    HostObject *pFile = new HostObject(HostFile);
+    pFile->fd = fd;
+    pFile->bOverlapped = (dwFlagsAndAttributes & FILE_FLAG_OVERLAPPED) != 0;
+    return (HANDLE) pFile;
+}
+
+HANDLE CreateFileA(LPCSTR pFileName, DWORD dwDesiredAccess, DWORD dwShareMode,
+                   LPSECURITY_ATTRIBUTES lpsa, DWORD dwCreationDisposition,
+                   DWORD dwFlagsAndAttributes, HANDLE hTemplateFile)
+{
+    return OpenFileObject(pFileName, dwDesiredAccess, dwCreationDisposition, dwFlagsAndAttributes);
+}
+
+HANDLE CreateFileW(LPCWSTR pFileName, DWORD dwDesiredAccess, DWORD dwShareMode,
+                   LPSECURITY_ATTRIBUTES lpsa, DWORD dwCreationDisposition,
+                   DWORD dwFlagsAndAttributes, HANDLE hTemplateFile)
+{
+    char szName[MAX_PATH * 4];
+    snprintf(szName, sizeof(szName), "%ls", pFileName);
+    return OpenFileObject(szName, dwDesiredAccess, dwCreationDisposition, dwFlagsAndAttributes);
+}
+
+BOOL ReadFile(HANDLE hFile, LPVOID pBuffer, DWORD cbToRead, LPDWORD pcbRead, LPOVERLAPPED pov)
+{
+    HostObject *pFile = ObjectFromHandle(hFile);
+    if (pFile == NULL || pFile->Type != HostFile) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+
+    if (pFile->bOverlapped) {
+        pthread_once(&g_IoOnce, StartIoThreads);
+        HostRead Read = { pFile, pBuffer, cbToRead, pov };
+        pthread_mutex_lock(&g_Lock);
+        pFile->cRef++;
+        pov->Internal = STATUS_PENDING;
+        HostObject *pEvent = ObjectFromHandle((HANDLE) ((ULONG_PTR) pov->hEvent & ~(ULONG_PTR) 1));
+        if (pEvent) {
+            pEvent->bSignalled = FALSE;
+        }
+        g_Reads.push_back(Read);
+        g_pIoQueue->lCount++;
+        NotifyWaiters(g_pIoQueue);
+        pthread_mutex_unlock(&g_Lock);
+        SetLastError(ERROR_IO_PENDING);
+        return FALSE;
+    }
+
+    ssize_t cb;
+    if (pov) {
+        LONGLONG llPos = ((LONGLONG) pov->OffsetHigh << 32) | pov->Offset;
+        cb = pread(pFile->fd, pBuffer, cbToRead, llPos);
+    } else {
+        cb = read(pFile->fd, pBuffer, cbToRead);
+    }
+    if (cb < 0) {
+        SetLastError(ERROR_INVALID_FUNCTION);
+        return FALSE;
+    }
+    if (pcbRead) {
+        *pcbRead = (DWORD) cb;
+    }
+    if (pov) {
+        pov->Internal = 0;
+        pov->InternalHigh = (ULONG_PTR) cb;
+        if (cb == 0 && cbToRead) {
+            SetLastError(ERROR_HANDLE_EOF);
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+BOOL WriteFile(HANDLE hFile, LPCVOID pBuffer, DWORD cbToWrite, LPDWORD pcbWritten, LPOVERLAPPED pov)
+{
+    HostObject *pFile = ObjectFromHandle(hFile);
+    if (pFile == NULL || pFile->Type != HostFile) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+    ssize_t cb = write(pFile->fd, pBuffer, cbToWrite);
+    if (cb < 0) {
+        SetLastError(ERROR_ACCESS_DENIED);
+        return FALSE;
+    }
+    if (pcbWritten) {
+        *pcbWritten = (DWORD) cb;
+    }
+    return TRUE;
+}
+
+HANDLE GetStdHandle(DWORD nStdHandle)
+{
+    static HostObject *s_apStd[2];
+    int i = nStdHandle == STD_ERROR_HANDLE ? 1 : 0;
+    pthread_mutex_lock(&g_Lock);
+    if (s_apStd[i] == NULL) {
+        s_apStd[i] = new HostObject(HostFile);
+        s_apStd[i]->fd = i + 1;
+        s_apStd[i]->cRef = 2;   // never closed
+    }
+    pthread_mutex_unlock(&g_Lock);
+    return (HANDLE) s_apStd[i];
+}
+
+BOOL GetFileSizeEx(HANDLE hFile, PLARGE_INTEGER pFileSize)
+{
+    HostObject *pFile = ObjectFromHandle(hFile);
+    struct stat st;
+    if (pFile == NULL || fstat(pFile->fd, &st) != 0) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+    pFileSize->QuadPart = st.st_size;
+    return TRUE;
+}
+
+BOOL GetOverlappedResult(HANDLE hFile, LPOVERLAPPED pov, LPDWORD pcbTransferred, BOOL bWait)
+{
+    HostObject *pEvent = ObjectFromHandle((HANDLE) ((ULONG_PTR) pov->hEvent & ~(ULONG_PTR) 1));
+    pthread_mutex_lock(&g_Lock);
+    while (pov->Internal == STATUS_PENDING) {
+        if (!bWait || pEvent == NULL) {
+            pthread_mutex_unlock(&g_Lock);
+            if (!bWait) {
+                SetLastError(ERROR_IO_INCOMPLETE);
+                return FALSE;
+            }
+            // no event to wait on: poll
+            Sleep(1);
+            pthread_mutex_lock(&g_Lock);
+            continue;
+        }
+        WaitLocked(1, &pEvent, FALSE, INFINITE, FALSE);
+    }
+    DWORD dwError = (DWORD) pov->Internal;
+    *pcbTransferred = (DWORD) pov->InternalHigh;
+    pthread_mutex_unlock(&g_Lock);
+    if (dwError) {
+        SetLastError(dwError);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// reads already queued to the host I/O threads run to completion, as a
+// cancel that comes too late does on Windows
+BOOL CancelIoEx(HANDLE hFile, LPOVERLAPPED pov)
+{
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return FALSE;
+}
+
+HANDLE CreateIoCompletionPort(HANDLE hFile, HANDLE hExistingPort, ULONG_PTR CompletionKey,
+                              DWORD dwConcurrentThreads)
+{
+    HostObject *pPort = ObjectFromHandle(hExistingPort);
+    if (pPort == NULL) {
+        pPort = new HostObject(HostPort);
+    }
+    HostObject *pFile = ObjectFromHandle(hFile);
+    if (pFile) {
+        pthread_mutex_lock(&g_Lock);
+        pFile->pPort = pPort;
+        pFile->PortKey = CompletionKey;
+        pthread_mutex_unlock(&g_Lock);
+    }
+    return (HANDLE) pPort;
+}
+
+BOOL GetQueuedCompletionStatus(HANDLE hPort, LPDWORD pcbTransferred, PULONG_PTR pCompletionKey,
+                               LPOVERLAPPED *ppov, DWORD dwMilliseconds)
+{
+    HostObject *pPort = ObjectFromHandle(hPort);
+    if (pPort == NULL || pPort->Type != HostPort) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        *ppov = NULL;
+        return FALSE;
+    }
+    pthread_mutex_lock(&g_Lock);
+    if (WaitLocked(1, &pPort, FALSE, dwMilliseconds, FALSE) != WAIT_OBJECT_0) {
+        pthread_mutex_unlock(&g_Lock);
+        *ppov = NULL;
+        SetLastError(WAIT_TIMEOUT);
+        return FALSE;
+    }
+    HostPacket Packet = pPort->Packets.front();
+    pPort->Packets.pop_front();
+    pthread_mutex_unlock(&g_Lock);
+
+    *pcbTransferred = Packet.cbTransferred;
+    *pCompletionKey = Packet.Key;
+    *ppov = Packet.pov;
+    if (Packet.dwError) {
+        SetLastError(Packet.dwError);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+BOOL PostQueuedCompletionStatus(HANDLE hPort, DWORD cbTransferred, ULONG_PTR CompletionKey,
+                                LPOVERLAPPED pov)
+{
+    HostObject *pPort = ObjectFromHandle(hPort);
+    if (pPort == NULL || pPort->Type != HostPort) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+    pthread_mutex_lock(&g_Lock);
+    PostPacketLocked(pPort, cbTransferred, CompletionKey, pov, 0);
+    pthread_mutex_unlock(&g_Lock);
+    return TRUE;
+}
+
+HANDLE CreateFileMappingA(HANDLE hFile, LPSECURITY_ATTRIBUTES lpsa, DWORD flProtect,
+                          DWORD dwMaximumSizeHigh, DWORD dwMaximumSizeLow, LPCSTR pName)
+{
+    HostObject *pFile = ObjectFromHandle(hFile);
+    LARGE_INTEGER liSize;
+    if (pFile == NULL || !GetFileSizeEx(hFile, &liSize)) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return NULL;
+    }
+    HostObject *pMapping = new HostObject(HostMapping);
+    pMapping->fd = dup(pFile->fd);
+    pMapping->llSize = liSize.QuadPart;
+    pMapping->bCopyOnWrite = flProtect == PAGE_WRITECOPY;
+    return (HANDLE) pMapping;
+}
+
+static std::map<const void *, SIZE_T> g_Views;
+
+LPVOID MapViewOfFile(HANDLE hMapping, DWORD dwDesiredAccess, DWORD dwFileOffsetHigh,
+                     DWORD dwFileOffsetLow, SIZE_T cbToMap)
+{
+    HostObject *pMapping = ObjectFromHandle(hMapping);
+    if (pMapping == NULL || pMapping->Type != HostMapping) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return NULL;
+    }
+    LONGLONG llOffset = ((LONGLONG) dwFileOffsetHigh << 32) | dwFileOffsetLow;
+    if (cbToMap == 0) {
+        cbToMap = (SIZE_T) (pMapping->llSize - llOffset);
+    }
+    BOOL bCopy = (dwDesiredAccess & FILE_MAP_COPY) || pMapping->bCopyOnWrite;
+    int nProt = (dwDesiredAccess & (FILE_MAP_WRITE | FILE_MAP_COPY)) ? PROT_READ | PROT_WRITE : PROT_READ;
+    void *p = mmap(NULL, cbToMap, nProt, bCopy ? MAP_PRIVATE : MAP_SHARED, pMapping->fd, llOffset);
+    if (p == MAP_FAILED) {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return NULL;
+    }
+    pthread_mutex_lock(&g_Lock);
+    g_Views[p] = cbToMap;
+    pthread_mutex_unlock(&g_Lock);
+    return p;
+}
+
+BOOL UnmapViewOfFile(LPCVOID pBaseAddress)
+{
+    pthread_mutex_lock(&g_Lock);
+    std::map<const void *, SIZE_T>::iterator it = g_Views.find(pBaseAddress);
+    if (it == g_Views.end()) {
+        pthread_mutex_unlock(&g_Lock);
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    SIZE_T cb = it->second;
+    g_Views.erase(it);
+    pthread_mutex_unlock(&g_Lock);
+    munmap((void *) pBaseAddress, cb);
+    return TRUE;
+}
+
+BOOL GetVolumePathNameA(LPCSTR pszFileName, LPSTR pszVolumePathName, DWORD cchBufferLength)
+{
+    lstrcpynA(pszVolumePathName, "/", cchBufferLength);
+    return TRUE;
+}
+
+BOOL GetDiskFreeSpaceA(LPCSTR pRootPathName, LPDWORD pSectorsPerCluster, LPDWORD pBytesPerSector,
+                       LPDWORD pNumberOfFreeClusters, LPDWORD pTotalNumberOfClusters)
+{
+    if (pSectorsPerCluster) *pSectorsPerCluster = 8;
+    if (pBytesPerSector) *pBytesPerSector = 512;
+    if (pNumberOfFreeClusters) *pNumberOfFreeClusters = 0;
+    if (pTotalNumberOfClusters) *pTotalNumberOfClusters = 0;
+    return TRUE;
+}
+
+// --- windows and messages ---------------------------------------------
+
+BOOL PeekMessageA(LPMSG pMsg, HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax, UINT wRemoveMsg) { return FALSE; }
+LRESULT DispatchMessageA(const MSG *pMsg) { return 0; }
+BOOL PostThreadMessageA(DWORD idThread, UINT Msg, WPARAM wParam, LPARAM lParam) { return FALSE; }
+DWORD GetQueueStatus(UINT flags) { return 0; }
+UINT RegisterWindowMessageA(LPCSTR pString) { return 0xC000; }
+DWORD GetWindowThreadProcessId(HWND hWnd, LPDWORD pdwProcessId) { return 0; }
+BOOL SetConsoleTitleA(LPCSTR pConsoleTitle) { return TRUE; }
+UINT GetProfileIntA(LPCSTR pAppName, LPCSTR pKeyName, INT nDefault) { return nDefault; }
+
+int MessageBoxA(HWND hWnd, LPCSTR pText, LPCSTR pCaption, UINT uType)
+{
+    fprintf(stderr, "%s: %s\n", pCaption, pText);
+    return IDIGNORE;
+}
+
+// --- COM --------------------------------------------------------------
+
+STDAPI CoCreateInstance(REFCLSID rclsid, LPUNKNOWN pUnkOuter, DWORD dwClsContext,
+                        REFIID riid, LPVOID *ppv)
+{
+    *ppv = NULL;
+    return REGDB_E_CLASSNOTREG;
+}
+
+STDAPI CoInitialize(LPVOID pvReserved) { return S_OK; }
+STDAPI CoInitializeEx(LPVOID pvReserved, DWORD dwCoInit) { return S_OK; }
+STDAPI_(void) CoUninitialize() {}
+STDAPI_(void) CoFreeUnusedLibraries() {}
+STDAPI_(LPVOID) CoTaskMemAlloc(SIZE_T cb) { return malloc(cb); }
+STDAPI_(LPVOID) CoTaskMemRealloc(LPVOID pv, SIZE_T cb) { return realloc(pv, cb); }
+STDAPI_(void) CoTaskMemFree(LPVOID pv) { free(pv); }
+
+STDAPI_(int) StringFromGUID2(REFGUID rguid, LPOLESTR psz, int cchMax)
+{
+    if (cchMax < 39) {
+        return 0;
+    }
+    swprintf(psz, cchMax, L"{%08X-%04X-%04X-%02X%02X-%02X%02X%02X%02X%02X%02X}",
+             rguid.Data1, rguid.Data2, rguid.Data3,
+             rguid.Data4[0], rguid.Data4[1], rguid.Data4[2], rguid.Data4[3],
+             rguid.Data4[4], rguid.Data4[5], rguid.Data4[6], rguid.Data4[7]);
+    return 39;
+}
+
+STDAPI_(BSTR) SysAllocString(const OLECHAR *psz)
+{
+    size_t cch = wcslen(psz) + 1;
+    BSTR bstr = (BSTR) malloc(cch * sizeof(OLECHAR));
+    if (bstr) {
+        wcscpy(bstr, psz);
+    }
+    return bstr;
+}
+
+STDAPI_(void) SysFreeString(BSTR bstr) { free(bstr); }
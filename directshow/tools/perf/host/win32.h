@@ -0,0 +1,958 @@
+//------------------------------------------------------------------------------
+// File: Win32.h
+//
+// Desc: The part of the Win32 API the base classes use, on POSIX, so that
+//       the performance harnesses can build the real base class files off
+//       Windows. The Interlocked functions and WaitOnAddress are the
+//       compiler's atomics and futexes, and the kernel objects are
+//       emulated in Win32.cpp.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#ifndef __PERF_WIN32__
+#define __PERF_WIN32__
+
+// the C and C++ headers go in first, before the SAL annotations below
+// turn names like __in and __out into nothing
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <wchar.h>
+#include <limits.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <new>
+#include <vector>
+#include <algorithm>
+#include <x86intrin.h>
+
+// --- processor ---------------------------------------------------
+//
+// The processor as Visual C++ names it, so that memcopy.cpp and
+// vconvert.cpp build their SIMD kernels here too. _MSC_VER stays
+// undefined, which leaves out the AVX-512 copy
+
+#if defined(__x86_64__)
+#define _M_X64              100
+#elif defined(__i386__)
+#define _M_IX86             600
+#endif
+
+// --- basic types -------------------------------------------------
+//
+// The base classes use long and LONG as the same type, as they are on
+// Windows, so LONG is long and 64 bits here. DWORD and HRESULT keep their
+// Windows sizes, as the HRESULT codes rely on the sign bit
+
+typedef int                 BOOL;
+typedef int                 INT;
+typedef unsigned int        UINT;
+typedef long                LONG;
+typedef unsigned long       ULONG;
+typedef unsigned int        DWORD;
+typedef unsigned short      WORD;
+typedef unsigned short      USHORT;
+typedef short               SHORT;
+typedef unsigned char       BYTE;
+typedef unsigned char       UCHAR;
+typedef unsigned char       BOOLEAN;
+typedef char                CHAR;
+typedef wchar_t             WCHAR;
+typedef char                TCHAR;
+typedef float               FLOAT;
+typedef long long           LONGLONG;
+typedef unsigned long long  ULONGLONG;
+typedef unsigned long long  DWORDLONG;
+typedef long long           LONG64;
+typedef unsigned long long  ULONG64;
+typedef unsigned long long  DWORD64;
+// macros rather than typedefs, as the base classes also say "unsigned
+// __int64"
+#define __int64             long long
+#define __int32             int
+#define __int16             short
+typedef char                __int8;
+typedef intptr_t            INT_PTR;
+typedef intptr_t            LONG_PTR;
+typedef uintptr_t           UINT_PTR;
+typedef uintptr_t           ULONG_PTR;
+typedef uintptr_t           DWORD_PTR;
+typedef uintptr_t           SIZE_T;
+typedef intptr_t            SSIZE_T;
+typedef void                VOID;
+typedef void *              PVOID;
+typedef void *              LPVOID;
+typedef const void *        LPCVOID;
+typedef void *              HANDLE;
+typedef HANDLE *            PHANDLE;
+typedef HANDLE *            LPHANDLE;
+typedef int                 HRESULT;
+typedef int                 SCODE;
+typedef int                 HFILE;
+typedef BYTE *              PBYTE;
+typedef BYTE *              LPBYTE;
+typedef const BYTE *        LPCBYTE;
+typedef BOOL *              LPBOOL;
+typedef INT *               LPINT;
+typedef WORD *              LPWORD;
+typedef LONG *              PLONG;
+typedef LONG *              LPLONG;
+// the only PULONG in the base classes points at a DWORD, as they are the
+// same type on Windows
+typedef DWORD *             PULONG;
+typedef DWORD *             PDWORD;
+typedef DWORD *             LPDWORD;
+typedef LONGLONG *          PLONGLONG;
+typedef ULONG_PTR *         PULONG_PTR;
+typedef SIZE_T *            PSIZE_T;
+typedef CHAR *              LPSTR;
+typedef const CHAR *        LPCSTR;
+typedef WCHAR *             LPWSTR;
+typedef const WCHAR *       LPCWSTR;
+typedef WCHAR *             PWSTR;
+typedef const WCHAR *       PCWSTR;
+typedef WCHAR *             LPOLESTR;
+typedef const WCHAR *       LPCOLESTR;
+typedef WCHAR               OLECHAR;
+typedef WCHAR *             BSTR;
+typedef TCHAR *             LPTSTR;
+typedef TCHAR *             PTCHAR;
+typedef const TCHAR *       LPCTSTR;
+typedef TCHAR *             PTSTR;
+typedef const TCHAR *       PCTSTR;
+typedef LONG_PTR            LRESULT;
+typedef UINT_PTR            WPARAM;
+typedef LONG_PTR            LPARAM;
+typedef DWORD               COLORREF;
+typedef DWORD               LCID;
+typedef UINT                MMRESULT;
+typedef double              DATE;
+typedef short               VARIANT_BOOL;
+
+struct HWND__; typedef HWND__ *HWND;
+struct HDC__; typedef HDC__ *HDC;
+struct HINSTANCE__; typedef HINSTANCE__ *HINSTANCE;
+typedef HINSTANCE HMODULE;
+struct HKEY__; typedef HKEY__ *HKEY;
+struct HMENU__; typedef HMENU__ *HMENU;
+struct HICON__; typedef HICON__ *HICON;
+typedef HICON HCURSOR;
+struct HBRUSH__; typedef HBRUSH__ *HBRUSH;
+struct HPALETTE__; typedef HPALETTE__ *HPALETTE;
+struct HBITMAP__; typedef HBITMAP__ *HBITMAP;
+struct HFONT__; typedef HFONT__ *HFONT;
+struct HGDIOBJ__; typedef HGDIOBJ__ *HGDIOBJ;
+struct HMONITOR__; typedef HMONITOR__ *HMONITOR;
+typedef void *HGLOBAL;
+typedef void *HLOCAL;
+
+typedef union _LARGE_INTEGER {
+    struct {
+        DWORD LowPart;
+        int HighPart;
+    };
+    struct {
+        DWORD LowPart;
+        int HighPart;
+    } u;
+    LONGLONG QuadPart;
+} LARGE_INTEGER, *PLARGE_INTEGER;
+
+typedef union _ULARGE_INTEGER {
+    struct {
+        DWORD LowPart;
+        DWORD HighPart;
+    };
+    ULONGLONG QuadPart;
+} ULARGE_INTEGER, *PULARGE_INTEGER;
+
+typedef struct _FILETIME {
+    DWORD dwLowDateTime;
+    DWORD dwHighDateTime;
+} FILETIME, *PFILETIME, *LPFILETIME;
+
+typedef struct tagRECT {
+    LONG left, top, right, bottom;
+} RECT, *PRECT, *LPRECT;
+typedef const RECT *LPCRECT;
+
+typedef struct tagPOINT {
+    LONG x, y;
+} POINT, *PPOINT, *LPPOINT;
+
+typedef struct tagSIZE {
+    LONG cx, cy;
+} SIZE, *PSIZE, *LPSIZE;
+
+typedef struct _LUID {
+    DWORD LowPart;
+    LONG HighPart;
+} LUID, *PLUID;
+
+typedef struct tagMSG {
+    HWND hwnd;
+    UINT message;
+    WPARAM wParam;
+    LPARAM lParam;
+    DWORD time;
+    POINT pt;
+} MSG, *LPMSG;
+
+typedef struct _OSVERSIONINFOA {
+    DWORD dwOSVersionInfoSize;
+    DWORD dwMajorVersion;
+    DWORD dwMinorVersion;
+    DWORD dwBuildNumber;
+    DWORD dwPlatformId;
+    CHAR szCSDVersion[128];
+} OSVERSIONINFO, *POSVERSIONINFO, *LPOSVERSIONINFO;
+#define VER_PLATFORM_WIN32_NT   2
+BOOL GetVersionExA(LPOSVERSIONINFO pVersionInformation);
+#define GetVersionEx GetVersionExA
+
+typedef struct _SECURITY_ATTRIBUTES {
+    DWORD nLength;
+    LPVOID lpSecurityDescriptor;
+    BOOL bInheritHandle;
+} SECURITY_ATTRIBUTES, *LPSECURITY_ATTRIBUTES;
+
+// --- calling conventions, declspecs and SAL -----------------------
+
+#define WINAPI
+#define APIENTRY
+#define CALLBACK
+#define __stdcall
+#define __cdecl
+#define __fastcall
+#define STDMETHODCALLTYPE
+#define STDAPICALLTYPE
+#define WINAPIV
+#define PASCAL
+#define FAR
+#define NEAR
+#define CONST               const
+#define __inline            inline
+#define __forceinline       inline __attribute__((always_inline))
+#define __assume(e)         ((void)0)
+#define __noop(...)         ((void)0)
+#define __debugbreak()      __builtin_trap()
+#define _alloca             __builtin_alloca
+#define UNREFERENCED_PARAMETER(P) ((void)(P))
+#define IN
+#define OUT
+#define Int32x32To64(a, b)  ((LONGLONG)((LONG)(a)) * (LONGLONG)((LONG)(b)))
+#define UInt32x32To64(a, b) ((ULONGLONG)((DWORD)(a)) * (ULONGLONG)((DWORD)(b)))
+
+#define __declspec(x)               __PERF_DECLSPEC_##x
+#define __PERF_DECLSPEC_novtable
+#define __PERF_DECLSPEC_dllimport
+#define __PERF_DECLSPEC_dllexport
+#define __PERF_DECLSPEC_nothrow
+#define __PERF_DECLSPEC_selectany   __attribute__((weak))
+#define __PERF_DECLSPEC_thread      __thread
+#define __PERF_DECLSPEC_noinline    __attribute__((noinline))
+#define __PERF_DECLSPEC_noreturn    __attribute__((noreturn))
+#define __PERF_DECLSPEC_align(n)    __attribute__((aligned(n)))
+#define __PERF_DECLSPEC_uuid(x)
+
+#define EXTERN_C            extern "C"
+#define STDAPI              EXTERN_C HRESULT
+#define STDAPI_(type)       EXTERN_C type
+#define STDMETHODIMP        HRESULT
+#define STDMETHODIMP_(type) type
+#define STDMETHOD(method)       virtual HRESULT method
+#define STDMETHOD_(type,method) virtual type method
+#define PURE                = 0
+#define THIS_
+#define THIS                void
+#define interface           struct
+#define DECLARE_INTERFACE(iface)            struct iface
+#define DECLARE_INTERFACE_(iface, base)     struct iface : public base
+
+#define __in
+#define __in_opt
+#define __out
+#define __out_opt
+#define __inout
+#define __inout_opt
+#define __deref_in
+#define __deref_out
+#define __deref_out_opt
+#define __deref_inout
+#define __deref_inout_opt
+#define __deref_out_range(l,h)
+#define __in_z
+#define __in_z_opt
+#define __in_range(l,h)
+#define __out_range(l,h)
+#define __in_ecount(x)
+#define __in_ecount_opt(x)
+#define __in_bcount(x)
+#define __in_bcount_opt(x)
+#define __out_ecount(x)
+#define __out_ecount_opt(x)
+#define __out_ecount_part(x,y)
+#define __out_ecount_part_opt(x,y)
+#define __out_bcount(x)
+#define __out_bcount_opt(x)
+#define __out_bcount_part(x,y)
+#define __out_bcount_part_opt(x,y)
+#define __inout_ecount(x)
+#define __inout_ecount_opt(x)
+#define __inout_bcount(x)
+#define __inout_bcount_opt(x)
+#define __inout_ecount_part(x,y)
+#define __inout_bcount_part(x,y)
+#define __deref_out_ecount(x)
+#define __deref_out_bcount(x)
+#define __deref_inout_ecount(x)
+#define __out_ecount_z(x)
+#define __out_z
+#define __field_ecount(x)
+#define __field_ecount_opt(x)
+#define __field_bcount(x)
+#define __field_ecount_part(x,y)
+#define __range(l,h)
+#define __success(x)
+#define __checkReturn
+#define __control_entrypoint(x)
+#define __analysis_assume(x)
+#define __format_string
+#define __nullterminated
+#define __reserved
+#define __callback
+#define __bcount(x)
+#define __ecount(x)
+#define __out_xcount(x)
+#define _In_
+#define _In_opt_
+#define _Out_
+#define _Out_opt_
+#define _Inout_
+#define _Inout_opt_
+#define _In_reads_(x)
+#define _In_reads_bytes_(x)
+#define _Out_writes_(x)
+#define _Out_writes_bytes_(x)
+#define _Outptr_
+#define _Printf_format_string_
+#define _Success_(x)
+#define _Check_return_
+#define _Ret_maybenull_
+#define _Post_writable_byte_size_(x)
+
+// Visual C++'s 64 bit literal suffixes
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wliteral-suffix"
+constexpr long long operator"" i64(unsigned long long ull) { return (long long)ull; }
+constexpr long long operator"" I64(unsigned long long ull) { return (long long)ull; }
+constexpr unsigned long long operator"" ui64(unsigned long long ull) { return ull; }
+#pragma GCC diagnostic pop
+
+// --- constants --------------------------------------------------
+
+#define TRUE                1
+#define FALSE               0
+#ifndef NULL
+#define NULL                0
+#endif
+#define INFINITE            0xFFFFFFFF
+#define MAXLONG             0x7FFFFFFF
+#define MAXDWORD            0xFFFFFFFF
+#define MAXLONGLONG         0x7FFFFFFFFFFFFFFFLL
+#define MAXULONG_PTR        (~(ULONG_PTR)0)
+#define MAXSIZE_T           (~(SIZE_T)0)
+#define INVALID_HANDLE_VALUE ((HANDLE)(LONG_PTR)-1)
+#define MAX_PATH            260
+
+#define WAIT_OBJECT_0       0x00000000
+#define WAIT_ABANDONED      0x00000080
+#define WAIT_TIMEOUT        0x00000102
+#define WAIT_FAILED         0xFFFFFFFF
+#define WAIT_IO_COMPLETION  0x000000C0
+#define MAXIMUM_WAIT_OBJECTS 64
+
+#define ERROR_SUCCESS               0
+#define NO_ERROR                    0
+#define ERROR_FILE_NOT_FOUND        2
+#define ERROR_ACCESS_DENIED         5
+#define ERROR_INVALID_HANDLE        6
+#define ERROR_NOT_ENOUGH_MEMORY     8
+#define ERROR_OUTOFMEMORY           14
+#define ERROR_NOT_SUPPORTED         50
+#define ERROR_INVALID_PARAMETER     87
+#define ERROR_INSUFFICIENT_BUFFER   122
+#define ERROR_HANDLE_EOF            38
+#define ERROR_OPERATION_ABORTED     995
+#define ERROR_IO_INCOMPLETE         996
+#define ERROR_IO_PENDING            997
+#define ERROR_TIMEOUT               1460
+#define ERROR_INVALID_FUNCTION      1
+#define ERROR_ALREADY_EXISTS        183
+
+#define THREAD_PRIORITY_LOWEST          (-2)
+#define THREAD_PRIORITY_BELOW_NORMAL    (-1)
+#define THREAD_PRIORITY_NORMAL          0
+#define THREAD_PRIORITY_ABOVE_NORMAL    1
+#define THREAD_PRIORITY_HIGHEST         2
+#define THREAD_PRIORITY_TIME_CRITICAL   15
+#define THREAD_PRIORITY_IDLE            (-15)
+#define THREAD_PRIORITY_ERROR_RETURN    MAXLONG
+#define CREATE_SUSPENDED                0x00000004
+#define STILL_ACTIVE                    0x00000103
+#define DUPLICATE_SAME_ACCESS           0x00000002
+#define DUPLICATE_CLOSE_SOURCE          0x00000001
+#define SYNCHRONIZE                     0x00100000
+#define EVENT_MODIFY_STATE              0x00000002
+
+#define MEM_COMMIT                  0x00001000
+#define MEM_RESERVE                 0x00002000
+#define MEM_DECOMMIT                0x00004000
+#define MEM_RELEASE                 0x00008000
+#define MEM_LARGE_PAGES             0x20000000
+#define PAGE_NOACCESS               0x01
+#define PAGE_READONLY               0x02
+#define PAGE_READWRITE              0x04
+#define PAGE_WRITECOPY              0x08
+#define NUMA_NO_PREFERRED_NODE      ((DWORD)-1)
+
+#define GENERIC_READ                0x80000000
+#define GENERIC_WRITE               0x40000000
+#define FILE_SHARE_READ             0x00000001
+#define FILE_SHARE_WRITE            0x00000002
+#define FILE_SHARE_DELETE           0x00000004
+#define CREATE_NEW                  1
+#define CREATE_ALWAYS               2
+#define OPEN_EXISTING               3
+#define OPEN_ALWAYS                 4
+#define FILE_ATTRIBUTE_NORMAL       0x00000080
+#define FILE_FLAG_OVERLAPPED        0x40000000
+#define FILE_FLAG_NO_BUFFERING      0x20000000
+#define FILE_FLAG_SEQUENTIAL_SCAN   0x08000000
+#define FILE_FLAG_RANDOM_ACCESS     0x10000000
+#define FILE_MAP_READ               0x00000004
+#define FILE_MAP_WRITE              0x00000002
+#define FILE_MAP_COPY               0x00000001
+#define SEC_COMMIT                  0x08000000
+#define STD_OUTPUT_HANDLE           ((DWORD)-11)
+#define STD_ERROR_HANDLE            ((DWORD)-12)
+
+#define TOKEN_QUERY                 0x0008
+#define SE_PRIVILEGE_ENABLED        0x00000002
+#define SE_LOCK_MEMORY_NAME         TEXT("SeLockMemoryPrivilege")
+
+#define CP_ACP                      0
+#define CP_UTF8                     65001
+#define LOCALE_INVARIANT            0x007F
+#define NORM_IGNORECASE             0x00000001
+#define CSTR_LESS_THAN              1
+#define CSTR_EQUAL                  2
+#define CSTR_GREATER_THAN           3
+
+#define PM_NOREMOVE                 0x0000
+#define PM_REMOVE                   0x0001
+#define QS_SENDMESSAGE              0x0040
+#define QS_POSTMESSAGE              0x0008
+#define QS_ALLINPUT                 0x04FF
+#define WM_NULL                     0x0000
+#define WM_QUIT                     0x0012
+#define WM_USER                     0x0400
+#define MB_OK                       0x00000000
+#define MB_ICONHAND                 0x00000010
+#define MB_ABORTRETRYIGNORE         0x00000002
+#define MB_SYSTEMMODAL              0x00001000
+#define MB_SETFOREGROUND            0x00010000
+#define IDABORT                     3
+#define IDRETRY                     4
+#define IDIGNORE                    5
+
+#define TIMERR_NOERROR              0
+#define TIME_ONESHOT                0x0000
+#define TIME_PERIODIC               0x0001
+#define TIME_CALLBACK_FUNCTION      0x0000
+#define TIME_CALLBACK_EVENT_SET     0x0010
+#define TIME_CALLBACK_EVENT_PULSE   0x0020
+#define TIME_KILL_SYNCHRONOUS       0x0100
+
+#define LOWORD(l)       ((WORD)((DWORD_PTR)(l) & 0xffff))
+#define HIWORD(l)       ((WORD)((DWORD_PTR)(l) >> 16))
+#define LOBYTE(w)       ((BYTE)((DWORD_PTR)(w) & 0xff))
+#define HIBYTE(w)       ((BYTE)((DWORD_PTR)(w) >> 8))
+#define MAKELONG(a, b)  ((LONG)(((WORD)(a)) | ((DWORD)((WORD)(b))) << 16))
+#define MAKEWORD(a, b)  ((WORD)(((BYTE)(a)) | ((WORD)((BYTE)(b))) << 8))
+#define ARRAYSIZE(a)    (sizeof(a)/sizeof((a)[0]))
+#define _countof(a)     (sizeof(a)/sizeof((a)[0]))
+#define RGB(r,g,b)      ((COLORREF)(((BYTE)(r)|((WORD)((BYTE)(g))<<8))|(((DWORD)(BYTE)(b))<<16)))
+#define FIELD_OFFSET(type, field)   offsetof(type, field)
+
+#ifndef max
+#define max(a,b)        (((a) > (b)) ? (a) : (b))
+#endif
+#ifndef min
+#define min(a,b)        (((a) < (b)) ? (a) : (b))
+#endif
+
+#define TEXT(s)         s
+#define _T(s)           s
+#define __TEXT(s)       s
+#define L__(s)          L ## s
+
+// --- HRESULTs ---------------------------------------------------
+
+#define _HRESULT_TYPEDEF_(x)    ((HRESULT)(x))
+#define SUCCEEDED(hr)           (((HRESULT)(hr)) >= 0)
+#define FAILED(hr)              (((HRESULT)(hr)) < 0)
+#define MAKE_HRESULT(sev,fac,code) \
+    ((HRESULT)(((unsigned int)(sev)<<31) | ((unsigned int)(fac)<<16) | ((unsigned int)(code))))
+#define MAKE_SCODE(sev,fac,code) MAKE_HRESULT(sev,fac,code)
+#define HRESULT_CODE(hr)        ((hr) & 0xFFFF)
+#define HRESULT_FACILITY(hr)    (((hr) >> 16) & 0x1fff)
+#define SCODE_CODE(sc)          ((sc) & 0xFFFF)
+#define SEVERITY_SUCCESS        0
+#define SEVERITY_ERROR          1
+#define FACILITY_WIN32          7
+#define FACILITY_ITF            4
+#define HRESULT_FROM_WIN32(x)   ((HRESULT)(x) <= 0 ? ((HRESULT)(x)) : \
+                                 ((HRESULT) (((x) & 0x0000FFFF) | (FACILITY_WIN32 << 16) | 0x80000000)))
+
+#define S_OK                    ((HRESULT)0)
+#define S_FALSE                 ((HRESULT)1)
+#define NOERROR                 0
+#define E_UNEXPECTED            _HRESULT_TYPEDEF_(0x8000FFFF)
+#define E_NOTIMPL               _HRESULT_TYPEDEF_(0x80004001)
+#define E_OUTOFMEMORY           _HRESULT_TYPEDEF_(0x8007000E)
+#define E_INVALIDARG            _HRESULT_TYPEDEF_(0x80070057)
+#define E_NOINTERFACE           _HRESULT_TYPEDEF_(0x80004002)
+#define E_POINTER               _HRESULT_TYPEDEF_(0x80004003)
+#define E_HANDLE                _HRESULT_TYPEDEF_(0x80070006)
+#define E_ABORT                 _HRESULT_TYPEDEF_(0x80004004)
+#define E_FAIL                  _HRESULT_TYPEDEF_(0x80004005)
+#define E_ACCESSDENIED          _HRESULT_TYPEDEF_(0x80070005)
+#define E_PENDING               _HRESULT_TYPEDEF_(0x8000000A)
+#define CLASS_E_NOAGGREGATION   _HRESULT_TYPEDEF_(0x80040110)
+#define CLASS_E_CLASSNOTAVAILABLE _HRESULT_TYPEDEF_(0x80040111)
+#define REGDB_E_CLASSNOTREG     _HRESULT_TYPEDEF_(0x80040154)
+#define CO_E_NOTINITIALIZED     _HRESULT_TYPEDEF_(0x800401F0)
+#define RPC_E_CHANGED_MODE      _HRESULT_TYPEDEF_(0x80010106)
+#define STRSAFE_MAX_CCH         2147483647
+#define STRSAFE_E_INSUFFICIENT_BUFFER _HRESULT_TYPEDEF_(0x8007007A)
+#define STRSAFE_E_INVALID_PARAMETER   _HRESULT_TYPEDEF_(0x80070057)
+
+#define COINIT_MULTITHREADED        0x0
+#define COINIT_APARTMENTTHREADED    0x2
+#define COINIT_DISABLE_OLE1DDE      0x4
+#define CLSCTX_INPROC_SERVER        0x1
+#define CLSCTX_INPROC               0x3
+#define CLSCTX_ALL                  0x17
+
+// --- Interlocked functions, on the compiler's atomics ----------------
+
+inline LONG InterlockedIncrement(LONG volatile *p)
+    { return __atomic_add_fetch(p, 1, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedDecrement(LONG volatile *p)
+    { return __atomic_sub_fetch(p, 1, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedExchange(LONG volatile *p, LONG l)
+    { return __atomic_exchange_n(p, l, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedExchangeAdd(LONG volatile *p, LONG l)
+    { return __atomic_fetch_add(p, l, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedOr(LONG volatile *p, LONG l)
+    { return __atomic_fetch_or(p, l, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedAnd(LONG volatile *p, LONG l)
+    { return __atomic_fetch_and(p, l, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedCompareExchange(LONG volatile *p, LONG lNew, LONG lComparand)
+{
+    __atomic_compare_exchange_n(p, &lComparand, lNew, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return lComparand;
+}
+inline LONGLONG InterlockedIncrement64(LONGLONG volatile *p)
+    { return __atomic_add_fetch(p, 1, __ATOMIC_SEQ_CST); }
+inline LONGLONG InterlockedDecrement64(LONGLONG volatile *p)
+    { return __atomic_sub_fetch(p, 1, __ATOMIC_SEQ_CST); }
+inline LONGLONG InterlockedExchange64(LONGLONG volatile *p, LONGLONG l)
+    { return __atomic_exchange_n(p, l, __ATOMIC_SEQ_CST); }
+inline LONGLONG InterlockedExchangeAdd64(LONGLONG volatile *p, LONGLONG l)
+    { return __atomic_fetch_add(p, l, __ATOMIC_SEQ_CST); }
+inline LONGLONG InterlockedCompareExchange64(LONGLONG volatile *p, LONGLONG lNew, LONGLONG lComparand)
+{
+    __atomic_compare_exchange_n(p, &lComparand, lNew, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return lComparand;
+}
+inline PVOID InterlockedExchangePointer(PVOID volatile *p, PVOID pv)
+    { return __atomic_exchange_n(p, pv, __ATOMIC_SEQ_CST); }
+inline PVOID InterlockedCompareExchangePointer(PVOID volatile *p, PVOID pvNew, PVOID pvComparand)
+{
+    __atomic_compare_exchange_n(p, &pvComparand, pvNew, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return pvComparand;
+}
+
+// the base classes pass HANDLE * and the like
+template <class T> inline T *InterlockedExchangePointer(T * volatile *p, T *pv)
+    { return __atomic_exchange_n(p, pv, __ATOMIC_SEQ_CST); }
+template <class T> inline T *InterlockedCompareExchangePointer(T * volatile *p, T *pvNew, T *pvComparand)
+{
+    __atomic_compare_exchange_n(p, &pvComparand, pvNew, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return pvComparand;
+}
+
+#define _InterlockedIncrement           InterlockedIncrement
+#define _InterlockedDecrement           InterlockedDecrement
+#define _InterlockedExchange            InterlockedExchange
+#define _InterlockedExchangeAdd         InterlockedExchangeAdd
+#define _InterlockedCompareExchange     InterlockedCompareExchange
+#define _InterlockedOr                  InterlockedOr
+#define _InterlockedAnd                 InterlockedAnd
+
+#define MemoryBarrier()     __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define _ReadWriteBarrier() __atomic_signal_fence(__ATOMIC_SEQ_CST)
+#define _ReadBarrier()      __atomic_signal_fence(__ATOMIC_SEQ_CST)
+#define _WriteBarrier()     __atomic_signal_fence(__ATOMIC_SEQ_CST)
+#define YieldProcessor()    _mm_pause()
+
+inline unsigned char _BitScanReverse(unsigned long *pIndex, unsigned int Mask)
+{
+    if (Mask == 0) return 0;
+    *pIndex = 31 - __builtin_clz(Mask);
+    return 1;
+}
+inline unsigned char _BitScanReverse(DWORD *pIndex, unsigned int Mask)
+{
+    if (Mask == 0) return 0;
+    *pIndex = 31 - __builtin_clz(Mask);
+    return 1;
+}
+inline unsigned char _BitScanForward(DWORD *pIndex, unsigned int Mask)
+{
+    if (Mask == 0) return 0;
+    *pIndex = __builtin_ctz(Mask);
+    return 1;
+}
+
+// --- errors, handles and threads ----------------------------------
+
+DWORD GetLastError();
+void SetLastError(DWORD dwError);
+
+BOOL CloseHandle(HANDLE h);
+BOOL DuplicateHandle(HANDLE hSourceProcess, HANDLE hSource, HANDLE hTargetProcess,
+                     LPHANDLE phTarget, DWORD dwAccess, BOOL bInherit, DWORD dwOptions);
+
+typedef DWORD (WINAPI *PTHREAD_START_ROUTINE)(LPVOID lpThreadParameter);
+typedef PTHREAD_START_ROUTINE LPTHREAD_START_ROUTINE;
+
+HANDLE CreateThread(LPSECURITY_ATTRIBUTES lpsa, SIZE_T cbStack,
+                    LPTHREAD_START_ROUTINE pfn, LPVOID pv,
+                    DWORD dwFlags, LPDWORD pdwThreadId);
+DWORD ResumeThread(HANDLE hThread);
+DWORD SuspendThread(HANDLE hThread);
+BOOL GetExitCodeThread(HANDLE hThread, LPDWORD pdwExitCode);
+BOOL SetThreadPriority(HANDLE hThread, int nPriority);
+int GetThreadPriority(HANDLE hThread);
+DWORD GetThreadId(HANDLE hThread);
+DWORD GetCurrentThreadId();
+DWORD GetCurrentProcessId();
+HANDLE GetCurrentThread();
+HANDLE GetCurrentProcess();
+void Sleep(DWORD dwMilliseconds);
+BOOL SwitchToThread();
+DWORD_PTR SetThreadAffinityMask(HANDLE hThread, DWORD_PTR dwMask);
+
+DWORD TlsAlloc();
+BOOL TlsFree(DWORD dwIndex);
+LPVOID TlsGetValue(DWORD dwIndex);
+BOOL TlsSetValue(DWORD dwIndex, LPVOID pv);
+#define TLS_OUT_OF_INDEXES ((DWORD)0xFFFFFFFF)
+
+// --- synchronization objects ----------------------------------------
+
+HANDLE CreateEventA(LPSECURITY_ATTRIBUTES lpsa, BOOL bManualReset, BOOL bInitialState, LPCSTR pName);
+#define CreateEvent CreateEventA
+BOOL SetEvent(HANDLE hEvent);
+BOOL ResetEvent(HANDLE hEvent);
+BOOL PulseEvent(HANDLE hEvent);
+HANDLE CreateSemaphoreA(LPSECURITY_ATTRIBUTES lpsa, LONG lInitialCount, LONG lMaximumCount, LPCSTR pName);
+#define CreateSemaphore CreateSemaphoreA
+BOOL ReleaseSemaphore(HANDLE hSemaphore, LONG lReleaseCount, LPLONG plPreviousCount);
+HANDLE CreateMutexA(LPSECURITY_ATTRIBUTES lpsa, BOOL bInitialOwner, LPCSTR pName);
+#define CreateMutex CreateMutexA
+BOOL ReleaseMutex(HANDLE hMutex);
+DWORD WaitForSingleObject(HANDLE h, DWORD dwMilliseconds);
+DWORD WaitForMultipleObjects(DWORD nCount, const HANDLE *ph, BOOL bWaitAll, DWORD dwMilliseconds);
+DWORD MsgWaitForMultipleObjects(DWORD nCount, const HANDLE *ph, BOOL bWaitAll,
+                                DWORD dwMilliseconds, DWORD dwWakeMask);
+DWORD WaitForSingleObjectEx(HANDLE h, DWORD dwMilliseconds, BOOL bAlertable);
+
+BOOL WaitOnAddress(volatile void *Address, PVOID CompareAddress, SIZE_T AddressSize, DWORD dwMilliseconds);
+void WakeByAddressSingle(PVOID Address);
+void WakeByAddressAll(PVOID Address);
+
+// a CRITICAL_SECTION is a recursive pthread mutex
+typedef struct _RTL_CRITICAL_SECTION {
+    pthread_mutex_t Mutex;
+} CRITICAL_SECTION, *LPCRITICAL_SECTION, *PCRITICAL_SECTION;
+
+void InitializeCriticalSection(LPCRITICAL_SECTION pcs);
+BOOL InitializeCriticalSectionAndSpinCount(LPCRITICAL_SECTION pcs, DWORD dwSpinCount);
+void DeleteCriticalSection(LPCRITICAL_SECTION pcs);
+void EnterCriticalSection(LPCRITICAL_SECTION pcs);
+BOOL TryEnterCriticalSection(LPCRITICAL_SECTION pcs);
+void LeaveCriticalSection(LPCRITICAL_SECTION pcs);
+
+// --- time -------------------------------------------------------
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER *pCount);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER *pFrequency);
+DWORD GetTickCount();
+ULONGLONG GetTickCount64();
+DWORD timeGetTime();
+void GetSystemTimeAsFileTime(LPFILETIME pft);
+
+typedef struct timecaps_tag {
+    UINT wPeriodMin;
+    UINT wPeriodMax;
+} TIMECAPS, *LPTIMECAPS;
+typedef void (CALLBACK TIMECALLBACK)(UINT uTimerID, UINT uMsg, DWORD_PTR dwUser, DWORD_PTR dw1, DWORD_PTR dw2);
+typedef TIMECALLBACK *LPTIMECALLBACK;
+MMRESULT timeGetDevCaps(LPTIMECAPS ptc, UINT cbtc);
+MMRESULT timeBeginPeriod(UINT uPeriod);
+MMRESULT timeEndPeriod(UINT uPeriod);
+MMRESULT timeSetEvent(UINT uDelay, UINT uResolution, LPTIMECALLBACK fptc, DWORD_PTR dwUser, UINT fuEvent);
+MMRESULT timeKillEvent(UINT uTimerID);
+
+// --- memory and the system ----------------------------------------
+
+LPVOID VirtualAlloc(LPVOID pv, SIZE_T cb, DWORD flAllocationType, DWORD flProtect);
+LPVOID VirtualAllocExNuma(HANDLE hProcess, LPVOID pv, SIZE_T cb, DWORD flAllocationType,
+                          DWORD flProtect, DWORD nndPreferred);
+BOOL VirtualFree(LPVOID pv, SIZE_T cb, DWORD dwFreeType);
+SIZE_T GetLargePageMinimum();
+
+typedef struct _SYSTEM_INFO {
+    WORD wProcessorArchitecture;
+    WORD wReserved;
+    DWORD dwPageSize;
+    LPVOID lpMinimumApplicationAddress;
+    LPVOID lpMaximumApplicationAddress;
+    DWORD_PTR dwActiveProcessorMask;
+    DWORD dwNumberOfProcessors;
+    DWORD dwProcessorType;
+    DWORD dwAllocationGranularity;
+    WORD wProcessorLevel;
+    WORD wProcessorRevision;
+} SYSTEM_INFO, *LPSYSTEM_INFO;
+void GetSystemInfo(LPSYSTEM_INFO psi);
+
+typedef struct _PROCESSOR_NUMBER {
+    WORD Group;
+    BYTE Number;
+    BYTE Reserved;
+} PROCESSOR_NUMBER, *PPROCESSOR_NUMBER;
+void GetCurrentProcessorNumberEx(PPROCESSOR_NUMBER pProcNumber);
+DWORD GetCurrentProcessorNumber();
+BOOL GetNumaProcessorNodeEx(PPROCESSOR_NUMBER pProcessor, USHORT *pNodeNumber);
+
+typedef enum _LOGICAL_PROCESSOR_RELATIONSHIP {
+    RelationProcessorCore,
+    RelationNumaNode,
+    RelationCache,
+    RelationProcessorPackage,
+    RelationGroup
+} LOGICAL_PROCESSOR_RELATIONSHIP;
+typedef enum _PROCESSOR_CACHE_TYPE {
+    CacheUnified,
+    CacheInstruction,
+    CacheData,
+    CacheTrace
+} PROCESSOR_CACHE_TYPE;
+typedef struct _CACHE_DESCRIPTOR {
+    BYTE Level;
+    BYTE Associativity;
+    WORD LineSize;
+    DWORD Size;
+    PROCESSOR_CACHE_TYPE Type;
+} CACHE_DESCRIPTOR;
+typedef struct _SYSTEM_LOGICAL_PROCESSOR_INFORMATION {
+    ULONG_PTR ProcessorMask;
+    LOGICAL_PROCESSOR_RELATIONSHIP Relationship;
+    union {
+        struct { BYTE Flags; } ProcessorCore;
+        struct { DWORD NodeNumber; } NumaNode;
+        CACHE_DESCRIPTOR Cache;
+        ULONGLONG Reserved[2];
+    };
+} SYSTEM_LOGICAL_PROCESSOR_INFORMATION, *PSYSTEM_LOGICAL_PROCESSOR_INFORMATION;
+BOOL GetLogicalProcessorInformation(PSYSTEM_LOGICAL_PROCESSOR_INFORMATION pBuffer, PDWORD pcbReturned);
+
+// no token ever has SeLockMemoryPrivilege here
+typedef enum _TOKEN_INFORMATION_CLASS { TokenUser = 1, TokenPrivileges = 3 } TOKEN_INFORMATION_CLASS;
+typedef struct _LUID_AND_ATTRIBUTES {
+    LUID Luid;
+    DWORD Attributes;
+} LUID_AND_ATTRIBUTES;
+typedef struct _TOKEN_PRIVILEGES {
+    DWORD PrivilegeCount;
+    LUID_AND_ATTRIBUTES Privileges[1];
+} TOKEN_PRIVILEGES, *PTOKEN_PRIVILEGES;
+BOOL OpenThreadToken(HANDLE hThread, DWORD dwAccess, BOOL bOpenAsSelf, PHANDLE phToken);
+BOOL OpenProcessToken(HANDLE hProcess, DWORD dwAccess, PHANDLE phToken);
+BOOL LookupPrivilegeValueA(LPCSTR pSystemName, LPCSTR pName, PLUID pLuid);
+#define LookupPrivilegeValue LookupPrivilegeValueA
+BOOL GetTokenInformation(HANDLE hToken, TOKEN_INFORMATION_CLASS Class, LPVOID pv,
+                         DWORD cb, PDWORD pcbReturned);
+
+#define CopyMemory(d,s,n)   memcpy((d),(s),(n))
+#define MoveMemory(d,s,n)   memmove((d),(s),(n))
+#define FillMemory(d,n,c)   memset((d),(c),(n))
+#define ZeroMemory(d,n)     memset((d),0,(n))
+
+HMODULE GetModuleHandleA(LPCSTR pModuleName);
+#define GetModuleHandle GetModuleHandleA
+HMODULE LoadLibraryA(LPCSTR pFileName);
+#define LoadLibrary LoadLibraryA
+BOOL FreeLibrary(HMODULE hModule);
+typedef INT_PTR (WINAPI *FARPROC)();
+FARPROC GetProcAddress(HMODULE hModule, LPCSTR pProcName);
+DWORD GetModuleFileNameA(HMODULE hModule, LPSTR pFilename, DWORD nSize);
+#define GetModuleFileName GetModuleFileNameA
+
+void OutputDebugStringA(LPCSTR pOutputString);
+void OutputDebugStringW(LPCWSTR pOutputString);
+#define OutputDebugString OutputDebugStringA
+void DebugBreak();
+
+// --- strings ------------------------------------------------------
+
+int lstrlenA(LPCSTR psz);
+int lstrlenW(LPCWSTR psz);
+#define lstrlen lstrlenA
+int lstrcmpA(LPCSTR psz1, LPCSTR psz2);
+int lstrcmpW(LPCWSTR psz1, LPCWSTR psz2);
+#define lstrcmp lstrcmpA
+int lstrcmpiA(LPCSTR psz1, LPCSTR psz2);
+int lstrcmpiW(LPCWSTR psz1, LPCWSTR psz2);
+#define lstrcmpi lstrcmpiA
+LPSTR lstrcpyA(LPSTR pszDest, LPCSTR pszSrc);
+LPWSTR lstrcpyW(LPWSTR pszDest, LPCWSTR pszSrc);
+#define lstrcpy lstrcpyA
+LPSTR lstrcpynA(LPSTR pszDest, LPCSTR pszSrc, int cch);
+LPWSTR lstrcpynW(LPWSTR pszDest, LPCWSTR pszSrc, int cch);
+#define lstrcpyn lstrcpynA
+int wsprintfA(LPSTR pszDest, LPCSTR pszFormat, ...);
+int wsprintfW(LPWSTR pszDest, LPCWSTR pszFormat, ...);
+#define wsprintf wsprintfA
+int wvsprintfA(LPSTR pszDest, LPCSTR pszFormat, va_list va);
+#define wvsprintf wvsprintfA
+// pszFormat with Visual C++'s I64 size prefix turned into the ll that
+// vsnprintf knows, in pszBuffer; or pszFormat itself if it has none
+LPCSTR HostFormatA(LPCSTR pszFormat, LPSTR pszBuffer, size_t cch);
+int CompareStringA(LCID Locale, DWORD dwCmpFlags, LPCSTR psz1, int cch1, LPCSTR psz2, int cch2);
+int CompareStringW(LCID Locale, DWORD dwCmpFlags, LPCWSTR psz1, int cch1, LPCWSTR psz2, int cch2);
+int MultiByteToWideChar(UINT CodePage, DWORD dwFlags, LPCSTR pMultiByteStr, int cbMultiByte,
+                        LPWSTR pWideCharStr, int cchWideChar);
+int WideCharToMultiByte(UINT CodePage, DWORD dwFlags, LPCWSTR pWideCharStr, int cchWideChar,
+                        LPSTR pMultiByteStr, int cbMultiByte, LPCSTR pDefaultChar, LPBOOL pbUsedDefaultChar);
+UINT GetACP();
+#define _wtoi(s)    ((int)wcstol((s), NULL, 10))
+#define _tcslen     strlen
+#define _tcscpy     strcpy
+#define _tcsrchr    strrchr
+#define _stricmp    strcasecmp
+#define _strnicmp   strncasecmp
+#define _snprintf   snprintf
+#define _vsnprintf  vsnprintf
+#define _wcsicmp    wcscasecmp
+
+// --- files, completion ports and file mappings ----------------------
+
+typedef struct _OVERLAPPED {
+    ULONG_PTR Internal;
+    ULONG_PTR InternalHigh;
+    union {
+        struct {
+            DWORD Offset;
+            DWORD OffsetHigh;
+        };
+        PVOID Pointer;
+    };
+    HANDLE hEvent;
+} OVERLAPPED, *LPOVERLAPPED;
+
+typedef struct _OVERLAPPED_ENTRY {
+    ULONG_PTR lpCompletionKey;
+    LPOVERLAPPED lpOverlapped;
+    ULONG_PTR Internal;
+    DWORD dwNumberOfBytesTransferred;
+} OVERLAPPED_ENTRY, *LPOVERLAPPED_ENTRY;
+
+HANDLE CreateFileA(LPCSTR pFileName, DWORD dwDesiredAccess, DWORD dwShareMode,
+                   LPSECURITY_ATTRIBUTES lpsa, DWORD dwCreationDisposition,
+                   DWORD dwFlagsAndAttributes, HANDLE hTemplateFile);
+HANDLE CreateFileW(LPCWSTR pFileName, DWORD dwDesiredAccess, DWORD dwShareMode,
+                   LPSECURITY_ATTRIBUTES lpsa, DWORD dwCreationDisposition,
+                   DWORD dwFlagsAndAttributes, HANDLE hTemplateFile);
+#define CreateFile CreateFileA
+BOOL ReadFile(HANDLE hFile, LPVOID pBuffer, DWORD cbToRead, LPDWORD pcbRead, LPOVERLAPPED pov);
+BOOL WriteFile(HANDLE hFile, LPCVOID pBuffer, DWORD cbToWrite, LPDWORD pcbWritten, LPOVERLAPPED pov);
+BOOL GetFileSizeEx(HANDLE hFile, PLARGE_INTEGER pFileSize);
+BOOL GetOverlappedResult(HANDLE hFile, LPOVERLAPPED pov, LPDWORD pcbTransferred, BOOL bWait);
+BOOL CancelIoEx(HANDLE hFile, LPOVERLAPPED pov);
+HANDLE GetStdHandle(DWORD nStdHandle);
+
+HANDLE CreateIoCompletionPort(HANDLE hFile, HANDLE hExistingPort, ULONG_PTR CompletionKey,
+                              DWORD dwConcurrentThreads);
+BOOL GetQueuedCompletionStatus(HANDLE hPort, LPDWORD pcbTransferred, PULONG_PTR pCompletionKey,
+                               LPOVERLAPPED *ppov, DWORD dwMilliseconds);
+BOOL PostQueuedCompletionStatus(HANDLE hPort, DWORD cbTransferred, ULONG_PTR CompletionKey,
+                                LPOVERLAPPED pov);
+
+HANDLE CreateFileMappingA(HANDLE hFile, LPSECURITY_ATTRIBUTES lpsa, DWORD flProtect,
+                          DWORD dwMaximumSizeHigh, DWORD dwMaximumSizeLow, LPCSTR pName);
+#define CreateFileMapping CreateFileMappingA
+LPVOID MapViewOfFile(HANDLE hMapping, DWORD dwDesiredAccess, DWORD dwFileOffsetHigh,
+                     DWORD dwFileOffsetLow, SIZE_T cbToMap);
+BOOL UnmapViewOfFile(LPCVOID pBaseAddress);
+
+BOOL GetVolumePathNameA(LPCSTR pszFileName, LPSTR pszVolumePathName, DWORD cchBufferLength);
+#define GetVolumePathName GetVolumePathNameA
+BOOL GetDiskFreeSpaceA(LPCSTR pRootPathName, LPDWORD pSectorsPerCluster, LPDWORD pBytesPerSector,
+                       LPDWORD pNumberOfFreeClusters, LPDWORD pTotalNumberOfClusters);
+#define GetDiskFreeSpace GetDiskFreeSpaceA
+
+// --- windows and messages, which the harnesses never use -------------
+
+BOOL PeekMessageA(LPMSG pMsg, HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax, UINT wRemoveMsg);
+#define PeekMessage PeekMessageA
+LRESULT DispatchMessageA(const MSG *pMsg);
+#define DispatchMessage DispatchMessageA
+BOOL PostThreadMessageA(DWORD idThread, UINT Msg, WPARAM wParam, LPARAM lParam);
+#define PostThreadMessage PostThreadMessageA
+DWORD GetQueueStatus(UINT flags);
+UINT RegisterWindowMessageA(LPCSTR pString);
+#define RegisterWindowMessage RegisterWindowMessageA
+int MessageBoxA(HWND hWnd, LPCSTR pText, LPCSTR pCaption, UINT uType);
+#define MessageBox MessageBoxA
+DWORD GetWindowThreadProcessId(HWND hWnd, LPDWORD pdwProcessId);
+BOOL SetConsoleTitleA(LPCSTR pConsoleTitle);
+#define SetConsoleTitle SetConsoleTitleA
+UINT GetProfileIntA(LPCSTR pAppName, LPCSTR pKeyName, INT nDefault);
+#define GetProfileInt GetProfileIntA
+
+// --- process memory, for the harnesses --------------------------------
+
+typedef struct _PROCESS_MEMORY_COUNTERS {
+    DWORD cb;
+    DWORD PageFaultCount;
+    SIZE_T PeakWorkingSetSize;
+    SIZE_T WorkingSetSize;
+} PROCESS_MEMORY_COUNTERS, *PPROCESS_MEMORY_COUNTERS;
+BOOL GetProcessMemoryInfo(HANDLE hProcess, PPROCESS_MEMORY_COUNTERS ppmc, DWORD cb);
+
+#endif // __PERF_WIN32__
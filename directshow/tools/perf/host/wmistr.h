@@ -0,0 +1,38 @@
+//------------------------------------------------------------------------------
+// File: WMIStr.h
+//
+// Desc: Just enough of the SDK's wmistr.h and evntrace.h for perflog.h and
+//       perfstruct.h. Nothing is ever traced off Windows.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#ifndef __PERF_WMISTR__
+#define __PERF_WMISTR__
+
+#define ANYSIZE_ARRAY           1
+#define WNODE_FLAG_TRACED_GUID  0x00020000
+
+typedef ULONG64 TRACEHANDLE;
+
+typedef struct _EVENT_TRACE_HEADER {
+    USHORT Size;
+    USHORT FieldTypeFlags;
+    UCHAR Type;
+    UCHAR Level;
+    USHORT Version;
+    ULONG ThreadId;
+    ULONG ProcessId;
+    LARGE_INTEGER TimeStamp;
+    GUID Guid;
+    ULONG ClientContext;
+    ULONG Flags;
+} EVENT_TRACE_HEADER, *PEVENT_TRACE_HEADER;
+
+typedef struct _TRACE_GUID_REGISTRATION {
+    LPCGUID Guid;
+    HANDLE RegHandle;
+} TRACE_GUID_REGISTRATION, *PTRACE_GUID_REGISTRATION;
+
+#endif // __PERF_WMISTR__
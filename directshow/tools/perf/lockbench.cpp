@@ -0,0 +1,400 @@
+//------------------------------------------------------------------------------
+// File: LockBench.cpp
+//
+// Desc: Contention benchmark for CAMEventCount against the semaphore based
+//       version it replaced, for the allocator's locked and lock-free
+//       free lists, and for CCritSec with and without profiling.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+/* The benchmarks are
+
+       pingpong    two threads handing a turn back and forth, each
+                   sleeping on the event count until it is theirs. Reports
+                   the round trip
+       broadcast   one notifier and 2, 4 or 8 waiters; each round the
+                   notifier changes the condition and waits for every
+                   waiter to have seen it. Reports rounds per second and
+                   how often the old version gave a stolen count back
+       allocator   1 to 8 threads calling GetBuffer and Release on a
+                   CMemAllocator with 4 samples, with and without
+                   SetLockFreeMode. Reports calls per second and the 99th
+                   percentile GetBuffer time
+       critsec     1 to 8 threads taking and releasing one CCritSec, not
+                   profiled, profiled, and profiled with another thread
+                   calling CritProfileReset and CritProfileGet all the
+                   while. Reports locks per second and the reads the
+                   other thread managed
+
+   CSemEventCount is CAMEventCount as it was before it moved to
+   WaitOnAddress, with a POSIX semaphore standing in for the kernel one.
+
+   Build it with "make lockbench" and run it as "lockbench [benchmark]" */
+
+
+#include <semaphore.h>
+#include "perfutil.h"
+
+
+// --- the semaphore version ------------------------------------------
+
+class CSemEventCount {
+
+    enum { WaiterMask = 0x0000FFFF, EpochShift = 16 };
+
+    volatile LONG m_lState;
+    sem_t m_Sem;
+
+public:
+
+    volatile LONG m_lGiveBacks;     // counts taken for a later epoch
+
+    CSemEventCount() : m_lState(0), m_lGiveBacks(0) {
+        sem_init(&m_Sem, 0, 0);
+    };
+    ~CSemEventCount() {
+        sem_destroy(&m_Sem);
+    };
+
+    LONG PrepareWait() {
+        return (LONG)((ULONG)InterlockedExchangeAdd(&m_lState, 1) >> EpochShift);
+    };
+
+    BOOL CancelWait(LONG lKey) {
+        for (;;) {
+            LONG lState = m_lState;
+            if ((LONG)((ULONG)lState >> EpochShift) != lKey) {
+                while (sem_wait(&m_Sem) != 0) {
+                }
+                return TRUE;
+            }
+            if (InterlockedCompareExchange(&m_lState, lState - 1, lState) == lState) {
+                return FALSE;
+            }
+        }
+    };
+
+    BOOL Wait(LONG lKey) {
+        for (;;) {
+            while (sem_wait(&m_Sem) != 0) {
+            }
+            if ((LONG)((ULONG)m_lState >> EpochShift) != lKey) {
+                return TRUE;
+            }
+            InterlockedIncrement(&m_lGiveBacks);
+            sem_post(&m_Sem);
+            SwitchToThread();
+        }
+    };
+
+    void NotifyAll() {
+        MemoryBarrier();
+        for (;;) {
+            LONG lState = m_lState;
+            LONG lWaiters = lState & WaiterMask;
+            if (lWaiters == 0) {
+                return;
+            }
+            LONG lNext = (LONG)(((ULONG)lState & ~(ULONG)WaiterMask) + (1UL << EpochShift));
+            if (InterlockedCompareExchange(&m_lState, lNext, lState) == lState) {
+                while (lWaiters--) {
+                    sem_post(&m_Sem);
+                }
+                return;
+            }
+        }
+    };
+};
+
+// the new one has no give-backs to count
+class CNewEventCount : public CAMEventCount {
+public:
+    volatile LONG m_lGiveBacks;
+    CNewEventCount() : m_lGiveBacks(0) {};
+};
+
+// wait on ec until *pl is no longer lSeen
+template <class EC> void WaitForChange(EC &ec, volatile LONG *pl, LONG lSeen)
+{
+    while (*pl == lSeen) {
+        LONG lKey = ec.PrepareWait();
+        if (*pl != lSeen) {
+            ec.CancelWait(lKey);
+            return;
+        }
+        ec.Wait(lKey);
+    }
+}
+
+// --- pingpong -------------------------------------------------------
+
+static const LONG c_lPingPongRounds = 100000;
+
+template <class EC> struct PINGPONG {
+    EC ec;
+    volatile LONG lTurn;
+};
+
+template <class EC> void PingPongThread(void *pv, int iThread)
+{
+    PINGPONG<EC> *pTest = (PINGPONG<EC> *) pv;
+    for (LONG i = 0; i < c_lPingPongRounds; i++) {
+        LONG lMine = 2 * i + iThread;
+        for (LONG lTurn; (lTurn = pTest->lTurn) != lMine; ) {
+            WaitForChange(pTest->ec, &pTest->lTurn, lTurn);
+        }
+        InterlockedExchange(&pTest->lTurn, lMine + 1);
+        pTest->ec.NotifyAll();
+    }
+}
+
+template <class EC> void RunPingPong(const char *pszName)
+{
+    PINGPONG<EC> *pTest = new PINGPONG<EC>;
+    pTest->lTurn = 0;
+    LONGLONG llSwitches = PerfContextSwitches();
+    double dCpu = PerfCpuSeconds();
+    LONGLONG llStart = PerfNanoseconds();
+    CPerfThreads::Run(2, PingPongThread<EC>, pTest);
+    LONGLONG llTime = PerfNanoseconds() - llStart;
+    printf("%-10s %12.0f %12.0f %12.1f\n", pszName,
+           (double) llTime / c_lPingPongRounds,
+           (PerfCpuSeconds() - dCpu) * 1e9 / c_lPingPongRounds,
+           (double) (PerfContextSwitches() - llSwitches) / c_lPingPongRounds);
+    delete pTest;
+}
+
+static void BenchPingPong()
+{
+    printf("pingpong: %ld round trips\n", c_lPingPongRounds);
+    printf("%-10s %12s %12s %12s\n", "", "ns/trip", "cpu ns/trip", "switches");
+    RunPingPong<CSemEventCount>("semaphore");
+    RunPingPong<CNewEventCount>("address");
+    printf("\n");
+}
+
+// --- broadcast ------------------------------------------------------
+
+static const LONG c_lBroadcastRounds = 20000;
+
+template <class EC> struct BROADCAST {
+    EC ecWaiters;           // the waiters sleep on this
+    EC ecNotifier;          // and the notifier on this
+    volatile LONG lGeneration;
+    volatile LONG lAcknowledged;
+    int cWaiters;
+};
+
+template <class EC> void BroadcastThread(void *pv, int iThread)
+{
+    BROADCAST<EC> *pTest = (BROADCAST<EC> *) pv;
+    if (iThread == 0) {
+        for (LONG i = 1; i <= c_lBroadcastRounds; i++) {
+            InterlockedExchange(&pTest->lAcknowledged, 0);
+            InterlockedExchange(&pTest->lGeneration, i);
+            pTest->ecWaiters.NotifyAll();
+            for (LONG lAck; (lAck = pTest->lAcknowledged) != pTest->cWaiters; ) {
+                WaitForChange(pTest->ecNotifier, &pTest->lAcknowledged, lAck);
+            }
+        }
+        return;
+    }
+    for (LONG i = 1; i <= c_lBroadcastRounds; i++) {
+        WaitForChange(pTest->ecWaiters, &pTest->lGeneration, i - 1);
+        InterlockedIncrement(&pTest->lAcknowledged);
+        pTest->ecNotifier.NotifyAll();
+    }
+}
+
+template <class EC> void RunBroadcast(const char *pszName, int cWaiters)
+{
+    BROADCAST<EC> *pTest = new BROADCAST<EC>;
+    pTest->lGeneration = 0;
+    pTest->lAcknowledged = 0;
+    pTest->cWaiters = cWaiters;
+    double dCpu = PerfCpuSeconds();
+    LONGLONG llStart = PerfNanoseconds();
+    CPerfThreads::Run(cWaiters + 1, BroadcastThread<EC>, pTest);
+    LONGLONG llTime = PerfNanoseconds() - llStart;
+    printf("%-10s %8d %12.0f %12.0f %12ld\n", pszName, cWaiters,
+           c_lBroadcastRounds * 1e9 / llTime,
+           (PerfCpuSeconds() - dCpu) * 1e9 / c_lBroadcastRounds,
+           pTest->ecWaiters.m_lGiveBacks + pTest->ecNotifier.m_lGiveBacks);
+    delete pTest;
+}
+
+static void BenchBroadcast()
+{
+    printf("broadcast: %ld rounds\n", c_lBroadcastRounds);
+    printf("%-10s %8s %12s %12s %12s\n", "", "waiters", "rounds/s", "cpu ns/round", "give-backs");
+    for (int cWaiters = 2; cWaiters <= 8; cWaiters *= 2) {
+        RunBroadcast<CSemEventCount>("semaphore", cWaiters);
+        RunBroadcast<CNewEventCount>("address", cWaiters);
+    }
+    printf("\n");
+}
+
+// --- allocator ------------------------------------------------------
+
+static const LONG c_lAllocatorCalls = 200000;     // per thread
+
+struct ALLOCATORBENCH {
+    CMemAllocator *pAllocator;
+    std::vector<LONGLONG> *pTimes;      // one vector per thread
+};
+
+static void AllocatorThread(void *pv, int iThread)
+{
+    ALLOCATORBENCH *pBench = (ALLOCATORBENCH *) pv;
+    std::vector<LONGLONG> &Times = pBench->pTimes[iThread];
+    for (LONG i = 0; i < c_lAllocatorCalls; i++) {
+        IMediaSample *pSample;
+        LONGLONG llStart = (i & 15) == 0 ? PerfNanoseconds() : 0;
+        PERF_CHECK(SUCCEEDED(pBench->pAllocator->GetBuffer(&pSample, NULL, NULL, 0)));
+        if (llStart) {
+            Times.push_back(PerfNanoseconds() - llStart);
+        }
+        pSample->Release();
+    }
+}
+
+static void RunAllocator(BOOL bLockFree, int cThreads)
+{
+    HRESULT hr = S_OK;
+    ALLOCATORBENCH Bench;
+    Bench.pAllocator = new CMemAllocator(NAME("lockbench"), NULL, &hr);
+    Bench.pAllocator->AddRef();
+    PERF_CHECK(SUCCEEDED(Bench.pAllocator->SetLockFreeMode(bLockFree)));
+    ALLOCATOR_PROPERTIES Request = { 4, 65536, 1, 0 }, Actual;
+    PERF_CHECK(SUCCEEDED(Bench.pAllocator->SetProperties(&Request, &Actual)));
+    PERF_CHECK(SUCCEEDED(Bench.pAllocator->Commit()));
+    Bench.pTimes = new std::vector<LONGLONG>[cThreads];
+
+    LONGLONG llStart = PerfNanoseconds();
+    CPerfThreads::Run(cThreads, AllocatorThread, &Bench);
+    LONGLONG llTime = PerfNanoseconds() - llStart;
+
+    std::vector<LONGLONG> All;
+    for (int i = 0; i < cThreads; i++) {
+        All.insert(All.end(), Bench.pTimes[i].begin(), Bench.pTimes[i].end());
+    }
+    printf("%-10s %8d %12.0f %12lld\n", bLockFree ? "lock-free" : "locked", cThreads,
+           (double) c_lAllocatorCalls * cThreads * 1e9 / llTime,
+           PerfPercentile(All, 99.0));
+
+    Bench.pAllocator->Decommit();
+    Bench.pAllocator->Release();
+    delete [] Bench.pTimes;
+}
+
+static void BenchAllocator()
+{
+    printf("allocator: %ld GetBuffer/Release pairs per thread, 4 samples\n", c_lAllocatorCalls);
+    printf("%-10s %8s %12s %12s\n", "", "threads", "calls/s", "p99 ns");
+    for (int cThreads = 1; cThreads <= 8; cThreads *= 2) {
+        RunAllocator(FALSE, cThreads);
+        RunAllocator(TRUE, cThreads);
+    }
+    printf("\n");
+}
+
+// --- critsec --------------------------------------------------------
+
+static const LONG c_lCritSecLocks = 500000;     // per thread
+
+enum CRITSECMODE { CritSecPlain, CritSecProfiled, CritSecReading };
+
+struct CRITSECBENCH {
+    CCritSec Lock;
+    LONG lValue;
+    int cLockers;
+    volatile LONG cRunning;
+    LONG cReads;
+};
+
+static void CritSecThread(void *pv, int iThread)
+{
+    CRITSECBENCH *pBench = (CRITSECBENCH *) pv;
+    if (iThread < pBench->cLockers) {
+        for (LONG i = 0; i < c_lCritSecLocks; i++) {
+            CAutoLock lck(&pBench->Lock);
+            pBench->lValue++;
+        }
+        InterlockedDecrement(&pBench->cRunning);
+        return;
+    }
+    AM_CRITSEC_PROFILE aProfiles[16];
+    while (pBench->cRunning) {
+        LONG cLocks;
+        CritProfileReset();
+        PERF_CHECK(SUCCEEDED(CritProfileGet(aProfiles, NUMELMS(aProfiles), &cLocks)));
+        pBench->cReads++;
+    }
+}
+
+static void RunCritSec(CRITSECMODE Mode, int cThreads)
+{
+    CRITSECBENCH *pBench = new CRITSECBENCH;
+    pBench->lValue = 0;
+    pBench->cLockers = cThreads;
+    pBench->cRunning = cThreads;
+    pBench->cReads = 0;
+    if (Mode != CritSecPlain) {
+        CritProfileName(&pBench->Lock, TEXT("lockbench"));
+    }
+
+    LONGLONG llStart = PerfNanoseconds();
+    CPerfThreads::Run(cThreads + (Mode == CritSecReading), CritSecThread, pBench);
+    LONGLONG llTime = PerfNanoseconds() - llStart;
+    PERF_CHECK(pBench->lValue == c_lCritSecLocks * cThreads);
+
+    static const char *aszModes[] = { "plain", "profiled", "reading" };
+    printf("%-10s %8d %12.0f %12.0f\n", aszModes[Mode], cThreads,
+           (double) c_lCritSecLocks * cThreads * 1e9 / llTime,
+           pBench->cReads * 1e9 / llTime);
+    delete pBench;
+}
+
+static void BenchCritSec()
+{
+    printf("critsec: %ld locks per thread\n", c_lCritSecLocks);
+    printf("%-10s %8s %12s %12s\n", "", "threads", "locks/s", "reads/s");
+    for (int cThreads = 1; cThreads <= 8; cThreads *= 2) {
+        RunCritSec(CritSecPlain, cThreads);
+        RunCritSec(CritSecProfiled, cThreads);
+        RunCritSec(CritSecReading, cThreads);
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct {
+        const char *pszName;
+        void (*pfnBench)();
+    } Benches[] = {
+        { "pingpong", BenchPingPong },
+        { "broadcast", BenchBroadcast },
+        { "allocator", BenchAllocator },
+        { "critsec", BenchCritSec }
+    };
+
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    printf("%u processors\n\n", si.dwNumberOfProcessors);
+
+    BOOL bRan = FALSE;
+    for (size_t i = 0; i < NUMELMS(Benches); i++) {
+        if (argc < 2 || strcmp(argv[1], Benches[i].pszName) == 0) {
+            Benches[i].pfnBench();
+            bRan = TRUE;
+        }
+    }
+    if (!bRan) {
+        fprintf(stderr, "lockbench: no benchmark called %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,731 @@
+//------------------------------------------------------------------------------
+// File: LockStress.cpp
+//
+// Desc: Stress test for the non-blocking classes in lockfree.h and for the
+//       allocator's lock-free free list built on them.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+/* Each test runs threads against one object and checks what they saw
+   against what must have happened. A lost wakeup hangs a test, which the
+   watchdog turns into a failure. The tests are
+
+       eventcount  waiters that register, recheck and sleep, some with
+                   short timeouts, against a notifier. Every waiter must
+                   see each change promptly, and none may be left
+                   registered at the end
+       queue       CBoundedQueue with four producers and four consumers
+                   blocking on CAMEventCounts when it is full or empty;
+                   every value must arrive exactly once
+       spsc        CSPSCQueue with batches of 1 to 8; values must arrive in
+                   order
+       sharedlock  CAMSharedLock readers checking a pair that writers only
+                   change together
+       allocator   CMemAllocator in lock-free mode with more threads than
+                   samples, then a decommit while threads are blocked in
+                   GetBuffer
+       placement   threads racing to make the first GetBuffer of an
+                   allocator whose block is left to it; each must get its
+                   own buffer, pointing into the block, whichever of them
+                   placed it
+       recycle     a block parked by an allocator on an explicit node must
+                   be found again by one asking for AM_NUMANODE_CURRENT on
+                   a thread of that node, and the other way round
+       profile     four threads contending for a profiled CCritSec while
+                   another resets the profile and reads it over and over;
+                   every copy read must add up - the waits in the
+                   histogram and by holder match the count of contended
+                   acquisitions - and after a reset with nothing else
+                   running the counts must start again from 0 exactly
+       deque       CAMTaskScheduler with four workers running trees of
+                   tasks that submit their children from the workers, so
+                   they are pushed, popped, stolen and the deques grown,
+                   while four other threads submit the roots at once;
+                   every task must run exactly once
+
+   Build it with "make lockstress" and run it as "lockstress [test]" */
+
+
+#include "perfutil.h"
+
+
+// --- eventcount -----------------------------------------------------
+
+static const int c_cEventCountWaiters = 8;
+
+struct EVENTCOUNTTEST {
+    CAMEventCount ec;
+    volatile LONG lGeneration;
+    volatile LONG lStop;
+    volatile LONG lWakeups;
+    volatile LONG lTimeouts;
+    volatile LONG alSeen[c_cEventCountWaiters];    // last generation each waiter saw
+};
+
+static void EventCountWaiter(void *pv, int iWaiter)
+{
+    EVENTCOUNTTEST *pTest = (EVENTCOUNTTEST *) pv;
+    DWORD dwSeed = iWaiter + 1;
+    while (pTest->lStop == 0) {
+        LONG lSeen = pTest->lGeneration;
+        InterlockedExchange(&pTest->alSeen[iWaiter], lSeen);
+        LONG lKey = pTest->ec.PrepareWait();
+        if (pTest->lGeneration != lSeen || pTest->lStop) {
+            pTest->ec.CancelWait(lKey);
+            continue;
+        }
+
+        // a third of the waits time out, to race CancelWait with NotifyAll
+        DWORD dwTimeout = (PerfRandom(&dwSeed) % 3) == 0 ? 1 : INFINITE;
+        if (pTest->ec.Wait(lKey, dwTimeout)) {
+            InterlockedIncrement(&pTest->lWakeups);
+        } else {
+            PERF_CHECK(dwTimeout != INFINITE);
+            InterlockedIncrement(&pTest->lTimeouts);
+        }
+    }
+}
+
+// Every 1000th change the notifier waits for all the waiters to have
+// seen it. One that registered before the change and is asleep with no
+// timeout can only see it if the NotifyAll woke it, so a lost wakeup
+// fails the check instead of being covered up by the next NotifyAll
+
+static void EventCountNotifier(void *pv, int iThread)
+{
+    EVENTCOUNTTEST *pTest = (EVENTCOUNTTEST *) pv;
+    if (iThread != 0) {
+        EventCountWaiter(pv, iThread - 1);
+        return;
+    }
+    for (int i = 1; i <= 200000; i++) {
+        LONG lGeneration = InterlockedIncrement(&pTest->lGeneration);
+        pTest->ec.NotifyAll();
+        if ((i % 1000) == 0) {
+            const LONGLONG llDeadline = PerfNanoseconds() + 5000000000LL;
+            for (int iWaiter = 0; iWaiter < c_cEventCountWaiters; iWaiter++) {
+                while (pTest->alSeen[iWaiter] != lGeneration) {
+                    PERF_CHECK(PerfNanoseconds() < llDeadline);
+                    SwitchToThread();
+                }
+            }
+        } else if ((i & 63) == 0) {
+            SwitchToThread();
+        }
+    }
+    InterlockedExchange(&pTest->lStop, 1);
+    pTest->ec.NotifyAll();
+}
+
+static void TestEventCount()
+{
+    EVENTCOUNTTEST *pTest = new EVENTCOUNTTEST;
+    pTest->lGeneration = 0;
+    pTest->lStop = 0;
+    pTest->lWakeups = 0;
+    pTest->lTimeouts = 0;
+    ZeroMemory((void *) pTest->alSeen, sizeof(pTest->alSeen));
+
+    CPerfThreads::Run(c_cEventCountWaiters + 1, EventCountNotifier, pTest);
+
+    PERF_CHECK(!pTest->ec.HasWaiters());
+    printf("eventcount: %ld wakeups, %ld timeouts\n", pTest->lWakeups, pTest->lTimeouts);
+    delete pTest;
+}
+
+// --- queue ----------------------------------------------------------
+
+static const int c_cProducers = 4;
+static const int c_cConsumers = 4;
+static const LONG c_lPerProducer = 100000;
+
+struct QUEUETEST {
+    CBoundedQueue<void> q;
+    CAMEventCount evNotEmpty;
+    CAMEventCount evNotFull;
+    volatile LONG lReceived;
+    volatile LONG *plSeen;
+};
+
+static void QueueThread(void *pv, int iThread)
+{
+    QUEUETEST *pTest = (QUEUETEST *) pv;
+    const LONG lTotal = c_cProducers * c_lPerProducer;
+
+    if (iThread < c_cProducers) {
+        for (LONG i = 0; i < c_lPerProducer; i++) {
+            // 0 would be NULL, so values start at 1
+            void *pValue = (void *) (ULONG_PTR) (iThread * c_lPerProducer + i + 1);
+            while (!pTest->q.Enqueue(pValue)) {
+                LONG lKey = pTest->evNotFull.PrepareWait();
+                if (pTest->q.Enqueue(pValue)) {
+                    pTest->evNotFull.CancelWait(lKey);
+                    break;
+                }
+                pTest->evNotFull.Wait(lKey);
+            }
+            pTest->evNotEmpty.NotifyAll();
+        }
+        return;
+    }
+
+    for (;;) {
+        void *pValue = pTest->q.Dequeue();
+        if (pValue == NULL) {
+            if (pTest->lReceived >= lTotal) {
+                return;
+            }
+            LONG lKey = pTest->evNotEmpty.PrepareWait();
+            pValue = pTest->q.Dequeue();
+            if (pValue == NULL) {
+                if (pTest->lReceived >= lTotal) {
+                    pTest->evNotEmpty.CancelWait(lKey);
+                    return;
+                }
+                pTest->evNotEmpty.Wait(lKey);
+                continue;
+            }
+            pTest->evNotEmpty.CancelWait(lKey);
+        }
+        pTest->evNotFull.NotifyAll();
+
+        LONG lValue = (LONG) (ULONG_PTR) pValue - 1;
+        PERF_CHECK(lValue >= 0 && lValue < lTotal);
+        PERF_CHECK(InterlockedIncrement(&pTest->plSeen[lValue]) == 1);
+
+        // the last value in wakes the consumers that are waiting for more
+        if (InterlockedIncrement(&pTest->lReceived) == lTotal) {
+            pTest->evNotEmpty.NotifyAll();
+        }
+    }
+}
+
+static void TestQueue()
+{
+    const LONG lTotal = c_cProducers * c_lPerProducer;
+    QUEUETEST *pTest = new QUEUETEST;
+    PERF_CHECK(SUCCEEDED(pTest->q.Initialize(64)));
+    pTest->lReceived = 0;
+    pTest->plSeen = new LONG[lTotal];
+    ZeroMemory((void *) pTest->plSeen, lTotal * sizeof(LONG));
+
+    CPerfThreads::Run(c_cProducers + c_cConsumers, QueueThread, pTest);
+
+    for (LONG i = 0; i < lTotal; i++) {
+        PERF_CHECK(pTest->plSeen[i] == 1);
+    }
+    PERF_CHECK(pTest->q.Dequeue() == NULL);
+    PERF_CHECK(!pTest->evNotEmpty.HasWaiters() && !pTest->evNotFull.HasWaiters());
+    printf("queue: %ld values through %d producers and %d consumers\n",
+           lTotal, c_cProducers, c_cConsumers);
+    delete [] pTest->plSeen;
+    delete pTest;
+}
+
+// --- spsc -----------------------------------------------------------
+
+static const LONG c_lSPSCValues = 2000000;
+
+struct SPSCTEST {
+    CSPSCQueue<void> q;
+};
+
+static void SPSCThread(void *pv, int iThread)
+{
+    SPSCTEST *pTest = (SPSCTEST *) pv;
+    if (iThread == 0) {
+        DWORD dwSeed = 7;
+        void *apBatch[8];
+        for (LONG lNext = 1; lNext <= c_lSPSCValues; ) {
+            LONG nBatch = (LONG) (PerfRandom(&dwSeed) % 8) + 1;
+            if (nBatch > c_lSPSCValues - lNext + 1) {
+                nBatch = c_lSPSCValues - lNext + 1;
+            }
+            for (LONG i = 0; i < nBatch; i++) {
+                apBatch[i] = (void *) (ULONG_PTR) (lNext + i);
+            }
+            while (!pTest->q.Enqueue(apBatch, nBatch)) {
+                SwitchToThread();
+            }
+            lNext += nBatch;
+        }
+    } else {
+        for (LONG lExpect = 1; lExpect <= c_lSPSCValues; ) {
+            void *pValue = pTest->q.Dequeue();
+            if (pValue == NULL) {
+                SwitchToThread();
+                continue;
+            }
+            PERF_CHECK((LONG) (ULONG_PTR) pValue == lExpect);
+            lExpect++;
+        }
+    }
+}
+
+static void TestSPSC()
+{
+    SPSCTEST *pTest = new SPSCTEST;
+    PERF_CHECK(SUCCEEDED(pTest->q.Initialize(32)));
+    CPerfThreads::Run(2, SPSCThread, pTest);
+    PERF_CHECK(pTest->q.IsEmpty());
+    printf("spsc: %ld values in order\n", c_lSPSCValues);
+    delete pTest;
+}
+
+// --- sharedlock -----------------------------------------------------
+
+struct SHAREDLOCKTEST {
+    CAMSharedLock Lock;
+    volatile LONG lFirst;
+    volatile LONG lSecond;
+    volatile LONG lReads;
+};
+
+static void SharedLockThread(void *pv, int iThread)
+{
+    SHAREDLOCKTEST *pTest = (SHAREDLOCKTEST *) pv;
+    if (iThread < 2) {
+        for (int i = 0; i < 20000; i++) {
+            pTest->Lock.LockExclusive();
+            LONG l = pTest->lFirst + 1;
+            pTest->lFirst = l;
+            SwitchToThread();
+            pTest->lSecond = l;
+            pTest->Lock.UnlockExclusive();
+        }
+    } else {
+        for (int i = 0; i < 100000; i++) {
+            pTest->Lock.LockShared();
+            LONG l = pTest->lFirst;
+            if ((i & 255) == 0) {
+                SwitchToThread();
+            }
+            PERF_CHECK(pTest->lSecond == l);
+            pTest->Lock.UnlockShared();
+            InterlockedIncrement(&pTest->lReads);
+        }
+    }
+}
+
+static void TestSharedLock()
+{
+    SHAREDLOCKTEST *pTest = new SHAREDLOCKTEST;
+    pTest->lFirst = 0;
+    pTest->lSecond = 0;
+    pTest->lReads = 0;
+    CPerfThreads::Run(8, SharedLockThread, pTest);
+    PERF_CHECK(pTest->lFirst == 40000 && pTest->lSecond == 40000);
+    printf("sharedlock: %ld writes, %ld reads\n", pTest->lFirst, pTest->lReads);
+    delete pTest;
+}
+
+// --- allocator ------------------------------------------------------
+
+struct ALLOCATORTEST {
+    CMemAllocator *pAllocator;
+    volatile LONG lGot;
+    volatile LONG lRefused;
+};
+
+static void AllocatorThread(void *pv, int iThread)
+{
+    ALLOCATORTEST *pTest = (ALLOCATORTEST *) pv;
+    for (;;) {
+        IMediaSample *pSample;
+        HRESULT hr = pTest->pAllocator->GetBuffer(&pSample, NULL, NULL, 0);
+        if (FAILED(hr)) {
+            PERF_CHECK(hr == VFW_E_NOT_COMMITTED);
+            InterlockedIncrement(&pTest->lRefused);
+            return;
+        }
+        InterlockedIncrement(&pTest->lGot);
+        if ((iThread & 1) == 0) {
+            SwitchToThread();
+        }
+        pSample->Release();
+    }
+}
+
+static DWORD WINAPI DecommitLater(LPVOID pv)
+{
+    ALLOCATORTEST *pTest = (ALLOCATORTEST *) pv;
+    while (pTest->lGot < 200000) {
+        Sleep(1);
+    }
+    pTest->pAllocator->Decommit();
+    return 0;
+}
+
+static void TestAllocator()
+{
+    HRESULT hr = S_OK;
+    ALLOCATORTEST Test;
+    Test.pAllocator = new CMemAllocator(NAME("lockstress"), NULL, &hr);
+    Test.pAllocator->AddRef();
+    Test.lGot = 0;
+    Test.lRefused = 0;
+    PERF_CHECK(SUCCEEDED(hr));
+    PERF_CHECK(SUCCEEDED(Test.pAllocator->SetLockFreeMode(TRUE)));
+
+    ALLOCATOR_PROPERTIES Request = { 3, 4096, 1, 0 }, Actual;
+    PERF_CHECK(SUCCEEDED(Test.pAllocator->SetProperties(&Request, &Actual)));
+    PERF_CHECK(SUCCEEDED(Test.pAllocator->Commit()));
+
+    HANDLE hDecommit = CreateThread(NULL, 0, DecommitLater, &Test, 0, NULL);
+    CPerfThreads::Run(8, AllocatorThread, &Test);
+    WaitForSingleObject(hDecommit, INFINITE);
+    CloseHandle(hDecommit);
+
+    // every thread must have been let out of GetBuffer by the decommit
+    PERF_CHECK(Test.lRefused == 8);
+    PERF_CHECK(Test.pAllocator->Release() == 0);
+    printf("allocator: %ld buffers through 3 samples and 8 threads\n", Test.lGot);
+}
+
+// --- placement ------------------------------------------------------
+
+static const LONG c_lPlaceSamples = 8;
+static const LONG c_cbPlaceSample = 16384;
+
+static void PlacementThread(void *pv, int iThread)
+{
+    CMemAllocator *pAllocator = (CMemAllocator *) pv;
+    IMediaSample *pSample;
+    PERF_CHECK(SUCCEEDED(pAllocator->GetBuffer(&pSample, NULL, NULL, 0)));
+    BYTE *pb;
+    PERF_CHECK(SUCCEEDED(pSample->GetPointer(&pb)));
+    PERF_CHECK(pb != NULL);
+    PERF_CHECK(pSample->GetSize() == c_cbPlaceSample);
+
+    // nobody else may be holding the same buffer
+    memset(pb, iThread + 1, c_cbPlaceSample);
+    SwitchToThread();
+    for (LONG i = 0; i < c_cbPlaceSample; i++) {
+        PERF_CHECK(pb[i] == iThread + 1);
+    }
+    pSample->Release();
+}
+
+static void TestPlacement()
+{
+    LONG cRounds = 0;
+    for (int iRound = 0; iRound < 400; iRound++) {
+        HRESULT hr = S_OK;
+        CMemAllocator *pAllocator = new CMemAllocator(NAME("lockstress"), NULL, &hr);
+        pAllocator->AddRef();
+        PERF_CHECK(SUCCEEDED(hr));
+        PERF_CHECK(SUCCEEDED(pAllocator->SetLockFreeMode(iRound & 1)));
+        PERF_CHECK(SUCCEEDED(pAllocator->SetBackingStore(
+            (iRound & 2) ? AM_MEMALLOC_PREFAULT : AM_MEMALLOC_PREFAULT | AM_MEMALLOC_NUMANODE)));
+
+        ALLOCATOR_PROPERTIES Request = { c_lPlaceSamples, c_cbPlaceSample, 1, 0 }, Actual;
+        PERF_CHECK(SUCCEEDED(pAllocator->SetProperties(&Request, &Actual)));
+
+        // nothing to place until committed, and a commit that is never
+        // used must leave nothing behind
+        IMediaSample *pSample;
+        PERF_CHECK(pAllocator->GetBuffer(&pSample, NULL, NULL, 0) == VFW_E_NOT_COMMITTED);
+        PERF_CHECK(SUCCEEDED(pAllocator->Commit()));
+        PERF_CHECK(SUCCEEDED(pAllocator->Decommit()));
+        PERF_CHECK(SUCCEEDED(pAllocator->Commit()));
+
+        CPerfThreads::Run(c_lPlaceSamples, PlacementThread, pAllocator);
+        cRounds++;
+
+        // and a second commit keeps the block that was placed
+        PERF_CHECK(SUCCEEDED(pAllocator->Decommit()));
+        PERF_CHECK(SUCCEEDED(pAllocator->Commit()));
+        CPerfThreads::Run(c_lPlaceSamples, PlacementThread, pAllocator);
+
+        PERF_CHECK(SUCCEEDED(pAllocator->Decommit()));
+        PERF_CHECK(pAllocator->Release() == 0);
+    }
+    printf("placement: %ld first GetBuffer races on %ld threads\n", cRounds, c_lPlaceSamples);
+}
+
+// --- recycle --------------------------------------------------------
+
+static DWORD g_dwRecycleNode;
+
+static void RecycleThread(void *pv, int iThread)
+{
+    CMemAllocator *pAllocator = (CMemAllocator *) pv;
+    if (pAllocator == NULL) {
+        g_dwRecycleNode = CMemAllocator::GetCurrentNumaNode();
+        return;
+    }
+
+    // one pass over the buffers, placing the block if it was left to us
+    IMediaSample *pSample;
+    PERF_CHECK(SUCCEEDED(pAllocator->GetBuffer(&pSample, NULL, NULL, 0)));
+    pSample->Release();
+}
+
+// commit, use and destroy an allocator with this node, returning whether
+// its block came out of the slab cache
+static BOOL RecycleOnce(DWORD dwNode)
+{
+    AM_SLABCACHE_STATISTICS Before, After;
+    CAMSlabCache::GetStatistics(&Before);
+
+    HRESULT hr = S_OK;
+    CMemAllocator *pAllocator = new CMemAllocator(NAME("lockstress"), NULL, &hr);
+    pAllocator->AddRef();
+    PERF_CHECK(SUCCEEDED(pAllocator->SetBackingStore(
+        AM_MEMALLOC_RECYCLE | AM_MEMALLOC_NUMANODE, dwNode)));
+    ALLOCATOR_PROPERTIES Request = { 4, 65536, 1, 0 }, Actual;
+    PERF_CHECK(SUCCEEDED(pAllocator->SetProperties(&Request, &Actual)));
+    PERF_CHECK(SUCCEEDED(pAllocator->Commit()));
+    CPerfThreads::Run(1, RecycleThread, pAllocator);
+    PERF_CHECK(SUCCEEDED(pAllocator->Decommit()));
+    PERF_CHECK(pAllocator->Release() == 0);
+
+    CAMSlabCache::GetStatistics(&After);
+    PERF_CHECK(After.cHits + After.cMisses == Before.cHits + Before.cMisses + 1);
+    return After.cHits != Before.cHits;
+}
+
+static void TestRecycle()
+{
+    // the node the allocators' fill threads run on
+    CPerfThreads::Run(1, RecycleThread, NULL);
+    if (g_dwRecycleNode == NUMA_NO_PREFERRED_NODE) {
+        printf("recycle: no NUMA node information, skipped\n");
+        return;
+    }
+
+    CAMSlabCache::Flush();
+    PERF_CHECK(!RecycleOnce(g_dwRecycleNode));
+    PERF_CHECK(RecycleOnce(AM_NUMANODE_CURRENT));
+    PERF_CHECK(RecycleOnce(g_dwRecycleNode));
+    PERF_CHECK(RecycleOnce(AM_NUMANODE_CURRENT));
+
+    // and never for another node
+    PERF_CHECK(!RecycleOnce(g_dwRecycleNode + 1));
+    CAMSlabCache::Flush();
+    printf("recycle: parked blocks found again on node %u\n", g_dwRecycleNode);
+}
+
+// --- profile --------------------------------------------------------
+
+static const int c_cProfileLockers = 4;
+static const LONG c_lProfileLocks = 20000;     // per locker
+
+struct PROFILETEST {
+    CCritSec Lock;
+    volatile LONG lValue;
+    volatile LONG cRunning;
+    LONG cReads;
+};
+
+// our lock's profile
+static AM_CRITSEC_PROFILE GetProfile(const CCritSec *pLock)
+{
+    AM_CRITSEC_PROFILE aProfiles[16];
+    LONG cLocks;
+    PERF_CHECK(SUCCEEDED(CritProfileGet(aProfiles, NUMELMS(aProfiles), &cLocks)));
+    for (LONG i = 0; i < (std::min)(cLocks, (LONG) NUMELMS(aProfiles)); i++) {
+        if (aProfiles[i].pLock == pLock) {
+            return aProfiles[i];
+        }
+    }
+    PERF_CHECK(!"profile not found");
+    return aProfiles[0];
+}
+
+static void CheckProfile(const AM_CRITSEC_PROFILE &Profile)
+{
+    LONGLONG cHistogram = 0, cHolders = 0, llHolders = 0;
+    for (int i = 0; i < AM_CRITSEC_WAIT_BUCKETS; i++) {
+        cHistogram += Profile.aWaitHistogram[i];
+    }
+    for (int i = 0; i < AM_CRITSEC_HOLDER_SITES; i++) {
+        cHolders += Profile.aHolders[i].cWaits;
+        llHolders += Profile.aHolders[i].llWaitTime;
+    }
+    PERF_CHECK(cHistogram == Profile.cContended);
+    PERF_CHECK(cHolders == Profile.cContended);
+    PERF_CHECK(llHolders == Profile.llWaitTime);
+    PERF_CHECK(Profile.llMaxWait <= Profile.llWaitTime);
+    PERF_CHECK(Profile.llMaxHold <= Profile.llHoldTime);
+
+    // a contended acquisition is counted as waited for just before it is
+    // counted as taken
+    PERF_CHECK(Profile.cContended <= Profile.cAcquired + 1);
+}
+
+static void ProfileThread(void *pv, int iThread)
+{
+    PROFILETEST *pTest = (PROFILETEST *) pv;
+    if (iThread < c_cProfileLockers) {
+        for (LONG i = 0; i < c_lProfileLocks; i++) {
+            CAutoLock lck(&pTest->Lock);
+            pTest->lValue++;
+            if ((i & 15) == 0) {
+                SwitchToThread();
+            }
+        }
+        InterlockedDecrement(&pTest->cRunning);
+        return;
+    }
+    while (pTest->cRunning) {
+        CritProfileReset();
+        for (int i = 0; i < 10; i++) {
+            CheckProfile(GetProfile(&pTest->Lock));
+            pTest->cReads++;
+        }
+        SwitchToThread();
+    }
+}
+
+static void TestProfile()
+{
+    PROFILETEST *pTest = new PROFILETEST;
+    pTest->lValue = 0;
+    pTest->cRunning = c_cProfileLockers;
+    pTest->cReads = 0;
+    CritProfileName(&pTest->Lock, TEXT("lockstress"));
+    CPerfThreads::Run(c_cProfileLockers + 1, ProfileThread, pTest);
+    PERF_CHECK(pTest->lValue == c_cProfileLockers * c_lProfileLocks);
+
+    AM_CRITSEC_PROFILE Profile = GetProfile(&pTest->Lock);
+    CheckProfile(Profile);
+    printf("profile: %ld copies read while resetting, all consistent\n", pTest->cReads);
+
+    // read as clear at once, then counted from 0 by the next holder
+    CritProfileReset();
+    Profile = GetProfile(&pTest->Lock);
+    PERF_CHECK(Profile.cAcquired == 0 && Profile.cContended == 0 && Profile.llHoldTime == 0);
+    for (LONG i = 0; i < 1000; i++) {
+        CAutoLock lck(&pTest->Lock);
+    }
+    Profile = GetProfile(&pTest->Lock);
+    CheckProfile(Profile);
+    PERF_CHECK(Profile.cAcquired == 1000 && Profile.cContended == 0);
+    printf("profile: counts start again from 0 after a reset\n");
+    delete pTest;
+}
+
+// --- deque ----------------------------------------------------------
+
+// each root fans out to c_lDequeFan subtrees, enough to grow a deque, and
+// each subtree is a binary tree of depth c_lDequeDepth
+static const LONG c_lDequeRoots = 8;        // per submitting thread
+static const LONG c_lDequeFan = 150;
+static const LONG c_lDequeDepth = 6;
+static const LONG c_lDequeTasks =
+    4 * c_lDequeRoots * (1 + c_lDequeFan * ((2 << c_lDequeDepth) - 1));
+
+struct DEQUETEST {
+    CAMTaskScheduler Scheduler;
+    volatile LONG alRuns[c_lDequeTasks];
+    volatile LONG lNextId;
+    volatile LONG lRemaining;
+    HANDLE hDone;
+};
+
+struct DEQUETASK {
+    DEQUETEST *pTest;
+    LONG lId;
+    LONG lDepth;            // -1 for a root
+};
+
+static void DequeTask(PVOID pv);
+
+static void SubmitDequeTask(DEQUETEST *pTest, LONG lDepth)
+{
+    DEQUETASK *pTask = new DEQUETASK;
+    pTask->pTest = pTest;
+    pTask->lId = InterlockedIncrement(&pTest->lNextId) - 1;
+    pTask->lDepth = lDepth;
+    PERF_CHECK(pTask->lId < c_lDequeTasks);
+    PERF_CHECK(SUCCEEDED(pTest->Scheduler.Submit(DequeTask, pTask)));
+}
+
+static void DequeTask(PVOID pv)
+{
+    DEQUETASK *pTask = (DEQUETASK *) pv;
+    DEQUETEST *pTest = pTask->pTest;
+    PERF_CHECK(InterlockedIncrement(&pTest->alRuns[pTask->lId]) == 1);
+    if (pTask->lDepth < 0) {
+        for (LONG i = 0; i < c_lDequeFan; i++) {
+            SubmitDequeTask(pTest, c_lDequeDepth);
+        }
+    } else if (pTask->lDepth > 0) {
+        SubmitDequeTask(pTest, pTask->lDepth - 1);
+        SubmitDequeTask(pTest, pTask->lDepth - 1);
+    }
+    delete pTask;
+
+    // the children were counted in before this, so this can't reach 0
+    // while any task is still to run
+    if (InterlockedDecrement(&pTest->lRemaining) == 0) {
+        SetEvent(pTest->hDone);
+    }
+}
+
+static void DequeThread(void *pv, int iThread)
+{
+    DEQUETEST *pTest = (DEQUETEST *) pv;
+    for (LONG i = 0; i < c_lDequeRoots; i++) {
+        SubmitDequeTask(pTest, -1);
+    }
+}
+
+static void TestDeque()
+{
+    DEQUETEST *pTest = new DEQUETEST;
+    ZeroMemory((void *) pTest->alRuns, sizeof(pTest->alRuns));
+    pTest->lNextId = 0;
+    pTest->lRemaining = c_lDequeTasks;
+    pTest->hDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+    PERF_CHECK(SUCCEEDED(pTest->Scheduler.Create(4)));
+
+    CPerfThreads::Run(4, DequeThread, pTest);
+    PERF_CHECK(WaitForSingleObject(pTest->hDone, INFINITE) == WAIT_OBJECT_0);
+    PERF_CHECK(pTest->lNextId == c_lDequeTasks);
+    for (LONG i = 0; i < c_lDequeTasks; i++) {
+        PERF_CHECK(pTest->alRuns[i] == 1);
+    }
+
+    AM_TASKSCHEDULER_STATISTICS Stats;
+    pTest->Scheduler.GetStatistics(&Stats);
+    printf("deque: %ld tasks each run once, %lld stolen, on %ld workers\n",
+           c_lDequeTasks, Stats.cTasksStolen, Stats.cWorkers);
+    CloseHandle(pTest->hDone);
+    delete pTest;
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct {
+        const char *pszName;
+        void (*pfnTest)();
+    } Tests[] = {
+        { "eventcount", TestEventCount },
+        { "queue", TestQueue },
+        { "spsc", TestSPSC },
+        { "sharedlock", TestSharedLock },
+        { "allocator", TestAllocator },
+        { "placement", TestPlacement },
+        { "recycle", TestRecycle },
+        { "profile", TestProfile },
+        { "deque", TestDeque }
+    };
+
+    PerfWatchdog(300);
+    BOOL bRan = FALSE;
+    for (size_t i = 0; i < NUMELMS(Tests); i++) {
+        if (argc < 2 || strcmp(argv[1], Tests[i].pszName) == 0) {
+            Tests[i].pfnTest();
+            bRan = TRUE;
+        }
+    }
+    if (!bRan) {
+        fprintf(stderr, "lockstress: no test called %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
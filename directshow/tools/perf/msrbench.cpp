@@ -0,0 +1,164 @@
+//------------------------------------------------------------------------------
+// File: MsrBench.cpp
+//
+// Desc: Cost benchmark for the MSR_ measurement macros, switched off and on,
+//       and for dumping what they logged.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+/* Each of MSR_NOTE, MSR_START and MSR_STOP in pairs, and MSR_INTEGER is
+   called over and over, with recording paused and then running, and we
+   report the time per incident and the processor time per incident. Paused
+   they should cost no more than the test of g_fMsrEnabled; running, a time
+   stamp counter read and a store into the thread's own buffer. Then 1 to 8
+   threads log notes at once, and we report the most processor time any
+   of them spent on an incident - no more than one thread alone spends, as
+   they share nothing - and the incidents logged per second by them all.
+   Last, Msr_DumpStats and Msr_Dump are timed over the buffers those
+   threads filled, since the statistics are all worked out then rather
+   than as incidents are logged.
+
+   Build it with "make msrbench" and run it as "msrbench" */
+
+
+#include "perfutil.h"
+
+
+static const LONG c_lIncidents = 4000000;
+
+static int g_idNote;
+static int g_idStartStop;
+static int g_idInteger;
+
+enum MSRKIND { MsrNote, MsrStartStop, MsrInteger };
+
+// cIncidents of Kind, returning the time they took
+static LONGLONG LogIncidents(MSRKIND Kind, LONG cIncidents)
+{
+    LONGLONG llStart = PerfNanoseconds();
+    switch (Kind) {
+    case MsrNote:
+        for (LONG i = 0; i < cIncidents; i++) {
+            MSR_NOTE(g_idNote);
+        }
+        break;
+    case MsrStartStop:
+        for (LONG i = 0; i < cIncidents; i += 2) {
+            MSR_START(g_idStartStop);
+            MSR_STOP(g_idStartStop);
+        }
+        break;
+    case MsrInteger:
+        for (LONG i = 0; i < cIncidents; i++) {
+            MSR_INTEGER(g_idInteger, i);
+        }
+        break;
+    }
+    return PerfNanoseconds() - llStart;
+}
+
+// --- one thread ---------------------------------------------------------
+
+static void RunOne(MSRKIND Kind, BOOL bEnabled)
+{
+    MSR_CONTROL(bEnabled ? MSR_RUN : MSR_PAUSE);
+    double dCpu = PerfCpuSeconds();
+    LONGLONG llTime = LogIncidents(Kind, c_lIncidents);
+    dCpu = PerfCpuSeconds() - dCpu;
+    MSR_CONTROL(MSR_PAUSE);
+
+    static const char *aszKinds[] = { "note", "start/stop", "integer" };
+    printf("%-12s %-8s %12.2f %12.2f\n", aszKinds[Kind], bEnabled ? "running" : "paused",
+           (double) llTime / c_lIncidents, dCpu * 1e9 / c_lIncidents);
+}
+
+// --- threads ------------------------------------------------------------
+
+struct MSRTHREADS {
+    LONGLONG *pllTimes;         // processor time, one per thread
+};
+
+static LONGLONG ThreadCpuNanoseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void NoteThread(void *pv, int iThread)
+{
+    MSRTHREADS *pBench = (MSRTHREADS *) pv;
+    LONGLONG llStart = ThreadCpuNanoseconds();
+    LogIncidents(MsrNote, c_lIncidents);
+    pBench->pllTimes[iThread] = ThreadCpuNanoseconds() - llStart;
+}
+
+static void RunThreads(int cThreads)
+{
+    MSRTHREADS Bench;
+    Bench.pllTimes = new LONGLONG[cThreads];
+    MSR_CONTROL(MSR_RUN);
+    LONGLONG llStart = PerfNanoseconds();
+    CPerfThreads::Run(cThreads, NoteThread, &Bench);
+    LONGLONG llTime = PerfNanoseconds() - llStart;
+    MSR_CONTROL(MSR_PAUSE);
+
+    // each thread's own processor time, so that threads time sliced on
+    // fewer processors aren't charged for each other
+    LONGLONG llSlowest = 0;
+    for (int i = 0; i < cThreads; i++) {
+        llSlowest = (std::max)(llSlowest, Bench.pllTimes[i]);
+    }
+    printf("%-12s %8d %12.2f %12.0f\n", "note", cThreads,
+           (double) llSlowest / c_lIncidents,
+           (double) c_lIncidents * cThreads * 1e3 / llTime);
+    delete [] Bench.pllTimes;
+}
+
+// --- dump ---------------------------------------------------------------
+
+static void RunDump()
+{
+    HANDLE hFile = CreateFile(TEXT("/dev/null"), GENERIC_WRITE, 0, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    PERF_CHECK(hFile != INVALID_HANDLE_VALUE);
+    LONGLONG llStart = PerfNanoseconds();
+    MSR_DUMPSTATS(hFile);
+    LONGLONG llStats = PerfNanoseconds() - llStart;
+    llStart = PerfNanoseconds();
+    MSR_DUMP(hFile);
+    LONGLONG llLog = PerfNanoseconds() - llStart;
+    CloseHandle(hFile);
+    printf("Msr_DumpStats %.2fms, Msr_Dump %.2fms\n", llStats / 1e6, llLog / 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+    MSR_INIT();
+    g_idNote = MSR_REGISTER(TEXT("msrbench - note"));
+    g_idStartStop = MSR_REGISTER(TEXT("msrbench - start/stop"));
+    g_idInteger = MSR_REGISTER(TEXT("msrbench - integer"));
+
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    printf("%u processors, %ld incidents a run\n\n", si.dwNumberOfProcessors, c_lIncidents);
+
+    printf("%-12s %-8s %12s %12s\n", "", "", "ns/incident", "cpu ns");
+    for (int iKind = MsrNote; iKind <= MsrInteger; iKind++) {
+        RunOne((MSRKIND) iKind, FALSE);
+        RunOne((MSRKIND) iKind, TRUE);
+    }
+    printf("\n");
+
+    printf("%-12s %8s %12s %12s\n", "", "threads", "cpu ns", "M/s");
+    for (int cThreads = 1; cThreads <= 8; cThreads *= 2) {
+        RunThreads(cThreads);
+    }
+    printf("\n");
+
+    RunDump();
+    MSR_TERMINATE();
+    return 0;
+}
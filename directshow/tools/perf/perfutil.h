@@ -0,0 +1,139 @@
+//------------------------------------------------------------------------------
+// File: PerfUtil.h
+//
+// Desc: Timing, thread and checking helpers shared by the performance
+//       harnesses.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#ifndef __PERFUTIL__
+#define __PERFUTIL__
+
+// system headers before streams.h, whose SAL macros break them
+#include <sys/resource.h>
+#include <signal.h>
+#include <streams.h>
+
+// a check that fails stops the harness, so "make check" sees it
+#define PERF_CHECK(_x_) \
+    ((_x_) ? (void)0 : (fprintf(stderr, "%s(%d) : check failed: %s\n", \
+                                __FILE__, __LINE__, #_x_), exit(1)))
+
+// a stress test that hangs has lost a wakeup; SIGALRM ends it with a
+// failure rather than leaving it to whoever is watching
+inline void PerfWatchdog(unsigned uSeconds)
+{
+    alarm(uSeconds);
+}
+
+inline LONGLONG PerfNanoseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (LONGLONG) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// processor time used by the whole process, all threads together
+inline double PerfCpuSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// voluntary and involuntary context switches of the whole process
+inline LONGLONG PerfContextSwitches()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return (LONGLONG) ru.ru_nvcsw + ru.ru_nivcsw;
+}
+
+inline LONGLONG PerfPageFaults()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return (LONGLONG) ru.ru_minflt + ru.ru_majflt;
+}
+
+// dPercent of the way through the sorted samples; sorts them
+inline LONGLONG PerfPercentile(std::vector<LONGLONG> &Samples, double dPercent)
+{
+    if (Samples.empty()) {
+        return 0;
+    }
+    std::sort(Samples.begin(), Samples.end());
+    size_t i = (size_t) (dPercent / 100.0 * (Samples.size() - 1) + 0.5);
+    return Samples[i];
+}
+
+// cheap per-thread random numbers for the stress tests
+inline DWORD PerfRandom(DWORD *pdwSeed)
+{
+    *pdwSeed = *pdwSeed * 1664525 + 1013904223;
+    return *pdwSeed >> 8;
+}
+
+// A video media type of this subtype and size, whose format block is
+// *pvih. A negative lHeight makes an RGB image top-down
+inline void PerfVideoType(const GUID *pSubtype, LONG lWidth, LONG lHeight,
+                          AM_MEDIA_TYPE *pmt, VIDEOINFOHEADER *pvih)
+{
+    ZeroMemory(pmt, sizeof(*pmt));
+    ZeroMemory(pvih, sizeof(*pvih));
+    PERF_CHECK(SUCCEEDED(CAMVideoConverter::InitBitmapInfoHeader(
+        pSubtype, lWidth, lHeight, &pvih->bmiHeader)));
+    pmt->majortype = MEDIATYPE_Video;
+    pmt->subtype = *pSubtype;
+    pmt->formattype = FORMAT_VideoInfo;
+    pmt->cbFormat = sizeof(*pvih);
+    pmt->pbFormat = (BYTE *) pvih;
+}
+
+// Runs pfn(pv, iThread) on cThreads threads, released together, and
+// returns when they have all finished
+class CPerfThreads {
+
+    typedef void (*PFN)(void *pv, int iThread);
+
+    struct CStart {
+        PFN pfn;
+        void *pv;
+        int iThread;
+        volatile LONG *plGo;
+    };
+
+    static DWORD WINAPI ThreadProc(LPVOID pv) {
+        CStart *pStart = (CStart *) pv;
+        while (*pStart->plGo == 0) {
+            SwitchToThread();
+        }
+        pStart->pfn(pStart->pv, pStart->iThread);
+        return 0;
+    };
+
+public:
+
+    static void Run(int cThreads, PFN pfn, void *pv) {
+        std::vector<CStart> Starts(cThreads);
+        std::vector<HANDLE> Threads(cThreads);
+        volatile LONG lGo = 0;
+        for (int i = 0; i < cThreads; i++) {
+            Starts[i].pfn = pfn;
+            Starts[i].pv = pv;
+            Starts[i].iThread = i;
+            Starts[i].plGo = &lGo;
+            Threads[i] = CreateThread(NULL, 0, ThreadProc, &Starts[i], 0, NULL);
+            PERF_CHECK(Threads[i] != NULL);
+        }
+        InterlockedExchange(&lGo, 1);
+        for (int i = 0; i < cThreads; i++) {
+            WaitForSingleObject(Threads[i], INFINITE);
+            CloseHandle(Threads[i]);
+        }
+    };
+};
+
+#endif // __PERFUTIL__
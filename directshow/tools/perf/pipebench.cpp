@@ -0,0 +1,294 @@
+//------------------------------------------------------------------------------
+// File: PipeBench.cpp
+//
+// Desc: Throughput and added latency benchmark for CTransformFilter's
+//       pipelined transforms, by depth.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+/* A CTransformFilter whose Transform spins for 1ms, as a decoder would on a
+   frame, is fed from an allocator sized by what its input pin asks for and
+   delivers to a CPerfSinkPin, without pipelining and then pipelined at
+   depths from 1 to 8 (and the number of processors if that is more). For
+   each we report
+
+       buffers     what the output allocator and upstream's ended up with -
+                   each should be at least the depth, and upstream's one
+                   more, or the pipeline can't be kept full
+       frames/s    frames fed as fast as the filter takes them
+       speedup     frames/s over that without pipelining
+       lat ms      average and worst time from Receive to delivery, fed
+                   that fast - this grows with the depth, as frames queue
+       added ms    average and worst time from Receive to delivery beyond
+                   the transform itself, with frames fed at half the rate
+                   one thread could manage - the cost of handing frames to
+                   the pipeline's threads and back
+
+   Without pipelining the latency is timed around each Receive, which is
+   when the frame is delivered; pipelined it comes from
+   GetPipelineStatistics.
+
+   Build it with "make pipebench" and run it as "pipebench" */
+
+
+#include "sinkpin.h"
+
+
+static const LONGLONG c_llTransformNs = 1000000;
+static const LONG c_lFrames = 400;
+static const LONG c_lPacedFrames = 200;
+
+// --- the filter ---------------------------------------------------------
+
+// attached straight to a CPerfSinkPin, with an allocator of our choosing,
+// rather than connected
+class CPipeOutputPin : public CTransformOutputPin
+{
+public:
+
+    CPipeOutputPin(CTransformFilter *pFilter, HRESULT *phr) :
+        CTransformOutputPin(NAME("pipebench"), pFilter, phr, L"Out") {};
+
+    void Attach(CPerfSinkPin *pSink, IMemAllocator *pAllocator)
+    {
+        m_Connected = pSink;
+        m_pInputPin = pSink;
+        m_pAllocator = pAllocator;
+        m_pAllocator->AddRef();
+    }
+
+    void Detach()
+    {
+        m_Connected = NULL;
+        m_pInputPin = NULL;
+        m_pAllocator->Release();
+        m_pAllocator = NULL;
+    }
+
+    IMemAllocator *Allocator() { return m_pAllocator; };
+};
+
+class CPipeFilter : public CTransformFilter
+{
+public:
+
+    CPipeFilter() : CTransformFilter(NAME("pipebench"), NULL, GUID_NULL) {};
+
+    CBasePin *GetPin(int n)
+    {
+        if (m_pInput == NULL) {
+            HRESULT hr = S_OK;
+            m_pInput = new CTransformInputPin(NAME("pipebench"), this, &hr, L"In");
+            m_pOutput = new CPipeOutputPin(this, &hr);
+            PERF_CHECK(SUCCEEDED(hr));
+        }
+        return CTransformFilter::GetPin(n);
+    }
+
+    CTransformInputPin *Input() { return (CTransformInputPin *) GetPin(0); };
+    CPipeOutputPin *Output() { return (CPipeOutputPin *) GetPin(1); };
+
+    // what Receive does once it has the input sample, without the checks
+    // on the input pin's connection
+    HRESULT Push(IMediaSample *pIn)
+    {
+        IMediaSample *pOut;
+        HRESULT hr = Output()->Allocator()->GetBuffer(&pOut, NULL, NULL, 0);
+        if (FAILED(hr)) {
+            return hr;
+        }
+        if (m_pPipeline) {
+            return PipelineReceive(pIn, pOut);
+        }
+        hr = Transform(pIn, pOut);
+        if (hr == S_OK) {
+            hr = m_pOutput->Deliver(pOut);
+        }
+        pOut->Release();
+        return hr;
+    }
+
+    void Drain() { PipelineDrain(); };
+
+    HRESULT Transform(IMediaSample *pIn, IMediaSample *pOut)
+    {
+        LONGLONG llUntil = PerfNanoseconds() + c_llTransformNs;
+        while (PerfNanoseconds() < llUntil) {
+        }
+        return S_OK;
+    }
+
+    HRESULT CheckInputType(const CMediaType *mtIn) { return E_NOTIMPL; }
+    HRESULT CheckTransform(const CMediaType *mtIn, const CMediaType *mtOut) { return E_NOTIMPL; }
+    HRESULT DecideBufferSize(IMemAllocator *pAlloc, ALLOCATOR_PROPERTIES *pprop) { return E_NOTIMPL; }
+    HRESULT GetMediaType(int iPosition, CMediaType *pMediaType) { return E_NOTIMPL; }
+};
+
+// --- depth --------------------------------------------------------------
+
+static CMemAllocator *CreateAllocator(LONG cBuffers)
+{
+    HRESULT hr = S_OK;
+    CMemAllocator *pAllocator = new CMemAllocator(NAME("pipebench"), NULL, &hr);
+    pAllocator->AddRef();
+    PERF_CHECK(SUCCEEDED(hr));
+    ALLOCATOR_PROPERTIES Request = { cBuffers, 4096, 1, 0 }, Actual;
+    PERF_CHECK(SUCCEEDED(pAllocator->SetProperties(&Request, &Actual)));
+    return pAllocator;
+}
+
+static LONG BufferCount(IMemAllocator *pAllocator)
+{
+    ALLOCATOR_PROPERTIES Props;
+    PERF_CHECK(SUCCEEDED(pAllocator->GetProperties(&Props)));
+    return Props.cBuffers;
+}
+
+struct PIPERESULT {
+    LONG cOutBuffers;
+    LONG cInBuffers;
+    double dFramesPerSecond;
+    double dLatencyAvgMs;       // fed as fast as it goes
+    double dLatencyMaxMs;
+    double dAddedAvgMs;         // fed at half speed, less the transform
+    double dAddedMaxMs;
+};
+
+// a filter pipelined to cDepth (or not, if 0) between its allocators, for
+// one run - so the pipeline's statistics cover just that run
+struct PIPERIG {
+    CPerfSinkPin Sink;
+    CPipeFilter *pFilter;
+    CMemAllocator *pOutAllocator;
+    CMemAllocator *pInAllocator;
+
+    PIPERIG(LONG cDepth)
+    {
+        pFilter = new CPipeFilter;
+        pFilter->AddRef();
+        pOutAllocator = CreateAllocator(1);
+        pFilter->Output()->Attach(&Sink, pOutAllocator);
+        if (cDepth) {
+            PERF_CHECK(SUCCEEDED(pFilter->EnablePipelining(TRUE, cDepth)));
+        }
+
+        // upstream sizes its allocator from what the input pin asks for
+        ALLOCATOR_PROPERTIES Required;
+        ZeroMemory(&Required, sizeof(Required));
+        pFilter->Input()->GetAllocatorRequirements(&Required);
+        pInAllocator = CreateAllocator((std::max)(Required.cBuffers, (LONG) 1));
+        PERF_CHECK(SUCCEEDED(pOutAllocator->Commit()));
+        PERF_CHECK(SUCCEEDED(pInAllocator->Commit()));
+    }
+
+    ~PIPERIG()
+    {
+        pFilter->EnablePipelining(FALSE);
+        pFilter->Output()->Detach();
+        pFilter->Release();
+        pInAllocator->Decommit();
+        pInAllocator->Release();
+        pOutAllocator->Decommit();
+        pOutAllocator->Release();
+    }
+
+    // feed cFrames, each llIntervalNs after the last (or as fast as they
+    // are taken if 0), returning the time taken and the latency
+    LONGLONG Feed(LONG cFrames, LONGLONG llIntervalNs, double *pdAvgMs, double *pdMaxMs)
+    {
+        LONGLONG llLatencyTotal = 0, llLatencyMax = 0;
+        LONGLONG llStart = PerfNanoseconds();
+        for (LONG i = 0; i < cFrames; i++) {
+            if (llIntervalNs) {
+                while (PerfNanoseconds() < llStart + i * llIntervalNs) {
+                    SwitchToThread();
+                }
+            }
+            IMediaSample *pIn;
+            PERF_CHECK(SUCCEEDED(pInAllocator->GetBuffer(&pIn, NULL, NULL, 0)));
+            LONGLONG llReceive = PerfNanoseconds();
+            PERF_CHECK(pFilter->Push(pIn) == S_OK);
+            LONGLONG llLatency = PerfNanoseconds() - llReceive;
+            llLatencyTotal += llLatency;
+            llLatencyMax = (std::max)(llLatencyMax, llLatency);
+            pIn->Release();
+        }
+        pFilter->Drain();
+        LONGLONG llTime = PerfNanoseconds() - llStart;
+        PERF_CHECK(Sink.m_lReceived == cFrames);
+
+        AM_PIPELINE_STATISTICS Stats;
+        if (SUCCEEDED(pFilter->GetPipelineStatistics(&Stats))) {
+            PERF_CHECK(Stats.cFramesDelivered == cFrames);
+            *pdAvgMs = Stats.rtLatencyAvg / 1e4;
+            *pdMaxMs = Stats.rtLatencyMax / 1e4;
+        } else {
+            *pdAvgMs = llLatencyTotal / 1e6 / cFrames;
+            *pdMaxMs = llLatencyMax / 1e6;
+        }
+        return llTime;
+    }
+};
+
+static PIPERESULT TimeDepth(LONG cDepth)
+{
+    PIPERESULT Result;
+    {
+        PIPERIG Rig(cDepth);
+        Result.cOutBuffers = BufferCount(Rig.pOutAllocator);
+        Result.cInBuffers = BufferCount(Rig.pInAllocator);
+        LONGLONG llTime = Rig.Feed(c_lFrames, 0, &Result.dLatencyAvgMs,
+                                   &Result.dLatencyMaxMs);
+        Result.dFramesPerSecond = c_lFrames * 1e9 / llTime;
+    }
+    {
+        PIPERIG Rig(cDepth);
+        double dAvgMs, dMaxMs;
+        Rig.Feed(c_lPacedFrames, c_llTransformNs * 2, &dAvgMs, &dMaxMs);
+        Result.dAddedAvgMs = dAvgMs - c_llTransformNs / 1e6;
+        Result.dAddedMaxMs = dMaxMs - c_llTransformNs / 1e6;
+    }
+    return Result;
+}
+
+int main(int argc, char *argv[])
+{
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    printf("transform %.1fms, %u processors\n\n", c_llTransformNs / 1e6,
+           si.dwNumberOfProcessors);
+    printf("%5s %7s | %9s %8s %8s %8s | %8s %8s\n", "", "buffers", "", "", "lat ms", "",
+           "added ms", "");
+    printf("%5s %7s | %9s %8s %8s %8s | %8s %8s\n", "depth", "out/in", "frames/s",
+           "speedup", "avg", "max", "avg", "max");
+
+    LONG alDepths[] = { 0, 1, 2, 4, 8, (LONG) si.dwNumberOfProcessors };
+    double dNone = 0;
+    for (size_t i = 0; i < NUMELMS(alDepths); i++) {
+        if (i == NUMELMS(alDepths) - 1 && alDepths[i] <= 8) {
+            break;
+        }
+        PIPERESULT Result = TimeDepth(alDepths[i]);
+        if (alDepths[i] == 0) {
+            dNone = Result.dFramesPerSecond;
+        }
+        char szDepth[16], szBuffers[16];
+        if (alDepths[i]) {
+            sprintf(szDepth, "%ld", alDepths[i]);
+        } else {
+            strcpy(szDepth, "none");
+        }
+        sprintf(szBuffers, "%ld/%ld", Result.cOutBuffers, Result.cInBuffers);
+        printf("%5s %7s | %9.1f %8.2f %8.2f %8.2f | %8.3f %8.3f\n", szDepth, szBuffers,
+               Result.dFramesPerSecond, Result.dFramesPerSecond / dNone,
+               Result.dLatencyAvgMs, Result.dLatencyMaxMs,
+               Result.dAddedAvgMs, Result.dAddedMaxMs);
+        if (alDepths[i]) {
+            PERF_CHECK(Result.cOutBuffers >= alDepths[i]);
+            PERF_CHECK(Result.cInBuffers >= alDepths[i] + 1);
+        }
+    }
+    return 0;
+}
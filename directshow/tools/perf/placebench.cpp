@@ -0,0 +1,146 @@
+//------------------------------------------------------------------------------
+// File: PlaceBench.cpp
+//
+// Desc: Page fault and first touch benchmark for where and when
+//       CMemAllocator places and prefaults its buffer block.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+/* For 4MB and 64MB blocks of 8 samples, Commit is called on the main thread
+   and a separate fill thread then makes two passes, each taking every
+   buffer with GetBuffer, writing all of it and releasing it. The backing
+   stores are
+
+       default     no flags; the block is allocated at Commit and the fill
+                   thread faults every page in on the first pass
+       node        AM_MEMALLOC_PREFAULT | AM_MEMALLOC_NUMANODE with the
+                   fill thread's own GetCurrentNumaNode(); placed and
+                   touched at Commit, which is what the committing thread
+                   used to do for every prefault
+       deferred    AM_MEMALLOC_PREFAULT alone; placed and touched by the
+                   fill thread's first GetBuffer
+
+   and for each we report the median over a few runs of the Commit time,
+   the first GetBuffer, the page faults taken in that GetBuffer and in the
+   rest of the fill thread's first pass, and how long the first and second
+   passes took.
+
+   This host has one NUMA node and the shim ignores the node given to
+   VirtualAllocExNuma, so what shows here is the cost moving between Commit,
+   the first GetBuffer and the first pass, not the remote memory traffic
+   that placing the block on the wrong node costs on a NUMA machine.
+
+   Build it with "make placebench" and run it as "placebench" */
+
+
+#include "perfutil.h"
+
+
+static const LONG c_lSamples = 8;
+static const int c_iRuns = 5;
+
+struct PLACEBENCH {
+    CMemAllocator *pAllocator;
+    LONGLONG llFirstGetBuffer;
+    LONGLONG llGetFaults;       // taken in the first GetBuffer
+    LONGLONG llFillFaults;      // and in the rest of the first pass
+    LONGLONG llFirstPass;
+    LONGLONG llSecondPass;
+};
+
+// one pass: take every buffer, write all of it, give them all back
+static LONGLONG FillPass(PLACEBENCH *pBench, BOOL bFirst)
+{
+    IMediaSample *apSamples[c_lSamples];
+    LONGLONG llStart = PerfNanoseconds();
+    for (LONG i = 0; i < c_lSamples; i++) {
+        LONGLONG llFaults = PerfPageFaults();
+        LONGLONG llGet = PerfNanoseconds();
+        PERF_CHECK(SUCCEEDED(pBench->pAllocator->GetBuffer(&apSamples[i], NULL, NULL, 0)));
+        if (bFirst && i == 0) {
+            pBench->llFirstGetBuffer = PerfNanoseconds() - llGet;
+            pBench->llGetFaults = PerfPageFaults() - llFaults;
+        }
+        BYTE *pb;
+        PERF_CHECK(SUCCEEDED(apSamples[i]->GetPointer(&pb)));
+        PERF_CHECK(pb != NULL);
+        memset(pb, i, apSamples[i]->GetSize());
+    }
+    for (LONG i = 0; i < c_lSamples; i++) {
+        apSamples[i]->Release();
+    }
+    return PerfNanoseconds() - llStart;
+}
+
+static void FillThread(void *pv, int iThread)
+{
+    PLACEBENCH *pBench = (PLACEBENCH *) pv;
+    LONGLONG llFaults = PerfPageFaults();
+    pBench->llFirstPass = FillPass(pBench, TRUE);
+    pBench->llFillFaults = PerfPageFaults() - llFaults - pBench->llGetFaults;
+    pBench->llSecondPass = FillPass(pBench, FALSE);
+}
+
+static DWORD g_dwFillNode;
+
+static void NodeThread(void *pv, int iThread)
+{
+    g_dwFillNode = CMemAllocator::GetCurrentNumaNode();
+}
+
+static void RunPlace(const char *pszName, LONG cbBlock, DWORD dwFlags, DWORD dwNode)
+{
+    std::vector<LONGLONG> Commit, FirstGet, GetFaults, FillFaults, FirstPass, SecondPass;
+
+    for (int iRun = 0; iRun < c_iRuns; iRun++) {
+        HRESULT hr = S_OK;
+        PLACEBENCH Bench;
+        Bench.pAllocator = new CMemAllocator(NAME("placebench"), NULL, &hr);
+        Bench.pAllocator->AddRef();
+        PERF_CHECK(SUCCEEDED(Bench.pAllocator->SetBackingStore(dwFlags, dwNode)));
+        ALLOCATOR_PROPERTIES Request = { c_lSamples, cbBlock / c_lSamples, 1, 0 }, Actual;
+        PERF_CHECK(SUCCEEDED(Bench.pAllocator->SetProperties(&Request, &Actual)));
+
+        LONGLONG llStart = PerfNanoseconds();
+        PERF_CHECK(SUCCEEDED(Bench.pAllocator->Commit()));
+        Commit.push_back(PerfNanoseconds() - llStart);
+
+        CPerfThreads::Run(1, FillThread, &Bench);
+        FirstGet.push_back(Bench.llFirstGetBuffer);
+        GetFaults.push_back(Bench.llGetFaults);
+        FillFaults.push_back(Bench.llFillFaults);
+        FirstPass.push_back(Bench.llFirstPass);
+        SecondPass.push_back(Bench.llSecondPass);
+
+        Bench.pAllocator->Decommit();
+        Bench.pAllocator->Release();
+    }
+
+    printf("%-10s %6ldMB %10.0f %10.0f %10lld %10lld %10.0f %10.0f\n", pszName, cbBlock >> 20,
+           PerfPercentile(Commit, 50.0) / 1e3,
+           PerfPercentile(FirstGet, 50.0) / 1e3,
+           PerfPercentile(GetFaults, 50.0),
+           PerfPercentile(FillFaults, 50.0),
+           PerfPercentile(FirstPass, 50.0) / 1e3,
+           PerfPercentile(SecondPass, 50.0) / 1e3);
+}
+
+int main(int argc, char *argv[])
+{
+    CPerfThreads::Run(1, NodeThread, NULL);
+    printf("%ld samples, median of %d runs, fill thread on node %d\n\n",
+           c_lSamples, c_iRuns, (int) g_dwFillNode);
+    printf("%-10s %8s %10s %10s %10s %10s %10s %10s\n", "", "block", "commit us",
+           "1st get us", "get faults", "fill fault", "pass 1 us", "pass 2 us");
+
+    static const LONG acbBlocks[] = { 4 << 20, 64 << 20 };
+    for (size_t i = 0; i < NUMELMS(acbBlocks); i++) {
+        RunPlace("default", acbBlocks[i], 0, AM_NUMANODE_CURRENT);
+        RunPlace("node", acbBlocks[i],
+                 AM_MEMALLOC_PREFAULT | AM_MEMALLOC_NUMANODE, g_dwFillNode);
+        RunPlace("deferred", acbBlocks[i], AM_MEMALLOC_PREFAULT, AM_NUMANODE_CURRENT);
+    }
+    return 0;
+}
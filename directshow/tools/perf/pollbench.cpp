@@ -0,0 +1,235 @@
+//------------------------------------------------------------------------------
+// File: PollBench.cpp
+//
+// Desc: Latency benchmark for polling a filter's clock and a pin's media
+//       type while a streaming thread keeps the filter lock busy.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+/* A streaming thread works on 1ms frames, holding the filter lock for each
+   as a filter does while it delivers, and every 50 frames changes the
+   filter's clock and its pin's media type. Meanwhile 1, 2 or 4 monitoring
+   threads each call GetSyncSource and ConnectionMediaType every 200us,
+   as a graph monitor polling for changes would. That is run
+
+       filter lock     with the polls taking the filter lock first, as
+                       both queries did before they moved to a
+                       CAMSharedLock of their own
+       shared lock     with the polls as they are now
+
+   and for each we report the polls made, the 50th and 99th percentile and
+   worst time a poll took, and the frames per second the streaming thread
+   managed, which the polls should not slow. A poll that has to wait for
+   the filter lock waits for the rest of a frame.
+
+   Build it with "make pollbench" and run it as "pollbench" */
+
+
+#include <algorithm>
+#include "perfutil.h"
+
+
+static const LONGLONG c_llFrameNs = 1000000;
+static const LONGLONG c_llPollNs = 200000;
+static const LONG c_lFrames = 1000;
+static const LONG c_lChangeFrames = 50;
+
+// sleep until PerfNanoseconds() reaches llNs
+static void SleepUntil(LONGLONG llNs)
+{
+    struct timespec ts;
+    ts.tv_sec = (time_t) (llNs / 1000000000);
+    ts.tv_nsec = (long) (llNs % 1000000000);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {
+    }
+}
+
+// --- the filter ---------------------------------------------------------
+
+// a clock that is never asked the time, only swapped in and out
+class CPollClock : public IReferenceClock {
+    volatile LONG m_cRef;
+public:
+    CPollClock() : m_cRef(1) {};
+
+    STDMETHODIMP QueryInterface(REFIID riid, void **ppv) {
+        if (riid == IID_IReferenceClock || riid == IID_IUnknown) {
+            *ppv = (IReferenceClock *) this;
+            AddRef();
+            return S_OK;
+        }
+        *ppv = NULL;
+        return E_NOINTERFACE;
+    };
+    STDMETHODIMP_(ULONG) AddRef() { return InterlockedIncrement(&m_cRef); };
+    STDMETHODIMP_(ULONG) Release() {
+        LONG cRef = InterlockedDecrement(&m_cRef);
+        if (cRef == 0) {
+            delete this;
+        }
+        return cRef;
+    };
+    STDMETHODIMP GetTime(REFERENCE_TIME *) { return E_NOTIMPL; };
+    STDMETHODIMP AdviseTime(REFERENCE_TIME, REFERENCE_TIME, HEVENT, DWORD_PTR *) { return E_NOTIMPL; };
+    STDMETHODIMP AdvisePeriodic(REFERENCE_TIME, REFERENCE_TIME, HSEMAPHORE, DWORD_PTR *) { return E_NOTIMPL; };
+    STDMETHODIMP Unadvise(DWORD_PTR) { return E_NOTIMPL; };
+};
+
+// counts as connected, to itself, so that ConnectionMediaType copies m_mt
+class CPollPin : public CBasePin
+{
+public:
+    CPollPin(CBaseFilter *pFilter, CCritSec *pLock, HRESULT *phr) :
+        CBasePin(NAME("pollbench"), pFilter, pLock, phr, L"In", PINDIR_INPUT)
+    {
+        m_Connected = this;
+    };
+    ~CPollPin() { m_Connected = NULL; };
+
+    HRESULT CheckMediaType(const CMediaType *) { return S_OK; };
+    STDMETHODIMP BeginFlush() { return S_OK; };
+    STDMETHODIMP EndFlush() { return S_OK; };
+};
+
+class CPollFilter : public CBaseFilter
+{
+    CCritSec m_Lock;
+    CPollPin *m_pPin;
+
+public:
+    CPollFilter() : CBaseFilter(NAME("pollbench"), NULL, &m_Lock, GUID_NULL)
+    {
+        HRESULT hr = S_OK;
+        m_pPin = new CPollPin(this, &m_Lock, &hr);
+        PERF_CHECK(SUCCEEDED(hr));
+    };
+    ~CPollFilter() { delete m_pPin; };
+
+    int GetPinCount() { return 1; };
+    CBasePin *GetPin(int n) { return n == 0 ? m_pPin : NULL; };
+
+    CCritSec *FilterLock() { return &m_Lock; };
+};
+
+// --- the run ------------------------------------------------------------
+
+struct POLLBENCH {
+    CPollFilter *pFilter;
+    CPollClock *apClocks[2];
+    CMediaType amt[2];
+    BOOL bFilterLock;           // take it around each poll
+    volatile LONG bStreaming;
+    std::vector<LONGLONG> *pTimes;      // one vector per poller
+    LONGLONG llStreamNs;
+};
+
+static void Stream(POLLBENCH *pBench)
+{
+    LONGLONG llStart = PerfNanoseconds();
+    for (LONG i = 0; i < c_lFrames; i++) {
+        CAutoLock lck(pBench->pFilter->FilterLock());
+        if (i % c_lChangeFrames == 0) {
+            LONG iNext = (i / c_lChangeFrames) & 1;
+            PERF_CHECK(SUCCEEDED(pBench->pFilter->SetSyncSource(pBench->apClocks[iNext])));
+            PERF_CHECK(SUCCEEDED(pBench->pFilter->GetPin(0)->SetMediaType(&pBench->amt[iNext])));
+        }
+        LONGLONG llUntil = PerfNanoseconds() + c_llFrameNs;
+        while (PerfNanoseconds() < llUntil) {
+        }
+    }
+    pBench->llStreamNs = PerfNanoseconds() - llStart;
+    InterlockedExchange(&pBench->bStreaming, FALSE);
+}
+
+static void Poll(POLLBENCH *pBench, std::vector<LONGLONG> &Times)
+{
+    IPin *pPin = pBench->pFilter->GetPin(0);
+    LONGLONG llNext = PerfNanoseconds();
+    while (pBench->bStreaming) {
+        SleepUntil(llNext);
+        llNext += c_llPollNs;
+
+        LONGLONG llStart = PerfNanoseconds();
+        IReferenceClock *pClock;
+        AM_MEDIA_TYPE mt;
+        if (pBench->bFilterLock) {
+            CAutoLock lck(pBench->pFilter->FilterLock());
+            PERF_CHECK(SUCCEEDED(pBench->pFilter->GetSyncSource(&pClock)));
+            PERF_CHECK(SUCCEEDED(pPin->ConnectionMediaType(&mt)));
+        } else {
+            PERF_CHECK(SUCCEEDED(pBench->pFilter->GetSyncSource(&pClock)));
+            PERF_CHECK(SUCCEEDED(pPin->ConnectionMediaType(&mt)));
+        }
+        Times.push_back(PerfNanoseconds() - llStart);
+
+        PERF_CHECK(pClock == pBench->apClocks[0] || pClock == pBench->apClocks[1]);
+        pClock->Release();
+        PERF_CHECK(mt.cbFormat == sizeof(VIDEOINFOHEADER));
+        FreeMediaType(mt);
+    }
+}
+
+static void PollThread(void *pv, int iThread)
+{
+    POLLBENCH *pBench = (POLLBENCH *) pv;
+    if (iThread == 0) {
+        Stream(pBench);
+    } else {
+        Poll(pBench, pBench->pTimes[iThread - 1]);
+    }
+}
+
+static void RunPoll(BOOL bFilterLock, int cPollers)
+{
+    POLLBENCH Bench;
+    Bench.pFilter = new CPollFilter;
+    Bench.pFilter->AddRef();
+    for (int i = 0; i < 2; i++) {
+        Bench.apClocks[i] = new CPollClock;
+        AM_MEDIA_TYPE mt;
+        VIDEOINFOHEADER vih;
+        PerfVideoType(i ? &MEDIASUBTYPE_RGB32 : &MEDIASUBTYPE_YUY2, 640, 480, &mt, &vih);
+        PERF_CHECK(SUCCEEDED(Bench.amt[i].Set(*(CMediaType *) &mt)));
+    }
+    PERF_CHECK(SUCCEEDED(Bench.pFilter->SetSyncSource(Bench.apClocks[0])));
+    PERF_CHECK(SUCCEEDED(Bench.pFilter->GetPin(0)->SetMediaType(&Bench.amt[0])));
+    Bench.bFilterLock = bFilterLock;
+    Bench.bStreaming = TRUE;
+    Bench.pTimes = new std::vector<LONGLONG>[cPollers];
+
+    CPerfThreads::Run(cPollers + 1, PollThread, &Bench);
+
+    std::vector<LONGLONG> All;
+    for (int i = 0; i < cPollers; i++) {
+        All.insert(All.end(), Bench.pTimes[i].begin(), Bench.pTimes[i].end());
+    }
+    LONGLONG llWorst = *std::max_element(All.begin(), All.end());
+    printf("%-12s %8d %8ld %10.1f %10.1f %10.1f %10.1f\n",
+           bFilterLock ? "filter lock" : "shared lock", cPollers, (LONG) All.size(),
+           PerfPercentile(All, 50.0) / 1e3, PerfPercentile(All, 99.0) / 1e3,
+           llWorst / 1e3, c_lFrames * 1e9 / Bench.llStreamNs);
+
+    Bench.pFilter->SetSyncSource(NULL);
+    Bench.pFilter->Release();
+    for (int i = 0; i < 2; i++) {
+        Bench.apClocks[i]->Release();
+    }
+    delete [] Bench.pTimes;
+}
+
+int main(int argc, char *argv[])
+{
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    printf("%u processors, %ld frames of %.1fms, a poll every %lldus\n\n",
+           si.dwNumberOfProcessors, c_lFrames, c_llFrameNs / 1e6, c_llPollNs / 1000);
+    printf("%-12s %8s %8s %10s %10s %10s %10s\n", "", "pollers", "polls",
+           "p50 us", "p99 us", "worst us", "frames/s");
+    for (int cPollers = 1; cPollers <= 4; cPollers *= 2) {
+        RunPoll(TRUE, cPollers);
+        RunPoll(FALSE, cPollers);
+    }
+    return 0;
+}
@@ -0,0 +1,324 @@
+//------------------------------------------------------------------------------
+// File: PullBench.cpp
+//
+// Desc: Throughput and processor cost benchmarks for CAsyncFileReader and
+//       for CPullPin pulling it.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+/* The benchmarks are
+
+       reader      a loop driving IAsyncReader directly, keeping 1, 4 and
+                   16 requests of 64KB and 1MB in flight and touching each
+                   page of every sample it collects, with overlapped reads,
+                   worker threads and a mapping. Reports MB/s, processor
+                   time per MB - every thread in the process, the reader's
+                   included - and the share of completions that came back
+                   before a request made earlier had
+       pullpin     a CPullPin pulling the file from the reader end to end
+                   and touching each page of every sample, with sync
+                   reads, with the classic two requests of 64KB in flight
+                   and with read-ahead of up to 16 x 1MB, in each of the
+                   three modes. Reports MB/s, processor time per MB and,
+                   for read-ahead, the depth and request size it settled
+                   on
+       mapsample   the three ways the reader can fill a sample: a read
+                   into a buffer of our own, a copy from the mapping into
+                   one, and a sample pointing straight into a view of the
+                   mapping, with 4 requests of 64KB, 1MB and 4MB in flight
+                   and each page touched. Reports MB/s, processor time and
+                   page faults per MB, and how far the resident set grew
+                   above where it started, at most and once done
+
+   The file is written just before it is read, so it comes from the page
+   cache: these are the costs of the reader, not of a disk.
+
+   Build it with "make pullbench" and run it as "pullbench [benchmark]" */
+
+
+#include "filepin.h"
+
+
+static const LONGLONG c_cbFile = 64 << 20;
+static const LONG c_lPasses = 4;
+
+static const struct {
+    const char *pszName;
+    DWORD dwFlags;
+} c_Modes[] = {
+    { "overlapped", 0 },
+    { "workers", AM_ASYNCFILE_WORKERS },
+    { "mapped", AM_ASYNCFILE_MAPPED }
+};
+
+// --- reader ---------------------------------------------------------
+
+static SIZE_T ResidentBytes()
+{
+    PROCESS_MEMORY_COUNTERS Counters;
+    Counters.cb = sizeof(Counters);
+    PERF_CHECK(GetProcessMemoryInfo(GetCurrentProcess(), &Counters, sizeof(Counters)));
+    return Counters.WorkingSetSize;
+}
+
+// read the whole file once with cDepth requests in flight, returning how
+// many completions overtook an earlier request.  If asked, every so often
+// note the largest resident set seen
+static LONG ReadPass(IAsyncReader *pReader, IMemAllocator *pAlloc, LONG cDepth,
+                     LONG cbRequest, SIZE_T *pcbMaxResident = NULL)
+{
+    LONGLONG llPos = 0;
+    LONG cInFlight = 0;
+    DWORD_PTR dwIssued = 0, dwCollected = 0;
+    LONG lOvertook = 0;
+    DWORD dwTouched = 0;
+    while (llPos < c_cbFile || cInFlight > 0) {
+        while (cInFlight < cDepth && llPos < c_cbFile) {
+            IMediaSample *pSample;
+            PERF_CHECK(SUCCEEDED(pAlloc->GetBuffer(&pSample, NULL, NULL, 0)));
+            REFERENCE_TIME tStart = llPos * UNITS;
+            REFERENCE_TIME tStop = (std::min)(llPos + cbRequest, c_cbFile) * UNITS;
+            pSample->SetTime(&tStart, &tStop);
+            PERF_CHECK(SUCCEEDED(pReader->Request(pSample, dwIssued++)));
+            llPos += cbRequest;
+            cInFlight++;
+        }
+
+        IMediaSample *pSample;
+        DWORD_PTR dwUser;
+        PERF_CHECK(SUCCEEDED(pReader->WaitForNext(INFINITE, &pSample, &dwUser)));
+        if (dwUser != dwCollected++) {
+            lOvertook++;
+        }
+        BYTE *pb;
+        pSample->GetPointer(&pb);
+        for (LONG i = 0; i < pSample->GetActualDataLength(); i += 4096) {
+            dwTouched += pb[i];
+        }
+        if (pcbMaxResident && (dwCollected & 15) == 0) {
+            *pcbMaxResident = (std::max)(*pcbMaxResident, ResidentBytes());
+        }
+        pSample->Release();
+        cInFlight--;
+    }
+    PERF_CHECK(dwTouched != 1);     // keep the touches
+    return lOvertook;
+}
+
+static void RunReader(const CPerfFile &File, size_t iMode, LONG cDepth, LONG cbRequest)
+{
+    HRESULT hr = S_OK;
+    CAsyncFileReader *pReader = new CAsyncFileReader(NAME("pullbench"), NULL, &hr);
+    pReader->AddRef();
+    PERF_CHECK(SUCCEEDED(pReader->Open(File.Name(), c_Modes[iMode].dwFlags)));
+    ALLOCATOR_PROPERTIES Request = { cDepth, cbRequest, 1, 0 };
+    IMemAllocator *pAlloc;
+    PERF_CHECK(SUCCEEDED(pReader->RequestAllocator(NULL, &Request, &pAlloc)));
+    PERF_CHECK(SUCCEEDED(pAlloc->Commit()));
+
+    // an untimed pass, so the buffers are already faulted in
+    ReadPass(pReader, pAlloc, cDepth, cbRequest);
+
+    LONG lOvertook = 0;
+    double dCpuStart = PerfCpuSeconds();
+    LONGLONG llStart = PerfNanoseconds();
+    for (LONG i = 0; i < c_lPasses; i++) {
+        lOvertook += ReadPass(pReader, pAlloc, cDepth, cbRequest);
+    }
+    LONGLONG llTime = PerfNanoseconds() - llStart;
+    double dCpu = PerfCpuSeconds() - dCpuStart;
+
+    pAlloc->Decommit();
+    pAlloc->Release();
+    pReader->Close();
+    pReader->Release();
+
+    double dMB = (double) c_cbFile * c_lPasses / (1 << 20);
+    LONG cRequests = (LONG) ((c_cbFile + cbRequest - 1) / cbRequest) * c_lPasses;
+    printf("%-10s %6ld %8ldKB %10.0f %10.3f %10.1f\n", c_Modes[iMode].pszName,
+           cDepth, cbRequest >> 10, dMB * 1e9 / llTime, dCpu * 1e3 / dMB,
+           100.0 * lOvertook / cRequests);
+}
+
+static void BenchReader()
+{
+    printf("reader: %lldMB file read %ld times\n", c_cbFile >> 20, c_lPasses);
+    printf("%-10s %6s %10s %10s %10s %10s\n", "", "depth", "request",
+           "MB/s", "cpu ms/MB", "% overtook");
+    CPerfFile File(c_cbFile);
+    for (size_t iMode = 0; iMode < NUMELMS(c_Modes); iMode++) {
+        for (LONG cbRequest = 64 << 10; cbRequest <= (1 << 20); cbRequest *= 16) {
+            for (LONG cDepth = 1; cDepth <= 16; cDepth *= 4) {
+                RunReader(File, iMode, cDepth, cbRequest);
+            }
+        }
+    }
+    printf("\n");
+}
+
+// --- mapsample ------------------------------------------------------
+
+enum { FillRead, FillMapCopy, FillMapView };
+
+static void RunMapSample(const CPerfFile &File, int iFill, LONG cbRequest)
+{
+    static const char *aszFills[] = { "read", "map copy", "map view" };
+    static const LONG cDepth = 4;
+    SIZE_T cbBase = ResidentBytes();
+
+    HRESULT hr = S_OK;
+    CAsyncFileReader *pReader = new CAsyncFileReader(NAME("pullbench"), NULL, &hr);
+    pReader->AddRef();
+    PERF_CHECK(SUCCEEDED(pReader->Open(File.Name(),
+                                       iFill == FillRead ? 0 : AM_ASYNCFILE_MAPPED)));
+    ALLOCATOR_PROPERTIES Request = { cDepth, cbRequest, 1, 0 }, Actual;
+    IMemAllocator *pAlloc;
+    if (iFill == FillMapCopy) {
+        // not the reader's allocator, so it has to copy into our buffers
+        CMemAllocator *pMemAlloc = new CMemAllocator(NAME("pullbench"), NULL, &hr);
+        pMemAlloc->AddRef();
+        PERF_CHECK(SUCCEEDED(pMemAlloc->SetProperties(&Request, &Actual)));
+        pAlloc = pMemAlloc;
+    } else {
+        PERF_CHECK(SUCCEEDED(pReader->RequestAllocator(NULL, &Request, &pAlloc)));
+    }
+    PERF_CHECK(SUCCEEDED(pAlloc->Commit()));
+
+    ReadPass(pReader, pAlloc, cDepth, cbRequest);
+
+    SIZE_T cbMaxResident = 0;
+    LONGLONG llFaults = PerfPageFaults();
+    double dCpuStart = PerfCpuSeconds();
+    LONGLONG llStart = PerfNanoseconds();
+    for (LONG i = 0; i < c_lPasses; i++) {
+        ReadPass(pReader, pAlloc, cDepth, cbRequest, &cbMaxResident);
+    }
+    LONGLONG llTime = PerfNanoseconds() - llStart;
+    double dCpu = PerfCpuSeconds() - dCpuStart;
+    llFaults = PerfPageFaults() - llFaults;
+    SIZE_T cbAfter = ResidentBytes();
+
+    pAlloc->Decommit();
+    pAlloc->Release();
+    pReader->Close();
+    pReader->Release();
+
+    double dMB = (double) c_cbFile * c_lPasses / (1 << 20);
+    printf("%-10s %8ldKB %10.0f %10.3f %10.1f %10.1f %10.1f\n", aszFills[iFill],
+           cbRequest >> 10, dMB * 1e9 / llTime, dCpu * 1e3 / dMB, llFaults / dMB,
+           ((double) cbMaxResident - cbBase) / (1 << 20),
+           ((double) cbAfter - cbBase) / (1 << 20));
+}
+
+static void BenchMapSample()
+{
+    printf("mapsample: %lldMB file read %ld times, 4 requests in flight\n",
+           c_cbFile >> 20, c_lPasses);
+    printf("%-10s %10s %10s %10s %10s %10s %10s\n", "", "request", "MB/s",
+           "cpu ms/MB", "faults/MB", "max rss MB", "rss MB");
+    CPerfFile File(c_cbFile);
+    for (LONG cbRequest = 64 << 10; cbRequest <= (4 << 20); cbRequest *= 4) {
+        if (cbRequest == (256 << 10)) {
+            continue;
+        }
+        for (int iFill = FillRead; iFill <= FillMapView; iFill++) {
+            RunMapSample(File, iFill, cbRequest);
+        }
+    }
+    printf("\n");
+}
+
+// --- pullpin --------------------------------------------------------
+
+enum { PullSync, PullClassic, PullReadAhead };
+
+static void RunPullPin(const CPerfFile &File, size_t iMode, int iPull)
+{
+    static const char *aszPulls[] = { "sync", "classic", "read-ahead" };
+    HRESULT hr = S_OK;
+    CAsyncFileReader *pReader = new CAsyncFileReader(NAME("pullbench"), NULL, &hr);
+    pReader->AddRef();
+    PERF_CHECK(SUCCEEDED(pReader->Open(File.Name(), c_Modes[iMode].dwFlags)));
+    CPerfPullPin *pPin = new CPerfPullPin(FALSE);
+    if (iPull == PullReadAhead) {
+        PERF_CHECK(SUCCEEDED(pPin->SetReadAhead(16, 1 << 20)));
+    }
+    PERF_CHECK(SUCCEEDED(pPin->Connect(pReader, NULL, iPull == PullSync)));
+
+    // the first pass is untimed, and lets read-ahead find its feet
+    double dCpuStart = 0;
+    LONGLONG llStart = 0;
+    for (LONG i = -1; i < c_lPasses; i++) {
+        if (i == 0) {
+            dCpuStart = PerfCpuSeconds();
+            llStart = PerfNanoseconds();
+        }
+        ResetEvent(pPin->m_hDone);
+        pPin->m_llNext = 0;
+        PERF_CHECK(SUCCEEDED(pPin->Active()));
+        PERF_CHECK(WaitForSingleObject(pPin->m_hDone, INFINITE) == WAIT_OBJECT_0);
+        pPin->Inactive();
+        PERF_CHECK(pPin->m_hrError == S_OK);
+    }
+    LONGLONG llTime = PerfNanoseconds() - llStart;
+    double dCpu = PerfCpuSeconds() - dCpuStart;
+    PERF_CHECK(pPin->m_lOutOfOrder == 0);
+
+    LONG cRequests, cbRequest;
+    char szReadAhead[32] = "-";
+    if (pPin->GetReadAhead(&cRequests, &cbRequest, NULL, NULL) == S_OK) {
+        sprintf(szReadAhead, "%ld x %ldKB", cRequests, cbRequest >> 10);
+    }
+
+    delete pPin;
+    pReader->Close();
+    pReader->Release();
+
+    double dMB = (double) c_cbFile * c_lPasses / (1 << 20);
+    printf("%-10s %-10s %10.0f %10.3f %14s\n", c_Modes[iMode].pszName,
+           aszPulls[iPull], dMB * 1e9 / llTime, dCpu * 1e3 / dMB, szReadAhead);
+}
+
+static void BenchPullPin()
+{
+    printf("pullpin: %lldMB file pulled %ld times\n", c_cbFile >> 20, c_lPasses);
+    printf("%-10s %-10s %10s %10s %14s\n", "", "", "MB/s", "cpu ms/MB", "read-ahead");
+    CPerfFile File(c_cbFile);
+    for (size_t iMode = 0; iMode < NUMELMS(c_Modes); iMode++) {
+        for (int iPull = PullSync; iPull <= PullReadAhead; iPull++) {
+            RunPullPin(File, iMode, iPull);
+        }
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct {
+        const char *pszName;
+        void (*pfnBench)();
+    } Benches[] = {
+        { "reader", BenchReader },
+        { "pullpin", BenchPullPin },
+        { "mapsample", BenchMapSample }
+    };
+
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    printf("%u processors\n\n", si.dwNumberOfProcessors);
+
+    BOOL bRan = FALSE;
+    for (size_t i = 0; i < NUMELMS(Benches); i++) {
+        if (argc < 2 || strcmp(argv[1], Benches[i].pszName) == 0) {
+            Benches[i].pfnBench();
+            bRan = TRUE;
+        }
+    }
+    if (!bRan) {
+        fprintf(stderr, "pullbench: no benchmark called %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,156 @@
+//------------------------------------------------------------------------------
+// File: PullStress.cpp
+//
+// Desc: Delivery order stress test for CPullPin pulling a CAsyncFileReader.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+/* CAsyncFileReader completes requests in whatever order the reads finish,
+   which with several in flight is often not the order they were made in.
+   CPullPin must still deliver the file in order. The tests are
+
+       order       pull a 32MB file with overlapped reads, worker threads
+                   and a mapping, each with the classic two requests in
+                   flight and with read-ahead of up to 16 x 256KB; every
+                   sample must start where the last one ended and hold
+                   what the file has there
+       seek        pull it with read-ahead while seeking to random places,
+                   so that flushes find completions waiting for their turn;
+                   each segment must again arrive in order, and the last
+                   must run to the end of the file
+
+   Build it with "make pullstress" and run it as "pullstress [test]" */
+
+
+#include "filepin.h"
+
+
+static const LONGLONG c_cbFile = 32 << 20;
+
+static const struct {
+    const char *pszName;
+    DWORD dwFlags;
+} c_Modes[] = {
+    { "overlapped", 0 },
+    { "workers", AM_ASYNCFILE_WORKERS },
+    { "mapped", AM_ASYNCFILE_MAPPED }
+};
+
+static CAsyncFileReader *OpenReader(const CPerfFile &File, DWORD dwFlags)
+{
+    HRESULT hr = S_OK;
+    CAsyncFileReader *pReader = new CAsyncFileReader(NAME("pullstress"), NULL, &hr);
+    pReader->AddRef();
+    PERF_CHECK(SUCCEEDED(hr));
+    PERF_CHECK(SUCCEEDED(pReader->Open(File.Name(), dwFlags)));
+    return pReader;
+}
+
+static void CloseReader(CAsyncFileReader *pReader)
+{
+    pReader->Close();
+    pReader->Release();
+}
+
+// --- order ----------------------------------------------------------
+
+static void TestOrder()
+{
+    CPerfFile File(c_cbFile);
+    for (size_t iMode = 0; iMode < NUMELMS(c_Modes); iMode++) {
+        for (int iReadAhead = 0; iReadAhead < 2; iReadAhead++) {
+            CAsyncFileReader *pReader = OpenReader(File, c_Modes[iMode].dwFlags);
+            CPerfPullPin *pPin = new CPerfPullPin(TRUE);
+            if (iReadAhead) {
+                PERF_CHECK(SUCCEEDED(pPin->SetReadAhead(16, 256 << 10)));
+            }
+            PERF_CHECK(SUCCEEDED(pPin->Connect(pReader, NULL, FALSE)));
+            PERF_CHECK(SUCCEEDED(pPin->Active()));
+            PERF_CHECK(WaitForSingleObject(pPin->m_hDone, INFINITE) == WAIT_OBJECT_0);
+            pPin->Inactive();
+
+            printf("order: %-10s %-10s %6ld samples, %ld out of order\n",
+                   c_Modes[iMode].pszName, iReadAhead ? "read-ahead" : "classic",
+                   pPin->m_lSamples, pPin->m_lOutOfOrder);
+            PERF_CHECK(pPin->m_hrError == S_OK);
+            PERF_CHECK(pPin->m_lOutOfOrder == 0);
+            PERF_CHECK(pPin->m_lBadData == 0);
+            PERF_CHECK(pPin->m_llBytes == c_cbFile);
+
+            delete pPin;
+            CloseReader(pReader);
+        }
+    }
+}
+
+// --- seek -----------------------------------------------------------
+
+static const LONG c_lSeeks = 200;
+
+static void TestSeek()
+{
+    CPerfFile File(c_cbFile);
+    for (size_t iMode = 0; iMode < NUMELMS(c_Modes); iMode++) {
+        CAsyncFileReader *pReader = OpenReader(File, c_Modes[iMode].dwFlags);
+        CPerfPullPin *pPin = new CPerfPullPin(TRUE);
+        PERF_CHECK(SUCCEEDED(pPin->SetReadAhead(16, 64 << 10)));
+        PERF_CHECK(SUCCEEDED(pPin->Connect(pReader, NULL, FALSE)));
+        PERF_CHECK(SUCCEEDED(pPin->Active()));
+
+        DWORD dwSeed = 1;
+        for (LONG i = 0; i < c_lSeeks; i++) {
+            // let a few samples through, so there is something in flight
+            LONG lSamples = pPin->m_lSamples;
+            while (pPin->m_lSamples < lSamples + 2 &&
+                   WaitForSingleObject(pPin->m_hDone, 0) == WAIT_TIMEOUT) {
+                SwitchToThread();
+            }
+
+            // anywhere but the last megabyte, on a page boundary
+            LONGLONG llPos = (PerfRandom(&dwSeed) % ((c_cbFile >> 12) - 256)) << 12;
+            pPin->m_llSeekBase = llPos;
+            ResetEvent(pPin->m_hDone);
+            PERF_CHECK(SUCCEEDED(pPin->Seek(llPos * UNITS, c_cbFile * UNITS)));
+        }
+        PERF_CHECK(WaitForSingleObject(pPin->m_hDone, INFINITE) == WAIT_OBJECT_0);
+        pPin->Inactive();
+
+        printf("seek: %-10s %6ld samples, %ld out of order\n",
+               c_Modes[iMode].pszName, pPin->m_lSamples, pPin->m_lOutOfOrder);
+        PERF_CHECK(pPin->m_hrError == S_OK);
+        PERF_CHECK(pPin->m_lOutOfOrder == 0);
+        PERF_CHECK(pPin->m_lBadData == 0);
+        PERF_CHECK(pPin->m_llBase + pPin->m_llNext == c_cbFile);
+
+        delete pPin;
+        CloseReader(pReader);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct {
+        const char *pszName;
+        void (*pfnTest)();
+    } Tests[] = {
+        { "order", TestOrder },
+        { "seek", TestSeek }
+    };
+
+    PerfWatchdog(300);
+
+    BOOL bRan = FALSE;
+    for (size_t i = 0; i < NUMELMS(Tests); i++) {
+        if (argc < 2 || strcmp(argv[1], Tests[i].pszName) == 0) {
+            Tests[i].pfnTest();
+            bRan = TRUE;
+        }
+    }
+    if (!bRan) {
+        fprintf(stderr, "pullstress: no test called %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,95 @@
+//------------------------------------------------------------------------------
+// File: QueueBench.cpp
+//
+// Desc: Throughput and enqueue latency benchmark for COutputQueue with the
+//       locked sample list and with the lock-free ring.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+/* A producer takes samples from a CMemAllocator and passes them to a
+   COutputQueue, whose thread delivers them to a CPerfSinkPin. That is run
+   with the queue on its CSampleList and semaphore, and with
+   bLockFreeQueue; with Receive and with ReceiveMultiple of 8 samples at a
+   time; and with a sink that returns at once and one that spends 2us on
+   each sample. We report samples per second from the first Receive until
+   the sink has had the last one, and the 50th and 99th percentile time
+   a Receive or ReceiveMultiple call took - the producer's enqueue
+   latency. The allocator has no more samples than the queue holds, so a
+   producer that gets ahead of the sink waits in GetBuffer, not in the
+   call being timed.
+
+   Build it with "make queuebench" and run it as "queuebench" */
+
+
+#include "sinkpin.h"
+
+
+static const LONG c_lSamples = 200000;
+static const LONG c_lQueueSize = 64;
+
+static void RunQueue(BOOL bRing, LONG cBatch, LONGLONG llWorkNs)
+{
+    HRESULT hr = S_OK;
+    CPerfSinkPin Sink(llWorkNs);
+    CMemAllocator *pAllocator = new CMemAllocator(NAME("queuebench"), NULL, &hr);
+    pAllocator->AddRef();
+    // no more samples than the queue holds, so in both modes a producer
+    // that gets ahead waits in GetBuffer rather than in Receive
+    ALLOCATOR_PROPERTIES Request = { c_lQueueSize, 1024, 1, 0 }, Actual;
+    PERF_CHECK(SUCCEEDED(pAllocator->SetProperties(&Request, &Actual)));
+    PERF_CHECK(SUCCEEDED(pAllocator->Commit()));
+
+    COutputQueue *pQueue = new COutputQueue(&Sink, &hr, FALSE, TRUE, 1, FALSE,
+                                            c_lQueueSize, THREAD_PRIORITY_NORMAL,
+                                            false, bRing != FALSE);
+    PERF_CHECK(SUCCEEDED(hr));
+
+    std::vector<LONGLONG> Times;
+    Times.reserve(c_lSamples / cBatch);
+    IMediaSample *apSamples[8];
+    LONGLONG llStart = PerfNanoseconds();
+    for (LONG i = 0; i < c_lSamples; i += cBatch) {
+        for (LONG j = 0; j < cBatch; j++) {
+            PERF_CHECK(SUCCEEDED(pAllocator->GetBuffer(&apSamples[j], NULL, NULL, 0)));
+        }
+        LONGLONG llCall = PerfNanoseconds();
+        if (cBatch == 1) {
+            hr = pQueue->Receive(apSamples[0]);
+        } else {
+            long nProcessed;
+            hr = pQueue->ReceiveMultiple(apSamples, cBatch, &nProcessed);
+        }
+        Times.push_back(PerfNanoseconds() - llCall);
+        PERF_CHECK(SUCCEEDED(hr));
+    }
+    Sink.WaitFor(c_lSamples);
+    LONGLONG llTime = PerfNanoseconds() - llStart;
+
+    delete pQueue;
+    pAllocator->Decommit();
+    pAllocator->Release();
+
+    printf("%-6s %6ld %8lld %12.0f %10lld %10lld\n", bRing ? "ring" : "list",
+           cBatch, llWorkNs, (double) c_lSamples * 1e9 / llTime,
+           PerfPercentile(Times, 50.0), PerfPercentile(Times, 99.0));
+}
+
+int main(int argc, char *argv[])
+{
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    printf("%u processors, %ld samples, queue of %ld\n\n", si.dwNumberOfProcessors,
+           c_lSamples, c_lQueueSize);
+    printf("%-6s %6s %8s %12s %10s %10s\n", "", "batch", "work ns",
+           "samples/s", "p50 ns", "p99 ns");
+    static const LONGLONG allWork[] = { 0, 2000 };
+    for (size_t iWork = 0; iWork < NUMELMS(allWork); iWork++) {
+        for (LONG cBatch = 1; cBatch <= 8; cBatch *= 8) {
+            RunQueue(FALSE, cBatch, allWork[iWork]);
+            RunQueue(TRUE, cBatch, allWork[iWork]);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,339 @@
+//------------------------------------------------------------------------------
+// File: SchedBench.cpp
+//
+// Desc: Scaling benchmark for CAMSchedule's advise heap against the sorted
+//       list it replaced.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+/* With 10, 100, 1000, 10000 and 100000 advises outstanding the benchmarks
+   are
+
+       cancel      Unadvise a random outstanding advise and add a new one
+                   at a random time, as a renderer does when it gives up
+                   on a sample
+       fire        Advise at the time of the earliest advise, so it fires,
+                   and add a new one at a random later time, as a clock
+                   thread does
+       periodic    Advise at the time of the earliest of that many periodic
+                   advises, so it fires and is put back one period later,
+                   behind all the others
+
+   Each reports the time for one operation. The advises are added in
+   descending time order first, which is the list's best case, so that
+   setting up 100000 of them on the list doesn't take minutes.
+
+   CListSchedule is CAMSchedule as it was before the heap, a singly linked
+   list sorted on time between a head and a MAX_TIME tail sentry.
+
+   Build it with "make schedbench" and run it as "schedbench [benchmark]" */
+
+
+#include "perfutil.h"
+
+
+// --- the list version -----------------------------------------------
+
+class CListSchedule {
+
+    class CAdvisePacket {
+    public:
+        CAdvisePacket *m_next;
+        DWORD_PTR m_dwAdviseCookie;
+        REFERENCE_TIME m_rtEventTime;
+        REFERENCE_TIME m_rtPeriod;
+        HANDLE m_hNotify;
+        BOOL m_bPeriodic;
+
+        CAdvisePacket() {};
+        CAdvisePacket(CAdvisePacket *next, LONGLONG time) :
+            m_next(next), m_dwAdviseCookie(0), m_rtEventTime(time) {};
+        BOOL IsZ() const { return m_next == NULL; };
+        CAdvisePacket *Next() const {
+            return m_next->IsZ() ? NULL : m_next;
+        };
+    };
+
+    CAdvisePacket z, head;
+    DWORD_PTR m_dwNextCookie;
+    DWORD m_dwAdviseCount;
+    CCritSec m_Serialize;
+    CAdvisePacket *m_pAdviseCache;
+    DWORD m_dwCacheCount;
+    enum { dwCacheMax = 5 };
+    const HANDLE m_ev;
+
+    void Delete(CAdvisePacket *pPacket) {
+        if (m_dwCacheCount >= dwCacheMax) {
+            delete pPacket;
+        } else {
+            pPacket->m_next = m_pAdviseCache;
+            m_pAdviseCache = pPacket;
+            ++m_dwCacheCount;
+        }
+    };
+
+    DWORD_PTR AddAdvisePacket(CAdvisePacket *pPacket) {
+        CAdvisePacket *p_prev = &head;
+        CAdvisePacket *p_n;
+        const DWORD_PTR Result = pPacket->m_dwAdviseCookie = ++m_dwNextCookie;
+        for (;; p_prev = p_n) {
+            p_n = p_prev->m_next;
+            if (p_n->m_rtEventTime >= pPacket->m_rtEventTime) break;
+        }
+        pPacket->m_next = p_prev->m_next;
+        p_prev->m_next = pPacket;
+        ++m_dwAdviseCount;
+        if (p_prev == &head) SetEvent(m_ev);
+        return Result;
+    };
+
+    void ShuntHead() {
+        CAdvisePacket *p_prev = &head;
+        CAdvisePacket *p_n;
+        CAdvisePacket *const pPacket = head.m_next;
+        for (;; p_prev = p_n) {
+            p_n = p_prev->m_next;
+            if (p_n->m_rtEventTime > pPacket->m_rtEventTime) break;
+        }
+        if (p_prev != pPacket) {
+            head.m_next = pPacket->m_next;
+            (p_prev->m_next = pPacket)->m_next = p_n;
+        }
+    };
+
+public:
+
+    CListSchedule(HANDLE ev) :
+        z(0, MAX_TIME), head(&z, 0), m_dwNextCookie(0), m_dwAdviseCount(0),
+        m_pAdviseCache(0), m_dwCacheCount(0), m_ev(ev) {};
+
+    ~CListSchedule() {
+        while (m_pAdviseCache) {
+            CAdvisePacket *p = m_pAdviseCache;
+            m_pAdviseCache = p->m_next;
+            delete p;
+        }
+        while (!head.m_next->IsZ()) {
+            CAdvisePacket *p = head.m_next;
+            head.m_next = p->m_next;
+            delete p;
+        }
+    };
+
+    REFERENCE_TIME GetNextAdviseTime() {
+        CAutoLock lck(&m_Serialize);
+        return head.m_next->m_rtEventTime;
+    };
+
+    DWORD_PTR AddAdvisePacket(const REFERENCE_TIME &time1, const REFERENCE_TIME &time2,
+                              HANDLE h, BOOL periodic) {
+        CAutoLock lck(&m_Serialize);
+        CAdvisePacket *p;
+        if (m_pAdviseCache) {
+            p = m_pAdviseCache;
+            m_pAdviseCache = p->m_next;
+            --m_dwCacheCount;
+        } else {
+            p = new CAdvisePacket();
+        }
+        p->m_rtEventTime = time1; p->m_rtPeriod = time2;
+        p->m_hNotify = h; p->m_bPeriodic = periodic;
+        return AddAdvisePacket(p);
+    };
+
+    HRESULT Unadvise(DWORD_PTR dwAdviseCookie) {
+        CAutoLock lck(&m_Serialize);
+        CAdvisePacket *p_prev = &head;
+        CAdvisePacket *p_n;
+        while ((p_n = p_prev->Next()) != NULL) {
+            if (p_n->m_dwAdviseCookie == dwAdviseCookie) {
+                p_prev->m_next = p_n->m_next;
+                Delete(p_n);
+                --m_dwAdviseCount;
+                return S_OK;
+            }
+            p_prev = p_n;
+        }
+        return S_FALSE;
+    };
+
+    REFERENCE_TIME Advise(const REFERENCE_TIME &rtTime) {
+        REFERENCE_TIME rtNextTime;
+        CAdvisePacket *pAdvise;
+        CAutoLock lck(&m_Serialize);
+        while (rtTime >= (rtNextTime = (pAdvise = head.m_next)->m_rtEventTime) &&
+               !pAdvise->IsZ()) {
+            if (pAdvise->m_bPeriodic) {
+                ReleaseSemaphore(pAdvise->m_hNotify, 1, NULL);
+                pAdvise->m_rtEventTime += pAdvise->m_rtPeriod;
+                ShuntHead();
+            } else {
+                SetEvent(pAdvise->m_hNotify);
+                --m_dwAdviseCount;
+                head.m_next = pAdvise->m_next;
+                Delete(pAdvise);
+            }
+        }
+        return rtNextTime;
+    };
+};
+
+// --- the benchmarks -------------------------------------------------
+
+static const LONG c_lMaxAdvises = 100000;
+static const REFERENCE_TIME c_rtSpread = 1 << 30;   // advise times are spread over this
+
+static HANDLE g_hEvent;         // the schedule's event and every one-shot's
+static HANDLE g_hSemaphore;     // every periodic advise's
+
+// enough operations to time, but not minutes of the list at 100000
+static LONG OperationsFor(LONG cAdvises)
+{
+    return (std::max)(2000L, (std::min)(200000L, 200000000L / cAdvises));
+}
+
+static REFERENCE_TIME RandomTime(DWORD *pdwSeed)
+{
+    return ((REFERENCE_TIME) PerfRandom(pdwSeed) << 8 ^ PerfRandom(pdwSeed)) % c_rtSpread;
+}
+
+// cAdvises advises in descending time order, their cookies in Cookies
+template <class S> void Fill(S *pSchedule, LONG cAdvises, REFERENCE_TIME rtBase,
+                             std::vector<DWORD_PTR> &Cookies, BOOL bPeriodic)
+{
+    Cookies.resize(cAdvises);
+    for (LONG i = cAdvises - 1; i >= 0; i--) {
+        REFERENCE_TIME rt = rtBase + (c_rtSpread / cAdvises) * i;
+        Cookies[i] = pSchedule->AddAdvisePacket(rt, bPeriodic ? c_rtSpread : 0,
+                                                bPeriodic ? g_hSemaphore : g_hEvent,
+                                                bPeriodic);
+        PERF_CHECK(Cookies[i] != 0);
+    }
+}
+
+template <class S> double TimeCancel(LONG cAdvises)
+{
+    S *pSchedule = new S(g_hEvent);
+    std::vector<DWORD_PTR> Cookies;
+    Fill(pSchedule, cAdvises, c_rtSpread, Cookies, FALSE);
+
+    DWORD dwSeed = 1;
+    LONG cOperations = OperationsFor(cAdvises);
+    LONGLONG llStart = PerfNanoseconds();
+    for (LONG i = 0; i < cOperations; i++) {
+        LONG iCookie = (LONG) (PerfRandom(&dwSeed) % cAdvises);
+        PERF_CHECK(pSchedule->Unadvise(Cookies[iCookie]) == S_OK);
+        Cookies[iCookie] = pSchedule->AddAdvisePacket(
+            c_rtSpread + RandomTime(&dwSeed), 0, g_hEvent, FALSE);
+    }
+    LONGLONG llTime = PerfNanoseconds() - llStart;
+
+    for (LONG i = 0; i < cAdvises; i++) {
+        pSchedule->Unadvise(Cookies[i]);
+    }
+    delete pSchedule;
+    return (double) llTime / cOperations;
+}
+
+template <class S> double TimeFire(LONG cAdvises)
+{
+    S *pSchedule = new S(g_hEvent);
+    std::vector<DWORD_PTR> Cookies;
+    Fill(pSchedule, cAdvises, 0, Cookies, FALSE);
+
+    DWORD dwSeed = 1;
+    LONG cOperations = OperationsFor(cAdvises);
+    LONGLONG llStart = PerfNanoseconds();
+    for (LONG i = 0; i < cOperations; i++) {
+        REFERENCE_TIME rtNow = pSchedule->GetNextAdviseTime();
+        pSchedule->Advise(rtNow);
+        pSchedule->AddAdvisePacket(rtNow + 1 + RandomTime(&dwSeed), 0, g_hEvent, FALSE);
+    }
+    LONGLONG llTime = PerfNanoseconds() - llStart;
+
+    // firing them all is the easiest way to leave nothing behind
+    pSchedule->Advise(MAX_TIME - 1);
+    delete pSchedule;
+    return (double) llTime / cOperations;
+}
+
+template <class S> double TimePeriodic(LONG cAdvises)
+{
+    S *pSchedule = new S(g_hEvent);
+    std::vector<DWORD_PTR> Cookies;
+    Fill(pSchedule, cAdvises, 0, Cookies, TRUE);
+
+    LONG cOperations = OperationsFor(cAdvises);
+    LONGLONG llStart = PerfNanoseconds();
+    for (LONG i = 0; i < cOperations; i++) {
+        pSchedule->Advise(pSchedule->GetNextAdviseTime());
+    }
+    LONGLONG llTime = PerfNanoseconds() - llStart;
+
+    for (LONG i = 0; i < cAdvises; i++) {
+        PERF_CHECK(pSchedule->Unadvise(Cookies[i]) == S_OK);
+    }
+    delete pSchedule;
+    return (double) llTime / cOperations;
+}
+
+static void Report(const char *pszName, double (*pfnList)(LONG), double (*pfnHeap)(LONG))
+{
+    printf("%s: ns per operation\n", pszName);
+    printf("%8s %12s %12s %8s\n", "advises", "list", "heap", "ratio");
+    for (LONG cAdvises = 10; cAdvises <= c_lMaxAdvises; cAdvises *= 10) {
+        double dList = pfnList(cAdvises);
+        double dHeap = pfnHeap(cAdvises);
+        printf("%8ld %12.0f %12.0f %8.1f\n", cAdvises, dList, dHeap, dList / dHeap);
+    }
+    printf("\n");
+}
+
+static void BenchCancel()
+{
+    Report("cancel", TimeCancel<CListSchedule>, TimeCancel<CAMSchedule>);
+}
+
+static void BenchFire()
+{
+    Report("fire", TimeFire<CListSchedule>, TimeFire<CAMSchedule>);
+}
+
+static void BenchPeriodic()
+{
+    Report("periodic", TimePeriodic<CListSchedule>, TimePeriodic<CAMSchedule>);
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct {
+        const char *pszName;
+        void (*pfnBench)();
+    } Benches[] = {
+        { "cancel", BenchCancel },
+        { "fire", BenchFire },
+        { "periodic", BenchPeriodic }
+    };
+
+    g_hEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    g_hSemaphore = CreateSemaphore(NULL, 0, 0x7FFFFFFF, NULL);
+    PERF_CHECK(g_hEvent != NULL && g_hSemaphore != NULL);
+
+    BOOL bRan = FALSE;
+    for (size_t i = 0; i < NUMELMS(Benches); i++) {
+        if (argc < 2 || strcmp(argv[1], Benches[i].pszName) == 0) {
+            Benches[i].pfnBench();
+            bRan = TRUE;
+        }
+    }
+    CloseHandle(g_hEvent);
+    CloseHandle(g_hSemaphore);
+    if (!bRan) {
+        fprintf(stderr, "schedbench: no benchmark called %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
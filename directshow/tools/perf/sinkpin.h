@@ -0,0 +1,91 @@
+//------------------------------------------------------------------------------
+// File: SinkPin.h
+//
+// Desc: A downstream input pin for the harnesses to deliver samples to.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#ifndef __SINKPIN__
+#define __SINKPIN__
+
+#include "perfutil.h"
+
+// Counts what it receives and optionally spends a fixed time on each
+// sample, as a filter that does some work would. It is not reference
+// counted - it lives for as long as whatever delivers to it
+class CPerfSinkPin : public IPin, public IMemInputPin {
+
+    LONGLONG m_llWorkNs;            // time to spend on each sample
+
+public:
+
+    volatile LONG m_lReceived;      // samples
+    volatile LONG m_lCalls;         // Receive and ReceiveMultiple calls
+    volatile LONG m_lEndOfStream;
+
+    CPerfSinkPin(LONGLONG llWorkNs = 0) :
+        m_llWorkNs(llWorkNs), m_lReceived(0), m_lCalls(0), m_lEndOfStream(0) {};
+
+    // wait until lTotal samples have arrived
+    void WaitFor(LONG lTotal) {
+        while (m_lReceived < lTotal) {
+            SwitchToThread();
+        }
+    };
+
+    STDMETHODIMP QueryInterface(REFIID riid, void **ppv) {
+        if (riid == IID_IMemInputPin) {
+            *ppv = (IMemInputPin *) this;
+        } else if (riid == IID_IPin || riid == IID_IUnknown) {
+            *ppv = (IPin *) this;
+        } else {
+            *ppv = NULL;
+            return E_NOINTERFACE;
+        }
+        return S_OK;
+    };
+    STDMETHODIMP_(ULONG) AddRef() { return 2; };
+    STDMETHODIMP_(ULONG) Release() { return 1; };
+
+    // IPin - only what a sender calls
+    STDMETHODIMP Connect(IPin *, const AM_MEDIA_TYPE *) { return E_NOTIMPL; };
+    STDMETHODIMP ReceiveConnection(IPin *, const AM_MEDIA_TYPE *) { return E_NOTIMPL; };
+    STDMETHODIMP Disconnect() { return E_NOTIMPL; };
+    STDMETHODIMP ConnectedTo(IPin **ppPin) { *ppPin = NULL; return VFW_E_NOT_CONNECTED; };
+    STDMETHODIMP ConnectionMediaType(AM_MEDIA_TYPE *) { return VFW_E_NOT_CONNECTED; };
+    STDMETHODIMP QueryPinInfo(PIN_INFO *) { return E_NOTIMPL; };
+    STDMETHODIMP QueryDirection(PIN_DIRECTION *pPinDir) { *pPinDir = PINDIR_INPUT; return S_OK; };
+    STDMETHODIMP QueryId(LPWSTR *) { return E_NOTIMPL; };
+    STDMETHODIMP QueryAccept(const AM_MEDIA_TYPE *) { return S_OK; };
+    STDMETHODIMP EnumMediaTypes(IEnumMediaTypes **) { return E_NOTIMPL; };
+    STDMETHODIMP QueryInternalConnections(IPin **, ULONG *) { return E_NOTIMPL; };
+    STDMETHODIMP EndOfStream() { InterlockedIncrement(&m_lEndOfStream); return S_OK; };
+    STDMETHODIMP BeginFlush() { return S_OK; };
+    STDMETHODIMP EndFlush() { return S_OK; };
+    STDMETHODIMP NewSegment(REFERENCE_TIME, REFERENCE_TIME, double) { return S_OK; };
+
+    // IMemInputPin
+    STDMETHODIMP GetAllocator(IMemAllocator **) { return VFW_E_NO_ALLOCATOR; };
+    STDMETHODIMP NotifyAllocator(IMemAllocator *, BOOL) { return S_OK; };
+    STDMETHODIMP GetAllocatorRequirements(ALLOCATOR_PROPERTIES *) { return E_NOTIMPL; };
+    STDMETHODIMP Receive(IMediaSample *pSample) {
+        LONG lProcessed;
+        return ReceiveMultiple(&pSample, 1, &lProcessed);
+    };
+    STDMETHODIMP ReceiveMultiple(IMediaSample **, LONG nSamples, LONG *pnProcessed) {
+        if (m_llWorkNs) {
+            LONGLONG llUntil = PerfNanoseconds() + m_llWorkNs * nSamples;
+            while (PerfNanoseconds() < llUntil) {
+            }
+        }
+        InterlockedIncrement(&m_lCalls);
+        InterlockedExchangeAdd(&m_lReceived, nSamples);
+        *pnProcessed = nSamples;
+        return S_OK;
+    };
+    STDMETHODIMP ReceiveCanBlock() { return S_OK; };
+};
+
+#endif // __SINKPIN__
@@ -0,0 +1,245 @@
+//------------------------------------------------------------------------------
+// File: SliceBench.cpp
+//
+// Desc: Thread scaling benchmark for CTransformFilter's slice-parallel
+//       transforms.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+/* A CTransformFilter with slicing enabled converts 1920x1080 YUY2 frames
+   to top-down RGB32 through TransformSlices, each band converted by a
+   CAMVideoConverter set up for that band's height. We time it over and
+   over, for at least 200ms, with 1 to 8 threads (and up to twice the
+   number of processors if that is more), the streaming thread counted as
+   one of them, using the C conversion and the best one the processor has.
+   The C conversion is bound by arithmetic and the best is closer to being
+   bound by memory, so they scale differently. Each is run with the pool's
+   own threads and again with sharing on, when the bands are tasks on the
+   shared scheduler. For each we report
+
+       frames/s    whole frames through TransformSlices
+       speedup     frames/s over that with 1 thread
+       efficiency  speedup over the number of threads
+       cpu ms      processor time per frame, over all the threads
+
+   Past the number of processors the speedup should stay flat rather than
+   fall; a fall is the cost of the extra wakeups and the smaller bands.
+
+   Build it with "make slicebench" and run it as "slicebench" */
+
+
+#include "perfutil.h"
+
+
+static const LONG c_lWidth = 1920;
+static const LONG c_lHeight = 1080;
+static const LONGLONG c_llMinNs = 200000000;
+
+// --- the filter ---------------------------------------------------------
+
+// The filter never goes near its pins: TransformSlices is called directly,
+// and GetSliceRows answers from the frame size rather than the output type
+class CSliceFilter : public CTransformFilter
+{
+    // a converter for each band height the current split has - never more
+    // than two, as the bands differ by at most a row
+    struct BAND {
+        LONG lRows;
+        CAMVideoConverter *pConverter;
+    };
+    BAND m_aBands[2];
+    LONG m_cBands;
+    AM_VCONVERT_LEVEL m_Level;
+
+public:
+
+    CSliceFilter(AM_VCONVERT_LEVEL Level) :
+        CTransformFilter(NAME("slicebench"), NULL, GUID_NULL),
+        m_cBands(0),
+        m_Level(Level)
+    {
+    }
+
+    ~CSliceFilter()
+    {
+        ClearBands();
+    }
+
+    void ClearBands()
+    {
+        for (LONG i = 0; i < m_cBands; i++) {
+            delete m_aBands[i].pConverter;
+        }
+        m_cBands = 0;
+    }
+
+    // set up converters for the bands TransformSlices makes with cSlices
+    // threads, splitting as SliceItem does
+    void PrepareBands(LONG cSlices)
+    {
+        ClearBands();
+        for (LONG i = 0; i < cSlices; i++) {
+            LONG y0 = (LONG) (Int32x32To64(c_lHeight, i) / cSlices);
+            LONG y1 = (LONG) (Int32x32To64(c_lHeight, i + 1) / cSlices);
+            if (FindBand(y1 - y0) != NULL) {
+                continue;
+            }
+            PERF_CHECK(m_cBands < (LONG) NUMELMS(m_aBands));
+
+            AM_MEDIA_TYPE mtIn, mtOut;
+            VIDEOINFOHEADER vihIn, vihOut;
+            PerfVideoType(&MEDIASUBTYPE_YUY2, c_lWidth, y1 - y0, &mtIn, &vihIn);
+            PerfVideoType(&MEDIASUBTYPE_RGB32, c_lWidth, -(y1 - y0), &mtOut, &vihOut);
+            CAMVideoConverter *pConverter = new CAMVideoConverter;
+            PERF_CHECK(SUCCEEDED(pConverter->Initialize(&mtIn, &mtOut, m_Level)));
+            m_aBands[m_cBands].lRows = y1 - y0;
+            m_aBands[m_cBands].pConverter = pConverter;
+            m_cBands++;
+        }
+    }
+
+    CAMVideoConverter *FindBand(LONG lRows)
+    {
+        for (LONG i = 0; i < m_cBands; i++) {
+            if (m_aBands[i].lRows == lRows) {
+                return m_aBands[i].pConverter;
+            }
+        }
+        return NULL;
+    }
+
+    HRESULT GetSliceRows(IMediaSample *pIn, IMediaSample *pOut, LONG *plRows, LONG *plAlign)
+    {
+        *plRows = c_lHeight;
+        *plAlign = 1;
+        return NOERROR;
+    }
+
+    HRESULT TransformSlice(IMediaSample *pIn, IMediaSample *pOut, LONG y0, LONG y1)
+    {
+        CAMVideoConverter *pConverter = FindBand(y1 - y0);
+        if (pConverter == NULL) {
+            return E_UNEXPECTED;
+        }
+        BYTE *pbIn, *pbOut;
+        pIn->GetPointer(&pbIn);
+        pOut->GetPointer(&pbOut);
+        return pConverter->ConvertImage(pbIn + y0 * c_lWidth * 2, pbOut + y0 * c_lWidth * 4);
+    }
+
+    HRESULT CheckInputType(const CMediaType *mtIn) { return E_NOTIMPL; }
+    HRESULT CheckTransform(const CMediaType *mtIn, const CMediaType *mtOut) { return E_NOTIMPL; }
+    HRESULT DecideBufferSize(IMemAllocator *pAlloc, ALLOCATOR_PROPERTIES *pprop) { return E_NOTIMPL; }
+    HRESULT GetMediaType(int iPosition, CMediaType *pMediaType) { return E_NOTIMPL; }
+};
+
+// --- scaling ------------------------------------------------------------
+
+static IMediaSample *GetSample(CMemAllocator **ppAllocator, LONG cb)
+{
+    HRESULT hr = S_OK;
+    *ppAllocator = new CMemAllocator(NAME("slicebench"), NULL, &hr);
+    (*ppAllocator)->AddRef();
+    PERF_CHECK(SUCCEEDED(hr));
+    ALLOCATOR_PROPERTIES Request = { 1, cb, 64, 0 }, Actual;
+    PERF_CHECK(SUCCEEDED((*ppAllocator)->SetProperties(&Request, &Actual)));
+    PERF_CHECK(SUCCEEDED((*ppAllocator)->Commit()));
+
+    IMediaSample *pSample;
+    PERF_CHECK(SUCCEEDED((*ppAllocator)->GetBuffer(&pSample, NULL, NULL, 0)));
+    BYTE *pb;
+    pSample->GetPointer(&pb);
+    DWORD dwSeed = 1;
+    for (LONG i = 0; i < cb; i++) {
+        pb[i] = (BYTE) PerfRandom(&dwSeed);
+    }
+    return pSample;
+}
+
+static void FreeSample(CMemAllocator *pAllocator, IMediaSample *pSample)
+{
+    pSample->Release();
+    pAllocator->Decommit();
+    pAllocator->Release();
+}
+
+struct SLICERESULT {
+    double dFramesPerSecond;
+    double dCpuMs;              // per frame
+};
+
+static SLICERESULT TimeSlices(AM_VCONVERT_LEVEL Level, LONG cThreads,
+                              IMediaSample *pIn, IMediaSample *pOut)
+{
+    CSliceFilter *pFilter = new CSliceFilter(Level);
+    pFilter->AddRef();
+    PERF_CHECK(SUCCEEDED(pFilter->EnableSlicing(TRUE, cThreads)));
+    pFilter->PrepareBands(cThreads);
+
+    // one untimed, to start the threads and fault the output in
+    PERF_CHECK(pFilter->TransformSlices(pIn, pOut) == S_OK);
+    LONG cFrames = 0;
+    double dCpuStart = PerfCpuSeconds();
+    LONGLONG llStart = PerfNanoseconds(), llTime;
+    do {
+        PERF_CHECK(pFilter->TransformSlices(pIn, pOut) == S_OK);
+        cFrames++;
+        llTime = PerfNanoseconds() - llStart;
+    } while (llTime < c_llMinNs);
+
+    SLICERESULT Result;
+    Result.dFramesPerSecond = cFrames * 1e9 / llTime;
+    Result.dCpuMs = (PerfCpuSeconds() - dCpuStart) * 1e3 / cFrames;
+    pFilter->EnableSlicing(FALSE);
+    pFilter->Release();
+    return Result;
+}
+
+int main(int argc, char *argv[])
+{
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    LONG cMaxThreads = (std::max)((LONG) 8, (LONG) si.dwNumberOfProcessors * 2);
+    cMaxThreads = (std::min)(cMaxThreads, (LONG) MAXIMUM_WAIT_OBJECTS);
+    printf("%ldx%ld YUY2 to RGB32, %u processors\n\n", c_lWidth, c_lHeight,
+           si.dwNumberOfProcessors);
+
+    CMemAllocator *pInAllocator, *pOutAllocator;
+    IMediaSample *pIn = GetSample(&pInAllocator, c_lWidth * c_lHeight * 2);
+    IMediaSample *pOut = GetSample(&pOutAllocator, c_lWidth * c_lHeight * 4);
+
+    static const char *aszLevels[] = { "C", "SSE2", "AVX2" };
+    AM_VCONVERT_LEVEL aLevels[] = { AM_VCONVERT_SCALAR, CAMVideoConverter::GetProcessorLevel() };
+    printf("%-5s %-9s %8s %10s %8s %10s %8s\n", "", "threads", "", "frames/s",
+           "speedup", "efficiency", "cpu ms");
+    for (size_t iLevel = 0; iLevel < NUMELMS(aLevels); iLevel++) {
+        if (iLevel > 0 && aLevels[iLevel] == aLevels[0]) {
+            break;
+        }
+        for (int iShared = 0; iShared < 2; iShared++) {
+            PERF_CHECK(SUCCEEDED(CAMTaskScheduler::EnableSharing(iShared)));
+            double dOne = 0;
+            for (LONG cThreads = 1; cThreads <= cMaxThreads; cThreads++) {
+                if (cThreads > 8 && cThreads % si.dwNumberOfProcessors != 0) {
+                    continue;
+                }
+                SLICERESULT Result = TimeSlices(aLevels[iLevel], cThreads, pIn, pOut);
+                if (cThreads == 1) {
+                    dOne = Result.dFramesPerSecond;
+                }
+                double dSpeedup = Result.dFramesPerSecond / dOne;
+                printf("%-5s %-9s %8ld %10.1f %8.2f %10.2f %8.2f\n",
+                       aszLevels[aLevels[iLevel]], iShared ? "shared" : "dedicated",
+                       cThreads, Result.dFramesPerSecond, dSpeedup,
+                       dSpeedup / cThreads, Result.dCpuMs);
+            }
+        }
+    }
+    PERF_CHECK(SUCCEEDED(CAMTaskScheduler::EnableSharing(FALSE)));
+
+    FreeSample(pInAllocator, pIn);
+    FreeSample(pOutAllocator, pOut);
+    return 0;
+}
@@ -0,0 +1,526 @@
+//------------------------------------------------------------------------------
+// File: TraceStress.cpp
+//
+// Desc: Stress test for CAMStreamTrace recording from many threads into a
+//       ring that wraps, and for the JSON it writes.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+/* Every trace written is read back with a strict JSON parser, and each of
+   its events checked against what its recorder put in it. The tests are
+
+       record      four threads record 200000 events each into a ring of
+                   16, so that it wraps over and over and a thread that is
+                   preempted while writing an event is lapped by the others
+                   - the race where an old writer used to finish its event
+                   over a newer one. Half the events are StreamTrace ones
+                   whose id and data name the thread and the event's index,
+                   and half are Transform spans whose filter name, pin name
+                   and duration do. Meanwhile a fifth thread writes the
+                   trace over and over. Every file must parse, every event
+                   must carry one recorder's fields and no other's, under
+                   that recorder's thread id, and each recorder's events
+                   must appear once and in the order recorded
+       restart     a trace holds just what was recorded since the last
+                   Start, and is valid JSON when that is nothing
+
+   Build it with "make tracestress" and run it as "tracestress [test]" */
+
+
+#include <ctype.h>
+#include <math.h>
+#include <map>
+#include <string>
+#include <unistd.h>
+#include "perfutil.h"
+
+
+static const LONG c_cEvents = 16;
+static const int c_cRecorders = 4;
+static const LONG c_lRecords = 200000;     // per recorder
+static const ULONGLONG c_ullMagic = 0x5EED;
+
+// --- JSON -----------------------------------------------------------
+
+// just enough of a value to check the trace with
+enum JSONTYPE { JsonNull, JsonBool, JsonNumber, JsonString, JsonArray, JsonObject };
+
+struct JSONVALUE {
+    JSONTYPE Type;
+    double dNumber;
+    std::string Text;
+    std::vector<JSONVALUE> Items;
+    std::vector<std::string> Keys;      // for an object, one per item
+
+    const JSONVALUE *Member(const char *pszKey) const
+    {
+        for (size_t i = 0; i < Keys.size(); i++) {
+            if (Keys[i] == pszKey) {
+                return &Items[i];
+            }
+        }
+        return NULL;
+    }
+};
+
+// RFC 8259, failing the test on anything it does not allow
+class CJsonParser {
+
+    const char *m_pch;
+    const char *m_pchEnd;
+
+    void Fail(const char *pszWhat)
+    {
+        fprintf(stderr, "json: %s at \"%.40s\"\n", pszWhat, m_pch);
+        PERF_CHECK(!"invalid JSON");
+    }
+
+    void SkipSpace()
+    {
+        while (m_pch < m_pchEnd &&
+               (*m_pch == ' ' || *m_pch == '\t' || *m_pch == '\n' || *m_pch == '\r')) {
+            m_pch++;
+        }
+    }
+
+    void Expect(char ch)
+    {
+        SkipSpace();
+        if (m_pch == m_pchEnd || *m_pch != ch) {
+            Fail("unexpected character");
+        }
+        m_pch++;
+    }
+
+    BOOL Peek(char ch)
+    {
+        SkipSpace();
+        return m_pch < m_pchEnd && *m_pch == ch;
+    }
+
+    BOOL Literal(const char *psz)
+    {
+        size_t cch = strlen(psz);
+        if ((size_t) (m_pchEnd - m_pch) >= cch && memcmp(m_pch, psz, cch) == 0) {
+            m_pch += cch;
+            return TRUE;
+        }
+        return FALSE;
+    }
+
+    std::string ParseString()
+    {
+        Expect('"');
+        std::string String;
+        for (;;) {
+            if (m_pch == m_pchEnd) {
+                Fail("unterminated string");
+            }
+            char ch = *m_pch++;
+            if (ch == '"') {
+                return String;
+            }
+            if ((unsigned char) ch < 0x20) {
+                Fail("control character in string");
+            }
+            if (ch != '\\') {
+                String += ch;
+                continue;
+            }
+            if (m_pch == m_pchEnd) {
+                Fail("unterminated escape");
+            }
+            ch = *m_pch++;
+            switch (ch) {
+            case '"': case '\\': case '/': String += ch; break;
+            case 'b': String += '\b'; break;
+            case 'f': String += '\f'; break;
+            case 'n': String += '\n'; break;
+            case 'r': String += '\r'; break;
+            case 't': String += '\t'; break;
+            case 'u':
+                if (m_pchEnd - m_pch < 4 || !isxdigit(m_pch[0]) || !isxdigit(m_pch[1]) ||
+                    !isxdigit(m_pch[2]) || !isxdigit(m_pch[3])) {
+                    Fail("bad \\u escape");
+                }
+                String += '?';
+                m_pch += 4;
+                break;
+            default:
+                Fail("bad escape");
+            }
+        }
+    }
+
+    double ParseNumber()
+    {
+        const char *pchStart = m_pch;
+        if (m_pch < m_pchEnd && *m_pch == '-') {
+            m_pch++;
+        }
+        if (m_pch == m_pchEnd || !isdigit(*m_pch)) {
+            Fail("bad number");
+        }
+        if (*m_pch == '0') {
+            m_pch++;
+        } else {
+            while (m_pch < m_pchEnd && isdigit(*m_pch)) {
+                m_pch++;
+            }
+        }
+        if (m_pch < m_pchEnd && *m_pch == '.') {
+            m_pch++;
+            if (m_pch == m_pchEnd || !isdigit(*m_pch)) {
+                Fail("bad fraction");
+            }
+            while (m_pch < m_pchEnd && isdigit(*m_pch)) {
+                m_pch++;
+            }
+        }
+        if (m_pch < m_pchEnd && (*m_pch == 'e' || *m_pch == 'E')) {
+            m_pch++;
+            if (m_pch < m_pchEnd && (*m_pch == '+' || *m_pch == '-')) {
+                m_pch++;
+            }
+            if (m_pch == m_pchEnd || !isdigit(*m_pch)) {
+                Fail("bad exponent");
+            }
+            while (m_pch < m_pchEnd && isdigit(*m_pch)) {
+                m_pch++;
+            }
+        }
+        return strtod(std::string(pchStart, m_pch).c_str(), NULL);
+    }
+
+    void ParseValue(JSONVALUE *pValue)
+    {
+        SkipSpace();
+        if (m_pch == m_pchEnd) {
+            Fail("missing value");
+        }
+        pValue->dNumber = 0;
+        if (*m_pch == '{') {
+            pValue->Type = JsonObject;
+            m_pch++;
+            if (Peek('}')) {
+                m_pch++;
+                return;
+            }
+            for (;;) {
+                pValue->Keys.push_back(ParseString());
+                Expect(':');
+                pValue->Items.push_back(JSONVALUE());
+                ParseValue(&pValue->Items.back());
+                if (!Peek(',')) {
+                    break;
+                }
+                m_pch++;
+            }
+            Expect('}');
+        } else if (*m_pch == '[') {
+            pValue->Type = JsonArray;
+            m_pch++;
+            if (Peek(']')) {
+                m_pch++;
+                return;
+            }
+            for (;;) {
+                pValue->Items.push_back(JSONVALUE());
+                ParseValue(&pValue->Items.back());
+                if (!Peek(',')) {
+                    break;
+                }
+                m_pch++;
+            }
+            Expect(']');
+        } else if (*m_pch == '"') {
+            pValue->Type = JsonString;
+            pValue->Text = ParseString();
+        } else if (Literal("true") || Literal("false")) {
+            pValue->Type = JsonBool;
+        } else if (Literal("null")) {
+            pValue->Type = JsonNull;
+        } else {
+            pValue->Type = JsonNumber;
+            pValue->dNumber = ParseNumber();
+        }
+    }
+
+public:
+
+    void Parse(const std::string &Text, JSONVALUE *pRoot)
+    {
+        m_pch = Text.c_str();
+        m_pchEnd = m_pch + Text.size();
+        ParseValue(pRoot);
+        SkipSpace();
+        if (m_pch != m_pchEnd) {
+            Fail("text after the value");
+        }
+    }
+};
+
+// --- checking a trace -----------------------------------------------
+
+static const JSONVALUE *Member(const JSONVALUE &Object, const char *pszKey, JSONTYPE Type)
+{
+    PERF_CHECK(Object.Type == JsonObject);
+    const JSONVALUE *pValue = Object.Member(pszKey);
+    if (pValue == NULL || pValue->Type != Type) {
+        fprintf(stderr, "trace: \"%s\" missing or of the wrong type\n", pszKey);
+        PERF_CHECK(!"bad event");
+    }
+    return pValue;
+}
+
+static double Number(const JSONVALUE &Object, const char *pszKey)
+{
+    return Member(Object, pszKey, JsonNumber)->dNumber;
+}
+
+static const std::string &String(const JSONVALUE &Object, const char *pszKey)
+{
+    return Member(Object, pszKey, JsonString)->Text;
+}
+
+// what identifies a recorder's events
+static ULONGLONG RecordCheck(ULONGLONG ullIndex, int iThread)
+{
+    return (ullIndex * 2654435761u) ^ (iThread + 1);
+}
+
+struct TRACECHECK {
+    std::map<double, int> Threads;          // recorder by thread id
+    std::map<int, double> ThreadIds;        // and the other way
+    LONG alLast[c_cRecorders];              // last index seen of each
+    LONG cEvents;
+};
+
+// the event came from recorder iThread on thread dTid - which must be the
+// thread that recorder has always been on - and was its lIndex'th
+static void CheckRecorder(TRACECHECK *pCheck, double dTid, int iThread, LONG lIndex)
+{
+    PERF_CHECK(iThread >= 0 && iThread < c_cRecorders);
+    if (pCheck->Threads.count(dTid) == 0 && pCheck->ThreadIds.count(iThread) == 0) {
+        pCheck->Threads[dTid] = iThread;
+        pCheck->ThreadIds[iThread] = dTid;
+    }
+    if (pCheck->Threads.count(dTid) == 0 || pCheck->Threads[dTid] != iThread) {
+        fprintf(stderr, "trace: recorder %d's event %ld is on another's thread\n",
+                iThread, lIndex);
+        PERF_CHECK(!"mixed event");
+    }
+    if (lIndex <= pCheck->alLast[iThread]) {
+        fprintf(stderr, "trace: recorder %d's event %ld follows its %ld\n",
+                iThread, lIndex, pCheck->alLast[iThread]);
+        PERF_CHECK(!"event out of order");
+    }
+    pCheck->alLast[iThread] = lIndex;
+}
+
+static void CheckEvent(TRACECHECK *pCheck, const JSONVALUE &Event)
+{
+    PERF_CHECK(String(Event, "cat") == "dshow");
+    PERF_CHECK(Number(Event, "pid") == getpid());
+    PERF_CHECK(Number(Event, "ts") >= 0);
+    double dTid = Number(Event, "tid");
+    const JSONVALUE &Args = *Member(Event, "args", JsonObject);
+    const std::string &Name = String(Event, "name");
+
+    if (Name == "StreamTrace") {
+        PERF_CHECK(String(Event, "ph") == "i");
+        const JSONVALUE &Data = *Member(Args, "data", JsonArray);
+        PERF_CHECK(Data.Items.size() == 4);
+        for (size_t i = 0; i < 4; i++) {
+            PERF_CHECK(Data.Items[i].Type == JsonNumber);
+        }
+        int iThread = (int) Number(Args, "id");
+        ULONGLONG ullIndex = (ULONGLONG) Data.Items[0].dNumber;
+        if (Number(Args, "clock") != Data.Items[0].dNumber ||
+            Data.Items[1].dNumber != iThread ||
+            (ULONGLONG) Data.Items[2].dNumber != RecordCheck(ullIndex, iThread) ||
+            (ULONGLONG) Data.Items[3].dNumber != c_ullMagic) {
+            fprintf(stderr, "trace: StreamTrace event %llu of recorder %d is mixed\n",
+                    ullIndex, iThread);
+            PERF_CHECK(!"mixed event");
+        }
+        CheckRecorder(pCheck, dTid, iThread, (LONG) ullIndex);
+    } else if (Name == "Transform") {
+        PERF_CHECK(String(Event, "ph") == "X");
+        int iThread;
+        LONG lIndex;
+        char chEnd;
+        PERF_CHECK(sscanf(String(Args, "filter").c_str(), "recorder \"%d\"\\%c",
+                          &iThread, &chEnd) == 2 && chEnd == '/');
+        PERF_CHECK(sscanf(String(Args, "pin").c_str(), "event %ld", &lIndex) == 1);
+        PERF_CHECK(Args.Member("sample_ms") == NULL);
+
+        // the span is as many microseconds as the recorder's number, plus 1
+        if (fabs(Number(Event, "dur") - (iThread + 1)) > 0.01) {
+            fprintf(stderr, "trace: Transform event %ld of recorder %d lasts %.3fus\n",
+                    lIndex, iThread, Number(Event, "dur"));
+            PERF_CHECK(!"mixed event");
+        }
+        CheckRecorder(pCheck, dTid, iThread, lIndex);
+    } else {
+        fprintf(stderr, "trace: unexpected event %s\n", Name.c_str());
+        PERF_CHECK(!"unexpected event");
+    }
+    pCheck->cEvents++;
+}
+
+// write the trace, parse it and check every event in it; returns how many
+// there were
+static LONG CheckTrace(const char *pszFile)
+{
+    PERF_CHECK(SUCCEEDED(CAMStreamTrace::WriteChromeTrace(pszFile)));
+    FILE *pFile = fopen(pszFile, "rb");
+    PERF_CHECK(pFile != NULL);
+    std::string Text;
+    char ach[65536];
+    for (size_t cb; (cb = fread(ach, 1, sizeof(ach), pFile)) > 0; ) {
+        Text.append(ach, cb);
+    }
+    fclose(pFile);
+
+    JSONVALUE Root;
+    CJsonParser Parser;
+    Parser.Parse(Text, &Root);
+    PERF_CHECK(String(Root, "displayTimeUnit") == "ms");
+    const JSONVALUE &Events = *Member(Root, "traceEvents", JsonArray);
+
+    TRACECHECK Check;
+    for (int i = 0; i < c_cRecorders; i++) {
+        Check.alLast[i] = -1;
+    }
+    Check.cEvents = 0;
+    for (size_t i = 0; i < Events.Items.size(); i++) {
+        CheckEvent(&Check, Events.Items[i]);
+    }
+    return Check.cEvents;
+}
+
+// a scratch file for the traces, deleted again when we are
+class CTraceFile {
+    char m_szName[64];
+public:
+    CTraceFile() {
+        strcpy(m_szName, "/tmp/perftraceXXXXXX");
+        int fd = mkstemp(m_szName);
+        PERF_CHECK(fd >= 0);
+        close(fd);
+    };
+    ~CTraceFile() { unlink(m_szName); };
+
+    const char *Name() const { return m_szName; };
+};
+
+// what recorder iThread records as its lIndex'th event, if recording
+static void RecordEvent(int iThread, LONG lIndex)
+{
+    if (!CAMStreamTrace::IsEnabled()) {
+        return;
+    }
+    if (lIndex & 1) {
+        WCHAR szFilter[32], szPin[32];
+        swprintf(szFilter, NUMELMS(szFilter), L"recorder \"%d\"\\/", iThread);
+        swprintf(szPin, NUMELMS(szPin), L"event %ld", lIndex);
+        LONGLONG llNow = CAMStreamTrace::Now();
+        CAMStreamTrace::Record(AM_TRACE_TRANSFORM, szFilter, szPin, NULL,
+                               llNow, llNow + (iThread + 1) * 10);
+    } else {
+        CAMStreamTrace::RecordStreamTrace(iThread, lIndex, lIndex, iThread,
+                                          RecordCheck(lIndex, iThread), c_ullMagic);
+    }
+}
+
+// --- record ---------------------------------------------------------
+
+struct RECORDTEST {
+    CTraceFile File;
+    volatile LONG cRunning;
+    LONG cTraces;
+};
+
+static void RecordThread(void *pv, int iThread)
+{
+    RECORDTEST *pTest = (RECORDTEST *) pv;
+    if (iThread < c_cRecorders) {
+        for (LONG i = 0; i < c_lRecords; i++) {
+            RecordEvent(iThread, i);
+        }
+        InterlockedDecrement(&pTest->cRunning);
+        return;
+    }
+    while (pTest->cRunning) {
+        CheckTrace(pTest->File.Name());
+        pTest->cTraces++;
+    }
+}
+
+static void TestRecord()
+{
+    RECORDTEST *pTest = new RECORDTEST;
+    pTest->cRunning = c_cRecorders;
+    pTest->cTraces = 0;
+    PERF_CHECK(SUCCEEDED(CAMStreamTrace::Start(c_cEvents)));
+    CPerfThreads::Run(c_cRecorders + 1, RecordThread, pTest);
+    CAMStreamTrace::Stop();
+
+    // the last ring's worth, less any events lost to a slot still being
+    // written
+    LONG cEvents = CheckTrace(pTest->File.Name());
+    PERF_CHECK(cEvents > 0 && cEvents <= c_cEvents);
+    printf("record: %ld traces written while recording, all valid; %ld of the last %ld events kept\n",
+           pTest->cTraces, cEvents, c_cEvents);
+    delete pTest;
+}
+
+// --- restart --------------------------------------------------------
+
+static void TestRestart()
+{
+    CTraceFile File;
+    PERF_CHECK(SUCCEEDED(CAMStreamTrace::Start(c_cEvents)));
+    PERF_CHECK(CheckTrace(File.Name()) == 0);
+    for (LONG i = 0; i < 10; i++) {
+        RecordEvent(0, i);
+    }
+    PERF_CHECK(CheckTrace(File.Name()) == 10);
+
+    // stopped, nothing more is recorded; started again, the ring is empty
+    CAMStreamTrace::Stop();
+    RecordEvent(0, 10);
+    PERF_CHECK(CheckTrace(File.Name()) == 10);
+    PERF_CHECK(SUCCEEDED(CAMStreamTrace::Start(c_cEvents)));
+    PERF_CHECK(CheckTrace(File.Name()) == 0);
+    CAMStreamTrace::Stop();
+    printf("restart: traces hold what was recorded since Start\n");
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct {
+        const char *pszName;
+        void (*pfnTest)();
+    } Tests[] = {
+        { "record", TestRecord },
+        { "restart", TestRestart }
+    };
+
+    PerfWatchdog(300);
+    BOOL bRan = FALSE;
+    for (size_t i = 0; i < NUMELMS(Tests); i++) {
+        if (argc < 2 || strcmp(argv[1], Tests[i].pszName) == 0) {
+            Tests[i].pfnTest();
+            bRan = TRUE;
+        }
+    }
+    if (!bRan) {
+        fprintf(stderr, "tracestress: no test called %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,337 @@
+//------------------------------------------------------------------------------
+// File: ViewStress.cpp
+//
+// Desc: Lifetime and reference count stress test for CMediaSampleView and
+//       CSampleViewAllocator.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+/* A view holds a reference on its parent sample, so the parent must not go
+   back to its allocator, and be refilled, until the last view on it is
+   released; and an allocator that has been decommitted and released must
+   last until its last sample or view is back. The tests are
+
+       outlive     producers fill parents from a CMemAllocator, split them
+                   into views, release the parents at once and queue the
+                   views; consumers hold the views for a while, check the
+                   bytes they see were not overwritten, and release them in
+                   a random order. Then both allocators are decommitted and
+                   released while views are still out, and must only go
+                   away with the last view. Run with the parent allocator
+                   locked and lock-free
+       shared      four threads each holding a reference on the same views
+                   release them together, over and over; every parent and
+                   view must be back on its free list once, and only once,
+                   after each round
+
+   Build it with "make viewstress" and run it as "viewstress [test]" */
+
+
+#include "perfutil.h"
+
+
+// counts its own destruction so the tests can see when it happens
+class CCountedMemAllocator : public CMemAllocator {
+public:
+    static volatile LONG m_lDestroyed;
+    CCountedMemAllocator(HRESULT *phr) :
+        CMemAllocator(NAME("viewstress"), NULL, phr) {};
+    ~CCountedMemAllocator() { InterlockedIncrement(&m_lDestroyed); };
+};
+
+volatile LONG CCountedMemAllocator::m_lDestroyed = 0;
+
+class CCountedViewAllocator : public CSampleViewAllocator {
+public:
+    static volatile LONG m_lDestroyed;
+    CCountedViewAllocator(HRESULT *phr) :
+        CSampleViewAllocator(NAME("viewstress"), phr) {};
+    ~CCountedViewAllocator() { InterlockedIncrement(&m_lDestroyed); };
+};
+
+volatile LONG CCountedViewAllocator::m_lDestroyed = 0;
+
+static const LONG c_lSlices = 4;
+
+// fill the parent with one byte value and cut it into random slices
+static void FillAndSplit(CSampleViewAllocator *pViews, IMediaSample *pParent,
+                         BYTE bValue, DWORD *pdwSeed,
+                         IMediaSample **ppViews, LONG *plLengths)
+{
+    BYTE *pb;
+    PERF_CHECK(SUCCEEDED(pParent->GetPointer(&pb)));
+    LONG cb = pParent->GetSize();
+    memset(pb, bValue, cb);
+    PERF_CHECK(SUCCEEDED(pParent->SetActualDataLength(cb)));
+
+    LONG cbLeft = cb;
+    for (LONG i = 0; i < c_lSlices - 1; i++) {
+        plLengths[i] = 1 + (LONG) (PerfRandom(pdwSeed) % (cbLeft / 2));
+        cbLeft -= plLengths[i];
+    }
+    plLengths[c_lSlices - 1] = cbLeft;
+    PERF_CHECK(SUCCEEDED(pViews->SplitSample(pParent, c_lSlices, plLengths, ppViews)));
+}
+
+// every byte of the view must still be the one its parent was filled with
+static void CheckView(IMediaSample *pView)
+{
+    BYTE *pb;
+    PERF_CHECK(SUCCEEDED(pView->GetPointer(&pb)));
+    LONG cb = pView->GetActualDataLength();
+    PERF_CHECK(cb > 0);
+    for (LONG i = 1; i < cb; i++) {
+        PERF_CHECK(pb[i] == pb[0]);
+    }
+}
+
+// --- outlive --------------------------------------------------------
+
+static const int c_cOutliveProducers = 2;
+static const int c_cOutliveConsumers = 2;
+static const LONG c_lOutliveParents = 20000;     // per producer
+static const LONG c_lOutliveHeld = 8;            // views a consumer sits on
+
+struct OUTLIVETEST {
+    CCountedMemAllocator *pParents;
+    CCountedViewAllocator *pViews;
+    CBoundedQueue<IMediaSample> q;
+    volatile LONG lQueued;
+    volatile LONG lChecked;
+};
+
+static void OutliveThread(void *pv, int iThread)
+{
+    OUTLIVETEST *pTest = (OUTLIVETEST *) pv;
+    DWORD dwSeed = iThread + 1;
+
+    if (iThread < c_cOutliveProducers) {
+        for (LONG i = 0; i < c_lOutliveParents; i++) {
+            IMediaSample *pParent;
+            PERF_CHECK(SUCCEEDED(pTest->pParents->GetBuffer(&pParent, NULL, NULL, 0)));
+
+            IMediaSample *apViews[c_lSlices];
+            LONG alLengths[c_lSlices];
+            FillAndSplit(pTest->pViews, pParent, (BYTE) PerfRandom(&dwSeed),
+                         &dwSeed, apViews, alLengths);
+
+            // from here on only the views keep the parent
+            pParent->Release();
+            for (LONG j = 0; j < c_lSlices; j++) {
+                PERF_CHECK(pTest->q.Enqueue(apViews[j]));
+                InterlockedIncrement(&pTest->lQueued);
+            }
+        }
+        return;
+    }
+
+    const LONG lTotal = c_cOutliveProducers * c_lOutliveParents * c_lSlices;
+    IMediaSample *apHeld[c_lOutliveHeld];
+    LONG cHeld = 0;
+    for (;;) {
+        IMediaSample *pView = pTest->q.Dequeue();
+        if (pView == NULL) {
+            // let go of everything so the producers can't starve
+            while (cHeld > 0) {
+                apHeld[--cHeld]->Release();
+            }
+            if (pTest->lChecked >= lTotal) {
+                return;
+            }
+            SwitchToThread();
+            continue;
+        }
+        CheckView(pView);
+        InterlockedIncrement(&pTest->lChecked);
+
+        // hold on to it, letting a random one of the others go when full
+        if (cHeld == c_lOutliveHeld) {
+            LONG iRelease = (LONG) (PerfRandom(&dwSeed) % c_lOutliveHeld);
+            CheckView(apHeld[iRelease]);
+            apHeld[iRelease]->Release();
+            apHeld[iRelease] = apHeld[--cHeld];
+        }
+        apHeld[cHeld++] = pView;
+    }
+}
+
+static void RunOutlive(BOOL bLockFree)
+{
+    HRESULT hr = S_OK;
+    LONG lParentsDestroyed = CCountedMemAllocator::m_lDestroyed;
+    LONG lViewsDestroyed = CCountedViewAllocator::m_lDestroyed;
+
+    OUTLIVETEST *pTest = new OUTLIVETEST;
+    pTest->pParents = new CCountedMemAllocator(&hr);
+    pTest->pParents->AddRef();
+    pTest->pViews = new CCountedViewAllocator(&hr);
+    pTest->pViews->AddRef();
+    pTest->lQueued = 0;
+    pTest->lChecked = 0;
+    PERF_CHECK(SUCCEEDED(hr));
+    PERF_CHECK(SUCCEEDED(pTest->pParents->SetLockFreeMode(bLockFree)));
+
+    ALLOCATOR_PROPERTIES Request = { 4, 4096, 1, 0 }, Actual;
+    PERF_CHECK(SUCCEEDED(pTest->pParents->SetProperties(&Request, &Actual)));
+    PERF_CHECK(SUCCEEDED(pTest->pParents->Commit()));
+    PERF_CHECK(SUCCEEDED(pTest->pViews->SetCount(32)));
+    PERF_CHECK(SUCCEEDED(pTest->pViews->Commit()));
+    PERF_CHECK(SUCCEEDED(pTest->q.Initialize(64)));
+
+    CPerfThreads::Run(c_cOutliveProducers + c_cOutliveConsumers, OutliveThread, pTest);
+    PERF_CHECK(pTest->lChecked == pTest->lQueued);
+
+    // now leave views out while both allocators are let go of
+    IMediaSample *pParent;
+    PERF_CHECK(SUCCEEDED(pTest->pParents->GetBuffer(&pParent, NULL, NULL, 0)));
+    IMediaSample *apViews[c_lSlices];
+    LONG alLengths[c_lSlices];
+    DWORD dwSeed = 12345;
+    FillAndSplit(pTest->pViews, pParent, 0x5A, &dwSeed, apViews, alLengths);
+    pParent->Release();
+
+    PERF_CHECK(SUCCEEDED(pTest->pParents->Decommit()));
+    PERF_CHECK(SUCCEEDED(pTest->pViews->Decommit()));
+    pTest->pParents->Release();
+    pTest->pViews->Release();
+    PERF_CHECK(CCountedMemAllocator::m_lDestroyed == lParentsDestroyed);
+    PERF_CHECK(CCountedViewAllocator::m_lDestroyed == lViewsDestroyed);
+
+    // release them in a random order; both go with the last one
+    for (LONG cLeft = c_lSlices; cLeft > 0; cLeft--) {
+        PERF_CHECK(CCountedMemAllocator::m_lDestroyed == lParentsDestroyed);
+        LONG i = (LONG) (PerfRandom(&dwSeed) % cLeft);
+        CheckView(apViews[i]);
+        apViews[i]->Release();
+        apViews[i] = apViews[cLeft - 1];
+    }
+    PERF_CHECK(CCountedMemAllocator::m_lDestroyed == lParentsDestroyed + 1);
+    PERF_CHECK(CCountedViewAllocator::m_lDestroyed == lViewsDestroyed + 1);
+
+    printf("outlive: %ld views checked, %s parents\n",
+           pTest->lChecked, bLockFree ? "lock-free" : "locked");
+    delete pTest;
+}
+
+static void TestOutlive()
+{
+    RunOutlive(FALSE);
+    RunOutlive(TRUE);
+}
+
+// --- shared ---------------------------------------------------------
+
+static const int c_cSharedThreads = 4;
+static const LONG c_lSharedRounds = 20000;
+
+struct SHAREDTEST {
+    CCountedMemAllocator *pParents;
+    CCountedViewAllocator *pViews;
+    IMediaSample *apViews[c_lSlices];
+    volatile LONG lArrived;             // for the barrier
+    volatile LONG lGeneration;
+};
+
+// every thread waits here until all of them have arrived
+static void SharedBarrier(SHAREDTEST *pTest)
+{
+    LONG lGeneration = pTest->lGeneration;
+    if (InterlockedIncrement(&pTest->lArrived) == c_cSharedThreads) {
+        pTest->lArrived = 0;
+        InterlockedIncrement(&pTest->lGeneration);
+        return;
+    }
+    while (pTest->lGeneration == lGeneration) {
+        SwitchToThread();
+    }
+}
+
+static void SharedThread(void *pv, int iThread)
+{
+    SHAREDTEST *pTest = (SHAREDTEST *) pv;
+    DWORD dwSeed = iThread + 1;
+
+    for (LONG iRound = 0; iRound < c_lSharedRounds; iRound++) {
+        if (iThread == 0) {
+            // the parent and the views from the last round must all be back
+            IMediaSample *pParent;
+            PERF_CHECK(SUCCEEDED(pTest->pParents->GetBuffer(&pParent, NULL, NULL, AM_GBF_NOWAIT)));
+            LONG alLengths[c_lSlices];
+            FillAndSplit(pTest->pViews, pParent, (BYTE) iRound, &dwSeed,
+                         pTest->apViews, alLengths);
+            pParent->Release();
+            for (LONG i = 0; i < c_lSlices; i++) {
+                for (int j = 1; j < c_cSharedThreads; j++) {
+                    pTest->apViews[i]->AddRef();
+                }
+            }
+        }
+        SharedBarrier(pTest);
+
+        // everyone lets go of their references together, in their own order
+        LONG iFirst = (LONG) (PerfRandom(&dwSeed) % c_lSlices);
+        for (LONG i = 0; i < c_lSlices; i++) {
+            IMediaSample *pView = pTest->apViews[(iFirst + i) % c_lSlices];
+            CheckView(pView);
+            pView->Release();
+        }
+        SharedBarrier(pTest);
+    }
+}
+
+static void TestShared()
+{
+    HRESULT hr = S_OK;
+    SHAREDTEST *pTest = new SHAREDTEST;
+    pTest->pParents = new CCountedMemAllocator(&hr);
+    pTest->pParents->AddRef();
+    pTest->pViews = new CCountedViewAllocator(&hr);
+    pTest->pViews->AddRef();
+    pTest->lArrived = 0;
+    pTest->lGeneration = 0;
+    PERF_CHECK(SUCCEEDED(hr));
+
+    // one parent and just enough views, so a leaked reference shows at once
+    ALLOCATOR_PROPERTIES Request = { 1, 4096, 1, 0 }, Actual;
+    PERF_CHECK(SUCCEEDED(pTest->pParents->SetProperties(&Request, &Actual)));
+    PERF_CHECK(SUCCEEDED(pTest->pParents->Commit()));
+    PERF_CHECK(SUCCEEDED(pTest->pViews->SetCount(c_lSlices)));
+    PERF_CHECK(SUCCEEDED(pTest->pViews->Commit()));
+
+    CPerfThreads::Run(c_cSharedThreads, SharedThread, pTest);
+
+    PERF_CHECK(SUCCEEDED(pTest->pParents->Decommit()));
+    PERF_CHECK(SUCCEEDED(pTest->pViews->Decommit()));
+    PERF_CHECK(pTest->pParents->Release() == 0);
+    PERF_CHECK(pTest->pViews->Release() == 0);
+    printf("shared: %ld rounds of %d threads releasing the same views\n",
+           c_lSharedRounds, c_cSharedThreads);
+    delete pTest;
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct {
+        const char *pszName;
+        void (*pfnTest)();
+    } Tests[] = {
+        { "outlive", TestOutlive },
+        { "shared", TestShared }
+    };
+
+    PerfWatchdog(300);
+    BOOL bRan = FALSE;
+    for (size_t i = 0; i < NUMELMS(Tests); i++) {
+        if (argc < 2 || strcmp(argv[1], Tests[i].pszName) == 0) {
+            Tests[i].pfnTest();
+            bRan = TRUE;
+        }
+    }
+    if (!bRan) {
+        fprintf(stderr, "viewstress: no test called %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
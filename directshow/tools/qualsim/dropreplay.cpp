@@ -0,0 +1,281 @@
+//------------------------------------------------------------------------------
+// File: DropReplay.cpp
+//
+// Desc: Replays a trace of video decode costs through the frame dropping
+//       policies of CVideoTransformFilter, so they can be compared offline.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+/* A debug build of CVideoTransformFilter with predictive skipping enabled
+   logs a line for each frame at LOG_TIMING level 3:
+
+       Frame <type> cost <cost> due <due> length <length> now <now>
+
+   type is AM_VIDEO_FRAME_xxx, cost what the frame took to decode (-1 if it
+   was dropped), due its start time, length its duration and now the stream
+   time when the filter looked at it, all in 100ns units. Anything before
+   "Frame" on a line is ignored, as are lines without it. Lines of just
+
+       <type> <cost> <due> <now>
+
+   are read too, taking each frame's length from when the next is due.
+
+   Each policy is run over the frames on a simulated decoder. A frame can't
+   be started before the trace's "now" for it, or before the last frame
+   decoded has finished. Frames dropped in the trace are given the average
+   cost of their type. The policies are
+
+       none        decode everything
+       reactive    what ShouldSkipFrame does with Quality messages, taking
+                   the lateness of the last frame decoded as the message
+       predictive  CAMFrameDropPredictor, as EnablePredictiveSkipping does
+
+   Off Windows build it with host/streams.h standing in for the real one:
+
+       g++ -Ihost -I../../baseclasses dropreplay.cpp \
+           ../../baseclasses/framedrop.cpp -o dropreplay
+
+   and run it as "dropreplay trace.txt", or with the trace on stdin */
+
+
+#include <streams.h>
+#include <stdio.h>
+#include <string.h>
+
+struct FRAME {
+    int iType;
+    REFERENCE_TIME rtCost;          // -1 if not known
+    REFERENCE_TIME rtDue;
+    REFERENCE_TIME rtLength;        // 0 until we know it
+    REFERENCE_TIME rtNow;
+};
+
+struct RESULTS {
+    int cDecoded;
+    int acDropped[3];               // by type
+    int cLate;                      // decoded, but finished after it was due
+    REFERENCE_TIME rtTotalLate;
+    REFERENCE_TIME rtMaxLate;
+    REFERENCE_TIME rtMaxFreeze;     // longest time the picture didn't change
+};
+
+enum POLICY { POLICY_NONE, POLICY_REACTIVE, POLICY_PREDICTIVE };
+
+
+static BOOL ParseLine(const char *pszLine, FRAME *pFrame)
+{
+    long long llCost, llDue, llLength, llNow;
+    const char *psz = strstr(pszLine, "Frame ");
+    if (psz) {
+        if (sscanf(psz, "Frame %d cost %lld due %lld length %lld now %lld",
+                   &pFrame->iType, &llCost, &llDue, &llLength, &llNow) != 5) {
+            return FALSE;
+        }
+    } else {
+        if (sscanf(pszLine, "%d %lld %lld %lld",
+                   &pFrame->iType, &llCost, &llDue, &llNow) != 4) {
+            return FALSE;
+        }
+        llLength = 0;
+    }
+    if (pFrame->iType < AM_VIDEO_FRAME_KEY || pFrame->iType > AM_VIDEO_FRAME_B) {
+        return FALSE;
+    }
+    pFrame->rtCost = llCost < 0 ? -1 : llCost;
+    pFrame->rtDue = llDue;
+    pFrame->rtLength = llLength;
+    pFrame->rtNow = llNow;
+    return TRUE;
+}
+
+static FRAME *ReadTrace(FILE *pFile, int *pcFrames)
+{
+    int cAlloc = 1024;
+    int cFrames = 0;
+    FRAME *aFrames = new FRAME[cAlloc];
+    char szLine[512];
+
+    while (fgets(szLine, sizeof(szLine), pFile)) {
+        FRAME Frame;
+        if (!ParseLine(szLine, &Frame)) {
+            continue;
+        }
+        if (cFrames == cAlloc) {
+            FRAME *aNew = new FRAME[cAlloc * 2];
+            memcpy(aNew, aFrames, cFrames * sizeof(FRAME));
+            delete [] aFrames;
+            aFrames = aNew;
+            cAlloc *= 2;
+        }
+        aFrames[cFrames++] = Frame;
+    }
+
+    // fill in what the trace didn't have
+    REFERENCE_TIME artTotal[3] = { 0, 0, 0 };
+    int acCosts[3] = { 0, 0, 0 };
+    for (int i = 0; i < cFrames; i++) {
+        if (aFrames[i].rtLength <= 0) {
+            aFrames[i].rtLength = i + 1 < cFrames ? aFrames[i + 1].rtDue - aFrames[i].rtDue :
+                                  i > 0 ? aFrames[i - 1].rtLength : 0;
+        }
+        if (aFrames[i].rtCost >= 0) {
+            artTotal[aFrames[i].iType - AM_VIDEO_FRAME_KEY] += aFrames[i].rtCost;
+            acCosts[aFrames[i].iType - AM_VIDEO_FRAME_KEY]++;
+        }
+    }
+    for (int i = 0; i < cFrames; i++) {
+        if (aFrames[i].rtCost < 0) {
+            int iType = aFrames[i].iType - AM_VIDEO_FRAME_KEY;
+            if (acCosts[iType] == 0) {
+                iType = AM_VIDEO_FRAME_DELTA - AM_VIDEO_FRAME_KEY;
+            }
+            aFrames[i].rtCost = acCosts[iType] ? artTotal[iType] / acCosts[iType] : 0;
+        }
+    }
+
+    *pcFrames = cFrames;
+    return aFrames;
+}
+
+/* The key frame period is tracked as ShouldSkipFrame does, and once a delta
+   frame is dropped everything up to the next key frame goes too */
+
+static void Replay(POLICY Policy, const FRAME *aFrames, int cFrames, RESULTS *pResults)
+{
+    CAMFrameDropPredictor Predictor;
+    REFERENCE_TIME rtFree = 0;              // when the decoder is next free
+    REFERENCE_TIME rtLastLate = 0;          // as the last Quality message says
+    REFERENCE_TIME rtAvgDecode = 300000;    // as m_itrAvgDecode
+    REFERENCE_TIME rtShown = 0;             // due time of the last frame decoded
+    BOOL bShown = FALSE;
+    BOOL bSkipping = FALSE;
+    int nKeyFramePeriod = 0;
+    int nFramesSinceKeyFrame = 0;
+
+    memset(pResults, 0, sizeof(*pResults));
+
+    for (int i = 0; i < cFrames; i++) {
+        const FRAME *pFrame = &aFrames[i];
+        const REFERENCE_TIME rtStart = max(rtFree, pFrame->rtNow);
+
+        if (pFrame->iType == AM_VIDEO_FRAME_KEY) {
+            if (nKeyFramePeriod < nFramesSinceKeyFrame) {
+                nKeyFramePeriod = nFramesSinceKeyFrame;
+            }
+            nFramesSinceKeyFrame = 0;
+            bSkipping = FALSE;
+        } else if (nFramesSinceKeyFrame > nKeyFramePeriod && nKeyFramePeriod > 0) {
+            nKeyFramePeriod = nFramesSinceKeyFrame;
+        }
+
+        BOOL bDrop = bSkipping;
+        if (!bDrop && Policy == POLICY_PREDICTIVE) {
+            int nTillKey = -1;
+            if (nKeyFramePeriod > 0) {
+                nTillKey = max(nKeyFramePeriod - nFramesSinceKeyFrame, 1);
+            }
+            bDrop = Predictor.ShouldDrop(pFrame->iType, rtStart, pFrame->rtDue,
+                                         pFrame->rtLength, nTillKey);
+            if (bDrop && pFrame->iType == AM_VIDEO_FRAME_DELTA) {
+                bSkipping = TRUE;
+            }
+        } else if (!bDrop && Policy == POLICY_REACTIVE &&
+                   pFrame->iType != AM_VIDEO_FRAME_KEY &&
+                   rtAvgDecode * 4 > pFrame->rtLength &&
+                   rtLastLate > pFrame->rtLength &&
+                   nKeyFramePeriod > 0) {
+            const REFERENCE_TIME rtTillKey =
+                pFrame->rtLength * (nKeyFramePeriod - nFramesSinceKeyFrame - 1);
+            if (rtLastLate > rtTillKey) {
+                bDrop = bSkipping = TRUE;
+            }
+        }
+        ++nFramesSinceKeyFrame;
+
+        if (bDrop) {
+            pResults->acDropped[pFrame->iType - AM_VIDEO_FRAME_KEY]++;
+            rtLastLate -= pFrame->rtLength;
+            continue;
+        }
+
+        rtFree = rtStart + pFrame->rtCost;
+        Predictor.AddCost(pFrame->iType, pFrame->rtCost);
+        rtAvgDecode = pFrame->rtCost / 16 + 15 * (rtAvgDecode / 16);
+        pResults->cDecoded++;
+
+        const REFERENCE_TIME rtLate = rtFree - pFrame->rtDue;
+        rtLastLate = rtLate;
+        if (rtLate > 0) {
+            pResults->cLate++;
+            pResults->rtTotalLate += rtLate;
+            pResults->rtMaxLate = max(pResults->rtMaxLate, rtLate);
+        }
+        if (bShown) {
+            pResults->rtMaxFreeze = max(pResults->rtMaxFreeze, pFrame->rtDue - rtShown);
+        }
+        rtShown = pFrame->rtDue;
+        bShown = TRUE;
+    }
+}
+
+static double Ms(REFERENCE_TIME rt)
+{
+    return (double) rt / 10000;
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *pFile = stdin;
+    if (argc > 1) {
+        pFile = fopen(argv[1], "r");
+        if (pFile == NULL) {
+            fprintf(stderr, "dropreplay: can't open %s\n", argv[1]);
+            return 1;
+        }
+    }
+
+    int cFrames;
+    FRAME *aFrames = ReadTrace(pFile, &cFrames);
+    if (pFile != stdin) {
+        fclose(pFile);
+    }
+    if (cFrames == 0) {
+        fprintf(stderr, "dropreplay: no frames in the trace\n");
+        delete [] aFrames;
+        return 1;
+    }
+
+    static const struct {
+        POLICY Policy;
+        const char *pszName;
+    } aPolicies[] = {
+        { POLICY_NONE,          "none" },
+        { POLICY_REACTIVE,      "reactive" },
+        { POLICY_PREDICTIVE,    "predictive" },
+    };
+
+    printf("%d frames\n\n", cFrames);
+    printf("%-11s %8s %6s %6s %6s %6s %10s %10s %10s\n",
+           "policy", "decoded", "drop I", "drop P", "drop B", "late",
+           "mean ms", "max ms", "freeze ms");
+    const int cPolicies = (int) (sizeof(aPolicies) / sizeof(aPolicies[0]));
+    for (int i = 0; i < cPolicies; i++) {
+        RESULTS Results;
+        Replay(aPolicies[i].Policy, aFrames, cFrames, &Results);
+        printf("%-11s %8d %6d %6d %6d %6d %10.2f %10.2f %10.2f\n",
+               aPolicies[i].pszName,
+               Results.cDecoded,
+               Results.acDropped[0],
+               Results.acDropped[1],
+               Results.acDropped[2],
+               Results.cLate,
+               Results.cLate ? Ms(Results.rtTotalLate / Results.cLate) : 0.0,
+               Ms(Results.rtMaxLate),
+               Ms(Results.rtMaxFreeze));
+    }
+
+    delete [] aFrames;
+    return 0;
+}
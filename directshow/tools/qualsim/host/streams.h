@@ -0,0 +1,52 @@
+//------------------------------------------------------------------------------
+// File: Streams.h
+//
+// Desc: Stands in for the base classes' streams.h when the quality control
+//       simulators are built off Windows. It has just enough for the
+//       base class files they take their policies from, which only deal
+//       in times.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+#ifndef __QUALSIM_STREAMS__
+#define __QUALSIM_STREAMS__
+
+typedef int BOOL;
+typedef long LONG;
+typedef long long LONGLONG;
+typedef LONGLONG REFERENCE_TIME;
+
+#define TRUE    1
+#define FALSE   0
+#define UNITS   10000000
+
+#define __inout
+
+// as in the SDK's strmif.h and renbase.h
+enum QualityMessageType { Famine, Flood };
+
+struct Quality {
+    QualityMessageType Type;
+    long Proportion;
+    REFERENCE_TIME Late;
+    REFERENCE_TIME TimeStamp;
+};
+
+#define AVGPERIOD 4
+
+// the real one has the CRT headers in before windows.h defines these
+#include <math.h>
+
+#ifndef max
+#define max(a,b)    (((a) > (b)) ? (a) : (b))
+#endif
+#ifndef min
+#define min(a,b)    (((a) < (b)) ? (a) : (b))
+#endif
+
+#include <framedrop.h>
+#include <qualpol.h>
+
+#endif // __QUALSIM_STREAMS__
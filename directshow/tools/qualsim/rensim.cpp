@@ -0,0 +1,515 @@
+//------------------------------------------------------------------------------
+// File: RenSim.cpp
+//
+// Desc: Runs the video renderer quality control policies against made up
+//       streams, so they can be compared without a graph or a clock.
+//
+// Copyright (c) 1992-2001 Microsoft Corporation.  All rights reserved.
+//------------------------------------------------------------------------------
+
+
+/* Each scenario is a stream of frames of a fixed length with a decode and a
+   draw cost for each, from a scripted load and a random number generator
+   with a fixed seed, so every run gives the same answers. Every twelfth
+   frame is a sync point.
+
+   The renderer is modelled on CBaseVideoRenderer: its averages, earliness
+   and statistics are updated as ShouldDrawSampleNow, RecordFrameLateness
+   and OnRenderEnd update them, and each decision is the policy's, made from
+   the AM_VIDEO_QUALITY_STATE the renderer would have built. Receive holds
+   the supplier until a frame is drawn or dropped, so the supplier decodes
+   the next frame after that. In the scenarios where the supplier handles
+   Quality messages it skips a frame for each frame length of Late it is
+   told about, but never a sync point, and flags the next frame it sends as
+   a discontinuity.
+
+   For each policy the table shows the frames drawn, dropped by the renderer
+   and skipped by the supplier, the longest run of frames dropped in a row,
+   how late frames were drawn, the standard deviation of the time between
+   them (the jitter a viewer sees) and the Proportion and Late the supplier
+   was sent on average.
+
+   Off Windows build it with host/streams.h standing in for the real one:
+
+       g++ -Ihost -I../../baseclasses rensim.cpp \
+           ../../baseclasses/qualpol.cpp -o rensim
+
+   and run it as "rensim", or "rensim <scenario>" for just the one */
+
+
+#include <streams.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#define MSEC    10000       // REFERENCE_TIME units in a millisecond
+
+struct RANDOM {
+    unsigned int uSeed;
+};
+
+// the same numbers on every run and every compiler
+static int Random(RANDOM *pRandom, int nLow, int nHigh)
+{
+    pRandom->uSeed = pRandom->uSeed * 1103515245 + 12345;
+    return nLow + (int) ((pRandom->uSeed >> 16) % (unsigned int) (nHigh - nLow + 1));
+}
+
+typedef void (*LOADFN)(int iFrame, RANDOM *pRandom,
+                       REFERENCE_TIME *prtDecode, REFERENCE_TIME *prtDraw);
+
+struct SCENARIO {
+    const char *pszName;
+    int cFrames;
+    REFERENCE_TIME rtDuration;
+    BOOL bSupplierHandlesQuality;
+    LOADFN pfnLoad;
+};
+
+struct RESULTS {
+    int cDrawn;
+    int cDropped;                   // by the renderer
+    int cSkipped;                   // by the supplier
+    int cMaxRun;                    // most frames dropped or skipped in a row
+    REFERENCE_TIME rtTotalLate;     // of the frames drawn late
+    int cLate;
+    REFERENCE_TIME rtMaxLate;
+    double dJitter;                 // std deviation of the time between draws
+    int cQuality;                   // Quality messages sent
+    LONGLONG llTotalProportion;
+    REFERENCE_TIME rtTotalQualityLate;
+};
+
+
+// --- loads -----------------------
+
+// well within what the machine can do
+static void SteadyLoad(int /* iFrame */, RANDOM *pRandom,
+                       REFERENCE_TIME *prtDecode, REFERENCE_TIME *prtDraw)
+{
+    *prtDecode = Random(pRandom, 6, 10) * MSEC;
+    *prtDraw = Random(pRandom, 4, 8) * MSEC;
+}
+
+// drawing alone takes longer than a frame
+static void SlowDrawLoad(int /* iFrame */, RANDOM *pRandom,
+                         REFERENCE_TIME *prtDecode, REFERENCE_TIME *prtDraw)
+{
+    *prtDecode = Random(pRandom, 6, 10) * MSEC;
+    *prtDraw = Random(pRandom, 40, 50) * MSEC;
+}
+
+// steady, but every fiftieth frame takes a long time to decode
+static void GlitchLoad(int iFrame, RANDOM *pRandom,
+                       REFERENCE_TIME *prtDecode, REFERENCE_TIME *prtDraw)
+{
+    SteadyLoad(iFrame, pRandom, prtDecode, prtDraw);
+    if (iFrame % 50 == 49) {
+        *prtDecode = 150 * MSEC;
+    }
+}
+
+// something else takes the machine for a while, then lets it go
+static void BusyLoad(int iFrame, RANDOM *pRandom,
+                     REFERENCE_TIME *prtDecode, REFERENCE_TIME *prtDraw)
+{
+    if (iFrame >= 150 && iFrame < 450) {
+        *prtDecode = Random(pRandom, 20, 40) * MSEC;
+        *prtDraw = Random(pRandom, 10, 20) * MSEC;
+    } else {
+        SteadyLoad(iFrame, pRandom, prtDecode, prtDraw);
+    }
+}
+
+// costs all over the place, about the frame length on average
+static void NoisyLoad(int /* iFrame */, RANDOM *pRandom,
+                      REFERENCE_TIME *prtDecode, REFERENCE_TIME *prtDraw)
+{
+    *prtDecode = Random(pRandom, 5, 50) * MSEC;
+    *prtDraw = Random(pRandom, 2, 25) * MSEC;
+}
+
+static const SCENARIO g_aScenarios[] = {
+    { "steady",         600, 400000, FALSE, SteadyLoad },
+    { "slowdraw",       600, 400000, FALSE, SlowDrawLoad },
+    { "glitch",         600, 400000, FALSE, GlitchLoad },
+    { "busy",           600, 400000, FALSE, BusyLoad },
+    { "busy-supplier",  600, 400000, TRUE,  BusyLoad },
+    { "noisy",          600, 333333, FALSE, NoisyLoad },
+    { "noisy-supplier", 600, 333333, TRUE,  NoisyLoad },
+};
+
+
+// --- the renderer -----------------------
+
+//  Helper function for clamping time differences, as renbase.cpp's
+static int TimeDiff(REFERENCE_TIME rt)
+{
+    if (rt < - (50 * UNITS)) {
+        return -(50 * UNITS);
+    } else
+    if (rt > 50 * UNITS) {
+        return 50 * UNITS;
+    } else return (int)rt;
+}
+
+// the CBaseVideoRenderer members the policies are fed from
+
+struct RENDERER {
+    const CAMVideoQualityPolicy *pPolicy;
+    BOOL bSupplierHandlingQuality;
+    REFERENCE_TIME trLastDraw;
+    int trRenderAvg;
+    int trRenderLast;
+    int trFrameAvg;
+    int trDuration;
+    int trWaitAvg;
+    int trEarliness;
+    int nNormal;
+    int trLate;                     // as PreparePerformanceData leaves them
+    int trFrame;
+    int cFramesDrawn;
+    int cFramesDropped;
+    LONGLONG iTotAcc;
+    LONGLONG iSumFrameTime;
+    LONGLONG iSumSqFrameTime;
+};
+
+enum DECISION { DRAW_NOW, DRAW_WHEN_DUE, DROP };
+
+static void ResetStreamingTimes(RENDERER *pRen, const CAMVideoQualityPolicy *pPolicy,
+                                BOOL bSupplierHandlingQuality)
+{
+    memset(pRen, 0, sizeof(*pRen));
+    pRen->pPolicy = pPolicy;
+    pRen->bSupplierHandlingQuality = bSupplierHandlingQuality;
+    pRen->trLastDraw = -1000;
+    pRen->trFrameAvg = -1;
+}
+
+static int StdDev(int nSamples, LONGLONG llSumSq, LONGLONG iTot)
+{
+    if (nSamples<=1) {
+        return 0;
+    }
+    LONGLONG x = llSumSq - iTot * iTot / nSamples;
+    x = x / (nSamples-1);
+    return x > 0 ? (int) sqrt((double) x) : 0;
+}
+
+static void GetQualityState(const RENDERER *pRen, REFERENCE_TIME trLate,
+                            AM_VIDEO_QUALITY_STATE *pState)
+{
+    memset(pState, 0, sizeof(*pState));
+    pState->trLate = TimeDiff(trLate);
+    pState->trLateUncapped = trLate;
+    pState->bSupplierHandlingQuality = pRen->bSupplierHandlingQuality;
+    pState->trRenderAvg = pRen->trRenderAvg;
+    pState->trFrameAvg = pRen->trFrameAvg;
+    pState->trWaitAvg = pRen->trWaitAvg;
+    pState->cFramesDrawn = pRen->cFramesDrawn;
+    pState->cFramesDropped = pRen->cFramesDropped;
+    pState->iTotAcc = pRen->iTotAcc;
+    if (pRen->pPolicy->UsesJitter()) {
+        pState->iJitter = StdDev(pRen->cFramesDrawn - 2,
+                                 pRen->iSumSqFrameTime, pRen->iSumFrameTime);
+    }
+}
+
+static void RecordFrameLateness(RENDERER *pRen)
+{
+    int tLate = pRen->trLate/10000;
+    if (tLate>1000 || tLate<-1000) {
+        if (pRen->cFramesDrawn<=1) {
+            tLate = 0;
+        } else if (tLate>0) {
+            tLate = 1000;
+        } else {
+            tLate = -1000;
+        }
+    }
+    if (pRen->cFramesDrawn>1) {
+        pRen->iTotAcc += tLate;
+    }
+    if (pRen->cFramesDrawn>2) {
+        int tFrame = pRen->trFrame/10000;
+        if (tFrame>1000||tFrame<0) tFrame = 1000;
+        pRen->iSumSqFrameTime += tFrame*tFrame;
+        pRen->iSumFrameTime += tFrame;
+    }
+    ++pRen->cFramesDrawn;
+}
+
+// the draw time is measured with timeGetTime, so in whole milliseconds
+static void OnRenderEnd(RENDERER *pRen, REFERENCE_TIME rtDraw)
+{
+    const int tr = (int) (rtDraw / MSEC) * 10000;
+    if (tr < pRen->trRenderAvg*2 || tr < 2 * pRen->trRenderLast) {
+        const int nPeriod = pRen->pPolicy->AveragingPeriod();
+        pRen->trRenderAvg = (tr + (nPeriod-1)*pRen->trRenderAvg)/nPeriod;
+    }
+    pRen->trRenderLast = tr;
+}
+
+// ShouldDrawSampleNow and SendQuality, with trRealStream as the stream time
+// now. *ptrStart comes back as when a frame drawn when due would be drawn
+
+static DECISION ShouldDrawSampleNow(RENDERER *pRen, REFERENCE_TIME trRealStream,
+                                    REFERENCE_TIME *ptrStart, REFERENCE_TIME *ptrEnd,
+                                    BOOL bSyncPoint, BOOL bDiscontinuity,
+                                    Quality *pq)
+{
+    if (*ptrStart>=80000) {
+        *ptrStart -= 80000;
+        *ptrEnd -= 80000;
+    }
+    const REFERENCE_TIME trRememberStampForPerf = *ptrStart;
+
+    const int trTrueLate = TimeDiff(trRealStream - *ptrStart);
+    const int trLate = trTrueLate;
+
+    AM_VIDEO_QUALITY_STATE State;
+    GetQualityState(pRen, trRealStream - *ptrStart, &State);
+    pq->TimeStamp = trRealStream;
+    pRen->pPolicy->GetQuality(&State, pq);
+
+    const int trDuration = (int)(*ptrEnd - *ptrStart);
+    {
+        int t = pRen->trDuration/32;
+        if (  trDuration > pRen->trDuration+t
+           || trDuration < pRen->trDuration-t
+           ) {
+            pRen->trFrameAvg = trDuration;
+            pRen->trDuration = trDuration;
+        }
+    }
+
+    const BOOL bJustDroppedFrame
+        = (pRen->bSupplierHandlingQuality && bDiscontinuity)
+       || (pRen->nNormal==-1);
+
+    if (trLate>0) {
+        pRen->trEarliness = 0;
+    } else if (  (trLate>=pRen->trEarliness) || bJustDroppedFrame) {
+        pRen->trEarliness = trLate;
+    } else {
+        pRen->trEarliness = pRen->trEarliness - pRen->trEarliness/8;
+    }
+
+    const int nPeriod = pRen->pPolicy->AveragingPeriod();
+    int trWaitAvg;
+    {
+        int trL = trLate<0 ? -trLate : 0;
+        trWaitAvg = (trL + pRen->trWaitAvg*(nPeriod-1))/nPeriod;
+    }
+
+    int trFrame;
+    {
+        REFERENCE_TIME tr = trRealStream - pRen->trLastDraw;
+        if (tr>10000000) {
+            tr = 10000000;
+        }
+        trFrame = int(tr);
+    }
+
+    GetQualityState(pRen, trLate, &State);
+    State.trDuration = trDuration;
+    State.trSinceLastDraw = trRealStream - pRen->trLastDraw;
+    State.bSyncPoint = bSyncPoint;
+    State.bJustDroppedFrame = bJustDroppedFrame;
+
+    if (!pRen->pPolicy->ShouldDraw(&State)) {
+        pRen->trWaitAvg = trWaitAvg;
+        pRen->nNormal = -1;
+        ++pRen->cFramesDropped;
+        return DROP;
+    }
+
+    if (pRen->pPolicy->ShouldDrawAtOnce(&State)) {
+        pRen->nNormal = 0;
+        pRen->trWaitAvg = (pRen->trWaitAvg*(nPeriod-1))/nPeriod;
+        pRen->trFrameAvg = (trFrame + pRen->trFrameAvg*(nPeriod-1))/nPeriod;
+        pRen->trLate = trTrueLate;
+        pRen->trFrame = trFrame;
+        pRen->trLastDraw = trRealStream;
+        if (pRen->trEarliness > trLate) {
+            pRen->trEarliness = trLate;
+        }
+        return DRAW_NOW;
+    }
+
+    ++pRen->nNormal;
+    pRen->trFrameAvg = trDuration;
+    {
+        int trE = pRen->trEarliness;
+        if (trE < -pRen->trFrameAvg) {
+            trE = -pRen->trFrameAvg;
+        }
+        *ptrStart += trE;
+    }
+
+    const int Delay = -trTrueLate;
+    pRen->trWaitAvg = trWaitAvg;
+    if (Delay>0) {
+        trFrame = TimeDiff(*ptrStart-pRen->trLastDraw);
+        pRen->trLastDraw = *ptrStart;
+        pRen->trLate = TimeDiff(*ptrStart-trRememberStampForPerf);
+    } else {
+        pRen->trLastDraw = trRealStream;
+        pRen->trLate = trTrueLate;
+    }
+    pRen->trFrame = trFrame;
+    return Delay>0 ? DRAW_WHEN_DUE : DRAW_NOW;
+}
+
+
+// --- the simulation -----------------------
+
+static void Run(const SCENARIO *pScenario, const CAMVideoQualityPolicy *pPolicy,
+                RESULTS *pResults)
+{
+    RENDERER Ren;
+    ResetStreamingTimes(&Ren, pPolicy, pScenario->bSupplierHandlesQuality);
+    memset(pResults, 0, sizeof(*pResults));
+
+    RANDOM Rand = { 1 };
+    REFERENCE_TIME rtFree = 0;          // when Receive returns to the supplier
+    REFERENCE_TIME rtLastShown = 0;
+    BOOL bShown = FALSE;
+    double dSumInterval = 0;
+    double dSumSqInterval = 0;
+    int cIntervals = 0;
+    int cRun = 0;
+    int cToSkip = 0;
+    BOOL bDiscontinuity = FALSE;
+
+    for (int i = 0; i < pScenario->cFrames; i++) {
+
+        // draw the costs for every frame so each policy sees the same ones
+        REFERENCE_TIME rtDecode, rtDraw;
+        pScenario->pfnLoad(i, &Rand, &rtDecode, &rtDraw);
+
+        const BOOL bSyncPoint = (i % 12 == 0);
+        if (cToSkip > 0 && !bSyncPoint) {
+            --cToSkip;
+            pResults->cSkipped++;
+            pResults->cMaxRun = max(pResults->cMaxRun, ++cRun);
+            bDiscontinuity = TRUE;
+            continue;
+        }
+        cToSkip = 0;
+
+        const REFERENCE_TIME rtDue = i * pScenario->rtDuration;
+        REFERENCE_TIME trStart = rtDue;
+        REFERENCE_TIME trEnd = rtDue + pScenario->rtDuration;
+        const REFERENCE_TIME rtArrive = rtFree + rtDecode;
+
+        Quality q;
+        const DECISION Decision =
+            ShouldDrawSampleNow(&Ren, rtArrive, &trStart, &trEnd,
+                                bSyncPoint, bDiscontinuity, &q);
+        bDiscontinuity = FALSE;
+
+        pResults->cQuality++;
+        pResults->llTotalProportion += q.Proportion;
+        pResults->rtTotalQualityLate += q.Late;
+        if (pScenario->bSupplierHandlesQuality && q.Late > 0) {
+            cToSkip = (int) (q.Late / pScenario->rtDuration);
+        }
+
+        if (Decision == DROP) {
+            pResults->cDropped++;
+            pResults->cMaxRun = max(pResults->cMaxRun, ++cRun);
+            rtFree = rtArrive;
+            continue;
+        }
+        cRun = 0;
+
+        const REFERENCE_TIME rtShown =
+            Decision == DRAW_WHEN_DUE ? max(trStart, rtArrive) : rtArrive;
+        RecordFrameLateness(&Ren);
+        OnRenderEnd(&Ren, rtDraw);
+        rtFree = rtShown + rtDraw;
+        pResults->cDrawn++;
+
+        const REFERENCE_TIME rtLate = rtShown - rtDue;
+        if (rtLate > 0) {
+            pResults->cLate++;
+            pResults->rtTotalLate += rtLate;
+            pResults->rtMaxLate = max(pResults->rtMaxLate, rtLate);
+        }
+        if (bShown) {
+            const double dInterval = (double) (rtShown - rtLastShown) / MSEC;
+            dSumInterval += dInterval;
+            dSumSqInterval += dInterval * dInterval;
+            cIntervals++;
+        }
+        rtLastShown = rtShown;
+        bShown = TRUE;
+    }
+
+    if (cIntervals > 1) {
+        const double dVar = (dSumSqInterval - dSumInterval * dSumInterval / cIntervals)
+                            / (cIntervals - 1);
+        pResults->dJitter = dVar > 0 ? sqrt(dVar) : 0;
+    }
+}
+
+static double Ms(REFERENCE_TIME rt)
+{
+    return (double) rt / MSEC;
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct {
+        AM_VIDEO_QUALITY_POLICY Policy;
+        const char *pszName;
+    } aPolicies[] = {
+        { AM_QUALITY_DEFAULT,           "default" },
+        { AM_QUALITY_LOW_LATENCY,       "lowlatency" },
+        { AM_QUALITY_SMOOTH_CADENCE,    "smooth" },
+        { AM_QUALITY_KEY_FRAMES,        "keyframes" },
+    };
+    const int cPolicies = (int) (sizeof(aPolicies) / sizeof(aPolicies[0]));
+    const int cScenarios = (int) (sizeof(g_aScenarios) / sizeof(g_aScenarios[0]));
+
+    BOOL bFound = FALSE;
+    for (int s = 0; s < cScenarios; s++) {
+        const SCENARIO *pScenario = &g_aScenarios[s];
+        if (argc > 1 && strcmp(argv[1], pScenario->pszName) != 0) {
+            continue;
+        }
+        bFound = TRUE;
+
+        printf("%s: %d frames of %.2f ms%s\n\n", pScenario->pszName,
+               pScenario->cFrames, Ms(pScenario->rtDuration),
+               pScenario->bSupplierHandlesQuality ? ", supplier handles quality" : "");
+        printf("%-11s %6s %6s %6s %4s %6s %9s %9s %9s %6s %9s\n",
+               "policy", "drawn", "drop", "skip", "run", "late",
+               "mean ms", "max ms", "jitter ms", "prop", "q late ms");
+        for (int p = 0; p < cPolicies; p++) {
+            RESULTS Results;
+            Run(pScenario, CAMVideoQualityPolicy::Get(aPolicies[p].Policy), &Results);
+            printf("%-11s %6d %6d %6d %4d %6d %9.2f %9.2f %9.2f %6d %9.2f\n",
+                   aPolicies[p].pszName,
+                   Results.cDrawn,
+                   Results.cDropped,
+                   Results.cSkipped,
+                   Results.cMaxRun,
+                   Results.cLate,
+                   Results.cLate ? Ms(Results.rtTotalLate / Results.cLate) : 0.0,
+                   Ms(Results.rtMaxLate),
+                   Results.dJitter,
+                   Results.cQuality ? (int) (Results.llTotalProportion / Results.cQuality) : 0,
+                   Results.cQuality ? Ms(Results.rtTotalQualityLate / Results.cQuality) : 0.0);
+        }
+        printf("\n");
+    }
+
+    if (!bFound) {
+        fprintf(stderr, "rensim: no scenario called %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}